@@ -81,6 +81,13 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'oneshot': {'req_attr': ['name', 'time']},
                       'udata_regex': {'req_attr': ['instance', 'regex', 'base'],
                                       'opt_attr': ['incr']},
+                      'shm_set_add': {'req_attr': ['name'],
+                                      'opt_attr': ['producer']},
+                      'shm_set_del': {'req_attr': ['name']},
+                      'update_stats': {'opt_attr': ['type', 'regex', 'instance',
+                                                    'limit', 'cursor']},
+                      'update_stats_config': {'req_attr': ['state'],
+                                              'opt_attr': ['interval']},
                       'version': {'req_attr': [], 'opt_attr': []},
                       'loglevel': {'req_attr': ['level'],},
                       'include': {'req_attr': ['path'] },
@@ -99,13 +106,17 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'prdcr_start_regex': {'req_attr': ['regex'],
                                             'opt_attr': ['interval']},
                       'prdcr_stop_regex': {'req_attr': ['regex']},
-                      'prdcr_status': {'opt_attr': [], 'req_attr': ['name']},
-                      'prdcr_set_status': {'opt_attr': ['producer', 'instance', 'schema']},
+                      'prdcr_status': {'opt_attr': ['regex', 'limit', 'cursor'], 'req_attr': ['name']},
+                      'prdcr_set_status': {'opt_attr': ['producer', 'regex', 'instance',
+                                                        'schema', 'state', 'limit',
+                                                        'cursor', 'format']},
                       'prdcr_hint_tree': {'req_attr':['name'], 'opt_attr': []},
                       'prdcr_subscribe': {'req_attr':['regex', 'stream'], 'opt_attr': []},
+                      'prdcr_conn_config': {'req_attr': [], 'opt_attr': ['rate', 'backoff_max']},
                       ##### Updater Policy #####
                       'updtr_add': {'req_attr': ['name'],
-                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval']},
+                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval',
+                                                 'conditional']},
                       'updtr_del': {'req_attr': ['name']},
                       'updtr_match_add': {'req_attr': ['name', 'regex', 'match']},
                       'updtr_match_del': {'req_attr': ['name', 'regex', 'match']},
@@ -115,10 +126,14 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                                       'opt_attr': ['interval', 'offset', 'auto_interval']},
                       'updtr_stop': {'req_attr': ['name']},
                       'udptr_status': {'req_attr': [], 'opt_attr': ['name']},
-                      'updtr_task': {'req_attr': ['name'], 'opt_attr': []},
+                      'updtr_task': {'req_attr': ['name'],
+                                     'opt_attr': ['regex', 'limit', 'cursor']},
                       ##### Storage Policy #####
                       'strgp_add': {'req_attr': ['name', 'plugin', 'container',
-                                              'schema']},
+                                              'schema'],
+                                    'opt_attr': ['history', 'downsample',
+                                                 'downsample_op', 'deadband',
+                                                 'heartbeat']},
                       'strgp_del': {'req_attr': ['name']},
                       'strgp_prdcr_add': {'req_attr': ['name', 'regex']},
                       'strgp_prdcr_del': {'req_attr': ['name', 'regex']},
@@ -126,7 +141,11 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'strgp_metric_del': {'req_attr': ['name', 'metric']},
                       'strgp_start': {'req_attr': ['name']},
                       'strgp_stop': {'req_attr': ['name']},
-                      'strgp_status': {'req_attr': [], 'opt_attr': ['name']},
+                      'strgp_history': {'req_attr': ['name'],
+                                        'opt_attr': ['instance', 'metric',
+                                                     'begin', 'end']},
+                      'strgp_status': {'req_attr': [],
+                                       'opt_attr': ['name', 'regex', 'limit', 'cursor']},
                       ##### Plugin #####
                       'plugn_sets': {'req_attr': [], 'opt_attr': []},
                       ##### Streams ###
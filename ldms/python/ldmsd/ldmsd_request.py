@@ -101,7 +101,22 @@ class LDMSD_Req_Attr(object):
     UID = 32
     GID = 33
     STREAM = 34
-    LAST = 35
+    LIMIT = 35
+    CURSOR = 36
+    STATE = 37
+    FORMAT = 38
+    BINARY = 39
+    HISTORY = 40
+    BEGIN = 41
+    END = 42
+    RATE = 43
+    BACKOFF_MAX = 44
+    CONDITIONAL = 45
+    DOWNSAMPLE = 46
+    DOWNSAMPLE_OP = 47
+    DEADBAND = 48
+    HEARTBEAT = 49
+    LAST = 50
 
     NAME_ID_MAP = {'name': NAME,
                    'interval': INTERVAL,
@@ -138,6 +153,21 @@ class LDMSD_Req_Attr(object):
                    'uid': UID,
                    'gid': GID,
                    'stream': STREAM,
+                   'limit': LIMIT,
+                   'cursor': CURSOR,
+                   'state': STATE,
+                   'format': FORMAT,
+                   'binary': BINARY,
+                   'history': HISTORY,
+                   'begin': BEGIN,
+                   'end': END,
+                   'rate': RATE,
+                   'backoff_max': BACKOFF_MAX,
+                   'conditional': CONDITIONAL,
+                   'downsample': DOWNSAMPLE,
+                   'downsample_op': DOWNSAMPLE_OP,
+                   'deadband': DEADBAND,
+                   'heartbeat': HEARTBEAT,
                    'TERMINATING': LAST
         }
 
@@ -215,7 +245,7 @@ class LDMSD_Req_Attr(object):
             fmt = str(attr_len) + 's'
 
         (attr_value,) = struct.unpack(fmt, buf[cls.LDMSD_REQ_ATTR_SZ:attr_len + cls.LDMSD_REQ_ATTR_SZ])
-        if attr_id != cls.REC_LEN:
+        if attr_id != cls.REC_LEN and attr_id != cls.BINARY:
             attr_value = attr_value.strip('\0')
 
         attr = LDMSD_Req_Attr(value = attr_value, attr_id = attr_id, attr_len = attr_len)
@@ -238,6 +268,7 @@ class LDMSD_Request(object):
     PRDCR_SET_STATUS = 0x100 + 7
     PRDCR_HINT_TREE = 0x100 + 8
     PRDCR_SUBSCRIBE = 0x100 + 9
+    PRDCR_CONN_CONFIG = 0x100 + 10
 
     STRGP_ADD = 0x200
     STRGP_DEL = 0x200 + 1
@@ -248,6 +279,7 @@ class LDMSD_Request(object):
     STRGP_PRDCR_DEL = 0X200 + 6
     STRGP_METRIC_ADD = 0X200 + 7
     STRGP_METRIC_DEL = 0X200 + 8
+    STRGP_HISTORY = 0x200 + 9
 
     UPDTR_ADD = 0X300
     UPDTR_DEL = 0X300 + 1
@@ -287,6 +319,10 @@ class LDMSD_Request(object):
     LOGROTATE = 0x600 + 8
     EXIT_DAEMON = 0x600 + 9
     SET_ROUTE = 0X600 + 11
+    SHM_SET_ADD = 0x600 + 12
+    SHM_SET_DEL = 0x600 + 13
+    UPDATE_STATS = 0x600 + 14
+    UPDATE_STATS_CONFIG = 0x600 + 15
 
     FAILOVER_CONFIG        = 0x700
     FAILOVER_PEERCFG_START = 0x700  +  1
@@ -322,12 +358,14 @@ class LDMSD_Request(object):
             'prdcr_set_status': {'id': PRDCR_SET_STATUS},
             'prdcr_hint_tree': {'id': PRDCR_HINT_TREE},
             'prdcr_subscribe': {'id': PRDCR_SUBSCRIBE},
+            'prdcr_conn_config': {'id': PRDCR_CONN_CONFIG},
 
             'strgp_add': {'id': STRGP_ADD},
             'strgp_del': {'id': STRGP_DEL},
             'strgp_start': {'id': STRGP_START},
             'strgp_stop': {'id': STRGP_STOP},
             'strgp_status': {'id': STRGP_STATUS},
+            'strgp_history': {'id': STRGP_HISTORY},
             'strgp_prdcr_add': {'id': STRGP_PRDCR_ADD},
             'strgp_prdcr_del': {'id': STRGP_PRDCR_DEL},
             'strgp_metric_add': {'id': STRGP_METRIC_ADD},
@@ -371,6 +409,10 @@ class LDMSD_Request(object):
             'failover_start'         : {'id' : FAILOVER_START},
             'failover_stop'          : {'id' : FAILOVER_STOP},
             'set_route': {'id': SET_ROUTE},
+            'shm_set_add': {'id': SHM_SET_ADD},
+            'shm_set_del': {'id': SHM_SET_DEL},
+            'update_stats': {'id': UPDATE_STATS},
+            'update_stats_config': {'id': UPDATE_STATS_CONFIG},
 
             'setgroup_add'  :  {'id':  SETGROUP_ADD},
             'setgroup_mod'  :  {'id':  SETGROUP_MOD},
@@ -529,12 +571,19 @@ class LDMSD_Request(object):
                 offset += attr.LDMSD_REQ_ATTR_SZ + attr.attr_len
 
         msg = None
-        if len(attr_list) == 1:
-            if (attr_list[0].attr_id == LDMSD_Req_Attr.STRING) or (attr_list[0].attr_id == LDMSD_Req_Attr.JSON):
+        cursor = None
+        if len(attr_list) > 0:
+            if attr_list[0].attr_id in (LDMSD_Req_Attr.STRING,
+                                        LDMSD_Req_Attr.JSON,
+                                        LDMSD_Req_Attr.BINARY):
                 msg = attr_list[0].attr_value
-        elif len(attr_list) == 0:
+            # A paged status reply ends with the cursor of the next page
+            if attr_list[-1].attr_id == LDMSD_Req_Attr.CURSOR:
+                cursor = attr_list[-1].attr_value
+        else:
             attr_list = None
-        return {'errcode': errcode, 'msg': msg, 'attr_list': attr_list}
+        return {'errcode': errcode, 'msg': msg, 'attr_list': attr_list,
+                'cursor': cursor}
 
     def is_error_resp(self, json_obj_resp):
         if json_obj_resp == 0:
@@ -679,3 +728,89 @@ if __name__ == "__main__":
             sys.exit(2)
         else:
             print(e)
+
+PRDCR_SET_STATE_STR = ['START', 'LOOKUP', 'READY', 'UPDATING']
+
+def prdcr_set_status_unpack(buf):
+    """Decode a format=binary prdcr_set_status reply
+
+    Return a list of dictionaries with the same keys as the JSON reply.
+    """
+    hdr_fmt = '!LLLLLL'
+    hdr_sz = struct.calcsize(hdr_fmt)
+    sets = []
+    off = 0
+    while off + hdr_sz <= len(buf):
+        (rec_len, state, ts_sec, ts_usec, dur_sec, dur_usec) = \
+                struct.unpack(hdr_fmt, buf[off:off + hdr_sz])
+        if rec_len < hdr_sz:
+            raise ValueError("Invalid prdcr_set_status record")
+        names = buf[off + hdr_sz:off + rec_len].split('\0')
+        if state < len(PRDCR_SET_STATE_STR):
+            state_str = PRDCR_SET_STATE_STR[state]
+        else:
+            state_str = 'BAD STATE'
+        sets.append({'inst_name': names[0],
+                     'schema_name': names[1],
+                     'state': state_str,
+                     'origin': names[2],
+                     'producer': names[3],
+                     'timestamp.sec': str(ts_sec),
+                     'timestamp.usec': str(ts_usec),
+                     'duration.sec': str(dur_sec),
+                     'duration.usec': str(dur_usec)})
+        off += rec_len
+    return sets
+
+LDMSD_HISTORY_MAGIC = 0x4c485354
+LDMSD_HISTORY_VERSION = 1
+# enum ldms_value_type
+LDMS_V_S8 = 3
+LDMS_V_S16 = 5
+LDMS_V_S32 = 7
+LDMS_V_S64 = 9
+LDMS_V_F32 = 10
+LDMS_V_D64 = 11
+
+def strgp_history_unpack(buf):
+    """Decode a strgp_history reply
+
+    Return a tuple of the metric names and a dictionary mapping each set
+    instance name to its list of rows. A row is a list holding the
+    timestamp in seconds followed by the metric values.
+    """
+    def get_str(off):
+        (slen,) = struct.unpack('!L', buf[off:off + 4])
+        return (buf[off + 4:off + 4 + slen - 1], off + 4 + slen)
+
+    (magic, version, mcount, scount) = struct.unpack('!LLLL', buf[:16])
+    if magic != LDMSD_HISTORY_MAGIC or version != LDMSD_HISTORY_VERSION:
+        raise ValueError("Invalid strgp_history reply")
+    off = 16
+    types = []
+    names = []
+    for i in range(mcount):
+        (t,) = struct.unpack('!L', buf[off:off + 4])
+        (name, off) = get_str(off + 4)
+        types.append(t)
+        names.append(name)
+    series = {}
+    for i in range(scount):
+        (inst, off) = get_str(off)
+        (rows,) = struct.unpack('!L', buf[off:off + 4])
+        off += 4
+        ts = struct.unpack('!%dQ' % rows, buf[off:off + 8 * rows])
+        off += 8 * rows
+        cols = []
+        for t in types:
+            if t in (LDMS_V_F32, LDMS_V_D64):
+                fmt = '!%dd' % rows
+            elif t in (LDMS_V_S8, LDMS_V_S16, LDMS_V_S32, LDMS_V_S64):
+                fmt = '!%dq' % rows
+            else:
+                fmt = '!%dQ' % rows
+            cols.append(struct.unpack(fmt, buf[off:off + 8 * rows]))
+            off += 8 * rows
+        series[inst] = [[ts[j] / 1e6] + [c[j] for c in cols]
+                        for j in range(rows)]
+    return (names, series)
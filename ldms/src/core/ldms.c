@@ -208,6 +208,15 @@ uint64_t ldms_set_data_gn_get(ldms_set_t s)
 	return __le64_to_cpu(s->set->data->gn);
 }
 
+uint64_t ldms_set_info_gn_get(ldms_set_t s)
+{
+	uint64_t gn;
+	pthread_mutex_lock(&s->set->lock);
+	gn = s->set->info_gn;
+	pthread_mutex_unlock(&s->set->lock);
+	return gn;
+}
+
 struct cb_arg {
 	void *user_arg;
 	int (*user_cb)(struct ldms_set *, void *);
@@ -325,6 +334,7 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 		       "\"data_gn\":%lld,"
 		       "\"timestamp\":{\"sec\":%d,\"usec\":%d},"
 		       "\"duration\":{\"sec\":%d,\"usec\":%d},"
+		       "\"info_gn\":%lld,"
 		       "\"info\":[",
 		       need_comma ? ',' : ' ',
 		       get_instance_name(set->meta)->name,
@@ -340,13 +350,15 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 		       __le64_to_cpu(set->meta->meta_gn),
 		       __le64_to_cpu(set->data->gn),
 		       __le32_to_cpu(set->data->trans.ts.sec), __le32_to_cpu(set->data->trans.ts.usec),
-		       __le32_to_cpu(set->data->trans.dur.sec), __le32_to_cpu(set->data->trans.dur.usec)
+		       __le32_to_cpu(set->data->trans.dur.sec), __le32_to_cpu(set->data->trans.dur.usec),
+		       set->info_gn
 		       );
 	if (cnt >= buf_size)
 		goto out;
-	struct ldms_set_info_pair *info, *linfo;
+	ldms_name_t key;
 	int comma = 0;
-	LIST_FOREACH(info, &set->local_info, entry) {
+	for (key = __ldms_set_info_first(&set->local_info); key;
+	     key = __ldms_set_info_next(key)) {
 		if (comma)
 			cnt += snprintf(&buf[cnt], buf_size - cnt, ",");
 		else
@@ -355,14 +367,14 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 			goto out;
 		cnt += snprintf(&buf[cnt], buf_size - cnt,
 				"{\"key\":\"%s\",\"value\":\"%s\"}",
-				info->key, info->value);
+				key->name, __ldms_set_info_value(key)->name);
 		if (cnt >= buf_size)
 			goto out;
 	}
-	LIST_FOREACH(info, &set->remote_info, entry) {
+	for (key = __ldms_set_info_first(&set->remote_info); key;
+	     key = __ldms_set_info_next(key)) {
 		/* Print remote info that is not overriden by local info */
-		linfo = __ldms_set_info_find(&set->local_info, info->key);
-		if (linfo)
+		if (__ldms_set_info_find(&set->local_info, key->name))
 			continue;
 		if (comma)
 			cnt += snprintf(&buf[cnt], buf_size - cnt, ",");
@@ -372,7 +384,7 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 			goto out;
 		cnt += snprintf(&buf[cnt], buf_size - cnt,
 				"{\"key\":\"%s\",\"value\":\"%s\"}",
-				info->key, info->value);
+				key->name, __ldms_set_info_value(key)->name);
 		if (cnt >= buf_size)
 			goto out;
 	}
@@ -449,8 +461,6 @@ __record_set(const char *instance_name,
 		goto out;
 	}
 
-	LIST_INIT(&set->local_info);
-	LIST_INIT(&set->remote_info);
 	LIST_INIT(&set->remote_rbd_list);
 	LIST_INIT(&set->local_rbd_list);
 	pthread_mutex_init(&set->lock, NULL);
@@ -616,16 +626,113 @@ int ldms_xprt_update(ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	return 0;
 }
 
-void __ldms_set_info_delete(struct ldms_set_info_list *info)
+int ldms_xprt_update_cond(ldms_set_t s, uint64_t gn,
+			  ldms_update_cb_t cb, void *arg)
+{
+	if (!cb)
+		return EINVAL;
+	if (s->set->flags & LDMS_SET_F_REMOTE)
+		return __ldms_remote_update_cond(s->xprt, s, gn, cb, arg);
+	cb(s->xprt, s, 0, arg);
+	return 0;
+}
+
+struct ldms_update_batch {
+	ldms_update_batch_cb_t cb;
+	void *arg;
+	int count;
+	int remaining;
+	ldms_set_t *sets;
+	int *status;
+	struct ldms_update_batch **ent;	/* one per set, for the index */
+};
+
+static void __update_batch_put(struct ldms_update_batch *b)
+{
+	if (__sync_sub_and_fetch(&b->remaining, 1))
+		return;
+	b->cb(b->sets, b->status, b->count, b->arg);
+	free(b);
+}
+
+static void __update_batch_cb(ldms_t x, ldms_set_t s, int status, void *arg)
 {
-	struct ldms_set_info_pair *pair;
-	while (!LIST_EMPTY(info)) {
-		pair = LIST_FIRST(info);
-		LIST_REMOVE(pair, entry);
-		free(pair->key);
-		free(pair->value);
-		free(pair);
+	struct ldms_update_batch **ent = arg;
+	struct ldms_update_batch *b = *ent;
+
+	if (status & LDMS_UPD_F_MORE)
+		return;
+	b->status[ent - b->ent] = status;
+	__update_batch_put(b);
+}
+
+int ldms_xprt_update_batch(ldms_set_t *sets, const uint64_t *gn, int count,
+			   ldms_update_batch_cb_t cb, void *arg)
+{
+	struct ldms_update_batch *b;
+	ldms_set_t s;
+	int i, rc;
+
+	if (!cb || count <= 0)
+		return EINVAL;
+	b = calloc(1, sizeof(*b) + count * (sizeof(*b->sets) +
+					    sizeof(*b->ent) +
+					    sizeof(*b->status)));
+	if (!b)
+		return ENOMEM;
+	b->cb = cb;
+	b->arg = arg;
+	b->count = count;
+	b->sets = (void *)&b[1];
+	b->ent = (void *)&b->sets[count];
+	b->status = (void *)&b->ent[count];
+	/* The extra reference keeps the batch until all reads are issued */
+	b->remaining = count + 1;
+	memcpy(b->sets, sets, count * sizeof(*sets));
+	for (i = 0; i < count; i++) {
+		s = sets[i];
+		b->ent[i] = b;
+		if (!(s->set->flags & LDMS_SET_F_REMOTE)) {
+			__update_batch_put(b);
+			continue;
+		}
+		if (gn && gn[i])
+			rc = __ldms_remote_update_cond(s->xprt, s, gn[i],
+						       __update_batch_cb,
+						       &b->ent[i]);
+		else
+			rc = __ldms_remote_update(s->xprt, s,
+						  __update_batch_cb,
+						  &b->ent[i]);
+		if (rc) {
+			b->status[i] = LDMS_UPD_ERROR(rc);
+			__update_batch_put(b);
+		}
 	}
+	__update_batch_put(b);
+	return 0;
+}
+
+void __ldms_set_info_delete(struct ldms_set_info *info)
+{
+	free(info->blob);
+	free(info->idx);
+	memset(info, 0, sizeof(*info));
+}
+
+static void __set_free(struct ldms_set *set)
+{
+	if (set->flags & LDMS_SET_F_MEMMAP)
+		munmap(set->meta, set->mmap_sz ? set->mmap_sz
+						: __ldms_set_size_get(set));
+	else
+		mm_free(set->meta);
+	if (set->slot_mem)
+		mm_free(set->slot_mem);
+	free(set->slot);
+	__ldms_set_info_delete(&set->local_info);
+	__ldms_set_info_delete(&set->remote_info);
+	free(set);
 }
 
 void ldms_set_delete(ldms_set_t s)
@@ -663,10 +770,222 @@ void ldms_set_delete(ldms_set_t s)
 		__ldms_free_rbd(rbd);
 	}
 
-	mm_free(set->meta);
-	__ldms_set_info_delete(&set->local_info);
-	__ldms_set_info_delete(&set->remote_info);
-	free(set);
+	pthread_mutex_lock(&set->lock);
+	if (set->snap_count) {
+		/* freed by the last ldms_set_snapshot_put() */
+		set->flags |= LDMS_SET_F_DELETED;
+		pthread_mutex_unlock(&set->lock);
+		return;
+	}
+	pthread_mutex_unlock(&set->lock);
+	__set_free(set);
+}
+
+int __ldms_set_slot_default = 0;
+
+int ldms_set_snapshot_slots(int slots)
+{
+	if (slots < 0)
+		return EINVAL;
+	__ldms_set_slot_default = slots;
+	return 0;
+}
+
+/* The set is not yet visible to the transports. */
+int __ldms_set_slots_init(struct ldms_set *set, int slot_card)
+{
+	uint32_t data_sz = __le32_to_cpu(set->meta->data_sz);
+	int i;
+
+	if (slot_card < 2 || __le32_to_cpu(set->meta->array_card) != 1)
+		return 0;
+	set->slot = calloc(slot_card, sizeof(*set->slot));
+	if (!set->slot)
+		return ENOMEM;
+	set->slot_mem = mm_alloc((slot_card - 1) * data_sz);
+	if (!set->slot_mem) {
+		free(set->slot);
+		set->slot = NULL;
+		return ENOMEM;
+	}
+	set->slot[0].data = set->data_array;
+	for (i = 1; i < slot_card; i++) {
+		set->slot[i].data = set->slot_mem + (i - 1) * data_sz;
+		memcpy(set->slot[i].data, set->data_array, data_sz);
+	}
+	set->slot_curr = 0;
+	set->slot_card = slot_card;
+	return 0;
+}
+
+/*
+ * Reserve a slot to read the next update into. If \c slot is not
+ * negative, only that slot is considered. Returns the slot or -1 if
+ * all of them are in use. Slot 0 is tried last, as the snapshots of
+ * it are copies.
+ */
+int __ldms_set_slot_acquire(struct ldms_set *set, int slot)
+{
+	int i, j, rc = -1;
+
+	pthread_mutex_lock(&set->lock);
+	for (j = 1; j <= set->slot_card; j++) {
+		i = j % set->slot_card;
+		if (slot >= 0 && i != slot)
+			continue;
+		if (i == set->slot_curr || set->slot[i].ref)
+			continue;
+		set->slot[i].ref++;
+		rc = i;
+		break;
+	}
+	pthread_mutex_unlock(&set->lock);
+	return rc;
+}
+
+void __ldms_set_slot_release(struct ldms_set *set, int slot)
+{
+	pthread_mutex_lock(&set->lock);
+	set->slot[slot].ref--;
+	pthread_mutex_unlock(&set->lock);
+}
+
+/* The read into \c slot has completed, make it the current data. */
+void __ldms_set_slot_commit(struct ldms_set *set, int slot)
+{
+	pthread_mutex_lock(&set->lock);
+	set->slot[slot].ref--;
+	set->slot_curr = slot;
+	set->data = set->slot[slot].data;
+	pthread_mutex_unlock(&set->lock);
+}
+
+/*
+ * Pushed data is written in place, i.e. into slot 0, which is
+ * therefore never held by a snapshot.
+ */
+void __ldms_set_slot_reset(struct ldms_set *set)
+{
+	pthread_mutex_lock(&set->lock);
+	set->slot_curr = 0;
+	set->data = set->slot[0].data;
+	pthread_mutex_unlock(&set->lock);
+}
+
+struct ldms_set_snapshot {
+	struct ldms_rbuf_desc rbd;
+	struct ldms_set set;	/* a view of `src` with the pinned data */
+	struct ldms_set *src;
+	int slot;
+	void *data_copy;	/* private data of ldms_set_snapshot_copy() */
+};
+
+ldms_set_t ldms_set_snapshot_get(ldms_set_t s)
+{
+	struct ldms_set *set = s->set;
+	struct ldms_set_snapshot *snap;
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+	pthread_mutex_lock(&set->lock);
+	if (!set->slot_card || !set->slot_curr) {
+		/*
+		 * The data is written in place by the pushes (slot 0) or
+		 * by every update (no slots), it cannot be held.
+		 */
+		pthread_mutex_unlock(&set->lock);
+		free(snap);
+		return ldms_set_snapshot_copy(s);
+	}
+	LIST_INIT(&snap->set.local_rbd_list);
+	LIST_INIT(&snap->set.remote_rbd_list);
+	pthread_mutex_init(&snap->set.lock, NULL);
+	snap->rbd.set = &snap->set;
+	snap->rbd.type = LDMS_RBD_LOCAL;
+	snap->src = set;
+	snap->set.set_id = set->set_id;
+	snap->set.flags = set->flags & ~LDMS_SET_F_PUBLISHED;
+	snap->set.meta = set->meta;
+	snap->set.data = set->data;
+	snap->slot = set->slot_curr;
+	set->slot[snap->slot].ref++;
+	snap->set.data_array = set->data;
+	snap->set.curr_idx = 0;
+	set->snap_count++;
+	pthread_mutex_unlock(&set->lock);
+	return &snap->rbd;
+}
+
+void ldms_set_snapshot_put(ldms_set_t s)
+{
+	struct ldms_set_snapshot *snap;
+	struct ldms_set *set;
+	int do_free;
+
+	if (!s)
+		return;
+	snap = container_of(s, struct ldms_set_snapshot, rbd);
+	set = snap->src;
+	pthread_mutex_lock(&set->lock);
+	if (snap->slot >= 0)
+		set->slot[snap->slot].ref--;
+	set->snap_count--;
+	do_free = !set->snap_count && (set->flags & LDMS_SET_F_DELETED);
+	pthread_mutex_unlock(&set->lock);
+	if (do_free)
+		__set_free(set);
+	pthread_mutex_destroy(&snap->set.lock);
+	free(snap->data_copy);
+	free(snap);
+}
+
+ldms_set_t ldms_set_snapshot_copy(ldms_set_t s)
+{
+	struct ldms_set *set = s->set;
+	struct ldms_set_snapshot *snap;
+	size_t data_sz = __le32_to_cpu(set->meta->data_sz);
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+	snap->data_copy = malloc(data_sz);
+	if (!snap->data_copy) {
+		free(snap);
+		return NULL;
+	}
+	LIST_INIT(&snap->set.local_rbd_list);
+	LIST_INIT(&snap->set.remote_rbd_list);
+	pthread_mutex_init(&snap->set.lock, NULL);
+	snap->rbd.set = &snap->set;
+	snap->rbd.type = LDMS_RBD_LOCAL;
+	snap->src = set;
+	snap->slot = -1;
+
+	pthread_mutex_lock(&set->lock);
+	snap->set.set_id = set->set_id;
+	snap->set.flags = set->flags & ~LDMS_SET_F_PUBLISHED;
+	snap->set.meta = set->meta;
+	memcpy(snap->data_copy, set->data, data_sz);
+	set->snap_count++;
+	pthread_mutex_unlock(&set->lock);
+	snap->set.data = snap->data_copy;
+	snap->set.data_array = snap->data_copy;
+	snap->set.curr_idx = 0;
+	/* the copy is a single buffer, never inside a transaction */
+	snap->set.data->trans.flags = LDMS_TRANSACTION_END;
+	return &snap->rbd;
+}
+
+void ldms_set_snapshot_timestamp_set(ldms_set_t s, struct ldms_timestamp ts,
+				     struct ldms_timestamp dur)
+{
+	struct ldms_data_hdr *dh = s->set->data;
+
+	dh->trans.ts.sec = __cpu_to_le32(ts.sec);
+	dh->trans.ts.usec = __cpu_to_le32(ts.usec);
+	dh->trans.dur.sec = __cpu_to_le32(dur.sec);
+	dh->trans.dur.usec = __cpu_to_le32(dur.usec);
 }
 
 void ldms_set_put(ldms_set_t s)
@@ -948,48 +1267,33 @@ void __ldms_metric_size_get(const char *name, enum ldms_value_type t,
 	*data_sz = __ldms_value_size_get(t, count);
 }
 
-ldms_set_t ldms_set_new_with_auth(const char *instance_name,
-				  ldms_schema_t schema,
-				  uid_t uid, gid_t gid, mode_t perm)
+/* Size of the metadata of a set of \c schema named \c instance_name */
+static size_t __set_meta_sz(const char *instance_name, ldms_schema_t schema)
+{
+	size_t meta_sz;
+	meta_sz = schema->meta_sz /* header + metric dict */
+		+ strlen(schema->name) + 2 /* schema name + '\0' + len */
+		+ strlen(instance_name) + 2; /* instance name + '\0' + len */
+	return roundup(meta_sz, 8);
+}
+
+/*
+ * Lay out a set of \c schema at \c meta. The memory must hold
+ * meta_sz + set_array_card * schema->data_sz bytes.
+ */
+static void __set_init(struct ldms_set_hdr *meta, size_t meta_sz,
+		       int set_array_card, const char *instance_name,
+		       ldms_schema_t schema, uid_t uid, gid_t gid, mode_t perm)
 {
 	struct ldms_data_hdr *data, *data_base;
-	struct ldms_set_hdr *meta;
 	struct ldms_value_desc *vd;
-	size_t meta_sz, array_data_sz;
 	uint64_t value_off;
 	ldms_mdef_t md;
 	int metric_idx;
 	int i;
-	int set_array_card;
-
-	if (!instance_name || !schema) {
-		errno = EINVAL;
-		return NULL;
-	}
-
-	set_array_card = schema->array_card;
-
-	if (set_array_card < 0) {
-		errno = EINVAL;
-		return NULL;
-	}
 
-	if (!set_array_card) {
-		set_array_card = 1;
-	}
-
-	meta_sz = schema->meta_sz /* header + metric dict */
-		+ strlen(schema->name) + 2 /* schema name + '\0' + len */
-		+ strlen(instance_name) + 2; /* instance name + '\0' + len */
-	meta_sz = roundup(meta_sz, 8);
 	assert(schema->data_sz == roundup(schema->data_sz, 8));
-	array_data_sz = schema->data_sz * set_array_card;
-	meta = mm_alloc(meta_sz + array_data_sz);
-	if (!meta) {
-		errno = ENOMEM;
-		return NULL;
-	}
-	memset(meta, 0, meta_sz + array_data_sz);
+	memset(meta, 0, meta_sz + schema->data_sz * set_array_card);
 	LDMS_VERSION_SET(meta->version);
 	meta->card = __cpu_to_le32(schema->card);
 	meta->meta_sz = __cpu_to_le32(meta_sz);
@@ -1070,6 +1374,43 @@ ldms_set_t ldms_set_new_with_auth(const char *instance_name,
 		value_off += __ldms_value_size_get(vd->vd_type,
 						   __le32_to_cpu(vd->vd_array_count));
 	}
+}
+
+ldms_set_t ldms_set_new_with_auth(const char *instance_name,
+				  ldms_schema_t schema,
+				  uid_t uid, gid_t gid, mode_t perm)
+{
+	struct ldms_data_hdr *data_base;
+	struct ldms_set_hdr *meta;
+	size_t meta_sz, array_data_sz;
+	int set_array_card;
+
+	if (!instance_name || !schema) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	set_array_card = schema->array_card;
+
+	if (set_array_card < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!set_array_card) {
+		set_array_card = 1;
+	}
+
+	meta_sz = __set_meta_sz(instance_name, schema);
+	array_data_sz = schema->data_sz * set_array_card;
+	meta = mm_alloc(meta_sz + array_data_sz);
+	if (!meta) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	__set_init(meta, meta_sz, set_array_card, instance_name, schema,
+		   uid, gid, perm);
+	data_base = (void*)meta + meta_sz;
 	__ldms_set_tree_lock();
 	struct ldms_set *set = __record_set(instance_name, meta, data_base, LDMS_SET_F_LOCAL);
 	if (!set)
@@ -1119,6 +1460,11 @@ uint32_t ldms_set_card_get(ldms_set_t s)
 	return __le32_to_cpu(s->set->meta->card);
 }
 
+uint32_t ldms_set_array_card_get(ldms_set_t s)
+{
+	return __le32_to_cpu(s->set->meta->array_card);
+}
+
 uint32_t ldms_set_uid_get(ldms_set_t s)
 {
 	return __le32_to_cpu(s->set->meta->uid);
@@ -1144,6 +1490,25 @@ extern uint32_t ldms_set_data_sz_get(ldms_set_t s)
 	return __le32_to_cpu(s->set->meta->data_sz);
 }
 
+const void *ldms_set_data_values_get(ldms_set_t s, size_t *len)
+{
+	size_t off = roundup(sizeof(struct ldms_data_hdr), 8);
+	*len = __le32_to_cpu(s->set->meta->data_sz) - off;
+	return (const char *)s->set->data + off;
+}
+
+const void *ldms_set_meta_block_get(ldms_set_t s, size_t *len)
+{
+	*len = __le32_to_cpu(s->set->meta->meta_sz);
+	return s->set->meta;
+}
+
+const void *ldms_set_data_block_get(ldms_set_t s, size_t *len)
+{
+	*len = __le32_to_cpu(s->set->meta->data_sz);
+	return s->set->data;
+}
+
 int ldms_mmap_set(void *meta_addr, void *data_addr, ldms_set_t *ps)
 {
 	struct ldms_set_hdr *sh = meta_addr;
@@ -1173,6 +1538,248 @@ int ldms_mmap_set(void *meta_addr, void *data_addr, ldms_set_t *ps)
 	return errno;
 }
 
+ldms_set_t ldms_shm_set_new(const char *shm_name, const char *instance_name,
+			   ldms_schema_t schema,
+			   uid_t uid, gid_t gid, mode_t perm)
+{
+	struct ldms_set_hdr *meta;
+	struct ldms_set *set;
+	ldms_set_t rbd;
+	size_t meta_sz, set_sz;
+	int set_array_card;
+	int fd, rc;
+
+	if (!shm_name || !instance_name || !schema || schema->array_card < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	/*
+	 * With at least two buffers the writer never modifies the buffer
+	 * of the last completed transaction.
+	 */
+	set_array_card = schema->array_card;
+	if (set_array_card < 2)
+		set_array_card = 2;
+	/* The data must start on a page, see ldms_shm_set_open() */
+	meta_sz = roundup(__set_meta_sz(instance_name, schema),
+			  sysconf(_SC_PAGESIZE));
+	set_sz = meta_sz + schema->data_sz * set_array_card;
+
+	/* The publishing ldmsd must be able to open the object read-write */
+	fd = shm_open(shm_name, O_CREAT|O_EXCL|O_RDWR, 0600 | (perm & 0060));
+	if (fd < 0)
+		return NULL;
+	/* ldms_shm_set_open() takes the set owner from the object */
+	if (fchown(fd, uid, gid) || ftruncate(fd, set_sz)) {
+		rc = errno;
+		goto err_0;
+	}
+	meta = mmap(NULL, set_sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (meta == MAP_FAILED) {
+		rc = errno;
+		goto err_0;
+	}
+	close(fd);
+	__set_init(meta, meta_sz, set_array_card, instance_name, schema,
+		   uid, gid, perm);
+
+	__ldms_set_tree_lock();
+	set = __record_set(instance_name, meta, (void*)meta + meta_sz,
+			   LDMS_SET_F_MEMMAP | LDMS_SET_F_LOCAL);
+	if (!set) {
+		rc = errno;
+		goto err_1;
+	}
+	set->mmap_sz = set_sz;
+	rbd = __ldms_alloc_rbd(NULL, set, LDMS_RBD_LOCAL);
+	if (!rbd) {
+		rc = ENOMEM;
+		goto err_2;
+	}
+	__ldms_set_tree_unlock();
+	return rbd;
+ err_2:
+	rbt_del(&set_tree, &set->rb_node);
+	rbt_del(&id_tree, &set->id_node);
+	free(set);
+ err_1:
+	__ldms_set_tree_unlock();
+	munmap(meta, set_sz);
+	shm_unlink(shm_name);
+	errno = rc;
+	return NULL;
+ err_0:
+	close(fd);
+	shm_unlink(shm_name);
+	errno = rc;
+	return NULL;
+}
+
+/*
+ * Check that the names, the dictionary and every value descriptor of
+ * \c meta lie within the metadata, and that every value lies within
+ * the metadata or a data buffer.
+ */
+static int __set_meta_check(struct ldms_set_hdr *meta)
+{
+	struct ldms_value_desc *vd;
+	ldms_name_t name;
+	uint32_t meta_sz, data_sz, card, i;
+	uint64_t end, off, sz;
+
+	meta_sz = __le32_to_cpu(meta->meta_sz);
+	data_sz = __le32_to_cpu(meta->data_sz);
+	card = __le32_to_cpu(meta->card);
+	if (meta_sz < sizeof(*meta) || data_sz < sizeof(struct ldms_data_hdr))
+		return EINVAL;
+
+	/* The dictionary is followed by the instance and schema names */
+	end = (uint64_t)((char *)meta->dict - (char *)meta)
+		+ (uint64_t)card * sizeof(meta->dict[0]);
+	if (end + sizeof(*name) > meta_sz)
+		return EINVAL;
+	name = get_instance_name(meta);
+	end += sizeof(*name) + name->len;
+	if (!name->len || end + sizeof(*name) > meta_sz ||
+	    name->name[name->len - 1] != '\0')
+		return EINVAL;
+	name = get_schema_name(meta);
+	end += sizeof(*name) + name->len;
+	if (!name->len || end > meta_sz || name->name[name->len - 1] != '\0')
+		return EINVAL;
+
+	for (i = 0; i < card; i++) {
+		off = __le32_to_cpu(meta->dict[i]);
+		if (off < end || off + sizeof(*vd) > meta_sz)
+			return EINVAL;
+		vd = ldms_ptr_(struct ldms_value_desc, meta, off);
+		if (!vd->vd_name_len ||
+		    off + sizeof(*vd) + vd->vd_name_len > meta_sz ||
+		    vd->vd_name[vd->vd_name_len - 1] != '\0')
+			return EINVAL;
+		if (vd->vd_type <= LDMS_V_NONE || vd->vd_type > LDMS_V_D64_ARRAY)
+			return EINVAL;
+		if (!ldms_type_is_array(vd->vd_type) &&
+		    __le32_to_cpu(vd->vd_array_count) != 1)
+			return EINVAL;
+		sz = __ldms_value_size_get(vd->vd_type,
+					   __le32_to_cpu(vd->vd_array_count));
+		off = __le32_to_cpu(vd->vd_data_offset);
+		if (vd->vd_flags & LDMS_MDESC_F_DATA) {
+			if (off < sizeof(struct ldms_data_hdr) ||
+			    off + sz > data_sz)
+				return EINVAL;
+		} else if (off < end || off + sz > meta_sz) {
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+int ldms_shm_set_open(const char *shm_name, ldms_set_t *ps, struct stat *pst)
+{
+	struct ldms_set_hdr hdr, *meta;
+	struct ldms_data_hdr *dh;
+	struct ldms_set *set;
+	ldms_set_t rbd;
+	struct stat st;
+	uint32_t meta_sz, data_sz, array_card, idx;
+	void *data;
+	int fd, rc;
+
+	fd = shm_open(shm_name, O_RDWR, 0);
+	if (fd < 0)
+		return errno;
+	if (fstat(fd, &st)) {
+		rc = errno;
+		goto err_0;
+	}
+	rc = EINVAL;
+	if (st.st_size < sizeof(hdr) ||
+	    pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto err_0;
+	meta_sz = __le32_to_cpu(hdr.meta_sz);
+	if (meta_sz < sizeof(hdr) || meta_sz >= st.st_size ||
+	    meta_sz % sysconf(_SC_PAGESIZE))
+		goto err_0;
+
+	/*
+	 * Only the data buffers are shared with the writer. The metadata
+	 * is copied, so the names, the dictionary and the sizes checked
+	 * below cannot change once the set is open. The copy and the
+	 * mapping of the data are contiguous, as in any other set.
+	 */
+	meta = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (meta == MAP_FAILED) {
+		rc = errno;
+		goto err_0;
+	}
+	if (pread(fd, meta, meta_sz, 0) != meta_sz)
+		goto err_1;
+	data = mmap((void *)meta + meta_sz, st.st_size - meta_sz,
+		    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, meta_sz);
+	if (data == MAP_FAILED) {
+		rc = errno;
+		goto err_1;
+	}
+	close(fd);
+	fd = -1;
+
+	/* Validate what the other process wrote before trusting offsets */
+	data_sz = __le32_to_cpu(meta->data_sz);
+	array_card = __le32_to_cpu(meta->array_card);
+	if (!LDMS_VERSION_EQUAL(meta->version) || !array_card ||
+	    __le32_to_cpu(meta->meta_sz) != meta_sz ||
+	    (uint64_t)meta_sz + (uint64_t)data_sz * array_card != st.st_size ||
+	    __set_meta_check(meta))
+		goto err_1;
+	/* The object owner vouches for the set owner */
+	if (__le32_to_cpu(meta->uid) != st.st_uid ||
+	    __le32_to_cpu(meta->gid) != st.st_gid) {
+		rc = EPERM;
+		goto err_1;
+	}
+
+	__ldms_set_tree_lock();
+	set = __record_set(get_instance_name(meta)->name, meta, data,
+			   LDMS_SET_F_MEMMAP | LDMS_SET_F_LOCAL);
+	if (!set) {
+		rc = errno;
+		goto err_2;
+	}
+	set->mmap_sz = st.st_size;
+	/* Continue from the writer's current buffer */
+	dh = set->data_array;
+	idx = __le32_to_cpu(dh->curr_idx);
+	if (idx < array_card) {
+		set->curr_idx = idx;
+		set->data = __set_array_get(set, idx);
+	}
+	rbd = __ldms_alloc_rbd(NULL, set, LDMS_RBD_LOCAL);
+	if (!rbd) {
+		rc = ENOMEM;
+		goto err_3;
+	}
+	__ldms_set_tree_unlock();
+	if (pst)
+		*pst = st;
+	*ps = rbd;
+	return 0;
+ err_3:
+	rbt_del(&set_tree, &set->rb_node);
+	rbt_del(&id_tree, &set->id_node);
+	free(set);
+ err_2:
+	__ldms_set_tree_unlock();
+ err_1:
+	munmap(meta, st.st_size);
+ err_0:
+	if (fd >= 0)
+		close(fd);
+	return rc;
+}
+
 static char *type_names[] = {
 	[LDMS_V_NONE] = "none",
 	[LDMS_V_CHAR] = "char",
@@ -2209,6 +2816,11 @@ int ldms_transaction_begin(ldms_set_t s)
 		dh->curr_idx = __cpu_to_le32(s->set->curr_idx);
 	}
 	s->set->data = __ldms_set_array_get(s, s->set->curr_idx);
+	/*
+	 * Readers in other processes must see the buffer marked as
+	 * in-progress before any of its metrics change.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 	pthread_mutex_unlock(&s->set->lock);
 	return 0;
 }
@@ -2231,7 +2843,9 @@ int ldms_transaction_end(ldms_set_t s)
 	dh->trans.dur.usec = __cpu_to_le32(dh->trans.dur.usec);
 	dh->trans.ts.sec = __cpu_to_le32(tv.tv_sec);
 	dh->trans.ts.usec = __cpu_to_le32(tv.tv_usec);
-	dh->trans.flags = LDMS_TRANSACTION_END;
+	/* ... and the metrics before the buffer is marked complete */
+	__atomic_store_n(&dh->trans.flags, LDMS_TRANSACTION_END,
+			 __ATOMIC_RELEASE);
 	pthread_mutex_unlock(&s->set->lock);
 	__ldms_xprt_push(s, LDMS_RBD_F_PUSH_CHANGE);
 	return 0;
@@ -2301,48 +2915,270 @@ void ldms_local_cred_get(ldms_t x, ldms_cred_t lcl)
 	ldms_auth_cred_get(x->auth, lcl);
 }
 
+#define SET_INFO_IDX_MIN 16
+#define SET_INFO_REC_SZ(klen, vlen) (2 * sizeof(struct ldms_name) + (klen) + (vlen))
+/* ldms_name.len is 8 bits and includes the terminating '\0' */
+#define SET_INFO_LEN_MAX UINT8_MAX
+
+static uint32_t __set_info_hash(const char *key)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261U;
+	while (*key) {
+		h ^= (unsigned char)*key++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * The index slot holding \c key, or the empty slot \c key would take.
+ * The index must not be empty.
+ */
+static uint32_t *__set_info_slot(struct ldms_set_info *info, const char *key)
+{
+	uint32_t mask = info->idx_card - 1;
+	uint32_t i = __set_info_hash(key) & mask;
+	ldms_name_t k;
+
+	while (info->idx[i]) {
+		k = (ldms_name_t)&info->blob[info->idx[i] - 1];
+		if (0 == strcmp(k->name, key))
+			break;
+		i = (i + 1) & mask;
+	}
+	return &info->idx[i];
+}
+
+/* Rebuild the index from the records in the blob */
+static void __set_info_index(struct ldms_set_info *info)
+{
+	ldms_name_t key;
+
+	memset(info->idx, 0, info->idx_card * sizeof(*info->idx));
+	info->count = 0;
+	for (key = __ldms_set_info_first(info); key;
+	     key = __ldms_set_info_next(key)) {
+		*__set_info_slot(info, key->name) = (char *)key - info->blob + 1;
+		info->count++;
+	}
+}
+
+/* Rebuild the index with \c card slots */
+static int __set_info_reindex(struct ldms_set_info *info, uint32_t card)
+{
+	uint32_t *idx;
+
+	idx = malloc(card * sizeof(*idx));
+	if (!idx)
+		return ENOMEM;
+	free(info->idx);
+	info->idx = idx;
+	info->idx_card = card;
+	__set_info_index(info);
+	return 0;
+}
+
+/* Make room for \c len more bytes of records and the terminator */
+static int __set_info_reserve(struct ldms_set_info *info, size_t len)
+{
+	size_t sz = info->len + len + sizeof(struct ldms_name);
+	char *blob;
+
+	if (sz <= info->sz)
+		return 0;
+	if (sz < 2 * info->sz)
+		sz = 2 * info->sz;
+	blob = realloc(info->blob, sz);
+	if (!blob)
+		return ENOMEM;
+	info->blob = blob;
+	info->sz = sz;
+	return 0;
+}
+
+static void __set_info_terminate(struct ldms_set_info *info)
+{
+	((ldms_name_t)&info->blob[info->len])->len = 0;
+}
+
+/* Remove the pair indexed by \c slot */
+static void __set_info_remove(struct ldms_set_info *info, uint32_t *slot)
+{
+	uint32_t mask = info->idx_card - 1;
+	uint32_t i = slot - info->idx;
+	uint32_t j = i, h;
+	uint32_t off = *slot;
+	ldms_name_t key = (ldms_name_t)&info->blob[off - 1];
+	ldms_name_t value = __ldms_set_info_value(key);
+	char *end = &value->name[value->len];
+	size_t rec_len = end - (char *)key;
+
+	/* backward shift deletion keeps the probe sequences intact */
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!info->idx[j])
+			break;
+		h = __set_info_hash(info->blob + info->idx[j] - 1 +
+				    sizeof(struct ldms_name)) & mask;
+		if ((i <= j) ? (i < h && h <= j) : (i < h || h <= j))
+			continue;
+		info->idx[i] = info->idx[j];
+		i = j;
+	}
+	info->idx[i] = 0;
+
+	memmove(key, end, info->len - (end - info->blob));
+	info->len -= rec_len;
+	__set_info_terminate(info);
+	info->count--;
+	/* the records behind it moved */
+	for (i = 0; i < info->idx_card; i++) {
+		if (info->idx[i] > off)
+			info->idx[i] -= rec_len;
+	}
+}
+
 /* The caller must hold the set lock */
 /*
  * return 0 if there are changes. Otherwise, -1 is returned.
  *        errno is returned on error.
  */
-int __ldms_set_info_set(struct ldms_set_info_list *info,
+int __ldms_set_info_set(struct ldms_set_info *info,
 			const char *key, const char *value)
 {
-	struct ldms_set_info_pair *pair;
-
-	LIST_FOREACH(pair, info, entry) {
-		if (0 == strcmp(key, pair->key)) {
-			if (0 != strcmp(value, pair->value)) {
-				/* reset value */
-				free(pair->value);
-				goto set_value;
-			} else {
-				/* no changes */
-				return -1;
+	size_t klen = strlen(key) + 1;
+	size_t vlen = strlen(value) + 1;
+	ldms_name_t k, v;
+	uint32_t *slot;
+	size_t off;
+	int rc;
+
+	if (klen > SET_INFO_LEN_MAX || vlen > SET_INFO_LEN_MAX)
+		return E2BIG;
+	if (info->idx_card) {
+		slot = __set_info_slot(info, key);
+		if (*slot) {
+			k = (ldms_name_t)&info->blob[*slot - 1];
+			v = __ldms_set_info_value(k);
+			if (v->len == vlen) {
+				if (0 == memcmp(v->name, value, vlen))
+					return -1; /* no changes */
+				/* same size, overwrite in place */
+				memcpy(v->name, value, vlen);
+				return 0;
 			}
 		}
 	}
-	/* new key-value pair */
-	pair = malloc(sizeof(*pair));
-	if (!pair)
-		return ENOMEM;
+	rc = __set_info_reserve(info, SET_INFO_REC_SZ(klen, vlen));
+	if (rc)
+		return rc;
+	if ((info->count + 1) * 2 > info->idx_card) {
+		rc = __set_info_reindex(info, info->idx_card ?
+					2 * info->idx_card : SET_INFO_IDX_MIN);
+		if (rc)
+			return rc;
+	}
+	slot = __set_info_slot(info, key);
+	if (*slot) {
+		/* the value size changed; re-append the pair */
+		__set_info_remove(info, slot);
+		slot = __set_info_slot(info, key);
+	}
+	off = info->len;
+	k = (ldms_name_t)&info->blob[off];
+	k->len = klen;
+	memcpy(k->name, key, klen);
+	v = __ldms_set_info_value(k);
+	v->len = vlen;
+	memcpy(v->name, value, vlen);
+	info->len += SET_INFO_REC_SZ(klen, vlen);
+	__set_info_terminate(info);
+	*slot = off + 1;
+	info->count++;
+	return 0;
+}
 
-	pair->key = strdup(key);
-	if (!pair->key) {
-		free(pair);
-		return ENOMEM;
+/* The caller must hold the set lock. */
+const char *__ldms_set_info_find(struct ldms_set_info *info, const char *key)
+{
+	uint32_t *slot;
+	if (!info->idx_card)
+		return NULL;
+	slot = __set_info_slot(info, key);
+	if (!*slot)
+		return NULL;
+	return __ldms_set_info_value((ldms_name_t)&info->blob[*slot - 1])->name;
+}
+
+/* The caller must hold the set lock. */
+int __ldms_set_info_unset(struct ldms_set_info *info, const char *key)
+{
+	uint32_t *slot;
+	if (!info->idx_card)
+		return ENOENT;
+	slot = __set_info_slot(info, key);
+	if (!*slot)
+		return ENOENT;
+	__set_info_remove(info, slot);
+	return 0;
+}
+
+/*
+ * The length of the key/value records in \c blob, a zero length
+ * terminated sequence of ldms_name records, without the terminator.
+ */
+size_t __ldms_set_info_blob_len(const char *blob)
+{
+	ldms_name_t key = (ldms_name_t)blob;
+	ldms_name_t value;
+
+	while (key->len) {
+		value = __ldms_set_info_value(key);
+		key = (ldms_name_t)&value->name[value->len];
 	}
-	LIST_INSERT_HEAD(info, pair, entry);
+	return (char *)key - blob;
+}
 
-set_value:
-	pair->value = strdup(value);
-	if (!pair->value) {
-		LIST_REMOVE(pair, entry);
-		free(pair->key);
-		free(pair);
-		return ENOMEM;
+/*
+ * Replace the content of \c info with the records in \c blob, as received
+ * from the peer. Both are laid out the same way, so an unchanged set info
+ * is detected by comparing the bytes. A NULL \c blob is empty.
+ *
+ * The caller must hold the set lock.
+ *
+ * return 0 if there are changes. Otherwise, -1 is returned.
+ *        errno is returned on error.
+ */
+int __ldms_set_info_apply(struct ldms_set_info *info, const char *blob)
+{
+	struct ldms_set_info new_info = {0};
+	size_t len = blob ? __ldms_set_info_blob_len(blob) : 0;
+	uint32_t card = SET_INFO_IDX_MIN;
+	ldms_name_t key;
+	int count = 0;
+	int rc;
+
+	if (len == info->len && (!len || 0 == memcmp(blob, info->blob, len)))
+		return -1; /* no changes */
+	rc = __set_info_reserve(&new_info, len);
+	if (rc)
+		return rc;
+	memcpy(new_info.blob, blob, len);
+	new_info.len = len;
+	__set_info_terminate(&new_info);
+	for (key = __ldms_set_info_first(&new_info); key;
+	     key = __ldms_set_info_next(key))
+		count++;
+	while (card < 2 * count)
+		card <<= 1;
+	rc = __set_info_reindex(&new_info, card);
+	if (rc) {
+		__ldms_set_info_delete(&new_info);
+		return rc;
 	}
+	__ldms_set_info_delete(info);
+	*info = new_info;
 	return 0;
 }
 
@@ -2355,6 +3191,9 @@ int ldms_set_info_set(ldms_set_t s, const char *key, const char *value)
 	if (!value)
 		return EINVAL;
 
+	if (strlen(key) >= SET_INFO_LEN_MAX || strlen(value) >= SET_INFO_LEN_MAX)
+		return E2BIG;
+
 	pthread_mutex_lock(&s->set->lock);
 	rc = __ldms_set_info_set(&s->set->local_info, key, value);
 	if (rc > 0) {
@@ -2366,6 +3205,7 @@ int ldms_set_info_set(ldms_set_t s, const char *key, const char *value)
 		rc = 0;
 		goto out;
 	}
+	s->set->info_gn++;
 	if (s->set->flags & LDMS_SET_F_PUBLISHED)
 		__ldms_dir_upd_set(s->set);
 out:
@@ -2373,35 +3213,14 @@ out:
 	return rc;
 }
 
-/* The caller must hold the set lock. */
-struct ldms_set_info_pair *__ldms_set_info_find(struct ldms_set_info_list *info,
-								const char *key)
-{
-	struct ldms_set_info_pair *pair;
-	LIST_FOREACH(pair, info, entry)
-		if (0 == strcmp(key, pair->key))
-			return pair;
-	return NULL;
-}
-
-void __ldms_set_info_unset(struct ldms_set_info_pair *pair)
-{
-	LIST_REMOVE(pair, entry);
-	free(pair->key);
-	free(pair->value);
-	free(pair);
-}
-
 void ldms_set_info_unset(ldms_set_t s, const char *key)
 {
-	struct ldms_set_info_pair *pair;
 	pthread_mutex_lock(&s->set->lock);
-	pair = __ldms_set_info_find(&s->set->local_info, key);
-	if (!pair) {
+	if (__ldms_set_info_unset(&s->set->local_info, key)) {
 		pthread_mutex_unlock(&s->set->lock);
 		return;
 	}
-	__ldms_set_info_unset(pair);
+	s->set->info_gn++;
 	if (s->set->flags & LDMS_SET_F_PUBLISHED)
 		__ldms_dir_upd_set(s->set);
 	pthread_mutex_unlock(&s->set->lock);
@@ -2409,23 +3228,17 @@ void ldms_set_info_unset(ldms_set_t s, const char *key)
 
 char *ldms_set_info_get(ldms_set_t s, const char *key)
 {
-	struct ldms_set_info_pair *pair;
-	char *value = NULL;
+	const char *value;
+	char *copy = NULL;
 
 	pthread_mutex_lock(&s->set->lock);
-	pair = __ldms_set_info_find(&s->set->local_info, key);
-	if (pair) {
-		value = strdup(pair->value);
-		goto out;
-	}
-
-	pair = __ldms_set_info_find(&s->set->remote_info, key);
-	if (!pair)
-		goto out;
-	value = strdup(pair->value);
-out:
+	value = __ldms_set_info_find(&s->set->local_info, key);
+	if (!value)
+		value = __ldms_set_info_find(&s->set->remote_info, key);
+	if (value)
+		copy = strdup(value);
 	pthread_mutex_unlock(&s->set->lock);
-	return value;
+	return copy;
 }
 
 char *ldms_dir_set_info_get(ldms_dir_set_t dset, const char *key)
@@ -2441,21 +3254,22 @@ char *ldms_dir_set_info_get(ldms_dir_set_t dset, const char *key)
 int ldms_set_info_traverse(ldms_set_t s, ldms_set_info_traverse_cb_fn cb,
 							int flag, void *cb_arg)
 {
-	struct ldms_set_info_pair *pair;
-	struct ldms_set_info_list *list;
+	struct ldms_set_info *info;
+	ldms_name_t key;
 	int rc = 0;
 	pthread_mutex_lock(&s->set->lock);
 	if (flag == LDMS_SET_INFO_F_LOCAL) {
-		list = &s->set->local_info;
+		info = &s->set->local_info;
 	} else if (flag == LDMS_SET_INFO_F_REMOTE) {
-		list = &s->set->remote_info;
+		info = &s->set->remote_info;
 	} else {
 		rc = EINVAL;
 		goto out;
 	}
 
-	LIST_FOREACH(pair, list, entry) {
-		rc = cb(pair->key, pair->value, cb_arg);
+	for (key = __ldms_set_info_first(info); key;
+	     key = __ldms_set_info_next(key)) {
+		rc = cb(key->name, __ldms_set_info_value(key)->name, cb_arg);
 		if (rc)
 			goto out;
 	}
@@ -52,6 +52,7 @@
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/queue.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <netinet/in.h>
 #include <byteswap.h>
@@ -303,6 +304,7 @@ typedef void (*ldms_lookup_cb_t)(ldms_t t, enum ldms_lookup_status status,
 #define LDMS_SET_F_REMOTE	0x0008
 #define LDMS_SET_F_PUSH_CHANGE	0x0010
 #define LDMS_SET_F_PUBLISHED	0x100000 /* Set is in the set tree. */
+#define LDMS_SET_F_DELETED	0x200000 /* Deleted, snapshots outstanding. */
 #define LDMS_SET_ID_DATA	0x1000000
 
 /**
@@ -544,6 +546,25 @@ extern int ldms_xprt_send(ldms_t x, char *msg_buf, size_t msg_len);
  */
 size_t ldms_xprt_msg_max(ldms_t x);
 
+/**
+ * \brief Coalesce the directory updates sent to the peers
+ *
+ * The directory updates (set publish, delete and info change) for a peer
+ * are held for up to \c window_us after the first one and sent together
+ * in one message. The message is sent early when it is full, when it
+ * holds \c max_sets sets, or when an update of another type follows. A
+ * \c window_us of 0 sends each update right away.
+ *
+ * The initial values are taken from the LDMS_DIR_UPDATE_WINDOW
+ * (microseconds) and LDMS_DIR_UPDATE_MAX environment variables; both
+ * default to 0.
+ *
+ * \param window_us The time in microseconds to hold the updates
+ * \param max_sets  The maximum number of sets in a message, 0 is no limit
+ * \retval 0 on success, or an errno
+ */
+int ldms_dir_update_coalesce(uint64_t window_us, int max_sets);
+
 /** \} */
 
 /**
@@ -769,6 +790,8 @@ extern int ldms_xprt_lookup(ldms_t t, const char *name, enum ldms_lookup_flags f
 #define LDMS_UPD_F_PUSH_LAST	0x20000000
 /** Indicate more outstanding update completion on the set */
 #define LDMS_UPD_F_MORE		0x40000000
+/** The set has not changed; only the data header was read */
+#define LDMS_UPD_F_NOT_MODIFIED	0x08000000
 
 #define LDMS_UPD_ERROR_MASK 0x00FFFFFF
 
@@ -801,6 +824,66 @@ typedef void (*ldms_update_cb_t)(ldms_t t, ldms_set_t s, int flags, void *arg);
  */
 extern int ldms_xprt_update(ldms_set_t s, ldms_update_cb_t update_cb, void *arg);
 
+/**
+ * \brief Update the set only if its data has changed
+ *
+ * Read the data header of the remote set first. If its data generation
+ * number is \c gn and neither the metadata nor the current set buffer
+ * have changed, \c update_cb is called with LDMS_UPD_F_NOT_MODIFIED and
+ * the data is not transferred. Otherwise the update proceeds as in
+ * ldms_xprt_update() and \c update_cb is called the same way.
+ *
+ * This saves the data transfer when the set is updated more often than
+ * it is sampled, at the cost of one more round trip when it has
+ * changed. On a local set it is the same as ldms_xprt_update().
+ *
+ * \param s	    The metric set handle
+ * \param gn	    The data generation number of the last update seen
+ * \param update_cb The function to call when the update completes
+ * \param arg	    The argument passed to \c update_cb
+ * \retval 0 on success, or an errno
+ */
+extern int ldms_xprt_update_cond(ldms_set_t s, uint64_t gn,
+				 ldms_update_cb_t update_cb, void *arg);
+
+/**
+ * \brief Prototype for the function called when a batch update completes.
+ *
+ * \param sets	 The sets given to ldms_xprt_update_batch(), in order
+ * \param status The completion status of each set, as the \c flags
+ *		 of ::ldms_update_cb_t
+ * \param count	 The number of sets
+ * \param arg	 The argument given to ldms_xprt_update_batch()
+ */
+typedef void (*ldms_update_batch_cb_t)(ldms_set_t *sets, int *status,
+				       int count, void *arg);
+
+/**
+ * \brief Update many sets with one completion
+ *
+ * The reads of all \c sets are posted back to back without waiting
+ * for each other, and \c update_cb is called once after the last of
+ * them has completed. The sets may come from different transports.
+ *
+ * If \c gn is not NULL, the sets with a non-zero \c gn[i] are updated
+ * as in ldms_xprt_update_cond(). A set whose update cannot be started
+ * has the error in its \c status entry; the batch itself still
+ * completes. The intermediate LDMS_UPD_F_MORE completions of a set
+ * with more than one set buffer are not reported, only its latest
+ * buffer is available when \c update_cb is called. Such sets should be
+ * updated with ldms_xprt_update() if every buffer is needed.
+ *
+ * \param sets	    The set handles
+ * \param gn	    NULL or the data generation numbers last seen
+ * \param count	    The number of sets
+ * \param update_cb The function to call when all updates complete
+ * \param arg	    The argument passed to \c update_cb
+ * \retval 0 on success, or an errno if the batch was not started
+ */
+extern int ldms_xprt_update_batch(ldms_set_t *sets, const uint64_t *gn,
+				  int count, ldms_update_batch_cb_t update_cb,
+				  void *arg);
+
 #define LDMS_XPRT_PUSH_F_CHANGE	1
 /**
  * \brief Register a remote set for push notifications
@@ -1063,6 +1146,69 @@ extern int ldms_set_producer_name_set(ldms_set_t s, const char *name);
  */
 extern int ldms_mmap_set(void *meta_addr, void *data_addr, ldms_set_t *s);
 
+/**
+ * \brief Create a metric set in a named shared memory object
+ *
+ * This lets a process that does not run \c ldmsd write metrics that an
+ * \c ldmsd publishes without copying them. The set is created in the
+ * POSIX shared memory object \c shm_name (see shm_open(3)), which must
+ * not exist. The caller updates it with the ldms_metric_set_*()
+ * functions between ldms_transaction_begin() and
+ * ldms_transaction_end() as usual, and the \c ldmsd attaches to it
+ * with the \c shm_set_add configuration command. The caller need not
+ * call ldms_init().
+ *
+ * The set has at least two buffers (see
+ * ldms_schema_array_card_set()), so the buffer of the last completed
+ * transaction is not modified while the next one is in progress.
+ *
+ * The object is created with mode 0600, plus the group bits of \c perm,
+ * and is owned by \c uid and \c gid, so the caller must be allowed to
+ * chown(2) it to them. The \c ldmsd must run as the same user, a member
+ * of the group, or root. The \c ldmsd copies the metadata when it
+ * attaches, so set the meta-metrics before that. Remove the object
+ * with shm_unlink(3) when it is no longer needed.
+ *
+ * \param shm_name	The shared memory object name, e.g. "/myapp.metrics"
+ * \param instance_name	The set instance name
+ * \param schema	The schema of the set
+ * \param uid		The set owner
+ * \param gid		The set group
+ * \param perm		The set permissions
+ * \returns		The set handle, or NULL with errno set.
+ */
+extern ldms_set_t ldms_shm_set_new(const char *shm_name,
+				   const char *instance_name,
+				   ldms_schema_t schema,
+				   uid_t uid, gid_t gid, mode_t perm);
+
+/**
+ * \brief Attach to a metric set created by ldms_shm_set_new()
+ *
+ * The set is validated and added to the local sets but it is not
+ * published; call ldms_set_publish() to make it visible to peers.
+ * The set owner and group recorded by the writer must match those of
+ * the shared memory object.
+ *
+ * Only the metric values remain shared with the writer. The metadata,
+ * i.e. the names, the metric dictionary and the meta-metrics, is
+ * copied and validated when the set is opened, so later changes to it
+ * by the writer are not seen. ldms_set_delete() unmaps the memory but
+ * leaves the shared memory object in place.
+ *
+ * \param shm_name	The shared memory object name
+ * \param s		Pointer to memory to receive handle.
+ * \param st		If not NULL, receives the fstat(2) of the object,
+ *			e.g. to check the access of the requester.
+ * \returns 0		Success
+ * \returns EINVAL	The object does not contain a valid metric set.
+ * \returns EPERM	The set owner or group is not that of the object.
+ * \returns EEXIST	A set with the same instance name exists.
+ * \returns errno	Any error from shm_open(3) or mmap(2).
+ */
+extern int ldms_shm_set_open(const char *shm_name, ldms_set_t *s,
+			     struct stat *st);
+
 /**
  * \brief Get the number of metrics in the set.
  *
@@ -1071,6 +1217,14 @@ extern int ldms_mmap_set(void *meta_addr, void *data_addr, ldms_set_t *s);
  */
 extern uint32_t ldms_set_card_get(ldms_set_t s);
 
+/**
+ * \brief Get the number of set buffers of the set.
+ *
+ * \param s	The ldms_set_t handle.
+ * \return The number of set buffers (see ldms_schema_array_card_set())
+ */
+extern uint32_t ldms_set_array_card_get(ldms_set_t s);
+
 /**
  * \brief Retreive the UID of the LDMS set.
  * \param s The set handle.
@@ -1106,6 +1260,44 @@ extern uint32_t ldms_set_meta_sz_get(ldms_set_t s);
  */
 extern uint32_t ldms_set_data_sz_get(ldms_set_t s);
 
+/**
+ * \brief Get the values of the data metrics of a set
+ *
+ * The values of the data metrics are contiguous in the current data
+ * buffer, in the order of the metrics, in the set byte order. Comparing
+ * them with a copy taken earlier tells whether any data metric changed.
+ *
+ * \param s	The ldms_set_t handle.
+ * \param len	Set to the size of the values in bytes.
+ * \return The address of the first value.
+ */
+extern const void *ldms_set_data_values_get(ldms_set_t s, size_t *len);
+
+/**
+ * \brief Get the meta data block of a set
+ *
+ * The block is the set header, the dictionary and the metric
+ * descriptors, in the set byte order. A copy of it and of a data block
+ * (ldms_set_data_block_get()) is enough to rebuild the set with
+ * ldms_mmap_set().
+ *
+ * \param s	The ldms_set_t handle.
+ * \param len	Set to the size of the block in bytes.
+ * \return The address of the meta data block.
+ */
+extern const void *ldms_set_meta_block_get(ldms_set_t s, size_t *len);
+
+/**
+ * \brief Get the current data block of a set
+ *
+ * The block is the data header followed by the metric values.
+ *
+ * \param s	The ldms_set_t handle.
+ * \param len	Set to the size of the block in bytes.
+ * \return The address of the current data block.
+ */
+extern const void *ldms_set_data_block_get(ldms_set_t s, size_t *len);
+
 /**
  * \brief Get a set by name.
  *
@@ -1138,6 +1330,18 @@ uint64_t ldms_set_meta_gn_get(ldms_set_t s);
  * \returns	The 64bit data generation number.
  */
 uint64_t ldms_set_data_gn_get(ldms_set_t s);
+
+/**
+ * \brief Get the set information generation number.
+ *
+ * The number changes whenever a key of the set information is set,
+ * changed or unset, locally or, on a remote set, by the peer. It is
+ * local to the process and is not comparable across processes.
+ *
+ * \param s	The ldms_set_t handle.
+ * \returns	The 64bit set information generation number.
+ */
+uint64_t ldms_set_info_gn_get(ldms_set_t s);
 /** \} */
 
 /**
@@ -1223,6 +1427,75 @@ extern double ldms_difftimestamp(const struct ldms_timestamp *after, const struc
  */
 extern int ldms_set_is_consistent(ldms_set_t s);
 
+/**
+ * \brief Set the number of local data slots of the looked up sets
+ *
+ * A set looked up after this call keeps \c slots copies of its data.
+ * An update is read into a copy that is neither current nor held by a
+ * snapshot, and becomes the current data when the read completes, so
+ * the data held by ldms_set_snapshot_get() is not changed by the
+ * updates. A value less than 2 disables the slots. Sets with more
+ * than one set buffer (see ldms_schema_array_card_set()) are not
+ * slotted. Pushed updates are written in place, into the first slot.
+ *
+ * The initial value is taken from the LDMS_SET_SNAPSHOT_SLOTS
+ * environment variable, 0 by default.
+ *
+ * \param slots The number of data slots
+ * \retval 0 on success, or EINVAL
+ */
+extern int ldms_set_snapshot_slots(int slots);
+
+/**
+ * \brief Take a snapshot of the current data of a set
+ *
+ * The returned handle can be passed to the metric, timestamp and
+ * metadata accessors in place of the set. Its data does not change
+ * until ldms_set_snapshot_put() is called. If the current data is in a
+ * data slot other than the first (see ldms_set_snapshot_slots()), the
+ * slot is held by the snapshot, and an update that finds all the slots
+ * held fails with EBUSY. Otherwise, e.g. for pushed sets or sets with
+ * more than one set buffer, the data is copied as by
+ * ldms_set_snapshot_copy(). The set info is not available from
+ * a snapshot. The set is freed by the last ldms_set_snapshot_put() if
+ * it is deleted while snapshots are held.
+ *
+ * \param s The set handle
+ * \retval snapshot The snapshot handle, or NULL with errno on error
+ */
+extern ldms_set_t ldms_set_snapshot_get(ldms_set_t s);
+
+/**
+ * \brief Release a snapshot taken by ldms_set_snapshot_get()
+ *
+ * \param snapshot The snapshot handle
+ */
+extern void ldms_set_snapshot_put(ldms_set_t snapshot);
+
+/**
+ * \brief Take a writable copy of the current data of a set
+ *
+ * Like ldms_set_snapshot_get(), but the snapshot has its own copy of
+ * the data, which the data metric setters change without affecting the
+ * set. The metadata is shared with the set and must not be changed
+ * through the copy. Release the copy with ldms_set_snapshot_put().
+ *
+ * \param s The set handle
+ * \retval snapshot The snapshot handle, or NULL with errno on error
+ */
+extern ldms_set_t ldms_set_snapshot_copy(ldms_set_t s);
+
+/**
+ * \brief Set the transaction timestamp and duration of a copy
+ *
+ * \param snapshot A copy taken by ldms_set_snapshot_copy()
+ * \param ts The transaction timestamp
+ * \param dur The transaction duration
+ */
+extern void ldms_set_snapshot_timestamp_set(ldms_set_t snapshot,
+					    struct ldms_timestamp ts,
+					    struct ldms_timestamp dur);
+
 #define LDMS_SET_INFO_F_LOCAL 0
 #define LDMS_SET_INFO_F_REMOTE 1
 
@@ -1241,6 +1514,7 @@ extern int ldms_set_is_consistent(ldms_set_t s);
  * \param value	The information
  *
  * \return 0 on success. ENOMEM if malloc fails. EINVAL if \c s does not exist.
+ *         E2BIG if \c key or \c value is 255 characters or longer.
  *
  * \see ldms_set_info_unset, ldms_set_info_get
  */
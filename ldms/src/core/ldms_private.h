@@ -77,20 +77,31 @@ struct ldms_schema_s {
 	LIST_ENTRY(ldms_schema_s) entry;
 };
 
-struct ldms_set_info_pair {
-	char *key;
-	char *value;
-	LIST_ENTRY(ldms_set_info_pair) entry;
+/*
+ * Set information key/value pairs. The pairs are kept in one buffer as
+ * consecutive ldms_name records (key, value, key, value, ...) followed by
+ * a zero length; this is the layout of the lookup reply, so the buffer
+ * goes on the wire as-is. The open-addressed index holds the buffer offset
+ * (+1) of each key record.
+ */
+struct ldms_set_info {
+	char *blob;		/* key/value records, zero length terminated */
+	size_t len;		/* bytes of records, without the terminator */
+	size_t sz;		/* bytes allocated for blob */
+	uint32_t *idx;		/* hash index of the key records */
+	uint32_t idx_card;	/* number of index slots, a power of two */
+	int count;		/* number of key/value pairs */
 };
-LIST_HEAD(ldms_set_info_list, ldms_set_info_pair);
 LIST_HEAD(rbd_list, ldms_rbuf_desc);
 struct ldms_set {
 	unsigned long flags;
 	uint64_t set_id;	/* unique identifier for a set in this daemon */
 	struct ldms_set_hdr *meta;
 	struct ldms_data_hdr *data; /* points to current entry of data array */
-	struct ldms_set_info_list local_info;
-	struct ldms_set_info_list remote_info; /*set info from the lookup operation */
+	struct ldms_set_info local_info;
+	struct ldms_set_info remote_info; /*set info from the lookup operation */
+	uint64_t info_gn;	/* bumped on every change of the set info */
+	uint64_t peer_info_gn;	/* info_gn of the peer when remote_info was applied */
 	struct rbn rb_node;
 	struct rbn id_node;
 	struct rbd_list local_rbd_list;
@@ -98,6 +109,22 @@ struct ldms_set {
 	pthread_mutex_t lock;
 	int curr_idx;
 	struct ldms_data_hdr *data_array;
+	size_t mmap_sz;		/* size of the mapping of a shared memory set */
+
+	/*
+	 * Consumer-side data slots. Slot 0 is the data in the set
+	 * memory, the others are in slot_mem. Updates are read into a
+	 * free slot and `data` is switched to it when the read
+	 * completes. See ldms_set_snapshot_get().
+	 */
+	int slot_card;		/* 0 if the set has no slots */
+	int slot_curr;		/* the slot `data` points to */
+	struct ldms_set_slot {
+		struct ldms_data_hdr *data;
+		int ref;	/* snapshots and reads in progress */
+	} *slot;
+	void *slot_mem;
+	int snap_count;		/* snapshots outstanding */
 };
 
 /* Convenience macro to roundup a value to a multiple of the _s parameter */
@@ -118,6 +145,12 @@ __ldms_create_set(const char *instance_name, const char *schema_name,
 		  size_t meta_len, size_t data_len, size_t card,
 		  size_t array_card,
 		  uint32_t flags);
+extern int __ldms_set_slots_init(struct ldms_set *set, int slot_card);
+extern int __ldms_set_slot_acquire(struct ldms_set *set, int slot);
+extern void __ldms_set_slot_release(struct ldms_set *set, int slot);
+extern void __ldms_set_slot_commit(struct ldms_set *set, int slot);
+extern void __ldms_set_slot_reset(struct ldms_set *set);
+extern int __ldms_set_slot_default;
 extern void __ldms_dir_add_set(struct ldms_set *set);
 extern void __ldms_dir_del_set(struct ldms_set *set);
 extern void __ldms_dir_upd_set(struct ldms_set *set);
@@ -147,15 +180,41 @@ extern struct ldms_set *__ldms_local_set_first(void);
 extern struct ldms_set *__ldms_local_set_next(struct ldms_set *);
 
 extern int __ldms_remote_update(ldms_t t, ldms_set_t s, ldms_update_cb_t cb, void *arg);
+extern int __ldms_remote_update_cond(ldms_t t, ldms_set_t s, uint64_t gn,
+				     ldms_update_cb_t cb, void *arg);
 extern void __ldms_set_tree_lock();
 extern void __ldms_set_tree_unlock();
 
-extern int __ldms_set_info_set(struct ldms_set_info_list *info,
+extern int __ldms_set_info_set(struct ldms_set_info *info,
 				const char *key, const char *value);
-void __ldms_set_info_unset(struct ldms_set_info_pair *pair);
-extern void __ldms_set_info_delete(struct ldms_set_info_list *info);
-extern struct ldms_set_info_pair *__ldms_set_info_find(struct ldms_set_info_list *info,
-								const char *key);
+extern int __ldms_set_info_unset(struct ldms_set_info *info, const char *key);
+extern void __ldms_set_info_delete(struct ldms_set_info *info);
+extern const char *__ldms_set_info_find(struct ldms_set_info *info,
+					const char *key);
+extern int __ldms_set_info_apply(struct ldms_set_info *info, const char *blob);
+extern size_t __ldms_set_info_blob_len(const char *blob);
+
+/* The first key record of \c info, NULL if \c info is empty */
+static inline ldms_name_t __ldms_set_info_first(struct ldms_set_info *info)
+{
+	if (!info->len)
+		return NULL;
+	return (ldms_name_t)info->blob;
+}
+
+/* The value record of the key record \c key */
+static inline ldms_name_t __ldms_set_info_value(ldms_name_t key)
+{
+	return (ldms_name_t)&key->name[key->len];
+}
+
+/* The key record following \c key, NULL at the end */
+static inline ldms_name_t __ldms_set_info_next(ldms_name_t key)
+{
+	ldms_name_t value = __ldms_set_info_value(key);
+	key = (ldms_name_t)&value->name[value->len];
+	return key->len ? key : NULL;
+}
 static inline
 struct ldms_data_hdr *__set_array_get(struct ldms_set *set, int idx)
 {
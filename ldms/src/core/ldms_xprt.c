@@ -58,6 +58,7 @@
 #include <dlfcn.h>
 #include <assert.h>
 #include <time.h>
+#include <sys/time.h>
 #include <limits.h>
 #include <fcntl.h>
 #include <netdb.h>
@@ -107,8 +108,9 @@ pthread_mutex_t xprt_list_lock;
 #define LDMS_ZAP_XPRT_SOCK 0;
 #define LDMS_ZAP_XPRT_RDMA 1;
 #define LDMS_ZAP_XPRT_UGNI 2;
+#define LDMS_ZAP_XPRT_SHM 3;
 pthread_mutex_t ldms_zap_list_lock;
-static zap_t ldms_zap_list[3] = {0};
+static zap_t ldms_zap_list[4] = {0};
 
 ldms_t ldms_xprt_get(ldms_t x)
 {
@@ -201,63 +203,6 @@ void __ldms_free_ctxt(struct ldms_xprt *x, struct ldms_context *ctxt)
 	free(ctxt);
 }
 
-static void send_dir_update(struct ldms_xprt *x,
-			    enum ldms_dir_type t,
-			    struct ldms_set *set)
-{
-	size_t hdr_len;
-	size_t buf_len;
-	size_t cnt;
-	struct ldms_reply *reply;
-
-	assert(t != LDMS_DIR_LIST);
-
-	hdr_len = sizeof(struct ldms_reply_hdr)
-		+ sizeof(struct ldms_dir_reply);
-	buf_len = ldms_xprt_msg_max(x);
-	reply = malloc(buf_len);
-
-	cnt = snprintf(reply->dir.json_data, buf_len - hdr_len,
-		       "{ \"directory\" : [");
-	cnt += __ldms_format_set_meta_as_json(set, 0,
-					      &reply->dir.json_data[cnt],
-					      buf_len - hdr_len - cnt);
-	if (cnt >= (buf_len - hdr_len))
-		goto out;
-	cnt += snprintf(&reply->dir.json_data[cnt],
-			buf_len - hdr_len - cnt,
-			"]}");
-	if (cnt >= (buf_len - hdr_len))
-		goto out;
-
-	reply->hdr.xid = x->remote_dir_xid;
-	reply->hdr.cmd = htonl(LDMS_CMD_DIR_UPDATE_REPLY);
-	reply->hdr.rc = 0;
-	reply->dir.type = htonl(t);
-	reply->dir.json_data_len = cnt;
-	reply->hdr.len = htonl(hdr_len + cnt);
-
-#ifdef DEBUG
-	x->log("%s(): x %p: remote dir ctxt %p\n",
-			__func__, x, (void *)x->remote_dir_xid);
-#endif /* DEBUG */
-
-	zap_err_t zerr;
-	zerr = zap_send(x->zap_ep, reply, hdr_len + cnt);
-	if (zerr != ZAP_ERR_OK) {
-		if (x->log)
-			x->log("%s: x %p: zap_send synchronously error. '%s'\n",
-			       __FUNCTION__, x, zap_err_str(zerr));
-		ldms_xprt_close(x);
-	}
-	free(reply);
-	return;
- out:
-	free(reply);
-	x->log("Directory message is too large for the max transport message.\n");
-	return;
-}
-
 static void send_req_notify_reply(struct ldms_xprt *x,
 				  struct ldms_set *set,
 				  uint64_t xid,
@@ -294,17 +239,273 @@ static void send_req_notify_reply(struct ldms_xprt *x,
 	return;
 }
 
+/*
+ * Directory updates are coalesced per transport. The sets published,
+ * deleted or updated within dir_window_us of the first pending update are
+ * sent in one message; the message goes out early when it is full, when it
+ * holds dir_max_sets sets or when an update of another type arrives, so
+ * that the peer sees the updates in order. Transports with a pending
+ * message are queued in deadline order for the dir_batch_proc() thread,
+ * which holds a reference on each.
+ *
+ * dir_batch_lock only guards the batches and queues. A flushed message is
+ * sealed onto the transport's out_q and the transport onto dir_send_q;
+ * __dir_batch_send() sends them after the lock is dropped, one thread at
+ * a time per transport, so that a slow peer does not hold up the others
+ * and zap_send() is never called under the global lock.
+ */
+static pthread_mutex_t dir_batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dir_batch_cv = PTHREAD_COND_INITIALIZER;
+static TAILQ_HEAD(, ldms_xprt) dir_batch_q = TAILQ_HEAD_INITIALIZER(dir_batch_q);
+static TAILQ_HEAD(, ldms_xprt) dir_send_q = TAILQ_HEAD_INITIALIZER(dir_send_q);
+static pthread_t dir_batch_thread;
+static int dir_batch_thread_running;
+static int dir_batch_stop;
+static uint64_t dir_window_us;
+static int dir_max_sets;
+
+#define DIR_BATCH_HDR_LEN (sizeof(struct ldms_reply_hdr) + \
+			   sizeof(struct ldms_dir_reply))
+
+/*
+ * Put \c x on the send queue. The caller's reference on \c x is handed
+ * to the queue and dropped by __dir_batch_send().
+ */
+static void __dir_send_enqueue(struct ldms_xprt *x)
+{
+	/* dir_batch_lock is held */
+	x->dir_batch.send_refs++;
+	if (x->dir_batch.send_queued)
+		return;
+	x->dir_batch.send_queued = 1;
+	TAILQ_INSERT_TAIL(&dir_send_q, x, dir_batch.send_entry);
+}
+
+static void __dir_batch_flush(struct ldms_xprt *x)
+{
+	/* dir_batch_lock is held */
+	struct ldms_dir_batch *b = &x->dir_batch;
+	struct ldms_reply *reply = b->reply;
+	struct ldms_dir_msg *m;
+	size_t len;
+
+	if (!b->count)
+		goto out;
+	len = b->len;
+	len += snprintf(&reply->dir.json_data[len],
+			ldms_xprt_msg_max(x) - DIR_BATCH_HDR_LEN - len, "]}");
+	b->count = 0;
+	b->len = 0;
+	if (!x->remote_dir_xid)
+		goto out; /* the peer has canceled the updates */
+	reply->hdr.xid = x->remote_dir_xid;
+	reply->hdr.cmd = htonl(LDMS_CMD_DIR_UPDATE_REPLY);
+	reply->hdr.rc = 0;
+	reply->dir.type = htonl(b->type);
+	reply->dir.more = 0;
+	reply->dir.json_data_len = htonl(len);
+	reply->hdr.len = htonl(DIR_BATCH_HDR_LEN + len);
+
+	m = malloc(sizeof(*m));
+	if (!m) {
+		x->log("%s(): Out of memory\n", __func__);
+		goto out;
+	}
+	m->reply = reply;
+	m->len = DIR_BATCH_HDR_LEN + len;
+	b->reply = NULL;
+	TAILQ_INSERT_TAIL(&b->out_q, m, entry);
+	ldms_xprt_get(x);
+	__dir_send_enqueue(x);
+ out:
+	if (b->queued) {
+		TAILQ_REMOVE(&dir_batch_q, x, dir_batch.entry);
+		b->queued = 0;
+		__dir_send_enqueue(x); /* the dir_batch_q reference */
+	}
+}
+
+/*
+ * Send the sealed messages and drop the send queue references.
+ * dir_batch_lock must not be held.
+ */
+static void __dir_batch_send(void)
+{
+	struct ldms_xprt *x;
+	struct ldms_dir_msg *m;
+	zap_err_t zerr;
+	int refs;
+
+	pthread_mutex_lock(&dir_batch_lock);
+	while ((x = TAILQ_FIRST(&dir_send_q))) {
+		TAILQ_REMOVE(&dir_send_q, x, dir_batch.send_entry);
+		x->dir_batch.send_queued = 0;
+		refs = x->dir_batch.send_refs;
+		x->dir_batch.send_refs = 0;
+		/*
+		 * If another thread is sending to x, it sends these too;
+		 * only one thread sends to a transport so the peer sees
+		 * the messages in order.
+		 */
+		while (!x->dir_batch.sending &&
+		       (m = TAILQ_FIRST(&x->dir_batch.out_q))) {
+			TAILQ_REMOVE(&x->dir_batch.out_q, m, entry);
+			x->dir_batch.sending = 1;
+			pthread_mutex_unlock(&dir_batch_lock);
+#ifdef DEBUG
+			x->log("%s(): x %p: remote dir ctxt %p\n",
+					__func__, x, (void *)x->remote_dir_xid);
+#endif /* DEBUG */
+			if (x->remote_dir_xid) {
+				zerr = zap_send(x->zap_ep, m->reply, m->len);
+				if (zerr != ZAP_ERR_OK) {
+					if (x->log)
+						x->log("%s: x %p: zap_send synchronously error. '%s'\n",
+						       __FUNCTION__, x, zap_err_str(zerr));
+					ldms_xprt_close(x);
+				}
+			}
+			free(m->reply);
+			free(m);
+			pthread_mutex_lock(&dir_batch_lock);
+			x->dir_batch.sending = 0;
+		}
+		pthread_mutex_unlock(&dir_batch_lock);
+		while (refs--)
+			ldms_xprt_put(x);
+		pthread_mutex_lock(&dir_batch_lock);
+	}
+	pthread_mutex_unlock(&dir_batch_lock);
+}
+
+static void *dir_batch_proc(void *arg)
+{
+	struct ldms_xprt *x;
+	struct timeval now;
+	struct timespec ts;
+
+	pthread_mutex_lock(&dir_batch_lock);
+	while (!dir_batch_stop) {
+		x = TAILQ_FIRST(&dir_batch_q);
+		if (!x) {
+			pthread_cond_wait(&dir_batch_cv, &dir_batch_lock);
+			continue;
+		}
+		gettimeofday(&now, NULL);
+		if (timercmp(&now, &x->dir_batch.deadline, <)) {
+			ts.tv_sec = x->dir_batch.deadline.tv_sec;
+			ts.tv_nsec = x->dir_batch.deadline.tv_usec * 1000;
+			pthread_cond_timedwait(&dir_batch_cv, &dir_batch_lock,
+					       &ts);
+			continue;
+		}
+		__dir_batch_flush(x);
+		pthread_mutex_unlock(&dir_batch_lock);
+		__dir_batch_send();
+		pthread_mutex_lock(&dir_batch_lock);
+	}
+	pthread_mutex_unlock(&dir_batch_lock);
+	return NULL;
+}
+
+static void dir_batch_add(struct ldms_xprt *x, enum ldms_dir_type t,
+			  struct ldms_set *set)
+{
+	/* dir_batch_lock is held */
+	struct ldms_dir_batch *b = &x->dir_batch;
+	size_t max = ldms_xprt_msg_max(x) - DIR_BATCH_HDR_LEN - 3; /* ]}\0 */
+	size_t cnt;
+	struct timeval tv;
+
+	assert(t != LDMS_DIR_LIST);
+	if (b->count && b->type != t)
+		__dir_batch_flush(x);
+	if (!b->reply) {
+		b->reply = malloc(ldms_xprt_msg_max(x));
+		if (!b->reply) {
+			x->log("%s(): Out of memory\n", __func__);
+			return;
+		}
+	}
+ again:
+	if (!b->count)
+		b->len = snprintf(b->reply->dir.json_data, max,
+				  "{ \"directory\" : [");
+	cnt = __ldms_format_set_meta_as_json(set, b->count,
+					     &b->reply->dir.json_data[b->len],
+					     max - b->len);
+	if (b->len + cnt >= max) {
+		if (b->count) {
+			/* send what we have and start over */
+			__dir_batch_flush(x);
+			if (!b->reply) {
+				b->reply = malloc(ldms_xprt_msg_max(x));
+				if (!b->reply) {
+					x->log("%s(): Out of memory\n", __func__);
+					return;
+				}
+			}
+			goto again;
+		}
+		x->log("Directory message is too large for the max transport message.\n");
+		return;
+	}
+	b->len += cnt;
+	b->type = t;
+	if (dir_window_us && !dir_batch_thread_running && !dir_batch_stop &&
+	    0 == pthread_create(&dir_batch_thread, NULL, dir_batch_proc, NULL))
+		dir_batch_thread_running = 1;
+	if (!b->count++ && dir_window_us && dir_batch_thread_running) {
+		gettimeofday(&tv, NULL);
+		b->deadline.tv_sec = tv.tv_sec + dir_window_us / 1000000;
+		b->deadline.tv_usec = tv.tv_usec + dir_window_us % 1000000;
+		if (b->deadline.tv_usec >= 1000000) {
+			b->deadline.tv_sec++;
+			b->deadline.tv_usec -= 1000000;
+		}
+		ldms_xprt_get(x);
+		b->queued = 1;
+		TAILQ_INSERT_TAIL(&dir_batch_q, x, dir_batch.entry);
+		if (TAILQ_FIRST(&dir_batch_q) == x)
+			pthread_cond_signal(&dir_batch_cv);
+	}
+	if (!dir_window_us || !dir_batch_thread_running ||
+	    (dir_max_sets && b->count >= dir_max_sets))
+		__dir_batch_flush(x);
+}
+
+int ldms_dir_update_coalesce(uint64_t window_us, int max_sets)
+{
+	struct ldms_xprt *x;
+
+	if (max_sets < 0)
+		return EINVAL;
+	pthread_mutex_lock(&dir_batch_lock);
+	/* send what is pending under the old window */
+	while ((x = TAILQ_FIRST(&dir_batch_q)))
+		__dir_batch_flush(x);
+	dir_window_us = window_us;
+	dir_max_sets = max_sets;
+	pthread_mutex_unlock(&dir_batch_lock);
+	__dir_batch_send();
+	return 0;
+}
+
 static void dir_update(struct ldms_set *set, enum ldms_dir_type t)
 {
 	struct ldms_xprt *x, *next_x;
 	x = (struct ldms_xprt *)ldms_xprt_first();
 	while (x) {
-		if (x->remote_dir_xid)
-			send_dir_update(x, t, set);
+		if (x->remote_dir_xid) {
+			pthread_mutex_lock(&dir_batch_lock);
+			dir_batch_add(x, t, set);
+			pthread_mutex_unlock(&dir_batch_lock);
+		}
 		next_x = (struct ldms_xprt *)ldms_xprt_next(x);
 		ldms_xprt_put(x);
 		x = next_x;
 	}
+	__dir_batch_send();
 }
 
 void __ldms_dir_add_set(struct ldms_set *set)
@@ -386,6 +587,16 @@ void __ldms_xprt_resource_free(struct ldms_xprt *x)
 	}
 	if (x->auth)
 		ldms_auth_free(x->auth);
+	if (x->dir_batch.reply) {
+		free(x->dir_batch.reply);
+		x->dir_batch.reply = NULL;
+	}
+	struct ldms_dir_msg *m;
+	while ((m = TAILQ_FIRST(&x->dir_batch.out_q))) {
+		TAILQ_REMOVE(&x->dir_batch.out_q, m, entry);
+		free(m->reply);
+		free(m);
+	}
 	pthread_mutex_unlock(&x->lock);
 }
 
@@ -721,8 +932,9 @@ static void __copy_set_info_to_lookup_msg(char *buffer, ldms_name_t schema,
 						ldms_name_t inst_name,
 						struct ldms_set *set)
 {
-	struct ldms_set_info_pair *pair;
+	ldms_name_t key, value;
 	ldms_name_t str = (ldms_name_t)buffer;
+	size_t len;
 
 	/* schema name */
 	str->len = schema->len;
@@ -734,66 +946,44 @@ static void __copy_set_info_to_lookup_msg(char *buffer, ldms_name_t schema,
 	strcpy(str->name, inst_name->name);
 	str = (ldms_name_t)&(str->name[str->len]);
 
-	/* Local set information */
-	LIST_FOREACH(pair, &set->local_info, entry) {
-		/* Copy the key string */
-		str->len = strlen(pair->key) + 1;
-		strcpy(str->name, pair->key);
-		str = (ldms_name_t)&(str->name[str->len]);
-
-		/* Copy the value string */
-		str->len = strlen(pair->value) + 1;
-		strcpy(str->name, pair->value);
-		str = (ldms_name_t)&(str->name[str->len]);
+	/* Local set information, already in the wire format */
+	if (set->local_info.len) {
+		memcpy(str, set->local_info.blob, set->local_info.len);
+		str = (ldms_name_t)((char *)str + set->local_info.len);
 	}
 
 	/* Remote set information */
-	LIST_FOREACH(pair, &set->remote_info, entry) {
-		if (__ldms_set_info_find(&set->local_info, pair->key)) {
+	for (key = __ldms_set_info_first(&set->remote_info); key;
+	     key = __ldms_set_info_next(key)) {
+		if (__ldms_set_info_find(&set->local_info, key->name)) {
 			/*
 			 * The local set info supersedes the remote set info.
 			 * Skip if the key exists in the local set info list.
 			 */
 			continue;
 		}
-
-		/* Copy the key string */
-		str->len = strlen(pair->key) + 1;
-		strcpy(str->name, pair->key);
-		str = (ldms_name_t)&(str->name[str->len]);
-
-		/* Copy the value string */
-		str->len = strlen(pair->value) + 1;
-		strcpy(str->name, pair->value);
-		str = (ldms_name_t)&(str->name[str->len]);
+		value = __ldms_set_info_value(key);
+		len = (char *)&value->name[value->len] - (char *)key;
+		memcpy(str, key, len);
+		str = (ldms_name_t)((char *)str + len);
 	}
 	str->len = 0;
 }
 
-struct lu_set_info {
-	struct ldms_set *set;
-	int flag; /* local/remote set info */
-	int count;
-	size_t len;
-};
-static int __get_set_info_sz(struct ldms_set *set, int *count, size_t *len)
+/* The bytes of set info records a lookup reply carries */
+static size_t __get_set_info_sz(struct ldms_set *set)
 {
-	struct ldms_set_info_pair *pair;
-	int cnt = 0;
-	size_t l = 0;
-	LIST_FOREACH(pair, &set->local_info, entry) {
-		cnt++;
-		l += strlen(pair->key) + strlen(pair->value) + 2;
-	}
-	LIST_FOREACH(pair, &set->remote_info, entry) {
-		if (__ldms_set_info_find(&set->local_info, pair->key))
+	ldms_name_t key, value;
+	size_t len = set->local_info.len;
+
+	for (key = __ldms_set_info_first(&set->remote_info); key;
+	     key = __ldms_set_info_next(key)) {
+		if (__ldms_set_info_find(&set->local_info, key->name))
 			continue;
-		cnt++;
-		l += strlen(pair->key) + strlen(pair->value) + 2;
+		value = __ldms_set_info_value(key);
+		len += (char *)&value->name[value->len] - (char *)key;
 	}
-	*count = cnt;
-	*len = l;
-	return 0;
+	return len;
 }
 
 static int __send_lookup_reply(struct ldms_xprt *x, struct ldms_set *set,
@@ -854,20 +1044,19 @@ static int __send_lookup_reply(struct ldms_xprt *x, struct ldms_set *set,
 	 * S                           S
 	 * +---------------------------+
 	 */
-	int set_info_cnt;
 	size_t set_info_len;
 	size_t msg_len;
 	struct ldms_rendezvous_msg *msg;
 
 	pthread_mutex_lock(&set->lock);
-	__get_set_info_sz(set, &set_info_cnt, &set_info_len);
+	set_info_len = __get_set_info_sz(set);
 	msg_len = sizeof(struct ldms_rendezvous_hdr)
 			+ sizeof(struct ldms_rendezvous_lookup_param)
 			/*
 			 * +2 for schema name and instance name
 			 * +1 for the terminating string of length 0
 			 */
-			+ sizeof(struct ldms_name) * (2 + (set_info_cnt) * 2 + 1)
+			+ sizeof(struct ldms_name) * (2 + 1)
 			+ name->len + schema->len + set_info_len;
 	msg = malloc(msg_len);
 	if (!msg)
@@ -1036,7 +1225,8 @@ static void process_lookup_request(struct ldms_xprt *x, struct ldms_request *req
 	process_lookup_request_re(x, req, flags);
 }
 
-static int do_read_all(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+static int do_read_all(ldms_t x, ldms_set_t s, int slot,
+			ldms_update_cb_t cb, void *arg)
 {
 	/* Read metadata and the first set in the set array in 1 RDMA read. */
 	TF();
@@ -1058,6 +1248,7 @@ static int do_read_all(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	ctxt->update.arg = arg;
 	ctxt->update.idx_from = 0;
 	ctxt->update.idx_to = 0;
+	ctxt->update.slot = slot;
 
 	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap),
 			s->lmap, zap_map_addr(s->lmap), len, ctxt);
@@ -1066,6 +1257,8 @@ static int do_read_all(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 out:
 	pthread_mutex_unlock(&x->lock);
 	ldms_xprt_put(x);
+	if (rc && slot >= 0)
+		__ldms_set_slot_release(s->set, slot);
 	return rc;
 }
 
@@ -1104,12 +1297,20 @@ static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
 {
 	/* Read multiple set data in the set array from `idx_from` to `idx_to`
 	 * (inclusive) in 1 RDMA read. */
-	int rc;
+	int rc, slot = -1;
 	uint32_t data_sz;
 	struct ldms_context *ctxt;
-	size_t doff, dlen;
+	struct zap_map *lmap;
+	size_t doff, dlen, loff;
 	TF();
 
+	if (s->set->slot_card) {
+		/* idx_from == idx_to == 0, read into a free data slot */
+		slot = __ldms_set_slot_acquire(s->set, -1);
+		if (slot < 0)
+			return EBUSY;
+	}
+
 	/* Prevent x being destroyed if DISCONNECTED is delivered in another thread */
 	assert(x == s->xprt);
 	ldms_xprt_get(x);
@@ -1125,19 +1326,28 @@ static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
 	ctxt->update.arg = arg;
 	ctxt->update.idx_from = idx_from;
 	ctxt->update.idx_to = idx_to;
+	ctxt->update.slot = slot;
 	data_sz = __le32_to_cpu(s->set->meta->data_sz);
 	doff = (uint8_t *)s->set->data_array - (uint8_t *)s->set->meta
 							+ idx_from * data_sz;
 	dlen = (idx_to - idx_from + 1) * data_sz;
-
+	if (slot > 0) {
+		lmap = s->smap;
+		loff = (slot - 1) * data_sz;
+	} else {
+		lmap = s->lmap;
+		loff = doff;
+	}
 
 	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + doff,
-		      s->lmap, zap_map_addr(s->lmap) + doff, dlen, ctxt);
+		      lmap, zap_map_addr(lmap) + loff, dlen, ctxt);
 	if (rc)
 		__ldms_free_ctxt(x, ctxt);
 out:
 	pthread_mutex_unlock(&x->lock);
 	ldms_xprt_put(x);
+	if (rc && slot >= 0)
+		__ldms_set_slot_release(s->set, slot);
 	return rc;
 }
 
@@ -1166,12 +1376,17 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	uint32_t data_meta_gn = __le32_to_cpu(set->data->meta_gn);
 	uint32_t n = __le32_to_cpu(set->meta->array_card);
 	int idx_from, idx_to, idx_next, idx_curr;
+	int slot = -1;
 
 	zap_get_ep(x->zap_ep);	/* Released in handle_zap_read_complete() */
 	if (meta_meta_gn == 0 || meta_meta_gn != data_meta_gn) {
-		if (set->curr_idx == (n-1)) {
+		/* The data of a slotted set can come along with the metadata
+		 * only if slot 0 is free */
+		if (set->slot_card)
+			slot = __ldms_set_slot_acquire(set, 0);
+		if (set->curr_idx == (n-1) && (!set->slot_card || slot == 0)) {
 			/* We can update the metadata along with the data */
-			rc = do_read_all(x, s, cb, arg);
+			rc = do_read_all(x, s, slot, cb, arg);
 		} else {
 			/* Otherwise, need to update metadata and data
 			 * separately */
@@ -1192,6 +1407,73 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	return rc;
 }
 
+/*
+ * Read the header of the current set buffer of the remote set into
+ * s->hdr. The data is read only if the header shows that it has changed,
+ * see __handle_update_cond().
+ */
+int __ldms_remote_update_cond(ldms_t x, ldms_set_t s, uint64_t gn,
+			      ldms_update_cb_t cb, void *arg)
+{
+	assert(x == s->xprt);
+	if (!s->lmap || !s->rmap)
+		return EINVAL;
+
+	if (LDMS_XPRT_AUTH_GUARD(x))
+		return EPERM;
+
+	struct ldms_set *set = s->set;
+	struct ldms_context *ctxt;
+	zap_err_t zerr;
+	size_t hoff;
+	int rc;
+
+	if (__le32_to_cpu(set->meta->meta_gn) == 0 ||
+	    set->meta->meta_gn != set->data->meta_gn)
+		/* The metadata has to be read anyway */
+		return __ldms_remote_update(x, s, cb, arg);
+
+	zap_get_ep(x->zap_ep);	/* Released in __handle_update_cond() */
+	ldms_xprt_get(x);
+	pthread_mutex_lock(&x->lock);
+	if (!s->hmap) {
+		s->hdr = mm_alloc(sizeof(*s->hdr));
+		if (!s->hdr) {
+			rc = ENOMEM;
+			goto out;
+		}
+		zerr = zap_map(x->zap_ep, &s->hmap, s->hdr, sizeof(*s->hdr),
+			       ZAP_ACCESS_READ | ZAP_ACCESS_WRITE);
+		if (zerr) {
+			mm_free(s->hdr);
+			s->hdr = NULL;
+			rc = ENOMEM;
+			goto out;
+		}
+	}
+	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE_COND);
+	if (!ctxt) {
+		rc = ENOMEM;
+		goto out;
+	}
+	ctxt->update.s = s;
+	ctxt->update.cb = cb;
+	ctxt->update.arg = arg;
+	ctxt->update.gn = gn;
+	hoff = (uint8_t *)set->data_array - (uint8_t *)set->meta
+		+ set->curr_idx * __le32_to_cpu(set->meta->data_sz);
+	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + hoff,
+		      s->hmap, zap_map_addr(s->hmap), sizeof(*s->hdr), ctxt);
+	if (rc)
+		__ldms_free_ctxt(x, ctxt);
+out:
+	pthread_mutex_unlock(&x->lock);
+	ldms_xprt_put(x);
+	if (rc)
+		zap_put_ep(x->zap_ep);
+	return rc;
+}
+
 static
 int ldms_xprt_recv_request(struct ldms_xprt *x, struct ldms_request *req)
 {
@@ -1282,15 +1564,13 @@ void process_dir_cancel_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 }
 
 static int __process_dir_set_info(struct ldms_set *lset, enum ldms_dir_type type,
-				ldms_dir_set_t dset, json_entity_t info_list)
+				ldms_dir_set_t dset, json_entity_t info_list,
+				uint64_t info_gn)
 {
 	json_entity_t info_entity, e;
-	int j, rc;
-	int dir_upd = 0;
-	struct ldms_set_info_pair *pair, *nxt_pair;
+	struct ldms_set_info info = {0};
+	int j, rc = 0;
 
-	if (lset)
-		pthread_mutex_lock(&lset->lock);
 	for (j = 0, info_entity = json_item_first(info_list); info_entity;
 	     info_entity = json_item_next(info_entity), j++) {
 		e = json_value_find(info_entity, "key");
@@ -1301,43 +1581,41 @@ static int __process_dir_set_info(struct ldms_set *lset, enum ldms_dir_type type
 		dset->info[j].value = strdup(json_value_str(e)->str);
 		if (!dset->info[j].value)
 			return ENOMEM;
-
-		if (lset) {
-			const char *key = dset->info[j].key;
-			const char *val = dset->info[j].value;
-			rc = __ldms_set_info_set(&lset->remote_info, key, val);
-			if (rc > 0)
-				return rc;
-			if (rc == 0)
-				dir_upd = 1;
-		}
 	}
 	if (!lset)
 		return 0;
 
-	pair = LIST_FIRST(&lset->remote_info);
-	while (pair) {
-		nxt_pair = LIST_NEXT(pair, entry);
-		for (j = 0, info_entity = json_item_first(info_list); info_entity;
-				info_entity = json_item_next(info_entity)) {
-			e = json_value_find(info_entity, "key");
-			if (0 == strcmp(pair->key, json_value_str(e)->str))
-				break;
-		}
-		if (!info_entity) {
-			__ldms_set_info_unset(pair);
-			dir_upd = 1;
-		}
-		pair = nxt_pair;
+	pthread_mutex_lock(&lset->lock);
+	if (info_gn && info_gn == lset->peer_info_gn) {
+		/* The peer's set info has not changed since we applied it */
+		goto out;
 	}
-	if (lset) {
-		pthread_mutex_unlock(&lset->lock);
-		if ((type == LDMS_DIR_UPD) && dir_upd &&
-				(lset->flags & LDMS_SET_F_PUBLISHED)) {
+	for (j = 0; j < dset->info_count; j++) {
+		/* A pair too long for a set info record (e.g. from an older
+		 * peer) is still passed to the dir callback, but it cannot be
+		 * kept in the set. */
+		if (strlen(dset->info[j].key) >= UINT8_MAX ||
+		    strlen(dset->info[j].value) >= UINT8_MAX)
+			continue;
+		rc = __ldms_set_info_set(&info, dset->info[j].key,
+					 dset->info[j].value);
+		if (rc > 0)
+			goto out;
+	}
+	rc = __ldms_set_info_apply(&lset->remote_info, info.blob);
+	if (rc > 0)
+		goto out;
+	lset->peer_info_gn = info_gn;
+	if (rc == 0) {
+		lset->info_gn++;
+		if ((type == LDMS_DIR_UPD) && (lset->flags & LDMS_SET_F_PUBLISHED))
 			__ldms_dir_upd_set(lset);
-		}
 	}
-	return 0;
+	rc = 0;
+out:
+	pthread_mutex_unlock(&lset->lock);
+	__ldms_set_info_delete(&info);
+	return rc;
 }
 
 static
@@ -1461,7 +1739,9 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 		__ldms_set_tree_lock();
 		dir->set_data[i].info_count = info_count;
 		lset = __ldms_find_local_set(dir->set_data[i].inst_name);
-		rc = __process_dir_set_info(lset, type, &dir->set_data[i], info_list);
+		e = json_value_find(set_entity, "info_gn");
+		rc = __process_dir_set_info(lset, type, &dir->set_data[i],
+					    info_list, e ? json_value_int(e) : 0);
 		__ldms_set_tree_unlock();
 		if (rc)
 			break;
@@ -1548,6 +1828,8 @@ static void process_push_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 	if (rc)
 		return; /* NOTE should we terminate the xprt? */
 
+	if (push_rbd->set->slot_card)
+		__ldms_set_slot_reset(push_rbd->set);
 	/* Copy the data to the metric set */
 	if (data_len) {
 		memcpy((char *)push_rbd->push_s->set->meta + data_off,
@@ -1640,8 +1922,11 @@ zap_mem_info_t ldms_zap_mem_info()
 	static struct mm_info mmi;
 	static struct zap_mem_info zmmi;
 	mm_get_info(&mmi);
+	if (!mmi.start)
+		return NULL; /* no set heap, e.g. ldmsctl */
 	zmmi.start = mmi.start;
 	zmmi.len = mmi.size;
+	zmmi.fd = mmi.fd; /* -1 unless the heap is shared */
 	return &zmmi;
 }
 
@@ -1769,9 +2054,17 @@ static void __handle_update_data(ldms_t x, struct ldms_context *ctxt,
 	rc = LDMS_UPD_ERROR(ev->status);
 	if (rc) {
 		/* READ ERROR */
+		if (ctxt->update.slot >= 0)
+			__ldms_set_slot_release(set, ctxt->update.slot);
 		ctxt->update.cb(x, s, rc, ctxt->update.arg);
 		goto cleanup;
 	}
+	if (ctxt->update.slot >= 0) {
+		/* A slotted set has only one set buffer */
+		__ldms_set_slot_commit(set, ctxt->update.slot);
+		ctxt->update.cb(x, s, 0, ctxt->update.arg);
+		goto cleanup;
+	}
 	n = __le32_to_cpu(set->meta->array_card);
 	/* update current index from the update */
 	data = __ldms_set_array_get(s, ctxt->update.idx_from);
@@ -1819,6 +2112,37 @@ cleanup:
 	pthread_mutex_unlock(&x->lock);
 }
 
+static void __handle_update_cond(ldms_t x, struct ldms_context *ctxt,
+				 zap_event_t ev)
+{
+	int rc;
+	ldms_set_t s = ctxt->update.s;
+	struct ldms_set *set = s->set;
+	struct ldms_data_hdr *hdr = s->hdr;
+
+	rc = LDMS_UPD_ERROR(ev->status);
+	if (rc) {
+		ctxt->update.cb(x, s, rc, ctxt->update.arg);
+		goto cleanup;
+	}
+	if (__le64_to_cpu(hdr->gn) == ctxt->update.gn &&
+	    hdr->meta_gn == set->meta->meta_gn &&
+	    __le32_to_cpu(hdr->curr_idx) == set->curr_idx &&
+	    hdr->trans.flags == LDMS_TRANSACTION_END) {
+		ctxt->update.cb(x, s, LDMS_UPD_F_NOT_MODIFIED,
+				ctxt->update.arg);
+		goto cleanup;
+	}
+	rc = __ldms_remote_update(x, s, ctxt->update.cb, ctxt->update.arg);
+	if (rc)
+		ctxt->update.cb(x, s, LDMS_UPD_ERROR(rc), ctxt->update.arg);
+cleanup:
+	zap_put_ep(x->zap_ep); /* from __ldms_remote_update_cond() */
+	pthread_mutex_lock(&x->lock);
+	__ldms_free_ctxt(x, ctxt);
+	pthread_mutex_unlock(&x->lock);
+}
+
 static void __handle_update_meta(ldms_t x, struct ldms_context *ctxt,
 				 zap_event_t ev)
 {
@@ -1889,6 +2213,9 @@ static void handle_zap_read_complete(zap_ep_t zep, zap_event_t ev)
 	case LDMS_CONTEXT_UPDATE_META:
 		__handle_update_meta(x, ctxt, ev);
 		break;
+	case LDMS_CONTEXT_UPDATE_COND:
+		__handle_update_cond(x, ctxt, ev);
+		break;
 	case LDMS_CONTEXT_LOOKUP:
 		__handle_lookup(x, ctxt, ev);
 		break;
@@ -1932,64 +2259,19 @@ int __is_lookup_name_good(struct ldms_xprt *x,
 }
 #endif /* DEBUG */
 
-static const ldms_name_t __lookup_set_info_find(const char *set_info,
-						const char *key_)
-{
-	ldms_name_t key = (ldms_name_t)set_info;
-	ldms_name_t value = (ldms_name_t)(&key->name[key->len]);
-	while (key->len) {
-		if (0 == strcmp(key_, key->name))
-			return key;
-		key = (ldms_name_t)(&value->name[value->len]);
-		value = (ldms_name_t)(&key->name[key->len]);
-	}
-	return NULL;
-}
-
 static int __process_lookup_set_info(struct ldms_set *lset, char *set_info)
 {
-	int rc = 0;
-	ldms_name_t key, value;
-	struct ldms_set_info_pair *pair, *nxt_pair;
-	int dir_upd = 0;
-
-	/* Check whether the value of a key is changed or not */
-	key = (ldms_name_t)(set_info);
-	value = (ldms_name_t)(&key->name[key->len]);
-	while (key->len) {
-		rc = __ldms_set_info_set(&lset->remote_info,
-					key->name, value->name);
-		if (rc > 0) {
-			/* error */
-			goto out;
-		}
-		if (rc == 0) {
-			/* There is a change in the set info data */
-			dir_upd = 1;
-		}
-		if (rc < 0)
-			rc = 0;
-		key = (ldms_name_t)(&value->name[value->len]);
-		value = (ldms_name_t)(&key->name[key->len]);
-	}
-	if (!dir_upd) {
-		/* Check if a key-value pair is removed from the set info or not */
-		pair = LIST_FIRST(&lset->remote_info);
-		while (pair) {
-			nxt_pair = LIST_NEXT(pair, entry);
-			key = __lookup_set_info_find(set_info, pair->key);
-			if (!key) {
-				/* Remove the key-value pair from the set info list */
-				__ldms_set_info_unset(pair);
-				dir_upd = 1;
-			}
-			pair = nxt_pair;
-		}
-	}
-	if (dir_upd && (lset->flags & LDMS_SET_F_PUBLISHED))
+	int rc;
+
+	rc = __ldms_set_info_apply(&lset->remote_info, set_info);
+	if (rc > 0)
+		return rc; /* error */
+	if (rc < 0)
+		return 0; /* no changes */
+	lset->info_gn++;
+	if (lset->flags & LDMS_SET_F_PUBLISHED)
 		__ldms_dir_upd_set(lset);
-out:
-	return rc;
+	return 0;
 }
 
 static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
@@ -2046,6 +2328,9 @@ static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
 			rc = errno;
 			goto unlock_out;
 		}
+		if (__ldms_set_slots_init(lset, __ldms_set_slot_default))
+			x->log("%s: no memory for the data slots of '%s'\n",
+			       __func__, inst_name->name);
 	}
 
 	/* Need to lock the set in case that the set has already been looked up. */
@@ -2132,8 +2417,10 @@ static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
 			"with error %d. NOTE: error %d indicates that it is "
 			"a synchronous error of zap_read\n", inst_name, rc, EIO);
 #endif /* DEBUG */
+	/* more tells the caller whether other sets are still to come */
 	if (ctxt->lookup.cb)
-		ctxt->lookup.cb(x, rc, 0, rbd, ctxt->lookup.cb_arg);
+		ctxt->lookup.cb(x, rc, ntohl(lu->more), rbd,
+				ctxt->lookup.cb_arg);
 	if (!lu->more) {
 		zap_put_ep(x->zap_ep);	/* Taken in __ldms_remote_lookup() */
 		pthread_mutex_lock(&x->lock);
@@ -2375,6 +2662,8 @@ zap_t __ldms_zap_get(const char *xprt, ldms_log_fn_t log_fn)
 		zap_type = LDMS_ZAP_XPRT_UGNI;
 	} else if (0 == strcmp(xprt, "rdma")) {
 		zap_type = LDMS_ZAP_XPRT_RDMA;
+	} else if (0 == strcmp(xprt, "shm")) {
+		zap_type = LDMS_ZAP_XPRT_SHM;
 	} else {
 		log_fn("ldms: Unrecognized xprt '%s'\n", xprt);
 		errno = EINVAL;
@@ -2449,6 +2738,7 @@ void __ldms_xprt_init(struct ldms_xprt *x, const char *name,
 
 	x->log = log_fn;
 	TAILQ_INIT(&x->ctxt_list);
+	TAILQ_INIT(&x->dir_batch.out_q);
 	sem_init(&x->sem, 0, 0);
 	rbt_init(&x->rbd_rbt, __rbd_rbt_key_comp);
 	pthread_mutex_init(&x->lock, NULL);
@@ -3231,6 +3521,15 @@ __ldms_alloc_rbd(struct ldms_xprt *x, struct ldms_set *s, enum ldms_rbd_type typ
 					 ZAP_ACCESS_READ | ZAP_ACCESS_WRITE);
 		if (zerr)
 			goto err1;
+		if (s->slot_mem) {
+			zerr = zap_map(x->zap_ep, &rbd->smap, s->slot_mem,
+				(s->slot_card - 1) * __le32_to_cpu(s->meta->data_sz),
+				ZAP_ACCESS_READ | ZAP_ACCESS_WRITE);
+			if (zerr) {
+				zap_unmap(x->zap_ep, rbd->lmap);
+				goto err1;
+			}
+		}
 	}
 
 	rbd->type = type;
@@ -3262,6 +3561,12 @@ void __ldms_rbd_xprt_release(struct ldms_rbuf_desc *rbd)
 		zap_unmap(rbd->xprt->zap_ep, rbd->lmap);
 	}
 	rbd->lmap = NULL;
+	if (rbd->smap)
+		zap_unmap(rbd->xprt->zap_ep, rbd->smap);
+	rbd->smap = NULL;
+	if (rbd->hmap)
+		zap_unmap(rbd->xprt->zap_ep, rbd->hmap);
+	rbd->hmap = NULL;
 	if (rbd->rmap) {
 		rbd->xprt->log("DEBUG: zap %p: unmap remote\n", rbd->xprt->zap_ep);
 		zap_unmap(rbd->xprt->zap_ep, rbd->rmap);
@@ -3271,6 +3576,12 @@ void __ldms_rbd_xprt_release(struct ldms_rbuf_desc *rbd)
 	if (rbd->lmap)
 		zap_unmap(rbd->xprt->zap_ep, rbd->lmap);
 	rbd->lmap = NULL;
+	if (rbd->smap)
+		zap_unmap(rbd->xprt->zap_ep, rbd->smap);
+	rbd->smap = NULL;
+	if (rbd->hmap)
+		zap_unmap(rbd->xprt->zap_ep, rbd->hmap);
+	rbd->hmap = NULL;
 	if (rbd->rmap)
 		zap_unmap(rbd->xprt->zap_ep, rbd->rmap);
 	rbd->rmap = NULL;
@@ -3284,6 +3595,8 @@ void __ldms_free_rbd(struct ldms_rbuf_desc *rbd)
 	if (rbd->xprt)
 		__ldms_rbd_xprt_release(rbd);
 	LIST_REMOVE(rbd, set_link);
+	if (rbd->hdr)
+		mm_free(rbd->hdr);
 	free(rbd);
 }
 
@@ -3334,10 +3647,29 @@ int ldms_xprt_sockaddr(ldms_t _x, struct sockaddr *local_sa,
 
 static void __attribute__ ((constructor)) cs_init(void)
 {
+	char *s;
+
 	pthread_mutex_init(&xprt_list_lock, 0);
 	pthread_mutex_init(&ldms_zap_list_lock, 0);
+	s = getenv("LDMS_DIR_UPDATE_WINDOW");
+	if (s)
+		dir_window_us = strtoull(s, NULL, 0);
+	s = getenv("LDMS_DIR_UPDATE_MAX");
+	if (s)
+		dir_max_sets = atoi(s);
+	if (dir_max_sets < 0)
+		dir_max_sets = 0;
+	s = getenv("LDMS_SET_SNAPSHOT_SLOTS");
+	if (s)
+		ldms_set_snapshot_slots(atoi(s));
 }
 
 static void __attribute__ ((destructor)) cs_term(void)
 {
+	pthread_mutex_lock(&dir_batch_lock);
+	dir_batch_stop = 1;
+	pthread_cond_signal(&dir_batch_cv);
+	pthread_mutex_unlock(&dir_batch_lock);
+	if (dir_batch_thread_running)
+		pthread_join(dir_batch_thread, NULL);
 }
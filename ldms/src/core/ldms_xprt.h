@@ -105,6 +105,9 @@ struct ldms_rbuf_desc {
 	 */
 	struct zap_map *rmap;	    /* Remote buffer map */
 	struct zap_map *lmap;	    /* Local buffer map */
+	struct zap_map *smap;	    /* Local map of the set data slots */
+	struct ldms_data_hdr *hdr;  /* Remote data header, see update_cond */
+	struct zap_map *hmap;	    /* Local map of hdr */
 	enum ldms_rbd_type {
 		LDMS_RBD_LOCAL = 0,
 		LDMS_RBD_INITIATOR,
@@ -291,6 +294,7 @@ typedef enum ldms_context_type {
 	LDMS_CONTEXT_SEND,
 	LDMS_CONTEXT_PUSH,
 	LDMS_CONTEXT_UPDATE_META,
+	LDMS_CONTEXT_UPDATE_COND,
 } ldms_context_type_t;
 
 struct ldms_context {
@@ -318,6 +322,8 @@ struct ldms_context {
 			void *arg;
 			int idx_from;
 			int idx_to;
+			int slot; /* local data slot, -1 if not slotted */
+			uint64_t gn; /* data GN the caller has seen */
 		} update;
 		struct {
 			ldms_set_t s;
@@ -328,6 +334,13 @@ struct ldms_context {
 	TAILQ_ENTRY(ldms_context) link;
 };
 
+/* A sealed directory update message waiting to be sent */
+struct ldms_dir_msg {
+	struct ldms_reply *reply;
+	size_t len;
+	TAILQ_ENTRY(ldms_dir_msg) entry;
+};
+
 #define LDMS_MAX_TRANSPORT_NAME_LEN 16
 
 struct ldms_xprt {
@@ -345,6 +358,21 @@ struct ldms_xprt {
 	uint64_t local_dir_xid;
 	/* This is the peers local_dir_xid that we provide when providing dir updates */
 	uint64_t remote_dir_xid;
+	/* Directory updates waiting to be sent to the peer, see dir_update() */
+	struct ldms_dir_batch {
+		enum ldms_dir_type type;
+		int count;		/* sets in reply */
+		size_t len;		/* JSON in reply */
+		int queued;		/* on the flush queue */
+		struct ldms_reply *reply;
+		struct timeval deadline;
+		TAILQ_ENTRY(ldms_xprt) entry;
+		TAILQ_HEAD(, ldms_dir_msg) out_q; /* sealed, to be sent */
+		int sending;		/* a thread is sending out_q */
+		int send_queued;	/* on the send queue */
+		int send_refs;		/* references held by the send queue */
+		TAILQ_ENTRY(ldms_xprt) send_entry;
+	} dir_batch;
 
 #ifdef DEBUG
 	int active_dir; /* Number of outstanding dir requests */
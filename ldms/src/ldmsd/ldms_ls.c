@@ -69,6 +69,7 @@
 #include <regex.h>
 #include <pwd.h>
 #include <grp.h>
+#include <coll/rbt.h>
 #include "ldms.h"
 #include "ldms_xprt.h"
 #include "config.h"
@@ -141,7 +142,7 @@ void null_log(const char *fmt, ...)
 	fflush(stderr);
 }
 
-#define FMT "h:p:x:w:m:ESIlvua:A:VP"
+#define FMT "h:p:x:w:m:ESIlvua:A:VPB:"
 void usage(char *argv[])
 {
 	printf("%s -h <hostname> -x <transport> [ name ... ]\n"
@@ -171,6 +172,11 @@ void usage(char *argv[])
 	       , LDMS_LS_MAX_MEM_SZ_STR, LDMS_LS_MEM_SZ_ENVVAR);
 	printf("\n    -V           Print LDMS version and exit.\n");
 	printf("\n    -P           Register for push updates.\n");
+	printf("\n    -B <window>      Bulk mode. Look up, update and print the sets with\n"
+	       "                     up to <window> sets in progress at a time. The\n"
+	       "                     <name>s are matched by the server, without\n"
+	       "                     reading the directory. The exit status is 1 if a\n"
+	       "                     set could not be read or a <name> matched nothing.\n");
 	exit(1);
 }
 
@@ -363,26 +369,8 @@ static int is_matched(char *inst_name, char *schema_name)
 static int verbose = 0;
 static int long_format = 0;
 
-void print_cb(ldms_t t, ldms_set_t s, int rc, void *arg)
+static void print_update(ldms_set_t s, int rc)
 {
-	int err;
-	unsigned long last = (unsigned long)arg;
-	err = LDMS_UPD_ERROR(rc);
-	if (err) {
-		printf("    Error %x updating metric set.\n", err);
-		goto out;
-	}
-	/* Ignore if more update of this set is expected */
-	if (rc & LDMS_UPD_F_MORE)
-		return;
-	/* If this is a push update and it's not the last, ignore it. */
-	if (rc & LDMS_UPD_F_PUSH) {
-		if (!(rc & LDMS_UPD_F_PUSH_LAST)) {
-			/* This will trigger the last update */
-			ldms_xprt_cancel_push(s);
-			return;
-		}
-	}
 	struct ldms_timestamp _ts = ldms_transaction_timestamp_get(s);
 	struct ldms_timestamp const *ts = &_ts;
 	int consistent = ldms_set_is_consistent(s);
@@ -405,6 +393,29 @@ void print_cb(ldms_t t, ldms_set_t s, int rc, void *arg)
 		for (i = 0; i < ldms_set_card_get(s); i++)
 			metric_printer(s, i);
 	}
+}
+
+void print_cb(ldms_t t, ldms_set_t s, int rc, void *arg)
+{
+	int err;
+	unsigned long last = (unsigned long)arg;
+	err = LDMS_UPD_ERROR(rc);
+	if (err) {
+		printf("    Error %x updating metric set.\n", err);
+		goto out;
+	}
+	/* Ignore if more update of this set is expected */
+	if (rc & LDMS_UPD_F_MORE)
+		return;
+	/* If this is a push update and it's not the last, ignore it. */
+	if (rc & LDMS_UPD_F_PUSH) {
+		if (!(rc & LDMS_UPD_F_PUSH_LAST)) {
+			/* This will trigger the last update */
+			ldms_xprt_cancel_push(s);
+			return;
+		}
+	}
+	print_update(s, rc);
 	if ((rc == 0) || (rc & LDMS_UPD_F_PUSH_LAST))
 		ldms_set_delete(s);
  out:
@@ -657,6 +668,284 @@ int is_in_set_list(const char *name)
 	return 0;
 }
 
+/*
+ * Bulk mode (-B): at most bulk_window sets are being looked up, updated
+ * or printed at a time. The main thread issues the lookups and updates,
+ * the transport threads queue the updated sets, and the printer thread
+ * formats them, deletes them and gives their window slot back.
+ */
+struct bulk_set {
+	const char *name;	/* the name or pattern looked up */
+	ldms_set_t s;
+	int status;		/* lookup or update error */
+	int has_slot;		/* holds a window slot */
+	TAILQ_ENTRY(bulk_set) entry;
+};
+TAILQ_HEAD(bulk_q, bulk_set);
+static struct bulk_q bulk_name_q = TAILQ_HEAD_INITIALIZER(bulk_name_q);
+static struct bulk_q bulk_update_q = TAILQ_HEAD_INITIALIZER(bulk_update_q);
+static struct bulk_q bulk_print_q = TAILQ_HEAD_INITIALIZER(bulk_print_q);
+static pthread_mutex_t bulk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bulk_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bulk_print_cv = PTHREAD_COND_INITIALIZER;
+static int bulk_window;
+static int bulk_inflight;	/* sets holding a window slot */
+static int bulk_lookups;	/* lookups with replies still to come */
+static int bulk_dir_done;
+static int bulk_finished;
+static uint64_t bulk_progress;
+static long bulk_sets, bulk_errors, bulk_inconsistent;
+
+/*
+ * Names of the sets already printed. A set matched by more than one
+ * pattern may be looked up again after its first copy was deleted.
+ */
+struct bulk_name {
+	struct rbn rbn;
+	char name[];
+};
+static int bulk_name_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+static struct rbt bulk_printed = RBT_INITIALIZER(bulk_name_cmp);
+
+static int bulk_printed_add(const char *name)
+{
+	struct bulk_name *bn;
+
+	if (rbt_find(&bulk_printed, name))
+		return EEXIST;
+	bn = malloc(sizeof(*bn) + strlen(name) + 1);
+	if (!bn) {
+		printf("ldms_ls: Out of memory\n");
+		exit(1);
+	}
+	strcpy(bn->name, name);
+	rbn_init(&bn->rbn, bn->name);
+	rbt_ins(&bulk_printed, &bn->rbn);
+	return 0;
+}
+
+static void bulk_print_queue(struct bulk_set *bs, int status)
+{
+	pthread_mutex_lock(&bulk_lock);
+	bs->status = status;
+	TAILQ_INSERT_TAIL(&bulk_print_q, bs, entry);
+	bulk_progress++;
+	pthread_cond_signal(&bulk_print_cv);
+	pthread_mutex_unlock(&bulk_lock);
+}
+
+static void bulk_update_cb(ldms_t t, ldms_set_t s, int rc, void *arg)
+{
+	struct bulk_set *bs = arg;
+	int err = LDMS_UPD_ERROR(rc);
+
+	if (!err && (rc & LDMS_UPD_F_MORE))
+		return;
+	bulk_print_queue(bs, err);
+}
+
+static void bulk_lookup_cb(ldms_t t, enum ldms_lookup_status status,
+			   int more, ldms_set_t s, void *arg)
+{
+	struct bulk_set *req = arg;
+	struct bulk_set *bs = req;
+	int update = 0;
+	int rc;
+
+	if (!req->has_slot) {
+		/* A server-side match, it waits for a window slot */
+		bs = calloc(1, sizeof(*bs));
+		if (!bs) {
+			printf("ldms_ls: Out of memory\n");
+			exit(1);
+		}
+		bs->name = req->name;
+	}
+	/* On error, s is not ours to delete */
+	bs->s = status ? NULL : s;
+	pthread_mutex_lock(&bulk_lock);
+	bulk_progress++;
+	if (!more)
+		bulk_lookups--;
+	if (status == EEXIST && !bs->has_slot) {
+		/* Matched by another pattern too, it is printed once */
+		free(bs);
+		bs = NULL;
+	} else if (status) {
+		bs->status = status;
+		TAILQ_INSERT_TAIL(&bulk_print_q, bs, entry);
+		pthread_cond_signal(&bulk_print_cv);
+	} else if (!bs->has_slot) {
+		/* The main thread may take it as soon as it is queued */
+		TAILQ_INSERT_TAIL(&bulk_update_q, bs, entry);
+	} else {
+		update = 1;
+	}
+	pthread_cond_signal(&bulk_cv);
+	pthread_mutex_unlock(&bulk_lock);
+	if (req != bs && !more)
+		free(req);
+
+	if (update) {
+		rc = ldms_xprt_update(s, bulk_update_cb, bs);
+		if (rc)
+			bulk_print_queue(bs, rc);
+	}
+}
+
+static void bulk_dir_cb(ldms_t t, int status, ldms_dir_t _dir, void *cb_arg)
+{
+	struct bulk_set *bs;
+	int i;
+
+	pthread_mutex_lock(&bulk_lock);
+	if (status) {
+		dir_status = status;
+		goto wakeup;
+	}
+	__add_dir(_dir);
+	for (i = 0; i < _dir->set_count; i++) {
+		bs = calloc(1, sizeof(*bs));
+		if (!bs) {
+			dir_status = ENOMEM;
+			goto wakeup;
+		}
+		bs->name = _dir->set_data[i].inst_name;
+		TAILQ_INSERT_TAIL(&bulk_name_q, bs, entry);
+	}
+	if (_dir->more)
+		goto out;
+ wakeup:
+	bulk_dir_done = 1;
+ out:
+	bulk_progress++;
+	pthread_cond_signal(&bulk_cv);
+	pthread_mutex_unlock(&bulk_lock);
+}
+
+static void bulk_print(struct bulk_set *bs)
+{
+	if (bs->status) {
+		bulk_errors++;
+		if (!bs->s && bs->status == ENOENT)
+			printf("ldms_ls: No metric sets matched '%s'\n\n",
+			       bs->name);
+		else if (!bs->s)
+			printf("%s: Error %d looking up metric set.\n\n",
+			       bs->name, bs->status);
+		else
+			printf("%s: Error %x updating metric set.\n\n",
+			       ldms_set_instance_name_get(bs->s), bs->status);
+	} else if (!bulk_printed_add(ldms_set_instance_name_get(bs->s))) {
+		bulk_sets++;
+		if (!ldms_set_is_consistent(bs->s))
+			bulk_inconsistent++;
+		print_update(bs->s, 0);
+		printf("\n");
+	}
+	if (bs->s)
+		ldms_set_delete(bs->s);
+}
+
+static void *bulk_print_proc(void *arg)
+{
+	struct bulk_set *bs;
+
+	pthread_mutex_lock(&bulk_lock);
+	while (1) {
+		bs = TAILQ_FIRST(&bulk_print_q);
+		if (!bs) {
+			if (bulk_finished)
+				break;
+			pthread_cond_wait(&bulk_print_cv, &bulk_lock);
+			continue;
+		}
+		TAILQ_REMOVE(&bulk_print_q, bs, entry);
+		pthread_mutex_unlock(&bulk_lock);
+		bulk_print(bs);
+		pthread_mutex_lock(&bulk_lock);
+		if (bs->has_slot)
+			bulk_inflight--;
+		bulk_progress++;
+		pthread_cond_signal(&bulk_cv);
+		free(bs);
+	}
+	pthread_mutex_unlock(&bulk_lock);
+	fflush(stdout);
+	return NULL;
+}
+
+/*
+ * Issue the queued lookups and updates as window slots become free,
+ * until every set has been printed.
+ */
+static void bulk_run(ldms_t ldms, int waitsecs)
+{
+	struct bulk_set *bs;
+	struct timespec ts;
+	uint64_t progress;
+	pthread_t thr;
+	int rc;
+
+	rc = pthread_create(&thr, NULL, bulk_print_proc, NULL);
+	if (rc) {
+		printf("ldms_ls: Error %d creating the printer thread\n", rc);
+		exit(1);
+	}
+	pthread_mutex_lock(&bulk_lock);
+	while (1) {
+		if (bulk_inflight < bulk_window) {
+			/* The sets already looked up go first */
+			bs = TAILQ_FIRST(&bulk_update_q);
+			if (bs) {
+				TAILQ_REMOVE(&bulk_update_q, bs, entry);
+				bs->has_slot = 1;
+				bulk_inflight++;
+				pthread_mutex_unlock(&bulk_lock);
+				rc = ldms_xprt_update(bs->s, bulk_update_cb, bs);
+				if (rc)
+					bulk_print_queue(bs, rc);
+				pthread_mutex_lock(&bulk_lock);
+				continue;
+			}
+			bs = TAILQ_FIRST(&bulk_name_q);
+			if (bs) {
+				TAILQ_REMOVE(&bulk_name_q, bs, entry);
+				bs->has_slot = 1;
+				bulk_inflight++;
+				bulk_lookups++;
+				pthread_mutex_unlock(&bulk_lock);
+				rc = ldms_xprt_lookup(ldms, bs->name, 0,
+						      bulk_lookup_cb, bs);
+				if (rc) {
+					pthread_mutex_lock(&bulk_lock);
+					bulk_lookups--;
+					pthread_mutex_unlock(&bulk_lock);
+					bulk_print_queue(bs, rc);
+				}
+				pthread_mutex_lock(&bulk_lock);
+				continue;
+			}
+		}
+		if (bulk_dir_done && !bulk_lookups && !bulk_inflight &&
+		    TAILQ_EMPTY(&bulk_update_q) && TAILQ_EMPTY(&bulk_name_q))
+			break;
+		progress = bulk_progress;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += waitsecs;
+		rc = pthread_cond_timedwait(&bulk_cv, &bulk_lock, &ts);
+		if (rc == ETIMEDOUT && progress == bulk_progress)
+			server_timeout();
+	}
+	bulk_finished = 1;
+	pthread_cond_signal(&bulk_print_cv);
+	pthread_mutex_unlock(&bulk_lock);
+	pthread_join(thr, NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	struct ldms_version version;
@@ -743,6 +1032,13 @@ int main(int argc, char *argv[])
 							version.flags);
 			exit(0);
 			break;
+		case 'B':
+			bulk_window = atoi(optarg);
+			if (bulk_window < 1) {
+				printf("ERROR: -B %s invalid window\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'P':
 			lu_cb_fn = lookup_push_cb;
 			long_format = 1;
@@ -770,6 +1066,11 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (bulk_window && lu_cb_fn == lookup_push_cb) {
+		printf("ERROR: -B and -P cannot be used together\n");
+		exit(1);
+	}
+
 	h = gethostbyname(hostname);
 	if (!h) {
 		herror(argv[0]);
@@ -838,6 +1139,60 @@ int main(int argc, char *argv[])
 	if (regex)
 		flags |= LDMS_LOOKUP_RE;
 
+	if (bulk_window) {
+		struct timespec start, end;
+		struct bulk_set *req;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (optind == argc) {
+			ret = ldms_xprt_dir(ldms, bulk_dir_cb, NULL, 0);
+			if (ret) {
+				printf("ldms_dir returned synchronous error %d\n",
+				       ret);
+				exit(1);
+			}
+		} else {
+			/* The server matches the names */
+			bulk_dir_done = 1;
+			if (schema)
+				flags |= LDMS_LOOKUP_BY_SCHEMA;
+			for (i = optind; i < argc; i++) {
+				req = calloc(1, sizeof(*req));
+				if (!req) {
+					perror("ldms: ");
+					exit(2);
+				}
+				req->name = argv[i];
+				pthread_mutex_lock(&bulk_lock);
+				bulk_lookups++;
+				pthread_mutex_unlock(&bulk_lock);
+				ret = ldms_xprt_lookup(ldms, argv[i], flags,
+						       bulk_lookup_cb, req);
+				if (ret) {
+					pthread_mutex_lock(&bulk_lock);
+					bulk_lookups--;
+					pthread_mutex_unlock(&bulk_lock);
+					bulk_print_queue(req, ret);
+				}
+			}
+		}
+		bulk_run(ldms, waitsecs);
+		if (dir_status) {
+			printf("Error %d looking up the metric set directory.\n",
+			       dir_status);
+			exit(3);
+		}
+		if (verbose) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			printf("Total Sets: %ld, Errors: %ld, Inconsistent: %ld, "
+			       "Elapsed (s): %.3f\n", bulk_sets, bulk_errors,
+			       bulk_inconsistent, (end.tv_sec - start.tv_sec) +
+			       (end.tv_nsec - start.tv_nsec) / 1e9);
+		}
+		done = 1;
+		goto done;
+	}
+
 	if (verbose) {
 		printf("%-*s %-*s %-*s %-*s %-*s %-*s %-*s %-*s %-*s %-*s %-*s\n",
 		       14, "Schema",
@@ -1023,5 +1378,5 @@ done:
 	}
 
 	ldms_xprt_close(ldms);
-	exit(0);
+	exit(bulk_errors ? 1 : 0);
 }
@@ -381,6 +381,23 @@ static void help_udata_regex()
 		"                    to the base value.\n");
 }
 
+static void help_shm_set_add()
+{
+	printf( "\nPublish a set that an external process maintains in shared memory.\n"
+		"Parameters:\n"
+		"     name=          The shared-memory object name, e.g. /myapp.metrics\n"
+		"     [producer=]    The producer name of the set. The default is the\n"
+		"                    producer name recorded in the set or, if empty,\n"
+		"                    the ldmsd name.\n");
+}
+
+static void help_shm_set_del()
+{
+	printf( "\nUnpublish and detach from a shared-memory set.\n"
+		"Parameters:\n"
+		"     name=          The shared-memory object name\n");
+}
+
 static void help_oneshot()
 {
 	printf( "\nSchedule a one-shot sample event\n\n"
@@ -566,6 +583,19 @@ void __print_prdcr_status(json_value *jvalue)
 	}
 }
 
+/*
+ * A paged status reply carries the cursor of the next page after the
+ * status attribute.
+ */
+static void __print_next_cursor(ldmsd_req_attr_t attr)
+{
+	for (attr = ldmsd_next_attr(attr); attr->discrim;
+	     attr = ldmsd_next_attr(attr)) {
+		if (attr->attr_id == LDMSD_ATTR_CURSOR)
+			printf("next cursor=%s\n", (char *)attr->attr_value);
+	}
+}
+
 static void resp_prdcr_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
 {
 	if (rsp_err) {
@@ -577,7 +607,7 @@ static void resp_prdcr_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err
 		return;
 
 	json_value *json, *prdcr_json;
-	json = json_parse((char*)attr->attr_value, len);
+	json = json_parse((char*)attr->attr_value, attr->attr_len);
 	if (!json)
 		return;
 
@@ -595,11 +625,17 @@ static void resp_prdcr_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err
 		__print_prdcr_status(prdcr_json);
 	}
 	json_value_free(json);
+	__print_next_cursor(attr);
 }
 
 static void help_prdcr_status()
 {
-	printf( "\nGet status of all producers\n");
+	printf( "\nGet status of all producers\n"
+		"Parameters:\n"
+		"     [name=]        Producer name\n"
+		"     [regex=]       A regular expression matching producer names\n"
+		"     [limit=]       The maximum number of producers in the reply\n"
+		"     [cursor=]      Resume after the producers of the previous reply\n");
 }
 
 void __print_prdcr_set_status(json_value *jvalue)
@@ -640,6 +676,44 @@ void __print_prdcr_set_status(json_value *jvalue)
 			name, schema, state, origin, prdcr, ts, dur);
 }
 
+static void __print_prdcr_set_status_bin(ldmsd_req_attr_t attr)
+{
+	struct ldmsd_prdcr_set_status_rec *rec;
+	char *name, *schema, *origin, *prdcr, *end;
+	size_t off, rec_len;
+	char ts[64];
+	char dur[64];
+
+	for (off = 0; off + sizeof(*rec) <= attr->attr_len; off += rec_len) {
+		rec = (void *)&attr->attr_value[off];
+		rec_len = ntohl(rec->rec_len);
+		if (rec_len <= sizeof(*rec) || off + rec_len > attr->attr_len)
+			goto einval;
+		end = (char *)rec + rec_len;
+		name = rec->names;
+		schema = name + strnlen(name, end - name) + 1;
+		if (schema >= end)
+			goto einval;
+		origin = schema + strnlen(schema, end - schema) + 1;
+		if (origin >= end)
+			goto einval;
+		prdcr = origin + strnlen(origin, end - origin) + 1;
+		if (prdcr >= end || end[-1] != '\0')
+			goto einval;
+		snprintf(ts, 63, "%" PRIu32 " [%" PRIu32 "]",
+			 ntohl(rec->ts_sec), ntohl(rec->ts_usec));
+		snprintf(dur, 63, "%" PRIu32 ".%06" PRIu32,
+			 ntohl(rec->dur_sec), ntohl(rec->dur_usec));
+		printf("%-20s %-16s %-10s %-16s %-16s %-25s %-12s\n",
+			name, schema,
+			ldmsd_prdcr_set_state_str(ntohl(rec->state)),
+			origin, prdcr, ts, dur);
+	}
+	return;
+einval:
+	printf("---Invalid producer set status record---\n");
+}
+
 static void resp_prdcr_set_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
 {
 	if (rsp_err) {
@@ -647,16 +721,21 @@ static void resp_prdcr_set_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp
 		return;
 	}
 	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
-	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
+	if (!attr->discrim)
 		return;
-	json_value *json, *prdcr_json;
-	json = json_parse((char*)attr->attr_value, len);
-	if (!json)
+	if (attr->attr_id != LDMSD_ATTR_JSON &&
+	    attr->attr_id != LDMSD_ATTR_BINARY)
 		return;
+	json_value *json = NULL, *prdcr_json;
+	if (attr->attr_id == LDMSD_ATTR_JSON) {
+		json = json_parse((char*)attr->attr_value, attr->attr_len);
+		if (!json)
+			return;
 
-	if (json->type != json_array) {
-		printf("Unrecognized producer set status format\n");
-		return;
+		if (json->type != json_array) {
+			printf("Unrecognized producer set status format\n");
+			return;
+		}
 	}
 	int i;
 
@@ -665,16 +744,30 @@ static void resp_prdcr_set_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp
 	printf("-------------------- ---------------- ---------- ---------------- "
 			"---------------- ------------------------- ---------------\n");
 
-	for (i = 0; i < json->u.array.length; i++) {
-		prdcr_json = ldmsctl_json_array_ele_get(json, i);
-		__print_prdcr_set_status(prdcr_json);
+	if (!json) {
+		__print_prdcr_set_status_bin(attr);
+	} else {
+		for (i = 0; i < json->u.array.length; i++) {
+			prdcr_json = ldmsctl_json_array_ele_get(json, i);
+			__print_prdcr_set_status(prdcr_json);
+		}
+		json_value_free(json);
 	}
-	json_value_free(json);
+	__print_next_cursor(attr);
 }
 
 static void help_prdcr_set_status()
 {
-	printf( "\nGet status of all producer sets\n");
+	printf( "\nGet status of all producer sets\n"
+		"Parameters:\n"
+		"     [producer=]    Producer name\n"
+		"     [regex=]       A regular expression matching producer names\n"
+		"     [instance=]    Instance name\n"
+		"     [schema=]      Schema name\n"
+		"     [state=]       Set state, e.g. READY\n"
+		"     [limit=]       The maximum number of sets in the reply\n"
+		"     [cursor=]      Resume after the sets of the previous reply\n"
+		"     [format=]      json (default) or binary\n");
 }
 
 static void __print_prdcr_hint_tree(json_value *prdcr_json)
@@ -761,6 +854,10 @@ static void help_updtr_add()
 		"                       updater will schedule the set updates according to\n"
 		"                       the given interval and offset values. If not\n"
 		"                       specified, the value is `false`.\n"
+		"    [conditional=]     [true|false] If true, only the data header of a\n"
+		"                       set is read first and the data is read only if\n"
+		"                       it has changed since the last update. If not\n"
+		"                       specified, the value is `false`.\n"
 		);
 
 }
@@ -954,7 +1051,7 @@ static void resp_updtr_task(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
 	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
 	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
 		return;
-	json = json_parse((char*)attr->attr_value, len);
+	json = json_parse((char*)attr->attr_value, attr->attr_len);
 	if (!json)
 		return;
 	if (json->type != json_array) {
@@ -966,13 +1063,17 @@ static void resp_updtr_task(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
 		__print_updtr_task(updtr);
 	}
 	json_value_free(json);
+	__print_next_cursor(attr);
 }
 
 static void help_updtr_task()
 {
 	printf("\bGet the tasks of an update\n"
 	       "Parameters:\n"
-	       "      [name=]     The updater policy name\n");
+	       "      [name=]     The updater policy name\n"
+	       "      [regex=]    A regular expression matching updater names\n"
+	       "      [limit=]    The maximum number of updaters in the reply\n"
+	       "      [cursor=]   Resume after the updaters of the previous reply\n");
 }
 
 static void help_strgp_add()
@@ -983,7 +1084,23 @@ static void help_strgp_add()
 		"     name=        The unique storage policy name.\n"
 		"     plugin=      The name of the storage backend.\n"
 		"     container=   The storage backend container name.\n"
-		"     schema=      The schema name of the metric set to store.\n");
+		"     schema=      The schema name of the metric set to store.\n"
+		"     [history=]   Keep the recent rows in memory up to this size,\n"
+		"                  e.g. 64M, see strgp_history.\n"
+		"     [downsample=] Store one row per set per window of this many\n"
+		"                  microseconds, aligned to the wall clock.\n"
+		"     [downsample_op=] The aggregate of each metric over a window:\n"
+		"                  a comma-separated list of mean, min, max, last\n"
+		"                  or rate, each one followed by :<metric> to apply\n"
+		"                  it to that metric only. The default is mean.\n"
+		"     [deadband=]  Store a row only if a metric changed by more\n"
+		"                  than a threshold since the last row stored for\n"
+		"                  the set: a comma-separated list of differences,\n"
+		"                  or percentages followed by %, each one followed\n"
+		"                  by :<metric> to apply it to that metric only.\n"
+		"                  0 stores any change, and is the default.\n"
+		"     [heartbeat=] With a deadband, store at least one row of a\n"
+		"                  set in this many.\n");
 }
 
 static void help_strgp_del()
@@ -1043,6 +1160,64 @@ static void help_strgp_stop()
 		"     name=   The storage policy name\n");
 }
 
+static long __json_int_get(json_value *obj, const char *name)
+{
+	json_value *v = ldmsctl_json_value_get(obj, name);
+	if (!v || v->type != json_integer)
+		return 0;
+	return v->u.integer;
+}
+
+static void help_prdcr_conn_config()
+{
+	printf( "\nSet how the producers connect and report the connection\n"
+		"state. Without parameters, only report.\n\n"
+		"Parameters:\n"
+		"     [rate=]        The connect attempts per second of all\n"
+		"                    producers. 0, the default, is unlimited.\n"
+		"     [backoff_max=] The limit in micro-seconds of the reconnect\n"
+		"                    interval, doubled after each failed attempt.\n"
+		"                    0, the default, disables the backoff.\n");
+}
+
+static void resp_prdcr_conn_config(ldmsd_req_hdr_t resp, size_t len,
+				   uint32_t rsp_err)
+{
+	ldmsd_req_attr_t attr;
+	json_value *json;
+	long ramp_us;
+
+	if (rsp_err) {
+		resp_generic(resp, len, rsp_err);
+		return;
+	}
+	attr = ldmsd_first_attr(resp);
+	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
+		return;
+	json = json_parse((char*)attr->attr_value, len);
+	if (!json)
+		return;
+	if (json->type != json_object) {
+		printf("Unrecognized producer connection format\n");
+		goto out;
+	}
+	ramp_us = __json_int_get(json, "ramp_us");
+	printf("rate: %ld/s, backoff_max: %ld us\n",
+	       __json_int_get(json, "rate"),
+	       __json_int_get(json, "backoff_max"));
+	printf("connected: %ld/%ld, %s %ld.%06ld s\n",
+	       __json_int_get(json, "connected"),
+	       __json_int_get(json, "started"),
+	       __json_int_get(json, "ramping") ? "connecting for" :
+						 "all connected in",
+	       ramp_us / 1000000, ramp_us % 1000000);
+	printf("host names: %ld cached, %ld being resolved\n",
+	       __json_int_get(json, "resolved"),
+	       __json_int_get(json, "resolving"));
+out:
+	json_value_free(json);
+}
+
 void __print_strgp_status(json_value *jvalue)
 {
 	if (jvalue->type != json_object) {
@@ -1095,6 +1270,164 @@ void __print_strgp_status(json_value *jvalue)
 		printf(" %s", metric_jvalue->u.string.ptr);
 	}
 	printf("\n");
+
+	json_value *hist = ldmsctl_json_value_get(jvalue, "history");
+	if (hist && hist->type == json_object) {
+		printf("     history: %ld/%ld bytes, %ld series, %ld rows, "
+		       "%ld dropped, %ld blocks evicted\n",
+		       __json_int_get(hist, "bytes"),
+		       __json_int_get(hist, "budget"),
+		       __json_int_get(hist, "series"),
+		       __json_int_get(hist, "rows"),
+		       __json_int_get(hist, "dropped"),
+		       __json_int_get(hist, "evicted"));
+	}
+
+	json_value *ds = ldmsctl_json_value_get(jvalue, "downsample");
+	if (ds && ds->type == json_object) {
+		json_value *op = ldmsctl_json_value_get(ds, "op");
+		printf("     downsample: %ld usec %s, %ld series, %ld samples, "
+		       "%ld rows, %ld late, %ld resets, %ld expired\n",
+		       __json_int_get(ds, "window"),
+		       (op && op->type == json_string) ? op->u.string.ptr : "",
+		       __json_int_get(ds, "series"),
+		       __json_int_get(ds, "samples"),
+		       __json_int_get(ds, "rows"),
+		       __json_int_get(ds, "late"),
+		       __json_int_get(ds, "resets"),
+		       __json_int_get(ds, "expired"));
+	}
+
+	json_value *db = ldmsctl_json_value_get(jvalue, "deadband");
+	if (db && db->type == json_object) {
+		json_value *spec = ldmsctl_json_value_get(db, "spec");
+		printf("     deadband: %s heartbeat %ld, %ld series, %ld stored, "
+		       "%ld suppressed (%ld unchanged), %ld heartbeats\n",
+		       (spec && spec->type == json_string) ? spec->u.string.ptr : "",
+		       __json_int_get(db, "heartbeat"),
+		       __json_int_get(db, "series"),
+		       __json_int_get(db, "stored"),
+		       __json_int_get(db, "suppressed"),
+		       __json_int_get(db, "unchanged"),
+		       __json_int_get(db, "heartbeats"));
+	}
+}
+
+static uint32_t __hist_u32(char **p, char *end)
+{
+	uint32_t v;
+	if (end - *p < sizeof(v))
+		return 0;
+	memcpy(&v, *p, sizeof(v));
+	*p += sizeof(v);
+	return ntohl(v);
+}
+
+static char *__hist_str(char **p, char *end)
+{
+	uint32_t len = __hist_u32(p, end);
+	char *s = *p;
+	if (!len || end - *p < len || s[len - 1] != '\0')
+		return NULL;
+	*p += len;
+	return s;
+}
+
+static uint64_t __hist_u64(char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return be64toh(v);
+}
+
+static void resp_strgp_history(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
+{
+	struct ldmsd_history_hdr hdr;
+	uint32_t i, j, c, rows, mcount, scount;
+	uint32_t *types = NULL;
+	char **names = NULL;
+	char *p, *end, *series;
+	uint64_t v;
+	union {
+		uint64_t u;
+		double d;
+	} dv;
+
+	if (rsp_err) {
+		resp_generic(resp, len, rsp_err);
+		return;
+	}
+	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
+	if (!attr->discrim || attr->attr_id != LDMSD_ATTR_BINARY)
+		return;
+	p = (char *)attr->attr_value;
+	end = p + attr->attr_len;
+	if (attr->attr_len < sizeof(hdr))
+		goto einval;
+	memcpy(&hdr, p, sizeof(hdr));
+	if (ntohl(hdr.magic) != LDMSD_HISTORY_MAGIC ||
+	    ntohl(hdr.version) != LDMSD_HISTORY_VERSION)
+		goto einval;
+	p += sizeof(hdr);
+	mcount = ntohl(hdr.metric_count);
+	scount = ntohl(hdr.series_count);
+	types = calloc(mcount + 1, sizeof(*types));
+	names = calloc(mcount + 1, sizeof(*names));
+	if (!types || !names) {
+		printf("Out of memory\n");
+		goto out;
+	}
+	for (c = 0; c < mcount; c++) {
+		types[c] = __hist_u32(&p, end);
+		names[c] = __hist_str(&p, end);
+		if (!names[c])
+			goto einval;
+	}
+	for (i = 0; i < scount; i++) {
+		series = __hist_str(&p, end);
+		if (!series)
+			goto einval;
+		rows = __hist_u32(&p, end);
+		if ((end - p) / sizeof(uint64_t) / (mcount + 1) < rows)
+			goto einval;
+		printf("%s\n%-28s", series, "    timestamp");
+		for (c = 0; c < mcount; c++)
+			printf(" %16s", names[c]);
+		printf("\n");
+		for (j = 0; j < rows; j++) {
+			v = __hist_u64(p + j * sizeof(uint64_t));
+			printf("    %10" PRIu64 ".%06" PRIu64 "       ",
+			       v / 1000000, v % 1000000);
+			for (c = 0; c < mcount; c++) {
+				v = __hist_u64(p + ((c + 1) * rows + j) *
+						   sizeof(uint64_t));
+				switch (types[c]) {
+				case LDMS_V_F32:
+				case LDMS_V_D64:
+					dv.u = v;
+					printf(" %16g", dv.d);
+					break;
+				case LDMS_V_S8:
+				case LDMS_V_S16:
+				case LDMS_V_S32:
+				case LDMS_V_S64:
+					printf(" %16" PRId64, (int64_t)v);
+					break;
+				default:
+					printf(" %16" PRIu64, v);
+					break;
+				}
+			}
+			printf("\n");
+		}
+		p += (mcount + 1) * rows * sizeof(uint64_t);
+	}
+	goto out;
+einval:
+	printf("---Invalid strgp history reply---\n");
+out:
+	free(types);
+	free(names);
 }
 
 static void resp_strgp_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
@@ -1107,7 +1440,7 @@ static void resp_strgp_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err
 	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
 		return;
 	json_value *json, *prdcr_json;
-	json = json_parse((char*)attr->attr_value, len);
+	json = json_parse((char*)attr->attr_value, attr->attr_len);
 	if (!json)
 		return;
 
@@ -1125,14 +1458,28 @@ static void resp_strgp_status(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err
 		__print_strgp_status(prdcr_json);
 	}
 	json_value_free(json);
+	__print_next_cursor(attr);
+}
 
+static void help_strgp_history()
+{
+	printf("\nGet the recent rows kept by a storage policy with a history\n"
+	       "Parameters:\n"
+	       "      name=       The storage policy name\n"
+	       "      [instance=] A regular expression matching set instance names\n"
+	       "      [metric=]   A comma separated list of metric names\n"
+	       "      [begin=]    Seconds since the epoch, or before now if negative\n"
+	       "      [end=]      Seconds since the epoch, or before now if negative\n");
 }
 
 static void help_strgp_status()
 {
 	printf("\nGet the statuses of all Storage policies\n"
 	       "Parameters:\n"
-	       "      None\n");
+	       "      [name=]     The storage policy name\n"
+	       "      [regex=]    A regular expression matching policy names\n"
+	       "      [limit=]    The maximum number of policies in the reply\n"
+	       "      [cursor=]   Resume after the policies of the previous reply\n");
 }
 
 static void __print_plugn_sets(json_value *plugin_sets)
@@ -1193,6 +1540,93 @@ static void help_version()
 	printf( "\nGet the LDMS version.\n");
 }
 
+static void __print_update_stats(json_value *obj)
+{
+	json_value *updt, *store, *lag;
+	char *name;
+
+	name = ldmsctl_json_str_value_get(obj, "name");
+	updt = ldmsctl_json_value_get(obj, "update");
+	store = ldmsctl_json_value_get(obj, "store");
+	lag = ldmsctl_json_value_get(obj, "push_lag");
+	if (!name || !updt || !store || !lag)
+		return;
+	printf("%-24s %10ld %8ld %8ld %8ld %10ld %8ld %8ld %8ld %8ld %8ld %8ld "
+	       "%8ld %13ld\n",
+		name, __json_int_get(updt, "count"),
+		__json_int_get(updt, "p50_usec"),
+		__json_int_get(updt, "p99_usec"),
+		__json_int_get(updt, "max_usec"),
+		__json_int_get(store, "count"),
+		__json_int_get(store, "p99_usec"),
+		__json_int_get(lag, "p99_usec"),
+		__json_int_get(obj, "oversampled"),
+		__json_int_get(obj, "inconsistent"),
+		__json_int_get(obj, "skipped"),
+		__json_int_get(obj, "errors"),
+		__json_int_get(obj, "not_modified"),
+		__json_int_get(obj, "bytes_avoided"));
+}
+
+static void resp_update_stats(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
+{
+	if (rsp_err) {
+		resp_generic(resp, len, rsp_err);
+		return;
+	}
+	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
+	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
+		return;
+
+	json_value *json;
+	json = json_parse((char*)attr->attr_value, attr->attr_len);
+	if (!json)
+		return;
+
+	if (json->type != json_array) {
+		printf("Unrecognized update statistics format\n");
+		json_value_free(json);
+		return;
+	}
+	int i;
+
+	printf("                         ---------- update (usec) --------- "
+	       "- store (usec) ---- push     ------------ counts ------------ "
+	       "- conditional ---------\n");
+	printf("Name                          count      p50      p99      max "
+	       "     count      p99  lag p99  ovrsmpl incnsist  skipped   errors "
+	       "  notmod bytes avoided\n");
+	printf("------------------------ ---------- -------- -------- -------- "
+	       "---------- -------- -------- -------- -------- -------- -------- "
+	       "-------- -------------\n");
+	for (i = 0; i < json->u.array.length; i++)
+		__print_update_stats(ldmsctl_json_array_ele_get(json, i));
+	json_value_free(json);
+	__print_next_cursor(attr);
+}
+
+static void help_update_stats()
+{
+	printf( "\nGet the update latency statistics\n"
+		"Parameters:\n"
+		"     [type=]        prdcr (default), updtr or set\n"
+		"     [regex=]       A regular expression matching producer or\n"
+		"                    updater names\n"
+		"     [instance=]    Set instance name, for type=set\n"
+		"     [limit=]       The maximum number of objects in the reply\n"
+		"     [cursor=]      Resume after the objects of the previous reply\n");
+}
+
+static void help_update_stats_config()
+{
+	printf( "\nTurn the update latency statistics on or off\n"
+		"Parameters:\n"
+		"     state=         on or off\n"
+		"     [interval=]    The interval in micro-seconds at which the\n"
+		"                    per-producer statistics sets are refreshed.\n"
+		"                    The default is 1000000. 0 disables the sets.\n");
+}
+
 static void help_set_route()
 {
 	printf("\nDisplay the route of the set from aggregators to the sampler daemon.\n"
@@ -1479,6 +1913,7 @@ static struct command command_tbl[] = {
 	{ "oneshot", LDMSD_ONESHOT_REQ, NULL, help_oneshot, resp_generic },
 	{ "plugn_sets", LDMSD_PLUGN_SETS_REQ, NULL, help_plugn_sets, resp_plugn_sets },
 	{ "prdcr_add", LDMSD_PRDCR_ADD_REQ, NULL, help_prdcr_add, resp_generic },
+	{ "prdcr_conn_config", LDMSD_PRDCR_CONN_CONFIG_REQ, NULL, help_prdcr_conn_config, resp_prdcr_conn_config },
 	{ "prdcr_del", LDMSD_PRDCR_DEL_REQ, NULL, help_prdcr_del, resp_generic },
 	{ "prdcr_hint_tree", LDMSD_PRDCR_HINT_TREE_REQ, NULL, help_prdcr_hint_tree, resp_prdcr_hint_tree },
 	{ "prdcr_set_status", LDMSD_PRDCR_SET_REQ, NULL, help_prdcr_set_status, resp_prdcr_set_status },
@@ -1497,10 +1932,13 @@ static struct command command_tbl[] = {
 	{ "setgroup_mod", LDMSD_SETGROUP_MOD_REQ, NULL, help_setgroup_mod, resp_generic },
 	{ "setgroup_rm",  LDMSD_SETGROUP_RM_REQ,  NULL, help_setgroup_rm,  resp_generic },
 	{ "source", LDMSCTL_SOURCE, handle_source, help_source, resp_generic },
+	{ "shm_set_add", LDMSD_SHM_SET_ADD_REQ, NULL, help_shm_set_add, resp_generic },
+	{ "shm_set_del", LDMSD_SHM_SET_DEL_REQ, NULL, help_shm_set_del, resp_generic },
 	{ "start", LDMSD_PLUGN_START_REQ, NULL, help_start, resp_generic },
 	{ "stop", LDMSD_PLUGN_STOP_REQ, NULL, help_stop, resp_generic },
 	{ "strgp_add", LDMSD_STRGP_ADD_REQ, NULL, help_strgp_add, resp_generic },
 	{ "strgp_del", LDMSD_STRGP_DEL_REQ, NULL, help_strgp_del, resp_generic },
+	{ "strgp_history", LDMSD_STRGP_HISTORY_REQ, NULL, help_strgp_history, resp_strgp_history },
 	{ "strgp_metric_add", LDMSD_STRGP_METRIC_ADD_REQ, NULL, help_strgp_metric_add, resp_generic },
 	{ "strgp_metric_del", LDMSD_STRGP_METRIC_DEL_REQ, NULL, help_strgp_metric_del, resp_generic },
 	{ "strgp_prdcr_add", LDMSD_STRGP_PRDCR_ADD_REQ, NULL, help_strgp_prdcr_add, resp_generic },
@@ -1511,6 +1949,8 @@ static struct command command_tbl[] = {
 	{ "term", LDMSD_PLUGN_TERM_REQ, NULL, help_term, resp_generic },
 	{ "udata", LDMSD_SET_UDATA_REQ, NULL, help_udata, resp_generic },
 	{ "udata_regex", LDMSD_SET_UDATA_REGEX_REQ, NULL, help_udata_regex, resp_generic },
+	{ "update_stats", LDMSD_UPDATE_STATS_REQ, NULL, help_update_stats, resp_update_stats },
+	{ "update_stats_config", LDMSD_UPDATE_STATS_CONFIG_REQ, NULL, help_update_stats_config, resp_generic },
 	{ "updtr_add", LDMSD_UPDTR_ADD_REQ, NULL, help_updtr_add, resp_generic },
 	{ "updtr_del", LDMSD_UPDTR_DEL_REQ, NULL, help_updtr_del, resp_generic },
 	{ "updtr_match_add", LDMSD_UPDTR_MATCH_ADD_REQ, NULL, help_updtr_match_add, resp_generic },
@@ -47,6 +47,9 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <unistd.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -62,6 +65,8 @@
 #include <sys/fcntl.h>
 #include <sys/mman.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <netinet/in.h>
 #include <signal.h>
 #include <sys/un.h>
@@ -73,6 +78,7 @@
 #include <time.h>
 #include <coll/rbt.h>
 #include <coll/str_map.h>
+#include <mmalloc/mmalloc.h>
 #include "ldms.h"
 #include "ldmsd.h"
 #include "ldms_xprt.h"
@@ -92,7 +98,7 @@
 #define LDMSD_LOGFILE "/var/log/ldmsd.log"
 #define LDMSD_PIDFILE_FMT "/var/run/%s.pid"
 
-#define FMT "B:H:i:l:S:s:x:I:T:M:t:P:m:FkN:r:R:p:v:Vz:Z:q:c:u:a:A:n:"
+#define FMT "B:H:i:l:S:s:x:I:T:M:t:P:m:FkN:r:R:p:v:Vz:Z:q:c:u:a:A:n:E:C:"
 
 #define LDMSD_MEM_SIZE_ENV "LDMSD_MEM_SZ"
 #define LDMSD_MEM_SIZE_STR "512kB"
@@ -512,8 +518,13 @@ void usage_hint(char *argv[],char *hint)
 	printf("    -k	     Publish kernel metrics.\n");
 	printf("    -s setfile     Text file containing kernel metric sets to publish.\n"
 	       "		   [" LDMSD_SETFILE "]\n");
+	printf("    -E KEY=VALUE   Placement of the metric set memory (repeatable):\n"
+	       "		   hugepages=thp|explicit, mlock=1, shared=1,\n"
+	       "		   numa=interleave:NODES|bind:NODES|preferred:NODE\n");
 	printf("  Thread Options\n");
 	printf("    -P thr_count   Count of event threads to start.\n");
+	printf("    -C KEY=CPUS    Pin threads to a CPU list, e.g. 0-3,8 (repeatable):\n"
+	       "		   ldmsd=CPUS, zap=CPUS (event workers), io=CPUS\n");
 	printf("    -f count       The number of flush threads.\n");
 	printf("    -D num	 The dirty threshold.\n");
 	printf("  Test Options\n");
@@ -574,6 +585,171 @@ pthread_t get_thread(int idx)
 	return ev_thread[idx];
 }
 
+/*
+ * Placement of the set memory (-E) and of the threads (-C)
+ */
+static struct mem_opt {
+	const char *key;
+	const char *env;	/* read by mm_init() */
+} mem_opts[] = {
+	{ "hugepages",	"MMALLOC_HUGEPAGES" },
+	{ "mlock",	"MMALLOC_MLOCK" },
+	{ "shared",	"MMALLOC_SHARED" },
+	{ "numa",	"MMALLOC_NUMA" },
+};
+
+static char *cpus_ldmsd;	/* ldmsd threads */
+static char *cpus_zap;		/* zap event workers */
+static char *cpus_io;		/* transport I/O threads */
+
+/* -E KEY=VALUE */
+static int mem_opt_set(const char *arg)
+{
+	const char *val = strchr(arg, '=');
+	int i;
+
+	if (!val || !val[1])
+		return EINVAL;
+	for (i = 0; i < sizeof(mem_opts) / sizeof(mem_opts[0]); i++) {
+		if (strlen(mem_opts[i].key) != val - arg ||
+		    strncmp(arg, mem_opts[i].key, val - arg))
+			continue;
+		if (setenv(mem_opts[i].env, val + 1, 1))
+			return errno;
+		return 0;
+	}
+	return ENOENT;
+}
+
+/* -C ldmsd|zap|io=CPU_LIST */
+static int cpu_opt_set(const char *arg)
+{
+	const char *val = strchr(arg, '=');
+	cpu_set_t set;
+	char **cpus;
+
+	if (!val)
+		return EINVAL;
+	if (0 == strncmp(arg, "ldmsd=", 6))
+		cpus = &cpus_ldmsd;
+	else if (0 == strncmp(arg, "zap=", 4))
+		cpus = &cpus_zap;
+	else if (0 == strncmp(arg, "io=", 3))
+		cpus = &cpus_io;
+	else
+		return ENOENT;
+	if (ovis_cpulist_parse(val + 1, &set))
+		return EINVAL;
+	free(*cpus);
+	*cpus = strdup(val + 1);
+	return *cpus ? 0 : ENOMEM;
+}
+
+/*
+ * Pin the calling thread, which the threads ldmsd creates afterward inherit,
+ * and the zap threads.
+ */
+static void cpu_affinity_apply(void)
+{
+	cpu_set_t set;
+	int rc;
+
+	if (cpus_ldmsd) {
+		ovis_cpulist_parse(cpus_ldmsd, &set);
+		rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (rc)
+			ldmsd_log(LDMSD_LERROR, "Error %d pinning ldmsd to "
+				  "CPUs %s\n", rc, cpus_ldmsd);
+	}
+	if (cpus_zap) {
+		rc = zap_thread_affinity(ZAP_THREAD_EVENT, cpus_zap);
+		if (rc)
+			ldmsd_log(LDMSD_LERROR, "Error %d pinning the zap event "
+				  "workers to CPUs %s\n", rc, cpus_zap);
+	}
+	if (cpus_io) {
+		rc = zap_thread_affinity(ZAP_THREAD_IO, cpus_io);
+		if (rc)
+			ldmsd_log(LDMSD_LERROR, "Error %d pinning the transport "
+				  "I/O threads to CPUs %s\n", rc, cpus_io);
+	}
+}
+
+#define NUMA_SAMPLE_PAGES 64
+#define NUMA_SAMPLE_NODES 64
+
+/* Log where the set memory and the threads ended up */
+static void placement_report(void)
+{
+	struct mm_info mmi;
+	const char *env;
+	char buf[256];
+	cpu_set_t set;
+	int n;
+
+	mm_get_info(&mmi);
+	ldmsd_log(LDMSD_LINFO, "Set memory: %zu bytes, %zu-byte pages%s%s%s%s\n",
+		  mmi.size, mmi.page_size,
+		  mmi.fd >= 0 ? ", shared" : "",
+		  mmi.flags & MM_F_HUGETLB ? ", hugetlb" : "",
+		  mmi.flags & MM_F_THP ? ", transparent huge pages" : "",
+		  mmi.flags & MM_F_MLOCK ? ", locked" : "");
+	env = getenv("MMALLOC_HUGEPAGES");
+	if (env && !(mmi.flags & (MM_F_HUGETLB | MM_F_THP)))
+		ldmsd_log(LDMSD_LERROR, "Set memory: hugepages=%s could not "
+			  "be applied\n", env);
+	env = getenv("MMALLOC_MLOCK");
+	if (env && atoi(env) && !(mmi.flags & MM_F_MLOCK))
+		ldmsd_log(LDMSD_LERROR, "Set memory: mlock failed, "
+			  "check RLIMIT_MEMLOCK\n");
+	env = getenv("MMALLOC_NUMA");
+	if (env && !(mmi.flags & MM_F_NUMA))
+		ldmsd_log(LDMSD_LERROR, "Set memory: numa=%s could not "
+			  "be applied\n", env);
+	else if (env)
+		ldmsd_log(LDMSD_LINFO, "Set memory: NUMA policy %s\n", env);
+#ifdef SYS_move_pages
+	{
+		void *pages[NUMA_SAMPLE_PAGES];
+		int status[NUMA_SAMPLE_PAGES];
+		int nodes[NUMA_SAMPLE_NODES] = {0};
+		size_t npages = mmi.size / mmi.page_size;
+		size_t step = npages / NUMA_SAMPLE_PAGES + 1;
+		int i, absent = 0, off;
+
+		for (n = 0; n < NUMA_SAMPLE_PAGES && n * step < npages; n++)
+			pages[n] = (char *)mmi.start + n * step * mmi.page_size;
+		if (0 == syscall(SYS_move_pages, 0, n, pages, NULL, status, 0)) {
+			for (i = 0; i < n; i++) {
+				if (status[i] >= 0 && status[i] < NUMA_SAMPLE_NODES)
+					nodes[status[i]]++;
+				else
+					absent++;
+			}
+			off = 0;
+			buf[0] = '\0';
+			for (i = 0; i < NUMA_SAMPLE_NODES; i++) {
+				if (nodes[i] && off < sizeof(buf))
+					off += snprintf(buf + off, sizeof(buf) - off,
+							" node%d=%d", i, nodes[i]);
+			}
+			ldmsd_log(LDMSD_LINFO, "Set memory: %d sampled pages:%s "
+				  "not present=%d\n", n, buf, absent);
+		}
+	}
+#endif
+	if (0 == pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+		ovis_cpulist_str(&set, buf, sizeof(buf));
+		ldmsd_log(LDMSD_LINFO, "Threads: ldmsd on CPUs %s\n", buf);
+	}
+	n = zap_thread_affinity_str(ZAP_THREAD_EVENT, buf, sizeof(buf));
+	ldmsd_log(LDMSD_LINFO, "Threads: %d zap event workers on CPUs %s\n",
+		  n, buf);
+	n = zap_thread_affinity_str(ZAP_THREAD_IO, buf, sizeof(buf));
+	ldmsd_log(LDMSD_LINFO, "Threads: %d transport I/O threads on CPUs %s\n",
+		  n, buf);
+}
+
 void kpublish(int map_fd, int set_no, int set_size, char *set_name)
 {
 	ldms_set_t map_set;
@@ -1612,6 +1788,21 @@ int main(int argc, char *argv[])
 		case 'm':
 			max_mem_sz_str = strdup(optarg);
 			break;
+		case 'E':
+			if (mem_opt_set(optarg)) {
+				printf("ERROR: Expecting -E hugepages=thp|explicit, "
+				       "mlock=1, shared=1 or numa=interleave|bind|preferred:"
+				       "NODES, but got: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'C':
+			if (cpu_opt_set(optarg)) {
+				printf("ERROR: Expecting -C ldmsd|zap|io=CPU_LIST, "
+				       "but got: %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'q':
 			usage_hint(argv,"-q becomes -v in LDMS v3. Update your scripts.\n"
 				"This message will disappear in a future release.");
@@ -1653,6 +1844,9 @@ int main(int argc, char *argv[])
 				exit(1);
 			}
 			port++;
+			/* Peers on the shm transport map the set memory */
+			if (0 == strncmp(optarg, "shm:", 4))
+				setenv("MMALLOC_SHARED", "1", 0);
 			break;
 		case 'c':
 			/* Handle below */
@@ -1717,6 +1911,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	cpu_affinity_apply();
+
 	/* Initialize LDMS */
 	umask(0);
 	if (!max_mem_sz_str) {
@@ -1960,6 +2156,7 @@ int main(int argc, char *argv[])
 			break;
 		}
 	}
+	placement_report();
 
 	opterr = 0;
 	optind = 0;
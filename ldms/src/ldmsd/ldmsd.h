@@ -174,6 +174,9 @@ typedef void (*ldmsd_cfgobj_del_fn_t)(struct ldmsd_cfgobj *);
 /* can execute even if the failover is turned on */
 #define LDMSD_PERM_FAILOVER_ALLOWED 04000
 
+/* config change mirrored to the failover peer, allowed while failover runs */
+#define LDMSD_PERM_FAILOVER_SYNC 010000
+
 typedef struct ldmsd_cfgobj {
 	char *name;		/* Unique producer name */
 	uint32_t ref_count;
@@ -191,6 +194,45 @@ typedef struct ldmsd_prdcr_stream_s {
 	LIST_ENTRY(ldmsd_prdcr_stream_s) entry;
 } *ldmsd_prdcr_stream_t;
 
+/*
+ * Update latency histogram
+ *
+ * The buckets are log-linear in micro-seconds: values below 4 have a bucket
+ * each, then every power of two is split into 4 equal buckets. The last
+ * bucket also counts everything above its lower bound (~29 seconds).
+ * All fields are updated with atomic operations only.
+ */
+#define LDMSD_HIST_SUB_BITS 2
+#define LDMSD_HIST_BUCKETS 96
+typedef struct ldmsd_hist {
+	uint64_t count;
+	uint64_t sum;	/* usec */
+	uint64_t max;	/* usec */
+	uint64_t bucket[LDMSD_HIST_BUCKETS];
+} *ldmsd_hist_t;
+
+enum ldmsd_updt_stat {
+	LDMSD_UPDT_STAT_UPDATE,		/* update scheduled -> read complete */
+	LDMSD_UPDT_STAT_STORE,		/* read complete -> store complete */
+	LDMSD_UPDT_STAT_PUSH_LAG,	/* push arrival - sample timestamp */
+	LDMSD_UPDT_STAT_LAST,
+};
+
+enum ldmsd_updt_cnt {
+	LDMSD_UPDT_CNT_OVERSAMPLED,	/* no new data since the last update */
+	LDMSD_UPDT_CNT_INCONSISTENT,
+	LDMSD_UPDT_CNT_SKIPPED,		/* previous update still outstanding */
+	LDMSD_UPDT_CNT_ERROR,
+	LDMSD_UPDT_CNT_NOT_MODIFIED,	/* conditional update found no change */
+	LDMSD_UPDT_CNT_BYTES_AVOIDED,	/* data not read by them */
+	LDMSD_UPDT_CNT_LAST,
+};
+
+typedef struct ldmsd_updt_stats {
+	struct ldmsd_hist hist[LDMSD_UPDT_STAT_LAST];
+	uint64_t cnt[LDMSD_UPDT_CNT_LAST];
+} *ldmsd_updt_stats_t;
+
 /**
  * Producer: Named instance of an LDMSD
  *
@@ -231,6 +273,14 @@ typedef struct ldmsd_prdcr {
 
 	struct ldmsd_task task;
 
+	/* connection scheduling, see prdcr_task_cb() */
+	int conn_attempts;	/* connect attempts since the last connect */
+	uint64_t conn_slot_us;	/* connect slot reserved on the ramp */
+	int conn_started;	/* counted as started in the ramp */
+	int conn_connected;	/* counted as connected in the ramp */
+	int resolve_wait;	/* waiting for the host name lookup */
+	LIST_ENTRY(ldmsd_prdcr) resolve_entry;
+
 	/**
 	 * list of subscribed streams from this producer
 	 */
@@ -252,6 +302,9 @@ typedef struct ldmsd_prdcr {
 #ifdef LDMSD_UPDATE_TIME
 	double sched_update_time;
 #endif /* LDMSD_UPDATE_TIME */
+	/* update statistics of all sets, allocated when first used */
+	ldmsd_updt_stats_t updt_stats;
+	ldms_set_t updt_stats_set;
 } *ldmsd_prdcr_t;
 
 struct ldmsd_strgp;
@@ -259,6 +312,7 @@ typedef struct ldmsd_strgp *ldmsd_strgp_t;
 
 typedef struct ldmsd_strgp_ref {
 	ldmsd_strgp_t strgp;
+	void *store_ctxt;	/* see ldmsd_store::store_ctxt */
 	LIST_ENTRY(ldmsd_strgp_ref) entry;
 } *ldmsd_strgp_ref_t;
 
@@ -308,6 +362,13 @@ typedef struct ldmsd_prdcr_set {
 	double updt_duration;
 #endif /* LDMSD_UPDATE_TIME */
 
+	ldmsd_updt_stats_t updt_stats; /* allocated when first used */
+
+	/* Members of a set group, resolved at membership gn grp_gn */
+	uint64_t grp_gn;
+	int grp_card;
+	struct ldmsd_prdcr_set **grp_members;
+
 	int ref_count;
 } *ldmsd_prdcr_set_t;
 
@@ -385,6 +446,13 @@ typedef struct ldmsd_updtr {
 	 */
 	uint8_t is_auto_task;
 
+	/*
+	 * Read only the data header of a set that has been updated before
+	 * and skip the data if its generation number has not changed, see
+	 * ldms_xprt_update_cond().
+	 */
+	uint8_t is_cond;
+
 	/* The default schedule specified from configuration */
 	struct ldmsd_updtr_task default_task;
 	/*
@@ -436,6 +504,49 @@ typedef struct ldmsd_strgp_metric {
 } *ldmsd_strgp_metric_t;
 
 typedef void (*strgp_update_fn_t)(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set);
+
+/* In-memory recent history of the sets stored by a strgp */
+typedef struct ldmsd_history *ldmsd_history_t;
+struct ldmsd_history_stats {
+	size_t budget;		/* bytes */
+	size_t bytes;		/* bytes in use */
+	uint64_t series;
+	uint64_t rows;
+	uint64_t dropped;	/* rows that did not fit the budget */
+	uint64_t evicted;	/* blocks evicted to make room */
+	uint64_t first_ts;	/* usec, oldest row kept */
+};
+
+/* Downsampling of the sets stored by a strgp to one row per window */
+typedef struct ldmsd_downsample *ldmsd_downsample_t;
+struct ldmsd_downsample_stats {
+	uint64_t window;	/* usec */
+	const char *op;		/* the functions as configured */
+	uint64_t series;
+	uint64_t samples;	/* samples aggregated */
+	uint64_t rows;		/* rows emitted */
+	uint64_t late;		/* samples not newer than the previous one */
+	uint64_t resets;	/* counter resets and producer restarts */
+	uint64_t expired;	/* series of the sets that stopped updating */
+};
+/*
+ * Called with a row to store. \c current is 1 if the row is of the set
+ * passed to ldmsd_downsample_add(), 0 if it is of another set.
+ */
+typedef void (*ldmsd_downsample_emit_fn_t)(ldms_set_t row, int current,
+					   void *arg);
+
+/* Store-on-change filter of the rows stored by a strgp */
+typedef struct ldmsd_deadband *ldmsd_deadband_t;
+struct ldmsd_deadband_stats {
+	const char *spec;	/* the deadbands as configured */
+	uint64_t heartbeat;
+	uint64_t series;
+	uint64_t stored;	/* rows passed to the store */
+	uint64_t suppressed;	/* rows within the deadband */
+	uint64_t unchanged;	/* suppressed rows identical to the stored one */
+	uint64_t heartbeats;	/* rows stored by the heartbeat */
+};
 struct ldmsd_strgp {
 	struct ldmsd_cfgobj obj;
 
@@ -469,6 +580,15 @@ struct ldmsd_strgp {
 
 	/** Update function */
 	strgp_update_fn_t update_fn;
+
+	/** Recent history of the stored sets, NULL if not enabled */
+	ldmsd_history_t history;
+
+	/** Downsampling of the stored sets, NULL if not enabled */
+	ldmsd_downsample_t downsample;
+
+	/** Store-on-change filter, NULL if not enabled */
+	ldmsd_deadband_t deadband;
 };
 
 typedef struct ldmsd_set_info {
@@ -592,6 +712,19 @@ struct ldmsd_store {
 	int (*flush)(ldmsd_store_handle_t sh);
 	void *(*get_context)(ldmsd_store_handle_t sh);
 	int (*store)(ldmsd_store_handle_t sh, ldms_set_t set, int *, size_t count);
+	/**
+	 * Optional. If present, it is called instead of \c store.
+	 *
+	 * \c ctxt is a slot that ldmsd keeps for each producer set
+	 * stored through \c sh. It is NULL the first time the producer
+	 * set is stored and the plugin may cache per-set state in it to
+	 * avoid looking the set up on every update. ldmsd discards the
+	 * slot, without freeing it, when the producer set goes away or
+	 * the storage policy is stopped; the memory it refers to is
+	 * owned by the plugin.
+	 */
+	int (*store_ctxt)(ldmsd_store_handle_t sh, ldms_set_t set, int *,
+			  size_t count, void **ctxt);
 };
 
 struct store_instance;
@@ -835,6 +968,8 @@ ldmsd_cfgobj_t ldmsd_cfgobj_find(const char *name, ldmsd_cfgobj_type_t type);
 void ldmsd_cfgobj_del(const char *name, ldmsd_cfgobj_type_t type);
 ldmsd_cfgobj_t ldmsd_cfgobj_first(ldmsd_cfgobj_type_t type);
 ldmsd_cfgobj_t ldmsd_cfgobj_next(ldmsd_cfgobj_t obj);
+ldmsd_cfgobj_t ldmsd_cfgobj_next_by_name(const char *name,
+					 ldmsd_cfgobj_type_t type);
 int ldmsd_cfgobj_access_check(ldmsd_cfgobj_t obj, int acc, ldmsd_sec_ctxt_t ctxt);
 
 #define LDMSD_CFGOBJ_FOREACH(obj, type) \
@@ -860,6 +995,8 @@ ldmsd_prdcr_t ldmsd_prdcr_next(struct ldmsd_prdcr *prdcr);
 ldmsd_prdcr_set_t ldmsd_prdcr_set_first(ldmsd_prdcr_t prdcr);
 ldmsd_prdcr_set_t ldmsd_prdcr_set_next(ldmsd_prdcr_set_t prv_set);
 ldmsd_prdcr_set_t ldmsd_prdcr_set_find(ldmsd_prdcr_t prdcr, const char *setname);
+ldmsd_prdcr_set_t ldmsd_prdcr_set_next_by_name(ldmsd_prdcr_t prdcr,
+					       const char *setname);
 ldmsd_prdcr_set_t ldmsd_prdcr_set_first_by_hint(ldmsd_prdcr_t prdcr,
 					struct ldmsd_updtr_schedule *hint);
 ldmsd_prdcr_set_t ldmsd_prdcr_set_next_by_hint(ldmsd_prdcr_set_t prd_set);
@@ -895,9 +1032,14 @@ static inline const char *ldmsd_prdcr_set_state_str(enum ldmsd_prdcr_set_state s
 }
 void ldmsd_prdcr_set_ref_get(ldmsd_prdcr_set_t set);
 void ldmsd_prdcr_set_ref_put(ldmsd_prdcr_set_t set);
+/* Put the member references cached by the set group \c grp */
+void ldmsd_prdcr_set_grp_release(ldmsd_prdcr_set_t grp);
 void ldmsd_prd_set_updtr_task_update(ldmsd_prdcr_set_t prd_set);
 int ldmsd_prdcr_start(const char *name, const char *interval_str,
 		      ldmsd_sec_ctxt_t ctxt);
+/* Start \c name with its first connect attempt \c delay_us from now */
+int ldmsd_prdcr_start_delayed(const char *name, long delay_us,
+			      ldmsd_sec_ctxt_t ctxt);
 int ldmsd_prdcr_start_regex(const char *prdcr_regex, const char *interval_str,
 			    char *rep_buf, size_t rep_len,
 			    ldmsd_sec_ctxt_t ctxt);
@@ -911,6 +1053,46 @@ int ldmsd_prdcr_subscribe_regex(const char *prdcr_regex, char *stream_name,
 int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt);
 int __ldmsd_prdcr_stop(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt);
 
+/* producer connection scheduling */
+struct ldmsd_prdcr_conn_stats {
+	long rate;		/* connect attempts per second, 0 is unlimited */
+	long backoff_max_us;	/* reconnect interval limit, 0 is no backoff */
+	int started;		/* started producers */
+	int connected;		/* started producers that are connected */
+	int ramping;		/* not all started producers are connected */
+	uint64_t ramp_us;	/* time of the current or the last ramp */
+	int resolving;		/* host name lookups in progress */
+	int resolved;		/* host names in the cache */
+};
+/*
+ * Set the rate of connect attempts and the reconnect backoff limit of all
+ * producers. A negative value leaves the setting unchanged.
+ */
+int ldmsd_prdcr_conn_config(long rate, long backoff_max_us);
+void ldmsd_prdcr_conn_stats_get(struct ldmsd_prdcr_conn_stats *stats);
+
+/* update statistics */
+extern int ldmsd_updt_stats_enabled;
+int ldmsd_hist_bucket(uint64_t usec);
+uint64_t ldmsd_hist_bucket_lo(int bucket);
+uint64_t ldmsd_hist_percentile(ldmsd_hist_t h, double p);
+void ldmsd_updt_stats_add(ldmsd_prdcr_set_t prd_set, enum ldmsd_updt_stat stat,
+			  uint64_t usec);
+void ldmsd_updt_stats_inc(ldmsd_prdcr_set_t prd_set, enum ldmsd_updt_cnt cnt);
+void ldmsd_updt_stats_cnt_add(ldmsd_prdcr_set_t prd_set,
+			      enum ldmsd_updt_cnt cnt, uint64_t n);
+void ldmsd_updt_stats_merge(ldmsd_updt_stats_t dst, ldmsd_updt_stats_t src);
+void ldmsd_updt_stats_updtr(ldmsd_updtr_t updtr, ldmsd_updt_stats_t dst);
+const char *ldmsd_updt_stat_str(enum ldmsd_updt_stat stat);
+const char *ldmsd_updt_cnt_str(enum ldmsd_updt_cnt cnt);
+/*
+ * Turn the statistics on or off. When \c interval_us is not 0, a set per
+ * producer holding its statistics is published and refreshed every
+ * \c interval_us.
+ */
+int ldmsd_updt_stats_config(int enable, long interval_us);
+void ldmsd_updt_stats_prdcr_del(ldmsd_prdcr_t prdcr);
+
 /* updtr */
 ldmsd_updtr_t
 ldmsd_updtr_new(const char *name, char *interval_str,
@@ -979,6 +1161,51 @@ ldmsd_name_match_t ldmsd_strgp_prdcr_first(ldmsd_strgp_t strgp);
 ldmsd_name_match_t ldmsd_strgp_prdcr_next(ldmsd_name_match_t match);
 ldmsd_strgp_metric_t ldmsd_strgp_metric_first(ldmsd_strgp_t strgp);
 ldmsd_strgp_metric_t ldmsd_strgp_metric_next(ldmsd_strgp_metric_t metric);
+ldmsd_history_t ldmsd_history_new(size_t budget);
+void ldmsd_history_free(ldmsd_history_t h);
+void ldmsd_history_add(ldmsd_history_t h, ldms_set_t set,
+		       int *metric_arry, size_t count);
+void ldmsd_history_stats_get(ldmsd_history_t h, struct ldmsd_history_stats *st);
+/*
+ * Encode the rows with timestamps in [begin, end] (usec) of the series
+ * matching \c instance (all if NULL) for the comma separated \c metrics
+ * (all if NULL) in the strgp_history reply format. The caller frees
+ * \c *buf.
+ */
+int ldmsd_history_query(ldmsd_history_t h, regex_t *instance,
+			const char *metrics, uint64_t begin, uint64_t end,
+			char **buf, size_t *len);
+/*
+ * \c window is in usec. \c op is a comma separated list of mean, min,
+ * max, last or rate, each optionally followed by :<metric> to apply only
+ * to that metric; NULL is mean.
+ */
+ldmsd_downsample_t ldmsd_downsample_new(uint64_t window, const char *op);
+void ldmsd_downsample_free(ldmsd_downsample_t ds);
+void ldmsd_downsample_add(ldmsd_downsample_t ds, ldms_set_t set,
+			  int *metric_arry, size_t count,
+			  ldmsd_downsample_emit_fn_t emit, void *arg);
+/* Emit the pending window of every set */
+void ldmsd_downsample_flush(ldmsd_downsample_t ds,
+			    ldmsd_downsample_emit_fn_t emit, void *arg);
+void ldmsd_downsample_stats_get(ldmsd_downsample_t ds,
+				struct ldmsd_downsample_stats *st);
+/*
+ * \c spec is a comma separated list of thresholds, each optionally
+ * followed by :<metric> to apply only to that metric. A threshold is an
+ * absolute difference, a percentage of the stored value followed by '%',
+ * or 0 for any change; NULL is 0. With a \c heartbeat, at least one row
+ * in \c heartbeat is stored.
+ */
+ldmsd_deadband_t ldmsd_deadband_new(const char *spec, uint64_t heartbeat);
+void ldmsd_deadband_free(ldmsd_deadband_t db);
+/* Forget the rows stored so far */
+void ldmsd_deadband_reset(ldmsd_deadband_t db);
+/* Returns 1 if the row is to be stored, 0 if it is within the deadband */
+int ldmsd_deadband_pass(ldmsd_deadband_t db, ldms_set_t set,
+			int *metric_arry, size_t count);
+void ldmsd_deadband_stats_get(ldmsd_deadband_t db,
+			      struct ldmsd_deadband_stats *st);
 static inline ldmsd_strgp_t ldmsd_strgp_get(ldmsd_strgp_t strgp) {
 	ldmsd_cfgobj_get(&strgp->obj);
 	return strgp;
@@ -1160,6 +1387,19 @@ typedef int (*ldmsd_group_iter_cb_t)(ldms_set_t grp, const char *name, void *arg
  */
 int ldmsd_group_iter(ldms_set_t grp, ldmsd_group_iter_cb_t cb, void *arg);
 
+/**
+ * \brief Get the membership generation number of the group.
+ *
+ * The number changes whenever a member is added or removed, so that the
+ * members resolved by a consumer need to be looked up again only when it
+ * has changed. Members are iterated in the order they were added.
+ *
+ * \param grp The group handle.
+ *
+ * \retval gn The membership generation number.
+ */
+uint64_t ldmsd_group_gn_get(ldms_set_t grp);
+
 /**
  * \brief Get the member name from a set info key.
  *
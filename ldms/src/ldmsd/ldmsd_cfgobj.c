@@ -252,6 +252,34 @@ ldmsd_cfgobj_t ldmsd_cfgobj_first(ldmsd_cfgobj_type_t type)
 	return NULL;
 }
 
+/**
+ * Return the first configuration object of the given type whose name sorts
+ * after \c name, or the first object if \c name is NULL.
+ *
+ * Unlike ldmsd_cfgobj_next(), the caller does not hold the cfgobj_type lock
+ * and need not hold a reference on the previous object, so a long walk can
+ * drop the lock between objects and tolerate concurrent deletes.
+ */
+ldmsd_cfgobj_t ldmsd_cfgobj_next_by_name(const char *name,
+					 ldmsd_cfgobj_type_t type)
+{
+	struct rbn *n;
+	ldmsd_cfgobj_t obj = NULL;
+
+	pthread_mutex_lock(cfgobj_locks[type]);
+	if (!name) {
+		n = rbt_min(cfgobj_trees[type]);
+	} else {
+		n = rbt_find_lub(cfgobj_trees[type], name);
+		if (n && 0 == strcmp(n->key, name))
+			n = rbn_succ(n);
+	}
+	if (n)
+		obj = ldmsd_cfgobj_get(container_of(n, struct ldmsd_cfgobj, rbn));
+	pthread_mutex_unlock(cfgobj_locks[type]);
+	return obj;
+}
+
 /**
  * Return the next configuration object of the given type
  *
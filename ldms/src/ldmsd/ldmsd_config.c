@@ -449,6 +449,123 @@ out:
 	return rc;
 }
 
+/*
+ * Sets written by other processes in shared memory, see
+ * ldms_shm_set_new(). The daemon only publishes them.
+ */
+struct ldmsd_shm_set {
+	char *shm_name;
+	ldms_set_t set;
+	struct stat st;		/* of the object, for access checks */
+	LIST_ENTRY(ldmsd_shm_set) entry;
+};
+static LIST_HEAD(, ldmsd_shm_set) shm_set_list = LIST_HEAD_INITIALIZER(0);
+static pthread_mutex_t shm_set_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Caller must hold shm_set_lock */
+static struct ldmsd_shm_set *__shm_set_find(const char *shm_name)
+{
+	struct ldmsd_shm_set *ss;
+	LIST_FOREACH(ss, &shm_set_list, entry) {
+		if (0 == strcmp(ss->shm_name, shm_name))
+			return ss;
+	}
+	return NULL;
+}
+
+int ldmsd_shm_set_add(const char *shm_name, const char *producer,
+		      char *errstr, size_t errsz, ldmsd_sec_ctxt_t sctxt)
+{
+	struct ldmsd_shm_set *ss;
+	ldms_set_t set;
+	struct stat st;
+	int rc;
+
+	pthread_mutex_lock(&shm_set_lock);
+	if (__shm_set_find(shm_name)) {
+		snprintf(errstr, errsz, "'%s' is already published.", shm_name);
+		rc = EEXIST;
+		goto out;
+	}
+	rc = ldms_shm_set_open(shm_name, &set, &st);
+	if (rc) {
+		snprintf(errstr, errsz, "Cannot attach to '%s', error %d.",
+			 shm_name, rc);
+		goto out;
+	}
+	/* The requester must be able to write the object itself */
+	rc = ovis_access_check(sctxt->crd.uid, sctxt->crd.gid, 0222,
+			       st.st_uid, st.st_gid, st.st_mode & 0777);
+	if (rc) {
+		snprintf(errstr, errsz, "Permission denied.");
+		goto err;
+	}
+	ss = calloc(1, sizeof(*ss));
+	if (!ss)
+		goto enomem;
+	ss->shm_name = strdup(shm_name);
+	if (!ss->shm_name) {
+		free(ss);
+		goto enomem;
+	}
+	ss->set = set;
+	ss->st = st;
+	if (producer)
+		ldms_set_producer_name_set(set, producer);
+	else if (!ldms_set_producer_name_get(set)[0])
+		ldms_set_producer_name_set(set, ldmsd_myname_get());
+	rc = ldms_set_publish(set);
+	if (rc) {
+		snprintf(errstr, errsz, "Cannot publish '%s', error %d.",
+			 shm_name, rc);
+		free(ss->shm_name);
+		free(ss);
+		goto err;
+	}
+	LIST_INSERT_HEAD(&shm_set_list, ss, entry);
+	ldmsd_log(LDMSD_LINFO, "Published set '%s' from shared memory '%s'\n",
+		  ldms_set_instance_name_get(set), shm_name);
+	goto out;
+ enomem:
+	snprintf(errstr, errsz, "Out of memory.");
+	rc = ENOMEM;
+ err:
+	ldms_set_delete(set);
+ out:
+	pthread_mutex_unlock(&shm_set_lock);
+	return rc;
+}
+
+int ldmsd_shm_set_del(const char *shm_name, char *errstr, size_t errsz,
+		      ldmsd_sec_ctxt_t sctxt)
+{
+	struct ldmsd_shm_set *ss;
+	int rc;
+
+	pthread_mutex_lock(&shm_set_lock);
+	ss = __shm_set_find(shm_name);
+	if (!ss) {
+		snprintf(errstr, errsz, "'%s' is not published.", shm_name);
+		rc = ENOENT;
+		goto out;
+	}
+	rc = ovis_access_check(sctxt->crd.uid, sctxt->crd.gid, 0222,
+			       ss->st.st_uid, ss->st.st_gid,
+			       ss->st.st_mode & 0777);
+	if (rc) {
+		snprintf(errstr, errsz, "Permission denied.");
+		goto out;
+	}
+	LIST_REMOVE(ss, entry);
+	ldms_set_unpublish(ss->set);
+	ldms_set_delete(ss->set);
+	free(ss->shm_name);
+	free(ss);
+ out:
+	pthread_mutex_unlock(&shm_set_lock);
+	return rc;
+}
+
 static int log_response_fn(ldmsd_cfg_xprt_t xprt, char *data, size_t data_len)
 {
 	ldmsd_req_attr_t attr;
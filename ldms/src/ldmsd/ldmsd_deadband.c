@@ -0,0 +1,505 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Store-on-change filter of a storage policy
+ *
+ * A storage policy with a deadband stores a row of a set only if one of
+ * its metrics moved out of the deadband around the value in the last row
+ * stored for that set. The deadband of a metric is either exact (any
+ * change is stored), an absolute difference, or a difference relative
+ * to the stored value. A row is stored anyway when the metadata changed,
+ * when the producer restarted (the data generation number went back) and,
+ * with a heartbeat, after heartbeat - 1 rows in a row were suppressed.
+ *
+ * The values of the data metrics of the last stored row are kept as a
+ * copy of the data values of the set (ldms_set_data_values_get()). A row
+ * whose values from the first to the last metric of the policy are
+ * identical to the copy is suppressed with a single memcmp(); only when
+ * they differ are the metrics of the policy compared one by one.
+ * Non-numeric metrics are always compared exactly.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+enum db_kind {
+	DB_EXACT,
+	DB_ABS,
+	DB_REL,
+};
+
+struct db_spec {
+	char *metric;		/* NULL for the default */
+	enum db_kind kind;
+	double thr;		/* relative thresholds as a fraction */
+};
+
+struct db_col {
+	int midx;
+	enum ldms_value_type type;
+	size_t off;		/* offset of the value in the data values */
+	size_t len;
+	enum db_kind kind;
+	double thr;
+};
+
+struct db_series {
+	struct rbn rbn;
+	unsigned char *vals;	/* data values of the last stored row */
+	double *last;		/* the numeric values of the last stored row */
+	size_t len;
+	uint64_t gn;
+	uint64_t meta_gn;
+	uint64_t skipped;	/* rows suppressed since the last stored */
+	char name[OVIS_FLEX];
+};
+
+struct ldmsd_deadband {
+	pthread_mutex_t lock;
+	char *spec_str;
+	uint64_t heartbeat;
+	struct db_spec dflt;
+	int spec_count;
+	struct db_spec *spec;
+	/* the strgp metric array the columns were built from */
+	int *metric_arry;
+	int metric_count;
+	int col_count;
+	struct db_col *cols;
+	size_t span_off;	/* the data values holding the columns */
+	size_t span_len;
+	struct rbt series_tree;
+	uint64_t series;
+	uint64_t stored;
+	uint64_t suppressed;
+	uint64_t unchanged;
+	uint64_t heartbeats;
+};
+
+static int __series_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static int __thr_parse(const char *s, struct db_spec *spec)
+{
+	char *end;
+	double v;
+
+	v = strtod(s, &end);
+	if (end == s || v < 0)
+		return EINVAL;
+	if (*end == '%') {
+		end++;
+		spec->kind = DB_REL;
+		spec->thr = v / 100;
+	} else {
+		spec->kind = v ? DB_ABS : DB_EXACT;
+		spec->thr = v;
+	}
+	if (*end)
+		return EINVAL;
+	return 0;
+}
+
+/*
+ * \c spec is a comma separated list of thresholds: a threshold alone is
+ * the deadband of the metrics not listed, <threshold>:<metric> is the
+ * deadband of that metric. A threshold is a difference, or a percentage
+ * of the stored value followed by '%'; 0 is exact.
+ */
+static int __spec_parse(ldmsd_deadband_t db, const char *spec)
+{
+	char *str, *tok, *ptr, *metric;
+	struct db_spec *sp;
+	int rc = 0;
+
+	db->dflt.kind = DB_EXACT;
+	if (!spec)
+		return 0;
+	str = strdup(spec);
+	if (!str)
+		return ENOMEM;
+	db->spec = calloc(strlen(spec) / 2 + 1, sizeof(*db->spec));
+	if (!db->spec) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (tok = strtok_r(str, ",", &ptr); tok;
+	     tok = strtok_r(NULL, ",", &ptr)) {
+		metric = strchr(tok, ':');
+		if (!metric) {
+			rc = __thr_parse(tok, &db->dflt);
+			if (rc)
+				goto out;
+			continue;
+		}
+		*metric++ = '\0';
+		sp = &db->spec[db->spec_count];
+		rc = __thr_parse(tok, sp);
+		if (rc || !*metric) {
+			rc = EINVAL;
+			goto out;
+		}
+		sp->metric = strdup(metric);
+		if (!sp->metric) {
+			rc = ENOMEM;
+			goto out;
+		}
+		db->spec_count++;
+	}
+out:
+	free(str);
+	return rc;
+}
+
+static void __series_free(struct db_series *s)
+{
+	free(s->vals);
+	free(s->last);
+	free(s);
+}
+
+/* Caller holds db->lock */
+static void __deadband_reset(ldmsd_deadband_t db)
+{
+	struct rbn *rbn;
+
+	while ((rbn = rbt_min(&db->series_tree))) {
+		rbt_del(&db->series_tree, rbn);
+		__series_free(container_of(rbn, struct db_series, rbn));
+	}
+	db->series = 0;
+	free(db->cols);
+	free(db->metric_arry);
+	db->cols = NULL;
+	db->col_count = 0;
+	db->metric_arry = NULL;
+	db->metric_count = 0;
+}
+
+void ldmsd_deadband_reset(ldmsd_deadband_t db)
+{
+	pthread_mutex_lock(&db->lock);
+	__deadband_reset(db);
+	pthread_mutex_unlock(&db->lock);
+}
+
+void ldmsd_deadband_free(ldmsd_deadband_t db)
+{
+	int i;
+
+	ldmsd_deadband_reset(db);
+	for (i = 0; i < db->spec_count; i++)
+		free(db->spec[i].metric);
+	free(db->spec);
+	free(db->spec_str);
+	pthread_mutex_destroy(&db->lock);
+	free(db);
+}
+
+ldmsd_deadband_t ldmsd_deadband_new(const char *spec, uint64_t heartbeat)
+{
+	ldmsd_deadband_t db;
+	int rc;
+
+	db = calloc(1, sizeof(*db));
+	if (!db)
+		return NULL;
+	pthread_mutex_init(&db->lock, NULL);
+	rbt_init(&db->series_tree, __series_cmp);
+	db->heartbeat = heartbeat;
+	db->spec_str = strdup(spec ? spec : "0");
+	if (!db->spec_str) {
+		rc = ENOMEM;
+		goto err;
+	}
+	rc = __spec_parse(db, spec);
+	if (rc)
+		goto err;
+	return db;
+err:
+	ldmsd_deadband_free(db);
+	errno = rc;
+	return NULL;
+}
+
+static int __is_scalar_num(enum ldms_value_type type)
+{
+	return type >= LDMS_V_U8 && type <= LDMS_V_D64;
+}
+
+static int __deadband_layout(ldmsd_deadband_t db, ldms_set_t set,
+			     int *metric_arry, size_t count)
+{
+	const unsigned char *base;
+	struct db_col *col;
+	const char *name;
+	size_t len, *off, span_end = 0;
+	int card, i, j;
+
+	__deadband_reset(db);
+	card = ldms_set_card_get(set);
+	off = calloc(card, sizeof(*off));
+	db->metric_arry = malloc(count * sizeof(int));
+	db->cols = calloc(count, sizeof(*db->cols));
+	if (!off || !db->metric_arry || !db->cols)
+		goto enomem;
+	memcpy(db->metric_arry, metric_arry, count * sizeof(int));
+	db->metric_count = count;
+
+	/* the data values are laid out in the order of the metrics */
+	base = ldms_set_data_values_get(set, &len);
+	for (i = 0; i < card; i++) {
+		if (ldms_metric_flags_get(set, i) & LDMS_MDESC_F_DATA)
+			off[i] = (unsigned char *)ldms_metric_get(set, i) - base;
+	}
+	for (i = 0; i < count; i++) {
+		if (!(ldms_metric_flags_get(set, metric_arry[i]) & LDMS_MDESC_F_DATA))
+			continue; /* meta metrics change the meta_gn */
+		col = &db->cols[db->col_count];
+		col->midx = metric_arry[i];
+		col->type = ldms_metric_type_get(set, col->midx);
+		col->off = off[col->midx];
+		col->len = len - col->off;
+		for (j = col->midx + 1; j < card; j++) {
+			if (ldms_metric_flags_get(set, j) & LDMS_MDESC_F_DATA) {
+				col->len = off[j] - col->off;
+				break;
+			}
+		}
+		col->kind = db->dflt.kind;
+		col->thr = db->dflt.thr;
+		name = ldms_metric_name_get(set, col->midx);
+		for (j = 0; j < db->spec_count; j++) {
+			if (0 == strcmp(name, db->spec[j].metric)) {
+				col->kind = db->spec[j].kind;
+				col->thr = db->spec[j].thr;
+			}
+		}
+		if (!__is_scalar_num(col->type))
+			col->kind = DB_EXACT;
+		if (!db->col_count || col->off < db->span_off)
+			db->span_off = col->off;
+		if (col->off + col->len > span_end)
+			span_end = col->off + col->len;
+		db->col_count++;
+	}
+	db->span_len = db->col_count ? span_end - db->span_off : 0;
+	free(off);
+	return 0;
+enomem:
+	free(off);
+	free(db->cols);
+	free(db->metric_arry);
+	db->cols = NULL;
+	db->metric_arry = NULL;
+	db->metric_count = 0;
+	return ENOMEM;
+}
+
+static struct db_series *__series_get(ldmsd_deadband_t db, const char *name)
+{
+	struct db_series *s;
+	struct rbn *rbn;
+
+	rbn = rbt_find(&db->series_tree, name);
+	if (rbn)
+		return container_of(rbn, struct db_series, rbn);
+	s = calloc(1, sizeof(*s) + strlen(name) + 1);
+	if (!s)
+		return NULL;
+	s->last = calloc(db->col_count, sizeof(*s->last));
+	if (!s->last) {
+		free(s);
+		return NULL;
+	}
+	strcpy(s->name, name);
+	rbn_init(&s->rbn, s->name);
+	rbt_ins(&db->series_tree, &s->rbn);
+	db->series++;
+	return s;
+}
+
+static double __val_get(ldms_set_t set, struct db_col *col)
+{
+	switch (col->type) {
+	case LDMS_V_U8:
+		return ldms_metric_get_u8(set, col->midx);
+	case LDMS_V_S8:
+		return ldms_metric_get_s8(set, col->midx);
+	case LDMS_V_U16:
+		return ldms_metric_get_u16(set, col->midx);
+	case LDMS_V_S16:
+		return ldms_metric_get_s16(set, col->midx);
+	case LDMS_V_U32:
+		return ldms_metric_get_u32(set, col->midx);
+	case LDMS_V_S32:
+		return ldms_metric_get_s32(set, col->midx);
+	case LDMS_V_U64:
+		return ldms_metric_get_u64(set, col->midx);
+	case LDMS_V_S64:
+		return ldms_metric_get_s64(set, col->midx);
+	case LDMS_V_F32:
+		return ldms_metric_get_float(set, col->midx);
+	case LDMS_V_D64:
+		return ldms_metric_get_double(set, col->midx);
+	default:
+		return 0;
+	}
+}
+
+/* Whether a metric of the policy moved out of its deadband */
+static int __series_changed(ldmsd_deadband_t db, struct db_series *s,
+			    ldms_set_t set, const unsigned char *vals)
+{
+	struct db_col *col;
+	double v;
+	int c;
+
+	for (c = 0; c < db->col_count; c++) {
+		col = &db->cols[c];
+		if (!memcmp(vals + col->off, s->vals + col->off, col->len))
+			continue;
+		if (col->kind == DB_EXACT)
+			return 1;
+		v = __val_get(set, col);
+		if (col->kind == DB_ABS && fabs(v - s->last[c]) > col->thr)
+			return 1;
+		if (col->kind == DB_REL &&
+		    fabs(v - s->last[c]) > col->thr * fabs(s->last[c]))
+			return 1;
+	}
+	return 0;
+}
+
+int ldmsd_deadband_pass(ldmsd_deadband_t db, ldms_set_t set,
+			int *metric_arry, size_t count)
+{
+	const unsigned char *vals;
+	struct db_series *s;
+	uint64_t gn, meta_gn;
+	size_t len;
+	int c, store = 1;
+
+	pthread_mutex_lock(&db->lock);
+	if (count != db->metric_count ||
+	    memcmp(metric_arry, db->metric_arry, count * sizeof(int))) {
+		/* first row, or the strgp was restarted with other metrics */
+		if (__deadband_layout(db, set, metric_arry, count))
+			goto out;
+	}
+	s = __series_get(db, ldms_set_instance_name_get(set));
+	if (!s)
+		goto out;
+	vals = ldms_set_data_values_get(set, &len);
+	gn = ldms_set_data_gn_get(set);
+	meta_gn = ldms_set_meta_gn_get(set);
+	if (!s->vals || len != s->len || meta_gn != s->meta_gn || gn < s->gn)
+		goto store;
+	if (db->heartbeat && s->skipped + 1 >= db->heartbeat) {
+		db->heartbeats++;
+		goto store;
+	}
+	if (!memcmp(vals + db->span_off, s->vals + db->span_off,
+		    db->span_len)) {
+		db->unchanged++;
+		goto suppress;
+	}
+	if (__series_changed(db, s, set, vals))
+		goto store;
+suppress:
+	store = 0;
+	s->skipped++;
+	s->gn = gn;
+	db->suppressed++;
+	goto out;
+store:
+	if (len != s->len) {
+		free(s->vals);
+		s->vals = malloc(len);
+		if (!s->vals) {
+			s->len = 0;
+			goto out;
+		}
+		s->len = len;
+	}
+	memcpy(s->vals, vals, len);
+	for (c = 0; c < db->col_count; c++) {
+		if (db->cols[c].kind != DB_EXACT)
+			s->last[c] = __val_get(set, &db->cols[c]);
+	}
+	s->gn = gn;
+	s->meta_gn = meta_gn;
+	s->skipped = 0;
+	db->stored++;
+out:
+	pthread_mutex_unlock(&db->lock);
+	return store;
+}
+
+void ldmsd_deadband_stats_get(ldmsd_deadband_t db,
+			      struct ldmsd_deadband_stats *st)
+{
+	pthread_mutex_lock(&db->lock);
+	st->spec = db->spec_str;
+	st->heartbeat = db->heartbeat;
+	st->series = db->series;
+	st->stored = db->stored;
+	st->suppressed = db->suppressed;
+	st->unchanged = db->unchanged;
+	st->heartbeats = db->heartbeats;
+	pthread_mutex_unlock(&db->lock);
+}
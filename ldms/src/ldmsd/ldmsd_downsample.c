@@ -0,0 +1,738 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Downsampling stage of a storage policy
+ *
+ * A storage policy with a downsample window stores one row per set per
+ * window instead of every update. The windows are aligned to wall-clock
+ * boundaries of the set transaction timestamps, i.e. window k of a set
+ * covers [k * window, (k + 1) * window) usec since the epoch. The samples
+ * of a window are aggregated per scalar numeric data metric with the
+ * configured function:
+ *
+ *   mean  the mean of the samples,
+ *   min   the smallest sample,
+ *   max   the largest sample,
+ *   last  the last sample,
+ *   rate  the increase per second of a counter.
+ *
+ * The row of a window is emitted when the first sample of a later window
+ * arrives. Windows without samples emit nothing. The row is a writable
+ * copy (ldms_set_snapshot_copy()) of the first sample of the window with
+ * the aggregates written in place and the transaction timestamp set to
+ * the beginning of the window and the duration to the window, so the
+ * stores see a set of the same schema. The other metrics (meta metrics
+ * and arrays) keep the values of the first sample. Integer metrics are
+ * rounded.
+ *
+ * The rate is the counter increase over the intervals between
+ * consecutive samples ending in the window divided by the length of
+ * those intervals, so a missing sample only makes an interval longer.
+ * An unsigned counter of 32 bits or less that decreases by more than
+ * half its range wrapped around; any other decrease of an unsigned
+ * counter is a reset, and that interval is left out. A data generation
+ * number going back means the producer restarted, and the interval is
+ * left out for all the counters. Signed and floating point metrics are
+ * differentiated as they are.
+ *
+ * The series are kept by set instance name, not by producer set, so a
+ * window survives a producer reconnect. A series that has no sample for
+ * two windows after the end of its pending window is emitted and
+ * removed; ldmsd_downsample_flush() emits all pending windows when the
+ * policy stops.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+enum ds_op {
+	DS_MEAN,
+	DS_MIN,
+	DS_MAX,
+	DS_LAST,
+	DS_RATE,
+};
+
+static const char *ds_op_names[] = {
+	[DS_MEAN] = "mean",
+	[DS_MIN] = "min",
+	[DS_MAX] = "max",
+	[DS_LAST] = "last",
+	[DS_RATE] = "rate",
+};
+
+enum ds_class {
+	DS_UNSIGNED,
+	DS_SIGNED,
+	DS_FLOAT,
+};
+
+union ds_val {
+	uint64_t u;
+	int64_t s;
+	double d;
+};
+
+struct ds_col {
+	int midx;		/* metric index in the set */
+	enum ldms_value_type type;
+	enum ds_class cls;
+	int bits;
+	enum ds_op op;
+};
+
+struct ds_acc {
+	union ds_val min;
+	union ds_val max;
+	union ds_val last;
+	union ds_val prev;	/* the previous sample, across windows */
+	long double sum;
+	long double delta;	/* counter increase over the valid intervals */
+	uint64_t dt;		/* usec of the valid intervals */
+};
+
+struct ds_series {
+	struct rbn rbn;
+	TAILQ_ENTRY(ds_series) entry; /* least recently sampled first */
+	ldms_set_t row;		/* the pending window, NULL if none */
+	uint64_t win;		/* window index of the pending window */
+	uint64_t samples;	/* samples in the pending window */
+	uint64_t prev_ts;	/* usec, 0 before the first sample */
+	uint64_t prev_gn;
+	struct ds_acc *acc;
+	char name[OVIS_FLEX];
+};
+TAILQ_HEAD(ds_series_list, ds_series);
+
+struct ds_op_spec {
+	char *metric;
+	enum ds_op op;
+};
+
+struct ldmsd_downsample {
+	pthread_mutex_t lock;
+	uint64_t window;	/* usec */
+	char *op_str;
+	enum ds_op op;		/* default function */
+	int spec_count;		/* per metric functions */
+	struct ds_op_spec *spec;
+	/* the strgp metric array the columns were built from */
+	int *metric_arry;
+	int metric_count;
+	int col_count;
+	struct ds_col *cols;
+	struct rbt series_tree;
+	struct ds_series_list series_list;
+	uint64_t series;
+	uint64_t samples;
+	uint64_t rows;
+	uint64_t late;
+	uint64_t resets;
+	uint64_t expired;
+};
+
+static int __series_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static int __op_parse(const char *s, enum ds_op *op)
+{
+	int i;
+	for (i = 0; i < sizeof(ds_op_names) / sizeof(ds_op_names[0]); i++) {
+		if (0 == strcmp(s, ds_op_names[i])) {
+			*op = i;
+			return 0;
+		}
+	}
+	return EINVAL;
+}
+
+/*
+ * \c op is a comma separated list of functions: a function alone is the
+ * function of the metrics not listed, <function>:<metric> is the
+ * function of that metric.
+ */
+static int __spec_parse(ldmsd_downsample_t ds, const char *op)
+{
+	char *str, *tok, *ptr, *metric;
+	int rc = 0;
+
+	ds->op = DS_MEAN;
+	if (!op)
+		return 0;
+	str = strdup(op);
+	if (!str)
+		return ENOMEM;
+	ds->spec = calloc(strlen(op) / 2 + 1, sizeof(*ds->spec));
+	if (!ds->spec) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (tok = strtok_r(str, ",", &ptr); tok;
+	     tok = strtok_r(NULL, ",", &ptr)) {
+		metric = strchr(tok, ':');
+		if (!metric) {
+			rc = __op_parse(tok, &ds->op);
+			if (rc)
+				goto out;
+			continue;
+		}
+		*metric++ = '\0';
+		rc = __op_parse(tok, &ds->spec[ds->spec_count].op);
+		if (rc || !*metric) {
+			rc = EINVAL;
+			goto out;
+		}
+		ds->spec[ds->spec_count].metric = strdup(metric);
+		if (!ds->spec[ds->spec_count].metric) {
+			rc = ENOMEM;
+			goto out;
+		}
+		ds->spec_count++;
+	}
+out:
+	free(str);
+	return rc;
+}
+
+static void __series_free(ldmsd_downsample_t ds, struct ds_series *s)
+{
+	rbt_del(&ds->series_tree, &s->rbn);
+	TAILQ_REMOVE(&ds->series_list, s, entry);
+	if (s->row)
+		ldms_set_snapshot_put(s->row);
+	free(s->acc);
+	free(s);
+	ds->series--;
+}
+
+static void __downsample_reset(ldmsd_downsample_t ds)
+{
+	while (!TAILQ_EMPTY(&ds->series_list))
+		__series_free(ds, TAILQ_FIRST(&ds->series_list));
+	free(ds->cols);
+	free(ds->metric_arry);
+	ds->cols = NULL;
+	ds->col_count = 0;
+	ds->metric_arry = NULL;
+	ds->metric_count = 0;
+}
+
+void ldmsd_downsample_free(ldmsd_downsample_t ds)
+{
+	int i;
+
+	__downsample_reset(ds);
+	for (i = 0; i < ds->spec_count; i++)
+		free(ds->spec[i].metric);
+	free(ds->spec);
+	free(ds->op_str);
+	pthread_mutex_destroy(&ds->lock);
+	free(ds);
+}
+
+ldmsd_downsample_t ldmsd_downsample_new(uint64_t window, const char *op)
+{
+	ldmsd_downsample_t ds;
+	int rc;
+
+	if (!window) {
+		errno = EINVAL;
+		return NULL;
+	}
+	ds = calloc(1, sizeof(*ds));
+	if (!ds)
+		return NULL;
+	pthread_mutex_init(&ds->lock, NULL);
+	ds->window = window;
+	rbt_init(&ds->series_tree, __series_cmp);
+	TAILQ_INIT(&ds->series_list);
+	ds->op_str = strdup(op ? op : ds_op_names[DS_MEAN]);
+	if (!ds->op_str) {
+		rc = ENOMEM;
+		goto err;
+	}
+	rc = __spec_parse(ds, op);
+	if (rc)
+		goto err;
+	return ds;
+err:
+	ldmsd_downsample_free(ds);
+	errno = rc;
+	return NULL;
+}
+
+static int __col_class(struct ds_col *col)
+{
+	switch (col->type) {
+	case LDMS_V_U8:
+	case LDMS_V_U16:
+	case LDMS_V_U32:
+	case LDMS_V_U64:
+		col->cls = DS_UNSIGNED;
+		break;
+	case LDMS_V_S8:
+	case LDMS_V_S16:
+	case LDMS_V_S32:
+	case LDMS_V_S64:
+		col->cls = DS_SIGNED;
+		break;
+	case LDMS_V_F32:
+	case LDMS_V_D64:
+		col->cls = DS_FLOAT;
+		break;
+	default:
+		return EINVAL;
+	}
+	switch (col->type) {
+	case LDMS_V_U8:
+	case LDMS_V_S8:
+		col->bits = 8;
+		break;
+	case LDMS_V_U16:
+	case LDMS_V_S16:
+		col->bits = 16;
+		break;
+	case LDMS_V_U32:
+	case LDMS_V_S32:
+	case LDMS_V_F32:
+		col->bits = 32;
+		break;
+	default:
+		col->bits = 64;
+		break;
+	}
+	return 0;
+}
+
+static int __downsample_layout(ldmsd_downsample_t ds, ldms_set_t set,
+			       int *metric_arry, size_t count)
+{
+	struct ds_col *col;
+	const char *name;
+	int i, j;
+
+	__downsample_reset(ds);
+	ds->metric_arry = malloc(count * sizeof(int));
+	ds->cols = calloc(count, sizeof(*ds->cols));
+	if (!ds->metric_arry || !ds->cols) {
+		__downsample_reset(ds);
+		return ENOMEM;
+	}
+	memcpy(ds->metric_arry, metric_arry, count * sizeof(int));
+	ds->metric_count = count;
+	for (i = 0; i < count; i++) {
+		if (!(ldms_metric_flags_get(set, metric_arry[i]) & LDMS_MDESC_F_DATA))
+			continue;
+		col = &ds->cols[ds->col_count];
+		col->midx = metric_arry[i];
+		col->type = ldms_metric_type_get(set, metric_arry[i]);
+		if (__col_class(col))
+			continue;
+		col->op = ds->op;
+		name = ldms_metric_name_get(set, metric_arry[i]);
+		for (j = 0; j < ds->spec_count; j++) {
+			if (0 == strcmp(name, ds->spec[j].metric))
+				col->op = ds->spec[j].op;
+		}
+		ds->col_count++;
+	}
+	return 0;
+}
+
+static struct ds_series *__series_get(ldmsd_downsample_t ds, const char *name)
+{
+	struct ds_series *s;
+	struct rbn *rbn;
+
+	rbn = rbt_find(&ds->series_tree, name);
+	if (rbn)
+		return container_of(rbn, struct ds_series, rbn);
+	s = calloc(1, sizeof(*s) + strlen(name) + 1);
+	if (!s)
+		return NULL;
+	s->acc = calloc(ds->col_count, sizeof(*s->acc));
+	if (!s->acc) {
+		free(s);
+		return NULL;
+	}
+	strcpy(s->name, name);
+	rbn_init(&s->rbn, s->name);
+	rbt_ins(&ds->series_tree, &s->rbn);
+	TAILQ_INSERT_TAIL(&ds->series_list, s, entry);
+	ds->series++;
+	return s;
+}
+
+static union ds_val __val_get(ldms_set_t set, struct ds_col *col)
+{
+	union ds_val v;
+	switch (col->type) {
+	case LDMS_V_U8:
+		v.u = ldms_metric_get_u8(set, col->midx);
+		break;
+	case LDMS_V_U16:
+		v.u = ldms_metric_get_u16(set, col->midx);
+		break;
+	case LDMS_V_U32:
+		v.u = ldms_metric_get_u32(set, col->midx);
+		break;
+	case LDMS_V_U64:
+		v.u = ldms_metric_get_u64(set, col->midx);
+		break;
+	case LDMS_V_S8:
+		v.s = ldms_metric_get_s8(set, col->midx);
+		break;
+	case LDMS_V_S16:
+		v.s = ldms_metric_get_s16(set, col->midx);
+		break;
+	case LDMS_V_S32:
+		v.s = ldms_metric_get_s32(set, col->midx);
+		break;
+	case LDMS_V_S64:
+		v.s = ldms_metric_get_s64(set, col->midx);
+		break;
+	case LDMS_V_F32:
+		v.d = ldms_metric_get_float(set, col->midx);
+		break;
+	default:
+		v.d = ldms_metric_get_double(set, col->midx);
+		break;
+	}
+	return v;
+}
+
+static void __val_put(ldms_set_t set, struct ds_col *col, union ds_val v)
+{
+	switch (col->type) {
+	case LDMS_V_U8:
+		ldms_metric_set_u8(set, col->midx, v.u);
+		break;
+	case LDMS_V_U16:
+		ldms_metric_set_u16(set, col->midx, v.u);
+		break;
+	case LDMS_V_U32:
+		ldms_metric_set_u32(set, col->midx, v.u);
+		break;
+	case LDMS_V_U64:
+		ldms_metric_set_u64(set, col->midx, v.u);
+		break;
+	case LDMS_V_S8:
+		ldms_metric_set_s8(set, col->midx, v.s);
+		break;
+	case LDMS_V_S16:
+		ldms_metric_set_s16(set, col->midx, v.s);
+		break;
+	case LDMS_V_S32:
+		ldms_metric_set_s32(set, col->midx, v.s);
+		break;
+	case LDMS_V_S64:
+		ldms_metric_set_s64(set, col->midx, v.s);
+		break;
+	case LDMS_V_F32:
+		ldms_metric_set_float(set, col->midx, v.d);
+		break;
+	default:
+		ldms_metric_set_double(set, col->midx, v.d);
+		break;
+	}
+}
+
+static double __val_double(struct ds_col *col, union ds_val v)
+{
+	switch (col->cls) {
+	case DS_UNSIGNED:
+		return v.u;
+	case DS_SIGNED:
+		return v.s;
+	default:
+		return v.d;
+	}
+}
+
+/* Round \c d to the type of the column */
+static union ds_val __val_from_double(struct ds_col *col, long double d)
+{
+	union ds_val v;
+	long double max;
+
+	switch (col->cls) {
+	case DS_UNSIGNED:
+		max = ldexpl(1, col->bits) - 1;
+		d = roundl(d);
+		v.u = d <= 0 ? 0 : d >= max ? (uint64_t)max : (uint64_t)d;
+		break;
+	case DS_SIGNED:
+		max = ldexpl(1, col->bits - 1) - 1;
+		d = roundl(d);
+		v.s = d <= -max - 1 ? (int64_t)(-max - 1) :
+		      d >= max ? (int64_t)max : (int64_t)d;
+		break;
+	default:
+		v.d = d;
+		break;
+	}
+	return v;
+}
+
+static int __val_cmp(struct ds_col *col, union ds_val a, union ds_val b)
+{
+	switch (col->cls) {
+	case DS_UNSIGNED:
+		return (a.u > b.u) - (a.u < b.u);
+	case DS_SIGNED:
+		return (a.s > b.s) - (a.s < b.s);
+	default:
+		return (a.d > b.d) - (a.d < b.d);
+	}
+}
+
+/*
+ * The increase of a counter from \c prev to \c cur, or -1 if the
+ * counter was reset.
+ */
+static int __counter_delta(struct ds_col *col, union ds_val prev,
+			   union ds_val cur, long double *delta)
+{
+	uint64_t range, d;
+
+	switch (col->cls) {
+	case DS_UNSIGNED:
+		if (cur.u >= prev.u) {
+			*delta = cur.u - prev.u;
+			return 0;
+		}
+		if (col->bits >= 64)
+			return -1;
+		range = 1ULL << col->bits;
+		d = cur.u + range - prev.u;
+		if (d >= range / 2)
+			return -1;
+		*delta = d; /* wrapped around */
+		return 0;
+	case DS_SIGNED:
+		*delta = (long double)cur.s - prev.s;
+		return 0;
+	default:
+		*delta = (long double)cur.d - prev.d;
+		return 0;
+	}
+}
+
+static void __series_emit(ldmsd_downsample_t ds, struct ds_series *s,
+			  ldmsd_downsample_emit_fn_t emit, int current,
+			  void *arg)
+{
+	struct ldms_timestamp ts, dur;
+	struct ds_col *col;
+	struct ds_acc *acc;
+	union ds_val v;
+	uint64_t t;
+	int c;
+
+	for (c = 0; c < ds->col_count; c++) {
+		col = &ds->cols[c];
+		acc = &s->acc[c];
+		switch (col->op) {
+		case DS_MEAN:
+			v = __val_from_double(col, acc->sum / s->samples);
+			break;
+		case DS_MIN:
+			v = acc->min;
+			break;
+		case DS_MAX:
+			v = acc->max;
+			break;
+		case DS_LAST:
+			v = acc->last;
+			break;
+		default:
+			v = __val_from_double(col, acc->dt ?
+					acc->delta * 1000000 / acc->dt : 0);
+			break;
+		}
+		__val_put(s->row, col, v);
+	}
+	t = s->win * ds->window;
+	ts.sec = t / 1000000;
+	ts.usec = t % 1000000;
+	dur.sec = ds->window / 1000000;
+	dur.usec = ds->window % 1000000;
+	ldms_set_snapshot_timestamp_set(s->row, ts, dur);
+	emit(s->row, current, arg);
+	ds->rows++;
+	ldms_set_snapshot_put(s->row);
+	s->row = NULL;
+	s->samples = 0;
+}
+
+void ldmsd_downsample_add(ldmsd_downsample_t ds, ldms_set_t set,
+			  int *metric_arry, size_t count,
+			  ldmsd_downsample_emit_fn_t emit, void *arg)
+{
+	struct ldms_timestamp ts;
+	struct ds_series *s, *old;
+	struct ds_col *col;
+	struct ds_acc *acc;
+	union ds_val v;
+	long double delta;
+	uint64_t t, k, gn;
+	int c, restart;
+
+	ts = ldms_transaction_timestamp_get(set);
+	t = (uint64_t)ts.sec * 1000000 + ts.usec;
+	if (!t)
+		return;
+	gn = ldms_set_data_gn_get(set);
+	pthread_mutex_lock(&ds->lock);
+	if (count != ds->metric_count ||
+	    memcmp(metric_arry, ds->metric_arry, count * sizeof(int))) {
+		/* first sample, or the strgp was restarted with other metrics */
+		if (__downsample_layout(ds, set, metric_arry, count))
+			goto out;
+	}
+	s = __series_get(ds, ldms_set_instance_name_get(set));
+	if (!s)
+		goto out;
+	if (s->prev_ts && t <= s->prev_ts) {
+		ds->late++; /* not newer than the last sample */
+		goto out;
+	}
+	k = t / ds->window;
+	if (s->row && k != s->win)
+		__series_emit(ds, s, emit, 1, arg);
+	if (!s->row) {
+		s->row = ldms_set_snapshot_copy(set);
+		if (!s->row)
+			goto out;
+		s->win = k;
+		for (c = 0; c < ds->col_count; c++) {
+			s->acc[c].sum = 0;
+			s->acc[c].delta = 0;
+			s->acc[c].dt = 0;
+		}
+	}
+	restart = s->prev_ts && gn < s->prev_gn;
+	if (restart)
+		ds->resets++;
+	for (c = 0; c < ds->col_count; c++) {
+		col = &ds->cols[c];
+		acc = &s->acc[c];
+		v = __val_get(set, col);
+		if (!s->samples || __val_cmp(col, v, acc->min) < 0)
+			acc->min = v;
+		if (!s->samples || __val_cmp(col, v, acc->max) > 0)
+			acc->max = v;
+		acc->last = v;
+		acc->sum += __val_double(col, v);
+		if (col->op == DS_RATE && s->prev_ts && !restart) {
+			if (__counter_delta(col, acc->prev, v, &delta)) {
+				ds->resets++;
+			} else {
+				acc->delta += delta;
+				acc->dt += t - s->prev_ts;
+			}
+		}
+		acc->prev = v;
+	}
+	s->samples++;
+	ds->samples++;
+	s->prev_ts = t;
+	s->prev_gn = gn;
+	TAILQ_REMOVE(&ds->series_list, s, entry);
+	TAILQ_INSERT_TAIL(&ds->series_list, s, entry);
+
+	/* emit and remove the series that stopped two windows ago */
+	while ((old = TAILQ_FIRST(&ds->series_list)) && old != s &&
+	       old->prev_ts / ds->window + 3 <= k) {
+		if (old->row)
+			__series_emit(ds, old, emit, 0, arg);
+		__series_free(ds, old);
+		ds->expired++;
+	}
+out:
+	pthread_mutex_unlock(&ds->lock);
+}
+
+void ldmsd_downsample_flush(ldmsd_downsample_t ds,
+			    ldmsd_downsample_emit_fn_t emit, void *arg)
+{
+	struct ds_series *s;
+
+	pthread_mutex_lock(&ds->lock);
+	TAILQ_FOREACH(s, &ds->series_list, entry) {
+		if (s->row)
+			__series_emit(ds, s, emit, 0, arg);
+	}
+	pthread_mutex_unlock(&ds->lock);
+}
+
+void ldmsd_downsample_stats_get(ldmsd_downsample_t ds,
+				struct ldmsd_downsample_stats *st)
+{
+	pthread_mutex_lock(&ds->lock);
+	st->window = ds->window;
+	st->op = ds->op_str;
+	st->series = ds->series;
+	st->samples = ds->samples;
+	st->rows = ds->rows;
+	st->late = ds->late;
+	st->resets = ds->resets;
+	st->expired = ds->expired;
+	pthread_mutex_unlock(&ds->lock);
+}
@@ -57,6 +57,7 @@
 #include <pthread.h>
 #include <netdb.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <math.h>
 
 #include "coll/rbt.h"
@@ -70,6 +71,7 @@
 #define DEFAULT_PING_INTERVAL 1000000 /* unit: uSec */
 #define DEFAULT_AUTOSWITCH 1
 #define DEFAULT_TIMEOUT_FACTOR 2
+#define FAILOVER_CONNECT_SPACING 1000 /* uSec between peer prdcr connects */
 
 #define ARRAY_LEN(x) (sizeof(x)/sizeof(*(x)))
 
@@ -132,6 +134,7 @@ typedef enum {
 	__FAILOVER_OUTSTANDING_PING   = 0x0008,
 	__FAILOVER_OURCFG_ACTIVATED   = 0x0010,
 	__FAILOVER_OUTSTANDING_UNPAIR = 0x0020,
+	__FAILOVER_PEERCFG_RESYNC     = 0x0040,
 
 } __failover_flags_t;
 
@@ -184,6 +187,29 @@ struct ldmsd_failover {
 	double ping_sd;       /* ping round-trip time standard deviation */
 
 	int ping_skipped; /* the number of ping skipped due to outstanding */
+
+	uint64_t peercfg_digest; /* digest of the peer snapshot we hold */
+
+	/* our config as the peer holds it, see __failover_send_diff() */
+	struct rbt ourcfg_rbt;
+	uint64_t ourcfg_digest;  /* 0 if the peer has no snapshot of ours */
+	uint64_t ourcfg_gn;      /* bumped by every config change request */
+	uint64_t ourcfg_sent_gn; /* ourcfg_gn when ourcfg_rbt was taken */
+
+	/* pair / peer config / takeover timing */
+	struct timeval pair_ts;
+	struct timeval cfg_ts;
+	struct timeval takeover_ts;
+	uint64_t pair_us;     /* pair request round-trip */
+	uint64_t cfg_us;      /* peer config request to config applied */
+	uint64_t cfg_bytes;   /* size of the last snapshot reply */
+	int cfg_objs;         /* the number of records in the snapshot */
+	uint64_t takeover_us; /* time to activate the peer config */
+	int takeover_prdcrs;  /* the number of producers activated */
+	int diffs_sent;       /* the number of config diffs sent to the peer */
+	uint64_t diff_bytes;  /* size of the last config diff sent */
+	int diffs_applied;    /* the number of peer config diffs applied */
+	uint64_t diff_us;     /* time to apply the last peer config diff */
 } *ldmsd_failover_t;
 
 struct str_rbn {
@@ -302,7 +328,11 @@ int __peercfg_start(ldmsd_failover_t f);
 static
 int __peercfg_stop(ldmsd_failover_t f);
 static
+int __peercfg_delete(ldmsd_failover_t f);
+static
 int __failover_reset_and_request_peercfg(ldmsd_failover_t f);
+static
+int __failover_request_peercfg(ldmsd_failover_t f);
 
 static inline
 void __failover_task_resched(ldmsd_failover_t f)
@@ -330,6 +360,7 @@ void __failover_init(ldmsd_failover_t f)
 	rbt_init(&f->prdcr_rbt, str_rbn_cmp);
 	rbt_init(&f->updtr_rbt, str_rbn_cmp);
 	rbt_init(&f->strgp_rbt, str_rbn_cmp);
+	rbt_init(&f->ourcfg_rbt, str_rbn_cmp);
 
 	ldmsd_task_init(&f->task);
 
@@ -380,228 +411,351 @@ void __failover_unlock(ldmsd_failover_t f)
 	pthread_mutex_unlock(&f->mutex);
 }
 
+/*
+ * Peer configuration snapshot
+ *
+ * The redundant configuration objects are serialized as a sequence of
+ * LDMSD_FAILOVER_CFG{PRDCR,UPDTR,STRGP}_REQ messages, each a complete request
+ * (header, attributes and the terminating discriminator in network byte
+ * order) exactly as it would be sent on its own. The snapshot prefixes the
+ * messages with `struct failover_snapshot_hdr`. The requester sends the
+ * header of the snapshot it currently holds; if the digest still matches, the
+ * peer replies with the header alone and the requester keeps its objects.
+ *
+ * Peers that do not understand snapshots ignore the request attributes and
+ * send the messages one by one (see __failover_replay_snapshot()).
+ */
+#define FAILOVER_SNAPSHOT_MAGIC   0x4c464353 /* "LFCS" */
+#define FAILOVER_SNAPSHOT_VERSION 1
+
+#pragma pack(push, 1)
+struct failover_snapshot_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t digest; /* FNV-1a of the records */
+	uint32_t count;  /* the number of records */
+	uint32_t len;    /* the length of the records, 0 if omitted */
+	char records[OVIS_FLEX];
+};
+#pragma pack(pop)
+
+struct cfg_buf {
+	char *buf;
+	size_t len;
+	size_t alloc;
+	size_t rec_off; /* offset of the record being encoded */
+	uint32_t count;
+	int rc; /* the first error, later appends become no-op */
+};
+
 static
-int __failover_send_prdcr(ldmsd_failover_t f, ldms_t x, ldmsd_prdcr_t p)
+uint64_t __fnv1a64(const void *data, size_t len)
 {
-	/* f->lock is held */
-	int rc = 0;
-	ldmsd_req_cmd_t rcmd;
-	char buff[128];
-	const char *cstr;
+	const unsigned char *p = data;
+	uint64_t h = 0xcbf29ce484222325LU;
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3LU;
+	}
+	return h;
+}
 
-	if (__cfgobj_is_failover(&p->obj)) {
-		rc = EINVAL;
-		goto out;
+static
+int __cfg_buf_reserve(struct cfg_buf *b, size_t sz)
+{
+	size_t alloc;
+	char *buf;
+	if (b->rc)
+		return b->rc;
+	if (b->len + sz <= b->alloc)
+		return 0;
+	alloc = (b->alloc)?(b->alloc):(4096);
+	while (alloc < b->len + sz)
+		alloc *= 2;
+	buf = realloc(b->buf, alloc);
+	if (!buf) {
+		b->rc = ENOMEM;
+		return b->rc;
+	}
+	b->buf = buf;
+	b->alloc = alloc;
+	return 0;
+}
+
+static
+int __cfg_buf_init(struct cfg_buf *b, size_t hdr_sz)
+{
+	bzero(b, sizeof(*b));
+	if (__cfg_buf_reserve(b, hdr_sz))
+		return b->rc;
+	b->len = hdr_sz;
+	return 0;
+}
+
+static
+void __cfg_buf_free(struct cfg_buf *b)
+{
+	free(b->buf);
+	b->buf = NULL;
+}
+
+static
+void __cfg_rec_begin(struct cfg_buf *b, uint32_t req_id)
+{
+	ldmsd_req_hdr_t hdr;
+	if (__cfg_buf_reserve(b, sizeof(*hdr)))
+		return;
+	b->rec_off = b->len;
+	hdr = (void*)&b->buf[b->len];
+	hdr->marker = LDMSD_RECORD_MARKER;
+	hdr->type = LDMSD_REQ_TYPE_CONFIG_CMD;
+	hdr->flags = LDMSD_REQ_SOM_F | LDMSD_REQ_EOM_F;
+	hdr->msg_no = 0;
+	hdr->req_id = req_id;
+	hdr->rec_len = 0; /* assigned in __cfg_rec_end() */
+	b->len += sizeof(*hdr);
+}
+
+static
+void __cfg_rec_attr(struct cfg_buf *b, uint32_t attr_id,
+		    const void *value, size_t value_len)
+{
+	ldmsd_req_attr_t attr;
+	if (__cfg_buf_reserve(b, sizeof(*attr) + value_len))
+		return;
+	attr = (void*)&b->buf[b->len];
+	attr->discrim = 1;
+	attr->attr_id = attr_id;
+	attr->attr_len = value_len;
+	ldmsd_hton_req_attr(attr);
+	memcpy(attr->attr_value, value, value_len);
+	b->len += sizeof(*attr) + value_len;
+}
+
+static inline
+void __cfg_rec_attr_str(struct cfg_buf *b, uint32_t attr_id, const char *str)
+{
+	__cfg_rec_attr(b, attr_id, str, strlen(str) + 1);
+}
+
+static
+void __cfg_rec_end(struct cfg_buf *b)
+{
+	ldmsd_req_hdr_t hdr;
+	uint32_t term = 0;
+	if (__cfg_buf_reserve(b, sizeof(term)))
+		return;
+	memcpy(&b->buf[b->len], &term, sizeof(term));
+	b->len += sizeof(term);
+	hdr = (void*)&b->buf[b->rec_off];
+	hdr->rec_len = b->len - b->rec_off;
+	ldmsd_hton_req_hdr(hdr);
+	b->count++;
+}
+
+static
+void __cfg_buf_seal(struct cfg_buf *b)
+{
+	struct failover_snapshot_hdr *sh = (void*)b->buf;
+	size_t len = b->len - sizeof(*sh);
+	sh->magic = htonl(FAILOVER_SNAPSHOT_MAGIC);
+	sh->version = htonl(FAILOVER_SNAPSHOT_VERSION);
+	sh->digest = htobe64(__fnv1a64(sh->records, len));
+	sh->count = htonl(b->count);
+	sh->len = htonl(len);
+}
+
+static
+void __cfg_buf_append(struct cfg_buf *b, const void *data, size_t len,
+		      uint32_t count)
+{
+	if (__cfg_buf_reserve(b, len))
+		return;
+	memcpy(&b->buf[b->len], data, len);
+	b->len += len;
+	b->count += count;
+}
+
+/*
+ * The snapshot records of one config object, so that the objects that
+ * changed between two snapshots can be told apart (see
+ * __failover_send_diff()).
+ */
+struct cfg_obj {
+	struct rbn rbn;
+	uint32_t req_id;
+	uint64_t hash;  /* FNV-1a of the records */
+	size_t off;     /* offset of the first record in the snapshot buffer */
+	size_t len;     /* length of the records */
+	uint32_t count; /* the number of records */
+	int changed;
+	char key[OVIS_FLEX]; /* type letter + failover name of the object */
+};
+
+#define CFG_OBJ(x) ((struct cfg_obj *)(x))
+
+static
+void __cfg_obj_add(struct rbt *objs, struct cfg_buf *b, uint32_t req_id,
+		   const char *name, size_t off, uint32_t count)
+{
+	struct cfg_obj *o;
+	size_t len;
+	char type;
+	if (b->rc)
+		return;
+	switch (req_id) {
+	case LDMSD_FAILOVER_CFGPRDCR_REQ:
+		type = 'p';
+		break;
+	case LDMSD_FAILOVER_CFGUPDTR_REQ:
+		type = 'u';
+		break;
+	default:
+		type = 's';
+		break;
+	}
+	len = 1 + sizeof(LDMSD_FAILOVER_NAME_PREFIX) + strlen(name);
+	o = calloc(1, sizeof(*o) + len);
+	if (!o) {
+		b->rc = ENOMEM;
+		return;
 	}
+	snprintf(o->key, len, "%c" LDMSD_FAILOVER_NAME_PREFIX "%s", type, name);
+	o->req_id = req_id;
+	o->off = off;
+	o->len = b->len - off;
+	o->count = b->count - count;
+	o->hash = __fnv1a64(&b->buf[off], o->len);
+	o->rbn.key = o->key;
+	rbt_ins(objs, &o->rbn);
+}
 
-	rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGPRDCR_REQ,
-				   NULL, NULL, NULL);
-	if (!rcmd) {
-		rc = errno;
-		goto out;
+static
+void __cfg_objs_free(struct rbt *objs)
+{
+	struct rbn *rbn;
+	while ((rbn = rbt_min(objs))) {
+		rbt_del(objs, rbn);
+		free(CFG_OBJ(rbn));
 	}
+}
+
+static
+void __failover_enc_prdcr(struct cfg_buf *b, ldmsd_prdcr_t p)
+{
+	char buff[128];
+
+	__cfg_rec_begin(b, LDMSD_FAILOVER_CFGPRDCR_REQ);
 
 	/* NAME */
 	snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s", p->obj.name);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, buff);
 
 	/* HOST */
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_HOST, p->host_name);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_HOST, p->host_name);
 
 	/* PORT */
 	snprintf(buff, sizeof(buff), "%d", (int)p->port_no);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PORT, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_PORT, buff);
 
 	/* XPRT */
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_XPRT, p->xprt_name);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_XPRT, p->xprt_name);
 
 	/* INTERVAL */
 	snprintf(buff, sizeof(buff), "%ld", p->conn_intrvl_us);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_INTERVAL, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_INTERVAL, buff);
 
 	/* TYPE */
-	cstr = (p->type == LDMSD_PRDCR_TYPE_ACTIVE)?("active"):("passive");
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_TYPE, cstr);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_TYPE,
+			(p->type == LDMSD_PRDCR_TYPE_ACTIVE)?("active"):("passive"));
 
 	/* UID */
 	snprintf(buff, sizeof(buff), "%u", p->obj.uid);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_UID, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_UID, buff);
 
 	/* GID */
 	snprintf(buff, sizeof(buff), "%u", p->obj.gid);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_GID, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_GID, buff);
 
 	/* PERM */
 	snprintf(buff, sizeof(buff), "%#o", p->obj.perm);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PERM, buff);
-	if (rc)
-		goto cleanup;
-
-	/* Terminate the message */
-	rc = ldmsd_req_cmd_attr_term(rcmd);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_PERM, buff);
 
-	/* let-through for cleanup */
-cleanup:
-	ldmsd_req_cmd_free(rcmd);
-out:
-	return rc;
+	__cfg_rec_end(b);
 }
 
 static
-int __failover_send_updtr(ldmsd_failover_t f, ldms_t x, ldmsd_updtr_t u)
+void __failover_enc_updtr(struct cfg_buf *b, ldmsd_updtr_t u)
 {
-	/* NOTE: Send a bunch of small messages due to msg size limitation. */
-	int rc = 0;
+	/* NOTE: The producers and the match conditions are separate records
+	 *       so that each message stays small when replayed. */
+	char name[128];
 	char buff[128];
 	const char *cstr;
 	ldmsd_prdcr_ref_t pref;
 	ldmsd_name_match_t nm;
-	ldmsd_prdcr_t p;
-	ldmsd_req_cmd_t rcmd;
 	struct rbn *rbn;
 
-	if (0 == strncmp(LDMSD_FAILOVER_NAME_PREFIX, u->obj.name,
-				sizeof(LDMSD_FAILOVER_NAME_PREFIX)-1)) {
-		rc = EINVAL;
-		goto out;
-	}
+	snprintf(name, sizeof(name), LDMSD_FAILOVER_NAME_PREFIX "%s", u->obj.name);
 
-	rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGUPDTR_REQ,
-				   NULL, NULL, NULL);
-
-	if (!rcmd) {
-		rc = errno;
-		goto out;
-	}
+	__cfg_rec_begin(b, LDMSD_FAILOVER_CFGUPDTR_REQ);
 
 	/* NAME */
-	snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s", u->obj.name);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
 
 	/* INTERVAL */
 	snprintf(buff, sizeof(buff), "%ld", u->default_task.hint.intrvl_us);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_INTERVAL, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_INTERVAL, buff);
 
 	/* OFFSET */
 	if (u->default_task.task_flags & LDMSD_TASK_F_SYNCHRONOUS) {
 		snprintf(buff, sizeof(buff), "%ld", u->default_task.hint.offset_us);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_OFFSET,
-						   buff);
-		if (rc)
-			goto cleanup;
+		__cfg_rec_attr_str(b, LDMSD_ATTR_OFFSET, buff);
 	}
 
 	/* AUTO INTERVAL */
 	if (!u->is_auto_task)
-	snprintf(buff, sizeof(buff), "false");
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_AUTO_INTERVAL, buff);
-	if (rc)
-		goto cleanup;
+		__cfg_rec_attr_str(b, LDMSD_ATTR_AUTO_INTERVAL, "false");
+
+	/* CONDITIONAL */
+	if (u->is_cond)
+		__cfg_rec_attr_str(b, LDMSD_ATTR_CONDITIONAL, "true");
 
 	/* PUSH */
 	if (u->push_flags & LDMSD_UPDTR_F_PUSH) {
 		cstr = "onpush";
 		if (u->push_flags & LDMSD_UPDTR_F_PUSH_CHANGE)
 			cstr = "onchange";
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PUSH, cstr);
-		if (rc)
-			goto cleanup;
+		__cfg_rec_attr_str(b, LDMSD_ATTR_PUSH, cstr);
 	}
 
 	/* UID */
 	snprintf(buff, sizeof(buff), "%u", u->obj.uid);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_UID, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_UID, buff);
 
 	/* GID */
 	snprintf(buff, sizeof(buff), "%u", u->obj.gid);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_GID, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_GID, buff);
 
 	/* PERM */
 	snprintf(buff, sizeof(buff), "%#o", u->obj.perm);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PERM, buff);
-	if (rc)
-		goto cleanup;
+	__cfg_rec_attr_str(b, LDMSD_ATTR_PERM, buff);
 
-	/* TERM */
-	rc = ldmsd_req_cmd_attr_term(rcmd);
-	if (rc)
-		goto cleanup;
-	ldmsd_req_cmd_free(rcmd);
-	rcmd = NULL;
+	__cfg_rec_end(b);
 
 	/* list of PRODUCERs in this updater */
 	for (rbn = rbt_min(&u->prdcr_tree); rbn; rbn = rbn_succ(rbn)) {
 		pref = container_of(rbn, struct ldmsd_prdcr_ref, rbn);
-		rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGUPDTR_REQ,
-					   NULL, NULL, NULL);
-		if (!rcmd) {
-			rc = errno;
-			goto out;
-		}
-
-		/* NAME */
-		snprintf(buff, sizeof(buff),
-			 LDMSD_FAILOVER_NAME_PREFIX "%s", u->obj.name);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-		if (rc)
-			goto cleanup;
-		p = pref->prdcr;
-		/* PRODUCER */
-		snprintf(buff, sizeof(buff),
-			 LDMSD_FAILOVER_NAME_PREFIX "%s", p->obj.name);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PRODUCER,
-						   buff);
-		if (rc)
-			goto cleanup;
-		/* TERM */
-		rc = ldmsd_req_cmd_attr_term(rcmd);
-		if (rc)
-			goto cleanup;
-		ldmsd_req_cmd_free(rcmd);
-		rcmd = NULL;
+		__cfg_rec_begin(b, LDMSD_FAILOVER_CFGUPDTR_REQ);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
+		snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s",
+			 pref->prdcr->obj.name);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_PRODUCER, buff);
+		__cfg_rec_end(b);
 	}
 
 	/* list of MATCH & REGEX for MATCH_ADD */
 	LIST_FOREACH(nm, &u->match_list, entry) {
-		rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGUPDTR_REQ,
-					   NULL, NULL, NULL);
-		if (!rcmd) {
-			rc = errno;
-			goto out;
-		}
-		/* NAME */
-		snprintf(buff, sizeof(buff),
-			 LDMSD_FAILOVER_NAME_PREFIX "%s", u->obj.name);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-		if (rc)
-			goto cleanup;
-		/* MATCH */
 		switch (nm->selector) {
 		case LDMSD_NAME_MATCH_INST_NAME:
 			cstr = "inst";
@@ -611,143 +765,72 @@ int __failover_send_updtr(ldmsd_failover_t f, ldms_t x, ldmsd_updtr_t u)
 			break;
 		default:
 			__ASSERT(0 == "Unknown match selector");
+			continue;
 		}
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_MATCH, cstr);
-		if (rc)
-			goto cleanup;
-		/* REGEX */
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_REGEX,
-						   nm->regex_str);
-		if (rc)
-			goto cleanup;
-		rc = ldmsd_req_cmd_attr_term(rcmd);
-		if (rc)
-			goto cleanup;
-		ldmsd_req_cmd_free(rcmd);
-		rcmd = NULL;
+		__cfg_rec_begin(b, LDMSD_FAILOVER_CFGUPDTR_REQ);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_MATCH, cstr);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_REGEX, nm->regex_str);
+		__cfg_rec_end(b);
 	}
-
-	/* let-through */
-cleanup:
-	if (rcmd)
-		ldmsd_req_cmd_free(rcmd);
-out:
-	return rc;
 }
 
 static
-int __failover_send_strgp(ldmsd_failover_t f, ldms_t x, ldmsd_strgp_t s)
+void __failover_enc_strgp(struct cfg_buf *b, ldmsd_strgp_t s)
 {
-
-	/* NOTE: Send a bunch of small messages due to msg size limitation. */
-	int rc = 0;
-	char buff[128];
+	/* NOTE: Like updtr, the producer regexes and the metrics are separate
+	 *       records. */
+	char name[128];
 	ldmsd_name_match_t nm;
 	ldmsd_strgp_metric_t sm;
-	ldmsd_req_cmd_t rcmd;
-
-	if (0 == strncmp(LDMSD_FAILOVER_NAME_PREFIX, s->obj.name,
-				sizeof(LDMSD_FAILOVER_NAME_PREFIX)-1)) {
-		rc = EINVAL;
-		goto out;
-	}
-
-	rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGSTRGP_REQ,
-				 NULL, NULL, NULL);
-
-	if (!rcmd) {
-		rc = errno;
-		goto out;
-	}
-
-	/* NAME */
-	snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s",
-				     s->obj.name);
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-	if (rc)
-		goto cleanup;
 
-	/* PLUGIN */
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PLUGIN,
-					   s->plugin_name);
-	if (rc)
-		goto cleanup;
-
-	/* CONTAINER */
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_CONTAINER,
-					   s->container);
-	if (rc)
-		goto cleanup;
-
-	/* SCHEMA */
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_SCHEMA, s->schema);
-	if (rc)
-		goto cleanup;
-
-	/* TERM */
-	rc = ldmsd_req_cmd_attr_term(rcmd);
-	if (rc)
-		goto cleanup;
-	ldmsd_req_cmd_free(rcmd);
-	rcmd = NULL;
+	snprintf(name, sizeof(name), LDMSD_FAILOVER_NAME_PREFIX "%s", s->obj.name);
+
+	__cfg_rec_begin(b, LDMSD_FAILOVER_CFGSTRGP_REQ);
+	__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
+	__cfg_rec_attr_str(b, LDMSD_ATTR_PLUGIN, s->plugin_name);
+	__cfg_rec_attr_str(b, LDMSD_ATTR_CONTAINER, s->container);
+	__cfg_rec_attr_str(b, LDMSD_ATTR_SCHEMA, s->schema);
+	if (s->history) {
+		struct ldmsd_history_stats st;
+		char buff[32];
+		ldmsd_history_stats_get(s->history, &st);
+		snprintf(buff, sizeof(buff), "%zu", st.budget);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_HISTORY, buff);
+	}
+	if (s->downsample) {
+		struct ldmsd_downsample_stats st;
+		char buff[32];
+		ldmsd_downsample_stats_get(s->downsample, &st);
+		snprintf(buff, sizeof(buff), "%" PRIu64, st.window);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_DOWNSAMPLE, buff);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_DOWNSAMPLE_OP, st.op);
+	}
+	if (s->deadband) {
+		struct ldmsd_deadband_stats st;
+		char buff[32];
+		ldmsd_deadband_stats_get(s->deadband, &st);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_DEADBAND, st.spec);
+		snprintf(buff, sizeof(buff), "%" PRIu64, st.heartbeat);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_HEARTBEAT, buff);
+	}
+	__cfg_rec_end(b);
 
 	/* list of PRDCR_MATCHES */
 	LIST_FOREACH(nm, &s->prdcr_list, entry) {
-		rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGSTRGP_REQ,
-					 NULL, NULL, NULL);
-		/* NAME */
-		snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s",
-					     s->obj.name);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-		if (rc)
-			goto cleanup;
-
-		/* REGEX */
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_REGEX,
-						   nm->regex_str);
-		if (rc)
-			goto cleanup;
-
-		/* TERM */
-		rc = ldmsd_req_cmd_attr_term(rcmd);
-		if (rc)
-			goto cleanup;
-		ldmsd_req_cmd_free(rcmd);
-		rcmd = NULL;
+		__cfg_rec_begin(b, LDMSD_FAILOVER_CFGSTRGP_REQ);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_REGEX, nm->regex_str);
+		__cfg_rec_end(b);
 	}
 
 	/* list of METRICs in this strgp */
 	TAILQ_FOREACH(sm, &s->metric_list, entry) {
-		rcmd = ldmsd_req_cmd_new(x, LDMSD_FAILOVER_CFGSTRGP_REQ,
-					 NULL, NULL, NULL);
-		/* NAME */
-		snprintf(buff, sizeof(buff), LDMSD_FAILOVER_NAME_PREFIX "%s",
-					     s->obj.name);
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_NAME, buff);
-		if (rc)
-			goto cleanup;
-
-		/* METRIC */
-		rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_METRIC,
-						   sm->name);
-		if (rc)
-			goto cleanup;
-
-		/* TERM */
-		rc = ldmsd_req_cmd_attr_term(rcmd);
-		if (rc)
-			goto cleanup;
-		ldmsd_req_cmd_free(rcmd);
-		rcmd = NULL;
+		__cfg_rec_begin(b, LDMSD_FAILOVER_CFGSTRGP_REQ);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_NAME, name);
+		__cfg_rec_attr_str(b, LDMSD_ATTR_METRIC, sm->name);
+		__cfg_rec_end(b);
 	}
-
-	/* let through */
-
-cleanup:
-	if (rcmd)
-		ldmsd_req_cmd_free(rcmd);
-out:
-	return rc;
 }
 
 static int __on_reset_resp(ldmsd_req_cmd_t rcmd)
@@ -788,87 +871,646 @@ int __failover_send_reset(ldmsd_failover_t f, ldms_t xprt)
 				 NULL, __on_reset_resp, f);
 	if (!rcmd) {
 		rc = errno;
-		goto out;
+		goto out;
+	}
+	/* reset has no attribute */
+	rc = ldmsd_req_cmd_attr_term(rcmd);
+	__F_ON(f, __FAILOVER_OUTSTANDING_UNPAIR);
+out:
+	if (rc && rcmd)
+		ldmsd_req_cmd_free(rcmd);
+	return rc;
+}
+
+/*
+ * Encode our config objects. If `objs` is not NULL, the records of each
+ * object are also indexed in it as `struct cfg_obj`.
+ */
+static
+int __failover_snapshot(ldmsd_failover_t f, struct cfg_buf *b,
+			struct rbt *objs)
+{
+	/* f->lock is held */
+	ldmsd_prdcr_t p;
+	ldmsd_updtr_t u;
+	ldmsd_strgp_t s;
+	uint32_t count;
+	size_t off;
+	int rc;
+
+	rc = __cfg_buf_init(b, sizeof(struct failover_snapshot_hdr));
+	if (rc)
+		return rc;
+
+	ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
+	for (p = ldmsd_prdcr_first(); p; p = ldmsd_prdcr_next(p)) {
+		if (__cfgobj_is_failover(&p->obj))
+			continue;
+		off = b->len;
+		count = b->count;
+		__failover_enc_prdcr(b, p);
+		if (objs)
+			__cfg_obj_add(objs, b, LDMSD_FAILOVER_CFGPRDCR_REQ,
+				      p->obj.name, off, count);
+	}
+	ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+
+	ldmsd_cfg_lock(LDMSD_CFGOBJ_UPDTR);
+	for (u = ldmsd_updtr_first(); u; u = ldmsd_updtr_next(u)) {
+		if (__cfgobj_is_failover(&u->obj))
+			continue;
+		off = b->len;
+		count = b->count;
+		__failover_enc_updtr(b, u);
+		if (objs)
+			__cfg_obj_add(objs, b, LDMSD_FAILOVER_CFGUPDTR_REQ,
+				      u->obj.name, off, count);
+	}
+	ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
+
+	ldmsd_cfg_lock(LDMSD_CFGOBJ_STRGP);
+	for (s = ldmsd_strgp_first(); s; s = ldmsd_strgp_next(s)) {
+		if (__cfgobj_is_failover(&s->obj))
+			continue;
+		off = b->len;
+		count = b->count;
+		__failover_enc_strgp(b, s);
+		if (objs)
+			__cfg_obj_add(objs, b, LDMSD_FAILOVER_CFGSTRGP_REQ,
+				      s->obj.name, off, count);
+	}
+	ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
+
+	if (b->rc) {
+		__cfg_buf_free(b);
+		return b->rc;
+	}
+	__cfg_buf_seal(b);
+	return 0;
+}
+
+/*
+ * Send the snapshot records one message at a time, for peers that do not
+ * request a snapshot.
+ */
+static
+int __failover_replay_snapshot(ldms_t x, struct cfg_buf *b)
+{
+	char *rec = b->buf + sizeof(struct failover_snapshot_hdr);
+	char *end = b->buf + b->len;
+	ldmsd_req_hdr_t hdr;
+	ldmsd_req_attr_t attr;
+	ldmsd_req_cmd_t rcmd;
+	uint32_t len;
+	int rc;
+
+	while (rec < end) {
+		hdr = (void*)rec;
+		rcmd = ldmsd_req_cmd_new(x, ntohl(hdr->req_id), NULL, NULL, NULL);
+		if (!rcmd)
+			return errno;
+		attr = ldmsd_first_attr(hdr);
+		while (attr->discrim) {
+			len = ntohl(attr->attr_len);
+			rc = ldmsd_req_cmd_attr_append(rcmd, ntohl(attr->attr_id),
+						       attr->attr_value, len);
+			if (rc)
+				goto err;
+			attr = (void*)&attr->attr_value[len];
+		}
+		rc = ldmsd_req_cmd_attr_term(rcmd);
+		if (rc)
+			goto err;
+		ldmsd_req_cmd_free(rcmd);
+		rec += ntohl(hdr->rec_len);
+	}
+	return 0;
+err:
+	ldmsd_req_cmd_free(rcmd);
+	return rc;
+}
+
+static
+int __failover_send_cfgobjs(ldmsd_failover_t f, ldms_t x)
+{
+	/* f->lock is held */
+	struct cfg_buf b;
+	int rc;
+
+	rc = __failover_snapshot(f, &b, NULL);
+	if (rc)
+		return rc;
+	rc = __failover_replay_snapshot(x, &b);
+	__cfg_buf_free(&b);
+	return rc;
+}
+
+static
+int __failover_send_snapshot(ldmsd_failover_t f, ldmsd_req_ctxt_t req,
+			     ldmsd_req_attr_t held)
+{
+	/* f->lock is held */
+	struct failover_snapshot_hdr *sh, *hsh;
+	struct ldmsd_req_attr_s attr;
+	struct cfg_buf b;
+	struct rbt objs;
+	uint64_t gn = f->ourcfg_gn;
+	size_t len;
+	int rc;
+
+	rbt_init(&objs, str_rbn_cmp);
+	rc = __failover_snapshot(f, &b, &objs);
+	if (rc)
+		goto out;
+	sh = (void*)b.buf;
+	len = b.len;
+	if (held && held->attr_len >= sizeof(*hsh)) {
+		hsh = (void*)held->attr_value;
+		if (hsh->digest == sh->digest) {
+			/* the requester is up to date, omit the records */
+			sh->count = 0;
+			sh->len = 0;
+			len = sizeof(*sh);
+		}
+	}
+	__dlog("Failover: sending snapshot, %u records, %zu bytes\n",
+	       b.count, len);
+	attr.discrim = 1;
+	attr.attr_id = LDMSD_ATTR_BINARY;
+	attr.attr_len = len;
+	ldmsd_hton_req_attr(&attr);
+	req->errcode = 0;
+	rc = ldmsd_append_reply(req, (void*)&attr, sizeof(attr),
+				LDMSD_REQ_SOM_F);
+	if (rc)
+		goto out;
+	rc = ldmsd_append_reply(req, b.buf, len, 0);
+	if (rc)
+		goto out;
+	attr.discrim = 0;
+	rc = ldmsd_append_reply(req, (char *)&attr.discrim, sizeof(uint32_t),
+				LDMSD_REQ_EOM_F);
+	if (rc)
+		goto out;
+	/* the peer now holds this snapshot, later changes go as diffs */
+	__cfg_objs_free(&f->ourcfg_rbt);
+	f->ourcfg_rbt = objs;
+	rbt_init(&objs, str_rbn_cmp);
+	f->ourcfg_digest = be64toh(sh->digest);
+	f->ourcfg_sent_gn = gn;
+out:
+	__cfg_buf_free(&b);
+	__cfg_objs_free(&objs);
+	return rc;
+}
+
+/*
+ * Peer configuration diff
+ *
+ * Once the peer holds a snapshot of ours (f->ourcfg_digest), our config
+ * changes are sent as a LDMSD_FAILOVER_CFGDIFF_REQ rather than waiting for
+ * the next pairing. A diff is computed by taking a new snapshot and comparing
+ * it, object by object, with the one the peer holds. It carries the NAME-only
+ * records of the objects to delete (strgp, updtr, then prdcr) followed by the
+ * complete records of the objects to create (prdcr, updtr, then strgp); a
+ * changed object is deleted and created again. `base` is the digest of the
+ * snapshot the diff applies to and `digest` the one of the snapshot it
+ * results in. A peer that holds any other snapshot rejects the diff and
+ * requests a snapshot instead.
+ */
+#define FAILOVER_DIFF_MAGIC   0x4c464344 /* "LFCD" */
+#define FAILOVER_DIFF_VERSION 1
+
+#pragma pack(push, 1)
+struct failover_diff_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t base;      /* digest of the snapshot the diff applies to */
+	uint64_t digest;    /* digest of the resulting snapshot */
+	uint32_t total;     /* the number of records of the resulting snapshot */
+	uint32_t del_count; /* the number of delete records */
+	uint32_t del_len;   /* the length of the delete records */
+	uint32_t count;     /* the number of create records */
+	uint32_t len;       /* the length of the create records */
+	char records[OVIS_FLEX];
+};
+#pragma pack(pop)
+
+static int __on_cfgdiff_resp(ldmsd_req_cmd_t rcmd)
+{
+	ldmsd_req_hdr_t hdr = (void*)rcmd->reqc->req_buf;
+	/* the peer requests a snapshot by itself if the diff did not apply */
+	if (hdr->rsp_err)
+		ldmsd_lerror("Failover: config diff remote error: %d\n",
+			     hdr->rsp_err);
+	return 0;
+}
+
+static
+int __failover_send_diff(ldmsd_failover_t f)
+{
+	/* f->lock is held */
+	static const uint32_t order[] = {
+		LDMSD_FAILOVER_CFGPRDCR_REQ,
+		LDMSD_FAILOVER_CFGUPDTR_REQ,
+		LDMSD_FAILOVER_CFGSTRGP_REQ,
+	};
+	struct failover_snapshot_hdr *sh;
+	struct failover_diff_hdr *dh;
+	struct cfg_buf snap, b;
+	struct cfg_obj *o, *old;
+	struct rbt objs;
+	struct rbn *rbn;
+	ldmsd_req_cmd_t rcmd;
+	uint64_t gn = f->ourcfg_gn;
+	uint32_t del_count;
+	size_t del_len;
+	int prdcr_del = 0;
+	int i, rc;
+
+	rbt_init(&objs, str_rbn_cmp);
+	rc = __failover_snapshot(f, &snap, &objs);
+	if (rc)
+		goto out0;
+	sh = (void*)snap.buf;
+	if (be64toh(sh->digest) == f->ourcfg_digest) {
+		/* e.g. start/stop, nothing the peer holds has changed */
+		f->ourcfg_sent_gn = gn;
+		goto out1;
+	}
+
+	RBT_FOREACH(rbn, &objs) {
+		o = CFG_OBJ(rbn);
+		old = CFG_OBJ(rbt_find(&f->ourcfg_rbt, o->key));
+		o->changed = !old || old->hash != o->hash;
+	}
+	RBT_FOREACH(rbn, &f->ourcfg_rbt) {
+		old = CFG_OBJ(rbn);
+		o = CFG_OBJ(rbt_find(&objs, old->key));
+		old->changed = !o || o->changed;
+		if (old->changed && old->req_id == LDMSD_FAILOVER_CFGPRDCR_REQ)
+			prdcr_del = 1;
+	}
+	if (prdcr_del) {
+		/* The peer cannot delete a producer still referenced by an
+		 * updater; the updaters are created again along with it. */
+		RBT_FOREACH(rbn, &objs) {
+			o = CFG_OBJ(rbn);
+			if (o->req_id != LDMSD_FAILOVER_CFGUPDTR_REQ ||
+			    o->changed)
+				continue;
+			o->changed = 1;
+			old = CFG_OBJ(rbt_find(&f->ourcfg_rbt, o->key));
+			old->changed = 1;
+		}
+	}
+
+	rc = __cfg_buf_init(&b, sizeof(*dh));
+	if (rc)
+		goto out1;
+	for (i = ARRAY_LEN(order) - 1; i >= 0; i--) {
+		RBT_FOREACH(rbn, &f->ourcfg_rbt) {
+			old = CFG_OBJ(rbn);
+			if (!old->changed || old->req_id != order[i])
+				continue;
+			__cfg_rec_begin(&b, old->req_id);
+			__cfg_rec_attr_str(&b, LDMSD_ATTR_NAME, old->key + 1);
+			__cfg_rec_end(&b);
+		}
+	}
+	del_count = b.count;
+	del_len = b.len - sizeof(*dh);
+	for (i = 0; i < ARRAY_LEN(order); i++) {
+		RBT_FOREACH(rbn, &objs) {
+			o = CFG_OBJ(rbn);
+			if (!o->changed || o->req_id != order[i])
+				continue;
+			__cfg_buf_append(&b, &snap.buf[o->off], o->len,
+					 o->count);
+		}
+	}
+	if (b.rc) {
+		rc = b.rc;
+		goto out2;
+	}
+	dh = (void*)b.buf;
+	dh->magic = htonl(FAILOVER_DIFF_MAGIC);
+	dh->version = htonl(FAILOVER_DIFF_VERSION);
+	dh->base = htobe64(f->ourcfg_digest);
+	dh->digest = sh->digest;
+	dh->total = sh->count;
+	dh->del_count = htonl(del_count);
+	dh->del_len = htonl(del_len);
+	dh->count = htonl(b.count - del_count);
+	dh->len = htonl(b.len - sizeof(*dh) - del_len);
+
+	rcmd = ldmsd_req_cmd_new(f->ax, LDMSD_FAILOVER_CFGDIFF_REQ,
+				 NULL, __on_cfgdiff_resp, f);
+	if (!rcmd) {
+		rc = errno;
+		goto out2;
 	}
-	/* reset has no attribute */
+	rc = ldmsd_req_cmd_attr_append(rcmd, LDMSD_ATTR_BINARY, b.buf, b.len);
+	if (rc)
+		goto err;
 	rc = ldmsd_req_cmd_attr_term(rcmd);
-	__F_ON(f, __FAILOVER_OUTSTANDING_UNPAIR);
-out:
-	if (rc && rcmd)
-		ldmsd_req_cmd_free(rcmd);
+	if (rc)
+		goto err;
+	ldmsd_linfo("Failover: config diff sent, %u deleted, %u created, "
+		    "%zu bytes\n", del_count, b.count - del_count, b.len);
+	__cfg_objs_free(&f->ourcfg_rbt);
+	f->ourcfg_rbt = objs;
+	rbt_init(&objs, str_rbn_cmp);
+	f->ourcfg_digest = be64toh(sh->digest);
+	f->ourcfg_sent_gn = gn;
+	f->diffs_sent++;
+	f->diff_bytes = b.len;
+	goto out2;
+err:
+	ldmsd_req_cmd_free(rcmd);
+out2:
+	__cfg_buf_free(&b);
+out1:
+	__cfg_buf_free(&snap);
+out0:
+	if (rc)
+		ldmsd_lerror("Failover: config diff error: %d\n", rc);
+	__cfg_objs_free(&objs);
 	return rc;
 }
 
+static inline
+uint64_t __tv_diff_us(struct timeval *a, struct timeval *b)
+{
+	struct timeval tv;
+	timersub(a, b, &tv);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 static
-int __failover_send_cfgobjs(ldmsd_failover_t f, ldms_t x)
+int __failover_cfgprdcr_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen);
+static
+int __failover_cfgupdtr_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen);
+static
+int __failover_cfgstrgp_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen);
+
+static
+int __failover_apply_records(ldmsd_failover_t f, char *rec, size_t rec_len,
+			     struct ldmsd_sec_ctxt sctxt)
 {
 	/* f->lock is held */
-	ldmsd_prdcr_t p;
-	ldmsd_updtr_t u;
-	ldmsd_strgp_t s;
+	char *end = rec + rec_len;
+	ldmsd_req_hdr_t hdr;
+	char errbuf[256];
+	uint32_t len;
 	int rc = 0;
 
-	/* Send PRDCR update */
-	ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
-	for (p = ldmsd_prdcr_first(); p; p = ldmsd_prdcr_next(p)) {
-		if (__cfgobj_is_failover(&p->obj))
-			continue;
-		rc = __failover_send_prdcr(f, x, p);
+	while (rec < end) {
+		hdr = (void*)rec;
+		len = ntohl(hdr->rec_len);
+		if (len < sizeof(*hdr) + sizeof(uint32_t) || len > end - rec)
+			return EPROTO;
+		ldmsd_ntoh_req_msg(hdr);
+		if (hdr->marker != LDMSD_RECORD_MARKER)
+			return EPROTO;
+		errbuf[0] = '\0';
+		switch (hdr->req_id) {
+		case LDMSD_FAILOVER_CFGPRDCR_REQ:
+			rc = __failover_cfgprdcr_apply(f, rec, sctxt,
+						       errbuf, sizeof(errbuf));
+			break;
+		case LDMSD_FAILOVER_CFGUPDTR_REQ:
+			rc = __failover_cfgupdtr_apply(f, rec, sctxt,
+						       errbuf, sizeof(errbuf));
+			break;
+		case LDMSD_FAILOVER_CFGSTRGP_REQ:
+			rc = __failover_cfgstrgp_apply(f, rec, sctxt,
+						       errbuf, sizeof(errbuf));
+			break;
+		default:
+			rc = EPROTO;
+			break;
+		}
 		if (rc) {
-			ldmsd_prdcr_put(p);
-			ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
-			goto out;
+			ldmsd_lerror("Failover: peer config record %s "
+				     "error %d: %s\n",
+				     ldmsd_req_id2str(hdr->req_id), rc, errbuf);
+			return rc;
 		}
+		rec += len;
 	}
-	ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+	return 0;
+}
 
-	/* Send UPDTR update */
-	ldmsd_cfg_lock(LDMSD_CFGOBJ_UPDTR);
-	for (u = ldmsd_updtr_first(); u; u = ldmsd_updtr_next(u)) {
-		if (__cfgobj_is_failover(&u->obj))
-			continue;
-		rc = __failover_send_updtr(f, x, u);
+/*
+ * Delete the peer config objects named by the NAME-only records of a diff.
+ */
+static
+int __failover_delete_records(ldmsd_failover_t f, char *rec, size_t rec_len)
+{
+	/* f->lock is held */
+	char *end = rec + rec_len;
+	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(NULL);
+	ldmsd_req_hdr_t hdr;
+	ldmsd_req_attr_t attr;
+	struct rbt *t;
+	struct rbn *rbn;
+	int (*del)(const char *, ldmsd_sec_ctxt_t);
+	uint32_t len;
+	int rc;
+
+	while (rec < end) {
+		hdr = (void*)rec;
+		len = ntohl(hdr->rec_len);
+		if (len < sizeof(*hdr) + sizeof(uint32_t) || len > end - rec)
+			return EPROTO;
+		ldmsd_ntoh_req_msg(hdr);
+		if (hdr->marker != LDMSD_RECORD_MARKER)
+			return EPROTO;
+		switch (hdr->req_id) {
+		case LDMSD_FAILOVER_CFGPRDCR_REQ:
+			t = &f->prdcr_rbt;
+			del = ldmsd_prdcr_del;
+			break;
+		case LDMSD_FAILOVER_CFGUPDTR_REQ:
+			t = &f->updtr_rbt;
+			del = ldmsd_updtr_del;
+			break;
+		case LDMSD_FAILOVER_CFGSTRGP_REQ:
+			t = &f->strgp_rbt;
+			del = ldmsd_strgp_del;
+			break;
+		default:
+			return EPROTO;
+		}
+		attr = ldmsd_req_attr_get_by_id(rec, LDMSD_ATTR_NAME);
+		if (!attr || !attr->attr_len ||
+		    attr->attr_value[attr->attr_len - 1] != '\0')
+			return EPROTO;
+		rbn = rbt_find(t, attr->attr_value);
+		if (!rbn) {
+			ldmsd_lerror("Failover: peer config '%s' not found\n",
+				     (char *)attr->attr_value);
+			return ENOENT;
+		}
+		rc = del(STR_RBN(rbn)->str, &sctxt);
 		if (rc) {
-			ldmsd_updtr_put(u);
-			ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
-			goto out;
+			ldmsd_lerror("Failover: peer config '%s' deletion "
+				     "failed, rc: %d\n", STR_RBN(rbn)->str, rc);
+			return rc;
 		}
+		rbt_del(t, rbn);
+		str_rbn_free(STR_RBN(rbn));
+		rec += len;
 	}
-	ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
+	return 0;
+}
 
-	ldmsd_cfg_lock(LDMSD_CFGOBJ_STRGP);
-	for (s = ldmsd_strgp_first(); s; s = ldmsd_strgp_next(s)) {
-		if (__cfgobj_is_failover(&s->obj))
-			continue;
-		rc = __failover_send_strgp(f, x, s);
-		if (rc) {
-			ldmsd_strgp_put(s);
-			ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
-			goto out;
-		}
+static
+int __failover_recv_diff(ldmsd_failover_t f, ldmsd_req_attr_t attr,
+			 struct ldmsd_sec_ctxt sctxt)
+{
+	/* f->lock is held */
+	struct failover_diff_hdr *dh = (void*)attr->attr_value;
+	struct timeval ts, tv;
+	uint64_t base, digest;
+	uint32_t del_len, len;
+	int rc;
+
+	if (attr->attr_len < sizeof(*dh) ||
+	    ntohl(dh->magic) != FAILOVER_DIFF_MAGIC ||
+	    ntohl(dh->version) != FAILOVER_DIFF_VERSION)
+		return EPROTO;
+	del_len = ntohl(dh->del_len);
+	len = ntohl(dh->len);
+	if ((uint64_t)del_len + len != attr->attr_len - sizeof(*dh))
+		return EPROTO;
+	base = be64toh(dh->base);
+	digest = be64toh(dh->digest);
+	if (f->peercfg_digest && digest == f->peercfg_digest)
+		return 0; /* a snapshot with the change got here first */
+	if (!f->peercfg_digest || base != f->peercfg_digest)
+		return ESTALE;
+	if (__peercfg_activated(f))
+		return EBUSY;
+
+	gettimeofday(&ts, NULL);
+	/* the objects match no snapshot until the whole diff is applied */
+	f->peercfg_digest = 0;
+	rc = __failover_delete_records(f, dh->records, del_len);
+	if (rc)
+		return rc;
+	rc = __failover_apply_records(f, dh->records + del_len, len, sctxt);
+	if (rc)
+		return rc;
+	f->peercfg_digest = digest;
+	f->cfg_objs = ntohl(dh->total);
+	f->diffs_applied++;
+	gettimeofday(&tv, NULL);
+	f->diff_us = __tv_diff_us(&tv, &ts);
+	ldmsd_linfo("Failover: peer config diff applied, %u deleted, "
+		    "%u created, %lu usec\n", ntohl(dh->del_count),
+		    ntohl(dh->count), f->diff_us);
+	return 0;
+}
+
+static
+int __failover_recv_snapshot(ldmsd_failover_t f, ldmsd_req_attr_t attr)
+{
+	/* f->lock is held */
+	struct failover_snapshot_hdr *sh = (void*)attr->attr_value;
+	struct ldmsd_sec_ctxt sctxt;
+	uint64_t digest;
+	int rc;
+
+	if (attr->attr_len < sizeof(*sh) ||
+	    ntohl(sh->magic) != FAILOVER_SNAPSHOT_MAGIC ||
+	    ntohl(sh->version) != FAILOVER_SNAPSHOT_VERSION)
+		return EPROTO;
+	f->cfg_bytes = attr->attr_len;
+	digest = be64toh(sh->digest);
+	if (f->peercfg_digest && digest == f->peercfg_digest) {
+		ldmsd_linfo("Failover: peer config unchanged\n");
+		return 0;
 	}
-	ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
+	if (ntohl(sh->len) != attr->attr_len - sizeof(*sh) ||
+	    __fnv1a64(sh->records, ntohl(sh->len)) != digest)
+		return EPROTO;
 
-out:
-	return rc;
+	/* replace the config we are holding */
+	rc = __peercfg_stop(f);
+	if (rc)
+		return rc;
+	rc = __peercfg_delete(f);
+	if (rc)
+		return rc;
+	ldms_xprt_cred_get(f->ax, NULL, &sctxt.crd);
+	rc = __failover_apply_records(f, sh->records, ntohl(sh->len), sctxt);
+	if (rc) {
+		__peercfg_delete(f);
+		return rc;
+	}
+	f->peercfg_digest = digest;
+	f->cfg_objs = ntohl(sh->count);
+	return 0;
 }
 
 int __on_peercfg_resp(ldmsd_req_cmd_t rcmd)
 {
 	ldmsd_failover_t f = rcmd->ctxt;
 	ldmsd_req_hdr_t hdr = (void*)rcmd->reqc->req_buf;
+	ldmsd_req_attr_t attr;
+	struct timeval tv;
+	int resync;
+	int rc;
+
 	__failover_lock(f);
-	if (hdr->rsp_err) {
+	/* a diff was rejected while the snapshot was on its way */
+	resync = f->conn_state == FAILOVER_CONN_STATE_CONFIGURING &&
+		 __F_GET(f, __FAILOVER_PEERCFG_RESYNC);
+	__F_OFF(f, __FAILOVER_PEERCFG_RESYNC);
+	rc = hdr->rsp_err;
+	if (rc) {
 		ldmsd_lerror("Failover: peer config request remote error: %d\n",
-			     hdr->rsp_err);
-		f->conn_state = FAILOVER_CONN_STATE_ERROR;
-		ldms_xprt_close(f->ax);
-	} else {
-		/* all peercfg have been received at this point */
-		__F_ON(f, __FAILOVER_PEERCFG_RECEIVED);
-		f->conn_state = FAILOVER_CONN_STATE_CONFIGURED;
-		ldmsd_linfo("Failover: peer config recv success\n");
+			     rc);
+		goto err;
 	}
+	attr = ldmsd_req_attr_get_by_id(rcmd->reqc->req_buf,
+					LDMSD_ATTR_BINARY);
+	if (attr) {
+		rc = __failover_recv_snapshot(f, attr);
+		if (rc) {
+			ldmsd_lerror("Failover: peer config snapshot "
+				     "error: %d\n", rc);
+			goto err;
+		}
+	} else {
+		/* The peer does not send snapshots; the objects have been
+		 * received one message at a time ahead of this response. */
+		f->peercfg_digest = 0;
+		f->cfg_bytes = 0;
+		f->cfg_objs = 0;
+	}
+	/* all peercfg have been received at this point */
+	__F_ON(f, __FAILOVER_PEERCFG_RECEIVED);
+	f->conn_state = FAILOVER_CONN_STATE_CONFIGURED;
+	gettimeofday(&tv, NULL);
+	f->cfg_us = __tv_diff_us(&tv, &f->cfg_ts);
+	ldmsd_linfo("Failover: peer config recv success, %lu usec\n",
+		    f->cfg_us);
+	if (resync && 0 == __failover_request_peercfg(f))
+		__F_ON(f, __FAILOVER_PEERCFG_RESYNC);
+	__failover_unlock(f);
+	return 0;
+err:
+	f->conn_state = FAILOVER_CONN_STATE_ERROR;
+	ldms_xprt_close(f->ax);
 	__failover_unlock(f);
 	return 0;
 }
@@ -877,6 +1519,7 @@ static
 int __failover_request_peercfg(ldmsd_failover_t f)
 {
 	/* f->lock is held */
+	struct failover_snapshot_hdr sh = {0};
 	ldmsd_req_cmd_t rcmd;
 	int rc;
 
@@ -888,7 +1531,23 @@ int __failover_request_peercfg(ldmsd_failover_t f)
 		rc = errno;
 		goto out;
 	}
+	/* ask for a snapshot, telling the peer what we have */
+	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_FORMAT, "snapshot");
+	if (rc)
+		goto err;
+	sh.magic = htonl(FAILOVER_SNAPSHOT_MAGIC);
+	sh.version = htonl(FAILOVER_SNAPSHOT_VERSION);
+	sh.digest = htobe64(f->peercfg_digest);
+	rc = ldmsd_req_cmd_attr_append(rcmd, LDMSD_ATTR_BINARY, &sh, sizeof(sh));
+	if (rc)
+		goto err;
+	gettimeofday(&f->cfg_ts, NULL);
 	rc = ldmsd_req_cmd_attr_term(rcmd);
+	if (rc)
+		goto err;
+	goto out;
+err:
+	ldmsd_req_cmd_free(rcmd);
 out:
 	if (rc) {
 		ldmsd_lerror("Failover: peer config request local error: %d\n",
@@ -897,6 +1556,35 @@ out:
 	return rc;
 }
 
+/*
+ * The peer config we hold does not match the peer anymore, get a snapshot.
+ */
+static
+void __failover_peercfg_resync(ldmsd_failover_t f)
+{
+	/* f->lock is held */
+	if (__peercfg_activated(f)) {
+		/* keep running it, but replace it when the peer is back */
+		f->peercfg_digest = 0;
+		return;
+	}
+	switch (f->conn_state) {
+	case FAILOVER_CONN_STATE_CONFIGURED:
+		if (__F_GET(f, __FAILOVER_PEERCFG_RESYNC))
+			break; /* already requested */
+		if (0 == __failover_request_peercfg(f))
+			__F_ON(f, __FAILOVER_PEERCFG_RESYNC);
+		break;
+	case FAILOVER_CONN_STATE_CONFIGURING:
+		/* request again once the outstanding snapshot is in */
+		__F_ON(f, __FAILOVER_PEERCFG_RESYNC);
+		break;
+	default:
+		/* the peer config is requested after pairing */
+		break;
+	}
+}
+
 static
 int __failover_reset_and_request_peercfg(ldmsd_failover_t f)
 {
@@ -905,7 +1593,13 @@ int __failover_reset_and_request_peercfg(ldmsd_failover_t f)
 	__ASSERT(f->conn_state == FAILOVER_CONN_STATE_RESETTING);
 	if (f->conn_state != FAILOVER_CONN_STATE_RESETTING)
 		return EINVAL;
-	rc = __peercfg_reset(f);
+	if (f->peercfg_digest) {
+		/* Keep the config from the previous snapshot; it is replaced
+		 * only if the peer reports a different digest. */
+		rc = __peercfg_stop(f);
+	} else {
+		rc = __peercfg_reset(f);
+	}
 	if (rc)
 		return rc; /* the f->task will retry this later */
 	f->conn_state = FAILOVER_CONN_STATE_CONFIGURING;
@@ -917,10 +1611,13 @@ int __on_pair_resp(ldmsd_req_cmd_t rcmd)
 {
 	ldmsd_failover_t f = rcmd->ctxt;
 	ldmsd_req_hdr_t hdr = (void*)rcmd->reqc->req_buf;
+	struct timeval tv;
 	int rc = 0;
 
 	__failover_lock(f);
 	__ASSERT(f->conn_state == FAILOVER_CONN_STATE_PAIRING);
+	gettimeofday(&tv, NULL);
+	f->pair_us = __tv_diff_us(&tv, &f->pair_ts);
 
 	if (hdr->rsp_err) {
 		if (hdr->rsp_err == EAGAIN) {
@@ -973,6 +1670,7 @@ void __failover_pair(ldmsd_failover_t f)
 	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_PEER_NAME, myname);
 	if (rc)
 		goto err;
+	gettimeofday(&f->pair_ts, NULL);
 	rc = ldmsd_req_cmd_attr_term(rcmd);
 	if (rc)
 		goto err;
@@ -1020,6 +1718,7 @@ void __failover_xprt_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 		__F_ON(f, __FAILOVER_OURCFG_ACTIVATED);
 		__F_OFF(f, __FAILOVER_OUTSTANDING_PING);
 		__F_OFF(f, __FAILOVER_OUTSTANDING_UNPAIR);
+		__F_OFF(f, __FAILOVER_PEERCFG_RESYNC);
 		__failover_unlock(f);
 		if (need_start) {
 			ldmsd_ourcfg_start_proc();
@@ -1238,6 +1937,7 @@ int __peercfg_delete(ldmsd_failover_t f)
 	int (*fn)(void*, void*);
 
 	ldmsd_linfo("Failover: deleting peer config\n");
+	f->peercfg_digest = 0;
 
 	/* cfgobjs have all already stopped */
 	for (i = 0; i < 3; i++) {
@@ -1351,6 +2051,8 @@ int __try_stop(ldmsd_failover_t f)
 
 	ldmsd_task_stop(&f->task);
 	f->state = FAILOVER_STATE_STOP;
+	__cfg_objs_free(&f->ourcfg_rbt);
+	f->ourcfg_digest = 0;
 	ldmsd_inband_cfg_mask_set(LDMSD_PERM_FAILOVER_ALLOWED | 0777);
 	return 0;
 }
@@ -1430,6 +2132,9 @@ void __failover_active_routine(ldmsd_failover_t f)
 		break;
 	case FAILOVER_CONN_STATE_CONFIGURED:
 		__failover_ping(f);
+		/* config changes since the peer took its snapshot */
+		if (f->ourcfg_digest && f->ourcfg_gn != f->ourcfg_sent_gn)
+			(void)__failover_send_diff(f);
 		break;
 	default:
 		__ASSERT(0 == "BAD STATE");
@@ -1489,17 +2194,24 @@ int __peercfg_start(ldmsd_failover_t f)
 {
 	/* f->lock is held */
 	int rc = 0;
+	int n = 0;
 	struct rbn *rbn;
 	struct str_rbn *srbn;
+	struct timeval tv;
 	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(NULL);
 
 	ldmsd_linfo("Failover: starting peercfg, flags: %#lo\n", f->flags);
 
+	gettimeofday(&f->takeover_ts, NULL);
+	/* All producers are started in one pass; the first connects are
+	 * spread out so that the takeover does not hit the network (and the
+	 * name service) with all of them at once. */
 	RBT_FOREACH(rbn, &f->prdcr_rbt) {
 		srbn = STR_RBN(rbn);
 		if (srbn->started)
 			continue;
-		rc = ldmsd_prdcr_start(srbn->str, NULL, &sctxt);
+		rc = ldmsd_prdcr_start_delayed(srbn->str,
+				1 + n * FAILOVER_CONNECT_SPACING, &sctxt);
 		if (rc) {
 			ldmsd_log(LDMSD_LERROR,
 				  "failover: prdcr_start(%s) failed, "
@@ -1507,6 +2219,7 @@ int __peercfg_start(ldmsd_failover_t f)
 			continue;
 		}
 		srbn->started = 1;
+		n++;
 	}
 
 	RBT_FOREACH(rbn, &f->updtr_rbt) {
@@ -1523,6 +2236,15 @@ int __peercfg_start(ldmsd_failover_t f)
 		srbn->started = 1;
 	}
 
+	if (n) {
+		gettimeofday(&tv, NULL);
+		f->takeover_us = __tv_diff_us(&tv, &f->takeover_ts);
+		f->takeover_prdcrs = n;
+		ldmsd_linfo("Failover: %d peer producers started in %lu usec, "
+			    "connecting over %d usec\n", n, f->takeover_us,
+			    n * FAILOVER_CONNECT_SPACING);
+	}
+
 	__dlog("Failover: __peercfg_start(), flags: %#lx, rc: %d\n",
 	       f->flags, rc);
 	return 0;
@@ -1699,12 +2421,14 @@ int failover_status_handler(ldmsd_req_ctxt_t req)
 		__FAILOVER_PEERCFG_RECEIVED,
 		__FAILOVER_OUTSTANDING_PING,
 		__FAILOVER_OURCFG_ACTIVATED,
+		__FAILOVER_PEERCFG_RESYNC,
 	};
 	static const char *fls[] = {
 		"CONFIGURED",
 		"PEERCFG_RECEIVED",
 		"OUTSTANDING_PING",
 		"OURCFG_ACTIVATED",
+		"PEERCFG_RESYNC",
 	};
 	f = __ldmsd_req_failover_get(req);
 	if (!f) {
@@ -1762,6 +2486,20 @@ int failover_status_handler(ldmsd_req_ctxt_t req)
 	__APPEND(", \"peercfg_activated\": \"%d\"", __peercfg_activated(f));
 	__APPEND(", \"peercfg_updtr_activated\": \"%d\"", __peercfg_updtr_activated(f));
 	__APPEND(", \"peercfg_prdcr_activated\": \"%d\"", __peercfg_prdcr_activated(f));
+	__APPEND(", \"peercfg_digest\": \"%#lx\"", f->peercfg_digest);
+	__APPEND(", \"pair_usec\": \"%lu\"", f->pair_us);
+	__APPEND(", \"peercfg_usec\": \"%lu\"", f->cfg_us);
+	__APPEND(", \"peercfg_bytes\": \"%lu\"", f->cfg_bytes);
+	__APPEND(", \"peercfg_objs\": \"%d\"", f->cfg_objs);
+	__APPEND(", \"peercfg_diffs\": \"%d\"", f->diffs_applied);
+	__APPEND(", \"peercfg_diff_usec\": \"%lu\"", f->diff_us);
+	__APPEND(", \"ourcfg_digest\": \"%#lx\"", f->ourcfg_digest);
+	__APPEND(", \"ourcfg_diffs\": \"%d\"", f->diffs_sent);
+	__APPEND(", \"ourcfg_diff_bytes\": \"%lu\"", f->diff_bytes);
+	__APPEND(", \"takeover_ts\": \"%ld.%ld\"", f->takeover_ts.tv_sec,
+						    f->takeover_ts.tv_usec);
+	__APPEND(", \"takeover_usec\": \"%lu\"", f->takeover_us);
+	__APPEND(", \"takeover_prdcrs\": \"%d\"", f->takeover_prdcrs);
 	__APPEND(", \"flags\": {");
 	for (i = 0; i < (sizeof(fl)/sizeof(*fl)); i++) {
 		if (i)
@@ -1964,21 +2702,37 @@ int failover_reset_handler(ldmsd_req_ctxt_t req)
 	return 0;
 }
 
-int failover_cfgprdcr_handler(ldmsd_req_ctxt_t req)
+static inline
+char *__msg_attr_gets(char *msg, enum ldmsd_request_attr aid)
 {
-	/* create new cfg if not existed, or update if exited */
+	ldmsd_req_attr_t attr = ldmsd_req_attr_get_by_id(msg, aid);
+	if (!attr)
+		return NULL;
+	return str_repl_env_vars((char *)attr->attr_value);
+}
 
-	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
+/*
+ * The cfg*_apply() functions process a LDMSD_FAILOVER_CFG*_REQ message in
+ * host byte order, either received on its own or taken from a peer config
+ * snapshot.
+ */
+static
+int __failover_cfgprdcr_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen)
+{
+	/* f->lock is held */
+	/* create new cfg if not existed, or update if exited */
 
-	char *name = __req_attr_gets(req, LDMSD_ATTR_NAME);
-	char *host = __req_attr_gets(req, LDMSD_ATTR_HOST);
-	char *port = __req_attr_gets(req, LDMSD_ATTR_PORT);
-	char *xprt = __req_attr_gets(req, LDMSD_ATTR_XPRT);
-	char *interval = __req_attr_gets(req, LDMSD_ATTR_INTERVAL);
-	char *type = __req_attr_gets(req, LDMSD_ATTR_TYPE);
-	char *uid = __req_attr_gets(req, LDMSD_ATTR_UID);
-	char *gid = __req_attr_gets(req, LDMSD_ATTR_GID);
-	char *perm = __req_attr_gets(req, LDMSD_ATTR_PERM);
+	char *name = __msg_attr_gets(msg, LDMSD_ATTR_NAME);
+	char *host = __msg_attr_gets(msg, LDMSD_ATTR_HOST);
+	char *port = __msg_attr_gets(msg, LDMSD_ATTR_PORT);
+	char *xprt = __msg_attr_gets(msg, LDMSD_ATTR_XPRT);
+	char *interval = __msg_attr_gets(msg, LDMSD_ATTR_INTERVAL);
+	char *type = __msg_attr_gets(msg, LDMSD_ATTR_TYPE);
+	char *uid = __msg_attr_gets(msg, LDMSD_ATTR_UID);
+	char *gid = __msg_attr_gets(msg, LDMSD_ATTR_GID);
+	char *perm = __msg_attr_gets(msg, LDMSD_ATTR_PERM);
 
 	uid_t _uid;
 	gid_t _gid;
@@ -1987,11 +2741,8 @@ int failover_cfgprdcr_handler(ldmsd_req_ctxt_t req)
 	enum ldmsd_prdcr_type ptype;
 	ldmsd_prdcr_t p;
 	struct str_rbn *srbn;
-	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(req);
 	int rc = 0;
 
-	__failover_lock(f);
-
 	if (!name || !__name_is_failover(name)) {
 		__ASSERT(0 == "BAD MESSAGE");
 		rc = EINVAL;
@@ -2031,12 +2782,12 @@ int failover_cfgprdcr_handler(ldmsd_req_ctxt_t req)
 			atoi(interval), _uid, _gid, _perm);
 	if (!p) {
 		rc = errno;
+		snprintf(errbuf, errlen, "prdcr '%s' creation failed", name);
 		str_rbn_free(srbn);
 		goto out;
 	}
 	rbt_ins(&f->prdcr_rbt, &srbn->rbn);
 out:
-	__failover_unlock(f);
 	if (name)
 		free(name);
 	if (host)
@@ -2055,29 +2806,45 @@ out:
 		free(gid);
 	if (perm)
 		free(perm);
+	return rc;
+}
+
+int failover_cfgprdcr_handler(ldmsd_req_ctxt_t req)
+{
+	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
+	int rc;
+
+	__failover_lock(f);
+	rc = __failover_cfgprdcr_apply(f, req->req_buf, __get_sec_ctxt(req),
+				       req->line_buf, req->line_len);
+	__failover_unlock(f);
 	/* this req needs no resp */
 	return rc;
 }
 
 int __ldmsd_updtr_prdcr_add(ldmsd_updtr_t updtr, ldmsd_prdcr_t prdcr);
 
-int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
+static
+int __failover_cfgupdtr_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen)
 {
+	/* f->lock is held */
 	/* create new cfg if not existed, or update if exited */
 	int push_flags = 0;
-	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
 
-	char *name = __req_attr_gets(req, LDMSD_ATTR_NAME);
-	char *interval = __req_attr_gets(req, LDMSD_ATTR_INTERVAL);
-	char *offset = __req_attr_gets(req, LDMSD_ATTR_OFFSET);
-	char *regex = __req_attr_gets(req, LDMSD_ATTR_REGEX);
-	char *match = __req_attr_gets(req, LDMSD_ATTR_MATCH);
-	char *push = __req_attr_gets(req, LDMSD_ATTR_PUSH);
-	char *producer = __req_attr_gets(req, LDMSD_ATTR_PRODUCER);
-	char *auto_interval = __req_attr_gets(req, LDMSD_ATTR_AUTO_INTERVAL);
-	char *uid = __req_attr_gets(req, LDMSD_ATTR_UID);
-	char *gid = __req_attr_gets(req, LDMSD_ATTR_GID);
-	char *perm = __req_attr_gets(req, LDMSD_ATTR_PERM);
+	char *name = __msg_attr_gets(msg, LDMSD_ATTR_NAME);
+	char *interval = __msg_attr_gets(msg, LDMSD_ATTR_INTERVAL);
+	char *offset = __msg_attr_gets(msg, LDMSD_ATTR_OFFSET);
+	char *regex = __msg_attr_gets(msg, LDMSD_ATTR_REGEX);
+	char *match = __msg_attr_gets(msg, LDMSD_ATTR_MATCH);
+	char *push = __msg_attr_gets(msg, LDMSD_ATTR_PUSH);
+	char *producer = __msg_attr_gets(msg, LDMSD_ATTR_PRODUCER);
+	char *auto_interval = __msg_attr_gets(msg, LDMSD_ATTR_AUTO_INTERVAL);
+	char *cond = __msg_attr_gets(msg, LDMSD_ATTR_CONDITIONAL);
+	char *uid = __msg_attr_gets(msg, LDMSD_ATTR_UID);
+	char *gid = __msg_attr_gets(msg, LDMSD_ATTR_GID);
+	char *perm = __msg_attr_gets(msg, LDMSD_ATTR_PERM);
 
 	uid_t _uid;
 	gid_t _gid;
@@ -2086,12 +2853,9 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 	ldmsd_updtr_t u;
 	ldmsd_prdcr_t p;
 	struct str_rbn *srbn;
-	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(req);
 	int rc = 0;
 	uint8_t is_auto_interval = (auto_interval)?0:1;
 
-	__failover_lock(f);
-
 	if (!name || !__name_is_failover(name)) {
 		__ASSERT(0 == "BAD MESSAGE");
 		rc = EINVAL;
@@ -2117,13 +2881,17 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 	if (!u) {
 		/* create */
 		srbn = str_rbn_new(name);
-		if (!srbn)
+		if (!srbn) {
+			rc = ENOMEM;
 			goto out;
+		}
 		u = ldmsd_updtr_new_with_auth(name, interval, offset,
 						push_flags, is_auto_interval,
 						_uid, _gid, _perm);
 		if (!u) {
 			rc = errno;
+			snprintf(errbuf, errlen, "updtr '%s' creation failed",
+				 name);
 			str_rbn_free(srbn);
 			goto out;
 		}
@@ -2142,11 +2910,15 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 		if (push_flags)
 			u->default_task.task_flags = LDMSD_TASK_F_IMMEDIATE;
 	}
+	if (cond)
+		u->is_cond = (0 == strcasecmp(cond, "true"));
 	if (producer) {
 		/* add producer */
 		p = ldmsd_prdcr_find(producer);
 		if (!p) {
 			rc = ENOENT;
+			snprintf(errbuf, errlen, "prdcr '%s' not found",
+				 producer);
 			goto updtr_put;
 		}
 		rc = __ldmsd_updtr_prdcr_add(u, p);
@@ -2154,13 +2926,12 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 	}
 	if (match && regex) {
 		/* add matching condition */
-		rc = ldmsd_updtr_match_add(name, regex, match, req->line_buf,
-					   req->line_len, &sctxt);
+		rc = ldmsd_updtr_match_add(name, regex, match, errbuf,
+					   errlen, &sctxt);
 	}
 updtr_put:
 	ldmsd_updtr_put(u);
 out:
-	__failover_unlock(f);
 	if (name)
 		free(name);
 	if (interval)
@@ -2175,30 +2946,54 @@ out:
 		free(push);
 	if (producer)
 		free(producer);
+	if (auto_interval)
+		free(auto_interval);
+	if (cond)
+		free(cond);
 	if (uid)
 		free(uid);
 	if (gid)
 		free(gid);
 	if (perm)
 		free(perm);
+	return rc;
+}
+
+int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
+{
+	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
+	int rc;
+
+	__failover_lock(f);
+	rc = __failover_cfgupdtr_apply(f, req->req_buf, __get_sec_ctxt(req),
+				       req->line_buf, req->line_len);
+	__failover_unlock(f);
 	/* this req need no resp */
 	return rc;
 }
 
-int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
+static
+int __failover_cfgstrgp_apply(ldmsd_failover_t f, char *msg,
+			      struct ldmsd_sec_ctxt sctxt,
+			      char *errbuf, size_t errlen)
 {
+	/* f->lock is held */
 	/* create new cfg if not existed, or update if exited */
-	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
 
-	char *name = __req_attr_gets(req, LDMSD_ATTR_NAME);
-	char *regex = __req_attr_gets(req, LDMSD_ATTR_REGEX);
-	char *metric = __req_attr_gets(req, LDMSD_ATTR_METRIC);
-	char *plugin = __req_attr_gets(req, LDMSD_ATTR_PLUGIN);
-	char *schema = __req_attr_gets(req, LDMSD_ATTR_SCHEMA);
-	char *container = __req_attr_gets(req, LDMSD_ATTR_CONTAINER);
-	char *uid = __req_attr_gets(req, LDMSD_ATTR_UID);
-	char *gid = __req_attr_gets(req, LDMSD_ATTR_GID);
-	char *perm = __req_attr_gets(req, LDMSD_ATTR_PERM);
+	char *name = __msg_attr_gets(msg, LDMSD_ATTR_NAME);
+	char *regex = __msg_attr_gets(msg, LDMSD_ATTR_REGEX);
+	char *metric = __msg_attr_gets(msg, LDMSD_ATTR_METRIC);
+	char *plugin = __msg_attr_gets(msg, LDMSD_ATTR_PLUGIN);
+	char *schema = __msg_attr_gets(msg, LDMSD_ATTR_SCHEMA);
+	char *container = __msg_attr_gets(msg, LDMSD_ATTR_CONTAINER);
+	char *uid = __msg_attr_gets(msg, LDMSD_ATTR_UID);
+	char *gid = __msg_attr_gets(msg, LDMSD_ATTR_GID);
+	char *perm = __msg_attr_gets(msg, LDMSD_ATTR_PERM);
+	char *history = __msg_attr_gets(msg, LDMSD_ATTR_HISTORY);
+	char *downsample = __msg_attr_gets(msg, LDMSD_ATTR_DOWNSAMPLE);
+	char *downsample_op = __msg_attr_gets(msg, LDMSD_ATTR_DOWNSAMPLE_OP);
+	char *deadband = __msg_attr_gets(msg, LDMSD_ATTR_DEADBAND);
+	char *heartbeat = __msg_attr_gets(msg, LDMSD_ATTR_HEARTBEAT);
 
 	uid_t _uid;
 	gid_t _gid;
@@ -2207,11 +3002,8 @@ int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
 	struct str_rbn *srbn;
 
 	ldmsd_strgp_t s;
-	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(req);
 	int rc = 0;
 
-	__failover_lock(f);
-
 	if (!name || !__name_is_failover(name)) {
 		__ASSERT(0 == "BAD MESSAGE");
 		rc = EINVAL;
@@ -2233,11 +3025,15 @@ int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
 			goto out;
 		}
 		srbn = str_rbn_new(name);
-		if (!srbn)
+		if (!srbn) {
+			rc = ENOMEM;
 			goto out;
+		}
 		s = ldmsd_strgp_new_with_auth(name, _uid, _gid, _perm);
 		if (!s) {
 			rc = errno;
+			snprintf(errbuf, errlen, "strgp '%s' creation failed",
+				 name);
 			str_rbn_free(srbn);
 			goto out;
 		}
@@ -2249,12 +3045,35 @@ int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
 		schema = NULL;
 		s->container = container;
 		container = NULL;
+		if (history) {
+			s->history = ldmsd_history_new(strtoul(history, NULL, 0));
+			if (!s->history) {
+				rc = ENOMEM;
+				goto put;
+			}
+		}
+		if (downsample) {
+			s->downsample = ldmsd_downsample_new(
+					strtoull(downsample, NULL, 0),
+					downsample_op);
+			if (!s->downsample) {
+				rc = errno;
+				goto put;
+			}
+		}
+		if (deadband) {
+			s->deadband = ldmsd_deadband_new(deadband,
+				heartbeat ? strtoull(heartbeat, NULL, 0) : 0);
+			if (!s->deadband) {
+				rc = errno;
+				goto put;
+			}
+		}
 	}
 
 	if (regex) {
 		/* strgp_prdcr_add */
-		rc = ldmsd_strgp_prdcr_add(name, regex, req->line_buf,
-					   req->line_len, &sctxt);
+		rc = ldmsd_strgp_prdcr_add(name, regex, errbuf, errlen, &sctxt);
 		if (rc)
 			goto put;
 	}
@@ -2269,7 +3088,6 @@ int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
 put:
 	ldmsd_strgp_put(s);
 out:
-	__failover_unlock(f);
 	if (name)
 		free(name);
 	if (regex)
@@ -2288,6 +3106,28 @@ out:
 		free(gid);
 	if (perm)
 		free(perm);
+	if (history)
+		free(history);
+	if (downsample)
+		free(downsample);
+	if (downsample_op)
+		free(downsample_op);
+	if (deadband)
+		free(deadband);
+	if (heartbeat)
+		free(heartbeat);
+	return rc;
+}
+
+int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req)
+{
+	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
+	int rc;
+
+	__failover_lock(f);
+	rc = __failover_cfgstrgp_apply(f, req->req_buf, __get_sec_ctxt(req),
+				       req->line_buf, req->line_len);
+	__failover_unlock(f);
 	/* this req need no resp */
 	return rc;
 }
@@ -2347,21 +3187,86 @@ int failover_peercfg_handler(ldmsd_req_ctxt_t req)
 {
 	int rc = 0;
 	ldmsd_failover_t f;
+	char *format;
 
 	f = __ldmsd_req_failover_get(req);
 	if (!f) {
 		rc = ENOENT;
 		goto out;
 	}
+	format = __req_attr_gets(req, LDMSD_ATTR_FORMAT);
 	__failover_lock(f);
+	if (format && 0 == strcmp(format, "snapshot")) {
+		rc = __failover_send_snapshot(f, req,
+				ldmsd_req_attr_get_by_id(req->req_buf,
+							 LDMSD_ATTR_BINARY));
+		__failover_unlock(f);
+		free(format);
+		if (!rc)
+			return 0; /* the snapshot is the response */
+		goto out;
+	}
 	rc = __failover_send_cfgobjs(f, req->xprt->ldms.ldms);
 	__failover_unlock(f);
+	if (format)
+		free(format);
 out:
 	req->errcode = rc;
 	ldmsd_send_req_response(req, NULL);
 	return rc;
 }
 
+int failover_cfgdiff_handler(ldmsd_req_ctxt_t req)
+{
+	ldmsd_failover_t f = __ldmsd_req_failover_get(req);
+	ldmsd_req_attr_t attr;
+	int rc;
+
+	attr = ldmsd_req_attr_get_by_id(req->req_buf, LDMSD_ATTR_BINARY);
+	__failover_lock(f);
+	if (attr)
+		rc = __failover_recv_diff(f, attr, __get_sec_ctxt(req));
+	else
+		rc = EINVAL;
+	if (rc == ESTALE) {
+		ldmsd_linfo("Failover: peer config diff does not apply to "
+			    "our snapshot, requesting a new one\n");
+		__failover_peercfg_resync(f);
+	} else if (rc) {
+		ldmsd_lerror("Failover: peer config diff error: %d\n", rc);
+		__failover_peercfg_resync(f);
+	}
+	__failover_unlock(f);
+	req->errcode = rc;
+	ldmsd_send_req_response(req, NULL);
+	return rc;
+}
+
+/*
+ * The peer objects (LDMSD_FAILOVER_NAME_PREFIX) are created and deleted only
+ * by the failover service. Returns EPERM if the config request names one.
+ */
+int failover_cfg_req_check(ldmsd_req_ctxt_t req)
+{
+	char *name;
+	int rc;
+	name = __req_attr_gets(req, LDMSD_ATTR_NAME);
+	if (!name)
+		return 0;
+	rc = (__name_is_failover(name))?(EPERM):(0);
+	free(name);
+	return rc;
+}
+
+/*
+ * Called after each config request that may change what the peer holds;
+ * the failover task sends the changes on its next run.
+ */
+void failover_cfg_changed()
+{
+	__sync_add_and_fetch(&__failover.ourcfg_gn, 1);
+}
+
 int ldmsd_failover_start()
 {
 	int rc;
@@ -2379,9 +3284,11 @@ int ldmsd_failover_start()
 		goto out;
 
 	f->state = FAILOVER_STATE_START;
-	/* allows only failover-safe and failover-internal commands */
+	/* allows only failover-safe, failover-internal and the config
+	 * commands that are mirrored to the peer */
 	ldmsd_inband_cfg_mask_set(LDMSD_PERM_FAILOVER_ALLOWED |
-				  LDMSD_PERM_FAILOVER_INTERNAL);
+				  LDMSD_PERM_FAILOVER_INTERNAL |
+				  LDMSD_PERM_FAILOVER_SYNC);
 out:
 	__failover_unlock(f);
 	return rc;
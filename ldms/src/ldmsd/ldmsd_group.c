@@ -124,6 +124,12 @@ int ldmsd_group_iter(ldms_set_t grp, ldmsd_group_iter_cb_t cb, void *arg)
 	return rc;
 }
 
+uint64_t ldmsd_group_gn_get(ldms_set_t grp)
+{
+	/* The members are the only set info of a group */
+	return ldms_set_info_gn_get(grp);
+}
+
 int ldmsd_group_check(ldms_set_t set)
 {
 	const char *sname;
@@ -0,0 +1,729 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Recent history of a storage policy
+ *
+ * A storage policy with a history keeps the recent rows of every set it
+ * stores in memory so that the last minutes of data can be queried from
+ * the aggregator without going to the storage backend. Only the scalar
+ * numeric metrics of the policy are kept, each one as a 64-bit column:
+ * the integer types widened to int64_t/uint64_t and the floating point
+ * types as the bits of a double.
+ *
+ * Each series (set instance) has an open block holding the last
+ * HIST_BLOCK_ROWS rows uncompressed. A full block is sealed: it is
+ * compressed column by column and appended to the series and to the list
+ * of all sealed blocks of the history in the order they were sealed. The
+ * timestamps are encoded as zigzag varints of the delta of deltas, the
+ * integer columns as zigzag varints of the deltas and the floating point
+ * columns as varints of the XOR with the previous value, so a regular
+ * sampling interval and slowly changing values take a byte or two a row.
+ *
+ * The memory used by the history is capped by its budget. When it is
+ * exceeded, the oldest sealed blocks are evicted first, whichever series
+ * they belong to. A row that does not fit even when there are no sealed
+ * blocks left is dropped and counted.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "ldmsd_request.h"
+
+#define HIST_BLOCK_ROWS 64
+#define HIST_VARINT_MAX 10
+
+struct hist_block {
+	struct hist_series *series;
+	TAILQ_ENTRY(hist_block) series_entry; /* oldest first */
+	TAILQ_ENTRY(hist_block) hist_entry; /* oldest first */
+	int rows;
+	uint64_t first_ts;
+	uint64_t last_ts;
+	size_t len;
+	unsigned char data[OVIS_FLEX];
+};
+TAILQ_HEAD(hist_block_list, hist_block);
+
+struct hist_series {
+	struct rbn rbn;
+	struct hist_block_list blocks;
+	int rows;		/* rows in the open block */
+	uint64_t *ts;		/* open block timestamps (usec) */
+	uint64_t *vals;		/* open block columns, HIST_BLOCK_ROWS each */
+	char name[OVIS_FLEX];
+};
+
+struct hist_col {
+	int midx;		/* metric index in the set */
+	enum ldms_value_type type;
+	char *name;
+};
+
+struct ldmsd_history {
+	pthread_mutex_t lock;
+	size_t budget;
+	size_t bytes;
+	uint64_t rows;		/* rows kept, sealed and open */
+	uint64_t dropped;
+	uint64_t evicted;
+	/* the strgp metric array the columns were built from */
+	int *metric_arry;
+	int metric_count;
+	int col_count;
+	struct hist_col *cols;
+	unsigned char *enc_buf;	/* scratch buffer to seal a block */
+	struct rbt series_tree;
+	struct hist_block_list blocks;
+};
+
+static int __series_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+ldmsd_history_t ldmsd_history_new(size_t budget)
+{
+	ldmsd_history_t h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	pthread_mutex_init(&h->lock, NULL);
+	h->budget = budget;
+	h->bytes = sizeof(*h);
+	rbt_init(&h->series_tree, __series_cmp);
+	TAILQ_INIT(&h->blocks);
+	return h;
+}
+
+static size_t __series_size(ldmsd_history_t h, const char *name)
+{
+	return sizeof(struct hist_series) + strlen(name) + 1 +
+		(h->col_count + 1) * HIST_BLOCK_ROWS * sizeof(uint64_t);
+}
+
+static void __block_free(ldmsd_history_t h, struct hist_block *blk)
+{
+	TAILQ_REMOVE(&blk->series->blocks, blk, series_entry);
+	TAILQ_REMOVE(&h->blocks, blk, hist_entry);
+	h->bytes -= sizeof(*blk) + blk->len;
+	h->rows -= blk->rows;
+	free(blk);
+}
+
+/* Drop every series and the column layout */
+static void __history_reset(ldmsd_history_t h)
+{
+	struct hist_series *s;
+	struct rbn *rbn;
+	int i;
+
+	while (!TAILQ_EMPTY(&h->blocks))
+		__block_free(h, TAILQ_FIRST(&h->blocks));
+	while ((rbn = rbt_min(&h->series_tree))) {
+		s = container_of(rbn, struct hist_series, rbn);
+		rbt_del(&h->series_tree, rbn);
+		free(s->ts);
+		free(s->vals);
+		free(s);
+	}
+	for (i = 0; i < h->col_count; i++)
+		free(h->cols[i].name);
+	free(h->cols);
+	free(h->metric_arry);
+	free(h->enc_buf);
+	h->enc_buf = NULL;
+	h->cols = NULL;
+	h->col_count = 0;
+	h->metric_arry = NULL;
+	h->metric_count = 0;
+	h->rows = 0;
+	h->bytes = sizeof(*h);
+}
+
+void ldmsd_history_free(ldmsd_history_t h)
+{
+	__history_reset(h);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+}
+
+static int __is_scalar_num(enum ldms_value_type type)
+{
+	return type >= LDMS_V_U8 && type <= LDMS_V_D64;
+}
+
+static int __is_float(enum ldms_value_type type)
+{
+	return type == LDMS_V_F32 || type == LDMS_V_D64;
+}
+
+/* Build the columns from the stored metrics of the set */
+static int __history_layout(ldmsd_history_t h, ldms_set_t set,
+			    int *metric_arry, size_t count)
+{
+	enum ldms_value_type type;
+	int i;
+
+	__history_reset(h);
+	h->metric_arry = malloc(count * sizeof(int));
+	h->cols = calloc(count, sizeof(*h->cols));
+	if (!h->metric_arry || !h->cols)
+		goto enomem;
+	memcpy(h->metric_arry, metric_arry, count * sizeof(int));
+	h->metric_count = count;
+	for (i = 0; i < count; i++) {
+		type = ldms_metric_type_get(set, metric_arry[i]);
+		if (!__is_scalar_num(type))
+			continue;
+		h->cols[h->col_count].midx = metric_arry[i];
+		h->cols[h->col_count].type = type;
+		h->cols[h->col_count].name =
+			strdup(ldms_metric_name_get(set, metric_arry[i]));
+		if (!h->cols[h->col_count].name)
+			goto enomem;
+		h->bytes += strlen(h->cols[h->col_count].name) + 1;
+		h->col_count++;
+	}
+	h->enc_buf = malloc((h->col_count + 1) * HIST_BLOCK_ROWS *
+			    HIST_VARINT_MAX);
+	if (!h->enc_buf)
+		goto enomem;
+	h->bytes += count * (sizeof(int) + sizeof(*h->cols));
+	return 0;
+enomem:
+	__history_reset(h);
+	return ENOMEM;
+}
+
+static uint64_t __metric_bits(ldms_set_t set, struct hist_col *col)
+{
+	union {
+		double d;
+		uint64_t u;
+	} v;
+	switch (col->type) {
+	case LDMS_V_U8:
+		return ldms_metric_get_u8(set, col->midx);
+	case LDMS_V_S8:
+		return (int64_t)ldms_metric_get_s8(set, col->midx);
+	case LDMS_V_U16:
+		return ldms_metric_get_u16(set, col->midx);
+	case LDMS_V_S16:
+		return (int64_t)ldms_metric_get_s16(set, col->midx);
+	case LDMS_V_U32:
+		return ldms_metric_get_u32(set, col->midx);
+	case LDMS_V_S32:
+		return (int64_t)ldms_metric_get_s32(set, col->midx);
+	case LDMS_V_U64:
+		return ldms_metric_get_u64(set, col->midx);
+	case LDMS_V_S64:
+		return ldms_metric_get_s64(set, col->midx);
+	case LDMS_V_F32:
+		v.d = ldms_metric_get_float(set, col->midx);
+		return v.u;
+	case LDMS_V_D64:
+		v.d = ldms_metric_get_double(set, col->midx);
+		return v.u;
+	default:
+		return 0;
+	}
+}
+
+static inline unsigned char *__varint_put(unsigned char *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static inline const unsigned char *__varint_get(const unsigned char *p,
+						 uint64_t *v)
+{
+	uint64_t x = 0;
+	int shift = 0;
+	do {
+		x |= (uint64_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	*v = x;
+	return p;
+}
+
+static inline uint64_t __zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t __unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t __block_encode(ldmsd_history_t h, int rows, const uint64_t *ts,
+			     const uint64_t *vals, unsigned char *buf)
+{
+	unsigned char *p = buf;
+	const uint64_t *col;
+	uint64_t prev, delta;
+	int i, c;
+
+	p = __varint_put(p, ts[0]);
+	prev = ts[0];
+	delta = 0;
+	for (i = 1; i < rows; i++) {
+		p = __varint_put(p, __zigzag((ts[i] - prev) - delta));
+		delta = ts[i] - prev;
+		prev = ts[i];
+	}
+	for (c = 0; c < h->col_count; c++) {
+		col = &vals[c * HIST_BLOCK_ROWS];
+		prev = 0;
+		if (__is_float(h->cols[c].type)) {
+			for (i = 0; i < rows; i++) {
+				p = __varint_put(p, col[i] ^ prev);
+				prev = col[i];
+			}
+		} else {
+			for (i = 0; i < rows; i++) {
+				p = __varint_put(p, __zigzag(col[i] - prev));
+				prev = col[i];
+			}
+		}
+	}
+	return p - buf;
+}
+
+static void __block_decode(ldmsd_history_t h, struct hist_block *blk,
+			   uint64_t *ts, uint64_t *vals)
+{
+	const unsigned char *p = blk->data;
+	uint64_t *col;
+	uint64_t v, prev, delta;
+	int i, c;
+
+	p = __varint_get(p, &ts[0]);
+	prev = ts[0];
+	delta = 0;
+	for (i = 1; i < blk->rows; i++) {
+		p = __varint_get(p, &v);
+		delta += __unzigzag(v);
+		ts[i] = prev + delta;
+		prev = ts[i];
+	}
+	for (c = 0; c < h->col_count; c++) {
+		col = &vals[c * HIST_BLOCK_ROWS];
+		prev = 0;
+		for (i = 0; i < blk->rows; i++) {
+			p = __varint_get(p, &v);
+			if (__is_float(h->cols[c].type))
+				col[i] = prev ^ v;
+			else
+				col[i] = prev + __unzigzag(v);
+			prev = col[i];
+		}
+	}
+}
+
+/* Evict the oldest sealed blocks until \c need more bytes fit the budget */
+static int __history_make_room(ldmsd_history_t h, size_t need)
+{
+	while (h->bytes + need > h->budget) {
+		if (TAILQ_EMPTY(&h->blocks))
+			return ENOSPC;
+		__block_free(h, TAILQ_FIRST(&h->blocks));
+		h->evicted++;
+	}
+	return 0;
+}
+
+static void __series_seal(ldmsd_history_t h, struct hist_series *s)
+{
+	struct hist_block *blk;
+	size_t len;
+
+	len = __block_encode(h, s->rows, s->ts, s->vals, h->enc_buf);
+	blk = malloc(sizeof(*blk) + len);
+	if (!blk) {
+		/* keep the history consistent, lose the rows */
+		h->rows -= s->rows;
+		h->dropped += s->rows;
+		s->rows = 0;
+		return;
+	}
+	blk->series = s;
+	blk->rows = s->rows;
+	blk->first_ts = s->ts[0];
+	blk->last_ts = s->ts[s->rows - 1];
+	blk->len = len;
+	memcpy(blk->data, h->enc_buf, len);
+	TAILQ_INSERT_TAIL(&s->blocks, blk, series_entry);
+	TAILQ_INSERT_TAIL(&h->blocks, blk, hist_entry);
+	h->bytes += sizeof(*blk) + len;
+	s->rows = 0;
+	(void)__history_make_room(h, 0);
+}
+
+static struct hist_series *__series_get(ldmsd_history_t h, const char *name)
+{
+	struct hist_series *s;
+	struct rbn *rbn;
+	size_t sz;
+
+	rbn = rbt_find(&h->series_tree, name);
+	if (rbn)
+		return container_of(rbn, struct hist_series, rbn);
+	sz = __series_size(h, name);
+	if (__history_make_room(h, sz))
+		return NULL;
+	s = calloc(1, sizeof(*s) + strlen(name) + 1);
+	if (!s)
+		return NULL;
+	s->ts = malloc(HIST_BLOCK_ROWS * sizeof(uint64_t));
+	s->vals = malloc((h->col_count + 1) * HIST_BLOCK_ROWS * sizeof(uint64_t));
+	if (!s->ts || !s->vals) {
+		free(s->ts);
+		free(s->vals);
+		free(s);
+		return NULL;
+	}
+	strcpy(s->name, name);
+	TAILQ_INIT(&s->blocks);
+	rbn_init(&s->rbn, s->name);
+	rbt_ins(&h->series_tree, &s->rbn);
+	h->bytes += sz;
+	return s;
+}
+
+/*
+ * Called from the strgp update path with the metric array of the strgp.
+ */
+void ldmsd_history_add(ldmsd_history_t h, ldms_set_t set,
+		       int *metric_arry, size_t count)
+{
+	struct ldms_timestamp ts;
+	struct hist_series *s;
+	uint64_t t;
+	int c;
+
+	pthread_mutex_lock(&h->lock);
+	if (count != h->metric_count ||
+	    memcmp(metric_arry, h->metric_arry, count * sizeof(int))) {
+		/* first sample, or the strgp was restarted with other metrics */
+		if (__history_layout(h, set, metric_arry, count))
+			goto drop;
+	}
+	s = __series_get(h, ldms_set_instance_name_get(set));
+	if (!s)
+		goto drop;
+	ts = ldms_transaction_timestamp_get(set);
+	t = (uint64_t)ts.sec * 1000000 + ts.usec;
+	if (s->rows && t <= s->ts[s->rows - 1])
+		goto out; /* not newer than the last row */
+	s->ts[s->rows] = t;
+	for (c = 0; c < h->col_count; c++)
+		s->vals[c * HIST_BLOCK_ROWS + s->rows] =
+				__metric_bits(set, &h->cols[c]);
+	s->rows++;
+	h->rows++;
+	if (s->rows == HIST_BLOCK_ROWS)
+		__series_seal(h, s);
+	goto out;
+drop:
+	h->dropped++;
+out:
+	pthread_mutex_unlock(&h->lock);
+}
+
+void ldmsd_history_stats_get(ldmsd_history_t h, struct ldmsd_history_stats *st)
+{
+	struct hist_block *blk;
+	struct rbn *rbn;
+	struct hist_series *s;
+
+	pthread_mutex_lock(&h->lock);
+	st->budget = h->budget;
+	st->bytes = h->bytes;
+	st->rows = h->rows;
+	st->dropped = h->dropped;
+	st->evicted = h->evicted;
+	st->series = 0;
+	st->first_ts = 0;
+	blk = TAILQ_FIRST(&h->blocks);
+	if (blk)
+		st->first_ts = blk->first_ts;
+	RBT_FOREACH(rbn, &h->series_tree) {
+		s = container_of(rbn, struct hist_series, rbn);
+		st->series++;
+		if (!blk && s->rows && (!st->first_ts || s->ts[0] < st->first_ts))
+			st->first_ts = s->ts[0];
+	}
+	pthread_mutex_unlock(&h->lock);
+}
+
+struct hist_buf {
+	char *buf;
+	size_t len;
+	size_t alloc;
+};
+
+static int __buf_reserve(struct hist_buf *b, size_t len)
+{
+	char *buf;
+	size_t alloc;
+
+	if (b->len + len <= b->alloc)
+		return 0;
+	alloc = b->alloc ? b->alloc : 4096;
+	while (alloc < b->len + len)
+		alloc *= 2;
+	buf = realloc(b->buf, alloc);
+	if (!buf)
+		return ENOMEM;
+	b->buf = buf;
+	b->alloc = alloc;
+	return 0;
+}
+
+static int __buf_u32(struct hist_buf *b, uint32_t v)
+{
+	if (__buf_reserve(b, sizeof(v)))
+		return ENOMEM;
+	v = htonl(v);
+	memcpy(&b->buf[b->len], &v, sizeof(v));
+	b->len += sizeof(v);
+	return 0;
+}
+
+static int __buf_str(struct hist_buf *b, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	if (__buf_u32(b, len) || __buf_reserve(b, len))
+		return ENOMEM;
+	memcpy(&b->buf[b->len], s, len);
+	b->len += len;
+	return 0;
+}
+
+/* The rows of a series in the query range, gathered before encoding */
+struct hist_rows {
+	int count;
+	int alloc;
+	int ncols;
+	uint64_t *ts;
+	uint64_t *vals;	/* row major, ncols a row */
+};
+
+static int __rows_add(struct hist_rows *r, ldmsd_history_t h, int *sel,
+		      int rows, const uint64_t *ts, const uint64_t *vals,
+		      uint64_t begin, uint64_t end)
+{
+	void *p;
+	int i, c;
+
+	for (i = 0; i < rows; i++) {
+		if (ts[i] < begin || ts[i] > end)
+			continue;
+		if (r->count == r->alloc) {
+			r->alloc = r->alloc ? r->alloc * 2 : HIST_BLOCK_ROWS;
+			p = realloc(r->ts, r->alloc * sizeof(uint64_t));
+			if (!p)
+				return ENOMEM;
+			r->ts = p;
+			p = realloc(r->vals, r->alloc * (r->ncols + 1) *
+					     sizeof(uint64_t));
+			if (!p)
+				return ENOMEM;
+			r->vals = p;
+		}
+		r->ts[r->count] = ts[i];
+		for (c = 0; c < r->ncols; c++)
+			r->vals[r->count * r->ncols + c] =
+				vals[sel[c] * HIST_BLOCK_ROWS + i];
+		r->count++;
+	}
+	return 0;
+}
+
+static int __series_encode(struct hist_buf *b, struct hist_series *s,
+			   struct hist_rows *r)
+{
+	uint64_t *p;
+	int i, c;
+
+	if (__buf_str(b, s->name) || __buf_u32(b, r->count) ||
+	    __buf_reserve(b, r->count * (r->ncols + 1) * sizeof(uint64_t)))
+		return ENOMEM;
+	p = (uint64_t *)&b->buf[b->len];
+	for (i = 0; i < r->count; i++)
+		*p++ = htobe64(r->ts[i]);
+	for (c = 0; c < r->ncols; c++) {
+		for (i = 0; i < r->count; i++)
+			*p++ = htobe64(r->vals[i * r->ncols + c]);
+	}
+	b->len = (char *)p - b->buf;
+	return 0;
+}
+
+/* Map the comma separated metric names to columns */
+static int __history_select(ldmsd_history_t h, const char *metrics,
+			    int *sel, int *count)
+{
+	char *names, *name, *ptr;
+	int c, rc = 0;
+
+	*count = 0;
+	if (!metrics) {
+		for (c = 0; c < h->col_count; c++)
+			sel[(*count)++] = c;
+		return 0;
+	}
+	names = strdup(metrics);
+	if (!names)
+		return ENOMEM;
+	for (name = strtok_r(names, ",", &ptr); name;
+	     name = strtok_r(NULL, ",", &ptr)) {
+		for (c = 0; c < h->col_count; c++) {
+			if (0 == strcmp(name, h->cols[c].name))
+				break;
+		}
+		if (c == h->col_count || *count == h->col_count) {
+			rc = ENOENT;
+			break;
+		}
+		sel[(*count)++] = c;
+	}
+	free(names);
+	return rc;
+}
+
+int ldmsd_history_query(ldmsd_history_t h, regex_t *instance,
+			const char *metrics, uint64_t begin, uint64_t end,
+			char **buf_out, size_t *len_out)
+{
+	struct ldmsd_history_hdr *hdr;
+	struct hist_buf b = {0};
+	struct hist_rows r = {0};
+	struct hist_series *s;
+	struct hist_block *blk;
+	struct rbn *rbn;
+	uint64_t *ts = NULL, *vals = NULL;
+	uint32_t series = 0;
+	int *sel = NULL;
+	int c, rc;
+
+	pthread_mutex_lock(&h->lock);
+	rc = ENOMEM;
+	sel = calloc(h->col_count + 1, sizeof(int));
+	ts = malloc(HIST_BLOCK_ROWS * sizeof(uint64_t));
+	vals = malloc((h->col_count + 1) * HIST_BLOCK_ROWS * sizeof(uint64_t));
+	if (!sel || !ts || !vals)
+		goto out;
+	rc = __history_select(h, metrics, sel, &r.ncols);
+	if (rc)
+		goto out;
+
+	rc = ENOMEM;
+	if (__buf_reserve(&b, sizeof(*hdr)))
+		goto out;
+	b.len = sizeof(*hdr);
+	for (c = 0; c < r.ncols; c++) {
+		if (__buf_u32(&b, h->cols[sel[c]].type) ||
+		    __buf_str(&b, h->cols[sel[c]].name))
+			goto out;
+	}
+	RBT_FOREACH(rbn, &h->series_tree) {
+		s = container_of(rbn, struct hist_series, rbn);
+		if (instance && regexec(instance, s->name, 0, NULL, 0))
+			continue;
+		r.count = 0;
+		TAILQ_FOREACH(blk, &s->blocks, series_entry) {
+			if (blk->last_ts < begin || blk->first_ts > end)
+				continue;
+			__block_decode(h, blk, ts, vals);
+			if (__rows_add(&r, h, sel, blk->rows, ts, vals,
+				       begin, end))
+				goto out;
+		}
+		if (__rows_add(&r, h, sel, s->rows, s->ts, s->vals, begin, end))
+			goto out;
+		if (!r.count)
+			continue;
+		if (__series_encode(&b, s, &r))
+			goto out;
+		series++;
+	}
+	hdr = (void *)b.buf;
+	hdr->magic = htonl(LDMSD_HISTORY_MAGIC);
+	hdr->version = htonl(LDMSD_HISTORY_VERSION);
+	hdr->metric_count = htonl(r.ncols);
+	hdr->series_count = htonl(series);
+	*buf_out = b.buf;
+	*len_out = b.len;
+	b.buf = NULL;
+	rc = 0;
+out:
+	pthread_mutex_unlock(&h->lock);
+	free(b.buf);
+	free(r.ts);
+	free(r.vals);
+	free(sel);
+	free(ts);
+	free(vals);
+	return rc;
+}
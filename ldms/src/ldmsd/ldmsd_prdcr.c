@@ -58,6 +58,9 @@
 #include <coll/rbt.h>
 #include <ovis_util/util.h>
 #include <netdb.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
 #include "ldms.h"
 #include "ldmsd.h"
 #include "ldms_xprt.h"
@@ -66,27 +69,359 @@
 
 static void prdcr_task_cb(ldmsd_task_t task, void *arg);
 
-int prdcr_resolve(const char *hostname, unsigned short port_no,
-		  struct sockaddr_storage *ss, socklen_t *ss_len)
+/*
+ * Host names are looked up by a small pool of threads so that neither
+ * prdcr_add nor the connect path blocks on DNS. The addresses are cached
+ * by host name; an expired address is still used while it is refreshed.
+ * Producers waiting for a lookup are queued on the cache entry and their
+ * task is rescheduled when the lookup completes.
+ */
+#define PRDCR_RESOLVE_THREADS	4
+#define PRDCR_RESOLVE_TTL	300	/* seconds to use a resolved address */
+#define PRDCR_RESOLVE_NEG_TTL	5	/* seconds to remember a failure */
+
+typedef struct prdcr_resolve_ent {
+	char *host;
+	int family;
+	int pending;		/* queued or being looked up */
+	int rc;			/* the getaddrinfo() result of the last lookup */
+	struct sockaddr_storage ss; /* port is not set */
+	socklen_t ss_len;	/* 0 until a lookup succeeds */
+	time_t expire;
+	LIST_HEAD(, ldmsd_prdcr) waiters;
+	TAILQ_ENTRY(prdcr_resolve_ent) q_entry;
+	struct rbn rbn;
+} *prdcr_resolve_ent_t;
+
+static int prdcr_resolve_cmp(void *a, const void *b)
+{
+	const struct prdcr_resolve_ent *ea = a, *eb = b;
+	int rc = strcmp(ea->host, eb->host);
+	if (rc)
+		return rc;
+	return ea->family - eb->family;
+}
+
+static pthread_mutex_t resolve_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolve_cv = PTHREAD_COND_INITIALIZER;
+static struct rbt resolve_tree = RBT_INITIALIZER(prdcr_resolve_cmp);
+static TAILQ_HEAD(, prdcr_resolve_ent) resolve_q =
+				TAILQ_HEAD_INITIALIZER(resolve_q);
+static int resolve_threads;
+static int resolve_pending;
+static int resolve_count;
+
+static void *prdcr_resolve_proc(void *arg)
+{
+	LIST_HEAD(, ldmsd_prdcr) waiters;
+	struct addrinfo hints, *ai;
+	prdcr_resolve_ent_t ent;
+	ldmsd_prdcr_t prdcr;
+	int rc;
+
+	pthread_mutex_lock(&resolve_lock);
+	while (1) {
+		while (TAILQ_EMPTY(&resolve_q))
+			pthread_cond_wait(&resolve_cv, &resolve_lock);
+		ent = TAILQ_FIRST(&resolve_q);
+		TAILQ_REMOVE(&resolve_q, ent, q_entry);
+		pthread_mutex_unlock(&resolve_lock);
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = ent->family;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_ADDRCONFIG;
+		rc = getaddrinfo(ent->host, NULL, &hints, &ai);
+
+		pthread_mutex_lock(&resolve_lock);
+		ent->rc = rc;
+		if (!rc) {
+			memcpy(&ent->ss, ai->ai_addr, ai->ai_addrlen);
+			ent->ss_len = ai->ai_addrlen;
+			ent->expire = time(NULL) + PRDCR_RESOLVE_TTL;
+			freeaddrinfo(ai);
+		} else {
+			ldmsd_log(LDMSD_LERROR, "The host '%s' is not resolved: "
+				  "%s%s\n", ent->host, gai_strerror(rc),
+				  ent->ss_len ? ", using the last address" : "");
+			ent->expire = time(NULL) + PRDCR_RESOLVE_NEG_TTL;
+		}
+		ent->pending = 0;
+		resolve_pending--;
+		LIST_INIT(&waiters);
+		while ((prdcr = LIST_FIRST(&ent->waiters))) {
+			LIST_REMOVE(prdcr, resolve_entry);
+			prdcr->resolve_wait = 0;
+			LIST_INSERT_HEAD(&waiters, prdcr, resolve_entry);
+		}
+		pthread_mutex_unlock(&resolve_lock);
+		/* run the producer tasks now */
+		while ((prdcr = LIST_FIRST(&waiters))) {
+			LIST_REMOVE(prdcr, resolve_entry);
+			ldmsd_task_resched(&prdcr->task, 0, 0, 0);
+			ldmsd_prdcr_put(prdcr);
+		}
+		pthread_mutex_lock(&resolve_lock);
+	}
+	return NULL;
+}
+
+static prdcr_resolve_ent_t prdcr_resolve_ent_new(const char *host, int family)
 {
-	struct hostent *h;
+	/* resolve_lock is held */
+	struct addrinfo hints, *ai;
+	prdcr_resolve_ent_t ent;
 
-	h = gethostbyname(hostname);
-	if (!h)
-		return -1;
+	ent = calloc(1, sizeof(*ent));
+	if (!ent)
+		return NULL;
+	ent->host = strdup(host);
+	if (!ent->host) {
+		free(ent);
+		return NULL;
+	}
+	ent->family = family;
+	LIST_INIT(&ent->waiters);
+	/* numeric addresses do not need a lookup */
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST;
+	if (0 == getaddrinfo(host, NULL, &hints, &ai)) {
+		memcpy(&ent->ss, ai->ai_addr, ai->ai_addrlen);
+		ent->ss_len = ai->ai_addrlen;
+		ent->expire = (time_t)LONG_MAX;
+		freeaddrinfo(ai);
+	}
+	rbn_init(&ent->rbn, ent);
+	rbt_ins(&resolve_tree, &ent->rbn);
+	resolve_count++;
+	return ent;
+}
 
-	if (h->h_addrtype != AF_INET)
-		return -1;
+static int prdcr_resolve_queue(prdcr_resolve_ent_t ent)
+{
+	/* resolve_lock is held */
+	pthread_t t;
+	int rc;
 
-	memset(ss, 0, sizeof *ss);
-	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
-	sin->sin_addr.s_addr = *(unsigned int *)(h->h_addr_list[0]);
-	sin->sin_family = h->h_addrtype;
-	sin->sin_port = htons(port_no);
-	*ss_len = sizeof(*sin);
+	if (resolve_threads < PRDCR_RESOLVE_THREADS &&
+	    resolve_threads <= resolve_pending) {
+		rc = pthread_create(&t, NULL, prdcr_resolve_proc, NULL);
+		if (rc) {
+			if (!resolve_threads)
+				return rc;
+		} else {
+			pthread_detach(t);
+			resolve_threads++;
+		}
+	}
+	ent->pending = 1;
+	resolve_pending++;
+	TAILQ_INSERT_TAIL(&resolve_q, ent, q_entry);
+	pthread_cond_signal(&resolve_cv);
+	return 0;
+}
+
+/*
+ * Get the producer address from the cache.
+ *
+ * Returns 0 if \c prdcr->ss holds the address, EINPROGRESS if the host name
+ * is being looked up, in which case the producer task is rescheduled when
+ * the lookup completes, or EHOSTUNREACH if the last lookup failed.
+ */
+static int prdcr_resolve(ldmsd_prdcr_t prdcr)
+{
+	/* prdcr lock is held */
+	struct prdcr_resolve_ent key;
+	prdcr_resolve_ent_t ent;
+	struct rbn *rbn;
+	int rc = 0;
+
+	key.host = prdcr->host_name;
+	/* matching passive producers supports only IPv4 */
+	key.family = (prdcr->type == LDMSD_PRDCR_TYPE_PASSIVE) ?
+							AF_INET : AF_UNSPEC;
+	pthread_mutex_lock(&resolve_lock);
+	rbn = rbt_find(&resolve_tree, &key);
+	if (rbn) {
+		ent = container_of(rbn, struct prdcr_resolve_ent, rbn);
+	} else {
+		ent = prdcr_resolve_ent_new(key.host, key.family);
+		if (!ent) {
+			rc = ENOMEM;
+			goto out;
+		}
+	}
+	if (!ent->pending && ent->expire <= time(NULL)) {
+		rc = prdcr_resolve_queue(ent);
+		if (rc)
+			goto out;
+	}
+	if (ent->ss_len) {
+		memcpy(&prdcr->ss, &ent->ss, ent->ss_len);
+		prdcr->ss_len = ent->ss_len;
+		if (prdcr->ss.ss_family == AF_INET6)
+			((struct sockaddr_in6 *)&prdcr->ss)->sin6_port =
+							htons(prdcr->port_no);
+		else
+			((struct sockaddr_in *)&prdcr->ss)->sin_port =
+							htons(prdcr->port_no);
+	} else if (ent->pending) {
+		if (!prdcr->resolve_wait &&
+		    prdcr->conn_state != LDMSD_PRDCR_STATE_STOPPED) {
+			ldmsd_prdcr_get(prdcr);
+			prdcr->resolve_wait = 1;
+			LIST_INSERT_HEAD(&ent->waiters, prdcr, resolve_entry);
+		}
+		rc = EINPROGRESS;
+	} else {
+		rc = EHOSTUNREACH;
+	}
+out:
+	pthread_mutex_unlock(&resolve_lock);
+	return rc;
+}
+
+/*
+ * The connect attempts of all producers are spread over time at the
+ * configured rate. Each attempt reserves the next free slot on the ramp and
+ * the producer task is rescheduled to the slot. Failed attempts are retried
+ * at the connect interval, doubled after each failure up to the backoff
+ * limit, with +/-25% jitter.
+ */
+static struct prdcr_conn_sched {
+	pthread_mutex_t lock;
+	long rate;
+	long backoff_max_us;
+	uint64_t next_us;	/* next free connect slot */
+	int started;
+	int connected;
+	int ramping;
+	struct timeval ramp_begin;
+	uint64_t ramp_us;	/* time to all connected of the last ramp */
+} conn_sched = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t __now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+int ldmsd_prdcr_conn_config(long rate, long backoff_max_us)
+{
+	pthread_mutex_lock(&conn_sched.lock);
+	if (rate >= 0)
+		conn_sched.rate = rate;
+	if (backoff_max_us >= 0)
+		conn_sched.backoff_max_us = backoff_max_us;
+	pthread_mutex_unlock(&conn_sched.lock);
+	return 0;
+}
+
+void ldmsd_prdcr_conn_stats_get(struct ldmsd_prdcr_conn_stats *stats)
+{
+	struct timeval tv, dt;
+
+	pthread_mutex_lock(&conn_sched.lock);
+	stats->rate = conn_sched.rate;
+	stats->backoff_max_us = conn_sched.backoff_max_us;
+	stats->started = conn_sched.started;
+	stats->connected = conn_sched.connected;
+	stats->ramping = conn_sched.ramping;
+	if (conn_sched.ramping) {
+		gettimeofday(&tv, NULL);
+		timersub(&tv, &conn_sched.ramp_begin, &dt);
+		stats->ramp_us = dt.tv_sec * 1000000UL + dt.tv_usec;
+	} else {
+		stats->ramp_us = conn_sched.ramp_us;
+	}
+	pthread_mutex_unlock(&conn_sched.lock);
+	pthread_mutex_lock(&resolve_lock);
+	stats->resolving = resolve_pending;
+	stats->resolved = resolve_count;
+	pthread_mutex_unlock(&resolve_lock);
+}
+
+/*
+ * Update the started and connected producer counts, timing how long it
+ * takes for all started producers to connect.
+ */
+static void prdcr_conn_account(ldmsd_prdcr_t prdcr, int started, int connected)
+{
+	/* prdcr lock is held */
+	struct timeval tv, dt;
+	int all;
+
+	pthread_mutex_lock(&conn_sched.lock);
+	all = (conn_sched.connected == conn_sched.started);
+	conn_sched.started += started - prdcr->conn_started;
+	conn_sched.connected += connected - prdcr->conn_connected;
+	prdcr->conn_started = started;
+	prdcr->conn_connected = connected;
+	if (all && conn_sched.connected < conn_sched.started) {
+		gettimeofday(&conn_sched.ramp_begin, NULL);
+		conn_sched.ramping = 1;
+	} else if (conn_sched.ramping &&
+		   conn_sched.connected == conn_sched.started) {
+		conn_sched.ramping = 0;
+		if (conn_sched.started) {
+			gettimeofday(&tv, NULL);
+			timersub(&tv, &conn_sched.ramp_begin, &dt);
+			conn_sched.ramp_us = dt.tv_sec * 1000000UL + dt.tv_usec;
+			ldmsd_log(LDMSD_LINFO, "All %d producers are connected "
+				  "in %lu.%06lu seconds\n", conn_sched.started,
+				  (unsigned long)dt.tv_sec,
+				  (unsigned long)dt.tv_usec);
+		}
+	}
+	pthread_mutex_unlock(&conn_sched.lock);
+}
+
+/* Returns how long to wait for the producer's connect slot */
+static long prdcr_conn_wait_us(ldmsd_prdcr_t prdcr)
+{
+	/* prdcr lock is held */
+	uint64_t now = __now_us();
+
+	if (!prdcr->conn_slot_us) {
+		pthread_mutex_lock(&conn_sched.lock);
+		if (!conn_sched.rate) {
+			pthread_mutex_unlock(&conn_sched.lock);
+			return 0;
+		}
+		if (conn_sched.next_us < now)
+			conn_sched.next_us = now;
+		prdcr->conn_slot_us = conn_sched.next_us;
+		conn_sched.next_us += 1000000 / conn_sched.rate;
+		pthread_mutex_unlock(&conn_sched.lock);
+	}
+	if (prdcr->conn_slot_us > now + 1000)
+		return prdcr->conn_slot_us - now;
+	prdcr->conn_slot_us = 0;
 	return 0;
 }
 
+/* Returns the time to the next connect attempt */
+static long prdcr_backoff_us(ldmsd_prdcr_t prdcr)
+{
+	/* prdcr lock is held */
+	long max = conn_sched.backoff_max_us;
+	long us = prdcr->conn_intrvl_us;
+	int n;
+
+	for (n = 1; n < prdcr->conn_attempts && us < max; n++)
+		us *= 2;
+	if (max > prdcr->conn_intrvl_us && us > max)
+		us = max;
+	if (us >= 4)
+		us = us - us / 4 + random() % (us / 2);
+	return us;
+}
+
 void ldmsd_prdcr___del(ldmsd_cfgobj_t obj)
 {
 	ldmsd_prdcr_t prdcr = (ldmsd_prdcr_t)obj;
@@ -94,6 +429,7 @@ void ldmsd_prdcr___del(ldmsd_cfgobj_t obj)
 		free(prdcr->host_name);
 	if (prdcr->xprt_name)
 		free(prdcr->xprt_name);
+	ldmsd_updt_stats_prdcr_del(prdcr);
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -144,6 +480,8 @@ void __prdcr_set_del(ldmsd_prdcr_set_t set)
 	if (set->updt_hint_entry.le_prev)
 		LIST_REMOVE(set, updt_hint_entry);
 
+	ldmsd_prdcr_set_grp_release(set);
+	free(set->updt_stats);
 	free(set->inst_name);
 	free(set);
 }
@@ -161,6 +499,15 @@ void ldmsd_prdcr_set_ref_put(ldmsd_prdcr_set_t set)
 		__prdcr_set_del(set);
 }
 
+void ldmsd_prdcr_set_grp_release(ldmsd_prdcr_set_t grp)
+{
+	while (grp->grp_card)
+		ldmsd_prdcr_set_ref_put(grp->grp_members[--grp->grp_card]);
+	free(grp->grp_members);
+	grp->grp_members = NULL;
+	grp->grp_gn = 0;
+}
+
 static void prdcr_set_del(ldmsd_prdcr_set_t set)
 {
 	set->state = LDMSD_PRDCR_SET_STATE_START;
@@ -245,12 +592,17 @@ static ldmsd_prdcr_set_t _find_set(ldmsd_prdcr_t prdcr, const char *inst_name)
 	return NULL;
 }
 
-void ldmsd_prd_set_updtr_task_update(ldmsd_prdcr_set_t prd_set)
+/*
+ * Update the tasks of the running updaters for the sets of one producer,
+ * e.g. the sets of a directory update, in one pass over the updaters.
+ */
+static void prd_sets_updtr_task_update(ldmsd_prdcr_set_t *sets, int count)
 {
 	ldmsd_updtr_t updtr;
 	ldmsd_name_match_t match;
+	ldmsd_prdcr_set_t prd_set;
 	char *str;
-	int rc;
+	int i, rc;
 	ldmsd_cfg_lock(LDMSD_CFGOBJ_UPDTR);
 	for (updtr = ldmsd_updtr_first(); updtr; updtr = ldmsd_updtr_next(updtr)) {
 		ldmsd_updtr_lock(updtr);
@@ -264,27 +616,29 @@ void ldmsd_prd_set_updtr_task_update(ldmsd_prdcr_set_t prd_set)
 			ldmsd_updtr_unlock(updtr);
 			continue;
 		}
-		if (!ldmsd_updtr_prdcr_find(updtr, prd_set->prdcr->obj.name)) {
+		if (!ldmsd_updtr_prdcr_find(updtr, sets[0]->prdcr->obj.name)) {
 			ldmsd_updtr_unlock(updtr);
 			continue;
 		}
-		if (!LIST_EMPTY(&updtr->match_list)) {
-			LIST_FOREACH(match, &updtr->match_list, entry) {
-				if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
-					str = prd_set->inst_name;
-				else
-					str = prd_set->schema_name;
-				rc = regexec(&match->regex, str, 0, NULL, 0);
-				if (!rc)
-					goto update_tasks;
+		for (i = 0; i < count; i++) {
+			prd_set = sets[i];
+			if (!LIST_EMPTY(&updtr->match_list)) {
+				LIST_FOREACH(match, &updtr->match_list, entry) {
+					if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
+						str = prd_set->inst_name;
+					else
+						str = prd_set->schema_name;
+					rc = regexec(&match->regex, str, 0, NULL, 0);
+					if (!rc)
+						goto update_tasks;
+				}
+				continue;
 			}
-			goto nxt_updtr;
+		update_tasks:
+			pthread_mutex_lock(&prd_set->lock);
+			ldmsd_updtr_tasks_update(updtr, prd_set);
+			pthread_mutex_unlock(&prd_set->lock);
 		}
-	update_tasks:
-		pthread_mutex_lock(&prd_set->lock);
-		ldmsd_updtr_tasks_update(updtr, prd_set);
-		pthread_mutex_unlock(&prd_set->lock);
-	nxt_updtr:
 		ldmsd_updtr_unlock(updtr);
 	}
 
@@ -292,6 +646,11 @@ void ldmsd_prd_set_updtr_task_update(ldmsd_prdcr_set_t prd_set)
 	ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
 }
 
+void ldmsd_prd_set_updtr_task_update(ldmsd_prdcr_set_t prd_set)
+{
+	prd_sets_updtr_task_update(&prd_set, 1);
+}
+
 static void __update_set_info(ldmsd_prdcr_set_t set, ldms_dir_set_t dset)
 {
 	long intrvl_us;
@@ -326,7 +685,8 @@ static void __update_set_info(ldmsd_prdcr_set_t set, ldms_dir_set_t dset)
 	}
 }
 
-static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
+static ldmsd_prdcr_set_t _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr,
+				 ldms_dir_set_t dset)
 {
 	ldmsd_prdcr_set_t set;
 
@@ -340,14 +700,14 @@ static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
 			ldmsd_log(LDMSD_LERROR, "Memory allocation failure in %s "
 				 "for set_name %s\n",
 				 __FUNCTION__, dset->inst_name);
-			return;
+			return NULL;
 		}
 		set->prdcr = prdcr;
 		rbt_ins(&prdcr->set_tree, &set->rbn);
 	} else {
 		ldmsd_log(LDMSD_LCRITICAL, "Receive a duplicated dir_add update of "
 				"the set '%s'.\n", dset->inst_name);
-		return;
+		return NULL;
 	}
 
 	__update_set_info(set, dset);
@@ -357,20 +717,41 @@ static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
 		prdcr_hint_tree_update(prdcr, set,
 				&set->updt_hint, UPDT_HINT_TREE_ADD);
  	}
-
-	ldmsd_prdcr_unlock(prdcr);
-	ldmsd_prd_set_updtr_task_update(set);
-	ldmsd_prdcr_lock(prdcr);
+	return set;
 }
 
 /*
- * Process the directory list and add or restore specified sets.
+ * Process the directory list and add or restore specified sets. The
+ * updater tasks are updated once for all the sets in the directory.
  */
 static void prdcr_dir_cb_add(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
 {
-	int i;
-	for (i = 0; i < dir->set_count; i++)
-		_add_cb(xprt, prdcr, &dir->set_data[i]);
+	ldmsd_prdcr_set_t set, *sets;
+	int i, count = 0;
+
+	sets = calloc(dir->set_count, sizeof(*sets));
+	for (i = 0; i < dir->set_count; i++) {
+		set = _add_cb(xprt, prdcr, &dir->set_data[i]);
+		if (!set)
+			continue;
+		if (sets) {
+			ldmsd_prdcr_set_ref_get(set);
+			sets[count++] = set;
+			continue;
+		}
+		ldmsd_prdcr_unlock(prdcr);
+		ldmsd_prd_set_updtr_task_update(set);
+		ldmsd_prdcr_lock(prdcr);
+	}
+	if (!count)
+		goto out;
+	ldmsd_prdcr_unlock(prdcr);
+	prd_sets_updtr_task_update(sets, count);
+	ldmsd_prdcr_lock(prdcr);
+	for (i = 0; i < count; i++)
+		ldmsd_prdcr_set_ref_put(sets[i]);
+out:
+	free(sets);
 }
 
 static void prdcr_dir_cb_list(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
@@ -503,6 +884,8 @@ static void prdcr_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 				prdcr->obj.name, prdcr->xprt_name,
 				prdcr->host_name, (int)prdcr->port_no);
 		prdcr->conn_state = LDMSD_PRDCR_STATE_CONNECTED;
+		prdcr->conn_attempts = 0;
+		prdcr_conn_account(prdcr, 1, 1);
 		if (__prdcr_subscribe(prdcr)) {
 			ldmsd_log(LDMSD_LERROR, "Could not subscribe to stream data on producer %s\n",
 				  prdcr->obj.name);
@@ -542,13 +925,15 @@ reset_prdcr:
 	switch (prdcr->conn_state) {
 	case LDMSD_PRDCR_STATE_STOPPING:
 		prdcr->conn_state = LDMSD_PRDCR_STATE_STOPPED;
+		prdcr_conn_account(prdcr, 0, 0);
 		break;
 	case LDMSD_PRDCR_STATE_DISCONNECTED:
 	case LDMSD_PRDCR_STATE_CONNECTING:
 	case LDMSD_PRDCR_STATE_CONNECTED:
 		prdcr->conn_state = LDMSD_PRDCR_STATE_DISCONNECTED;
+		prdcr_conn_account(prdcr, 1, 0);
 		ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
-				 0, prdcr->conn_intrvl_us, 0);
+				 0, prdcr_backoff_us(prdcr), 0);
 		break;
 	case LDMSD_PRDCR_STATE_STOPPED:
 		assert(0 == "STOPPED shouldn't have xprt event");
@@ -604,6 +989,8 @@ static void prdcr_connect(ldmsd_prdcr_t prdcr)
 static void prdcr_task_cb(ldmsd_task_t task, void *arg)
 {
 	ldmsd_prdcr_t prdcr = arg;
+	long wait_us;
+	int rc;
 
 	ldmsd_prdcr_lock(prdcr);
 	switch (prdcr->conn_state) {
@@ -612,7 +999,23 @@ static void prdcr_task_cb(ldmsd_task_t task, void *arg)
 		ldmsd_task_stop(&prdcr->task);
 		break;
 	case LDMSD_PRDCR_STATE_DISCONNECTED:
-		prdcr_connect(prdcr);
+		rc = prdcr_resolve(prdcr);
+		if (rc == EINPROGRESS) {
+			/* rescheduled when the lookup completes */
+			ldmsd_task_resched(task, 0, prdcr->conn_intrvl_us, 0);
+			break;
+		}
+		if (!rc) {
+			wait_us = prdcr_conn_wait_us(prdcr);
+			if (wait_us) {
+				ldmsd_task_resched(task, 0, wait_us, 0);
+				break;
+			}
+		}
+		prdcr->conn_attempts++;
+		ldmsd_task_resched(task, 0, prdcr_backoff_us(prdcr), 0);
+		if (!rc)
+			prdcr_connect(prdcr);
 		break;
 	case LDMSD_PRDCR_STATE_CONNECTING:
 		break;
@@ -685,13 +1088,12 @@ ldmsd_prdcr_new_with_auth(const char *name, const char *xprt_name,
 	if (!prdcr->port_no)
 		goto out;
 
-	if (prdcr_resolve(host_name, port_no, &prdcr->ss, &prdcr->ss_len)) {
-		errno = EAFNOSUPPORT;
-		ldmsd_log(LDMSD_LERROR, "ldmsd_prdcr_new: %s:%u not resolved.\n",
-			host_name,(unsigned) port_no);
+	ldmsd_task_init(&prdcr->task);
+	/* start the host name lookup ahead of prdcr_start */
+	if (ENOMEM == prdcr_resolve(prdcr)) {
+		errno = ENOMEM;
 		goto out;
 	}
-	ldmsd_task_init(&prdcr->task);
 	ldmsd_cfgobj_unlock(&prdcr->obj);
 	return prdcr;
 out:
@@ -765,7 +1167,8 @@ ldmsd_prdcr_t ldmsd_prdcr_next(struct ldmsd_prdcr *prdcr)
 	return (ldmsd_prdcr_t)ldmsd_cfgobj_next(&prdcr->obj);
 }
 
-int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
+static int __prdcr_start(ldmsd_prdcr_t prdcr, long delay_us,
+			 ldmsd_sec_ctxt_t ctxt)
 {
 	int rc;
 	ldmsd_prdcr_lock(prdcr);
@@ -778,16 +1181,28 @@ int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
 	}
 
 	prdcr->conn_state = LDMSD_PRDCR_STATE_DISCONNECTED;
+	prdcr->conn_attempts = 0;
+	prdcr->conn_slot_us = 0;
+	prdcr_conn_account(prdcr, 1, 0);
 
 	prdcr->obj.perm |= LDMSD_PERM_DSTART;
-	ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
-			 LDMSD_TASK_F_IMMEDIATE,
-			 prdcr->conn_intrvl_us, 0);
+	if (delay_us > 0)
+		ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
+				 0, delay_us, 0);
+	else
+		ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
+				 LDMSD_TASK_F_IMMEDIATE,
+				 prdcr->conn_intrvl_us, 0);
 out:
 	ldmsd_prdcr_unlock(prdcr);
 	return rc;
 }
 
+int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
+{
+	return __prdcr_start(prdcr, 0, ctxt);
+}
+
 int ldmsd_prdcr_start(const char *name, const char *interval_str,
 		      ldmsd_sec_ctxt_t ctxt)
 {
@@ -802,6 +1217,18 @@ int ldmsd_prdcr_start(const char *name, const char *interval_str,
 	return rc;
 }
 
+int ldmsd_prdcr_start_delayed(const char *name, long delay_us,
+			      ldmsd_sec_ctxt_t ctxt)
+{
+	int rc = 0;
+	ldmsd_prdcr_t prdcr = ldmsd_prdcr_find(name);
+	if (!prdcr)
+		return ENOENT;
+	rc = __prdcr_start(prdcr, delay_us, ctxt);
+	ldmsd_prdcr_put(prdcr);
+	return rc;
+}
+
 int __ldmsd_prdcr_stop(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
 {
 	int rc;
@@ -829,8 +1256,10 @@ int __ldmsd_prdcr_stop(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
 	ldmsd_prdcr_unlock(prdcr);
 	ldmsd_task_join(&prdcr->task);
 	ldmsd_prdcr_lock(prdcr);
-	if (!prdcr->xprt)
+	if (!prdcr->xprt) {
 		prdcr->conn_state = LDMSD_PRDCR_STATE_STOPPED;
+		prdcr_conn_account(prdcr, 0, 0);
+	}
 out:
 	ldmsd_prdcr_unlock(prdcr);
 	return rc;
@@ -952,6 +1381,26 @@ ldmsd_prdcr_set_t ldmsd_prdcr_set_find(ldmsd_prdcr_t prdcr, const char *setname)
 	return NULL;
 }
 
+/**
+ * Get the first producer set whose instance name sorts after \c setname,
+ * or the first set if \c setname is NULL.
+ *
+ * This function must be called with the producer lock held.
+ */
+ldmsd_prdcr_set_t ldmsd_prdcr_set_next_by_name(ldmsd_prdcr_t prdcr,
+					       const char *setname)
+{
+	struct rbn *rbn;
+	if (!setname)
+		return ldmsd_prdcr_set_first(prdcr);
+	rbn = rbt_find_lub(&prdcr->set_tree, setname);
+	if (rbn && 0 == strcmp(rbn->key, setname))
+		rbn = rbn_succ(rbn);
+	if (rbn)
+		return container_of(rbn, struct ldmsd_prdcr_set, rbn);
+	return NULL;
+}
+
 /**
  * Get the first set with the given update hint \c intrvl and \c offset.
  *
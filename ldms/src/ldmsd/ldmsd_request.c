@@ -156,6 +156,7 @@ static int prdcr_stop_regex_handler(ldmsd_req_ctxt_t req_ctxt);
 static int prdcr_status_handler(ldmsd_req_ctxt_t req_ctxt);
 static int prdcr_set_status_handler(ldmsd_req_ctxt_t req_ctxt);
 static int prdcr_subscribe_regex_handler(ldmsd_req_ctxt_t req_ctxt);
+static int prdcr_conn_config_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_add_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_del_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_start_handler(ldmsd_req_ctxt_t req_ctxt);
@@ -165,6 +166,7 @@ static int strgp_prdcr_del_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_metric_add_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_metric_del_handler(ldmsd_req_ctxt_t req_ctxt);
 static int strgp_status_handler(ldmsd_req_ctxt_t req_ctxt);
+static int strgp_history_handler(ldmsd_req_ctxt_t req_ctxt);
 static int updtr_add_handler(ldmsd_req_ctxt_t req_ctxt);
 static int updtr_del_handler(ldmsd_req_ctxt_t req_ctxt);
 static int updtr_prdcr_add_handler(ldmsd_req_ctxt_t req_ctxt);
@@ -194,6 +196,10 @@ static int logrotate_handler(ldmsd_req_ctxt_t req_ctxt);
 static int exit_daemon_handler(ldmsd_req_ctxt_t req_ctxt);
 static int greeting_handler(ldmsd_req_ctxt_t req_ctxt);
 static int set_route_handler(ldmsd_req_ctxt_t req_ctxt);
+static int shm_set_add_handler(ldmsd_req_ctxt_t req_ctxt);
+static int shm_set_del_handler(ldmsd_req_ctxt_t req_ctxt);
+static int update_stats_handler(ldmsd_req_ctxt_t req_ctxt);
+static int update_stats_config_handler(ldmsd_req_ctxt_t req_ctxt);
 static int unimplemented_handler(ldmsd_req_ctxt_t req_ctxt);
 static int eperm_handler(ldmsd_req_ctxt_t req_ctxt);
 static int ebusy_handler(ldmsd_req_ctxt_t reqc);
@@ -213,6 +219,9 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req_ctxt);
 int failover_cfgstrgp_handler(ldmsd_req_ctxt_t req_ctxt);
 int failover_ping_handler(ldmsd_req_ctxt_t req_ctxt);
 int failover_peercfg_handler(ldmsd_req_ctxt_t req);
+int failover_cfgdiff_handler(ldmsd_req_ctxt_t req);
+int failover_cfg_req_check(ldmsd_req_ctxt_t req);
+void failover_cfg_changed();
 
 int failover_start_handler(ldmsd_req_ctxt_t req_ctxt);
 int failover_stop_handler(ldmsd_req_ctxt_t req_ctxt);
@@ -236,16 +245,20 @@ static struct request_handler_entry request_handler[] = {
 
 	/* PRDCR */
 	[LDMSD_PRDCR_ADD_REQ] = {
-		LDMSD_PRDCR_ADD_REQ, prdcr_add_handler, XUG
+		LDMSD_PRDCR_ADD_REQ, prdcr_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_PRDCR_DEL_REQ] = {
-		LDMSD_PRDCR_DEL_REQ, prdcr_del_handler, XUG
+		LDMSD_PRDCR_DEL_REQ, prdcr_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_PRDCR_START_REQ] = {
-		LDMSD_PRDCR_START_REQ, prdcr_start_handler, XUG
+		LDMSD_PRDCR_START_REQ, prdcr_start_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_PRDCR_STOP_REQ] = {
-		LDMSD_PRDCR_STOP_REQ, prdcr_stop_handler, XUG
+		LDMSD_PRDCR_STOP_REQ, prdcr_stop_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_PRDCR_STATUS_REQ] = {
 		LDMSD_PRDCR_STATUS_REQ, prdcr_status_handler,
@@ -269,61 +282,84 @@ static struct request_handler_entry request_handler[] = {
 		LDMSD_PRDCR_SUBSCRIBE_REQ, prdcr_subscribe_regex_handler,
 		XUG | LDMSD_PERM_FAILOVER_ALLOWED
 	},
+	[LDMSD_PRDCR_CONN_CONFIG_REQ] = {
+		LDMSD_PRDCR_CONN_CONFIG_REQ, prdcr_conn_config_handler, XUG
+	},
 
 	/* STRGP */
 	[LDMSD_STRGP_ADD_REQ] = {
-		LDMSD_STRGP_ADD_REQ, strgp_add_handler, XUG
+		LDMSD_STRGP_ADD_REQ, strgp_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_DEL_REQ]  = {
-		LDMSD_STRGP_DEL_REQ, strgp_del_handler, XUG
+		LDMSD_STRGP_DEL_REQ, strgp_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_PRDCR_ADD_REQ] = {
-		LDMSD_STRGP_PRDCR_ADD_REQ, strgp_prdcr_add_handler, XUG
+		LDMSD_STRGP_PRDCR_ADD_REQ, strgp_prdcr_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_PRDCR_DEL_REQ] = {
-		LDMSD_STRGP_PRDCR_DEL_REQ, strgp_prdcr_del_handler, XUG
+		LDMSD_STRGP_PRDCR_DEL_REQ, strgp_prdcr_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_METRIC_ADD_REQ] = {
-		LDMSD_STRGP_METRIC_ADD_REQ, strgp_metric_add_handler, XUG
+		LDMSD_STRGP_METRIC_ADD_REQ, strgp_metric_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_METRIC_DEL_REQ] = {
-		LDMSD_STRGP_METRIC_DEL_REQ, strgp_metric_del_handler, XUG
+		LDMSD_STRGP_METRIC_DEL_REQ, strgp_metric_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_START_REQ] = {
-		LDMSD_STRGP_START_REQ, strgp_start_handler, XUG
+		LDMSD_STRGP_START_REQ, strgp_start_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_STOP_REQ] = {
-		LDMSD_STRGP_STOP_REQ, strgp_stop_handler, XUG
+		LDMSD_STRGP_STOP_REQ, strgp_stop_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_STRGP_STATUS_REQ] = {
 		LDMSD_STRGP_STATUS_REQ, strgp_status_handler,
 		XALL | LDMSD_PERM_FAILOVER_ALLOWED
 	},
+	[LDMSD_STRGP_HISTORY_REQ] = {
+		LDMSD_STRGP_HISTORY_REQ, strgp_history_handler,
+		XALL | LDMSD_PERM_FAILOVER_ALLOWED
+	},
 
 	/* UPDTR */
 	[LDMSD_UPDTR_ADD_REQ] = {
-		LDMSD_UPDTR_ADD_REQ, updtr_add_handler, XUG
+		LDMSD_UPDTR_ADD_REQ, updtr_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_DEL_REQ] = {
-		LDMSD_UPDTR_DEL_REQ, updtr_del_handler, XUG
+		LDMSD_UPDTR_DEL_REQ, updtr_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_PRDCR_ADD_REQ] = {
-		LDMSD_UPDTR_PRDCR_ADD_REQ, updtr_prdcr_add_handler, XUG
+		LDMSD_UPDTR_PRDCR_ADD_REQ, updtr_prdcr_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_PRDCR_DEL_REQ] = {
-		LDMSD_UPDTR_PRDCR_DEL_REQ, updtr_prdcr_del_handler, XUG
+		LDMSD_UPDTR_PRDCR_DEL_REQ, updtr_prdcr_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_START_REQ] = {
-		LDMSD_UPDTR_START_REQ, updtr_start_handler, XUG
+		LDMSD_UPDTR_START_REQ, updtr_start_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_STOP_REQ] = {
-		LDMSD_UPDTR_STOP_REQ, updtr_stop_handler, XUG
+		LDMSD_UPDTR_STOP_REQ, updtr_stop_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_MATCH_ADD_REQ] = {
-		LDMSD_UPDTR_MATCH_ADD_REQ, updtr_match_add_handler, XUG
+		LDMSD_UPDTR_MATCH_ADD_REQ, updtr_match_add_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_MATCH_DEL_REQ] = {
-		LDMSD_UPDTR_MATCH_DEL_REQ, updtr_match_del_handler, XUG
+		LDMSD_UPDTR_MATCH_DEL_REQ, updtr_match_del_handler,
+		XUG | LDMSD_PERM_FAILOVER_SYNC,
 	},
 	[LDMSD_UPDTR_STATUS_REQ] = {
 		LDMSD_UPDTR_STATUS_REQ, updtr_status_handler,
@@ -402,6 +438,19 @@ static struct request_handler_entry request_handler[] = {
 	[LDMSD_SET_ROUTE_REQ] = {
 		LDMSD_SET_ROUTE_REQ, set_route_handler, XUG
 	},
+	[LDMSD_SHM_SET_ADD_REQ] = {
+		LDMSD_SHM_SET_ADD_REQ, shm_set_add_handler, XUG
+	},
+	[LDMSD_SHM_SET_DEL_REQ] = {
+		LDMSD_SHM_SET_DEL_REQ, shm_set_del_handler, XUG
+	},
+	[LDMSD_UPDATE_STATS_REQ] = {
+		LDMSD_UPDATE_STATS_REQ, update_stats_handler,
+		XALL | LDMSD_PERM_FAILOVER_ALLOWED
+	},
+	[LDMSD_UPDATE_STATS_CONFIG_REQ] = {
+		LDMSD_UPDATE_STATS_CONFIG_REQ, update_stats_config_handler, XUG
+	},
 
 	/* FAILOVER user commands */
 	[LDMSD_FAILOVER_CONFIG_REQ] = {
@@ -458,6 +507,10 @@ static struct request_handler_entry request_handler[] = {
 		LDMSD_FAILOVER_PEERCFG_REQ, failover_peercfg_handler,
 		XUG | LDMSD_PERM_FAILOVER_INTERNAL,
 	},
+	[LDMSD_FAILOVER_CFGDIFF_REQ] = {
+		LDMSD_FAILOVER_CFGDIFF_REQ, failover_cfgdiff_handler,
+		XUG | LDMSD_PERM_FAILOVER_INTERNAL,
+	},
 
 	/* SETGROUP */
 	[LDMSD_SETGROUP_ADD_REQ] = {
@@ -714,6 +767,7 @@ int ldmsd_handle_request(ldmsd_req_ctxt_t reqc)
 	uid_t luid;
 	gid_t lgid;
 	mode_t mask;
+	int rc;
 
 	__dlog("handling req %s\n", ldmsd_req_id2str(reqc->req_id));
 
@@ -746,9 +800,17 @@ int ldmsd_handle_request(ldmsd_req_ctxt_t reqc)
 		if (0 != ldms_access_check(xprt, 0111, luid, lgid,
 				ent->flag & 0111))
 			return eperm_handler(reqc);
+
+		/* the peer objects belong to the failover service */
+		if ((ent->flag & LDMSD_PERM_FAILOVER_SYNC) &&
+		    failover_cfg_req_check(reqc))
+			return eperm_handler(reqc);
 	}
 
-	return request_handler[request->req_id].handler(reqc);
+	rc = request_handler[request->req_id].handler(reqc);
+	if (ent->flag & LDMSD_PERM_FAILOVER_SYNC)
+		failover_cfg_changed();
+	return rc;
 }
 
 int ldmsd_handle_response(ldmsd_req_cmd_t rcmd)
@@ -1650,6 +1712,335 @@ send_reply:
 	return 0;
 }
 
+static int prdcr_conn_config_handler(ldmsd_req_ctxt_t reqc)
+{
+	char *rate_s, *backoff_s, *endptr;
+	long rate = -1, backoff_max_us = -1;
+	struct ldmsd_prdcr_conn_stats stats;
+	struct ldmsd_req_attr_s attr;
+	int rc;
+
+	reqc->errcode = 0;
+	rate_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_RATE);
+	backoff_s = ldmsd_req_attr_str_value_get_by_id(reqc,
+						       LDMSD_ATTR_BACKOFF_MAX);
+	if (rate_s) {
+		rate = strtol(rate_s, &endptr, 0);
+		if (*endptr != '\0' || rate < 0) {
+			reqc->errcode = EINVAL;
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The rate '%s' is invalid.", rate_s);
+			goto err;
+		}
+	}
+	if (backoff_s) {
+		backoff_max_us = strtol(backoff_s, &endptr, 0);
+		if (*endptr != '\0' || backoff_max_us < 0) {
+			reqc->errcode = EINVAL;
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The backoff_max '%s' is invalid.", backoff_s);
+			goto err;
+		}
+	}
+	reqc->errcode = ldmsd_prdcr_conn_config(rate, backoff_max_us);
+	if (reqc->errcode) {
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "Error %d configuring the producer connections.",
+			 reqc->errcode);
+		goto err;
+	}
+
+	ldmsd_prdcr_conn_stats_get(&stats);
+	reqc->line_off = 0;
+	rc = linebuf_printf(reqc, "{\"rate\":%ld,"
+			    "\"backoff_max\":%ld,"
+			    "\"started\":%d,"
+			    "\"connected\":%d,"
+			    "\"ramping\":%d,"
+			    "\"ramp_us\":%" PRIu64 ","
+			    "\"resolving\":%d,"
+			    "\"resolved\":%d}",
+			    stats.rate, stats.backoff_max_us,
+			    stats.started, stats.connected, stats.ramping,
+			    stats.ramp_us, stats.resolving, stats.resolved);
+	if (rc)
+		goto out;
+	attr.discrim = 1;
+	attr.attr_len = reqc->line_off;
+	attr.attr_id = LDMSD_ATTR_JSON;
+	ldmsd_hton_req_attr(&attr);
+	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr),
+				LDMSD_REQ_SOM_F);
+	if (rc)
+		goto out;
+	rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
+	if (rc)
+		goto out;
+	attr.discrim = 0;
+	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim, sizeof(uint32_t),
+				LDMSD_REQ_EOM_F);
+	goto out;
+err:
+	reqc->line_off = 0;
+	ldmsd_send_req_response(reqc, reqc->line_buf);
+	rc = 0;
+out:
+	free(rate_s);
+	free(backoff_s);
+	return rc;
+}
+
+/*
+ * Paged status replies
+ *
+ * The status requests accept 'limit=<n>' to cap the number of objects in a
+ * reply and 'cursor=<token>' to resume after the last object of the previous
+ * reply. When the limit stops the walk while objects remain, the reply
+ * carries an LDMSD_ATTR_CURSOR string attribute after the JSON attribute;
+ * the client sends it back to get the next page. The token is opaque to the
+ * client: "<len>:<object name><set name>" where <len> is the length of the
+ * object name.
+ *
+ * The configuration objects are walked in name order with
+ * ldmsd_cfgobj_next_by_name() so that only the object being formatted is
+ * locked; configuration changes may proceed between objects and a page never
+ * holds more than 'limit' objects in the line buffer.
+ */
+struct status_page {
+	int limit;		/* 0 means no limit */
+	int count;		/* objects in this reply */
+	int more;		/* the limit stopped the walk */
+	int binary;		/* format=binary */
+	char *after_obj;	/* resume after this object ... */
+	char *after_set;	/* ... or after this set in that object */
+	char *next_obj;		/* cursor of the next page */
+	char *next_set;
+	int has_regex;
+	regex_t regex;		/* object name filter */
+	char *instance;		/* prdcr_set_status filters */
+	char *schema;
+	char *state;
+};
+
+typedef int (*status_obj_fn_t)(ldmsd_req_ctxt_t reqc, ldmsd_cfgobj_t obj,
+			       struct status_page *pg);
+
+static void __status_page_free(struct status_page *pg)
+{
+	free(pg->after_obj);
+	free(pg->after_set);
+	free(pg->next_obj);
+	free(pg->next_set);
+	free(pg->instance);
+	free(pg->schema);
+	free(pg->state);
+	if (pg->has_regex)
+		regfree(&pg->regex);
+}
+
+/*
+ * Parse the paging and filter attributes common to the status requests.
+ * On error, reqc->line_buf holds the message and reqc->errcode is set.
+ */
+static int __status_page_init(ldmsd_req_ctxt_t reqc, struct status_page *pg)
+{
+	char *limit_s, *cursor, *regex_s, *format, *endptr;
+	unsigned long len;
+	int rc = 0;
+
+	memset(pg, 0, sizeof(*pg));
+	limit_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_LIMIT);
+	cursor = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_CURSOR);
+	regex_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_REGEX);
+	format = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_FORMAT);
+
+	if (limit_s) {
+		pg->limit = strtol(limit_s, &endptr, 0);
+		if (*endptr != '\0' || pg->limit <= 0) {
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The limit '%s' is invalid.", limit_s);
+			rc = EINVAL;
+			goto out;
+		}
+	}
+	if (cursor) {
+		len = strtoul(cursor, &endptr, 10);
+		if (*endptr != ':' || len > strlen(endptr + 1)) {
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The cursor '%s' is invalid.", cursor);
+			rc = EINVAL;
+			goto out;
+		}
+		endptr++;
+		pg->after_obj = strndup(endptr, len);
+		if (endptr[len] != '\0')
+			pg->after_set = strdup(&endptr[len]);
+		if (!pg->after_obj || (endptr[len] != '\0' && !pg->after_set))
+			goto enomem;
+	}
+	if (regex_s) {
+		if (ldmsd_compile_regex(&pg->regex, regex_s,
+					reqc->line_buf, reqc->line_len)) {
+			rc = EINVAL;
+			goto out;
+		}
+		pg->has_regex = 1;
+	}
+	if (format) {
+		if (0 == strcasecmp(format, "binary")) {
+			pg->binary = 1;
+		} else if (0 != strcasecmp(format, "json")) {
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The format '%s' is not supported.", format);
+			rc = EINVAL;
+			goto out;
+		}
+	}
+	goto out;
+enomem:
+	Snprintf(&reqc->line_buf, &reqc->line_len, "Out of memory");
+	rc = ENOMEM;
+out:
+	free(limit_s);
+	free(cursor);
+	free(regex_s);
+	free(format);
+	reqc->errcode = rc;
+	return rc;
+}
+
+/*
+ * Account for one more object in the reply. Returns 0 if the page is full,
+ * in which case the walk must stop.
+ */
+static int __status_page_take(struct status_page *pg)
+{
+	if (pg->limit && pg->count == pg->limit) {
+		pg->more = 1;
+		return 0;
+	}
+	pg->count++;
+	return 1;
+}
+
+/*
+ * Remember the last object put in a full page as the resume point. \c set
+ * is NULL for requests that page over whole configuration objects.
+ */
+static int __status_page_mark(struct status_page *pg, const char *obj,
+			      const char *set)
+{
+	if (!pg->limit || pg->count != pg->limit)
+		return 0;
+	pg->next_obj = strdup(obj);
+	if (set)
+		pg->next_set = strdup(set);
+	if (!pg->next_obj || (set && !pg->next_set))
+		return ENOMEM;
+	return 0;
+}
+
+/*
+ * Call \c fn on the objects of \c type in name order starting after the
+ * cursor, without holding the type lock across the calls.
+ */
+static int __status_page_walk(ldmsd_req_ctxt_t reqc, struct status_page *pg,
+			      ldmsd_cfgobj_type_t type, status_obj_fn_t fn)
+{
+	ldmsd_cfgobj_t obj, next;
+	int rc = 0;
+
+	if (pg->after_set) {
+		/* resume inside the object of the previous page */
+		obj = ldmsd_cfgobj_find(pg->after_obj, type);
+		if (!obj)
+			obj = ldmsd_cfgobj_next_by_name(pg->after_obj, type);
+	} else {
+		obj = ldmsd_cfgobj_next_by_name(pg->after_obj, type);
+	}
+	while (obj) {
+		if (!pg->has_regex ||
+		    0 == regexec(&pg->regex, obj->name, 0, NULL, 0)) {
+			rc = fn(reqc, obj, pg);
+			if (rc || pg->more) {
+				ldmsd_cfgobj_put(obj);
+				break;
+			}
+		}
+		if (pg->after_set) {
+			free(pg->after_set);
+			pg->after_set = NULL;
+		}
+		next = ldmsd_cfgobj_next_by_name(obj->name, type);
+		ldmsd_cfgobj_put(obj);
+		obj = next;
+	}
+	return rc;
+}
+
+/*
+ * Send the objects formatted in reqc->line_buf as a JSON array (or the raw
+ * records in binary format) followed by the cursor attribute if the page
+ * is not the last.
+ */
+static int __status_page_reply(ldmsd_req_ctxt_t reqc, struct status_page *pg)
+{
+	struct ldmsd_req_attr_s attr;
+	int rc;
+
+	attr.discrim = 1;
+	if (pg->binary) {
+		attr.attr_id = LDMSD_ATTR_BINARY;
+		attr.attr_len = reqc->line_off;
+	} else {
+		attr.attr_id = LDMSD_ATTR_JSON;
+		attr.attr_len = reqc->line_off + 2; /* +2 for '[' and ']' */
+	}
+	ldmsd_hton_req_attr(&attr);
+	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F);
+	if (rc)
+		return rc;
+	if (!pg->binary) {
+		rc = ldmsd_append_reply(reqc, "[", 1, 0);
+		if (rc)
+			return rc;
+	}
+	if (reqc->line_off) {
+		rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
+		if (rc)
+			return rc;
+	}
+	if (!pg->binary) {
+		rc = ldmsd_append_reply(reqc, "]", 1, 0);
+		if (rc)
+			return rc;
+	}
+
+	if (pg->more && pg->next_obj) {
+		reqc->line_off = 0;
+		rc = linebuf_printf(reqc, "%zu:%s%s", strlen(pg->next_obj),
+				    pg->next_obj,
+				    (pg->next_set ? pg->next_set : ""));
+		if (rc)
+			return rc;
+		attr.discrim = 1;
+		attr.attr_id = LDMSD_ATTR_CURSOR;
+		attr.attr_len = reqc->line_off + 1;
+		ldmsd_hton_req_attr(&attr);
+		rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), 0);
+		if (rc)
+			return rc;
+		rc = ldmsd_append_reply(reqc, reqc->line_buf,
+					reqc->line_off + 1, 0);
+		if (rc)
+			return rc;
+	}
+
+	attr.discrim = 0;
+	return ldmsd_append_reply(reqc, (char *)&attr.discrim,
+				  sizeof(uint32_t), LDMSD_REQ_EOM_F);
+}
+
 int __prdcr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_t prdcr, int prdcr_cnt)
 {
 	extern const char *prdcr_state_str(enum ldmsd_prdcr_state state);
@@ -1707,14 +2098,25 @@ out:
 	return rc;
 }
 
+static int __prdcr_status_page_fn(ldmsd_req_ctxt_t reqc, ldmsd_cfgobj_t obj,
+				  struct status_page *pg)
+{
+	int rc;
+	if (!__status_page_take(pg))
+		return 0;
+	rc = __prdcr_status_json_obj(reqc, (ldmsd_prdcr_t)obj, pg->count - 1);
+	if (rc)
+		return rc;
+	return __status_page_mark(pg, obj->name, NULL);
+}
+
 static int prdcr_status_handler(ldmsd_req_ctxt_t reqc)
 {
 	int rc = 0;
 	size_t cnt = 0;
-	struct ldmsd_req_attr_s attr;
+	struct status_page pg;
 	ldmsd_prdcr_t prdcr = NULL;
 	char *name;
-	int count;
 
 	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
 	if (name) {
@@ -1725,59 +2127,27 @@ static int prdcr_status_handler(ldmsd_req_ctxt_t reqc)
 					"prdcr '%s' doesn't exist.", name);
 			reqc->errcode = ENOENT;
 			ldmsd_send_req_response(reqc, reqc->line_buf);
+			free(name);
 			return 0;
 		}
 	}
+	if (__status_page_init(reqc, &pg)) {
+		ldmsd_send_req_response(reqc, reqc->line_buf);
+		goto out;
+	}
+	pg.binary = 0;
 
 	/* Construct the json object of the producer(s) */
-	if (prdcr) {
+	if (prdcr)
 		rc = __prdcr_status_json_obj(reqc, prdcr, 0);
-		if (rc)
-			goto out;
-	} else {
-		count = 0;
-		ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
-		for (prdcr = ldmsd_prdcr_first(); prdcr;
-				prdcr = ldmsd_prdcr_next(prdcr)) {
-			rc = __prdcr_status_json_obj(reqc, prdcr, count);
-			if (rc) {
-				ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
-				goto out;
-			}
-			count++;
-		}
-		ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
-	}
-	cnt = reqc->line_off + 2; /* +2 for '[' and ']' */
-
-	/* Send the json attribute header */
-	attr.discrim = 1;
-	attr.attr_len = cnt;
-	attr.attr_id = LDMSD_ATTR_JSON;
-	ldmsd_hton_req_attr(&attr);
-	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F);
-	if (rc)
-		goto out;
-
-	/* Send the json object */
-	rc = ldmsd_append_reply(reqc, "[", 1, 0);
+	else
+		rc = __status_page_walk(reqc, &pg, LDMSD_CFGOBJ_PRDCR,
+					__prdcr_status_page_fn);
 	if (rc)
 		goto out;
-	if (reqc->line_off) {
-		rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
-		if (rc)
-			goto out;
-	}
-	rc = ldmsd_append_reply(reqc, "]", 1, 0);
-	if (rc) {
-		goto out;
-	}
-
-	/* Send the terminating attribute */
-	attr.discrim = 0;
-	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim,
-			sizeof(uint32_t), LDMSD_REQ_EOM_F);
+	rc = __status_page_reply(reqc, &pg);
 out:
+	__status_page_free(&pg);
 	if (name)
 		free(name);
 	if (prdcr)
@@ -1785,7 +2155,52 @@ out:
 	return rc;
 }
 
-size_t __prdcr_set_status(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_set_t prd_set)
+static int __prdcr_set_status_bin(ldmsd_req_ctxt_t reqc,
+				  ldmsd_prdcr_set_t prd_set,
+				  struct ldms_timestamp *ts,
+				  struct ldms_timestamp *dur,
+				  const char *producer_name)
+{
+	struct ldmsd_prdcr_set_status_rec *rec;
+	const char *strs[4];
+	size_t lens[4], rec_len, off;
+	int i;
+
+	strs[0] = prd_set->inst_name;
+	strs[1] = prd_set->schema_name ? prd_set->schema_name : "";
+	strs[2] = producer_name;
+	strs[3] = prd_set->prdcr->obj.name;
+	rec_len = sizeof(*rec);
+	for (i = 0; i < 4; i++) {
+		lens[i] = strlen(strs[i]) + 1;
+		rec_len += lens[i];
+	}
+	if (reqc->line_off + rec_len > reqc->line_len) {
+		char *buf = realloc(reqc->line_buf,
+				    2 * reqc->line_len + rec_len);
+		if (!buf)
+			return ENOMEM;
+		reqc->line_buf = buf;
+		reqc->line_len = 2 * reqc->line_len + rec_len;
+	}
+	rec = (void *)&reqc->line_buf[reqc->line_off];
+	rec->rec_len = htonl(rec_len);
+	rec->state = htonl(prd_set->state);
+	rec->ts_sec = htonl(ts->sec);
+	rec->ts_usec = htonl(ts->usec);
+	rec->dur_sec = htonl(dur->sec);
+	rec->dur_usec = htonl(dur->usec);
+	off = 0;
+	for (i = 0; i < 4; i++) {
+		memcpy(&rec->names[off], strs[i], lens[i]);
+		off += lens[i];
+	}
+	reqc->line_off += rec_len;
+	return 0;
+}
+
+size_t __prdcr_set_status(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_set_t prd_set,
+			  struct status_page *pg)
 {
 	struct ldms_timestamp ts = { 0, 0 }, dur = { 0, 0 };
 	const char *producer_name = "";
@@ -1794,8 +2209,11 @@ size_t __prdcr_set_status(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_set_t prd_set)
 		dur = ldms_transaction_duration_get(prd_set->set);
 		producer_name = ldms_set_producer_name_get(prd_set->set);
 	}
+	if (pg->binary)
+		return __prdcr_set_status_bin(reqc, prd_set, &ts, &dur,
+					      producer_name);
 	return linebuf_printf(reqc,
-		"{ "
+		"%s{ "
 		"\"inst_name\":\"%s\","
 		"\"schema_name\":\"%s\","
 		"\"state\":\"%s\","
@@ -1806,6 +2224,7 @@ size_t __prdcr_set_status(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_set_t prd_set)
 		"\"duration.sec\":\"%d\","
 		"\"duration.usec\":\"%d\""
 		"}",
+		(pg->count > 1 ? ",\n" : ""),
 		prd_set->inst_name, prd_set->schema_name,
 		ldmsd_prdcr_set_state_str(prd_set->state),
 		producer_name,
@@ -1814,124 +2233,96 @@ size_t __prdcr_set_status(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_set_t prd_set)
 		dur.sec, dur.usec);
 }
 
-/* This function must be called with producer lock held */
-int __prdcr_set_status_handler(ldmsd_req_ctxt_t reqc, ldmsd_prdcr_t prdcr,
-			int *count, const char *setname, const char *schema)
+static int __prdcr_set_match(ldmsd_prdcr_set_t prd_set, struct status_page *pg)
 {
-	int rc = 0;
+	if (pg->schema && (!prd_set->schema_name ||
+			   0 != strcmp(prd_set->schema_name, pg->schema)))
+		return 0;
+	if (pg->state && 0 != strcasecmp(pg->state,
+				ldmsd_prdcr_set_state_str(prd_set->state)))
+		return 0;
+	return 1;
+}
+
+static int __prdcr_set_status_page_fn(ldmsd_req_ctxt_t reqc,
+				      ldmsd_cfgobj_t obj,
+				      struct status_page *pg)
+{
+	ldmsd_prdcr_t prdcr = (ldmsd_prdcr_t)obj;
 	ldmsd_prdcr_set_t prd_set;
+	int rc = 0;
 
-	if (setname) {
-		prd_set = ldmsd_prdcr_set_find(prdcr, setname);
-		if (!prd_set)
-			return 0;
-		if (schema && (0 != strcmp(prd_set->schema_name, schema)))
-			return 0;
-		if (*count) {
-			rc = linebuf_printf(reqc, ",\n");
-			if (rc)
-				return rc;
-		}
-		rc = __prdcr_set_status(reqc, prd_set);
+	ldmsd_prdcr_lock(prdcr);
+	if (pg->instance) {
+		prd_set = ldmsd_prdcr_set_find(prdcr, pg->instance);
+		if (!prd_set || !__prdcr_set_match(prd_set, pg))
+			goto out;
+		if (pg->after_set && strcmp(prd_set->inst_name, pg->after_set) <= 0)
+			goto out;
+		if (!__status_page_take(pg))
+			goto out;
+		rc = __prdcr_set_status(reqc, prd_set, pg);
+		if (!rc)
+			rc = __status_page_mark(pg, obj->name, prd_set->inst_name);
+		goto out;
+	}
+	for (prd_set = ldmsd_prdcr_set_next_by_name(prdcr, pg->after_set);
+	     prd_set; prd_set = ldmsd_prdcr_set_next(prd_set)) {
+		if (!__prdcr_set_match(prd_set, pg))
+			continue;
+		if (!__status_page_take(pg))
+			break;
+		rc = __prdcr_set_status(reqc, prd_set, pg);
 		if (rc)
-			return rc;
-		(*count)++;
-	} else {
-		for (prd_set = ldmsd_prdcr_set_first(prdcr); prd_set;
-			prd_set = ldmsd_prdcr_set_next(prd_set)) {
-			if (schema && (0 != strcmp(prd_set->schema_name, schema)))
-				continue;
-
-			if (*count) {
-				rc = linebuf_printf(reqc, ",\n");
-				if (rc)
-					return rc;
-			}
-			rc = __prdcr_set_status(reqc, prd_set);
-			if (rc)
-				return rc;
-			(*count)++;
-		}
+			break;
+		rc = __status_page_mark(pg, obj->name, prd_set->inst_name);
+		if (rc)
+			break;
 	}
+out:
+	ldmsd_prdcr_unlock(prdcr);
 	return rc;
 }
 
-int __prdcr_set_status_json_obj(ldmsd_req_ctxt_t reqc)
+static int prdcr_set_status_handler(ldmsd_req_ctxt_t reqc)
 {
-	char *prdcr_name, *setname, *schema;
-	prdcr_name = setname = schema = NULL;
-	ldmsd_prdcr_t prdcr = NULL;
-	int rc, count = 0;
-	reqc->errcode = 0;
+	struct status_page pg;
+	char *prdcr_name = NULL;
+	ldmsd_prdcr_t prdcr;
+	int rc;
 
+	reqc->errcode = 0;
+	if (__status_page_init(reqc, &pg)) {
+		ldmsd_send_req_response(reqc, reqc->line_buf);
+		rc = 0;
+		goto out;
+	}
 	prdcr_name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_PRODUCER);
-	setname = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_INSTANCE);
-	schema = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_SCHEMA);
+	pg.instance = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_INSTANCE);
+	pg.schema = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_SCHEMA);
+	pg.state = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_STATE);
 
-	rc = linebuf_printf(reqc, "[");
-	if (rc)
-		return rc;
+	rc = 0;
 	if (prdcr_name) {
+		if (pg.after_obj && 0 != strcmp(pg.after_obj, prdcr_name))
+			goto reply;
 		prdcr = ldmsd_prdcr_find(prdcr_name);
 		if (!prdcr)
-			goto out;
-	}
-
-	if (prdcr) {
-		ldmsd_prdcr_lock(prdcr);
-		rc = __prdcr_set_status_handler(reqc, prdcr, &count,
-						setname, schema);
-		ldmsd_prdcr_unlock(prdcr);
+			goto reply;
+		rc = __prdcr_set_status_page_fn(reqc, &prdcr->obj, &pg);
+		ldmsd_prdcr_put(prdcr);
 	} else {
-		ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
-		for (prdcr = ldmsd_prdcr_first(); prdcr;
-				prdcr = ldmsd_prdcr_next(prdcr)) {
-			ldmsd_prdcr_lock(prdcr);
-			rc = __prdcr_set_status_handler(reqc, prdcr, &count,
-							setname, schema);
-			ldmsd_prdcr_unlock(prdcr);
-			if (rc) {
-				ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
-				goto out;
-			}
-		}
-		ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+		rc = __status_page_walk(reqc, &pg, LDMSD_CFGOBJ_PRDCR,
+					__prdcr_set_status_page_fn);
 	}
-
+	if (rc)
+		goto out;
+reply:
+	rc = __status_page_reply(reqc, &pg);
 out:
-	rc = linebuf_printf(reqc, "]");
+	__status_page_free(&pg);
 	if (prdcr_name)
 		free(prdcr_name);
-	if (setname)
-		free(setname);
-	if (schema)
-		free(schema);
-	return rc;
-}
-
-static int prdcr_set_status_handler(ldmsd_req_ctxt_t reqc)
-{
-	int rc;
-	struct ldmsd_req_attr_s attr;
-
-	rc = __prdcr_set_status_json_obj(reqc);
-	if (rc)
-		return rc;
-	attr.discrim = 1;
-	attr.attr_len = reqc->line_off;
-	attr.attr_id = LDMSD_ATTR_JSON;
-	ldmsd_hton_req_attr(&attr);
-	rc = ldmsd_append_reply(reqc, (char *)&attr,
-				sizeof(attr), LDMSD_REQ_SOM_F);
-	if (rc)
-		return rc;
-
-	rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
-	if (rc)
-		return rc;
-	attr.discrim = 0;
-	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim,
-			sizeof(uint32_t), LDMSD_REQ_EOM_F);
 	return rc;
 }
 
@@ -1944,6 +2335,14 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	gid_t gid;
 	int perm;
 	char *perm_s = NULL;
+	char *history_s = NULL;
+	size_t history = 0;
+	char *downsample_s = NULL;
+	char *downsample_op = NULL;
+	ldmsd_downsample_t downsample = NULL;
+	char *deadband_s = NULL;
+	char *heartbeat_s = NULL;
+	ldmsd_deadband_t deadband = NULL;
 
 	reqc->errcode = 0;
 
@@ -1990,6 +2389,52 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	if (perm_s)
 		perm = strtol(perm_s, NULL, 0);
 
+	history_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_HISTORY);
+	if (history_s) {
+		history = ovis_get_mem_size(history_s);
+		if (!history) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "Invalid history size '%s'.", history_s);
+			goto send_reply;
+		}
+	}
+
+	downsample_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DOWNSAMPLE);
+	downsample_op = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DOWNSAMPLE_OP);
+	if (downsample_s) {
+		downsample = ldmsd_downsample_new(strtoull(downsample_s, NULL, 0),
+						  downsample_op);
+		if (!downsample) {
+			if (errno == ENOMEM)
+				goto enomem;
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "Invalid downsample window '%s' or "
+				       "downsample_op '%s'.", downsample_s,
+				       downsample_op ? downsample_op : "");
+			goto send_reply;
+		}
+	} else if (downsample_op) {
+		attr_name = "downsample";
+		goto einval;
+	}
+
+	deadband_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DEADBAND);
+	heartbeat_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_HEARTBEAT);
+	if (deadband_s || heartbeat_s) {
+		deadband = ldmsd_deadband_new(deadband_s,
+				heartbeat_s ? strtoull(heartbeat_s, NULL, 0) : 0);
+		if (!deadband) {
+			if (errno == ENOMEM)
+				goto enomem;
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "Invalid deadband '%s'.", deadband_s);
+			goto send_reply;
+		}
+	}
+
 	ldmsd_strgp_t strgp = ldmsd_strgp_new_with_auth(name, uid, gid, perm);
 	if (!strgp) {
 		if (errno == EEXIST)
@@ -2010,8 +2455,20 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	if (!strgp->container)
 		goto enomem_3;
 
+	if (history) {
+		strgp->history = ldmsd_history_new(history);
+		if (!strgp->history)
+			goto enomem_4;
+	}
+	strgp->downsample = downsample;
+	downsample = NULL;
+	strgp->deadband = deadband;
+	deadband = NULL;
+
 	goto send_reply;
 
+enomem_4:
+	free(strgp->container);
 enomem_3:
 	free(strgp->schema);
 enomem_2:
@@ -2045,6 +2502,20 @@ send_reply:
 		free(schema);
 	if (perm_s)
 		free(perm_s);
+	if (history_s)
+		free(history_s);
+	if (downsample_s)
+		free(downsample_s);
+	if (downsample_op)
+		free(downsample_op);
+	if (downsample)
+		ldmsd_downsample_free(downsample);
+	if (deadband_s)
+		free(deadband_s);
+	if (heartbeat_s)
+		free(heartbeat_s);
+	if (deadband)
+		ldmsd_deadband_free(deadband);
 	return 0;
 }
 
@@ -2508,20 +2979,84 @@ int __strgp_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_strgp_t strgp,
 		if (rc)
 			goto out;
 	}
-	rc = linebuf_printf(reqc, "]}");
+	rc = linebuf_printf(reqc, "]");
+	if (rc)
+		goto out;
+
+	if (strgp->history) {
+		struct ldmsd_history_stats st;
+		ldmsd_history_stats_get(strgp->history, &st);
+		rc = linebuf_printf(reqc, ",\"history\":{"
+				"\"budget\":%zu,"
+				"\"bytes\":%zu,"
+				"\"series\":%" PRIu64 ","
+				"\"rows\":%" PRIu64 ","
+				"\"dropped\":%" PRIu64 ","
+				"\"evicted\":%" PRIu64 ","
+				"\"first_ts\":%" PRIu64 "}",
+				st.budget, st.bytes, st.series, st.rows,
+				st.dropped, st.evicted, st.first_ts);
+		if (rc)
+			goto out;
+	}
+	if (strgp->downsample) {
+		struct ldmsd_downsample_stats st;
+		ldmsd_downsample_stats_get(strgp->downsample, &st);
+		rc = linebuf_printf(reqc, ",\"downsample\":{"
+				"\"window\":%" PRIu64 ","
+				"\"op\":\"%s\","
+				"\"series\":%" PRIu64 ","
+				"\"samples\":%" PRIu64 ","
+				"\"rows\":%" PRIu64 ","
+				"\"late\":%" PRIu64 ","
+				"\"resets\":%" PRIu64 ","
+				"\"expired\":%" PRIu64 "}",
+				st.window, st.op, st.series, st.samples,
+				st.rows, st.late, st.resets, st.expired);
+		if (rc)
+			goto out;
+	}
+	if (strgp->deadband) {
+		struct ldmsd_deadband_stats st;
+		ldmsd_deadband_stats_get(strgp->deadband, &st);
+		rc = linebuf_printf(reqc, ",\"deadband\":{"
+				"\"spec\":\"%s\","
+				"\"heartbeat\":%" PRIu64 ","
+				"\"series\":%" PRIu64 ","
+				"\"stored\":%" PRIu64 ","
+				"\"suppressed\":%" PRIu64 ","
+				"\"unchanged\":%" PRIu64 ","
+				"\"heartbeats\":%" PRIu64 "}",
+				st.spec, st.heartbeat, st.series, st.stored,
+				st.suppressed, st.unchanged, st.heartbeats);
+		if (rc)
+			goto out;
+	}
+	rc = linebuf_printf(reqc, "}");
 out:
 	ldmsd_strgp_unlock(strgp);
 	return rc;
 }
 
+static int __strgp_status_page_fn(ldmsd_req_ctxt_t reqc, ldmsd_cfgobj_t obj,
+				  struct status_page *pg)
+{
+	int rc;
+	if (!__status_page_take(pg))
+		return 0;
+	rc = __strgp_status_json_obj(reqc, (ldmsd_strgp_t)obj, pg->count - 1);
+	if (rc)
+		return rc;
+	return __status_page_mark(pg, obj->name, NULL);
+}
+
 static int strgp_status_handler(ldmsd_req_ctxt_t reqc)
 {
 	int rc = 0;
 	size_t cnt = 0;
-	struct ldmsd_req_attr_s attr;
+	struct status_page pg;
 	char *name;
 	ldmsd_strgp_t strgp = NULL;
-	int strgp_cnt;
 
 	reqc->errcode = 0;
 	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
@@ -2533,73 +3068,171 @@ static int strgp_status_handler(ldmsd_req_ctxt_t reqc)
 				"strgp '%s' doesn't exist.", name);
 			reqc->errcode = ENOENT;
 			ldmsd_send_req_response(reqc, reqc->line_buf);
+			free(name);
 			return 0;
 		}
 	}
-
-	/* Construct the json object of the strgp(s) */
-	if (strgp) {
-		rc = __strgp_status_json_obj(reqc, strgp, 0);
-	} else {
-		strgp_cnt = 0;
-		ldmsd_cfg_lock(LDMSD_CFGOBJ_STRGP);
-		for (strgp = ldmsd_strgp_first(); strgp;
-			strgp = ldmsd_strgp_next(strgp)) {
-			rc = __strgp_status_json_obj(reqc, strgp, strgp_cnt);
-			if (rc) {
-				ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
-				goto out;
-			}
-			strgp_cnt++;
-		}
-		ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
+	if (__status_page_init(reqc, &pg)) {
+		ldmsd_send_req_response(reqc, reqc->line_buf);
+		goto out;
+	}
+	pg.binary = 0;
+
+	/* Construct the json object of the strgp(s) */
+	if (strgp)
+		rc = __strgp_status_json_obj(reqc, strgp, 0);
+	else
+		rc = __status_page_walk(reqc, &pg, LDMSD_CFGOBJ_STRGP,
+					__strgp_status_page_fn);
+	if (rc)
+		goto out;
+	rc = __status_page_reply(reqc, &pg);
+out:
+	__status_page_free(&pg);
+	if (name)
+		free(name);
+	if (strgp)
+		ldmsd_strgp_put(strgp);
+	return rc;
+}
+
+/*
+ * Parse a strgp_history time given in seconds since the epoch, or
+ * relative to now if it is negative.
+ */
+static int __history_time(const char *str, uint64_t now, uint64_t *usec)
+{
+	char *end;
+	double v = strtod(str, &end);
+
+	if (end == str || *end != '\0')
+		return EINVAL;
+	if (v < 0)
+		v = (double)now / 1000000 + v;
+	if (v < 0)
+		v = 0;
+	*usec = v * 1000000;
+	return 0;
+}
+
+static int strgp_history_handler(ldmsd_req_ctxt_t reqc)
+{
+	char *name, *instance, *metric, *begin_s, *end_s, *attr_name;
+	struct ldmsd_req_attr_s attr;
+	ldmsd_strgp_t strgp = NULL;
+	regex_t regex;
+	int has_regex = 0;
+	uint64_t begin = 0, end = UINT64_MAX, now;
+	struct timeval tv;
+	char *buf = NULL;
+	size_t len;
+	int rc = 0;
+
+	reqc->errcode = 0;
+	instance = metric = begin_s = end_s = NULL;
+	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
+	if (!name) {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The attribute 'name' is required by strgp_history.");
+		goto send_reply;
+	}
+	instance = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_INSTANCE);
+	metric = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_METRIC);
+	begin_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_BEGIN);
+	end_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_END);
+
+	gettimeofday(&tv, NULL);
+	now = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	attr_name = "begin";
+	if (begin_s && __history_time(begin_s, now, &begin))
+		goto einval;
+	attr_name = "end";
+	if (end_s && __history_time(end_s, now, &end))
+		goto einval;
+	if (instance) {
+		reqc->errcode = ldmsd_compile_regex(&regex, instance,
+					reqc->line_buf, reqc->line_len);
+		if (reqc->errcode)
+			goto send_reply;
+		has_regex = 1;
+	}
+
+	strgp = ldmsd_strgp_find(name);
+	if (!strgp) {
+		reqc->errcode = ENOENT;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The storage policy '%s' does not exist.", name);
+		goto send_reply;
+	}
+	if (!strgp->history) {
+		reqc->errcode = ENOENT;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The storage policy '%s' does not keep a history.",
+			 name);
+		goto send_reply;
+	}
+	reqc->errcode = ldmsd_history_query(strgp->history,
+					    has_regex ? &regex : NULL,
+					    metric, begin, end, &buf, &len);
+	if (reqc->errcode == ENOENT) {
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The metrics '%s' are not in the history.", metric);
+		goto send_reply;
+	} else if (reqc->errcode) {
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "Memory allocation failed.");
+		goto send_reply;
 	}
-	cnt = reqc->line_off + 2; /* +2 for '[' and ']' */
 
-	/* Send the json attribute header */
 	attr.discrim = 1;
-	attr.attr_len = cnt;
-	attr.attr_id = LDMSD_ATTR_JSON;
+	attr.attr_id = LDMSD_ATTR_BINARY;
+	attr.attr_len = len;
 	ldmsd_hton_req_attr(&attr);
-	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F);
-	if (rc)
-		goto out;
-
-	/* Send the json object */
-	rc = ldmsd_append_reply(reqc, "[", 1, 0);
+	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr),
+				LDMSD_REQ_SOM_F);
 	if (rc)
 		goto out;
-	if (reqc->line_off) {
-		rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
-		if (rc)
-			goto out;
-	}
-	rc = ldmsd_append_reply(reqc, "]", 1, 0);
+	rc = ldmsd_append_reply(reqc, buf, len, 0);
 	if (rc)
 		goto out;
-
-	/* Send the terminating attribute */
 	attr.discrim = 0;
 	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim, sizeof(uint32_t),
-								LDMSD_REQ_EOM_F);
+				LDMSD_REQ_EOM_F);
+	goto out;
+
+einval:
+	reqc->errcode = EINVAL;
+	Snprintf(&reqc->line_buf, &reqc->line_len,
+		 "Invalid '%s' time, expecting seconds since the epoch.",
+		 attr_name);
+send_reply:
+	ldmsd_send_req_response(reqc, reqc->line_buf);
 out:
-	if (name)
-		free(name);
 	if (strgp)
 		ldmsd_strgp_put(strgp);
+	if (has_regex)
+		regfree(&regex);
+	free(buf);
+	free(name);
+	free(instance);
+	free(metric);
+	free(begin_s);
+	free(end_s);
 	return rc;
 }
 
 static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *name, *offset_str, *interval_str, *push, *auto_interval, *attr_name;
-	name = offset_str = interval_str = push = auto_interval = NULL;
+	char *cond;
+	name = offset_str = interval_str = push = auto_interval = cond = NULL;
 	size_t cnt = 0;
 	uid_t uid;
 	gid_t gid;
 	int perm;
 	char *perm_s = NULL;
-	int push_flags, is_auto_task;
+	int push_flags, is_auto_task, is_cond;
 
 	reqc->errcode = 0;
 
@@ -2632,6 +3265,7 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 	offset_str = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_OFFSET);
 	push = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_PUSH);
 	auto_interval = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_AUTO_INTERVAL);
+	cond = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_CONDITIONAL);
 
 	struct ldmsd_sec_ctxt sctxt;
 	if (reqc->xprt->xprt) {
@@ -2642,6 +3276,19 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 	uid = sctxt.crd.uid;
 	gid = sctxt.crd.gid;
 
+	is_cond = 0;
+	if (cond) {
+		if (0 == strcasecmp(cond, "true")) {
+			is_cond = 1;
+		} else if (0 != strcasecmp(cond, "false")) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "The conditional option requires "
+				       "either 'true', or 'false'\n");
+			goto send_reply;
+		}
+	}
+
 	perm = 0770;
 	perm_s = ldmsd_req_attr_str_value_get_by_name(reqc, "perm");
 	if (perm_s)
@@ -2703,6 +3350,8 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
 				       "The updtr could not be created.");
 		}
+	} else {
+		updtr->is_cond = is_cond;
 	}
 
 send_reply:
@@ -2713,6 +3362,8 @@ send_reply:
 		free(interval_str);
 	if (auto_interval)
 		free(auto_interval);
+	if (cond)
+		free(cond);
 	if (offset_str)
 		free(offset_str);
 	if (push)
@@ -3186,7 +3837,8 @@ int __updtr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_updtr_t updtr,
 		updtr->default_task.sched.intrvl_us,
 		default_offset,
 		((updtr->default_task.task_flags==LDMSD_TASK_F_SYNCHRONOUS)?"true":"false"),
-		update_mode(updtr->push_flags),
+		(updtr->is_cond ? "Conditional" :
+				  update_mode(updtr->push_flags)),
 		ldmsd_updtr_state_str(updtr->state));
 	if (rc)
 		goto out;
@@ -3357,13 +4009,30 @@ out:
 	return rc;
 }
 
+static int __updtr_task_page_fn(ldmsd_req_ctxt_t reqc, ldmsd_cfgobj_t obj,
+				struct status_page *pg)
+{
+	int rc;
+	if (!__status_page_take(pg))
+		return 0;
+	if (pg->count > 1) {
+		rc = linebuf_printf(reqc, ",\n");
+		if (rc)
+			return rc;
+	}
+	rc = __updtr_task_tree_json_obj(reqc, (ldmsd_updtr_t)obj);
+	if (rc)
+		return rc;
+	return __status_page_mark(pg, obj->name, NULL);
+}
+
 static int updtr_task_status_handler(ldmsd_req_ctxt_t reqc)
 {
-	int rc, updtr_count;
+	int rc;
 	size_t cnt = 0;
 	char *name;
+	struct status_page pg;
 	ldmsd_updtr_t updtr = NULL;
-	struct ldmsd_req_attr_s attr;
 
 	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
 	if (name) {
@@ -3372,60 +4041,32 @@ static int updtr_task_status_handler(ldmsd_req_ctxt_t reqc)
 			cnt = snprintf(reqc->line_buf, reqc->line_len, "updtr '%s' not found", name);
 			ldmsd_send_error_reply(reqc->xprt, reqc->rec_no, ENOENT,
 							reqc->line_buf, cnt);
+			free(name);
 			return 0;
 		}
-		rc = __updtr_task_tree_json_obj(reqc, updtr);
-		if (rc)
-			goto err;
-	} else {
-		updtr_count = 0;
-		ldmsd_cfg_lock(LDMSD_CFGOBJ_UPDTR);
-		for (updtr = ldmsd_updtr_first(); updtr; updtr = ldmsd_updtr_next(updtr)) {
-			if (updtr_count) {
-				rc = linebuf_printf(reqc, ",\n");
-				if (rc) {
-					ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
-					goto err;
-				}
-			}
-			rc = __updtr_task_tree_json_obj(reqc, updtr);
-			if (rc) {
-				ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
-				goto err;
-			}
-			updtr_count += 1;
-		}
-		ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
 	}
-	cnt = reqc->line_off + 2; /* +2 for the [ and ]. */
-
-	attr.discrim = 1;
-	attr.attr_len = cnt;
-	attr.attr_id = LDMSD_ATTR_JSON;
-	ldmsd_hton_req_attr(&attr);
-	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F);
-	if (rc)
-		goto err;
+	if (__status_page_init(reqc, &pg)) {
+		ldmsd_send_req_response(reqc, reqc->line_buf);
+		rc = 0;
+		goto out;
+	}
+	pg.binary = 0;
 
-	rc = ldmsd_append_reply(reqc, "[", 1, 0);
-	if (rc)
-		goto err;
-	rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
-	if (rc)
-		goto err;
-	rc = ldmsd_append_reply(reqc, "]", 1, 0);
+	if (updtr)
+		rc = __updtr_task_tree_json_obj(reqc, updtr);
+	else
+		rc = __status_page_walk(reqc, &pg, LDMSD_CFGOBJ_UPDTR,
+					__updtr_task_page_fn);
 	if (rc)
 		goto err;
-
-	attr.discrim = 0;
-	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim,
-				sizeof(uint32_t), LDMSD_REQ_EOM_F);
+	rc = __status_page_reply(reqc, &pg);
 	goto out;
 
 err:
 	ldmsd_send_error_reply(reqc->xprt, reqc->rec_no, rc,
 						"internal error", 15);
 out:
+	__status_page_free(&pg);
 	if (name)
 		free(name);
 	if (updtr)
@@ -4565,6 +5206,287 @@ out:
 	return 0;
 }
 
+extern int ldmsd_shm_set_add(const char *shm_name, const char *producer,
+		char *errstr, size_t errsz, ldmsd_sec_ctxt_t sctxt);
+static int shm_set_add_handler(ldmsd_req_ctxt_t reqc)
+{
+	char *name, *producer;
+	struct ldmsd_sec_ctxt sctxt;
+
+	reqc->errcode = 0;
+	producer = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_PRODUCER);
+	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
+	if (!name) {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The attribute 'name' is required.");
+		goto out;
+	}
+
+	ldmsd_req_ctxt_sec_get(reqc, &sctxt);
+	reqc->errcode = ldmsd_shm_set_add(name, producer, reqc->line_buf,
+					  reqc->line_len, &sctxt);
+out:
+	ldmsd_send_req_response(reqc, reqc->line_buf);
+	if (name)
+		free(name);
+	if (producer)
+		free(producer);
+	return 0;
+}
+
+extern int ldmsd_shm_set_del(const char *shm_name, char *errstr, size_t errsz,
+		ldmsd_sec_ctxt_t sctxt);
+static int shm_set_del_handler(ldmsd_req_ctxt_t reqc)
+{
+	char *name;
+	struct ldmsd_sec_ctxt sctxt;
+
+	reqc->errcode = 0;
+	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
+	if (!name) {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The attribute 'name' is required.");
+		goto out;
+	}
+
+	ldmsd_req_ctxt_sec_get(reqc, &sctxt);
+	reqc->errcode = ldmsd_shm_set_del(name, reqc->line_buf, reqc->line_len,
+					  &sctxt);
+out:
+	ldmsd_send_req_response(reqc, reqc->line_buf);
+	if (name)
+		free(name);
+	return 0;
+}
+
+static struct ldmsd_updt_stats __updt_stats_zero;
+
+static int __updt_stats_json(ldmsd_req_ctxt_t reqc, struct status_page *pg,
+			     const char *type, const char *name,
+			     const char *prdcr_name, ldmsd_updt_stats_t st)
+{
+	ldmsd_hist_t h;
+	int i, b, n, rc;
+
+	if (!st)
+		st = &__updt_stats_zero;
+	rc = linebuf_printf(reqc, "%s{\"name\":\"%s\",\"type\":\"%s\"",
+			    (pg->count > 1 ? ",\n" : ""), name, type);
+	if (rc)
+		return rc;
+	if (prdcr_name) {
+		rc = linebuf_printf(reqc, ",\"producer\":\"%s\"", prdcr_name);
+		if (rc)
+			return rc;
+	}
+	for (i = 0; i < LDMSD_UPDT_CNT_LAST; i++) {
+		rc = linebuf_printf(reqc, ",\"%s\":%" PRIu64,
+				    ldmsd_updt_cnt_str(i), st->cnt[i]);
+		if (rc)
+			return rc;
+	}
+	for (i = 0; i < LDMSD_UPDT_STAT_LAST; i++) {
+		h = &st->hist[i];
+		rc = linebuf_printf(reqc, ",\"%s\":{\"count\":%" PRIu64 ","
+				"\"avg_usec\":%" PRIu64 ","
+				"\"max_usec\":%" PRIu64 ","
+				"\"p50_usec\":%" PRIu64 ","
+				"\"p90_usec\":%" PRIu64 ","
+				"\"p99_usec\":%" PRIu64 ","
+				"\"buckets\":[",
+				ldmsd_updt_stat_str(i), h->count,
+				(h->count ? h->sum / h->count : 0), h->max,
+				ldmsd_hist_percentile(h, 0.50),
+				ldmsd_hist_percentile(h, 0.90),
+				ldmsd_hist_percentile(h, 0.99));
+		if (rc)
+			return rc;
+		/* only the non-empty buckets as [lower bound, count] */
+		for (b = n = 0; b < LDMSD_HIST_BUCKETS; b++) {
+			if (!h->bucket[b])
+				continue;
+			rc = linebuf_printf(reqc, "%s[%" PRIu64 ",%" PRIu64 "]",
+					    (n++ ? "," : ""),
+					    ldmsd_hist_bucket_lo(b),
+					    h->bucket[b]);
+			if (rc)
+				return rc;
+		}
+		rc = linebuf_printf(reqc, "]}");
+		if (rc)
+			return rc;
+	}
+	return linebuf_printf(reqc, "}");
+}
+
+static int __prdcr_updt_stats_page_fn(ldmsd_req_ctxt_t reqc,
+				      ldmsd_cfgobj_t obj,
+				      struct status_page *pg)
+{
+	ldmsd_prdcr_t prdcr = (ldmsd_prdcr_t)obj;
+	int rc;
+
+	if (!__status_page_take(pg))
+		return 0;
+	ldmsd_prdcr_lock(prdcr);
+	rc = __updt_stats_json(reqc, pg, "prdcr", obj->name, NULL,
+			       prdcr->updt_stats);
+	ldmsd_prdcr_unlock(prdcr);
+	if (rc)
+		return rc;
+	return __status_page_mark(pg, obj->name, NULL);
+}
+
+static int __updtr_updt_stats_page_fn(ldmsd_req_ctxt_t reqc,
+				      ldmsd_cfgobj_t obj,
+				      struct status_page *pg)
+{
+	ldmsd_updtr_t updtr = (ldmsd_updtr_t)obj;
+	ldmsd_updt_stats_t st;
+	int rc;
+
+	if (!__status_page_take(pg))
+		return 0;
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		return ENOMEM;
+	ldmsd_updtr_lock(updtr);
+	ldmsd_updt_stats_updtr(updtr, st);
+	ldmsd_updtr_unlock(updtr);
+	rc = __updt_stats_json(reqc, pg, "updtr", obj->name, NULL, st);
+	free(st);
+	if (rc)
+		return rc;
+	return __status_page_mark(pg, obj->name, NULL);
+}
+
+static int __set_updt_stats_page_fn(ldmsd_req_ctxt_t reqc,
+				    ldmsd_cfgobj_t obj,
+				    struct status_page *pg)
+{
+	ldmsd_prdcr_t prdcr = (ldmsd_prdcr_t)obj;
+	ldmsd_prdcr_set_t prd_set;
+	int rc = 0;
+
+	ldmsd_prdcr_lock(prdcr);
+	for (prd_set = ldmsd_prdcr_set_next_by_name(prdcr, pg->after_set);
+	     prd_set; prd_set = ldmsd_prdcr_set_next(prd_set)) {
+		if (pg->instance && 0 != strcmp(pg->instance, prd_set->inst_name))
+			continue;
+		if (!__status_page_take(pg))
+			break;
+		rc = __updt_stats_json(reqc, pg, "set", prd_set->inst_name,
+				       obj->name, prd_set->updt_stats);
+		if (rc)
+			break;
+		rc = __status_page_mark(pg, obj->name, prd_set->inst_name);
+		if (rc)
+			break;
+	}
+	ldmsd_prdcr_unlock(prdcr);
+	return rc;
+}
+
+static int update_stats_handler(ldmsd_req_ctxt_t reqc)
+{
+	struct status_page pg;
+	ldmsd_cfgobj_type_t cfg_type = LDMSD_CFGOBJ_PRDCR;
+	status_obj_fn_t fn = __prdcr_updt_stats_page_fn;
+	char *type;
+	int rc = 0;
+
+	reqc->errcode = 0;
+	type = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_TYPE);
+	if (__status_page_init(reqc, &pg))
+		goto err;
+	if (pg.binary) {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The format 'binary' is not supported.");
+		goto err;
+	}
+	if (!type || 0 == strcmp(type, "prdcr")) {
+		/* default */
+	} else if (0 == strcmp(type, "updtr")) {
+		cfg_type = LDMSD_CFGOBJ_UPDTR;
+		fn = __updtr_updt_stats_page_fn;
+	} else if (0 == strcmp(type, "set")) {
+		fn = __set_updt_stats_page_fn;
+		pg.instance = ldmsd_req_attr_str_value_get_by_id(reqc,
+							LDMSD_ATTR_INSTANCE);
+	} else {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "The type '%s' is invalid.", type);
+		goto err;
+	}
+	rc = __status_page_walk(reqc, &pg, cfg_type, fn);
+	if (rc) {
+		reqc->errcode = rc;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "Error %d formatting the statistics.", rc);
+		goto err;
+	}
+	rc = __status_page_reply(reqc, &pg);
+	goto out;
+err:
+	reqc->line_off = 0;
+	ldmsd_send_req_response(reqc, reqc->line_buf);
+	rc = 0;
+out:
+	__status_page_free(&pg);
+	free(type);
+	return rc;
+}
+
+static int update_stats_config_handler(ldmsd_req_ctxt_t reqc)
+{
+	char *state, *interval_s, *endptr;
+	long interval_us = 1000000;
+	int enable;
+
+	reqc->errcode = 0;
+	interval_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_INTERVAL);
+	state = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_STATE);
+	if (!state) {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The attribute 'state' is required.");
+		goto out;
+	}
+	if (0 == strcasecmp(state, "on")) {
+		enable = 1;
+	} else if (0 == strcasecmp(state, "off")) {
+		enable = 0;
+	} else {
+		reqc->errcode = EINVAL;
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The state '%s' is invalid.", state);
+		goto out;
+	}
+	if (interval_s) {
+		interval_us = strtol(interval_s, &endptr, 0);
+		if (*endptr != '\0' || interval_us < 0) {
+			reqc->errcode = EINVAL;
+			Snprintf(&reqc->line_buf, &reqc->line_len,
+				 "The interval '%s' is invalid.", interval_s);
+			goto out;
+		}
+	}
+	reqc->errcode = ldmsd_updt_stats_config(enable, interval_us);
+	if (reqc->errcode)
+		Snprintf(&reqc->line_buf, &reqc->line_len,
+			 "Error %d configuring the update statistics.",
+			 reqc->errcode);
+out:
+	ldmsd_send_req_response(reqc, reqc->line_buf);
+	free(state);
+	free(interval_s);
+	return 0;
+}
+
 static int verbosity_change_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *level_s = NULL;
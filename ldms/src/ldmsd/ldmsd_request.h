@@ -70,6 +70,7 @@ enum ldmsd_request {
 	LDMSD_PRDCR_SET_REQ,
 	LDMSD_PRDCR_HINT_TREE_REQ,
 	LDMSD_PRDCR_SUBSCRIBE_REQ,
+	LDMSD_PRDCR_CONN_CONFIG_REQ,
 	LDMSD_STRGP_ADD_REQ = 0x200,
 	LDMSD_STRGP_DEL_REQ,
 	LDMSD_STRGP_START_REQ,
@@ -79,6 +80,7 @@ enum ldmsd_request {
 	LDMSD_STRGP_PRDCR_DEL_REQ,
 	LDMSD_STRGP_METRIC_ADD_REQ,
 	LDMSD_STRGP_METRIC_DEL_REQ,
+	LDMSD_STRGP_HISTORY_REQ,
 	LDMSD_UPDTR_ADD_REQ = 0x300,
 	LDMSD_UPDTR_DEL_REQ,
 	LDMSD_UPDTR_START_REQ,
@@ -115,6 +117,10 @@ enum ldmsd_request {
 	LDMSD_EXIT_DAEMON_REQ,
 	LDMSD_RECORD_LEN_ADVICE_REQ,
 	LDMSD_SET_ROUTE_REQ,
+	LDMSD_SHM_SET_ADD_REQ,
+	LDMSD_SHM_SET_DEL_REQ,
+	LDMSD_UPDATE_STATS_REQ,
+	LDMSD_UPDATE_STATS_CONFIG_REQ,
 
 	/* failover requests by user */
 	LDMSD_FAILOVER_CONFIG_REQ = 0x700, /* "failover_config" user command */
@@ -131,6 +137,7 @@ enum ldmsd_request {
 	LDMSD_FAILOVER_CFGSTRGP_REQ, /* internal strgp failover config */
 	LDMSD_FAILOVER_PING_REQ, /* ping message over REQ protocol */
 	LDMSD_FAILOVER_PEERCFG_REQ, /* request peer cfg */
+	LDMSD_FAILOVER_CFGDIFF_REQ, /* peer cfg changes since the snapshot */
 
 	/* additional failover requests by user */
 	LDMSD_FAILOVER_START_REQ = 0x770, /* start the failover service */
@@ -187,11 +194,65 @@ enum ldmsd_request_attr {
 	LDMSD_ATTR_UID,
 	LDMSD_ATTR_GID,
 	LDMSD_ATTR_STREAM,
+	LDMSD_ATTR_LIMIT,
+	LDMSD_ATTR_CURSOR,
+	LDMSD_ATTR_STATE,
+	LDMSD_ATTR_FORMAT,
+	LDMSD_ATTR_BINARY,
+	LDMSD_ATTR_HISTORY,
+	LDMSD_ATTR_BEGIN,
+	LDMSD_ATTR_END,
+	LDMSD_ATTR_RATE,
+	LDMSD_ATTR_BACKOFF_MAX,
+	LDMSD_ATTR_CONDITIONAL,
+	LDMSD_ATTR_DOWNSAMPLE,
+	LDMSD_ATTR_DOWNSAMPLE_OP,
+	LDMSD_ATTR_DEADBAND,
+	LDMSD_ATTR_HEARTBEAT,
 	LDMSD_ATTR_LAST,
 };
 
 #define LDMSD_RECORD_MARKER 0xffffffff
 
+/*
+ * The format=binary encoding of a prdcr_set_status entry. The reply is an
+ * LDMSD_ATTR_BINARY attribute holding the records back to back. Integers
+ * are in network byte order; the instance, schema, origin and producer
+ * names follow the fixed part, in that order, each NUL-terminated.
+ */
+#pragma pack(push, 1)
+struct ldmsd_prdcr_set_status_rec {
+	uint32_t rec_len;	/* Record length including the names */
+	uint32_t state;		/* enum ldmsd_prdcr_set_state */
+	uint32_t ts_sec;	/* Last transaction timestamp */
+	uint32_t ts_usec;
+	uint32_t dur_sec;	/* Last transaction duration */
+	uint32_t dur_usec;
+	char names[OVIS_FLEX];
+};
+#pragma pack(pop)
+
+/*
+ * The strgp_history reply is an LDMSD_ATTR_BINARY attribute holding the
+ * header below, then for each metric its enum ldms_value_type and its
+ * name, then for each series its instance name, its row count, the row
+ * timestamps in microseconds and a column of 64-bit values per metric.
+ * Names are a uint32_t length including the terminating NUL followed by
+ * the string. All integers are in network byte order; the integer
+ * metrics are widened to 64 bits and the floating point metrics are the
+ * bits of a double.
+ */
+#define LDMSD_HISTORY_MAGIC 0x4c485354 /* "LHST" */
+#define LDMSD_HISTORY_VERSION 1
+#pragma pack(push, 1)
+struct ldmsd_history_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t metric_count;
+	uint32_t series_count;
+};
+#pragma pack(pop)
+
 #define LDMSD_REQ_SOM_F	1 /* start of message */
 #define LDMSD_REQ_EOM_F	2 /* end of message */
 
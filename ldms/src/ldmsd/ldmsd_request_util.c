@@ -84,6 +84,7 @@ const struct req_str_id req_str_id_table[] = {
 	{  "plugn_sets",         LDMSD_PLUGN_SETS_REQ  },
 	{  "plugn_status",       LDMSD_PLUGN_STATUS_REQ  },
 	{  "prdcr_add",          LDMSD_PRDCR_ADD_REQ  },
+	{  "prdcr_conn_config",  LDMSD_PRDCR_CONN_CONFIG_REQ  },
 	{  "prdcr_del",          LDMSD_PRDCR_DEL_REQ  },
 	{  "prdcr_hint_tree",    LDMSD_PRDCR_HINT_TREE_REQ  },
 	{  "prdcr_set_status",   LDMSD_PRDCR_SET_REQ  },
@@ -98,10 +99,13 @@ const struct req_str_id req_str_id_table[] = {
 	{  "setgroup_del",       LDMSD_SETGROUP_DEL_REQ  },
 	{  "setgroup_ins",       LDMSD_SETGROUP_INS_REQ  },
 	{  "setgroup_rm",        LDMSD_SETGROUP_RM_REQ  },
+	{  "shm_set_add",        LDMSD_SHM_SET_ADD_REQ  },
+	{  "shm_set_del",        LDMSD_SHM_SET_DEL_REQ  },
 	{  "start",              LDMSD_PLUGN_START_REQ  },
 	{  "stop",               LDMSD_PLUGN_STOP_REQ  },
 	{  "strgp_add",          LDMSD_STRGP_ADD_REQ  },
 	{  "strgp_del",          LDMSD_STRGP_DEL_REQ  },
+	{  "strgp_history",      LDMSD_STRGP_HISTORY_REQ  },
 	{  "strgp_metric_add",   LDMSD_STRGP_METRIC_ADD_REQ  },
 	{  "strgp_metric_del",   LDMSD_STRGP_METRIC_DEL_REQ  },
 	{  "strgp_prdcr_add",    LDMSD_STRGP_PRDCR_ADD_REQ  },
@@ -112,6 +116,8 @@ const struct req_str_id req_str_id_table[] = {
 	{  "term",               LDMSD_PLUGN_TERM_REQ  },
 	{  "udata",              LDMSD_SET_UDATA_REQ  },
 	{  "udata_regex",        LDMSD_SET_UDATA_REGEX_REQ  },
+	{  "update_stats",       LDMSD_UPDATE_STATS_REQ  },
+	{  "update_stats_config", LDMSD_UPDATE_STATS_CONFIG_REQ  },
 	{  "updtr_add",          LDMSD_UPDTR_ADD_REQ  },
 	{  "updtr_del",          LDMSD_UPDTR_DEL_REQ  },
 	{  "updtr_match_add",    LDMSD_UPDTR_MATCH_ADD_REQ  },
@@ -130,15 +136,27 @@ const struct req_str_id req_str_id_table[] = {
 const struct req_str_id attr_str_id_table[] = {
 	{  "auto_interval",     LDMSD_ATTR_AUTO_INTERVAL  },
 	{  "auto_switch",       LDMSD_ATTR_AUTO_SWITCH  },
+	{  "backoff_max",       LDMSD_ATTR_BACKOFF_MAX  },
 	{  "base",              LDMSD_ATTR_BASE  },
+	{  "begin",             LDMSD_ATTR_BEGIN  },
+	{  "conditional",       LDMSD_ATTR_CONDITIONAL  },
 	{  "container",         LDMSD_ATTR_CONTAINER  },
+	{  "cursor",            LDMSD_ATTR_CURSOR  },
+	{  "deadband",          LDMSD_ATTR_DEADBAND  },
+	{  "downsample",        LDMSD_ATTR_DOWNSAMPLE  },
+	{  "downsample_op",     LDMSD_ATTR_DOWNSAMPLE_OP  },
+	{  "end",               LDMSD_ATTR_END  },
+	{  "format",            LDMSD_ATTR_FORMAT  },
 	{  "gid",               LDMSD_ATTR_GID  },
+	{  "heartbeat",         LDMSD_ATTR_HEARTBEAT  },
+	{  "history",           LDMSD_ATTR_HISTORY  },
 	{  "host",              LDMSD_ATTR_HOST  },
 	{  "incr",              LDMSD_ATTR_INCREMENT  },
 	{  "instance",          LDMSD_ATTR_INSTANCE  },
 	{  "interval",          LDMSD_ATTR_INTERVAL  },
 	{  "interval_us",       LDMSD_ATTR_INTERVAL  },
 	{  "level",             LDMSD_ATTR_LEVEL  },
+	{  "limit",             LDMSD_ATTR_LIMIT  },
 	{  "match",             LDMSD_ATTR_MATCH  },
 	{  "metric",            LDMSD_ATTR_METRIC  },
 	{  "name",              LDMSD_ATTR_NAME  },
@@ -150,8 +168,10 @@ const struct req_str_id attr_str_id_table[] = {
 	{  "port",              LDMSD_ATTR_PORT  },
 	{  "producer",          LDMSD_ATTR_PRODUCER  },
 	{  "push",              LDMSD_ATTR_PUSH  },
+	{  "rate",              LDMSD_ATTR_RATE  },
 	{  "regex",             LDMSD_ATTR_REGEX  },
 	{  "schema",            LDMSD_ATTR_SCHEMA  },
+	{  "state",             LDMSD_ATTR_STATE  },
 	{  "stream",            LDMSD_ATTR_STREAM  },
 	{  "string",            LDMSD_ATTR_STRING  },
 	{  "test",              LDMSD_ATTR_TEST  },
@@ -206,6 +226,7 @@ const char *ldmsd_req_id2str(enum ldmsd_request req_id)
 	case LDMSD_PRDCR_SET_REQ         : return "PRDCR_SET_REQ";
 	case LDMSD_PRDCR_HINT_TREE_REQ   : return "PRDCR_HINT_TREE_REQ";
 	case LDMSD_PRDCR_SUBSCRIBE_REQ   : return "PRDCR_SUBSCRIBE_REQ";
+	case LDMSD_PRDCR_CONN_CONFIG_REQ : return "PRDCR_CONN_CONFIG_REQ";
 
 	case LDMSD_STRGP_ADD_REQ        : return "STRGP_ADD_REQ";
 	case LDMSD_STRGP_DEL_REQ        : return "STRGP_DEL_REQ";
@@ -216,6 +237,7 @@ const char *ldmsd_req_id2str(enum ldmsd_request req_id)
 	case LDMSD_STRGP_PRDCR_DEL_REQ  : return "STRGP_PRDCR_DEL_REQ";
 	case LDMSD_STRGP_METRIC_ADD_REQ : return "STRGP_METRIC_ADD_REQ";
 	case LDMSD_STRGP_METRIC_DEL_REQ : return "STRGP_METRIC_DEL_REQ";
+	case LDMSD_STRGP_HISTORY_REQ : return "STRGP_HISTORY_REQ";
 
 	case LDMSD_UPDTR_ADD_REQ       : return "UPDTR_ADD_REQ";
 	case LDMSD_UPDTR_DEL_REQ       : return "UPDTR_DEL_REQ";
@@ -256,6 +278,10 @@ const char *ldmsd_req_id2str(enum ldmsd_request req_id)
 	case LDMSD_EXIT_DAEMON_REQ       : return "EXIT_DAEMON_REQ";
 	case LDMSD_RECORD_LEN_ADVICE_REQ : return "RECORD_LEN_ADVICE_REQ";
 	case LDMSD_SET_ROUTE_REQ         : return "SET_ROUTE_REQ";
+	case LDMSD_SHM_SET_ADD_REQ       : return "SHM_SET_ADD_REQ";
+	case LDMSD_SHM_SET_DEL_REQ       : return "SHM_SET_DEL_REQ";
+	case LDMSD_UPDATE_STATS_REQ      : return "UPDATE_STATS_REQ";
+	case LDMSD_UPDATE_STATS_CONFIG_REQ : return "UPDATE_STATS_CONFIG_REQ";
 
 	/* failover requests by user */
 	case LDMSD_FAILOVER_CONFIG_REQ        : return "FAILOVER_CONFIG_REQ";
@@ -272,6 +298,7 @@ const char *ldmsd_req_id2str(enum ldmsd_request req_id)
 	case LDMSD_FAILOVER_CFGSTRGP_REQ  : return "FAILOVER_CFGSTRGP_REQ";
 	case LDMSD_FAILOVER_PING_REQ      : return "FAILOVER_PING_REQ";
 	case LDMSD_FAILOVER_PEERCFG_REQ   : return "FAILOVER_PEERCFG_REQ";
+	case LDMSD_FAILOVER_CFGDIFF_REQ   : return "FAILOVER_CFGDIFF_REQ";
 
 	/* additional failover requests by user */
 	case LDMSD_FAILOVER_START_REQ : return "FAILOVER_START_REQ";
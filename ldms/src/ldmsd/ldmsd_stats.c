@@ -0,0 +1,443 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Update latency statistics
+ *
+ * The update path records into the histograms of the producer set and of
+ * its producer with atomic operations only, so the statistics can stay on
+ * in production. The updater view is merged from the producer sets on
+ * request. When the publishing interval is set, every producer also gets a
+ * "<daemon name>/update_stats/<producer name>" set that is refreshed at
+ * that interval so that the statistics can be aggregated like any other
+ * metric set.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "ldmsd.h"
+
+#define UPDT_STATS_SCHEMA_NAME "ldmsd_update_stats"
+
+int ldmsd_updt_stats_enabled;
+
+static pthread_mutex_t updt_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ldmsd_task updt_stats_task;
+static int updt_stats_task_init;
+static long updt_stats_interval;
+static ldms_schema_t updt_stats_schema;
+static int bucket_lo_mid;
+static int hist_mid[LDMSD_UPDT_STAT_LAST][4]; /* count, sum, max, buckets */
+static int cnt_mid[LDMSD_UPDT_CNT_LAST];
+
+static const char *updt_stat_str[] = {
+	[LDMSD_UPDT_STAT_UPDATE]	= "update",
+	[LDMSD_UPDT_STAT_STORE]		= "store",
+	[LDMSD_UPDT_STAT_PUSH_LAG]	= "push_lag",
+};
+
+static const char *updt_cnt_str[] = {
+	[LDMSD_UPDT_CNT_OVERSAMPLED]	= "oversampled",
+	[LDMSD_UPDT_CNT_INCONSISTENT]	= "inconsistent",
+	[LDMSD_UPDT_CNT_SKIPPED]	= "skipped",
+	[LDMSD_UPDT_CNT_ERROR]		= "errors",
+	[LDMSD_UPDT_CNT_NOT_MODIFIED]	= "not_modified",
+	[LDMSD_UPDT_CNT_BYTES_AVOIDED]	= "bytes_avoided",
+};
+
+const char *ldmsd_updt_stat_str(enum ldmsd_updt_stat stat)
+{
+	return updt_stat_str[stat];
+}
+
+const char *ldmsd_updt_cnt_str(enum ldmsd_updt_cnt cnt)
+{
+	return updt_cnt_str[cnt];
+}
+
+int ldmsd_hist_bucket(uint64_t usec)
+{
+	int msb, b;
+	if (usec < (1 << LDMSD_HIST_SUB_BITS))
+		return usec;
+	msb = 63 - __builtin_clzll(usec);
+	b = ((msb - LDMSD_HIST_SUB_BITS + 1) << LDMSD_HIST_SUB_BITS) +
+	    ((usec >> (msb - LDMSD_HIST_SUB_BITS)) &
+	     ((1 << LDMSD_HIST_SUB_BITS) - 1));
+	if (b >= LDMSD_HIST_BUCKETS)
+		b = LDMSD_HIST_BUCKETS - 1;
+	return b;
+}
+
+uint64_t ldmsd_hist_bucket_lo(int bucket)
+{
+	int msb, sub;
+	if (bucket < (1 << LDMSD_HIST_SUB_BITS))
+		return bucket;
+	msb = (bucket >> LDMSD_HIST_SUB_BITS) + LDMSD_HIST_SUB_BITS - 1;
+	sub = bucket & ((1 << LDMSD_HIST_SUB_BITS) - 1);
+	return ((uint64_t)(1 << LDMSD_HIST_SUB_BITS) + sub) <<
+					(msb - LDMSD_HIST_SUB_BITS);
+}
+
+/*
+ * Returns the upper bound of the bucket holding the \c p quantile, capped
+ * at the maximum.
+ */
+uint64_t ldmsd_hist_percentile(ldmsd_hist_t h, double p)
+{
+	uint64_t total = 0, rank, sum = 0, hi;
+	int b;
+
+	for (b = 0; b < LDMSD_HIST_BUCKETS; b++)
+		total += h->bucket[b];
+	if (!total)
+		return 0;
+	rank = p * total;
+	if (rank < 1)
+		rank = 1;
+	for (b = 0; b < LDMSD_HIST_BUCKETS - 1; b++) {
+		sum += h->bucket[b];
+		if (sum < rank)
+			continue;
+		hi = ldmsd_hist_bucket_lo(b + 1);
+		return (hi < h->max ? hi : h->max);
+	}
+	return h->max;
+}
+
+static void __hist_add(ldmsd_hist_t h, uint64_t usec)
+{
+	uint64_t max;
+
+	__sync_fetch_and_add(&h->bucket[ldmsd_hist_bucket(usec)], 1);
+	__sync_fetch_and_add(&h->count, 1);
+	__sync_fetch_and_add(&h->sum, usec);
+	max = h->max;
+	while (usec > max) {
+		if (__sync_bool_compare_and_swap(&h->max, max, usec))
+			break;
+		max = h->max;
+	}
+}
+
+static ldmsd_updt_stats_t __updt_stats_get(ldmsd_updt_stats_t *p)
+{
+	ldmsd_updt_stats_t st = *p;
+	if (st)
+		return st;
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(p, NULL, st)) {
+		/* somebody else got there first */
+		free(st);
+		st = *p;
+	}
+	return st;
+}
+
+void ldmsd_updt_stats_add(ldmsd_prdcr_set_t prd_set, enum ldmsd_updt_stat stat,
+			  uint64_t usec)
+{
+	ldmsd_updt_stats_t st;
+	if (!ldmsd_updt_stats_enabled)
+		return;
+	st = __updt_stats_get(&prd_set->updt_stats);
+	if (st)
+		__hist_add(&st->hist[stat], usec);
+	st = __updt_stats_get(&prd_set->prdcr->updt_stats);
+	if (st)
+		__hist_add(&st->hist[stat], usec);
+}
+
+void ldmsd_updt_stats_cnt_add(ldmsd_prdcr_set_t prd_set,
+			      enum ldmsd_updt_cnt cnt, uint64_t n)
+{
+	ldmsd_updt_stats_t st;
+	if (!ldmsd_updt_stats_enabled)
+		return;
+	st = __updt_stats_get(&prd_set->updt_stats);
+	if (st)
+		__sync_fetch_and_add(&st->cnt[cnt], n);
+	st = __updt_stats_get(&prd_set->prdcr->updt_stats);
+	if (st)
+		__sync_fetch_and_add(&st->cnt[cnt], n);
+}
+
+void ldmsd_updt_stats_inc(ldmsd_prdcr_set_t prd_set, enum ldmsd_updt_cnt cnt)
+{
+	ldmsd_updt_stats_cnt_add(prd_set, cnt, 1);
+}
+
+void ldmsd_updt_stats_merge(ldmsd_updt_stats_t dst, ldmsd_updt_stats_t src)
+{
+	ldmsd_hist_t d, s;
+	int i, b;
+
+	for (i = 0; i < LDMSD_UPDT_STAT_LAST; i++) {
+		d = &dst->hist[i];
+		s = &src->hist[i];
+		d->count += s->count;
+		d->sum += s->sum;
+		if (d->max < s->max)
+			d->max = s->max;
+		for (b = 0; b < LDMSD_HIST_BUCKETS; b++)
+			d->bucket[b] += s->bucket[b];
+	}
+	for (i = 0; i < LDMSD_UPDT_CNT_LAST; i++)
+		dst->cnt[i] += src->cnt[i];
+}
+
+static int __updtr_set_match(ldmsd_updtr_t updtr, ldmsd_prdcr_set_t prd_set)
+{
+	ldmsd_name_match_t match;
+	const char *str;
+
+	match = ldmsd_updtr_match_first(updtr);
+	if (!match)
+		return 1;
+	for (; match; match = ldmsd_updtr_match_next(match)) {
+		if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
+			str = prd_set->inst_name;
+		else
+			str = prd_set->schema_name;
+		if (str && 0 == regexec(&match->regex, str, 0, NULL, 0))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Sum the statistics of the sets updated by \c updtr into \c dst. The
+ * caller must hold the updater lock.
+ */
+void ldmsd_updt_stats_updtr(ldmsd_updtr_t updtr, ldmsd_updt_stats_t dst)
+{
+	ldmsd_prdcr_ref_t ref;
+	ldmsd_prdcr_set_t prd_set;
+
+	for (ref = ldmsd_updtr_prdcr_first(updtr); ref;
+	     ref = ldmsd_updtr_prdcr_next(ref)) {
+		ldmsd_prdcr_lock(ref->prdcr);
+		for (prd_set = ldmsd_prdcr_set_first(ref->prdcr); prd_set;
+		     prd_set = ldmsd_prdcr_set_next(prd_set)) {
+			if (prd_set->updt_stats &&
+			    __updtr_set_match(updtr, prd_set))
+				ldmsd_updt_stats_merge(dst, prd_set->updt_stats);
+		}
+		ldmsd_prdcr_unlock(ref->prdcr);
+	}
+}
+
+static int __updt_stats_schema_new()
+{
+	char name[64];
+	ldms_schema_t schema;
+	int i, j, mid;
+	static const char *hist_fmt[] = {
+		"%s_count", "%s_sum_usec", "%s_max_usec", "%s_hist"
+	};
+
+	schema = ldms_schema_new(UPDT_STATS_SCHEMA_NAME);
+	if (!schema)
+		return ENOMEM;
+	mid = ldms_schema_meta_array_add(schema, "bucket_lo_usec",
+					 LDMS_V_U64_ARRAY, LDMSD_HIST_BUCKETS);
+	if (mid < 0)
+		goto err;
+	bucket_lo_mid = mid;
+	for (i = 0; i < LDMSD_UPDT_STAT_LAST; i++) {
+		for (j = 0; j < 4; j++) {
+			snprintf(name, sizeof(name), hist_fmt[j],
+				 updt_stat_str[i]);
+			if (j < 3)
+				mid = ldms_schema_metric_add(schema, name,
+							     LDMS_V_U64);
+			else
+				mid = ldms_schema_metric_array_add(schema, name,
+						LDMS_V_U64_ARRAY,
+						LDMSD_HIST_BUCKETS);
+			if (mid < 0)
+				goto err;
+			hist_mid[i][j] = mid;
+		}
+	}
+	for (i = 0; i < LDMSD_UPDT_CNT_LAST; i++) {
+		mid = ldms_schema_metric_add(schema, updt_cnt_str[i],
+					     LDMS_V_U64);
+		if (mid < 0)
+			goto err;
+		cnt_mid[i] = mid;
+	}
+	updt_stats_schema = schema;
+	return 0;
+err:
+	ldms_schema_delete(schema);
+	return -mid;
+}
+
+static ldms_set_t __updt_stats_set_new(ldmsd_prdcr_t prdcr)
+{
+	char name[512];
+	ldms_set_t set;
+	int b;
+
+	snprintf(name, sizeof(name), "%s/update_stats/%s",
+		 ldmsd_myname_get(), prdcr->obj.name);
+	set = ldms_set_new(name, updt_stats_schema);
+	if (!set) {
+		ldmsd_log(LDMSD_LERROR, "Cannot create the update statistics "
+			  "set '%s', error %d\n", name, errno);
+		return NULL;
+	}
+	ldms_set_producer_name_set(set, ldmsd_myname_get());
+	for (b = 0; b < LDMSD_HIST_BUCKETS; b++)
+		ldms_metric_array_set_u64(set, bucket_lo_mid, b,
+					  ldmsd_hist_bucket_lo(b));
+	ldms_set_publish(set);
+	return set;
+}
+
+static void __updt_stats_set_update(ldms_set_t set, ldmsd_updt_stats_t st)
+{
+	ldmsd_hist_t h;
+	int i, b;
+
+	ldms_transaction_begin(set);
+	for (i = 0; i < LDMSD_UPDT_STAT_LAST; i++) {
+		h = &st->hist[i];
+		ldms_metric_set_u64(set, hist_mid[i][0], h->count);
+		ldms_metric_set_u64(set, hist_mid[i][1], h->sum);
+		ldms_metric_set_u64(set, hist_mid[i][2], h->max);
+		for (b = 0; b < LDMSD_HIST_BUCKETS; b++)
+			ldms_metric_array_set_u64(set, hist_mid[i][3], b,
+						  h->bucket[b]);
+	}
+	for (i = 0; i < LDMSD_UPDT_CNT_LAST; i++)
+		ldms_metric_set_u64(set, cnt_mid[i], st->cnt[i]);
+	ldms_transaction_end(set);
+}
+
+static void __updt_stats_set_del(ldmsd_prdcr_t prdcr)
+{
+	/* prdcr->lock is held */
+	if (!prdcr->updt_stats_set)
+		return;
+	ldms_set_unpublish(prdcr->updt_stats_set);
+	ldms_set_delete(prdcr->updt_stats_set);
+	prdcr->updt_stats_set = NULL;
+}
+
+static void __updt_stats_task(ldmsd_task_t task, void *arg)
+{
+	ldmsd_prdcr_t prdcr;
+
+	ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
+	for (prdcr = ldmsd_prdcr_first(); prdcr;
+	     prdcr = ldmsd_prdcr_next(prdcr)) {
+		ldmsd_prdcr_lock(prdcr);
+		if (!prdcr->updt_stats_set)
+			prdcr->updt_stats_set = __updt_stats_set_new(prdcr);
+		if (prdcr->updt_stats_set && prdcr->updt_stats)
+			__updt_stats_set_update(prdcr->updt_stats_set,
+						prdcr->updt_stats);
+		ldmsd_prdcr_unlock(prdcr);
+	}
+	ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+}
+
+int ldmsd_updt_stats_config(int enable, long interval_us)
+{
+	ldmsd_prdcr_t prdcr;
+	int rc = 0;
+
+	pthread_mutex_lock(&updt_stats_lock);
+	if (updt_stats_interval) {
+		/* stop publishing */
+		ldmsd_task_stop(&updt_stats_task);
+		ldmsd_task_join(&updt_stats_task);
+		updt_stats_interval = 0;
+		ldmsd_cfg_lock(LDMSD_CFGOBJ_PRDCR);
+		for (prdcr = ldmsd_prdcr_first(); prdcr;
+		     prdcr = ldmsd_prdcr_next(prdcr)) {
+			ldmsd_prdcr_lock(prdcr);
+			__updt_stats_set_del(prdcr);
+			ldmsd_prdcr_unlock(prdcr);
+		}
+		ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+	}
+	ldmsd_updt_stats_enabled = enable;
+	if (!enable || !interval_us)
+		goto out;
+	if (!updt_stats_schema) {
+		rc = __updt_stats_schema_new();
+		if (rc)
+			goto out;
+	}
+	if (!updt_stats_task_init) {
+		ldmsd_task_init(&updt_stats_task);
+		updt_stats_task_init = 1;
+	}
+	rc = ldmsd_task_start(&updt_stats_task, __updt_stats_task, NULL,
+			      0, interval_us, 0);
+	if (!rc)
+		updt_stats_interval = interval_us;
+out:
+	pthread_mutex_unlock(&updt_stats_lock);
+	return rc;
+}
+
+void ldmsd_updt_stats_prdcr_del(ldmsd_prdcr_t prdcr)
+{
+	__updt_stats_set_del(prdcr);
+	free(prdcr->updt_stats);
+	prdcr->updt_stats = NULL;
+}
@@ -91,19 +91,73 @@ void ldmsd_strgp___del(ldmsd_cfgobj_t obj)
 	}
 	if (strgp->plugin_name)
 		free(strgp->plugin_name);
+	if (strgp->history)
+		ldmsd_history_free(strgp->history);
+	if (strgp->downsample)
+		ldmsd_downsample_free(strgp->downsample);
+	if (strgp->deadband)
+		ldmsd_deadband_free(strgp->deadband);
 	ldmsd_cfgobj___del(obj);
 }
 
+static ldmsd_strgp_ref_t strgp_ref_find(ldmsd_prdcr_set_t prd_set, ldmsd_strgp_t strgp);
+static void strgp_store(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set,
+			ldms_set_t set)
+{
+	ldmsd_strgp_ref_t ref;
+
+	if (strgp->deadband &&
+	    !ldmsd_deadband_pass(strgp->deadband, set, strgp->metric_arry,
+				 strgp->metric_count))
+		return;
+	if (prd_set && strgp->store->store_ctxt) {
+		ref = strgp_ref_find(prd_set, strgp);
+		if (ref) {
+			strgp->store->store_ctxt(strgp->store_handle, set,
+						 strgp->metric_arry,
+						 strgp->metric_count,
+						 &ref->store_ctxt);
+			return;
+		}
+	}
+	strgp->store->store(strgp->store_handle, set,
+			    strgp->metric_arry, strgp->metric_count);
+}
+
+struct strgp_emit_arg {
+	ldmsd_strgp_t strgp;
+	ldmsd_prdcr_set_t prd_set;
+};
+
+static void strgp_downsample_emit(ldms_set_t row, int current, void *arg)
+{
+	struct strgp_emit_arg *ea = arg;
+	/* the store context is of the producer set being updated */
+	strgp_store(ea->strgp, current ? ea->prd_set : NULL, row);
+}
+
 static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 {
+	struct strgp_emit_arg ea;
+
 	if (strgp->state != LDMSD_STRGP_STATE_RUNNING)
 		return;
 	if (!strgp->store_handle) {
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		return;
 	}
-	strgp->store->store(strgp->store_handle, prd_set->set,
-			    strgp->metric_arry, strgp->metric_count);
+	if (strgp->history)
+		ldmsd_history_add(strgp->history, prd_set->set,
+				  strgp->metric_arry, strgp->metric_count);
+	if (strgp->downsample) {
+		ea.strgp = strgp;
+		ea.prd_set = prd_set;
+		ldmsd_downsample_add(strgp->downsample, prd_set->set,
+				     strgp->metric_arry, strgp->metric_count,
+				     strgp_downsample_emit, &ea);
+		return;
+	}
+	strgp_store(strgp, prd_set, prd_set->set);
 }
 
 ldmsd_strgp_t
@@ -376,6 +430,16 @@ static ldmsd_strgp_ref_t strgp_ref_find(ldmsd_prdcr_set_t prd_set, ldmsd_strgp_t
 
 static void strgp_close(ldmsd_strgp_t strgp)
 {
+	struct strgp_emit_arg ea;
+
+	if (strgp->downsample && strgp->store_handle) {
+		ea.strgp = strgp;
+		ea.prd_set = NULL;
+		ldmsd_downsample_flush(strgp->downsample,
+				       strgp_downsample_emit, &ea);
+	}
+	if (strgp->deadband)
+		ldmsd_deadband_reset(strgp->deadband);
 	if (strgp->store) {
 		if (strgp->store_handle)
 			ldmsd_store_close(strgp->store, strgp->store_handle);
@@ -231,6 +231,48 @@ static void updtr_task_set_reset(ldmsd_updtr_task_t task)
 	task->set_count = 0;
 }
 
+static inline uint64_t __tv_usec(struct timeval *end, struct timeval *start)
+{
+	struct timeval tv;
+	if (timercmp(end, start, <))
+		return 0;
+	timersub(end, start, &tv);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Caller must hold prd_set->lock; prd_set->updt_end is set. */
+static void __updt_stats_record(ldmsd_prdcr_set_t prd_set, ldms_set_t set,
+				int status)
+{
+	struct ldms_timestamp ts;
+	struct timeval sample;
+
+	if (LDMS_UPD_ERROR(status)) {
+		ldmsd_updt_stats_inc(prd_set, LDMSD_UPDT_CNT_ERROR);
+		return;
+	}
+	if (status & LDMS_UPD_F_PUSH) {
+		ts = ldms_transaction_timestamp_get(set);
+		sample.tv_sec = ts.sec;
+		sample.tv_usec = ts.usec;
+		ldmsd_updt_stats_add(prd_set, LDMSD_UPDT_STAT_PUSH_LAG,
+				     __tv_usec(&prd_set->updt_end, &sample));
+	} else {
+		ldmsd_updt_stats_add(prd_set, LDMSD_UPDT_STAT_UPDATE,
+				     __tv_usec(&prd_set->updt_end,
+					       &prd_set->updt_start));
+	}
+	if (status & LDMS_UPD_F_NOT_MODIFIED) {
+		ldmsd_updt_stats_inc(prd_set, LDMSD_UPDT_CNT_NOT_MODIFIED);
+		ldmsd_updt_stats_cnt_add(prd_set, LDMSD_UPDT_CNT_BYTES_AVOIDED,
+					 ldms_set_data_sz_get(set) -
+					 sizeof(struct ldms_data_hdr));
+	} else if (!ldms_set_is_consistent(set))
+		ldmsd_updt_stats_inc(prd_set, LDMSD_UPDT_CNT_INCONSISTENT);
+	else if (prd_set->last_gn == ldms_set_data_gn_get(set))
+		ldmsd_updt_stats_inc(prd_set, LDMSD_UPDT_CNT_OVERSAMPLED);
+}
+
 static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 {
 	uint64_t gn;
@@ -247,6 +289,8 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 	errcode = LDMS_UPD_ERROR(status);
 	ldmsd_log(LDMSD_LDEBUG, "Update complete for Set %s with status %#x\n",
 					prd_set->inst_name, status);
+	if (ldmsd_updt_stats_enabled)
+		__updt_stats_record(prd_set, set, status);
 	if (errcode) {
 		char *op_s;
 		if (0 == (status & LDMS_UPD_F_PUSH))
@@ -259,6 +303,12 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 		goto out;
 	}
 
+	if (status & LDMS_UPD_F_NOT_MODIFIED) {
+		ldmsd_log(LDMSD_LDEBUG, "Set %s not modified.\n",
+			  prd_set->inst_name);
+		goto set_ready;
+	}
+
 	if (!ldms_set_is_consistent(set)) {
 		ldmsd_log(LDMSD_LINFO, "Set %s is inconsistent.\n", prd_set->inst_name);
 		goto set_ready;
@@ -280,6 +330,12 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 		strgp->update_fn(strgp, prd_set);
 		ldmsd_strgp_unlock(strgp);
 	}
+	if (ldmsd_updt_stats_enabled && !LIST_EMPTY(&prd_set->strgp_list)) {
+		struct timeval store_end;
+		gettimeofday(&store_end, NULL);
+		ldmsd_updt_stats_add(prd_set, LDMSD_UPDT_STAT_STORE,
+				     __tv_usec(&store_end, &prd_set->updt_end));
+	}
 set_ready:
 	if ((status & LDMS_UPD_F_MORE) == 0)
 		/* No more data pending move prdcr_set state UPDATING --> READY */
@@ -332,20 +388,243 @@ __grp_iter_cb(ldms_set_t grp, const char *name, void *arg)
 
 static void prdset_lookup_cb(ldms_t xprt, enum ldms_lookup_status status,
 			     int more, ldms_set_t set, void *arg);
+
+struct __grp_resolve_ctxt {
+	ldmsd_prdcr_set_t grp;
+	ldmsd_prdcr_set_t *members;
+	int card;
+	int alloc;
+	int missing;
+};
+
+static int
+__grp_resolve_cb(ldms_set_t grp, const char *name, void *arg)
+{
+	struct __grp_resolve_ctxt *ctxt = arg;
+	ldmsd_prdcr_set_t pset, *members;
+
+	pset = ldmsd_prdcr_set_find(ctxt->grp->prdcr, name);
+	if (!pset) {
+		/* No DIR_ADD for the member yet */
+		ctxt->missing++;
+		return 0;
+	}
+	if (ctxt->card == ctxt->alloc) {
+		ctxt->alloc = ctxt->alloc ? 2 * ctxt->alloc : 64;
+		members = realloc(ctxt->members,
+				  ctxt->alloc * sizeof(*members));
+		if (!members)
+			return ENOMEM;
+		ctxt->members = members;
+	}
+	ldmsd_prdcr_set_ref_get(pset);
+	ctxt->members[ctxt->card++] = pset;
+	return 0;
+}
+
+/*
+ * Resolve the member names of the group into producer sets. This is
+ * only done when the membership generation has changed, or when some
+ * members were not known at the last resolution. The caller holds the
+ * producer lock.
+ */
+static int __setgrp_resolve(ldmsd_prdcr_set_t grp)
+{
+	struct __grp_resolve_ctxt ctxt = { .grp = grp };
+	uint64_t gn;
+	int rc;
+
+	gn = ldmsd_group_gn_get(grp->set);
+	rc = ldmsd_group_iter(grp->set, __grp_resolve_cb, &ctxt);
+	if (rc) {
+		while (ctxt.card)
+			ldmsd_prdcr_set_ref_put(ctxt.members[--ctxt.card]);
+		free(ctxt.members);
+		return rc;
+	}
+	ldmsd_prdcr_set_grp_release(grp);
+	grp->grp_members = ctxt.members;
+	grp->grp_card = ctxt.card;
+	/* Try again on the next update if some members are missing */
+	grp->grp_gn = ctxt.missing ? 0 : gn;
+	ldmsd_log(LDMSD_LDEBUG, "Set group %s: %d members, %d missing\n",
+		  grp->inst_name, ctxt.card, ctxt.missing);
+	return 0;
+}
+
+struct __grp_update_ctxt {
+	ldmsd_prdcr_set_t grp;
+	uint64_t *gn;
+	ldms_set_t *sets;
+	ldmsd_prdcr_set_t *psets;
+};
+
+static void __setgrp_update_done(ldmsd_prdcr_set_t grp)
+{
+	pthread_mutex_lock(&grp->lock);
+	grp->state = LDMSD_PRDCR_SET_STATE_READY;
+	pthread_mutex_unlock(&grp->lock);
+#ifdef LDMSD_UPDATE_TIME
+	__updt_time_put(grp->updt_time);
+#endif
+	/* Put the reference taken in schedule_set_updates() */
+	ldmsd_prdcr_set_ref_put(grp);
+}
+
+static void __setgrp_update_cb(ldms_set_t *sets, int *status, int count,
+			       void *arg)
+{
+	struct __grp_update_ctxt *uctxt = arg;
+	int i;
+
+	for (i = 0; i < count; i++)
+		updtr_update_cb(NULL, sets[i], status[i], uctxt->psets[i]);
+	__setgrp_update_done(uctxt->grp);
+	free(uctxt);
+}
+
+/*
+ * Update the members of a set group in one batch. The group itself has
+ * no metrics and is not read. The caller holds the producer lock and a
+ * reference on the group that is put back when the batch completes.
+ */
+static int __setgrp_update(ldmsd_prdcr_set_t grp, ldmsd_updtr_t updtr)
+{
+	struct __grp_update_ctxt *uctxt;
+	ldmsd_prdcr_set_t pset;
+	int i, n, rc;
+
+	if (grp->grp_gn != ldmsd_group_gn_get(grp->set)) {
+		rc = __setgrp_resolve(grp);
+		if (rc)
+			goto err;
+	}
+	if (!grp->grp_card)
+		goto done;
+	uctxt = malloc(sizeof(*uctxt) + grp->grp_card *
+		       (sizeof(*uctxt->gn) + sizeof(*uctxt->sets) +
+			sizeof(*uctxt->psets)));
+	if (!uctxt) {
+		rc = ENOMEM;
+		goto err;
+	}
+	uctxt->grp = grp;
+	uctxt->gn = (void *)&uctxt[1];
+	uctxt->sets = (void *)&uctxt->gn[grp->grp_card];
+	uctxt->psets = (void *)&uctxt->sets[grp->grp_card];
+	n = 0;
+	for (i = 0; i < grp->grp_card; i++) {
+		pset = grp->grp_members[i];
+		switch (pset->state) {
+		case LDMSD_PRDCR_SET_STATE_READY:
+			break;
+		case LDMSD_PRDCR_SET_STATE_START:
+			if (pset != ldmsd_prdcr_set_find(grp->prdcr,
+							 pset->inst_name)) {
+				/* Deleted since the group was resolved */
+				grp->grp_gn = 0;
+				continue;
+			}
+			/*
+			 * The lookup callback of the set group was received
+			 * before the DIR_ADD of this member, do the lookup
+			 * here.
+			 */
+			ldmsd_prdcr_set_ref_get(pset);
+			pset->state = LDMSD_PRDCR_SET_STATE_LOOKUP;
+			rc = ldms_xprt_lookup(grp->prdcr->xprt, pset->inst_name,
+					      LDMS_LOOKUP_BY_INSTANCE,
+					      prdset_lookup_cb, pset);
+			if (rc) {
+				ldmsd_log(LDMSD_LINFO, "Synchronous error %d "
+					  "from ldms_lookup\n", rc);
+				pset->state = LDMSD_PRDCR_SET_STATE_START;
+				ldmsd_prdcr_set_ref_put(pset);
+			}
+			continue;
+		default:
+			/* Not ready or updated on its own */
+			continue;
+		}
+		pset->state = LDMSD_PRDCR_SET_STATE_UPDATING;
+		ldmsd_prdcr_set_ref_get(pset); /* put back in updtr_update_cb */
+		gettimeofday(&pset->updt_start, NULL);
+#ifdef LDMSD_UPDATE_TIME
+		__updt_time_get(pset->updt_time);
+		if (pset->updt_time->update_start.tv_sec == 0)
+			pset->updt_time->update_start = pset->updt_start;
+#endif
+		if (ldms_set_array_card_get(pset->set) > 1) {
+			/*
+			 * The batch reports only the last buffer of a set
+			 * array; update it on its own so that every buffer
+			 * is stored.
+			 */
+			if (updtr->is_cond && pset->last_gn)
+				rc = ldms_xprt_update_cond(pset->set,
+							   pset->last_gn,
+							   updtr_update_cb,
+							   pset);
+			else
+				rc = ldms_xprt_update(pset->set,
+						      updtr_update_cb, pset);
+			if (rc) {
+				ldmsd_log(LDMSD_LINFO, "Synchronous error %d: "
+					  "Updating Set %s\n", rc,
+					  pset->inst_name);
+#ifdef LDMSD_UPDATE_TIME
+				__updt_time_put(pset->updt_time);
+#endif
+				pset->state = LDMSD_PRDCR_SET_STATE_READY;
+				ldmsd_prdcr_set_ref_put(pset);
+			}
+			continue;
+		}
+		uctxt->gn[n] = updtr->is_cond ? pset->last_gn : 0;
+		uctxt->sets[n] = pset->set;
+		uctxt->psets[n] = pset;
+		n++;
+	}
+	if (!n) {
+		free(uctxt);
+		goto done;
+	}
+	ldmsd_log(LDMSD_LDEBUG, "Set group %s: updating %d of %d members\n",
+		  grp->inst_name, n, grp->grp_card);
+	rc = ldms_xprt_update_batch(uctxt->sets, uctxt->gn, n,
+				    __setgrp_update_cb, uctxt);
+	if (rc) {
+		for (i = 0; i < n; i++) {
+			pset = uctxt->psets[i];
+#ifdef LDMSD_UPDATE_TIME
+			__updt_time_put(pset->updt_time);
+#endif
+			pset->state = LDMSD_PRDCR_SET_STATE_READY;
+			ldmsd_prdcr_set_ref_put(pset);
+		}
+		free(uctxt);
+		goto err;
+	}
+	return 0;
+done:
+	__setgrp_update_done(grp);
+	return 0;
+err:
+	/* The caller puts the group reference */
+	grp->state = LDMSD_PRDCR_SET_STATE_READY;
+	return rc;
+}
+
 static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t task)
 {
 	int rc = 0;
 	int flags;
 	char *op_s;
-	ldmsd_prdcr_set_t pset;
 	ldmsd_updtr_t updtr = task->updtr;
-	struct ldmsd_group_traverse_ctxt ctxt;
 	/* The reference will be put back in update_cb */
 	ldmsd_log(LDMSD_LDEBUG, "Schedule an update for set %s\n",
 					prd_set->inst_name);
 	int push_flags = 0;
-	struct str_list_ent_s *ent;
-	LIST_INIT(&ctxt.str_list);
 	gettimeofday(&prd_set->updt_start, NULL);
 #ifdef LDMSD_UPDATE_TIME
 	__updt_time_get(prd_set->updt_time);
@@ -358,45 +637,11 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 		ldmsd_prdcr_set_ref_get(prd_set);
 		flags = ldmsd_group_check(prd_set->set);
 		if (flags & LDMSD_GROUP_IS_GROUP) {
-			/* This is a group */
-			ctxt.prdcr = prd_set->prdcr;
-			ctxt.updtr = updtr;
-			ctxt.task = task;
-			/* __grp_iter_cb() will populate ctxt.str_list */
-			rc = ldmsd_group_iter(prd_set->set,
-					      __grp_iter_cb, &ctxt);
-			if (rc)
-				goto out;
-			LIST_FOREACH(ent, &ctxt.str_list, entry) {
-				pset = ldmsd_prdcr_set_find(prd_set->prdcr, ent->str);
-				if (!pset)
-					continue; /* It is OK. Try again next iteration */
-				if (pset->state == LDMSD_PRDCR_SET_STATE_START) {
-					/*
-					 * The lookup callback of the setgroup
-					 * is received before the DIR_ADD
-					 * of this set member (pset).
-					 *
-					 * Thus, do the lookup here.
-					 */
-					rc = ldms_xprt_lookup(pset->prdcr->xprt,
-							pset->inst_name,
-							LDMS_LOOKUP_BY_INSTANCE,
-							prdset_lookup_cb, pset);
-					if (rc)
-						goto out;
-				}
-				if (pset->state != LDMSD_PRDCR_SET_STATE_READY)
-					continue; /* It is OK. The set might not be ready */
-				rc = schedule_set_updates(pset, task);
-				if (rc)
-					goto out;
-			}
-			prd_set->state = LDMSD_PRDCR_SET_STATE_READY;
-			/*
-			 * No metrics in the setgroup, so
-			 * do not update the setgroup.
-			 */
+			rc = __setgrp_update(prd_set, updtr);
+		} else if (updtr->is_cond && prd_set->last_gn) {
+			rc = ldms_xprt_update_cond(prd_set->set,
+						   prd_set->last_gn,
+						   updtr_update_cb, prd_set);
 		} else {
 			rc = ldms_xprt_update(prd_set->set, updtr_update_cb, prd_set);
 		}
@@ -420,11 +665,6 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 			prd_set->push_flags |= LDMSD_PRDCR_SET_F_PUSH_REG;
 		}
 	}
-out:
-	while ((ent = LIST_FIRST(&ctxt.str_list))) {
-		LIST_REMOVE(ent, entry);
-		free(ent);
-	}
 	if (rc) {
 #ifdef LDMSD_UPDATE_TIME
 		__updt_time_put(prd_set->updt_time);
@@ -640,6 +880,7 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 			ldmsd_log(LDMSD_LINFO, "%s: Set %s: "
 				"there is an outstanding update.\n",
 				__func__, prd_set->inst_name);
+			ldmsd_updt_stats_inc(prd_set, LDMSD_UPDT_CNT_SKIPPED);
 		default:
 			goto next_prd_set;
 		}
@@ -1422,6 +1663,10 @@ int ldmsd_updtr_prdcr_add(const char *updtr_name, const char *prdcr_regex,
 	for (prdcr = ldmsd_prdcr_first(); prdcr; prdcr = ldmsd_prdcr_next(prdcr)) {
 		if (regexec(&regex, prdcr->obj.name, 0, NULL, 0))
 			continue;
+		/* the peer producers are managed by the failover service */
+		if (cfgobj_is_failover(&prdcr->obj) &&
+		    !cfgobj_is_failover(&updtr->obj))
+			continue;
 		/* See if this match is already in the list */
 		ldmsd_prdcr_ref_t ref = prdcr_ref_find(updtr, prdcr->obj.name);
 		if (ref)
@@ -54,6 +54,7 @@
 #define _GNU_SOURCE
 #include <inttypes.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/errno.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -64,7 +65,6 @@
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
-#include <semaphore.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include "ldms.h"
@@ -87,15 +87,23 @@ static int jobid_index=1, appid_index=2; /* will lookup for better init */
 static int shmem_fd; /** file descriptor for shmem **/
 static struct stat shmem_stat;
 static shmem_header_t *shmem_header; /** pointer to beginning of shmem **/
-static void *shmem_data; /** pointer to this process' shmem data segment **/
-static int shmem_pmid; /** index into process metadata array **/
 static char *shmem_name = "/shm_ldmsapp"; /** shared memory name **/
-static char *sem_name = "/sem_ldmsapp"; /** ldmsapp_mutex name **/
-static sem_t *ldmsapp_mutex; /** mutex for accessing shmem **/
-static int last_process_sampled = 0; /** index of last process sampled **/
+static void *proc_copy; /** private copy of the process data being sampled **/
+
+/*
+ * Each active process slot is published as its own set, named
+ * <instance>/<pid>. The set goes away when the process finalizes.
+ */
+static struct appinfo_proc {
+	ldms_set_t set;
+	int process_id;
+} procs[MAX_PROCESSES];
+
+/* Copy attempts before accepting a copy that overlapped an update */
+#define APPINFO_COPY_RETRY 8
 
 /* Internal forward prototypes */
-static int sample_proc_metric(app_metric_t *metric, int id);
+static int sample_proc_metric(ldms_set_t pset, app_metric_t *metric, int id);
 static int create_shmem_data(ldms_set_t set);
 
 /**
@@ -253,7 +261,8 @@ static const char *usage(struct ldmsd_plugin *self)
 		"		appname	The application name\n"
 		"		jobid		The jobid\n"
 		"		username	The username\n"
-		"	sname		Optional schema name. Defaults to '" SAMP "'\n";
+		"	sname		Optional schema name. Defaults to '" SAMP "'\n"
+		"	Each reporting process is published as the set <inst_name>/<pid>.\n";
 }
 
 /**
@@ -272,7 +281,6 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 	char *metrics_str;
 	/* initialize as failed */
 	shmem_header = MAP_FAILED;
-	ldmsapp_mutex = SEM_FAILED;
 	shmem_fd = -1;
 	msglog(LDMSD_LDEBUG, SAMP ": Begin configuring.\n");
 
@@ -310,19 +318,6 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 
 	msglog(LDMSD_LDEBUG, SAMP ": Configuring shared memory.\n");
 
-	/* create shared memory semaphore, fail if error */
-	ldmsapp_mutex = sem_open(sem_name, O_CREAT, 0666, 1);
-	if (ldmsapp_mutex == SEM_FAILED) {
-		msglog(LDMSD_LERROR, SAMP ": Semaphore open error: %s\n",
-			strerror(errno));
-		goto err;
-	}
-
-	/* Reset the lock to 1 -- JEC: why? in case it existed... */
-	while (sem_trywait(ldmsapp_mutex) >= 0)
-		;
-	sem_post(ldmsapp_mutex);
-
 	/* open shared memory segment */
 	shmem_fd = shm_open(shmem_name, O_CREAT|O_RDWR, 0666);
 	if (shmem_fd == -1) {
@@ -332,8 +327,8 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 	}
 	/* Set size of shared memory segment */
 	/* This is just the max possible size, for now; must fix */
-	rc = ftruncate(shmem_fd, sizeof(shmem_header_t) +
-			MAX_PROCESSES*MAX_METRICS*(sizeof(app_metric_t)+256));
+	rc = ftruncate(shmem_fd, sizeof(shmem_header_t) + MAX_PROCESSES *
+			SHMEM_ALIGN(MAX_METRICS*(sizeof(app_metric_t)+256)));
 	/* Get stats (size) of shared memory segment and check */
 	if (fstat(shmem_fd, &shmem_stat) == -1) {
 		msglog(LDMSD_LERROR, SAMP ": Shmem stat error: %s\n",
@@ -358,6 +353,11 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 	/* Now set up all the sampler-specified data in shared memory */
 	actual_shmem_size = create_shmem_data(set);
 	/* TODO do another ftruncate here to shrink shmem to actual size */
+	proc_copy = malloc(shmem_header->data_block_size);
+	if (!proc_copy) {
+		rc = ENOMEM;
+		goto err;
+	}
 
 	/* BACK to regular config stuff here */
 
@@ -367,7 +367,6 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 	/* cleanup any successful progress that might have happened */
 	if (shmem_header != MAP_FAILED) munmap(shmem_header,shmem_stat.st_size);
 	if (shmem_fd != -1) close(shmem_fd);
-	if (ldmsapp_mutex != SEM_FAILED) sem_close(ldmsapp_mutex);
 	/* normal sampler cleanup */
 	base_del(base);
 	/* TODO delete metric set if created? */
@@ -383,72 +382,154 @@ static ldms_set_t get_set(struct ldmsd_sampler *self)
 }
 
 /**
- * Sample data. In the appinfo sampler, we need to find in the shared
- * memory the next process data structure that is ready for sampling,
- * copy it into the metric set, and mark it as sampled.
+ * Create and publish the set of the process in slot \c p.
+ **/
+static int proc_set_new(struct appinfo_proc *p, int pid)
+{
+	char name[512];
+	int rc;
+
+	snprintf(name, sizeof(name), "%s/%d", base->instance_name, pid);
+	p->set = ldms_set_new(name, base->schema);
+	if (!p->set)
+		return errno;
+	ldms_set_producer_name_set(p->set, base->producer_name);
+	ldms_metric_set_u64(p->set, BASE_COMPONENT_ID, base->component_id);
+	ldms_set_config_auth(p->set, base->uid, base->gid, base->perm);
+	rc = ldms_set_publish(p->set);
+	if (rc) {
+		ldms_set_delete(p->set);
+		p->set = NULL;
+		return rc;
+	}
+	ldmsd_set_register(p->set, base->pi_name);
+	p->process_id = pid;
+	return 0;
+}
+
+static void proc_set_delete(struct appinfo_proc *p)
+{
+	ldmsd_set_deregister(ldms_set_instance_name_get(p->set),
+			     base->pi_name);
+	ldms_set_unpublish(p->set);
+	ldms_set_delete(p->set);
+	p->set = NULL;
+	p->process_id = 0;
+}
+
+/**
+ * Free the slot \c pm of a process that exited without finalizing, as
+ * the finalize of the process would have.
+ **/
+static void proc_slot_reclaim(shmem_proc_t *pm)
+{
+	int pid = pm->process_id;
+
+	pm->app_id = 0;
+	pm->job_id = 0;
+	pm->process_id = 0;
+	pm->rank_id = 0;
+	__sync_fetch_and_sub(&shmem_header->num_registered, 1);
+	__sync_synchronize();
+	if (__sync_bool_compare_and_swap(&pm->status, ACTIVE, AVAILABLE))
+		msglog(LDMSD_LINFO, SAMP ": pid %d is gone, its slot is "
+			"reclaimed.\n", pid);
+}
+
+/**
+ * Take a copy of the data block of slot \c pm that no report overlapped,
+ * trying a few times before settling for the last copy. Writers are never
+ * held up.
+ * @return the writer sequence the copy corresponds to
+ **/
+static uint64_t proc_copy_get(shmem_proc_t *pm)
+{
+	uint64_t end;
+	int i;
+
+	for (i = 0; i < APPINFO_COPY_RETRY; i++) {
+		end = pm->wend;
+		__sync_synchronize();
+		memcpy(proc_copy, ((void *) shmem_header) + pm->start_offset,
+					shmem_header->data_block_size);
+		__sync_synchronize();
+		if (pm->wbegin == end)
+			return end;
+	}
+	msglog(LDMSD_LDEBUG, SAMP ": pid %d kept updating, using the last "
+				"copy.\n", pm->process_id);
+	return end;
+}
+
+/**
+ * Sample data. In the appinfo sampler, we walk all of the process slots
+ * in the shared memory and copy every process that reported since the
+ * last sample into its own set. Slots of processes that finalized have
+ * their sets removed, and so do the slots of processes that exited
+ * without finalizing, which are then freed.
  **/
 static int sample(struct ldmsd_sampler *self)
 {
-	int rc, i;
+	int i, j;
+	int pid;
 	int metric_no;
-	char *s;
-	void *proc_data;
-	app_metric_t *am;
-	char lbuf[256];
-	char metric_name[128];
-	union ldms_value v;
+	uint64_t end;
+	shmem_proc_t *pm;
+	struct appinfo_proc *p;
 	msglog(LDMSD_LDEBUG, SAMP ": Begin sample.\n");
 
 	if (!set) {
 		msglog(LDMSD_LDEBUG, SAMP ": plugin not initialized\n");
 		return EINVAL;
 	}
-	sem_wait(ldmsapp_mutex); /* shared mem control */
-	/* Find which process we should sample from */
-	i = (last_process_sampled+1) % MAX_PROCESSES;
-	do {
-		if (shmem_header->proc_metadata[i].status == NEEDSAMPLED)
-			break;
-		i = (i+1) % MAX_PROCESSES;
-	} while (i != last_process_sampled);
-	if (shmem_header->proc_metadata[i].status != NEEDSAMPLED) {
-		/* no process needs sampled, so skip! */
-		msglog(LDMSD_LDEBUG, SAMP ": No new data to sample.\n");
-		sem_post(ldmsapp_mutex); /* shared mem control */
-		return 0;
-	}
-	/* we will sample this process, so reset its status */
-	shmem_header->proc_metadata[i].status = NOTREADY;
-	last_process_sampled = i;
-
-	/* let base sampler fill in its data */
+	/* the node-level set carries the base metrics only */
 	base_sample_begin(base);
-	/* fill in app_id and job_id directly (TODO use common code here?) */
-	ldms_metric_set_u64(base->set, jobid_index,
-				shmem_header->proc_metadata[i].job_id);
-	ldms_metric_set_u64(base->set, appid_index,
-				shmem_header->proc_metadata[i].app_id);
-	/* start our metrics at offset */
-	metric_no = metric_offset;
-	/* fill in process and rank ids */
-	ldms_metric_set_u32(set, metric_no++,
-				shmem_header->proc_metadata[i].process_id);
-	ldms_metric_set_u32(set, metric_no++,
-				shmem_header->proc_metadata[i].rank_id);
-	/* then here fill in all of our metrics */
-	/* - copy process metrics over to metric set */
-	/* - create pointer to process data block */
-	proc_data = ((void *) shmem_header) +
-				shmem_header->proc_metadata[i].start_offset;
-	for (i = metric_no; i < shmem_header->metric_count; i++) {
-		am = (app_metric_t *) (proc_data +
-					shmem_header->metric_offset[i]);
-		sample_proc_metric(am, i);
+	base_sample_end(base);
+
+	for (i = 0; i < MAX_PROCESSES; i++) {
+		pm = &shmem_header->proc_metadata[i];
+		p = &procs[i];
+		if (pm->status != ACTIVE) {
+			if (p->set)
+				proc_set_delete(p);
+			continue;
+		}
+		pid = pm->process_id;
+		if (pm->wend == pm->sampled && kill(pid, 0) && errno == ESRCH) {
+			/* its last report, if any, is already sampled */
+			if (p->set)
+				proc_set_delete(p);
+			proc_slot_reclaim(pm);
+			continue;
+		}
+		if (p->set && p->process_id != pid)
+			proc_set_delete(p); /* the slot changed hands */
+		if (p->set && pm->wend == pm->sampled)
+			continue; /* nothing new */
+		if (!p->set && proc_set_new(p, pid)) {
+			msglog(LDMSD_LERROR, SAMP ": cannot create the set "
+				"for pid %d.\n", pid);
+			continue;
+		}
+		end = proc_copy_get(pm);
+
+		ldms_transaction_begin(p->set);
+		/* fill in app_id and job_id directly (TODO use common code here?) */
+		ldms_metric_set_u64(p->set, jobid_index, pm->job_id);
+		ldms_metric_set_u64(p->set, appid_index, pm->app_id);
+		/* start our metrics at offset */
+		metric_no = metric_offset;
+		/* fill in process and rank ids */
+		ldms_metric_set_u32(p->set, metric_no++, pid);
+		ldms_metric_set_u32(p->set, metric_no++, pm->rank_id);
+		/* then copy the process metrics over to the metric set */
+		for (j = metric_no; j < shmem_header->metric_count; j++)
+			sample_proc_metric(p->set, (app_metric_t *)
+				(proc_copy + shmem_header->metric_offset[j]), j);
+		ldms_transaction_end(p->set);
+		pm->sampled = end;
 	}
 
-out:
-	base_sample_end(base);
-	sem_post(ldmsapp_mutex); /* shared mem control */
 	msglog(LDMSD_LDEBUG, SAMP ": End sample.\n");
 	return 0;
 }
@@ -458,7 +539,12 @@ out:
  **/
 static void term(struct ldmsd_plugin *self)
 {
+	int i;
 	msglog(LDMSD_LDEBUG, SAMP ": Terminating sampler.\n");
+	for (i = 0; i < MAX_PROCESSES; i++) {
+		if (procs[i].set)
+			proc_set_delete(&procs[i]);
+	}
 	if (base)
 		base_del(base);
 	if (set)
@@ -467,10 +553,10 @@ static void term(struct ldmsd_plugin *self)
 	/* cleanup our own stuff here */
 	if (shmem_header != MAP_FAILED) munmap(shmem_header,shmem_stat.st_size);
 	if (shmem_fd != -1) close(shmem_fd);
-	if (ldmsapp_mutex != SEM_FAILED) sem_close(ldmsapp_mutex);
-	/* probably should unlink them */
+	free(proc_copy);
+	proc_copy = NULL;
+	/* probably should unlink it */
 	shm_unlink(shmem_name);
-	sem_unlink(sem_name);
 	msglog(LDMSD_LDEBUG, SAMP ": Done terminating.\n");
 }
 
@@ -514,12 +600,11 @@ static int create_shmem_data(ldms_set_t set)
 	void *proc1_data, *tp;
 
 	msglog(LDMSD_LDEBUG, SAMP ": Begin shmem data creation.\n");
-	sem_wait(ldmsapp_mutex); /* shared mem control */
 
 	/* make pointer to first process data block in shared mem */
 	/* we will set the metric info in the proc1 data block as */
 	/* a template, and then copy it to the others */
-	proc1_data = ((void*) shmem_header) + sizeof(shmem_header_t);
+	proc1_data = ((void*) shmem_header) + SHMEM_ALIGN(sizeof(shmem_header_t));
 
 	num_metrics = ldms_set_card_get(set);
 	if (num_metrics > MAX_METRICS) {
@@ -543,7 +628,7 @@ static int create_shmem_data(ldms_set_t set)
 		am = (app_metric_t *) (proc1_data + data_block_size);
 		am->status = 0;
 		strncpy(am->name, mname, sizeof(am->name));
-		am->name[sizeof(am->name)] = '\0';
+		am->name[sizeof(am->name)-1] = '\0';
 		am->vtype = mtype;
 		am->value.v_u64 = 0; /* just zero out value union field */
 		/* now add current record's size */
@@ -561,11 +646,17 @@ static int create_shmem_data(ldms_set_t set)
 	/* Clear out any remaining metric offsets */
 	for (; i < MAX_METRICS; i++)
 		shmem_header->metric_offset[i] = 0;
+	/* keep each process' data on cache lines of its own */
+	data_block_size = SHMEM_ALIGN(data_block_size);
 	shmem_header->data_block_size = data_block_size;
+	shmem_header->num_registered = 0;
 	/* Clear out process table */
-	tot_size = sizeof(shmem_header_t);
+	tot_size = SHMEM_ALIGN(sizeof(shmem_header_t));
 	for (i=0; i < MAX_PROCESSES; i++) {
 		shmem_header->proc_metadata[i].status = AVAILABLE;
+		shmem_header->proc_metadata[i].wbegin = 0;
+		shmem_header->proc_metadata[i].wend = 0;
+		shmem_header->proc_metadata[i].sampled = 0;
 		shmem_header->proc_metadata[i].app_id = 0;
 		shmem_header->proc_metadata[i].job_id = 0;
 		shmem_header->proc_metadata[i].process_id = 0;
@@ -580,18 +671,18 @@ static int create_shmem_data(ldms_set_t set)
 		tp += data_block_size;
 	}
 
-	sem_post(ldmsapp_mutex); /* shared mem control */
 	msglog(LDMSD_LDEBUG, SAMP ": Done shmem data creation.\n");
 	return tot_size;
 }
 
 /**
  * Sample a process metric.
+ * @param set is the set of the process
  * @param metric is the pointer to the process metric struct
  * @param id is the metric index (for now, absolute)
  * @return 0 on success, nonzero on failure
  **/
-static int sample_proc_metric(app_metric_t *metric, int id)
+static int sample_proc_metric(ldms_set_t set, app_metric_t *metric, int id)
 {
 	/* TODO Should id param be absolute or relative to metric_offset? */
 	/* (if relative we need this:) mid = mid + metric_offset; */
@@ -631,6 +722,12 @@ static int sample_proc_metric(app_metric_t *metric, int id)
 		case LDMS_V_S64:
 			ldms_metric_set_s64(set, id, metric->value.v_s64);
 			break;
+		case LDMS_V_F32:
+			ldms_metric_set_float(set, id, metric->value.v_f);
+			break;
+		case LDMS_V_D64:
+			ldms_metric_set_double(set, id, metric->value.v_d);
+			break;
 		default:
 			msglog(LDMSD_LERROR,
 				SAMP ": Unrecognized or unsupported"
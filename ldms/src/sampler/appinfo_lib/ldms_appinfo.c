@@ -42,7 +42,6 @@
   * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   */
 #include <sys/errno.h>
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -87,9 +86,8 @@ static struct stat shmem_stat;
 static shmem_header_t *shmem_header; /** pointer to beginning of shmem **/
 static void *shmem_data; /** pointer to this process' shmem data segment **/
 static int shmem_pmid; /** index into process metadata array **/
+static shmem_proc_t *shmem_proc; /** this process' slot **/
 static char *shmem_name = "/shm_ldmsapp"; /** shared memory name **/
-static char *sem_name = "/sem_ldmsapp"; /** ldmsapp_mutex name **/
-static sem_t *ldmsapp_mutex; /** mutex for accessing shmem **/
 
 /*
  * Macros for standard code in all of the reporting functions
@@ -106,34 +104,27 @@ static sem_t *ldmsapp_mutex; /** mutex for accessing shmem **/
 			"LDMS: No such metric number (%d): \n", (mid)); \
 		return -1; \
 	} \
-	/* (just wait) if (sem_trywait(ldmsapp_mutex) < 0) return -1; */ \
-	sem_wait(ldmsapp_mutex); \
 	(shmam) = (app_metric_t *) (shmem_data + \
 			shmem_header->metric_offset[(mid)]); \
-	if (!(shmam)) { \
-		/* some error? must ensure no access to null ptr */ \
-		sem_post(ldmsapp_mutex); \
-		return -1; \
-	} \
 	if ((shmam)->vtype != (type)) { \
 		/* shouldn't really print here, either; only for debugging */ \
 		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: Metric is not of "\
 					msg " type (%d,%d)\n", \
 					(shmam)->vtype,(type)); \
 		/* not sure if you want to return -1 here or not? */ \
-		sem_post(ldmsapp_mutex); \
 		return -1; \
-	}
+	} \
+	/* open the update; see ldms_appinfo_shm.h */ \
+	__sync_fetch_and_add(&shmem_proc->wbegin, 1);
 
 #define REPORT_METRIC_TEARDOWN() \
-	sem_post(ldmsapp_mutex); \
-	shmem_header->proc_metadata[shmem_pmid].status = NEEDSAMPLED;
+	__sync_fetch_and_add(&shmem_proc->wend, 1);
 
 /**
  * Initialize the ldmsapp interface. This initialization assumes that
  * LDMS and an LDMS appinfo sampler are running on the node this runs
- * on; if not, the opening of shared memory and a semaphore will fail
- * and the interface will be disabled.
+ * on; if not, the opening of shared memory will fail and the interface
+ * will be disabled.
  * @param ldmsapp_enable is LDMSAPP_ENABLE for normal initialization or
  *			    LDMSAPP_DISABLE for disabling init.
  * @param appid is a unique application id #
@@ -145,9 +136,9 @@ int ldmsapp_initialize(int ldmsapp_enable, int appid, int jobid,
 			int rank, int psilent)
 {
 	int i;
+	app_metric_t *am;
 	/* initialize as failed */
 	shmem_header = MAP_FAILED;
-	ldmsapp_mutex = SEM_FAILED;
 	shmem_fd = -1;
 
 	if (ldmsapp_enable == LDMSAPP_DISABLE) {
@@ -168,16 +159,6 @@ int ldmsapp_initialize(int ldmsapp_enable, int appid, int jobid,
 		}
 	}
 
-	/* open existing shared memory semaphore, fail if doesn't exist */
-	ldmsapp_mutex = sem_open(sem_name, 0);
-	if (ldmsapp_mutex == SEM_FAILED) {
-		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: "
-				"Semaphore open error: %s\n", strerror(errno));
-		goto err;
-	}
-
-	/* Application should not reset semaphore here, the sampler does */
-
 	/* open shared memory segment */
 	shmem_fd = shm_open(shmem_name, O_RDWR, 0);
 	if (shmem_fd == -1) {
@@ -205,50 +186,47 @@ int ldmsapp_initialize(int ldmsapp_enable, int appid, int jobid,
 		goto err;
 	}
 
-	/* JEC: allocate ourselves one of the process data struct blocks */
-	sem_wait(ldmsapp_mutex);
-	if (shmem_header->num_registered >= shmem_header->max_processes) {
-		sem_post(ldmsapp_mutex);
-		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: "
-			"no procs left: %d\n", shmem_header->num_registered);
-		goto err;
-	}
-	/* find open process data block */
-	for (i=0; i < shmem_header->max_processes; i++)
-		if (shmem_header->proc_metadata[i].status == AVAILABLE)
+	/* claim a free process slot; no lock, the CAS decides the owner */
+	for (i=0; i < shmem_header->max_processes; i++) {
+		if (shmem_header->proc_metadata[i].status != AVAILABLE)
+			continue;
+		if (__sync_bool_compare_and_swap(
+				&shmem_header->proc_metadata[i].status,
+				AVAILABLE, ALLOCATED))
 			break;
+	}
 	if (i >= shmem_header->max_processes) {
-		sem_post(ldmsapp_mutex);
 		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: "
-					"no procs left (2): %d\n", i);
+			"no procs left: %d\n", shmem_header->num_registered);
 		goto err;
 	}
 	shmem_pmid = i;
-	if (shmem_header->proc_metadata[shmem_pmid].status != AVAILABLE) {
-		sem_post(ldmsapp_mutex);
-		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: "
-				"proc md alloc!: %d\n",	shmem_pmid);
-		goto err;
-	}
-	shmem_header->proc_metadata[shmem_pmid].status = ALLOCATED;
-	shmem_header->proc_metadata[shmem_pmid].app_id = appid;
-	shmem_header->proc_metadata[shmem_pmid].job_id = jobid;
-	shmem_header->proc_metadata[shmem_pmid].process_id = getpid();
-	shmem_header->proc_metadata[shmem_pmid].rank_id = rank;
-	shmem_header->proc_metadata[shmem_pmid].start_offset =
-		sizeof(shmem_header_t) + (shmem_header->num_registered *
-					shmem_header->data_block_size);
-	/* calc position of next avail data block */
-	shmem_data = (((void*) shmem_header) + sizeof(shmem_header_t) +
-		(shmem_header->num_registered * shmem_header->data_block_size));
-	shmem_header->num_registered++;
-	sem_post(ldmsapp_mutex);
+	shmem_proc = &shmem_header->proc_metadata[shmem_pmid];
+	/* the sampler lays out the (cache-line aligned) data blocks */
+	shmem_data = ((void*) shmem_header) + shmem_proc->start_offset;
 	if (shmem_data+shmem_header->data_block_size >
 		((void*) shmem_header) + shmem_stat.st_size) {
+		shmem_proc->status = AVAILABLE;
 		if (!silent) fprintf(stderr,"LDMSAPP_LERROR: "
-			"Shmem too small! %d\n", shmem_header->num_registered);
+			"Shmem too small! %d\n", shmem_pmid);
 		goto err;
 	}
+	/* do not inherit the values of the previous owner */
+	for (i = 0; i < shmem_header->metric_count; i++) {
+		am = (app_metric_t *)
+			(shmem_data + shmem_header->metric_offset[i]);
+		memset(&am->value, 0, am->size - sizeof(app_metric_t) +
+					sizeof(union ldms_value));
+		am->status = 0;
+	}
+	shmem_proc->app_id = appid;
+	shmem_proc->job_id = jobid;
+	shmem_proc->process_id = getpid();
+	shmem_proc->rank_id = rank;
+	__sync_fetch_and_add(&shmem_header->num_registered, 1);
+	/* the sampler may pick the slot up from here on */
+	__sync_synchronize();
+	shmem_proc->status = ACTIVE;
 
 	/*
 	* return -2 if the parsed failed for some user metrics
@@ -261,7 +239,6 @@ err:
 	/* cleanup any successful progress that might have happened */
 	if (shmem_header != MAP_FAILED) munmap(shmem_header,shmem_stat.st_size);
 	if (shmem_fd != -1) close(shmem_fd);
-	if (ldmsapp_mutex != SEM_FAILED) sem_close(ldmsapp_mutex);
 	ldmsapp_status = LDMSAPP_STAT_ERROR;
 	return -1;
 }
@@ -281,24 +258,21 @@ int ldmsapp_finalize()
 	 * - but provide a hard-counter (10 seconds) failsafe override
 	 */
 	i = 0;
-	while (i<80 && shmem_header->proc_metadata[shmem_pmid].status == NEEDSAMPLED) {
+	while (i<80 && shmem_proc->sampled != shmem_proc->wend) {
 		usleep(125000);  /* 1/8 of a second */
 		i++;
 	}
 	/* clean up our process record */
-	sem_wait(ldmsapp_mutex);
-	shmem_header->proc_metadata[shmem_pmid].app_id = 0;
-	shmem_header->proc_metadata[shmem_pmid].job_id = 0;
-	shmem_header->proc_metadata[shmem_pmid].process_id = 0;
-	shmem_header->proc_metadata[shmem_pmid].rank_id = 0;
-	shmem_header->proc_metadata[shmem_pmid].start_offset = 0;
-	shmem_header->proc_metadata[shmem_pmid].status = AVAILABLE;
-	shmem_header->num_registered--;
-	sem_post(ldmsapp_mutex);
+	shmem_proc->app_id = 0;
+	shmem_proc->job_id = 0;
+	shmem_proc->process_id = 0;
+	shmem_proc->rank_id = 0;
+	__sync_fetch_and_sub(&shmem_header->num_registered, 1);
+	__sync_synchronize();
+	shmem_proc->status = AVAILABLE;
 	/* release resources */
 	munmap(shmem_header,shmem_stat.st_size);
 	close(shmem_fd);
-	sem_close(ldmsapp_mutex);
 	/* JEC: don't unlink on app side, this
 	 * would delete it so that it cannot be reused!
 	 */
@@ -418,7 +392,7 @@ int ldmsapp_inc_metric_u8(int metric_id, uint8_t value)
 {
 	app_metric_t *shm_metric;
 	REPORT_METRIC_SETUP(shm_metric, metric_id, LDMS_V_U8, "uint8")
-	shm_metric->value.v_u8 += value;
+	__sync_fetch_and_add(&shm_metric->value.v_u8, value);
 	shm_metric->status = 1;
 	REPORT_METRIC_TEARDOWN();
 	return 0;
@@ -428,7 +402,7 @@ int ldmsapp_inc_metric_u16(int metric_id, uint16_t value)
 {
 	app_metric_t *shm_metric;
 	REPORT_METRIC_SETUP(shm_metric, metric_id, LDMS_V_U16, "uint16")
-	shm_metric->value.v_u16 += value;
+	__sync_fetch_and_add(&shm_metric->value.v_u16, value);
 	shm_metric->status = 1;
 	REPORT_METRIC_TEARDOWN();
 	return 0;
@@ -438,7 +412,7 @@ int ldmsapp_inc_metric_u32(int metric_id, uint32_t value)
 {
 	app_metric_t *shm_metric;
 	REPORT_METRIC_SETUP(shm_metric, metric_id, LDMS_V_U32, "uint32")
-	shm_metric->value.v_u32 += value;
+	__sync_fetch_and_add(&shm_metric->value.v_u32, value);
 	shm_metric->status = 1;
 	REPORT_METRIC_TEARDOWN();
 	return 0;
@@ -448,7 +422,7 @@ int ldmsapp_inc_metric_u64(int metric_id, uint64_t value)
 {
 	app_metric_t *shm_metric;
 	REPORT_METRIC_SETUP(shm_metric, metric_id, LDMS_V_U64, "uint64")
-	shm_metric->value.v_u64 += value;
+	__sync_fetch_and_add(&shm_metric->value.v_u64, value);
 	shm_metric->status = 1;
 	REPORT_METRIC_TEARDOWN();
 	return 0;
@@ -477,13 +451,11 @@ char** ldmsapp_get_metric_names()
 	am = shmem_data;
 	memset(metrics, 0, sizeof(metrics)); /* zero out for safety */
 	if (ldmsapp_status >= 1) return NULL;
-	sem_wait(ldmsapp_mutex);
 	for (i = 0; i < shmem_header->metric_count; i++) {
 		am = (app_metric_t *)
 			(shmem_data + shmem_header->metric_offset[i]);
 		strncpy(metrics[i], am->name, strlen(am->name)+1);
 	}
-	sem_post(ldmsapp_mutex);
 	metrics[i][0] = '\0'; /* indicate end with empty string (redundant) */
 	return (char**) metrics;
 }
@@ -499,10 +471,8 @@ char* ldmsapp_get_metric_name_by_id(int id)
 	app_metric_t *am;
 	am = shmem_data;
 	if (ldmsapp_status >= 1) return NULL;
-	sem_wait(ldmsapp_mutex);
 	am = (app_metric_t *) (shmem_data + shmem_header->metric_offset[id]);
 	strncpy(name, am->name, strlen(am->name)+1);
-	sem_post(ldmsapp_mutex);
 	return name;
 }
 
@@ -0,0 +1,358 @@
+/* -*- c-basic-offset: 8 -*-
+  * Copyright (c) 2018 National Technology & Engineering Solutions
+  * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+  * NTESS, the U.S. Government retains certain rights in this software.
+  *
+  * This software is available to you under a choice of one of two
+  * licenses.  You may choose to be licensed under the terms of the GNU
+  * General Public License (GPL) Version 2, available from the file
+  * COPYING in the main directory of this source tree, or the BSD-type
+  * license below:
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions
+  * are met:
+  *
+  *      Redistributions of source code must retain the above copyright
+  *      notice, this list of conditions and the following disclaimer.
+  *
+  *      Redistributions in binary form must reproduce the above
+  *      copyright notice, this list of conditions and the following
+  *      disclaimer in the documentation and/or other materials provided
+  *      with the distribution.
+  *
+  *      Neither the name of Sandia nor the names of any contributors may
+  *      be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  *      Modified source versions must be plainly marked as such, and
+  *      must not be misrepresented as being the original software.
+  *
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  */
+
+/*
+ * Microbenchmark for the appinfo reporting path.
+ *
+ * Forks <nproc> reporter processes that call ldmsapp_inc_metric_u64() in a
+ * tight loop for <secs> seconds while this process samples the shared
+ * memory continuously, then prints the mean cost of a report call and the
+ * number of process records the sampler collected per second. Two modes
+ * are measured:
+ *	lockfree - the library as shipped (per-process slots, seqlock)
+ *	sem	 - the previous scheme, emulated here: every report and every
+ *		   sample holds one node-wide semaphore and the sampler harvests
+ *		   one updated process per pass
+ *
+ * The benchmark creates /shm_ldmsapp itself, so it must not run on a node
+ * where the appinfo sampler is loaded.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "ldms.h"
+#include "ldms_appinfo.h"
+#include "ldms_appinfo_shm.h"
+
+#define BENCH_METRICS 8
+
+static char *shmem_name = "/shm_ldmsapp";
+static shmem_header_t *shmem_header;
+static size_t shmem_size;
+
+/* results and control, shared with the reporters */
+static struct bench_ctl {
+	sem_t sem; /* the node-wide lock of the "sem" mode */
+	volatile int go;
+	volatile int done;
+	int last; /* round-robin position of the "sem" sampler */
+	struct {
+		uint64_t calls;
+		uint64_t ns;
+	} rep[MAX_PROCESSES];
+} *ctl;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the same layout the sampler builds in create_shmem_data() */
+static void shmem_layout()
+{
+	app_metric_t *am;
+	void *proc1_data, *tp;
+	unsigned int off = 0;
+	int i;
+
+	memset(shmem_header, 0, shmem_size);
+	proc1_data = ((void *) shmem_header) +
+				SHMEM_ALIGN(sizeof(shmem_header_t));
+	shmem_header->max_processes = MAX_PROCESSES;
+	shmem_header->metric_count = BENCH_METRICS;
+	for (i = 0; i < BENCH_METRICS; i++) {
+		shmem_header->metric_offset[i] = off;
+		am = proc1_data + off;
+		snprintf(am->name, sizeof(am->name), "m%d", i);
+		am->vtype = LDMS_V_U64;
+		am->size = sizeof(app_metric_t);
+		off += am->size;
+	}
+	shmem_header->data_block_size = SHMEM_ALIGN(off);
+	tp = proc1_data;
+	for (i = 0; i < MAX_PROCESSES; i++) {
+		shmem_header->proc_metadata[i].start_offset =
+							tp - (void *) shmem_header;
+		if (i)
+			memcpy(tp, proc1_data, shmem_header->data_block_size);
+		tp += shmem_header->data_block_size;
+	}
+}
+
+static void reporter(int mode, int rank, double secs)
+{
+	shmem_proc_t *pm = NULL;
+	app_metric_t *am;
+	uint64_t n = 0, t0, t1, deadline;
+	void *data;
+	int i;
+
+	if (mode) {
+		if (ldmsapp_initialize(LDMSAPP_ENABLE, 1, 1, rank, 0))
+			_exit(1);
+	} else {
+		/* "sem" mode: register the way the old library did */
+		sem_wait(&ctl->sem);
+		for (i = 0; i < MAX_PROCESSES; i++) {
+			pm = &shmem_header->proc_metadata[i];
+			if (pm->status == AVAILABLE)
+				break;
+		}
+		pm->status = ALLOCATED;
+		pm->process_id = getpid();
+		pm->rank_id = rank;
+		sem_post(&ctl->sem);
+	}
+	while (!ctl->go)
+		;
+	t0 = now_ns();
+	deadline = t0 + secs * 1e9;
+	do {
+		for (i = 0; i < 1024; i++, n++) {
+			if (mode) {
+				ldmsapp_inc_metric_u64(n % BENCH_METRICS, 1);
+				continue;
+			}
+			sem_wait(&ctl->sem);
+			data = ((void *) shmem_header) + pm->start_offset;
+			am = data + shmem_header->metric_offset[n % BENCH_METRICS];
+			am->value.v_u64 += 1;
+			am->status = 1;
+			sem_post(&ctl->sem);
+			pm->status = ACTIVE; /* stands for NEEDSAMPLED */
+		}
+		t1 = now_ns();
+	} while (t1 < deadline);
+	ctl->rep[rank].calls = n;
+	ctl->rep[rank].ns = t1 - t0;
+	if (mode) {
+		ldmsapp_finalize();
+	} else {
+		pm->status = AVAILABLE;
+	}
+	__sync_fetch_and_add(&ctl->done, 1);
+	_exit(0);
+}
+
+/* one sampler pass, returns the number of process records copied */
+static int sample_lockfree(void *buf)
+{
+	shmem_proc_t *pm;
+	uint64_t end;
+	int i, j, n = 0;
+
+	for (i = 0; i < MAX_PROCESSES; i++) {
+		pm = &shmem_header->proc_metadata[i];
+		if (pm->status != ACTIVE || pm->wend == pm->sampled)
+			continue;
+		for (j = 0; j < 8; j++) {
+			end = pm->wend;
+			__sync_synchronize();
+			memcpy(buf, ((void *) shmem_header) + pm->start_offset,
+					shmem_header->data_block_size);
+			__sync_synchronize();
+			if (pm->wbegin == end)
+				break;
+		}
+		pm->sampled = end;
+		n++;
+	}
+	return n;
+}
+
+static int sample_sem(void *buf)
+{
+	shmem_proc_t *pm;
+	int i;
+
+	sem_wait(&ctl->sem);
+	i = (ctl->last + 1) % MAX_PROCESSES;
+	do {
+		if (shmem_header->proc_metadata[i].status == ACTIVE)
+			break;
+		i = (i + 1) % MAX_PROCESSES;
+	} while (i != ctl->last);
+	pm = &shmem_header->proc_metadata[i];
+	if (pm->status != ACTIVE) {
+		sem_post(&ctl->sem);
+		return 0;
+	}
+	pm->status = ALLOCATED; /* stands for NOTREADY */
+	ctl->last = i;
+	memcpy(buf, ((void *) shmem_header) + pm->start_offset,
+				shmem_header->data_block_size);
+	sem_post(&ctl->sem);
+	return 1;
+}
+
+static int run(int mode, int nproc, double secs)
+{
+	uint64_t calls = 0, ns = 0, records = 0, passes = 0, t0, t1;
+	void *buf;
+	int i;
+
+	shmem_layout();
+	memset(ctl->rep, 0, sizeof(ctl->rep));
+	ctl->go = ctl->done = ctl->last = 0;
+	buf = malloc(shmem_header->data_block_size);
+	if (!buf)
+		return ENOMEM;
+	fflush(stdout);
+	for (i = 0; i < nproc; i++) {
+		switch (fork()) {
+		case -1:
+			perror("fork");
+			return errno;
+		case 0:
+			reporter(mode, i, secs);
+		}
+	}
+	sleep(1); /* let everybody register */
+	t0 = now_ns();
+	ctl->go = 1;
+	while (ctl->done < nproc) {
+		records += mode ? sample_lockfree(buf) : sample_sem(buf);
+		passes++;
+	}
+	t1 = now_ns();
+	while (wait(NULL) > 0)
+		;
+	for (i = 0; i < nproc; i++) {
+		calls += ctl->rep[i].calls;
+		ns += ctl->rep[i].ns;
+	}
+	printf("%-8s %6d %12.1f %14.0f %14.0f %14.0f\n",
+	       mode ? "lockfree" : "sem", nproc,
+	       calls ? (double)ns / calls : 0.0,
+	       (double)calls * 1e9 / (ns / nproc),
+	       (double)passes * 1e9 / (t1 - t0),
+	       (double)records * 1e9 / (t1 - t0));
+	free(buf);
+	return 0;
+}
+
+static void usage(char *argv[])
+{
+	printf("%s [-p <nproc>] [-t <secs>] [-m lockfree|sem|both]\n"
+	       "  -p  number of reporter processes, default 64, max %d\n"
+	       "  -t  seconds each mode runs, default 2\n"
+	       "  -m  mode to measure, default both\n", argv[0], MAX_PROCESSES);
+}
+
+int main(int argc, char *argv[])
+{
+	int nproc = 64, op, fd, rc;
+	double secs = 2;
+	char *mode = "both";
+
+	while ((op = getopt(argc, argv, "p:t:m:h")) != -1) {
+		switch (op) {
+		case 'p':
+			nproc = atoi(optarg);
+			break;
+		case 't':
+			secs = atof(optarg);
+			break;
+		case 'm':
+			mode = optarg;
+			break;
+		default:
+			usage(argv);
+			return op == 'h' ? 0 : EINVAL;
+		}
+	}
+	if (nproc < 1 || nproc > MAX_PROCESSES || secs <= 0) {
+		usage(argv);
+		return EINVAL;
+	}
+
+	fd = shm_open(shmem_name, O_CREAT|O_EXCL|O_RDWR, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s (is the appinfo sampler running?)\n",
+			shmem_name, strerror(errno));
+		return errno;
+	}
+	shmem_size = SHMEM_ALIGN(sizeof(shmem_header_t)) + MAX_PROCESSES *
+			SHMEM_ALIGN(BENCH_METRICS * sizeof(app_metric_t));
+	rc = ftruncate(fd, shmem_size);
+	if (rc) {
+		rc = errno;
+		goto out;
+	}
+	shmem_header = mmap(NULL, shmem_size, PROT_READ|PROT_WRITE,
+			    MAP_SHARED, fd, 0);
+	ctl = mmap(NULL, sizeof(*ctl), PROT_READ|PROT_WRITE,
+		   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (shmem_header == MAP_FAILED || ctl == MAP_FAILED) {
+		rc = errno;
+		goto out;
+	}
+	sem_init(&ctl->sem, 1, 1);
+
+	printf("%-8s %6s %12s %14s %14s %14s\n", "mode", "nproc",
+	       "ns/report", "reports/s", "passes/s", "records/s");
+	if (!strcmp(mode, "sem") || !strcmp(mode, "both"))
+		rc = run(0, nproc, secs);
+	if (!rc && (!strcmp(mode, "lockfree") || !strcmp(mode, "both")))
+		rc = run(1, nproc, secs);
+out:
+	if (rc)
+		fprintf(stderr, "error: %s\n", strerror(rc));
+	close(fd);
+	shm_unlink(shmem_name);
+	return rc;
+}
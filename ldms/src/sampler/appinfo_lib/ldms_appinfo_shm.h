@@ -70,33 +70,66 @@
  * Q: Should this code be configurable to support Kokkos? probably
  ***/
 
-#define MAX_PROCESSES 16
+/***
+ * Lock-free slots: each registered process owns one cache-line aligned
+ * entry in proc_metadata and one cache-line aligned data block. The
+ * application never takes the semaphore on the report path; a slot is
+ * claimed with a compare-and-swap on its status. Every update is bracketed
+ * by the slot's writer counters:
+ *	writer: wbegin++ (atomic); store value; wend++ (atomic)
+ *	reader: e = wend; copy block; b = wbegin; retry if b != e
+ * Several threads of one process may write concurrently; the reader sees a
+ * consistent copy whenever no update overlapped the copy. A copy is skipped
+ * altogether if wend still equals the sequence last published (sampled).
+ ***/
+
+#define MAX_PROCESSES 128
 #define MAX_METRICS 128
+#define SHMEM_CACHE_LINE 64
+#define SHMEM_ALIGN(x) (((x) + SHMEM_CACHE_LINE - 1) & ~(SHMEM_CACHE_LINE - 1))
+
+enum shmem_proc_status {
+	AVAILABLE=0,	/* slot free */
+	ALLOCATED,	/* claimed by a process, being initialized */
+	ACTIVE,		/* process is reporting into its data block */
+};
+
+/**
+ * Per-process slot. Fields marked (AP) are set by the owning process,
+ * (SS) by the sampler.
+ **/
+typedef struct shmem_proc_s {
+	volatile int status; /* enum shmem_proc_status (AP) */
+	unsigned int app_id; /* application ID (AP) */
+	unsigned int job_id; /* job ID (AP) */
+	int process_id; /* OS PID (AP) */
+	int rank_id; /* MPI rank ID (or other library rank id) (AP) */
+	int start_offset; /* starting address offset of data struct (SS) */
+	volatile uint64_t wbegin; /* updates begun (AP) */
+	volatile uint64_t wend; /* updates completed (AP) */
+	volatile uint64_t sampled; /* wend last published by the sampler (SS) */
+} __attribute__((aligned(SHMEM_CACHE_LINE))) shmem_proc_t;
+
 /**
  * Shared memory header. Fields marked (SS) are set by the sampler.
  * Others marked (AP) are set by the application processes.
  **/
 typedef struct shmem_header_s {
 	int max_processes;  /* max # of separate process data structs (SS) */
-	int num_registered; /* current # of process structs allocated (AP) */
+	volatile int num_registered; /* current # of process structs allocated (AP) */
 	int metric_count;  /* number of metrics each process data struct (SS) */
 	int data_block_size; /* size (bytes) of each process data struct (SS) */
-	int sample_offset;  /* offset to struct to sample this time (AP?) */
-	struct {
-		enum {AVAILABLE=0, ALLOCATED, NOTREADY, NEEDSAMPLED} status;
-		unsigned int app_id; /* application ID */
-		unsigned int job_id; /* job ID */
-		int process_id; /* OS PID */
-		int rank_id; /* MPI rank ID (or other library rank id) */
-		int start_offset; /* starting address offset of data struct */
-	} proc_metadata[MAX_PROCESSES]; /* table for data struct allocation */
 	unsigned int metric_offset[MAX_METRICS]; /* offsets for metrics (SS) */
-} shmem_header_t;
+	shmem_proc_t proc_metadata[MAX_PROCESSES]; /* table for data struct allocation */
+} __attribute__((aligned(SHMEM_CACHE_LINE))) shmem_header_t;
 
 /**
  * Each process metric data block is an array of these.
  * metric values are set by the application library side, and
  * then read and copied into an LDMS schema on the sampler side.
+ * Scalar values are naturally aligned, so a single store or an atomic
+ * add never tears even when read outside of a consistent copy; string
+ * values may.
  * BUT TODO: Omar's code has another array of sizes because these
  * can be variable size -- "value" can be a 256-byte array for strings.
  **/
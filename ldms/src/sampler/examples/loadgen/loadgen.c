@@ -0,0 +1,518 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file loadgen.c
+ * \brief Synthetic load for scale testing aggregators.
+ *
+ * Creates num_sets sets, assigned round robin to the configured schemas,
+ * and rewrites every metric of every set on each sample. Values come
+ * from loadgen.h so the loadgen_verify store can check what arrives.
+ * With jitter=0 all sets are updated back to back in sample(); with
+ * jitter>0 a thread spreads the updates of a round over that many
+ * microseconds at fixed per-set offsets, like unsynchronized producers.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "loadgen.h"
+
+#define SAMP "loadgen"
+
+/** most types one schema may cycle through */
+#define LG_MAX_TYPES 8
+
+struct lg_schema {
+	char *name;
+	ldms_schema_t schema;
+	int count;		/* generated metrics */
+	int array_len;		/* 0 for scalar metrics */
+	int ntypes;
+	enum ldms_value_type types[LG_MAX_TYPES];
+	int round_id;		/* metric id of lg_round */
+};
+
+struct lg_set {
+	ldms_set_t set;
+	uint32_t index;
+	struct lg_schema *lgs;
+	uint64_t phase;		/* usec into a jittered round */
+};
+
+static ldmsd_msg_log_f msglog;
+static struct lg_schema *lg_schemas;
+static int num_schemas;
+static struct lg_set *lg_sets;
+static int num_sets;
+static uint64_t seed = 1;
+static int mode = LOADGEN_COUNTER;
+static uint64_t jitter;
+
+static pthread_t jitter_thread;
+static int jitter_thread_used;
+static pthread_mutex_t lg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lg_cv = PTHREAD_COND_INITIALIZER;
+static uint64_t lg_round;	/* the round requested by sample() */
+static uint64_t lg_done_round;	/* the last round fully written */
+static struct timespec lg_round_start;
+static uint64_t lg_overruns;
+static int lg_stop;
+
+static void update_set(struct lg_set *s, uint64_t round)
+{
+	struct lg_schema *lgs = s->lgs;
+	union ldms_value v;
+	int j, e, mid;
+
+	ldms_transaction_begin(s->set);
+	ldms_metric_set_u64(s->set, lgs->round_id, round);
+	for (j = 0; j < lgs->count; j++) {
+		enum ldms_value_type t = lgs->types[j % lgs->ntypes];
+		mid = lgs->round_id + 1 + j;
+		if (!lgs->array_len) {
+			loadgen_value(t, mode, seed, s->index, j, 0, round, &v);
+			ldms_metric_set(s->set, mid, &v);
+			continue;
+		}
+		for (e = 0; e < lgs->array_len; e++) {
+			loadgen_value(t, mode, seed, s->index, j, e, round, &v);
+			ldms_metric_array_set_val(s->set, mid, e, &v);
+		}
+	}
+	ldms_transaction_end(s->set);
+}
+
+static void *jitter_proc(void *arg)
+{
+	struct timespec start, at;
+	uint64_t round;
+	int i;
+
+	pthread_mutex_lock(&lg_lock);
+	while (!lg_stop) {
+		if (lg_done_round == lg_round) {
+			pthread_cond_wait(&lg_cv, &lg_lock);
+			continue;
+		}
+		/* a late thread skips to the newest round */
+		round = lg_round;
+		start = lg_round_start;
+		pthread_mutex_unlock(&lg_lock);
+		for (i = 0; i < num_sets && !lg_stop; i++) {
+			uint64_t ns = start.tv_nsec + lg_sets[i].phase * 1000;
+			at.tv_sec = start.tv_sec + ns / 1000000000;
+			at.tv_nsec = ns % 1000000000;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &at, NULL) == EINTR)
+				;
+			update_set(&lg_sets[i], round);
+		}
+		pthread_mutex_lock(&lg_lock);
+		lg_done_round = round;
+	}
+	pthread_mutex_unlock(&lg_lock);
+	return NULL;
+}
+
+static int phase_cmp(const void *a, const void *b)
+{
+	const struct lg_set *x = a, *y = b;
+	if (x->phase != y->phase)
+		return x->phase < y->phase ? -1 : 1;
+	return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* name:count:type[/type...][:array_len] */
+static int parse_schema(char *spec, struct lg_schema *lgs)
+{
+	char *ptr, *name, *count, *types, *len, *t;
+	char *endp;
+
+	name = strtok_r(spec, ":", &ptr);
+	count = strtok_r(NULL, ":", &ptr);
+	types = strtok_r(NULL, ":", &ptr);
+	len = strtok_r(NULL, ":", &ptr);
+	if (!name || !count || !types || strtok_r(NULL, ":", &ptr))
+		goto einval;
+	lgs->count = strtol(count, &endp, 0);
+	if (*endp || lgs->count < 1)
+		goto einval;
+	if (len) {
+		lgs->array_len = strtol(len, &endp, 0);
+		if (*endp || lgs->array_len < 1)
+			goto einval;
+	}
+	for (t = strtok_r(types, "/", &ptr); t; t = strtok_r(NULL, "/", &ptr)) {
+		enum ldms_value_type vt = ldms_metric_str_to_type(t);
+		if (vt < LDMS_V_CHAR || vt > LDMS_V_D64 ||
+		    (vt == LDMS_V_CHAR && lgs->array_len)) {
+			msglog(LDMSD_LERROR, SAMP ": unsupported type '%s' in "
+			       "schema '%s'.\n", t, name);
+			return EINVAL;
+		}
+		if (lgs->ntypes == LG_MAX_TYPES) {
+			msglog(LDMSD_LERROR, SAMP ": schema '%s' has more "
+			       "than %d types.\n", name, LG_MAX_TYPES);
+			return EINVAL;
+		}
+		lgs->types[lgs->ntypes++] = vt;
+	}
+	if (!lgs->ntypes)
+		goto einval;
+	lgs->name = strdup(name);
+	if (!lgs->name)
+		return ENOMEM;
+	return 0;
+einval:
+	msglog(LDMSD_LERROR, SAMP ": bad schema spec '%s'; expected "
+	       "name:count:type[/type...][:array_len].\n", spec);
+	return EINVAL;
+}
+
+static int create_schema(struct lg_schema *lgs)
+{
+	char mname[32];
+	int j, rc;
+
+	lgs->schema = ldms_schema_new(lgs->name);
+	if (!lgs->schema)
+		return ENOMEM;
+	rc = ldms_schema_meta_add(lgs->schema, "component_id", LDMS_V_U64);
+	if (rc >= 0)
+		rc = ldms_schema_meta_add(lgs->schema, LOADGEN_INDEX, LDMS_V_U32);
+	if (rc >= 0)
+		rc = ldms_schema_meta_add(lgs->schema, LOADGEN_SEED, LDMS_V_U64);
+	if (rc >= 0)
+		rc = ldms_schema_meta_add(lgs->schema, LOADGEN_MODE, LDMS_V_U32);
+	if (rc >= 0)
+		rc = lgs->round_id = ldms_schema_metric_add(lgs->schema,
+						LOADGEN_ROUND, LDMS_V_U64);
+	for (j = 0; rc >= 0 && j < lgs->count; j++) {
+		enum ldms_value_type t = lgs->types[j % lgs->ntypes];
+		snprintf(mname, sizeof(mname), "m%d", j);
+		if (lgs->array_len)
+			rc = ldms_schema_metric_array_add(lgs->schema, mname,
+					t + (LDMS_V_CHAR_ARRAY - LDMS_V_CHAR),
+					lgs->array_len);
+		else
+			rc = ldms_schema_metric_add(lgs->schema, mname, t);
+	}
+	return (rc < 0) ? -rc : 0;
+}
+
+static int create_set(struct lg_set *s, const char *producer,
+		      const char *instance, int producers, uint64_t compid)
+{
+	char pname[LDMS_PRODUCER_NAME_MAX];
+	char iname[256];
+
+	if (producers > 1)
+		snprintf(pname, sizeof(pname), "%s%u", producer,
+			 s->index % producers);
+	else
+		snprintf(pname, sizeof(pname), "%s", producer);
+	snprintf(iname, sizeof(iname), "%s.%u/%s", instance, s->index,
+		 s->lgs->name);
+	s->set = ldms_set_new(iname, s->lgs->schema);
+	if (!s->set)
+		return errno;
+	ldms_set_producer_name_set(s->set, pname);
+	ldms_transaction_begin(s->set);
+	ldms_metric_set_u64(s->set, 0, compid == UINT64_MAX ? s->index : compid);
+	ldms_metric_set_u32(s->set, 1, s->index);
+	ldms_metric_set_u64(s->set, 2, seed);
+	ldms_metric_set_u32(s->set, 3, mode);
+	ldms_transaction_end(s->set);
+	if (jitter)
+		s->phase = loadgen_mix(seed ^ s->index) % jitter;
+	ldms_set_publish(s->set);
+	ldmsd_set_register(s->set, SAMP);
+	return 0;
+}
+
+static void lg_cleanup(void)
+{
+	int i;
+	if (jitter_thread_used) {
+		pthread_mutex_lock(&lg_lock);
+		lg_stop = 1;
+		pthread_cond_signal(&lg_cv);
+		pthread_mutex_unlock(&lg_lock);
+		pthread_join(jitter_thread, NULL);
+		jitter_thread_used = 0;
+		if (lg_overruns)
+			msglog(LDMSD_LINFO, SAMP ": %" PRIu64 " rounds started "
+			       "before the previous one finished.\n",
+			       lg_overruns);
+	}
+	for (i = 0; lg_sets && i < num_sets; i++) {
+		if (!lg_sets[i].set)
+			continue;
+		ldmsd_set_deregister(ldms_set_instance_name_get(lg_sets[i].set),
+				     SAMP);
+		ldms_set_delete(lg_sets[i].set);
+	}
+	free(lg_sets);
+	lg_sets = NULL;
+	num_sets = 0;
+	for (i = 0; lg_schemas && i < num_schemas; i++) {
+		if (lg_schemas[i].schema)
+			ldms_schema_delete(lg_schemas[i].schema);
+		free(lg_schemas[i].name);
+	}
+	free(lg_schemas);
+	lg_schemas = NULL;
+	num_schemas = 0;
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return  "config name=" SAMP " num_sets=<N> schemas=<specs> [producer=<name>]\n"
+		"       [instance=<prefix>] [producers=<P>] [first=<index>]\n"
+		"       [component_id=<id>] [mode=counter|random] [seed=<u64>]\n"
+		"       [jitter=<usec>]\n"
+		"    num_sets     The number of sets to create.\n"
+		"    schemas      Comma separated name:count:type[/type...][:array_len];\n"
+		"                 sets are given to the schemas round robin.\n"
+		"    producer     Producer name (default " SAMP "); with producers=P > 1\n"
+		"                 set i gets producer name <producer><i % P>.\n"
+		"    instance     Instance names are <instance>.<i>/<schema> (default\n"
+		"                 the producer).\n"
+		"    first        The index of the first set (default 0), so that\n"
+		"                 several daemons can serve disjoint sets.\n"
+		"    component_id Component id of all sets (default the set index).\n"
+		"    mode         counter (default) or random values.\n"
+		"    seed         Value seed (default 1).\n"
+		"    jitter       Spread each round over this many usec (default 0:\n"
+		"                 update all sets at once).\n";
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	char *value, *specs = NULL, *spec, *ptr, *endp;
+	const char *producer, *instance;
+	uint64_t compid = UINT64_MAX;
+	uint32_t first = 0;
+	int producers = 0;
+	int i, rc;
+
+	if (lg_sets) {
+		msglog(LDMSD_LERROR, SAMP ": Sets already created.\n");
+		return EINVAL;
+	}
+
+	value = av_value(avl, "num_sets");
+	if (!value || (num_sets = strtol(value, &endp, 0)) < 1 || *endp) {
+		msglog(LDMSD_LERROR, SAMP ": num_sets=<N> is required.\n");
+		num_sets = 0;
+		return EINVAL;
+	}
+	value = av_value(avl, "schemas");
+	if (!value) {
+		msglog(LDMSD_LERROR, SAMP ": schemas=<specs> is required.\n");
+		rc = EINVAL;
+		goto err;
+	}
+	specs = strdup(value);
+	if (!specs) {
+		rc = ENOMEM;
+		goto err;
+	}
+	producer = av_value(avl, "producer");
+	if (!producer)
+		producer = SAMP;
+	instance = av_value(avl, "instance");
+	if (!instance)
+		instance = producer;
+	value = av_value(avl, "producers");
+	if (value)
+		producers = strtol(value, NULL, 0);
+	value = av_value(avl, "first");
+	if (value)
+		first = strtoul(value, NULL, 0);
+	value = av_value(avl, "component_id");
+	if (value)
+		compid = strtoull(value, NULL, 0);
+	value = av_value(avl, "seed");
+	if (value)
+		seed = strtoull(value, NULL, 0);
+	value = av_value(avl, "jitter");
+	if (value)
+		jitter = strtoull(value, NULL, 0);
+	value = av_value(avl, "mode");
+	if (value) {
+		if (0 == strcmp(value, "random")) {
+			mode = LOADGEN_RANDOM;
+		} else if (0 == strcmp(value, "counter")) {
+			mode = LOADGEN_COUNTER;
+		} else {
+			msglog(LDMSD_LERROR, SAMP ": unknown mode '%s'.\n",
+			       value);
+			rc = EINVAL;
+			goto err;
+		}
+	}
+
+	for (num_schemas = 1, ptr = specs; *ptr; ptr++)
+		num_schemas += (*ptr == ',');
+	lg_schemas = calloc(num_schemas, sizeof(*lg_schemas));
+	lg_sets = calloc(num_sets, sizeof(*lg_sets));
+	if (!lg_schemas || !lg_sets) {
+		rc = ENOMEM;
+		goto err;
+	}
+	i = 0;
+	for (spec = strtok_r(specs, ",", &ptr); spec;
+	     spec = strtok_r(NULL, ",", &ptr)) {
+		rc = parse_schema(spec, &lg_schemas[i]);
+		if (rc)
+			goto err;
+		rc = create_schema(&lg_schemas[i]);
+		if (rc) {
+			msglog(LDMSD_LERROR, SAMP ": cannot create schema "
+			       "'%s': %d\n", lg_schemas[i].name, rc);
+			goto err;
+		}
+		i++;
+	}
+	num_schemas = i;
+	if (!num_schemas) {
+		rc = EINVAL;
+		goto err;
+	}
+
+	for (i = 0; i < num_sets; i++) {
+		lg_sets[i].index = first + i;
+		lg_sets[i].lgs = &lg_schemas[lg_sets[i].index % num_schemas];
+		rc = create_set(&lg_sets[i], producer, instance, producers,
+				compid);
+		if (rc) {
+			msglog(LDMSD_LERROR, SAMP ": cannot create set %d of "
+			       "%d: %d. Is the set memory (ldmsd -m) large "
+			       "enough?\n", i, num_sets, rc);
+			goto err;
+		}
+	}
+	if (jitter) {
+		qsort(lg_sets, num_sets, sizeof(*lg_sets), phase_cmp);
+		lg_stop = 0;
+		rc = pthread_create(&jitter_thread, NULL, jitter_proc, NULL);
+		if (rc)
+			goto err;
+		jitter_thread_used = 1;
+	}
+	msglog(LDMSD_LINFO, SAMP ": %d sets from %d schemas, first index %u.\n",
+	       num_sets, num_schemas, first);
+	free(specs);
+	return 0;
+err:
+	free(specs);
+	lg_cleanup();
+	return rc;
+}
+
+static ldms_set_t get_set(struct ldmsd_sampler *self)
+{
+	return NULL;
+}
+
+static int sample(struct ldmsd_sampler *self)
+{
+	int i;
+
+	if (!lg_sets) {
+		msglog(LDMSD_LDEBUG, SAMP ": plugin not initialized\n");
+		return EINVAL;
+	}
+	if (!jitter) {
+		lg_round++;
+		for (i = 0; i < num_sets; i++)
+			update_set(&lg_sets[i], lg_round);
+		return 0;
+	}
+	pthread_mutex_lock(&lg_lock);
+	if (lg_done_round != lg_round)
+		lg_overruns++;
+	lg_round++;
+	clock_gettime(CLOCK_MONOTONIC, &lg_round_start);
+	pthread_cond_signal(&lg_cv);
+	pthread_mutex_unlock(&lg_lock);
+	return 0;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	lg_cleanup();
+}
+
+static struct ldmsd_sampler loadgen_plugin = {
+	.base = {
+		.name = SAMP,
+		.type = LDMSD_PLUGIN_SAMPLER,
+		.term = term,
+		.config = config,
+		.usage = usage,
+	},
+	.get_set = get_set,
+	.sample = sample,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &loadgen_plugin.base;
+}
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file loadgen.h
+ * \brief Values of the loadgen sampler, shared with its verifier.
+ *
+ * Every loadgen set carries the inputs of its own values: the set index
+ * and seed in its meta data and the update round in its data. A value
+ * is a pure function of (seed, set index, metric, element, round), so a
+ * consumer can recompute every element of every row it receives.
+ */
+#ifndef __LOADGEN_H__
+#define __LOADGEN_H__
+
+#include <stdint.h>
+#include "ldms.h"
+
+#define LOADGEN_INDEX "lg_index"
+#define LOADGEN_SEED "lg_seed"
+#define LOADGEN_MODE "lg_mode"
+/** The update round; the generated metrics follow it in the set. */
+#define LOADGEN_ROUND "lg_round"
+
+enum loadgen_mode {
+	/** each element advances by a fixed per-element step each round */
+	LOADGEN_COUNTER = 0,
+	/** each element is a fresh pseudo-random value each round */
+	LOADGEN_RANDOM = 1,
+};
+
+/* splitmix64 finalizer */
+static inline uint64_t loadgen_mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * The value of element \c elem of generated metric \c metric (0 for the
+ * first metric after lg_round) of set \c index in update \c round.
+ * \param type the scalar type of the metric.
+ */
+static inline void loadgen_value(enum ldms_value_type type, int mode,
+				 uint64_t seed, uint32_t index,
+				 uint32_t metric, uint32_t elem,
+				 uint64_t round, union ldms_value *v)
+{
+	uint64_t h = loadgen_mix(seed ^ loadgen_mix(((uint64_t)index << 32) |
+				 metric) ^ ((uint64_t)elem << 40));
+	uint64_t r;
+
+	if (mode == LOADGEN_RANDOM)
+		r = loadgen_mix(h ^ round);
+	else
+		r = (h % 1000) + round * (1 + ((h >> 32) % 16));
+	switch (type) {
+	case LDMS_V_CHAR:
+		v->v_char = 'a' + r % 26;
+		break;
+	case LDMS_V_U8:
+		v->v_u8 = r;
+		break;
+	case LDMS_V_S8:
+		v->v_s8 = r;
+		break;
+	case LDMS_V_U16:
+		v->v_u16 = r;
+		break;
+	case LDMS_V_S16:
+		v->v_s16 = r;
+		break;
+	case LDMS_V_U32:
+		v->v_u32 = r;
+		break;
+	case LDMS_V_S32:
+		v->v_s32 = r;
+		break;
+	case LDMS_V_U64:
+		v->v_u64 = r;
+		break;
+	case LDMS_V_S64:
+		v->v_s64 = r;
+		break;
+	case LDMS_V_F32:
+		/* 40 bits keeps the d64 value exact */
+		v->v_f = (float)((r & 0xffffffffffULL) / 1024.0);
+		break;
+	case LDMS_V_D64:
+		v->v_d = (r & 0xffffffffffULL) / 1024.0;
+		break;
+	default:
+		v->v_u64 = 0;
+		break;
+	}
+}
+
+#endif
@@ -0,0 +1,350 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file loadgen_verify.c
+ * \brief Store plugin checking the rows of loadgen sets.
+ *
+ * Recomputes every stored element of a loadgen set from the set's own
+ * lg_seed, lg_index, lg_mode and lg_round, and follows lg_round per set
+ * to count the updates the aggregator never stored. Totals are logged
+ * every report interval and when the plugin is unloaded.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "loadgen.h"
+
+#define STORE "loadgen_verify"
+/** mismatches logged in detail before only counting */
+#define LGV_MISMATCH_LOG 10
+
+struct lgv_handle {
+	struct ldmsd_store *store;
+	char *schema;
+	int ids_ok;
+	int index_id, seed_id, mode_id, round_id;
+	void *ucontext;
+};
+
+struct lgv_series {
+	struct rbn rbn;
+	char *name;
+	uint64_t last_round;
+};
+
+static ldmsd_msg_log_f msglog;
+static pthread_mutex_t lgv_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rbt lgv_series_tree;
+static time_t report = 60;
+static time_t last_report;
+
+static struct lgv_stats {
+	uint64_t sets;
+	uint64_t rows;
+	uint64_t values;
+	uint64_t bad_values;
+	uint64_t bad_rows;
+	uint64_t missed;	/* rounds skipped between stored rows */
+	uint64_t repeated;	/* the same round stored again */
+	uint64_t restarts;	/* the round went backward */
+	uint64_t foreign;	/* sets without the loadgen metrics */
+} stats;
+
+static int __series_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static void lgv_report(const char *when)
+{
+	msglog(LDMSD_LINFO, STORE ": %s: %" PRIu64 " sets, %" PRIu64 " rows, %" PRIu64
+	       " values, %" PRIu64 " bad values in %" PRIu64 " rows, %" PRIu64
+	       " missed rounds, %" PRIu64 " repeated, %" PRIu64 " restarts, %"
+	       PRIu64 " foreign rows\n", when, stats.sets,
+	       stats.rows, stats.values, stats.bad_values, stats.bad_rows,
+	       stats.missed, stats.repeated, stats.restarts, stats.foreign);
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return
+"    config name=" STORE " [report=<sec>]\n"
+"           Check rows of loadgen sets; totals are logged every\n"
+"           report seconds (default 60, 0 for only at exit).\n";
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	char *value = av_value(avl, "report");
+	if (value)
+		report = strtol(value, NULL, 0);
+	return 0;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	struct rbn *rbn;
+	struct lgv_series *s;
+
+	pthread_mutex_lock(&lgv_lock);
+	if (stats.rows || stats.foreign)
+		lgv_report("final");
+	while ((rbn = rbt_min(&lgv_series_tree))) {
+		s = container_of(rbn, struct lgv_series, rbn);
+		rbt_del(&lgv_series_tree, rbn);
+		free(s->name);
+		free(s);
+	}
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutex_unlock(&lgv_lock);
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	struct lgv_handle *h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	h->schema = strdup(schema);
+	if (!h->schema) {
+		free(h);
+		return NULL;
+	}
+	h->store = s;
+	h->ucontext = ucontext;
+	return h;
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	struct lgv_handle *h = _sh;
+	return h->ucontext;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	return 0;
+}
+
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct lgv_handle *h = _sh;
+	free(h->schema);
+	free(h);
+}
+
+/* Does element e of metric mid (e ignored for scalars) equal x? */
+static int value_eq(ldms_set_t set, int mid, enum ldms_value_type t,
+		    int arr, int e, union ldms_value *x)
+{
+#define LGV_EQ(_get, _m) ((arr ? ldms_metric_array_get_##_get(set, mid, e) : \
+			   ldms_metric_get_##_get(set, mid)) == x->_m)
+	switch (t) {
+	case LDMS_V_CHAR:
+		return LGV_EQ(char, v_char);
+	case LDMS_V_U8:
+		return LGV_EQ(u8, v_u8);
+	case LDMS_V_S8:
+		return LGV_EQ(s8, v_s8);
+	case LDMS_V_U16:
+		return LGV_EQ(u16, v_u16);
+	case LDMS_V_S16:
+		return LGV_EQ(s16, v_s16);
+	case LDMS_V_U32:
+		return LGV_EQ(u32, v_u32);
+	case LDMS_V_S32:
+		return LGV_EQ(s32, v_s32);
+	case LDMS_V_U64:
+		return LGV_EQ(u64, v_u64);
+	case LDMS_V_S64:
+		return LGV_EQ(s64, v_s64);
+	case LDMS_V_F32:
+		return LGV_EQ(float, v_f);
+	case LDMS_V_D64:
+		return LGV_EQ(double, v_d);
+	default:
+		return 1;
+	}
+#undef LGV_EQ
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set,
+      int *metric_arry, size_t metric_count)
+{
+	struct lgv_handle *h = _sh;
+	const char *name = ldms_set_instance_name_get(set);
+	struct lgv_series *s;
+	struct rbn *rbn;
+	uint64_t seed, round;
+	uint32_t index;
+	int mode;
+	uint64_t values = 0, bad = 0;
+	size_t k;
+	time_t now;
+
+	if (!h->ids_ok) {
+		h->index_id = ldms_metric_by_name(set, LOADGEN_INDEX);
+		h->seed_id = ldms_metric_by_name(set, LOADGEN_SEED);
+		h->mode_id = ldms_metric_by_name(set, LOADGEN_MODE);
+		h->round_id = ldms_metric_by_name(set, LOADGEN_ROUND);
+		h->ids_ok = (h->index_id >= 0 && h->seed_id >= 0 &&
+			     h->mode_id >= 0 && h->round_id >= 0) ? 1 : -1;
+	}
+	if (h->ids_ok < 0) {
+		pthread_mutex_lock(&lgv_lock);
+		stats.foreign++;
+		pthread_mutex_unlock(&lgv_lock);
+		return 0;
+	}
+	index = ldms_metric_get_u32(set, h->index_id);
+	seed = ldms_metric_get_u64(set, h->seed_id);
+	mode = ldms_metric_get_u32(set, h->mode_id);
+	round = ldms_metric_get_u64(set, h->round_id);
+
+	for (k = 0; k < metric_count; k++) {
+		int mid = metric_arry[k];
+		enum ldms_value_type t;
+		union ldms_value x;
+		int arr, e, len;
+
+		if (mid <= h->round_id)
+			continue;
+		t = ldms_metric_type_get(set, mid);
+		arr = ldms_type_is_array(t);
+		if (arr) {
+			t = ldms_metric_type_to_scalar_type(t);
+			len = ldms_metric_array_get_len(set, mid);
+		} else {
+			len = 1;
+		}
+		for (e = 0; e < len; e++) {
+			loadgen_value(t, mode, seed, index, mid - h->round_id - 1,
+				      e, round, &x);
+			values++;
+			if (value_eq(set, mid, t, arr, e, &x))
+				continue;
+			if (bad++ < 1 && stats.bad_values < LGV_MISMATCH_LOG)
+				msglog(LDMSD_LWARNING, STORE ": %s round %"
+				       PRIu64 ": metric %s[%d] is not the "
+				       "generated value.\n", name, round,
+				       ldms_metric_name_get(set, mid), e);
+		}
+	}
+
+	pthread_mutex_lock(&lgv_lock);
+	stats.rows++;
+	stats.values += values;
+	stats.bad_values += bad;
+	stats.bad_rows += (bad != 0);
+	rbn = rbt_find(&lgv_series_tree, name);
+	if (rbn) {
+		s = container_of(rbn, struct lgv_series, rbn);
+		if (round == s->last_round)
+			stats.repeated++;
+		else if (round < s->last_round)
+			stats.restarts++;
+		else
+			stats.missed += round - s->last_round - 1;
+		s->last_round = round;
+	} else {
+		s = calloc(1, sizeof(*s));
+		if (s)
+			s->name = strdup(name);
+		if (s && s->name) {
+			s->last_round = round;
+			rbn_init(&s->rbn, s->name);
+			rbt_ins(&lgv_series_tree, &s->rbn);
+			stats.sets++;
+		} else {
+			free(s);
+		}
+	}
+	now = time(NULL);
+	if (!last_report)
+		last_report = now;
+	if (report && now - last_report >= report) {
+		lgv_report("report");
+		last_report = now;
+	}
+	pthread_mutex_unlock(&lgv_lock);
+	return 0;
+}
+
+static struct ldmsd_store loadgen_verify = {
+	.base = {
+		.name = STORE,
+		.term = term,
+		.config = config,
+		.usage = usage,
+		.type = LDMSD_PLUGIN_STORE,
+	},
+	.open = open_store,
+	.get_context = get_ucontext,
+	.store = store,
+	.flush = flush_store,
+	.close = close_store,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	rbt_init(&lgv_series_tree, __series_cmp);
+	return &loadgen_verify.base;
+}
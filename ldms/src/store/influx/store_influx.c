@@ -12,6 +12,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <linux/limits.h>
 #include <pthread.h>
 #include <errno.h>
@@ -21,10 +23,92 @@
 #include <sys/syscall.h>
 #include <assert.h>
 #include <curl/curl.h>
+#include <zlib.h>
 #include "ldms.h"
 #include "ldmsd.h"
 
 static char host_port[64];	/* hostname:port_no for influxdb */
+
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+#define INFLUX_BATCH_SIZE	65536		/* bytes */
+#define INFLUX_FLUSH_INTERVAL	1000000		/* usec */
+#define INFLUX_MAX_QUEUE	67108864	/* bytes */
+#define INFLUX_MAX_RETRY	3
+#define INFLUX_POLL_MS		100
+
+static size_t batch_size = INFLUX_BATCH_SIZE;
+static uint64_t flush_interval = INFLUX_FLUSH_INTERVAL;
+static size_t max_queue = INFLUX_MAX_QUEUE;
+static int max_retry = INFLUX_MAX_RETRY;
+static int gzip_body = 1;
+static int stats_set = 1;
+
+/*
+ * A batch is a block of line-protocol records ready to be POSTed to
+ * the database. Batches are sealed by store() when the pending buffer
+ * reaches batch_size and by the sender thread when the buffer ages
+ * past flush_interval. The body is gzip'd by the sender thread right
+ * before the first attempt so that the store path never pays for it.
+ */
+struct influx_batch {
+	char *data;
+	size_t len;
+	int recs;
+	int retries;
+	int gzipped;
+	struct timespec retry_at;
+	TAILQ_ENTRY(influx_batch) entry;
+};
+
+/*
+ * One influx_db per InfluxDB database (strgp container). All store
+ * handles writing to the same container share the pending buffer,
+ * the queue of sealed batches and the keep-alive HTTP connection.
+ */
+struct influx_db {
+	char *container;
+	char *url;
+	int ref_count;
+	int closing;
+	pthread_mutex_t lock;
+
+	char *buf;		/* pending records */
+	size_t buf_len;
+	size_t buf_sz;
+	int buf_recs;
+	struct timespec buf_start;
+	int flush_req;
+
+	TAILQ_HEAD(, influx_batch) queue;
+	size_t queue_bytes;
+	struct influx_batch *inflight;
+
+	CURL *curl;
+	struct curl_slist *headers;
+
+	/* counters, in records unless noted */
+	uint64_t buffered;	/* accepted, not yet sent or failed */
+	uint64_t sent;
+	uint64_t failed;	/* dropped after max_retry or on overflow */
+	uint64_t retries;	/* batches */
+	uint64_t bytes_sent;	/* on the wire */
+	ldms_set_t stats;
+
+	LIST_ENTRY(influx_db) entry;
+	TAILQ_ENTRY(influx_db) ready_entry; /* sender_proc only */
+};
+
+enum {
+	STATS_BUFFERED,
+	STATS_SENT,
+	STATS_FAILED,
+	STATS_RETRIES,
+	STATS_QUEUE_BYTES,
+	STATS_BYTES_SENT,
+};
+
 struct influx_store {
 	struct ldmsd_store *store;
 	void *ucontext;
@@ -35,15 +119,22 @@ struct influx_store {
 	int job_mid;
 	int comp_mid;
 	char **metric_name;
-	CURL *curl;
+	struct influx_db *db;
 	char measurement[4096];
 	LIST_ENTRY(influx_store) entry;
 };
 
 static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
 LIST_HEAD(influx_store_list, influx_store) store_list;
+LIST_HEAD(influx_db_list, influx_db) db_list;
 static ldmsd_msg_log_f msglog;
 
+static pthread_t sender_thread;
+static int sender_running;
+static int sender_stop;
+static CURLM *multi;
+static ldms_schema_t stats_schema;
+
 static int set_none_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
 {
 	assert(0 == "Invalid LDMS metric type");
@@ -129,32 +220,549 @@ influx_value_set_fn influx_value_set[] = {
 	[LDMS_V_CHAR_ARRAY] = set_str_fn
 };
 
+static void *sender_proc(void *arg);
+static void db_free(struct influx_db *db);
+
 /**
  * \brief Configuration
  */
 static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct attr_value_list *avl)
 {
 	char *value;
+	char *end;
+	unsigned long ul;
+	long l;
+	int rc = 0;
+
 	pthread_mutex_lock(&cfg_lock);
 
 	value = av_value(avl, "host_port");
 	if (!value) {
 		msglog(LDMSD_LERROR, "The 'host_port' keyword is required.\n");
-		return EINVAL;
+		rc = EINVAL;
+		goto out;
 	}
-	strncpy(host_port, value, sizeof(host_port));
+	strncpy(host_port, value, sizeof(host_port) - 1);
 
+	value = av_value(avl, "batch_size");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0' || !ul) {
+			msglog(LDMSD_LERROR, "store_influx: invalid batch_size '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		batch_size = ul;
+	}
+	value = av_value(avl, "flush_interval");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0' || !ul) {
+			msglog(LDMSD_LERROR, "store_influx: invalid flush_interval '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		flush_interval = ul;
+	}
+	value = av_value(avl, "max_queue");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0' || !ul) {
+			msglog(LDMSD_LERROR, "store_influx: invalid max_queue '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		max_queue = ul;
+	}
+	value = av_value(avl, "retry");
+	if (value) {
+		l = strtol(value, &end, 0);
+		if (*end != '\0' || l < 0 || l > INT_MAX) {
+			msglog(LDMSD_LERROR, "store_influx: invalid retry '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		max_retry = l;
+	}
+	value = av_value(avl, "gzip");
+	if (value) {
+		l = strtol(value, &end, 0);
+		if (*end != '\0' || (l != 0 && l != 1)) {
+			msglog(LDMSD_LERROR, "store_influx: invalid gzip '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		gzip_body = l;
+	}
+	value = av_value(avl, "stats");
+	if (value) {
+		l = strtol(value, &end, 0);
+		if (*end != '\0' || (l != 0 && l != 1)) {
+			msglog(LDMSD_LERROR, "store_influx: invalid stats '%s'.\n", value);
+			rc = EINVAL;
+			goto out;
+		}
+		stats_set = l;
+	}
+ out:
 	pthread_mutex_unlock(&cfg_lock);
-	return 0;
+	return rc;
 }
 
 static void term(struct ldmsd_plugin *self)
 {
+	struct influx_db *db;
+
+	pthread_mutex_lock(&cfg_lock);
+	if (!sender_running) {
+		pthread_mutex_unlock(&cfg_lock);
+		return;
+	}
+	sender_stop = 1;
+	pthread_mutex_unlock(&cfg_lock);
+	pthread_join(sender_thread, NULL);
+
+	pthread_mutex_lock(&cfg_lock);
+	while ((db = LIST_FIRST(&db_list))) {
+		LIST_REMOVE(db, entry);
+		db_free(db);
+	}
+	curl_multi_cleanup(multi);
+	multi = NULL;
+	sender_running = 0;
+	sender_stop = 0;
+	pthread_mutex_unlock(&cfg_lock);
 }
 
 static const char *usage(struct ldmsd_plugin *self)
 {
-	return  "    config name=influx host_port=<hostname>':'<port_no>\n";
+	return  "    config name=influx host_port=<hostname>':'<port_no>\n"
+		"           [batch_size=<bytes>] [flush_interval=<usec>]\n"
+		"           [max_queue=<bytes>] [retry=<count>] [gzip=<0|1>]\n"
+		"           [stats=<0|1>]\n"
+		"        batch_size     Records are POSTed in batches of about this many\n"
+		"                       bytes (default " STR(INFLUX_BATCH_SIZE) ").\n"
+		"        flush_interval A partial batch is sent once it is this old\n"
+		"                       (default " STR(INFLUX_FLUSH_INTERVAL) "us).\n"
+		"        max_queue      Bytes of unsent batches kept per database; the\n"
+		"                       oldest batch is dropped on overflow.\n"
+		"        retry          Send attempts before a batch is dropped (default "
+		STR(INFLUX_MAX_RETRY) ").\n"
+		"        gzip           Compress request bodies (default 1).\n"
+		"        stats          Publish a '<producer>/store_influx/<container>' set\n"
+		"                       with the buffered/sent/failed counters (default 1).\n";
+}
+
+static inline int64_t ts_diff_us(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000L
+		+ (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static size_t discard_body(char *ptr, size_t size, size_t nmemb, void *arg)
+{
+	return size * nmemb;
+}
+
+static ldms_schema_t stats_schema_get()
+{
+	if (stats_schema)
+		return stats_schema;
+	stats_schema = ldms_schema_new("store_influx_stats");
+	if (!stats_schema)
+		return NULL;
+	/* keep in sync with the STATS_ enum */
+	if (ldms_schema_metric_add(stats_schema, "buffered", LDMS_V_U64) < 0
+	    || ldms_schema_metric_add(stats_schema, "sent", LDMS_V_U64) < 0
+	    || ldms_schema_metric_add(stats_schema, "failed", LDMS_V_U64) < 0
+	    || ldms_schema_metric_add(stats_schema, "retries", LDMS_V_U64) < 0
+	    || ldms_schema_metric_add(stats_schema, "queue_bytes", LDMS_V_U64) < 0
+	    || ldms_schema_metric_add(stats_schema, "bytes_sent", LDMS_V_U64) < 0) {
+		ldms_schema_delete(stats_schema);
+		stats_schema = NULL;
+	}
+	return stats_schema;
+}
+
+static void db_stats_create(struct influx_db *db)
+{
+	char name[PATH_MAX];
+	ldms_schema_t schema = stats_schema_get();
+
+	if (!schema)
+		return;
+	snprintf(name, sizeof(name), "%s/store_influx/%s",
+		 ldmsd_myname_get(), db->container);
+	db->stats = ldms_set_new(name, schema);
+	if (!db->stats) {
+		msglog(LDMSD_LINFO, "store_influx: could not create the "
+		       "'%s' stats set, errno %d.\n", name, errno);
+		return;
+	}
+	ldms_set_producer_name_set(db->stats, ldmsd_myname_get());
+	ldms_set_publish(db->stats);
+}
+
+/* db->lock must be held */
+static void db_stats_update(struct influx_db *db)
+{
+	if (!db->stats)
+		return;
+	ldms_transaction_begin(db->stats);
+	ldms_metric_set_u64(db->stats, STATS_BUFFERED, db->buffered);
+	ldms_metric_set_u64(db->stats, STATS_SENT, db->sent);
+	ldms_metric_set_u64(db->stats, STATS_FAILED, db->failed);
+	ldms_metric_set_u64(db->stats, STATS_RETRIES, db->retries);
+	ldms_metric_set_u64(db->stats, STATS_QUEUE_BYTES, db->queue_bytes);
+	ldms_metric_set_u64(db->stats, STATS_BYTES_SENT, db->bytes_sent);
+	ldms_transaction_end(db->stats);
+}
+
+static void batch_free(struct influx_batch *b)
+{
+	free(b->data);
+	free(b);
+}
+
+static void db_free(struct influx_db *db)
+{
+	struct influx_batch *b;
+
+	if (db->inflight) {
+		curl_multi_remove_handle(multi, db->curl);
+		batch_free(db->inflight);
+	}
+	while ((b = TAILQ_FIRST(&db->queue))) {
+		TAILQ_REMOVE(&db->queue, b, entry);
+		batch_free(b);
+	}
+	if (db->buffered)
+		msglog(LDMSD_LERROR, "store_influx: %s: %" PRIu64 " records "
+		       "were not sent.\n", db->container, db->buffered);
+	msglog(LDMSD_LINFO, "store_influx: %s: sent %" PRIu64 ", failed %"
+	       PRIu64 ", retries %" PRIu64 ", bytes %" PRIu64 ".\n",
+	       db->container,
+	       db->sent, db->failed, db->retries, db->bytes_sent);
+	if (db->stats) {
+		ldms_set_unpublish(db->stats);
+		ldms_set_delete(db->stats);
+	}
+	if (db->curl)
+		curl_easy_cleanup(db->curl);
+	free(db->buf);
+	free(db->url);
+	free(db->container);
+	free(db);
+}
+
+/* cfg_lock must be held */
+static struct influx_db *db_get(const char *container)
+{
+	struct influx_db *db;
+	size_t len;
+
+	LIST_FOREACH(db, &db_list, entry) {
+		if (!db->closing && 0 == strcmp(db->container, container)) {
+			db->ref_count++;
+			return db;
+		}
+	}
+	db = calloc(1, sizeof(*db));
+	if (!db)
+		return NULL;
+	pthread_mutex_init(&db->lock, NULL);
+	TAILQ_INIT(&db->queue);
+	db->ref_count = 1;
+	db->container = strdup(container);
+	if (!db->container)
+		goto err;
+	len = strlen(host_port) + strlen(container) + 32;
+	db->url = malloc(len);
+	if (!db->url)
+		goto err;
+	snprintf(db->url, len, "http://%s/write?db=%s", host_port, container);
+	db->curl = curl_easy_init();
+	if (!db->curl)
+		goto err;
+	curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+	curl_easy_setopt(db->curl, CURLOPT_PRIVATE, db);
+	curl_easy_setopt(db->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(db->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(db->curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(db->curl, CURLOPT_TIMEOUT, 30L);
+	curl_easy_setopt(db->curl, CURLOPT_WRITEFUNCTION, discard_body);
+	if (stats_set)
+		db_stats_create(db);
+	LIST_INSERT_HEAD(&db_list, db, entry);
+	return db;
+ err:
+	db_free(db);
+	return NULL;
+}
+
+/* cfg_lock must be held */
+static void db_put(struct influx_db *db)
+{
+	if (--db->ref_count)
+		return;
+	/* The sender sends what is left and then frees the db */
+	pthread_mutex_lock(&db->lock);
+	db->closing = 1;
+	pthread_mutex_unlock(&db->lock);
+}
+
+/*
+ * Move the pending records to the send queue. If the queue is over
+ * max_queue, the oldest batches are dropped. db->lock must be held.
+ */
+static void db_seal(struct influx_db *db)
+{
+	struct influx_batch *b, *ob;
+
+	if (!db->buf_len)
+		return;
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return;	/* keep buffering, try again later */
+	b->data = db->buf;
+	b->len = db->buf_len;
+	b->recs = db->buf_recs;
+	db->buf = NULL;
+	db->buf_len = db->buf_sz = 0;
+	db->buf_recs = 0;
+	db->flush_req = 0;
+	TAILQ_INSERT_TAIL(&db->queue, b, entry);
+	db->queue_bytes += b->len;
+	while (db->queue_bytes > max_queue) {
+		ob = TAILQ_FIRST(&db->queue);
+		if (ob == b)
+			break;
+		TAILQ_REMOVE(&db->queue, ob, entry);
+		db->queue_bytes -= ob->len;
+		db->buffered -= ob->recs;
+		db->failed += ob->recs;
+		msglog(LDMSD_LERROR, "store_influx: %s: send queue is full, "
+		       "dropped %d records.\n", db->container, ob->recs);
+		batch_free(ob);
+	}
+}
+
+/* db->lock must be held */
+static int db_append(struct influx_db *db, const char *line, size_t len)
+{
+	size_t sz;
+	char *buf;
+
+	if (db->buf_len + len + 1 > db->buf_sz) {
+		sz = db->buf_sz ? db->buf_sz * 2 : batch_size + 4096;
+		while (sz < db->buf_len + len + 1)
+			sz *= 2;
+		buf = realloc(db->buf, sz);
+		if (!buf)
+			return ENOMEM;
+		db->buf = buf;
+		db->buf_sz = sz;
+	}
+	if (!db->buf_len)
+		clock_gettime(CLOCK_MONOTONIC, &db->buf_start);
+	memcpy(&db->buf[db->buf_len], line, len);
+	db->buf_len += len;
+	db->buf[db->buf_len++] = '\n';
+	db->buf_recs++;
+	db->buffered++;
+	if (db->buf_len >= batch_size)
+		db_seal(db);
+	return 0;
+}
+
+static int batch_gzip(struct influx_batch *b)
+{
+	z_stream zs;
+	uLong bound;
+	char *out;
+	int rc;
+
+	memset(&zs, 0, sizeof(zs));
+	/* windowBits + 16 selects the gzip wrapper */
+	rc = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+			  15 + 16, 8, Z_DEFAULT_STRATEGY);
+	if (rc != Z_OK)
+		return ENOMEM;
+	bound = deflateBound(&zs, b->len);
+	out = malloc(bound);
+	if (!out) {
+		deflateEnd(&zs);
+		return ENOMEM;
+	}
+	zs.next_in = (Bytef *)b->data;
+	zs.avail_in = b->len;
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = bound;
+	rc = deflate(&zs, Z_FINISH);
+	deflateEnd(&zs);
+	if (rc != Z_STREAM_END) {
+		free(out);
+		return EIO;
+	}
+	free(b->data);
+	b->data = out;
+	b->len = zs.total_out;
+	b->gzipped = 1;
+	return 0;
+}
+
+static struct curl_slist *hdr_plain;
+static struct curl_slist *hdr_gzip;
+
+/* Start sending the head of the queue if the connection is idle */
+static void db_send(struct influx_db *db, struct timespec *now)
+{
+	struct influx_batch *b;
+
+	pthread_mutex_lock(&db->lock);
+	b = TAILQ_FIRST(&db->queue);
+	if (!b || db->inflight
+	    || (b->retries && ts_diff_us(now, &b->retry_at) < 0)) {
+		pthread_mutex_unlock(&db->lock);
+		return;
+	}
+	TAILQ_REMOVE(&db->queue, b, entry);
+	db->queue_bytes -= b->len;
+	db->inflight = b;
+	pthread_mutex_unlock(&db->lock);
+
+	if (gzip_body && !b->gzipped)
+		(void)batch_gzip(b);
+	curl_easy_setopt(db->curl, CURLOPT_POSTFIELDS, b->data);
+	curl_easy_setopt(db->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)b->len);
+	curl_easy_setopt(db->curl, CURLOPT_HTTPHEADER,
+			 b->gzipped ? hdr_gzip : hdr_plain);
+	curl_multi_add_handle(multi, db->curl);
+}
+
+static void db_done(struct influx_db *db, CURLcode res)
+{
+	struct influx_batch *b = db->inflight;
+	long code = 0;
+
+	curl_multi_remove_handle(multi, db->curl);
+	if (res == CURLE_OK)
+		curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &code);
+
+	pthread_mutex_lock(&db->lock);
+	db->inflight = NULL;
+	if (code / 100 == 2) {
+		db->sent += b->recs;
+		db->buffered -= b->recs;
+		db->bytes_sent += b->len;
+		batch_free(b);
+		goto out;
+	}
+	if (code / 100 != 4 && b->retries < max_retry) {
+		/* transport error or server side failure, try again */
+		b->retries++;
+		db->retries++;
+		clock_gettime(CLOCK_MONOTONIC, &b->retry_at);
+		b->retry_at.tv_sec += b->retries;
+		TAILQ_INSERT_HEAD(&db->queue, b, entry);
+		db->queue_bytes += b->len;
+		goto out;
+	}
+	if (res != CURLE_OK)
+		msglog(LDMSD_LERROR, "store_influx: %s: dropped %d records, "
+		       "%s.\n", db->container, b->recs, curl_easy_strerror(res));
+	else
+		msglog(LDMSD_LERROR, "store_influx: %s: dropped %d records, "
+		       "HTTP status %ld.\n", db->container, b->recs, code);
+	db->failed += b->recs;
+	db->buffered -= b->recs;
+	batch_free(b);
+ out:
+	pthread_mutex_unlock(&db->lock);
+}
+
+static void *sender_proc(void *arg)
+{
+	struct influx_db *db, *next;
+	TAILQ_HEAD(, influx_db) ready;
+	struct timespec now;
+	CURLMsg *msg;
+	int running, n;
+
+	while (!sender_stop) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		TAILQ_INIT(&ready);
+		pthread_mutex_lock(&cfg_lock);
+		for (db = LIST_FIRST(&db_list); db; db = next) {
+			next = LIST_NEXT(db, entry);
+			pthread_mutex_lock(&db->lock);
+			if (db->buf_len
+			    && (db->flush_req || db->closing
+				|| ts_diff_us(&now, &db->buf_start) >= flush_interval))
+				db_seal(db);
+			db_stats_update(db);
+			if (db->closing && !db->inflight && TAILQ_EMPTY(&db->queue)) {
+				pthread_mutex_unlock(&db->lock);
+				LIST_REMOVE(db, entry);
+				db_free(db);
+				continue;
+			}
+			if (!db->inflight && !TAILQ_EMPTY(&db->queue))
+				TAILQ_INSERT_TAIL(&ready, db, ready_entry);
+			pthread_mutex_unlock(&db->lock);
+		}
+		pthread_mutex_unlock(&cfg_lock);
+
+		/*
+		 * Compress and send without cfg_lock. Only this thread
+		 * frees a database on the list, so the ready ones stay.
+		 */
+		TAILQ_FOREACH(db, &ready, ready_entry)
+			db_send(db, &now);
+
+		curl_multi_perform(multi, &running);
+		while ((msg = curl_multi_info_read(multi, &n))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&db);
+			db_done(db, msg->data.result);
+		}
+		curl_multi_wait(multi, NULL, 0, INFLUX_POLL_MS, &n);
+	}
+	return NULL;
+}
+
+/* cfg_lock must be held */
+static int sender_start()
+{
+	int rc;
+
+	if (sender_running)
+		return 0;
+	if (!hdr_plain) {
+		hdr_plain = curl_slist_append(NULL, "Content-Type: application/influx");
+		hdr_gzip = curl_slist_append(NULL, "Content-Type: application/influx");
+		hdr_gzip = curl_slist_append(hdr_gzip, "Content-Encoding: gzip");
+		if (!hdr_plain || !hdr_gzip)
+			return ENOMEM;
+	}
+	multi = curl_multi_init();
+	if (!multi)
+		return ENOMEM;
+	/*
+	 * Each database sends one batch at a time on its own easy handle,
+	 * which keeps its connection alive. Databases on the same host
+	 * must not wait for each other, so the host is not limited.
+	 */
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 0L);
+	rc = pthread_create(&sender_thread, NULL, sender_proc, NULL);
+	if (rc) {
+		curl_multi_cleanup(multi);
+		multi = NULL;
+		return rc;
+	}
+	sender_running = 1;
+	return 0;
 }
 
 static ldmsd_store_handle_t
@@ -181,13 +789,21 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
 	is->job_mid = -1;
 	is->comp_mid = -1;
 
-	is->curl = curl_easy_init();
-	if (!is->curl)
-		goto err3;
 	pthread_mutex_lock(&cfg_lock);
+	if (sender_start()) {
+		pthread_mutex_unlock(&cfg_lock);
+		goto err4;
+	}
+	is->db = db_get(container);
+	if (!is->db) {
+		pthread_mutex_unlock(&cfg_lock);
+		goto err4;
+	}
 	LIST_INSERT_HEAD(&store_list, is, entry);
 	pthread_mutex_unlock(&cfg_lock);
 	return is;
+ err4:
+	free(is->host_port);
  err3:
 	free(is->schema);
  err2:
@@ -290,13 +906,6 @@ store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_
 			goto err;
 	}
 
-	char url[128];
-	snprintf(url, sizeof(url), "http://%s/write?db=%s", is->host_port, is->container);
-	curl_easy_setopt(is->curl, CURLOPT_URL, url);
-
-	struct curl_slist *headers = NULL;
-	headers = curl_slist_append(headers, "Content-Type: application/influx");
-
 	measurement = is->measurement;
 	cnt = snprintf(measurement, 4096,
 		       "%s,job_id=%lui,component_id=%lui ",
@@ -337,13 +946,15 @@ store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_
 	cnt = snprintf(&measurement[off], 4096 - off, " %lld", ts);
 	off += cnt;
 
-	curl_easy_setopt(is->curl, CURLOPT_POSTFIELDS, measurement);
-	curl_easy_setopt(is->curl, CURLOPT_POSTFIELDSIZE, off);
-	curl_easy_setopt(is->curl, CURLOPT_HTTPHEADER, headers);
-	curl_easy_perform(is->curl);
-	curl_slist_free_all(headers);
+	/* queued for the sender thread, see db_send() */
+	pthread_mutex_lock(&is->db->lock);
+	rc = db_append(is->db, measurement, off);
+	pthread_mutex_unlock(&is->db->lock);
 	pthread_mutex_unlock(&is->lock);
-	return 0;
+	if (rc)
+		msglog(LDMSD_LERROR, "store_influx: out of memory buffering "
+		       "'%s' records.\n", is->container);
+	return rc;
 err:
 	pthread_mutex_unlock(&is->lock);
 	msglog(LDMSD_LERROR, "Overflow formatting InfluxDB measurement data.\n");
@@ -352,6 +963,13 @@ err:
 
 static int flush_store(ldmsd_store_handle_t _sh)
 {
+	struct influx_store *is = _sh;
+
+	if (!is)
+		return EINVAL;
+	pthread_mutex_lock(&is->db->lock);
+	db_seal(is->db);
+	pthread_mutex_unlock(&is->db->lock);
 	return 0;
 }
 
@@ -364,8 +982,10 @@ static void close_store(ldmsd_store_handle_t _sh)
 
 	pthread_mutex_lock(&cfg_lock);
 	LIST_REMOVE(is, entry);
+	db_put(is->db);
 	pthread_mutex_unlock(&cfg_lock);
 
+	free(is->host_port);
 	free(is->container);
 	free(is->schema);
 	free(is);
@@ -403,6 +1023,7 @@ static void store_influx_init()
 {
 	curl_global_init(CURL_GLOBAL_DEFAULT);
 	LIST_INIT(&store_list);
+	LIST_INIT(&db_list);
 }
 
 static void __attribute__ ((destructor)) store_influx_fini(void);
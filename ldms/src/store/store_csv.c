@@ -117,6 +117,14 @@ static int rolltype = -1;
 static ldmsd_msg_log_f msglog;
 static pthread_t rothread;
 static int rothread_used = 0;
+/** compresses rolled over outputs, if configured */
+static csv_compress_t compress;
+/** data files are written through compress rather than raw */
+static bool compress_stream;
+/** defaults for the compress_ options */
+#define COMPRESS_THREADS 1
+#define COMPRESS_QUEUE 64
+#define COMPRESS_RETRIES 3
 
 #define _stringify(_x) #_x
 #define stringify(_x) _stringify(_x)
@@ -165,6 +173,15 @@ static char* allocStoreKey(const char* container, const char* schema){
 }
 
 
+/* Open a data file, through the compressing stream if configured. */
+static FILE *open_output(const char *path)
+{
+	if (compress_stream)
+		return csv_compress_fopen(compress, path,
+					  LDMSD_DEFAULT_FILE_PERM);
+	return fopen_perm(path, "a+", LDMSD_DEFAULT_FILE_PERM);
+}
+
 struct roll_cb_arg {
 	struct csv_plugin_static *cps;
 	time_t appx;
@@ -226,7 +243,7 @@ static void roll_cb(void *obj, void *cb_arg)
 	//re name: if got here, then rollover requested
 	snprintf(tmp_path, PATH_MAX, "%s.%d",
 		 s_handle->path, (int) appx);
-	nfp = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+	nfp = open_output(tmp_path);
 	if (!nfp){
 		//we cant open the new file, skip
 		msglog(LDMSD_LERROR, PNAME ": Error: cannot open file <%s>\n",
@@ -257,7 +274,7 @@ static void roll_cb(void *obj, void *cb_arg)
 			NOTE_HDR, CSHC(s_handle), cps);
 		strcpy(roc.headerfilename, tmp_headerpath);
 	} else {
-		nhfp = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+		nhfp = open_output(tmp_path);
 		if (!nhfp){
 			fclose(nfp);
 			msglog(LDMSD_LERROR, PNAME ": Error: cannot open file <%s>\n",
@@ -274,25 +291,28 @@ static void roll_cb(void *obj, void *cb_arg)
 	}
 
 	//close and swap
+	if (s_handle->headerfile) {
+		/* may share the data file, so close it before retiring that */
+		fclose(s_handle->headerfile);
+	}
 	if (s_handle->file) {
 		fclose(s_handle->file);
 		notify_output(NOTE_CLOSE, s_handle-> filename, NOTE_DAT,
 			CSHC(s_handle), cps);
-		rename_output(s_handle->filename, NOTE_DAT,
-			CSHC(s_handle), cps);
-	}
-	if (s_handle->headerfile) {
-		fclose(s_handle->headerfile);
+		retire_output(s_handle->filename, NOTE_DAT,
+			CSHC(s_handle), cps, compress, compress_stream);
 	}
 	if (s_handle->headerfilename) {
 		notify_output(NOTE_CLOSE, s_handle-> headerfilename, NOTE_HDR,
 			CSHC(s_handle), cps);
-		rename_output(s_handle->headerfilename, NOTE_HDR,
-			CSHC(s_handle), cps);
+		/* without altheader this is the data file, retired above */
+		if (s_handle->altheader)
+			retire_output(s_handle->headerfilename, NOTE_HDR,
+				CSHC(s_handle), cps, compress, false);
 	}
 	if (s_handle->typefilename) {
-		rename_output(s_handle->typefilename, NOTE_KIND,
-			CSHC(s_handle), cps);
+		retire_output(s_handle->typefilename, NOTE_KIND,
+			CSHC(s_handle), cps, compress, false);
 		snprintf(tmp_typepath, PATH_MAX, "%s.KIND.%d",
 			s_handle->path, (int)appx);
 		strcpy(roc.typefilename, tmp_typepath);
@@ -482,6 +502,13 @@ static const char *update_blacklist[] = {
 	"rollagain", 
 	"rollover", 
 	"rolltype", 
+	"compress",
+	"compress_level",
+	"compress_threads",
+	"compress_queue",
+	"compress_rate",
+	"compress_retries",
+	"compress_stream",
 	NULL
 };
 
@@ -532,6 +559,67 @@ out:
 	return rc;
 }
 
+/**
+ * Start the compression of rolled over outputs, if configured.
+ * Called once, with the rollover settings.
+ */
+static int config_compress(int rollmethod)
+{
+	int32_t level = -1;
+	int32_t threads = COMPRESS_THREADS;
+	int32_t queue = COMPRESS_QUEUE;
+	int32_t retries = COMPRESS_RETRIES;
+	uint64_t rate = 0;
+	bool stream = false;
+	int cvt;
+
+	const char *codec = ldmsd_plugattr_value(pa, "compress", NULL);
+	if (!codec)
+		return 0;
+	if (rollmethod < MINROLLTYPE) {
+		msglog(LDMSD_LERROR, PNAME
+			": compress= requires rollover= and rolltype=.\n");
+		return EINVAL;
+	}
+	struct {
+		const char *name;
+		int32_t *val;
+	} *a, s32s[] = {
+		{ "compress_level", &level },
+		{ "compress_threads", &threads },
+		{ "compress_queue", &queue },
+		{ "compress_retries", &retries },
+		{ NULL, NULL }
+	};
+	for (a = s32s; a->name; a++) {
+		cvt = ldmsd_plugattr_s32(pa, a->name, NULL, a->val);
+		if (cvt && cvt != ENOKEY) {
+			msglog(LDMSD_LERROR, PNAME ": improper %s= input.\n",
+			       a->name);
+			return EINVAL;
+		}
+	}
+	cvt = ldmsd_plugattr_u64(pa, "compress_rate", NULL, &rate);
+	if (cvt && cvt != ENOKEY) {
+		msglog(LDMSD_LERROR, PNAME ": improper compress_rate= input.\n");
+		return EINVAL;
+	}
+	cvt = ldmsd_plugattr_bool(pa, "compress_stream", NULL, &stream);
+	if (cvt == -1) {
+		msglog(LDMSD_LERROR, PNAME ": improper compress_stream= input.\n");
+		return EINVAL;
+	}
+
+	compress = csv_compress_new(codec, level, threads, queue, rate,
+				    retries, msglog, PNAME);
+	if (!compress)
+		return errno;
+	compress_stream = stream;
+	msglog(LDMSD_LINFO, PNAME ": %s rolled over files with %s.\n",
+	       stream ? "writing" : "compressing", codec);
+	return 0;
+}
+
 /**
  * \brief Configuration
  */
@@ -548,6 +636,13 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 		"rollagain",
 		"rollover",
 		"rolltype",
+		"compress",
+		"compress_level",
+		"compress_threads",
+		"compress_queue",
+		"compress_rate",
+		"compress_retries",
+		"compress_stream",
 		CSV_STORE_ATTR_COMMON,
 		NULL
 	};
@@ -687,6 +782,10 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 		goto out;
 	}
 
+	rc = config_compress(rollmethod);
+	if (rc)
+		goto out;
+
 	rollover = roll;
 	rollagain = ragain;
 	if (rollmethod >= MINROLLTYPE) {
@@ -718,6 +817,9 @@ static const char *usage(struct ldmsd_plugin *self)
 		"           [rename_template=<metapath> [rename_uid=<int-uid> [rename_gid=<int-gid]\n"
 		"               rename_perm=<octal-mode>]]\n"
 		"           [create_uid=<int-uid> [create_gid=<int-gid] create_perm=<octal-mode>]\n"
+		"           [compress=<gzip/xz> compress_level=<num> compress_threads=<num>\n"
+		"               compress_queue=<num> compress_rate=<bytes/s>\n"
+		"               compress_retries=<num> compress_stream=<0/1>]\n"
 		"         - Set the root path for the storage of csvs and some default parameters\n"
 		"         - path      The path to the root of the csv directory\n"
 		"         - altheader Header in a separate file (optional, default 0)\n"
@@ -731,6 +833,7 @@ static const char *usage(struct ldmsd_plugin *self)
 		"         - rollover  Greater than or equal to zero; enables file rollover and sets interval\n"
 		"         - rolltype  [1-n] Defines the policy used to schedule rollover events.\n"
 		ROLLTYPES
+		COMPRESS_USAGE
 		"         - buffer    0 to disable buffering, 1 to enable it with autosize (default)\n"
 		"                     N > 1 to flush after that many kb (> 4) or that many lines (>=1)\n"
 		"         - buffertype [3,4] Defines the policy used to schedule buffer flush.\n"
@@ -938,7 +1041,7 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	char tp3[PATH_MAX];
 	struct roll_common roc = { tp1, tp2, tp3 };
 	if (!s_handle->file) { /* theoretically, we should never already have this file */
-		s_handle->file = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+		s_handle->file = open_output(tmp_path);
 		s_handle->otime = appx;
 	}
 	if (!s_handle->file){
@@ -975,7 +1078,7 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 			}
 			strcpy(roc.headerfilename, tmp_headerpath);
 		} else {
-			s_handle->headerfile = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+			s_handle->headerfile = open_output(tmp_path);
 			strcpy(roc.headerfilename, tmp_path);
 		}
 
@@ -1601,7 +1704,7 @@ static void close_store(ldmsd_store_handle_t _s_handle)
 	if (s_handle->headerfile)
 		fclose(s_handle->headerfile);
 	s_handle->headerfile = NULL;
-	CLOSE_STORE_COMMON(s_handle);
+	CLOSE_STORE_COMPRESS(s_handle, compress, compress_stream);
 
 	idx_delete(store_idx, s_handle->store_key, strlen(s_handle->store_key));
 
@@ -1659,6 +1762,8 @@ static void store_csv_fini()
 		pthread_cancel(rothread);
 		pthread_join(rothread, &dontcare);
 	}
+	csv_compress_free(compress);
+	compress = NULL;
 	pa = NULL;
 	store_idx = NULL;
 }
@@ -52,6 +52,7 @@
 #define store_csv_common_lib
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
@@ -306,22 +307,23 @@ int create_outdir(const char *path, struct csv_store_handle_common *s_handle,
 #undef EBSIZE
 }
 
-void rename_output(const char *name,
+/* Returns the new name, or NULL if the file was not renamed. */
+static char *__rename_output(const char *name,
 	const char *ftype, struct csv_store_handle_common *s_handle,
 	struct csv_plugin_static *cps) {
 #define EBSIZE 512
 	char errbuf[EBSIZE];
 	if (!cps) {
-		return;
+		return NULL;
 	}
 	if (!s_handle) {
 		cps->msglog(LDMSD_LERROR,"rename_output: NULL store handle received.\n");
-		return;
+		return NULL;
 	}
 	const char *container = s_handle->container;
 	const char *schema = s_handle->schema;
 	if (s_handle && !s_handle->rename_template)
-		return;
+		return NULL;
 	char *rt = s_handle->rename_template;
 	if (!rt || !name || !ftype || !container || !schema) {
 		cps->msglog(LDMSD_LDEBUG,"Invalid argument in rename_output"
@@ -332,7 +334,7 @@ void rename_output(const char *name,
 				container ? container : "missing container",
 				schema ? schema : "missing schema",
 				s_handle, cps);
-		return;
+		return NULL;
 	}
 	mode_t mode = (mode_t) s_handle->rename_perm;
 	if (mode > 0) {
@@ -393,7 +395,7 @@ void rename_output(const char *name,
 			} else {
 				cps->msglog(LDMSD_LERROR,"%s: rename_output: ENOMEM\n", cps->pname);
 				dstr_free(&ds);
-				return;
+				return NULL;
 			}
 			break;
 		case 'D':
@@ -406,7 +408,7 @@ void rename_output(const char *name,
 			} else {
 				cps->msglog(LDMSD_LERROR,"%s: rename_output: ENOMEM\n", cps->pname);
 				dstr_free(&ds);
-				return;
+				return NULL;
 			}
 			break;
 		case '{':
@@ -417,7 +419,7 @@ void rename_output(const char *name,
 					"%s: rename_output: unterminated %%{ in template at %s\n",
 					cps->pname, head);
 				dstr_free(&ds);
-				return;
+				return NULL;
 			} else {
 				size_t vlen = vend - head + 1;
 				char var[vlen];
@@ -436,7 +438,7 @@ void rename_output(const char *name,
 						cps->msglog(LDMSD_LERROR,
 							"%s: rename_output: rename cancelled\n",
 							cps->pname);
-						return;
+						return NULL;
 					}
 					dscat(ds, val);
 				} else {
@@ -452,7 +454,7 @@ void rename_output(const char *name,
 			if (!dot) {
 				cps->msglog(LDMSD_LERROR,"%s: rename_output: no timestamp\n", cps->pname);
 				dstr_free(&ds);
-				return;
+				return NULL;
 			}
 			dot = dot + 1;
 			char *num = dot;
@@ -462,7 +464,7 @@ void rename_output(const char *name,
 			if (*num != '\0') {
 				cps->msglog(LDMSD_LERROR,"%s: rename_output: no timestamp at end\n", cps->pname);
 				dstr_free(&ds);
-				return;
+				return NULL;
 			}
 			dscat(ds,dot);
 			break;
@@ -479,7 +481,7 @@ void rename_output(const char *name,
 	if (!newname) {
 		cps->msglog(LDMSD_LERROR,"%s: rename_output: failed to create new filename for %s\n",
 			cps->pname, name);
-		return;
+		return NULL;
 	}
 
 	namedup = strdup(newname);
@@ -510,7 +512,8 @@ void rename_output(const char *name,
 			strerror_r(err, errbuf, EBSIZE);
 			cps->msglog(LDMSD_LERROR, "%s: rename_output: failed to create directory for %s: %s\n",
 				cps->pname, newname, errbuf);
-			return;
+			free(newname);
+			return NULL;
 		}
 
 	}
@@ -526,11 +529,47 @@ void rename_output(const char *name,
 				cps->pname, name, newname, errbuf);
 		}
 		/* enoent happens if altheader = 0 or typeheader = 0 */
+		free(newname);
+		return NULL;
 	}
-	free(newname);
+	return newname;
 #undef EBSIZE
 }
 
+char *rename_output_path(const char *name,
+	const char *ftype, struct csv_store_handle_common *s_handle,
+	struct csv_plugin_static *cps) {
+	if (!name)
+		return NULL;
+	char *newname = __rename_output(name, ftype, s_handle, cps);
+	return newname ? newname : strdup(name);
+}
+
+void rename_output(const char *name,
+	const char *ftype, struct csv_store_handle_common *s_handle,
+	struct csv_plugin_static *cps) {
+	free(__rename_output(name, ftype, s_handle, cps));
+}
+
+void retire_output(const char *name, const char *type,
+	struct csv_store_handle_common *s_handle,
+	struct csv_plugin_static *cps,
+	csv_compress_t cz, bool stream) {
+	if (!cz) {
+		rename_output(name, type, s_handle, cps);
+		return;
+	}
+	char *path = rename_output_path(name, type, s_handle, cps);
+	if (!path)
+		return;
+	int rc = stream ? csv_compress_finish(cz, path) :
+		csv_compress_submit(cz, path);
+	if (rc)
+		cps->msglog(LDMSD_LERROR, "%s: %s left uncompressed: %s\n",
+			cps->pname, path, strerror(rc));
+	free(path);
+}
+
 void ch_output(FILE *f, const char *name,
 	struct csv_store_handle_common *s_handle,
 	struct csv_plugin_static *cps) {
@@ -547,6 +586,7 @@ void ch_output(FILE *f, const char *name,
 		cps->msglog(LDMSD_LERROR,"ch_output: NULL FILE pointer received.\n");
 		return;
 	}
+	/* a compressing stream has no descriptor; go by name */
 	int fd = fileno(f);
 	const mode_t ex = S_IXUSR | S_IXGRP | S_IXOTH;
 	mode_t mode = (mode_t) s_handle->create_perm;
@@ -554,7 +594,7 @@ void ch_output(FILE *f, const char *name,
 	mode &= ~ex;
 	if (mode > 0) {
 		errno = 0;
-		int merr = fchmod(fd, mode);
+		int merr = fd < 0 ? chmod(name, mode) : fchmod(fd, mode);
 		int rc = errno;
 		if (merr) {
 			strerror_r(rc, errbuf, EBSIZE);
@@ -568,7 +608,8 @@ void ch_output(FILE *f, const char *name,
 	if (newuid != (uid_t)-1 || newgid != (gid_t)-1)
 	{
 		errno = 0;
-		int merr = fchown(fd, newuid, newgid);
+		int merr = fd < 0 ? chown(name, newuid, newgid) :
+			fchown(fd, newuid, newgid);
 		int rc = errno;
 		if (merr) {
 			strerror_r(rc, errbuf, EBSIZE);
@@ -1035,6 +1076,10 @@ int open_store_common(struct plugattr *pa, struct csv_store_handle_common *s_han
 }
 
 void close_store_common(struct csv_store_handle_common *s_handle, struct csv_plugin_static *cps) {
+	close_store_compress(s_handle, cps, NULL, false);
+}
+
+void close_store_compress(struct csv_store_handle_common *s_handle, struct csv_plugin_static *cps, csv_compress_t cz, bool stream) {
 	if (!s_handle || !cps) {
 		cps->msglog(LDMSD_LERROR,
 			"%s: close_store_common with null argument\n",
@@ -1045,9 +1090,15 @@ void close_store_common(struct csv_store_handle_common *s_handle, struct csv_plu
 	notify_output(NOTE_CLOSE, s_handle->filename, NOTE_DAT, s_handle, cps);
 	notify_output(NOTE_CLOSE, s_handle->headerfilename, NOTE_HDR, s_handle,
 		cps);
-	rename_output(s_handle->filename, NOTE_DAT, s_handle, cps);
-	rename_output(s_handle->headerfilename, NOTE_HDR, s_handle, cps);
-	rename_output(s_handle->typefilename, NOTE_KIND, s_handle, cps);
+	/* without altheader the header is the data file, already retired */
+	bool hdr = !s_handle->filename || !s_handle->headerfilename ||
+		strcmp(s_handle->filename, s_handle->headerfilename);
+	retire_output(s_handle->filename, NOTE_DAT, s_handle, cps, cz, stream);
+	if (hdr)
+		retire_output(s_handle->headerfilename, NOTE_HDR, s_handle,
+			cps, cz, false);
+	retire_output(s_handle->typefilename, NOTE_KIND, s_handle, cps, cz,
+		false);
 	replace_string(&(s_handle->filename), NULL);
 	replace_string(&(s_handle->headerfilename),  NULL);
 	replace_string(&(s_handle->typefilename),  NULL);
@@ -60,6 +60,7 @@
 #include <ovis_util/notification.h>
 #include "ldmsd.h"
 #include "ldmsd_plugattr.h"
+#include "store_csv_compress.h"
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*a))
@@ -230,6 +231,26 @@ void rename_output(const char *name, const char *type,
 	struct csv_store_handle_common *s_handle,
 	struct csv_plugin_static *cps);
 
+/**
+ * As rename_output, but return the name the file has afterward.
+ * \return an allocated path the caller must free: the new name if the
+ * template renamed the file, else a copy of name; NULL if name is NULL
+ * or memory is exhausted.
+ */
+char *rename_output_path(const char *name, const char *type,
+	struct csv_store_handle_common *s_handle,
+	struct csv_plugin_static *cps);
+
+/**
+ * Rename a closed output as rename_output does and then, if cz is not
+ * NULL, give it to cz: as a finished compressed stream if stream is true,
+ * else to be compressed in the background.
+ */
+void retire_output(const char *name, const char *type,
+	struct csv_store_handle_common *s_handle,
+	struct csv_plugin_static *cps,
+	csv_compress_t cz, bool stream);
+
 /**
  * Chmod/chown a new output file per the create_ parameters.
  * Failures will be logged; there is no way to detect them here.
@@ -281,6 +302,14 @@ int open_store_common(struct plugattr *pa, struct csv_store_handle_common *s_han
 /** \brief clean up handle fields configured by CONFIG_INIT_COMMON */
 extern void close_store_common(struct csv_store_handle_common *s_handle, struct csv_plugin_static *cps);
 
+#define CLOSE_STORE_COMPRESS(h, cz, stream) \
+	close_store_compress(CSHC(h), &PG, cz, stream)
+/**
+ * \brief close_store_common, handing the renamed outputs to cz if not NULL.
+ * \param stream true if the data file was written by csv_compress_fopen.
+ */
+extern void close_store_compress(struct csv_store_handle_common *s_handle, struct csv_plugin_static *cps, csv_compress_t cz, bool stream);
+
 /** \brief Dump the common csv handle to log */
 void print_csv_store_handle_common(struct csv_store_handle_common *s_handle, struct csv_plugin_static *cps);
 
@@ -0,0 +1,772 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file store_csv_compress.c
+ * \brief Background compression of closed csv outputs.
+ *
+ * Closed (rolled over) outputs are queued to a small pool of worker
+ * threads that compress each file to \c <name><ext>.tmp, sync it,
+ * rename it to \c <name><ext> and then remove the raw file, so the
+ * compressed output only ever appears complete under its final name.
+ * Failed attempts are retried with a growing delay. All workers share
+ * one input byte rate limit so a burst of rolls does not starve the
+ * daemon of disk bandwidth.
+ *
+ * The same codec writers back the streaming mode, where the data file
+ * is written through a compressing stdio stream and no raw copy is
+ * ever written.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include "config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+#include "store_csv_compress.h"
+
+#define CSV_CODEC_GZIP 1
+#define CSV_CODEC_XZ 2
+
+/** read size of the compression workers, and the rate limit quantum */
+#define CSV_COMPRESS_BLOCK (64 * 1024)
+/** seconds before the first retry; doubled on each further failure */
+#define CSV_COMPRESS_BACKOFF 2
+
+static struct csv_codec {
+	const char *name;
+	const char *ext;
+	int codec;
+	int min_level;
+	int max_level;
+	int def_level;
+} csv_codecs[] = {
+#ifdef HAVE_LIBZ
+	{ "gzip", ".gz", CSV_CODEC_GZIP, 1, 9, 6 },
+#endif
+#ifdef HAVE_LIBLZMA
+	{ "xz", ".xz", CSV_CODEC_XZ, 0, 9, 6 },
+#endif
+	{ NULL, NULL, 0, 0, 0, 0 }
+};
+
+struct csv_codec_writer {
+	int codec;
+	int fd;
+#ifdef HAVE_LIBZ
+	gzFile gz;
+#endif
+#ifdef HAVE_LIBLZMA
+	lzma_stream xz;
+	uint8_t xbuf[CSV_COMPRESS_BLOCK];
+#endif
+};
+
+struct csv_compress_job {
+	char *path;
+	int tries;
+	time_t not_before;
+	TAILQ_ENTRY(csv_compress_job) entry;
+};
+
+struct csv_compress {
+	const struct csv_codec *codec;
+	int level;
+	int nthreads;
+	int queue_max;
+	uint64_t rate;
+	int retries;
+	ldmsd_msg_log_f msglog;
+	const char *pname;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t space_cv;
+	TAILQ_HEAD(, csv_compress_job) queue;
+	int depth;
+	int stop;
+	pthread_t *threads;
+	/** monotonic ns before which no further input may be read */
+	uint64_t rate_next;
+
+	uint64_t done;
+	uint64_t failed;
+	uint64_t retried;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+};
+
+static int full_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Copy an existing compressed file to the start of out, so a new member
+ * appended after it does not replace the output of an earlier close that
+ * had the same name. Both codecs read concatenated members.
+ */
+static int copy_existing(const char *final, int out, char *buf)
+{
+	int rc = 0;
+	int fd = open(final, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return (errno == ENOENT) ? 0 : errno;
+	for (;;) {
+		ssize_t n = read(fd, buf, CSV_COMPRESS_BLOCK);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = errno;
+			break;
+		}
+		if (!n)
+			break;
+		rc = full_write(out, buf, n);
+		if (rc)
+			break;
+	}
+	close(fd);
+	return rc;
+}
+
+static int cw_open(struct csv_codec_writer *w, int codec, int level, int fd)
+{
+	w->codec = codec;
+	w->fd = fd;
+	switch (codec) {
+#ifdef HAVE_LIBZ
+	case CSV_CODEC_GZIP: {
+		char mode[8];
+		/* gzclose closes its descriptor; keep ours for fsync. */
+		int gfd = dup(fd);
+		if (gfd < 0)
+			return errno;
+		snprintf(mode, sizeof(mode), "wb%d", level);
+		w->gz = gzdopen(gfd, mode);
+		if (!w->gz) {
+			close(gfd);
+			return ENOMEM;
+		}
+		return 0;
+	}
+#endif
+#ifdef HAVE_LIBLZMA
+	case CSV_CODEC_XZ: {
+		lzma_stream init = LZMA_STREAM_INIT;
+		w->xz = init;
+		if (lzma_easy_encoder(&w->xz, level, LZMA_CHECK_CRC64) != LZMA_OK)
+			return ENOMEM;
+		return 0;
+	}
+#endif
+	default:
+		return ENOTSUP;
+	}
+}
+
+#ifdef HAVE_LIBLZMA
+static int xz_code(struct csv_codec_writer *w, lzma_action action)
+{
+	lzma_ret ret;
+	do {
+		w->xz.next_out = w->xbuf;
+		w->xz.avail_out = sizeof(w->xbuf);
+		ret = lzma_code(&w->xz, action);
+		if (ret != LZMA_OK && ret != LZMA_STREAM_END)
+			return (ret == LZMA_MEM_ERROR) ? ENOMEM : EIO;
+		size_t n = sizeof(w->xbuf) - w->xz.avail_out;
+		if (n) {
+			int rc = full_write(w->fd, w->xbuf, n);
+			if (rc)
+				return rc;
+		}
+	} while (w->xz.avail_in ||
+		 (action == LZMA_FINISH && ret != LZMA_STREAM_END));
+	return 0;
+}
+#endif
+
+static int cw_write(struct csv_codec_writer *w, const void *buf, size_t len)
+{
+	switch (w->codec) {
+#ifdef HAVE_LIBZ
+	case CSV_CODEC_GZIP:
+		while (len) {
+			unsigned chunk = len > CSV_COMPRESS_BLOCK ?
+					 CSV_COMPRESS_BLOCK : len;
+			if (gzwrite(w->gz, buf, chunk) != (int)chunk)
+				return errno ? errno : EIO;
+			buf = (const char *)buf + chunk;
+			len -= chunk;
+		}
+		return 0;
+#endif
+#ifdef HAVE_LIBLZMA
+	case CSV_CODEC_XZ:
+		w->xz.next_in = buf;
+		w->xz.avail_in = len;
+		return xz_code(w, LZMA_RUN);
+#endif
+	default:
+		return ENOTSUP;
+	}
+}
+
+/* Finish the compressed stream. The caller's descriptor stays open. */
+static int cw_close(struct csv_codec_writer *w)
+{
+	int rc;
+	switch (w->codec) {
+#ifdef HAVE_LIBZ
+	case CSV_CODEC_GZIP:
+		rc = gzclose(w->gz);
+		w->gz = NULL;
+		return (rc == Z_OK) ? 0 : EIO;
+#endif
+#ifdef HAVE_LIBLZMA
+	case CSV_CODEC_XZ:
+		w->xz.next_in = NULL;
+		w->xz.avail_in = 0;
+		rc = xz_code(w, LZMA_FINISH);
+		lzma_end(&w->xz);
+		return rc;
+#endif
+	default:
+		return ENOTSUP;
+	}
+}
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Reserve len bytes of the shared input budget, sleeping until it is ours. */
+static void rate_wait(struct csv_compress *cz, size_t len)
+{
+	uint64_t now, start;
+	if (!cz->rate)
+		return;
+	pthread_mutex_lock(&cz->lock);
+	now = mono_ns();
+	if (cz->rate_next < now)
+		cz->rate_next = now;
+	start = cz->rate_next;
+	cz->rate_next += (uint64_t)len * 1000000000ULL / cz->rate;
+	pthread_mutex_unlock(&cz->lock);
+	if (start > now) {
+		struct timespec ts;
+		ts.tv_sec = (start - now) / 1000000000ULL;
+		ts.tv_nsec = (start - now) % 1000000000ULL;
+		while (nanosleep(&ts, &ts) && errno == EINTR)
+			;
+	}
+}
+
+/*
+ * Compress src into src<ext>. Returns 0 when the compressed file is in
+ * place and src is gone, or an errno value with src left untouched.
+ */
+static int compress_file(struct csv_compress *cz, const char *src)
+{
+	struct csv_codec_writer w;
+	struct stat st;
+	char *final = NULL;
+	char *tmp = NULL;
+	char *buf = NULL;
+	uint64_t nin = 0;
+	int in, out = -1;
+	int rc;
+
+	in = open(src, O_RDONLY | O_CLOEXEC);
+	if (in < 0)
+		return (errno == ENOENT) ? 0 : errno;
+	if (fstat(in, &st)) {
+		rc = errno;
+		goto out;
+	}
+	rc = ENOMEM;
+	buf = malloc(CSV_COMPRESS_BLOCK);
+	if (!buf)
+		goto out;
+	if (asprintf(&final, "%s%s", src, cz->codec->ext) < 0) {
+		final = NULL;
+		goto out;
+	}
+	if (asprintf(&tmp, "%s.tmp", final) < 0) {
+		tmp = NULL;
+		goto out;
+	}
+	out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		   st.st_mode & 0777);
+	if (out < 0) {
+		rc = errno;
+		goto out;
+	}
+	/* keep the ownership rename_output gave the raw file, if we may */
+	if (fchown(out, st.st_uid, st.st_gid) && errno != EPERM) {
+		rc = errno;
+		goto err;
+	}
+	rc = copy_existing(final, out, buf);
+	if (rc)
+		goto err;
+	rc = cw_open(&w, cz->codec->codec, cz->level, out);
+	if (rc)
+		goto err;
+	for (;;) {
+		ssize_t n = read(in, buf, CSV_COMPRESS_BLOCK);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = errno;
+			break;
+		}
+		if (!n)
+			break;
+		rate_wait(cz, n);
+		rc = cw_write(&w, buf, n);
+		if (rc)
+			break;
+		nin += n;
+	}
+	if (rc) {
+		cw_close(&w);
+		goto err;
+	}
+	rc = cw_close(&w);
+	if (rc)
+		goto err;
+	if (fsync(out) || fstat(out, &st)) {
+		rc = errno;
+		goto err;
+	}
+	close(out);
+	out = -1;
+	if (rename(tmp, final)) {
+		rc = errno;
+		goto err;
+	}
+	if (unlink(src) && errno != ENOENT)
+		cz->msglog(LDMSD_LWARNING, "%s: compressed %s but cannot "
+			"remove it: %s\n", cz->pname, src, strerror(errno));
+	pthread_mutex_lock(&cz->lock);
+	cz->bytes_in += nin;
+	cz->bytes_out += st.st_size;
+	pthread_mutex_unlock(&cz->lock);
+	cz->msglog(LDMSD_LDEBUG, "%s: compressed %s (%" PRIu64
+		" -> %jd bytes)\n", cz->pname, final, nin,
+		(intmax_t)st.st_size);
+	rc = 0;
+	goto out;
+err:
+	if (out >= 0)
+		close(out);
+	unlink(tmp);
+out:
+	close(in);
+	free(buf);
+	free(final);
+	free(tmp);
+	return rc;
+}
+
+static void *compress_proc(void *arg)
+{
+	struct csv_compress *cz = arg;
+	struct csv_compress_job *job;
+	struct timespec ts;
+	time_t now;
+	int rc;
+
+	pthread_mutex_lock(&cz->lock);
+	for (;;) {
+		job = TAILQ_FIRST(&cz->queue);
+		if (!job) {
+			if (cz->stop)
+				break;
+			pthread_cond_wait(&cz->work_cv, &cz->lock);
+			continue;
+		}
+		now = time(NULL);
+		if (job->not_before > now) {
+			if (cz->stop) {
+				/* do not hold up shutdown for a retry */
+				TAILQ_REMOVE(&cz->queue, job, entry);
+				cz->depth--;
+				cz->failed++;
+				cz->msglog(LDMSD_LWARNING, "%s: leaving "
+					"%s uncompressed at shutdown\n",
+					cz->pname, job->path);
+				free(job->path);
+				free(job);
+				continue;
+			}
+			ts.tv_sec = job->not_before;
+			ts.tv_nsec = 0;
+			pthread_cond_timedwait(&cz->work_cv, &cz->lock, &ts);
+			continue;
+		}
+		TAILQ_REMOVE(&cz->queue, job, entry);
+		cz->depth--;
+		pthread_cond_signal(&cz->space_cv);
+		pthread_mutex_unlock(&cz->lock);
+
+		rc = compress_file(cz, job->path);
+
+		pthread_mutex_lock(&cz->lock);
+		if (!rc) {
+			cz->done++;
+			free(job->path);
+			free(job);
+			continue;
+		}
+		job->tries++;
+		if (job->tries > cz->retries) {
+			cz->failed++;
+			cz->msglog(LDMSD_LERROR, "%s: giving up compressing "
+				"%s after %d attempts: %s\n", cz->pname,
+				job->path, job->tries, strerror(rc));
+			free(job->path);
+			free(job);
+			continue;
+		}
+		cz->retried++;
+		job->not_before = time(NULL) +
+			(CSV_COMPRESS_BACKOFF << (job->tries - 1));
+		cz->msglog(LDMSD_LWARNING, "%s: compressing %s failed: %s; "
+			"retry %d in %ld s\n", cz->pname, job->path,
+			strerror(rc), job->tries,
+			(long)(job->not_before - time(NULL)));
+		/* retries are already admitted; they do not count against the bound */
+		TAILQ_INSERT_TAIL(&cz->queue, job, entry);
+		cz->depth++;
+	}
+	pthread_mutex_unlock(&cz->lock);
+	return NULL;
+}
+
+csv_compress_t csv_compress_new(const char *codec, int level, int threads,
+				int queue, uint64_t rate, int retries,
+				ldmsd_msg_log_f msglog, const char *pname)
+{
+	struct csv_compress *cz;
+	const struct csv_codec *c;
+	int i, rc;
+
+	for (c = csv_codecs; c->name; c++) {
+		if (0 == strcmp(c->name, codec))
+			break;
+	}
+	if (!c->name) {
+		msglog(LDMSD_LERROR, "%s: compress=%s is not supported "
+			"by this build.\n", pname, codec);
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if (level < 0) {
+		level = c->def_level;
+	} else if (level < c->min_level || level > c->max_level) {
+		msglog(LDMSD_LERROR, "%s: compress_level for %s must be "
+			"%d to %d.\n", pname, c->name, c->min_level,
+			c->max_level);
+		errno = EINVAL;
+		return NULL;
+	}
+	if (threads < 1 || queue < 1 || retries < 0) {
+		msglog(LDMSD_LERROR, "%s: compress_threads and "
+			"compress_queue must be positive and compress_retries "
+			"not negative.\n", pname);
+		errno = EINVAL;
+		return NULL;
+	}
+	cz = calloc(1, sizeof(*cz));
+	if (!cz)
+		goto enomem;
+	cz->threads = calloc(threads, sizeof(*cz->threads));
+	if (!cz->threads)
+		goto enomem;
+	cz->codec = c;
+	cz->level = level;
+	cz->queue_max = queue;
+	cz->rate = rate;
+	cz->retries = retries;
+	cz->msglog = msglog;
+	cz->pname = pname;
+	TAILQ_INIT(&cz->queue);
+	pthread_mutex_init(&cz->lock, NULL);
+	pthread_cond_init(&cz->work_cv, NULL);
+	pthread_cond_init(&cz->space_cv, NULL);
+	for (i = 0; i < threads; i++) {
+		rc = pthread_create(&cz->threads[i], NULL, compress_proc, cz);
+		if (rc) {
+			msglog(LDMSD_LERROR, "%s: cannot start compression "
+				"thread: %s\n", pname, strerror(rc));
+			break;
+		}
+		cz->nthreads++;
+	}
+	if (!cz->nthreads) {
+		csv_compress_free(cz);
+		errno = rc;
+		return NULL;
+	}
+	return cz;
+enomem:
+	if (cz)
+		free(cz->threads);
+	free(cz);
+	msglog(LDMSD_LERROR, "%s: out of memory.\n", pname);
+	errno = ENOMEM;
+	return NULL;
+}
+
+void csv_compress_free(csv_compress_t cz)
+{
+	int i;
+	if (!cz)
+		return;
+	pthread_mutex_lock(&cz->lock);
+	cz->stop = 1;
+	pthread_cond_broadcast(&cz->work_cv);
+	pthread_cond_broadcast(&cz->space_cv);
+	pthread_mutex_unlock(&cz->lock);
+	for (i = 0; i < cz->nthreads; i++)
+		pthread_join(cz->threads[i], NULL);
+	cz->msglog(LDMSD_LINFO, "%s: compressed %" PRIu64 " files (%"
+		PRIu64 " -> %" PRIu64 " bytes), %" PRIu64 " retries, %" PRIu64
+		" failed\n", cz->pname, cz->done, cz->bytes_in,
+		cz->bytes_out, cz->retried, cz->failed);
+	pthread_mutex_destroy(&cz->lock);
+	pthread_cond_destroy(&cz->work_cv);
+	pthread_cond_destroy(&cz->space_cv);
+	free(cz->threads);
+	free(cz);
+}
+
+int csv_compress_submit(csv_compress_t cz, const char *path)
+{
+	struct csv_compress_job *job;
+	struct stat st;
+
+	if (stat(path, &st))
+		return (errno == ENOENT) ? 0 : errno; /* e.g. no KIND file */
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return ENOMEM;
+	job->path = strdup(path);
+	if (!job->path) {
+		free(job);
+		return ENOMEM;
+	}
+	pthread_mutex_lock(&cz->lock);
+	while (cz->depth >= cz->queue_max && !cz->stop)
+		pthread_cond_wait(&cz->space_cv, &cz->lock);
+	if (cz->stop) {
+		pthread_mutex_unlock(&cz->lock);
+		free(job->path);
+		free(job);
+		return ESHUTDOWN;
+	}
+	TAILQ_INSERT_TAIL(&cz->queue, job, entry);
+	cz->depth++;
+	pthread_cond_signal(&cz->work_cv);
+	pthread_mutex_unlock(&cz->lock);
+	return 0;
+}
+
+int csv_compress_finish(csv_compress_t cz, const char *path)
+{
+	struct stat st;
+	char *final = NULL;
+	char *tmp = NULL;
+	char *buf = NULL;
+	int out;
+	int rc = ENOMEM;
+
+	if (asprintf(&final, "%s%s", path, cz->codec->ext) < 0)
+		return ENOMEM;
+	if (stat(final, &st)) {
+		/* the usual case: nothing to merge with */
+		rc = rename(path, final) ? errno : 0;
+		if (rc == ENOENT)
+			rc = 0;
+		goto out;
+	}
+	/* already compressed members go after the existing ones as they are */
+	buf = malloc(CSV_COMPRESS_BLOCK);
+	if (!buf || asprintf(&tmp, "%s.tmp", final) < 0)
+		goto out;
+	if (access(path, F_OK)) {
+		rc = (errno == ENOENT) ? 0 : errno;
+		goto out;
+	}
+	out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		   st.st_mode & 0777);
+	if (out < 0) {
+		rc = errno;
+		goto out;
+	}
+	rc = copy_existing(final, out, buf);
+	if (!rc)
+		rc = copy_existing(path, out, buf);
+	if (!rc && fsync(out))
+		rc = errno;
+	close(out);
+	if (!rc && rename(tmp, final))
+		rc = errno;
+	if (rc)
+		unlink(tmp);
+	else
+		unlink(path);
+out:
+	if (rc)
+		cz->msglog(LDMSD_LERROR, "%s: cannot rename %s to %s: %s\n",
+			cz->pname, path, final, strerror(rc));
+	free(buf);
+	free(tmp);
+	free(final);
+	return rc;
+}
+
+struct csv_stream {
+	struct csv_codec_writer w;
+	int fd;
+};
+
+static ssize_t stream_write(void *cookie, const char *buf, size_t len)
+{
+	struct csv_stream *s = cookie;
+	int rc = cw_write(&s->w, buf, len);
+	if (rc) {
+		errno = rc;
+		return -1;
+	}
+	return len;
+}
+
+static int stream_close(void *cookie)
+{
+	struct csv_stream *s = cookie;
+	int rc = cw_close(&s->w);
+	if (fsync(s->fd) && !rc)
+		rc = errno;
+	close(s->fd);
+	free(s);
+	if (rc) {
+		errno = rc;
+		return EOF;
+	}
+	return 0;
+}
+
+FILE *csv_compress_fopen(csv_compress_t cz, const char *path, int perm)
+{
+	cookie_io_functions_t io = {
+		.read = NULL,
+		.write = stream_write,
+		.seek = NULL,
+		.close = stream_close,
+	};
+	struct csv_stream *s;
+	FILE *f;
+	int rc;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, perm);
+	if (s->fd < 0)
+		goto err;
+	rc = cw_open(&s->w, cz->codec->codec, cz->level, s->fd);
+	if (rc) {
+		errno = rc;
+		goto err;
+	}
+	f = fopencookie(s, "a", io);
+	if (f)
+		return f;
+	rc = errno;
+	cw_close(&s->w);
+	errno = rc;
+err:
+	rc = errno;
+	if (s->fd >= 0)
+		close(s->fd);
+	free(s);
+	errno = rc;
+	return NULL;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file store_csv_compress.h
+ * \brief Compression of csv store outputs, after closing or while writing.
+ */
+#ifndef store_csv_compress_h_seen
+#define store_csv_compress_h_seen
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ldmsd.h"
+
+/** Background compressor for closed outputs; see csv_compress_new. */
+typedef struct csv_compress *csv_compress_t;
+
+/**
+ * Start a pool of threads compressing closed outputs.
+ * \param codec "gzip" or "xz", as the build supports.
+ * \param level codec compression level, or -1 for the codec default.
+ * \param threads number of worker threads.
+ * \param queue files that may wait for a worker before
+ *        csv_compress_submit blocks.
+ * \param rate input bytes per second shared by all workers; 0 for no limit.
+ * \param retries attempts after the first before a file is left raw.
+ * \param msglog destination of log messages.
+ * \param pname plugin name for log messages; must outlive the pool.
+ * \return the pool, or NULL with errno set and the reason logged.
+ */
+csv_compress_t csv_compress_new(const char *codec, int level, int threads,
+				int queue, uint64_t rate, int retries,
+				ldmsd_msg_log_f msglog, const char *pname);
+
+/** Stop the workers after the queue drains; pending retries are dropped. */
+void csv_compress_free(csv_compress_t cz);
+
+/**
+ * Queue a closed file. On success it later appears as path plus the
+ * codec extension and path is removed. A missing path is not an error.
+ * Blocks while the queue is full.
+ * \return 0 or errno value.
+ */
+int csv_compress_submit(csv_compress_t cz, const char *path);
+
+/**
+ * Open path for appending through a compressing stream of the pool's
+ * codec. Each open appends a complete compressed member when closed;
+ * the codecs' tools read concatenated members as one file. Data still
+ * buffered in the stream is lost if the process dies.
+ * The stream has no file descriptor (fileno() is -1).
+ * \param perm mode bits if path is created.
+ */
+FILE *csv_compress_fopen(csv_compress_t cz, const char *path, int perm);
+
+/**
+ * Give a closed output written by csv_compress_fopen its final name,
+ * path plus the codec extension.
+ * \return 0 or errno value.
+ */
+int csv_compress_finish(csv_compress_t cz, const char *path);
+
+#define COMPRESS_USAGE \
+		"         - compress  gzip or xz; compress files after they roll over.\n" \
+		"         - compress_level  Codec level (default 6).\n" \
+		"         - compress_threads  Compression worker threads (default 1).\n" \
+		"         - compress_queue  Files waiting before rollover blocks (default 64).\n" \
+		"         - compress_rate  Input bytes per second for all workers (default 0, unlimited).\n" \
+		"         - compress_retries  Retries of a failed compression (default 3).\n" \
+		"         - compress_stream  1 to write the data file compressed as it is stored.\n"
+
+#endif /* store_csv_compress_h_seen */
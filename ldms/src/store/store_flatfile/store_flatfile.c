@@ -59,6 +59,8 @@
 #include <linux/limits.h>
 #include <pthread.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
 #include <coll/idx.h>
 #include "ldms.h"
 #include "ldmsd.h"
@@ -67,6 +69,12 @@
 /*
  * NOTE:
  *   (flatfile::path) = (root_path)/(container)/(schema)/(metric)
+ *
+ * Rows are appended to a per-metric buffer and written out with a
+ * single write() per metric file when the buffer exceeds buffer_sz or
+ * the flush interval has elapsed. File descriptors are opened only to
+ * write a buffer; with max_open set, at most that many are kept open
+ * and the least recently written file is closed to make room.
  */
 
 static idx_t store_idx;
@@ -79,21 +87,39 @@ static ldmsd_msg_log_f msglog;
 #define _stringify(_x) #_x
 #define stringify(_x) _stringify(_x)
 
+#define FLATFILE_BUFFER_SZ	65536	/* bytes */
+#define FLATFILE_FLUSH_INTERVAL	1000000	/* usec */
+#define FLATFILE_VAL_MAX	64	/* room for one formatted number */
+
+static size_t buffer_sz = FLATFILE_BUFFER_SZ;
+static uint64_t flush_interval = FLATFILE_FLUSH_INTERVAL;
+static int max_open = 0; /**< 0 means no limit */
+
 /**
  * \brief Store for individual metric.
  */
 struct flatfile_metric_store {
-	FILE *file; /**< File handle */
+	int fd; /**< File descriptor, -1 if closed. Protected by lru_lock. */
+	int busy; /**< fd is in use, not an eviction candidate */
 	pthread_mutex_t lock; /**< lock at metric store level */
 	char *path; /**< path of the flatfile store */
+	char *buf; /**< rows not yet written */
+	size_t len;
+	size_t sz;
 	LIST_ENTRY(flatfile_metric_store) entry; /**< Entry for free list. */
+	TAILQ_ENTRY(flatfile_metric_store) lru_entry; /**< open fd LRU */
 };
 
 struct flatfile_store_instance {
 	struct ldmsd_store *store;
 	char *path; /**< (root_path)/(container)/schema */
 	char *schema;
+	char *key; /**< (container):(schema), the store_idx key */
 	void *ucontext;
+	int ref_count;
+	int compidx; /**< component_id index, resolved on the first store */
+	int compidx_resolved;
+	uint64_t last_flush; /**< monotonic usec, claimed with a CAS */
 	idx_t ms_idx;
 	LIST_HEAD(ms_list, flatfile_metric_store) ms_list;
 	int metric_count;
@@ -102,17 +128,53 @@ struct flatfile_store_instance {
 
 static pthread_mutex_t cfg_lock;
 
+static pthread_mutex_t lru_lock = PTHREAD_MUTEX_INITIALIZER;
+static TAILQ_HEAD(flatfile_metric_store_lru, flatfile_metric_store) lru_list =
+				TAILQ_HEAD_INITIALIZER(lru_list);
+static int open_count;
+
 /**
  * \brief Configuration
  */
 static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct attr_value_list *avl)
 {
 	char *value;
+	char *end;
+	unsigned long ul;
+
 	value = av_value(avl, "path");
 	if (!value)
 		goto err;
 
 	pthread_mutex_lock(&cfg_lock);
+	value = av_value(avl, "buffer");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0') {
+			msglog(LDMSD_LERROR, STRFF ": invalid buffer '%s'.\n", value);
+			goto err_unlock;
+		}
+		buffer_sz = ul;
+	}
+	value = av_value(avl, "flush_interval");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0') {
+			msglog(LDMSD_LERROR, STRFF ": invalid flush_interval '%s'.\n", value);
+			goto err_unlock;
+		}
+		flush_interval = ul;
+	}
+	value = av_value(avl, "max_open");
+	if (value) {
+		ul = strtoul(value, &end, 0);
+		if (*end != '\0') {
+			msglog(LDMSD_LERROR, STRFF ": invalid max_open '%s'.\n", value);
+			goto err_unlock;
+		}
+		max_open = ul;
+	}
+	value = av_value(avl, "path");
 	if (root_path)
 		free(root_path);
 	root_path = strdup(value);
@@ -120,6 +182,8 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 	if (!root_path)
 		return ENOMEM;
 	return 0;
+ err_unlock:
+	pthread_mutex_unlock(&cfg_lock);
  err:
 	return EINVAL;
 }
@@ -135,9 +199,16 @@ static void term(struct ldmsd_plugin *self)
 static const char *usage(struct ldmsd_plugin *self)
 {
 	return
-"    config name=store_flatfile path=<path>\n"
+"    config name=store_flatfile path=<path> [buffer=<bytes>]\n"
+"           [flush_interval=<usec>] [max_open=<n>]\n"
 "              - Set the root path for the storage of flatfiles.\n"
-"              path      The path to the root of the flatfile directory\n";
+"              path      The path to the root of the flatfile directory\n"
+"              buffer    Bytes buffered per metric file before it is written\n"
+"                        (default " stringify(FLATFILE_BUFFER_SZ) ", 0 writes every row)\n"
+"              flush_interval Buffered rows are written at least this often\n"
+"                        (default " stringify(FLATFILE_FLUSH_INTERVAL) "us)\n"
+"              max_open  Maximum number of metric files kept open (default 0,\n"
+"                        no limit). Least recently written files are closed.\n";
 }
 
 static void *get_ucontext(ldmsd_store_handle_t _sh)
@@ -146,12 +217,133 @@ static void *get_ucontext(ldmsd_store_handle_t _sh)
 	return si->ucontext;
 }
 
+static uint64_t mono_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* lru_lock must be held */
+static void ms_fd_close(struct flatfile_metric_store *ms)
+{
+	TAILQ_REMOVE(&lru_list, ms, lru_entry);
+	close(ms->fd);
+	ms->fd = -1;
+	open_count--;
+}
+
+/*
+ * Open ms->fd if needed and pin it against eviction. The LRU victim is
+ * never busy, so its fd can be closed without taking its lock.
+ */
+static int ms_fd_get(struct flatfile_metric_store *ms)
+{
+	struct flatfile_metric_store *victim, *prev;
+	int rc = 0;
+
+	pthread_mutex_lock(&lru_lock);
+	if (ms->fd >= 0) {
+		TAILQ_REMOVE(&lru_list, ms, lru_entry);
+		goto out;
+	}
+	victim = TAILQ_LAST(&lru_list, flatfile_metric_store_lru);
+	while (max_open && open_count >= max_open && victim) {
+		prev = TAILQ_PREV(victim, flatfile_metric_store_lru, lru_entry);
+		if (!victim->busy)
+			ms_fd_close(victim);
+		victim = prev;
+	}
+	ms->fd = open(ms->path, O_WRONLY | O_APPEND | O_CREAT,
+		      LDMSD_DEFAULT_FILE_PERM);
+	if (ms->fd < 0) {
+		rc = errno;
+		pthread_mutex_unlock(&lru_lock);
+		msglog(LDMSD_LERROR, STRFF ": Error opening %s: %d: %s\n",
+		       ms->path, rc, strerror(rc));
+		return rc;
+	}
+	open_count++;
+ out:
+	TAILQ_INSERT_HEAD(&lru_list, ms, lru_entry);
+	ms->busy = 1;
+	pthread_mutex_unlock(&lru_lock);
+	return rc;
+}
+
+static void ms_fd_put(struct flatfile_metric_store *ms)
+{
+	pthread_mutex_lock(&lru_lock);
+	ms->busy = 0;
+	pthread_mutex_unlock(&lru_lock);
+}
+
+/* Write out the buffered rows. ms->lock must be held. */
+static int ms_write(struct flatfile_metric_store *ms)
+{
+	size_t off = 0;
+	ssize_t cnt;
+	int rc;
+
+	if (!ms->len)
+		return 0;
+	rc = ms_fd_get(ms);
+	if (rc)
+		return rc;
+	while (off < ms->len) {
+		cnt = write(ms->fd, ms->buf + off, ms->len - off);
+		if (cnt < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = errno;
+			msglog(LDMSD_LERROR, STRFF ": Error %d: %s writing %s\n",
+			       rc, strerror(rc), ms->path);
+			break;
+		}
+		off += cnt;
+	}
+	ms_fd_put(ms);
+	/* on error the rows are dropped rather than retried forever */
+	ms->len = 0;
+	return rc;
+}
+
+/* Make room for \c n more bytes. ms->lock must be held. */
+static int ms_reserve(struct flatfile_metric_store *ms, size_t n)
+{
+	size_t sz;
+	char *buf;
+
+	if (ms->len + n <= ms->sz)
+		return 0;
+	sz = ms->sz ? ms->sz : 1024;
+	while (sz < ms->len + n)
+		sz *= 2;
+	buf = realloc(ms->buf, sz);
+	if (!buf)
+		return ENOMEM;
+	ms->buf = buf;
+	ms->sz = sz;
+	return 0;
+}
+
+static void ms_free(struct flatfile_metric_store *ms)
+{
+	pthread_mutex_lock(&lru_lock);
+	if (ms->fd >= 0)
+		ms_fd_close(ms);
+	pthread_mutex_unlock(&lru_lock);
+	free(ms->buf);
+	free(ms->path);
+	free(ms);
+}
+
 static ldmsd_store_handle_t
 open_store(struct ldmsd_store *s, const char *container, const char *schema,
 	  struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
 {
 	struct flatfile_store_instance *si;
-	struct flatfile_metric_store *ms;
+	struct flatfile_metric_store *ms = NULL;
 	int i;
 	char *key = NULL;
 	size_t len;
@@ -169,101 +361,98 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
 	 * already exist
 	 */
 	si = idx_find(store_idx, (void *)key, strlen(key));
-	if (!si) {
-		/*
-		 * First, count the metric.
-		 */
-		int metric_count = 0;
-		ldmsd_strgp_metric_t x;
-		TAILQ_FOREACH(x, metric_list, entry) {
-			metric_count++;
+	if (si) {
+		si->ref_count++;
+		goto out;
+	}
+	/*
+	 * First, count the metric.
+	 */
+	int metric_count = 0;
+	ldmsd_strgp_metric_t x;
+	TAILQ_FOREACH(x, metric_list, entry) {
+		metric_count++;
+	}
+	sprintf(tmp_path, "%s/%s/%s", root_path, container, schema);
+	f_mkdir_p(tmp_path, 0777);
+
+	/*
+	 * Open a new store for this component-type and
+	 * metric combination
+	 */
+	si = calloc(1, sizeof(*si) +
+			metric_count *
+			sizeof(struct flatfile_metric_store *));
+	if (!si)
+		goto out;
+	si->metric_count = metric_count;
+	si->ref_count = 1;
+	si->ms_idx = idx_create();
+	if (!si->ms_idx)
+		goto err1;
+	si->ucontext = ucontext;
+	si->store = s;
+	si->last_flush = mono_usec();
+	si->path = strdup(tmp_path);
+	if (!si->path)
+		goto err2;
+	si->schema = strdup(schema);
+	if (!si->schema)
+		goto err3;
+	i = 0;
+	char mname[128];
+	char *name;
+	TAILQ_FOREACH(x, metric_list, entry) {
+		name = strchr(x->name, '#');
+		if (name) {
+			int len = name - x->name;
+			name = strncpy(mname, x->name, len);
+			name[len] = 0;
+		} else {
+			name = x->name;
 		}
-		sprintf(tmp_path, "%s/%s/%s", root_path, container, schema);
-		f_mkdir_p(tmp_path, 0777);
-
-		/*
-		 * Open a new store for this component-type and
-		 * metric combination
-		 */
-		si = calloc(1, sizeof(*si) +
-				metric_count *
-				sizeof(struct flatfile_metric_store *));
-		if (!si)
-			goto out;
-		si->metric_count = metric_count;
-		si->ms_idx = idx_create();
-		if (!si->ms_idx)
-			goto err1;
-		si->ucontext = ucontext;
-		si->store = s;
-		si->path = strdup(tmp_path);
-		if (!si->path)
-			goto err2;
-		si->schema = strdup(schema);
-		if (!si->schema)
-			goto err3;
-		i = 0;
-		char mname[128];
-		char *name;
-		TAILQ_FOREACH(x, metric_list, entry) {
-			name = strchr(x->name, '#');
-			if (name) {
-				int len = name - x->name;
-				name = strncpy(mname, x->name, len);
-				name[len] = 0;
-			} else {
-				name = x->name;
-			}
-			ms = idx_find(si->ms_idx, name, strlen(name));
-			if (ms) {
-				si->ms[i++] = ms;
-				continue;
-			}
-			/* Create new metric store if not exist. */
-			ms = calloc(1, sizeof(*ms));
-			if (!ms) {
-				msglog(LDMSD_LERROR, STRFF ": Out of memory at %s:%d\n",
-					__FILE__, __LINE__);
-				goto err4;
-			}
-			sprintf(tmp_path, "%s/%s", si->path, name);
-			ms->path = strdup(tmp_path);
-			if (!ms->path) {
-				msglog(LDMSD_LERROR, STRFF ": Out of memory at %s:%d\n",
-					__FILE__, __LINE__);
-				goto err4;
-			}
-			ms->file = fopen_perm(ms->path, "a+", LDMSD_DEFAULT_FILE_PERM);
-			if (!ms->file) {
-				int eno = errno;
-				msglog(LDMSD_LERROR, STRFF ": Error opening %s: %d: %s at %s:%d\n",
-					ms->path, eno, strerror(eno),
-					__FILE__, __LINE__);
-				goto err4;
-			}
-			pthread_mutex_init(&ms->lock, NULL);
-			idx_add(si->ms_idx, name, strlen(name), ms);
-			LIST_INSERT_HEAD(&si->ms_list, ms, entry);
+		ms = idx_find(si->ms_idx, name, strlen(name));
+		if (ms) {
 			si->ms[i++] = ms;
+			continue;
+		}
+		/* Create new metric store if not exist. */
+		ms = calloc(1, sizeof(*ms));
+		if (!ms) {
+			msglog(LDMSD_LERROR, STRFF ": Out of memory at %s:%d\n",
+				__FILE__, __LINE__);
+			goto err4;
 		}
-		idx_add(store_idx, (void *)key, strlen(key), si);
+		ms->fd = -1;
+		sprintf(tmp_path, "%s/%s", si->path, name);
+		ms->path = strdup(tmp_path);
+		if (!ms->path) {
+			msglog(LDMSD_LERROR, STRFF ": Out of memory at %s:%d\n",
+				__FILE__, __LINE__);
+			goto err4;
+		}
+		/* Create the file now so it is there before the first flush */
+		if (ms_fd_get(ms))
+			goto err4;
+		ms_fd_put(ms);
+		pthread_mutex_init(&ms->lock, NULL);
+		idx_add(si->ms_idx, name, strlen(name), ms);
+		LIST_INSERT_HEAD(&si->ms_list, ms, entry);
+		si->ms[i++] = ms;
 	}
+	si->key = key;
+	key = NULL;
+	idx_add(store_idx, (void *)si->key, strlen(si->key), si);
 	goto out;
 err4:
 	if (ms) {
 		if (ms->path)
 			free(ms->path);
-		if (ms->file)
-			fclose(ms->file);
 		free(ms);
 	}
 	while ((ms = LIST_FIRST(&si->ms_list))) {
 		LIST_REMOVE(ms, entry);
-		if (ms->path)
-			free(ms->path);
-		if (ms->file)
-			fclose(ms->file);
-		free(ms);
+		ms_free(ms);
 	}
 
 	free(si->schema);
@@ -281,15 +470,106 @@ out:
 	return si;
 }
 
+/* Append one "<prefix> <value>\n" row. ms->lock must be held. */
+static int ms_append(struct flatfile_metric_store *ms, const char *prefix,
+		     size_t plen, ldms_set_t set, int mid)
+{
+	enum ldms_value_type metric_type = ldms_metric_type_get(set, mid);
+	const char *str = NULL;
+	size_t n = FLATFILE_VAL_MAX;
+	char *p;
+	int cnt;
+
+	switch (metric_type) {
+	case LDMS_V_CHAR_ARRAY:
+		str = ldms_metric_array_get_str(set, mid);
+		n = strnlen(str, ldms_metric_array_get_len(set, mid)) + 3;
+		break;
+	case LDMS_V_U8:
+	case LDMS_V_S8:
+	case LDMS_V_U16:
+	case LDMS_V_S16:
+	case LDMS_V_U32:
+	case LDMS_V_S32:
+	case LDMS_V_U64:
+	case LDMS_V_S64:
+	case LDMS_V_F32:
+	case LDMS_V_D64:
+		break;
+	default:
+		/* array types not supported yet. want row and split files options */
+		return 0;
+	}
+	if (ms_reserve(ms, plen + n))
+		return ENOMEM;
+	p = ms->buf + ms->len;
+	memcpy(p, prefix, plen);
+	p += plen;
+	switch (metric_type) {
+	case LDMS_V_CHAR_ARRAY:
+		cnt = snprintf(p, n, " %.*s\n", (int)(n - 3), str);
+		break;
+	case LDMS_V_U8:
+		cnt = snprintf(p, n, " %u\n",
+			       (unsigned)ldms_metric_get_u8(set, mid));
+		break;
+	case LDMS_V_S8:
+		cnt = snprintf(p, n, " %d\n",
+			       (int)ldms_metric_get_s8(set, mid));
+		break;
+	case LDMS_V_U16:
+		cnt = snprintf(p, n, " %u\n",
+			       (unsigned)ldms_metric_get_u16(set, mid));
+		break;
+	case LDMS_V_S16:
+		cnt = snprintf(p, n, " %d\n",
+			       (int)ldms_metric_get_s16(set, mid));
+		break;
+	case LDMS_V_U32:
+		cnt = snprintf(p, n, " %u\n",
+			       (unsigned)ldms_metric_get_u32(set, mid));
+		break;
+	case LDMS_V_S32:
+		cnt = snprintf(p, n, " %d\n", ldms_metric_get_s32(set, mid));
+		break;
+	case LDMS_V_U64:
+		cnt = snprintf(p, n, " %"PRIu64"\n",
+			       ldms_metric_get_u64(set, mid));
+		break;
+	case LDMS_V_S64:
+		cnt = snprintf(p, n, " %"PRId64"\n",
+			       ldms_metric_get_s64(set, mid));
+		break;
+	case LDMS_V_F32:
+		cnt = snprintf(p, n, " %.9g\n", ldms_metric_get_float(set, mid));
+		break;
+	case LDMS_V_D64:
+		cnt = snprintf(p, n, " %.17g\n", ldms_metric_get_double(set, mid));
+		break;
+	default:
+		cnt = 0;
+		break;
+	}
+	if (cnt < 0 || cnt >= n)
+		return EINVAL;
+	ms->len += plen + cnt;
+	return 0;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh);
+
 static int
 store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_count)
 {
 	struct flatfile_store_instance *si;
+	struct flatfile_metric_store *ms;
+	uint64_t now, last;
 	int i;
-	int rc = 0, rc2 = 0;
+	int rc = 0;
 	int last_rc = 0;
 	int last_errno = 0;
-	int compidx;
+	char prefix[256];
+	int plen;
 
 	if (!_sh)
 		return EINVAL;
@@ -297,98 +577,48 @@ store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_
 	si = _sh;
 	const struct ldms_timestamp _ts = ldms_transaction_timestamp_get(set);
 	const struct ldms_timestamp *ts = &_ts;
-	uint64_t comp_id;
 
 	const char *prod;
 	prod = ldms_set_producer_name_get(set);
-	compidx = ldms_metric_by_name(set, LDMSD_COMPID);
-	if (compidx < 0){
+	if (!si->compidx_resolved) {
+		/* The index is the same for every set of the schema */
+		si->compidx = ldms_metric_by_name(set, LDMSD_COMPID);
+		si->compidx_resolved = 1;
+	}
+	if (si->compidx < 0){
 		msglog(LDMSD_LERROR, STRFF ": The component_id is missing from the metric set/schema.\n");
-		rc = compidx;
-		goto err;
-	} else {
-		comp_id = ldms_metric_get_u64(set, compidx);
+		return si->compidx;
 	}
+	/* time, host, compid -- the same for every metric in the row */
+	plen = snprintf(prefix, sizeof(prefix), "%"PRIu32".%06"PRIu32" %s %"PRIu64,
+			ts->sec, ts->usec, prod,
+			ldms_metric_get_u64(set, si->compidx));
+	if (plen >= sizeof(prefix))
+		return ENAMETOOLONG;
+
 	for (i=0; i<metric_count; i++) {
-		pthread_mutex_lock(&si->ms[i]->lock);
-		/* time, host, compid, value */
-#define STAMP \
-	rc2 = fprintf(si->ms[i]->file, "%"PRIu32".%06"PRIu32" %s %"PRIu64, \
-		ts->sec, ts->usec, prod, comp_id)
-		enum ldms_value_type metric_type =
-			ldms_metric_type_get(set, metric_arry[i]);
-		switch (metric_type) {
-		case LDMS_V_CHAR_ARRAY:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %s\n",
-			     ldms_metric_array_get_str(set, metric_arry[i]));
-			break;
-		case LDMS_V_U8:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %u\n",
-			     (unsigned)ldms_metric_get_u8(set, metric_arry[i]));
-			break;
-		case LDMS_V_S8:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %d\n",
-			     (int)ldms_metric_get_s8(set, metric_arry[i]));
-			break;
-		case LDMS_V_U16:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %u\n",
-			     (unsigned)ldms_metric_get_u16(set, metric_arry[i]));
-			break;
-		case LDMS_V_S16:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %d\n",
-			     (int)ldms_metric_get_s16(set, metric_arry[i]));
-			break;
-		case LDMS_V_U32:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %u\n",
-			     (unsigned)ldms_metric_get_u32(set, metric_arry[i]));
-			break;
-		case LDMS_V_S32:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %d\n",
-			     ldms_metric_get_s32(set, metric_arry[i]));
-			break;
-		case LDMS_V_U64:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %"PRIu64"\n",
-			     ldms_metric_get_u64(set, metric_arry[i]));
-			break;
-		case LDMS_V_S64:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %"PRId64"\n",
-			     ldms_metric_get_s64(set, metric_arry[i]));
-			break;
-		case LDMS_V_F32:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %.9g\n",
-			     ldms_metric_get_float(set, metric_arry[i]));
-			break;
-		case LDMS_V_D64:
-			STAMP;
-			rc = fprintf(si->ms[i]->file, " %.17g\n",
-			     ldms_metric_get_double(set, metric_arry[i]));
-			break;
-		default:
-			/* array types not supported yet. want row and split files options */
-			break;
-		}
-#undef STAMP
-		if (rc < 0 || rc2 < 0) {
-			last_errno = errno;
-			last_rc = (rc != 0 ? rc : rc2);
+		ms = si->ms[i];
+		pthread_mutex_lock(&ms->lock);
+		rc = ms_append(ms, prefix, plen, set, metric_arry[i]);
+		if (!rc && ms->len > buffer_sz)
+			rc = ms_write(ms);
+		if (rc) {
+			last_errno = rc;
+			last_rc = rc;
 			msglog(LDMSD_LERROR, STRFF ": Error %d: %s at %s:%d\n", last_errno,
 					strerror(last_errno), __FILE__,
 					__LINE__);
 		}
-		pthread_mutex_unlock(&si->ms[i]->lock);
+		pthread_mutex_unlock(&ms->lock);
 	}
 
- err:
+	/* Only the caller that moves last_flush forward does the flush */
+	now = mono_usec();
+	last = si->last_flush;
+	if (now - last >= flush_interval &&
+	    __sync_bool_compare_and_swap(&si->last_flush, last, now))
+		flush_store(si);
+
 	if (last_errno)
 		errno = last_errno;
 	return last_rc;
@@ -404,12 +634,10 @@ static int flush_store(ldmsd_store_handle_t _sh)
 	struct flatfile_metric_store *ms;
 	LIST_FOREACH(ms, &si->ms_list, entry) {
 		pthread_mutex_lock(&ms->lock);
-		lrc = fflush(ms->file);
+		lrc = ms_write(ms);
 		if (lrc) {
 			rc = lrc;
-			eno = errno;
-			msglog(LDMSD_LERROR, STRFF ": Errro %d: %s at %s:%d\n", eno, strerror(eno),
-					__FILE__, __LINE__);
+			eno = lrc;
 		}
 		pthread_mutex_unlock(&ms->lock);
 	}
@@ -420,23 +648,22 @@ static int flush_store(ldmsd_store_handle_t _sh)
 
 static void close_store(ldmsd_store_handle_t _sh)
 {
-	pthread_mutex_lock(&cfg_lock);
-	/*
-	 * NOTE: This close function looks like destroy to me.
-	 */
 	struct flatfile_store_instance *si = _sh;
 	if (!_sh)
 		return;
+	pthread_mutex_lock(&cfg_lock);
+	if (--si->ref_count) {
+		pthread_mutex_unlock(&cfg_lock);
+		return;
+	}
+	flush_store(si);
 	struct flatfile_metric_store *ms;
 	while ((ms = LIST_FIRST(&si->ms_list))) {
 		LIST_REMOVE(ms, entry);
-		if (ms->file)
-			fclose(ms->file);
-		if (ms->path)
-			free(ms->path);
-		free(ms);
+		ms_free(ms);
 	}
-	idx_delete(store_idx, (void *)(si->schema), strlen(si->schema));
+	idx_delete(store_idx, (void *)(si->key), strlen(si->key));
+	free(si->key);
 	free(si->path);
 	free(si->schema);
 	idx_destroy(si->ms_idx);
@@ -473,8 +700,15 @@ static void store_flatfile_init()
 }
 
 static void __attribute__ ((destructor)) store_flatfile_fini(void);
+static void __flush_cb(void *obj, void *cb_arg)
+{
+	flush_store(obj);
+}
+
 static void store_flatfile_fini()
 {
+	/* rows still buffered when ldmsd exits */
+	idx_traverse(store_idx, __flush_cb, NULL);
 	pthread_mutex_destroy(&cfg_lock);
 	idx_destroy(store_idx);
 }
@@ -265,10 +265,13 @@ struct dinfo{ //values of the derived metrics, updated as the calculations go al
 };
 
 struct setdatapoint{ //one of these for each instance for each schema
-	struct ldms_timestamp *ts;
+	struct ldms_timestamp ts;
+	int firsttime; /* no row has been written for this instance yet */
+	uint64_t plan_gen; /* the plan generation the datavals were laid out for */
 	struct dinfo* datavals; /* derived vals from the last timestep (one for each derived metric)
 				   indicies are those of the derived metrics (not the sources).
 				   The der and datavals are in the same order. */
+	uint64_t* vals; /* one contiguous block backing all the datavals' return and store vals */
 };
 /******/
 
@@ -298,6 +301,27 @@ struct derived_data{ //the generic information about the derived metric
 };
 /******/
 
+/***** per schema execution plan (compiled from the derived_data once the set is known) *****/
+struct plan_step{ //one per derived metric, in der order
+	struct derived_data* dd;
+	int fast; /* evaluated by the vector kernels (fastFunc) rather than by doFunc */
+	int base; /* input 0 is a set metric (1) or a derived metric (0) */
+	int in_idx; /* set metric index when base, derived metric index otherwise */
+	int in_array; /* base input is an array metric */
+	int in_dim; /* dimensionality of input 0 */
+};
+
+struct fn_plan{
+	int nsteps; /* == numder */
+	struct plan_step* steps;
+	size_t nvals; /* u64 slots in a setdatapoint's vals block */
+	size_t* ret_off; /* per derived metric offset of its return vals in the vals block (-1 if none) */
+	size_t* store_off; /* per derived metric offset of its store vals in the vals block (-1 if none) */
+	int compid_idx; /* set metric index of component_id or -1 */
+	int jobid_idx; /* set metric index of job_id or -1 */
+};
+/******/
+
 /*** per schema (includes instance data within the sets_idx) *******/
 struct function_store_handle { //these are per-schema
 	struct ldmsd_store *store;
@@ -313,6 +337,8 @@ struct function_store_handle { //these are per-schema
 			   Each setdatapoint will have X datavals where X = number of derived metrics (numder).
 			   The der and the datavals are in the same order */
 	int numsets;
+	struct fn_plan plan; /* compiled form of der[], valid when plan_gen != 0 */
+	uint64_t plan_gen; /* bumped on every (re)compile; cached setdatapoints from older plans are rebuilt */
 	printheader_t printheader;
 	int parseconfig;
 	char *store_key; /* this is the container+schema */
@@ -1221,6 +1247,9 @@ static void *get_ucontext(ldmsd_store_handle_t _s_handle)
 	return s_handle->ucontext;
 }
 
+static int compile_plan(struct function_store_handle *s_handle, ldms_set_t set,
+			int* metric_arry);
+
 static int print_header_from_store(struct function_store_handle *s_handle,
 				   ldms_set_t set, int* metric_arry, size_t metric_count)
 {
@@ -1250,6 +1279,9 @@ static int print_header_from_store(struct function_store_handle *s_handle,
 			       __FILE__);
 			return rc;
 		}
+		rc = compile_plan(s_handle, set, metric_arry);
+		if (rc != 0)
+			return rc;
 	}
 
 
@@ -2641,110 +2673,363 @@ static int doFunc(ldms_set_t set, int* metric_arry,
 
 };
 
-static int get_datapoint(idx_t* sets_idx, const char* instance_name,
-			 int numder, struct derived_data** der,
-			 int* numsets, struct setdatapoint** rdp, int* firsttime){
-
-	struct setdatapoint* dp = NULL;
-	int i, j;
+/**
+ * The vector kernels read u64 metrics straight out of the set memory, which
+ * is little-endian. On a big-endian host everything goes through doFunc and
+ * the per-element accessors instead.
+ */
+#if __BYTE_ORDER__ == __LITTLE_ENDIAN
+#define FAST_PLAN 1
+#else
+#define FAST_PLAN 0
+#endif
 
-	if (rdp == NULL){
-		msglog(LDMSD_LERROR, "%s: arg to getDatapoint is NULL!\n",
-		       __FILE__);
-		return EINVAL;
-	}
+static uint64_t plan_gen_next = 0;
+
+static void free_plan(struct fn_plan* plan){
+	if (plan->steps)
+		free(plan->steps);
+	if (plan->ret_off)
+		free(plan->ret_off);
+	if (plan->store_off)
+		free(plan->store_off);
+	memset(plan, 0, sizeof(*plan));
+	plan->compid_idx = -1;
+	plan->jobid_idx = -1;
+}
 
-	*rdp = NULL;
-	*firsttime = 0;
+/**
+ * \brief Compile the derived metrics into a flat execution plan
+ *
+ * Done once per schema (after derivedConfig) instead of on every row:
+ * - resolve the base inputs to set metric indices and the derived inputs
+ *   to derived indices, and mark the functions the vector kernels handle.
+ * - lay out the return/store vals of all the derived metrics in one
+ *   contiguous block so a setdatapoint is a single allocation.
+ * - resolve component_id and job_id once.
+ */
+static int compile_plan(struct function_store_handle *s_handle, ldms_set_t set,
+			int* metric_arry){
+	struct fn_plan* plan = &s_handle->plan;
+	struct derived_data* dd;
+	size_t off = 0;
+	int i;
 
-	dp = idx_find(*sets_idx, (void*) instance_name,
-		      strlen(instance_name));
+	free_plan(plan);
+	s_handle->plan_gen = 0;
 
-	if (dp == NULL){
-		//create a container to hold it
-		dp = (struct setdatapoint*)malloc(sizeof(struct setdatapoint));
-		if (!dp) {
+	plan->nsteps = s_handle->numder;
+	if (plan->nsteps){
+		plan->steps = calloc(plan->nsteps, sizeof(*plan->steps));
+		plan->ret_off = calloc(plan->nsteps, sizeof(size_t));
+		plan->store_off = calloc(plan->nsteps, sizeof(size_t));
+		if (!plan->steps || !plan->ret_off || !plan->store_off){
 			msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
+			free_plan(plan);
 			return ENOMEM;
 		}
-		dp->ts = NULL;
-		dp->datavals = NULL;
-		(*numsets)++;
-
-		idx_add(*sets_idx, (void*)instance_name,
-			strlen(instance_name), dp);
 	}
 
-	if (dp->ts == NULL){ //first time....
-		dp->ts = (struct ldms_timestamp*)malloc(sizeof (struct ldms_timestamp));
-		if (dp->ts == NULL) {
-			msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
-			free(dp);
-			dp = NULL;
-			return ENOMEM;
+	for (i = 0; i < plan->nsteps; i++){
+		struct plan_step* st = &plan->steps[i];
+		dd = s_handle->der[i];
+		st->dd = dd;
+		st->base = (dd->varidx[0].typei == BASE);
+		st->in_idx = (st->base ? metric_arry[dd->varidx[0].i] : dd->varidx[0].i);
+		st->in_array = (st->base && (dd->varidx[0].metric_type == LDMS_V_U64_ARRAY));
+		st->in_dim = dd->varidx[0].dim;
+
+		switch (dd->fct){
+		case RAW:
+		case THRESH_GE:
+		case THRESH_LT:
+		case RATE:
+		case DELTA:
+		case MAX:
+		case MIN:
+		case SUM:
+		case AVG:
+			st->fast = FAST_PLAN;
+			break;
+		default:
+			st->fast = 0;
+			break;
 		}
-		dp->ts->sec = 0;
-		dp->ts->usec = 0;
 
-		dp->datavals = calloc(numder, sizeof(struct dinfo));
-		if (dp->datavals == NULL) {
-			msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
-			free(dp->ts);
-			free(dp);
-			dp = NULL;
-			return ENOMEM;
+		plan->ret_off[i] = (size_t)-1;
+		plan->store_off[i] = (size_t)-1;
+		if (func_def[dd->fct].createreturn){
+			plan->ret_off[i] = off;
+			off += dd->dim;
 		}
+		if (func_def[dd->fct].createstore){
+			plan->store_off[i] = off;
+			off += dd->dim;
+		}
+	}
+	plan->nvals = off;
 
-		//create the space for the return vals and store vals if needed
-		for (i = 0; i < numder; i++){
-			dp->datavals[i].dim = der[i]->dim;
+	plan->compid_idx = ldms_metric_by_name(set, LDMSD_COMPID);
+	plan->jobid_idx = ldms_metric_by_name(set, LDMSD_JOBID);
 
-			if (func_def[der[i]->fct].createreturn){
-				dp->datavals[i].returnvals = calloc(dp->datavals[i].dim, sizeof(uint64_t));
-				if (dp->datavals[i].returnvals == NULL)
-					goto err;
-				dp->datavals[i].returnvalid = 0;
-			} else {
-				dp->datavals[i].returnvals = NULL;
-			}
+	s_handle->plan_gen = __sync_add_and_fetch(&plan_gen_next, 1);
 
-			if (func_def[der[i]->fct].createstore){
-				dp->datavals[i].storevals = calloc(dp->datavals[i].dim, sizeof(uint64_t));
-				if (dp->datavals[i].storevals == NULL)
-					goto err;
-				dp->datavals[i].storevalid = 0;
+	return 0;
+}
+
+/* u64 vector kernels. The loops are kept branch free so they vectorize. */
+static inline int vec_nonneg(const uint64_t* restrict curr,
+			     const uint64_t* restrict prev, int dim){
+	int neg = 0;
+	int j;
+
+	for (j = 0; j < dim; j++)
+		neg |= (curr[j] < prev[j]);
+	return !neg;
+}
+
+static inline uint64_t vec_sum(const uint64_t* restrict in, int dim){
+	uint64_t sum = 0;
+	int j;
+
+	for (j = 0; j < dim; j++)
+		sum += in[j];
+	return sum;
+}
+
+static inline uint64_t vec_max(const uint64_t* restrict in, int dim){
+	uint64_t m = in[0];
+	int j;
+
+	for (j = 1; j < dim; j++)
+		m = (in[j] > m ? in[j] : m);
+	return m;
+}
+
+static inline uint64_t vec_min(const uint64_t* restrict in, int dim){
+	uint64_t m = in[0];
+	int j;
+
+	for (j = 1; j < dim; j++)
+		m = (in[j] < m ? in[j] : m);
+	return m;
+}
+
+/**
+ * \brief Evaluate a plan step marked fast.
+ *
+ * Same semantics (order of operations, casts and validity rules) as doFunc,
+ * except that the input is resolved once to a u64 vector and each function
+ * is a single loop over it. Returns the valid flag.
+ */
+static int fastFunc(ldms_set_t set, struct setdatapoint* dp,
+		    struct plan_step* st, struct timeval diff, int flagtime){
+
+	struct derived_data* dd = st->dd;
+	struct dinfo* di = &dp->datavals[dd->idx];
+	uint64_t* restrict retvals = di->returnvals;
+	const uint64_t* in;
+	double scale = dd->scale;
+	int dim = dd->dim;
+	int in_valid = 1;
+	int j;
+
+	if (st->base){
+		ldms_mval_t mv = (st->in_array ? ldms_metric_array_get(set, st->in_idx) :
+				  ldms_metric_get(set, st->in_idx));
+		in = (st->in_array ? mv->a_u64 : &mv->v_u64);
+	} else {
+		in = dp->datavals[st->in_idx].returnvals;
+		in_valid = dp->datavals[st->in_idx].returnvalid;
+	}
+
+	switch (dd->fct){
+	case RAW:
+		di->returnvalid = in_valid;
+		if (!in_valid)
+			break;
+		for (j = 0; j < dim; j++)
+			retvals[j] = in[j] * scale;
+		return 1;
+	case THRESH_GE:
+		di->returnvalid = in_valid;
+		if (!in_valid)
+			break;
+		for (j = 0; j < dim; j++)
+			retvals[j] = (in[j] >= scale);
+		return 1;
+	case THRESH_LT:
+		di->returnvalid = in_valid;
+		if (!in_valid)
+			break;
+		for (j = 0; j < dim; j++)
+			retvals[j] = (in[j] < scale);
+		return 1;
+	case MAX:
+	case MIN:
+	case SUM:
+	case AVG:
+		di->returnvalid = in_valid;
+		if (!in_valid)
+			break;
+		switch (dd->fct){
+		case MAX:
+			retvals[0] = vec_max(in, st->in_dim);
+			retvals[0] *= scale;
+			break;
+		case MIN:
+			retvals[0] = vec_min(in, st->in_dim);
+			retvals[0] *= scale;
+			break;
+		case SUM:
+			retvals[0] = vec_sum(in, st->in_dim);
+			retvals[0] *= scale;
+			break;
+		default:
+			retvals[0] = (uint64_t)(((double)vec_sum(in, st->in_dim) * scale)/
+						(double)st->in_dim);
+			break;
+		}
+		return 1;
+	case RATE:
+	case DELTA:
+	{
+		/* see doFunc for the validity rules; in_valid here is the
+		 * validity of the new value of the dependent variable */
+		uint64_t* restrict storevals = di->storevals;
+		int valid = in_valid && di->storevalid && !flagtime &&
+			vec_nonneg(in, storevals, dim);
+
+		if (valid){
+			if (dd->fct == DELTA){
+				for (j = 0; j < dim; j++)
+					retvals[j] = (uint64_t)((double)(in[j] - storevals[j])*scale);
 			} else {
-				dp->datavals[i].storevals = NULL;
+				double dt_usec = (double)(diff.tv_sec*1000000+diff.tv_usec);
+				for (j = 0; j < dim; j++)
+					retvals[j] = (uint64_t)((((double)(in[j] - storevals[j])*1000000.0)*scale)/dt_usec);
 			}
+		} else {
+			memset(retvals, 0, dim * sizeof(uint64_t));
 		}
-
-		*firsttime = 1;
+		//dont store the scale, since it will be reapplied next time
+		if (in_valid)
+			memcpy(storevals, in, dim * sizeof(uint64_t));
+		else
+			memset(storevals, 0, dim * sizeof(uint64_t));
+		di->storevalid = in_valid;
+		di->returnvalid = valid;
+		return valid;
+	}
+	default:
+		/* NOTREACHED */
+		TOKEN_ERR(dd->fct, "RAW,THRESH_GE,THRESH_LT,MAX,MIN,SUM,AVG,RATE,DELTA");
+		break;
 	}
 
-	*rdp = dp;
+	memset(retvals, 0, dim * sizeof(uint64_t));
 	return 0;
+}
 
+static void free_datapoint(void* obj, void* cb_arg){
+	struct setdatapoint* dp = obj;
 
-err:
-	msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
-	for (j = 0; j <= i; j++){
-		if (dp->datavals[j].storevals)
-			free(dp->datavals[j].storevals);
-		if (dp->datavals[j].returnvals)
-			free(dp->datavals[j].returnvals);
-	}
 	free(dp->datavals);
-	free(dp->ts);
+	free(dp->vals);
 	free(dp);
-	dp = NULL;
+}
+
+/**
+ * (Re)lay out dp for the current plan of s_handle. All of the return and
+ * store vals live in dp->vals, at the offsets computed by compile_plan.
+ */
+static int layout_datapoint(struct function_store_handle *s_handle,
+			    struct setdatapoint* dp){
+	struct fn_plan* plan = &s_handle->plan;
+	struct dinfo* datavals;
+	uint64_t* vals;
+	int i;
+
+	datavals = calloc(plan->nsteps ? plan->nsteps : 1, sizeof(struct dinfo));
+	vals = calloc(plan->nvals ? plan->nvals : 1, sizeof(uint64_t));
+	if (!datavals || !vals) {
+		msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
+		free(datavals);
+		free(vals);
+		return ENOMEM;
+	}
 
-	return ENOMEM;
+	for (i = 0; i < plan->nsteps; i++){
+		datavals[i].dim = plan->steps[i].dd->dim;
+		if (plan->ret_off[i] != (size_t)-1)
+			datavals[i].returnvals = &vals[plan->ret_off[i]];
+		if (plan->store_off[i] != (size_t)-1)
+			datavals[i].storevals = &vals[plan->store_off[i]];
+	}
+
+	free(dp->datavals);
+	free(dp->vals);
+	dp->datavals = datavals;
+	dp->vals = vals;
+	dp->ts.sec = 0;
+	dp->ts.usec = 0;
+	dp->firsttime = 1;
+	dp->plan_gen = s_handle->plan_gen;
+	return 0;
+}
+
+/**
+ * Slow path for finding the per instance data: looked up by instance name
+ * the first time an instance is seen by this store (or after the plan has
+ * been recompiled). The caller caches the result in the store context.
+ */
+static int get_datapoint(struct function_store_handle *s_handle,
+			 const char* instance_name, struct setdatapoint** rdp){
+
+	struct setdatapoint* dp = NULL;
+	int rc;
+
+	if (rdp == NULL){
+		msglog(LDMSD_LERROR, "%s: arg to getDatapoint is NULL!\n",
+		       __FILE__);
+		return EINVAL;
+	}
+
+	*rdp = NULL;
+
+	dp = idx_find(s_handle->sets_idx, (void*) instance_name,
+		      strlen(instance_name));
 
+	if (dp == NULL){
+		//create a container to hold it
+		dp = calloc(1, sizeof(struct setdatapoint));
+		if (!dp) {
+			msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
+			return ENOMEM;
+		}
+		rc = layout_datapoint(s_handle, dp);
+		if (rc) {
+			free(dp);
+			return rc;
+		}
+		s_handle->numsets++;
+
+		idx_add(s_handle->sets_idx, (void*)instance_name,
+			strlen(instance_name), dp);
+	} else if (dp->plan_gen != s_handle->plan_gen){
+		rc = layout_datapoint(s_handle, dp);
+		if (rc)
+			return rc;
+	}
+
+	*rdp = dp;
+	return 0;
 };
 
 
 static int
-store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t metric_count)
+store_ctxt(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry,
+	   size_t metric_count, void **ctxt)
 {
 
 	const struct ldms_timestamp _ts = ldms_transaction_timestamp_get(set);
@@ -2757,7 +3042,6 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 	struct timeval prev, curr, diff;
 	int skip = 0;
 	int setflagtime = 0;
-	int tempidx;
 	int doflush = 0;
 	int rc;
 	int i, j;
@@ -2796,22 +3080,34 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 		break;
 	}
 
-	rc = get_datapoint(&(s_handle->sets_idx), ldms_set_instance_name_get(set),
-			   s_handle->numder, s_handle->der,
-			   &(s_handle->numsets), &dp, &skip);
-	if (rc != 0){
-		pthread_mutex_unlock(&s_handle->lock);
-		return rc;
+	if (!s_handle->plan_gen){
+		rc = compile_plan(s_handle, set, metric_arry);
+		if (rc != 0){
+			pthread_mutex_unlock(&s_handle->lock);
+			return rc;
+		}
 	}
 
+	dp = (ctxt ? *ctxt : NULL);
+	if (!dp || (dp->plan_gen != s_handle->plan_gen)){
+		rc = get_datapoint(s_handle, ldms_set_instance_name_get(set), &dp);
+		if (rc != 0){
+			pthread_mutex_unlock(&s_handle->lock);
+			return rc;
+		}
+		if (ctxt)
+			*ctxt = dp;
+	}
+	skip = dp->firsttime;
+
 	/*
 	 * New in v3: if time diff is not positive, always write out something and flag.
 	 * if its RAW data, write the val. if its RATE data, write zero
 	 */
 
 	setflagtime = 0;
-	prev.tv_sec = dp->ts->sec;
-	prev.tv_usec = dp->ts->usec;
+	prev.tv_sec = dp->ts.sec;
+	prev.tv_usec = dp->ts.usec;
 	curr.tv_sec = ts->sec;
 	curr.tv_usec = ts->usec;
 
@@ -2835,15 +3131,13 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 
 	pname = ldms_set_producer_name_get(set);
 
-	tempidx = ldms_metric_by_name(set, "component_id");
-	if (tempidx != -1)
-		compid = ldms_metric_get_u64(set, metric_arry[tempidx]);
+	if (s_handle->plan.compid_idx != -1)
+		compid = ldms_metric_get_u64(set, s_handle->plan.compid_idx);
 	else
 		compid = 0;
 
-	tempidx = ldms_metric_by_name(set, "job_id");
-	if (tempidx != -1)
-		jobid = ldms_metric_get_u64(set, metric_arry[tempidx]);
+	if (s_handle->plan.jobid_idx != -1)
+		jobid = ldms_metric_get_u64(set, s_handle->plan.jobid_idx);
 	else
 		jobid = 0;
 
@@ -2875,38 +3169,44 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 			//this will also do its writeout
 			if (!skip)
 				(void)doRAWTERMFunc(set, s_handle, metric_arry, s_handle->der[i]);
-		} else {
+			continue;
+		}
+
+		if (s_handle->plan.steps[i].fast)
+			(void)fastFunc(set, dp, &s_handle->plan.steps[i],
+				       diff, setflagtime);
+		else
 			(void)doFunc(set, metric_arry,
 				     dp, s_handle->der[i],
 				     diff, setflagtime);
-			//write it out, if its writeout and not skip
-			//FIXME: Should the writeout be moved in so its like doRAWTERMFunc ?
-			if (!skip && s_handle->der[i]->writeout){
-				struct dinfo* di = &(dp->datavals[i]);
-				for (j = 0; j < di->dim; j++) {
-					rc = fprintf(s_handle->file, ",%" PRIu64, di->returnvals[j]);
-					if (rc < 0) {
-						msglog(LDMSD_LERROR,"%s: Error %d writing to '%s'\n",
-						       __FILE__, rc, s_handle->path);
-						//FIXME: should this exit entirely from this store?
-						break;
-					} else {
-						s_handle->byte_count += rc;
-					}
-				}
-				rc = fprintf(s_handle->file, ",%d", (!di->returnvalid));
-				if (rc < 0)
+		//write it out, if its writeout and not skip
+		//FIXME: Should the writeout be moved in so its like doRAWTERMFunc ?
+		if (!skip && s_handle->der[i]->writeout){
+			struct dinfo* di = &(dp->datavals[i]);
+			for (j = 0; j < di->dim; j++) {
+				rc = fprintf(s_handle->file, ",%" PRIu64, di->returnvals[j]);
+				if (rc < 0) {
 					msglog(LDMSD_LERROR,"%s: Error %d writing to '%s'\n",
 					       __FILE__, rc, s_handle->path);
-				else
+					//FIXME: should this exit entirely from this store?
+					break;
+				} else {
 					s_handle->byte_count += rc;
+				}
 			}
+			rc = fprintf(s_handle->file, ",%d", (!di->returnvalid));
+			if (rc < 0)
+				msglog(LDMSD_LERROR,"%s: Error %d writing to '%s'\n",
+				       __FILE__, rc, s_handle->path);
+			else
+				s_handle->byte_count += rc;
 		}
 	}
 
 	//finally update the time for this whole set.
-	dp->ts->sec = curr.tv_sec;
-	dp->ts->usec = curr.tv_usec;
+	dp->ts.sec = curr.tv_sec;
+	dp->ts.usec = curr.tv_usec;
+	dp->firsttime = 0;
 
 	if (!setflagtime)
 		if ((ageusec > 0) && ((diff.tv_sec*1000000+diff.tv_usec) > ageusec))
@@ -2939,6 +3239,12 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 	return 0;
 }
 
+static int
+store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t metric_count)
+{
+	return store_ctxt(_s_handle, set, metric_arry, metric_count, NULL);
+}
+
 static int flush_store(ldmsd_store_handle_t _s_handle)
 {
 	struct function_store_handle *s_handle = _s_handle;
@@ -2993,8 +3299,11 @@ static void close_store(ldmsd_store_handle_t _s_handle)
 
 	s_handle->numder = 0;
 
+	free_plan(&s_handle->plan);
+	s_handle->plan_gen = 0;
+
 	if (s_handle->sets_idx) {
-		//FIXME: need someway to iterate thru this to get the ptrs to free them
+		idx_traverse(s_handle->sets_idx, free_datapoint, NULL);
 		idx_destroy(s_handle->sets_idx);
 	}
 
@@ -3030,6 +3339,7 @@ static struct ldmsd_store store_function_csv = {
 	.open = open_store,
 	.get_context = get_ucontext,
 	.store = store,
+	.store_ctxt = store_ctxt,
 	.flush = flush_store,
 	.close = close_store,
 };
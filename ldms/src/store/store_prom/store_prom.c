@@ -0,0 +1,1078 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * store_prom serves the latest value of the stored sets over HTTP in the
+ * Prometheus text exposition format.
+ *
+ * The update threads only copy the values of a set into a per-set
+ * snapshot when its data generation number changes, and they never wait
+ * for a scrape: the snapshot lock is only try-locked and a sample that
+ * meets a scrape in progress is dropped (the next one replaces it).
+ *
+ * The metric family names and the per-set label strings are built once.
+ * The scrape renders the lines of a set again only when the generation
+ * number of its snapshot changed since the previous scrape and reuses
+ * the whole response when nothing was stored in between.
+ */
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <endian.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+#define STRP "store_prom"
+
+#define _stringify(_x) #_x
+#define stringify(_x) _stringify(_x)
+
+#define PROM_PORT	9101
+#define PROM_STALE	600	/* seconds */
+#define PROM_REQ_MAX	4096
+
+static ldmsd_msg_log_f msglog;
+
+/* A value of the schema, compiled from the first set stored */
+struct prom_metric {
+	int mid;
+	enum ldms_value_type type;
+	int count;	/* array length, 1 for scalars */
+	size_t size;	/* bytes copied into the snapshot */
+	size_t off;	/* offset in the snapshot */
+	char *family;	/* <prefix>_<schema>_<metric> */
+};
+
+/* The latest values of a set */
+struct prom_set {
+	struct rbn rbn;
+	char *name;
+	pthread_mutex_t lock;	/* snapshot, labels; try-locked by store() */
+	uint64_t gn;		/* data generation number of the snapshot */
+	uint64_t meta_gn;	/* meta generation number of the labels */
+	uint64_t ts_ms;		/* sample timestamp */
+	time_t last_store;
+	char *labels;
+	char *snap;
+
+	/* owned by the scraper */
+	uint64_t text_gn;
+	char *text;
+	size_t text_len;
+	size_t text_sz;
+	size_t *line_off;	/* metric i: text[line_off[i]..line_off[i+1]] */
+};
+
+/* A container/schema storage policy */
+struct prom_store {
+	struct ldmsd_store *store;
+	void *ucontext;
+	char *key;		/* <container>:<schema> */
+	char *schema;
+	int ref_count;
+	pthread_rwlock_t rwlock; /* set_tree and the template */
+	struct rbt set_tree;
+	int compiled;
+	int metric_count;	/* samples */
+	int label_count;	/* meta values used as labels */
+	size_t snap_len;
+	struct prom_metric *metric;
+	int *label_mid;
+	LIST_ENTRY(prom_store) entry;
+};
+
+static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(prom_store_list, prom_store) store_list;
+static char *prefix;
+static int stale = PROM_STALE;
+
+/* bumped on every new snapshot; the response is reused while unchanged */
+static uint64_t store_gen = 1;
+
+static pthread_mutex_t http_lock = PTHREAD_MUTEX_INITIALIZER;
+static int listen_fd = -1;
+static pthread_t http_thread;
+
+/* the scrape response, owned by http_thread */
+struct prom_buf {
+	char *buf;
+	size_t len;
+	size_t sz;
+};
+static struct prom_buf resp;
+static uint64_t resp_gen;
+static time_t resp_expire; /* when the first set in resp becomes stale */
+
+static int buf_reserve(struct prom_buf *b, size_t n)
+{
+	char *p;
+	size_t sz;
+	if (b->len + n <= b->sz)
+		return 0;
+	sz = b->sz ? b->sz : 4096;
+	while (sz < b->len + n)
+		sz *= 2;
+	p = realloc(b->buf, sz);
+	if (!p)
+		return ENOMEM;
+	b->buf = p;
+	b->sz = sz;
+	return 0;
+}
+
+static int buf_append(struct prom_buf *b, const char *s, size_t n)
+{
+	if (buf_reserve(b, n))
+		return ENOMEM;
+	memcpy(&b->buf[b->len], s, n);
+	b->len += n;
+	return 0;
+}
+
+static int buf_printf(struct prom_buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+	while (1) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->buf ? &b->buf[b->len] : NULL,
+			      b->sz - b->len, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return EINVAL;
+		if (b->len + n < b->sz)
+			break;
+		if (buf_reserve(b, n + 1))
+			return ENOMEM;
+	}
+	b->len += n;
+	return 0;
+}
+
+/* Prometheus metric names: [a-zA-Z_:][a-zA-Z0-9_:]* */
+static char *family_name(const char *schema, const char *metric)
+{
+	char *name, *s;
+	size_t len = strlen(prefix) + strlen(schema) + strlen(metric) + 3;
+	name = malloc(len);
+	if (!name)
+		return NULL;
+	snprintf(name, len, "%s_%s_%s", prefix, schema, metric);
+	for (s = name; *s; s++) {
+		if (!isalnum(*s) && *s != '_' && *s != ':')
+			*s = '_';
+	}
+	if (isdigit(name[0]))
+		name[0] = '_';
+	return name;
+}
+
+/* Label names: [a-zA-Z_][a-zA-Z0-9_]* */
+static int label_name_append(struct prom_buf *b, const char *name)
+{
+	int rc = 0;
+	const char *s;
+	char c;
+	for (s = name; *s && !rc; s++) {
+		c = *s;
+		if (!isalnum(c) || (s == name && isdigit(c)))
+			c = '_';
+		rc = buf_append(b, &c, 1);
+	}
+	return rc;
+}
+
+static int label_value_append(struct prom_buf *b, const char *value)
+{
+	int rc = 0;
+	const char *s;
+	for (s = value; *s && !rc; s++) {
+		switch (*s) {
+		case '\\':
+			rc = buf_append(b, "\\\\", 2);
+			break;
+		case '"':
+			rc = buf_append(b, "\\\"", 2);
+			break;
+		case '\n':
+			rc = buf_append(b, "\\n", 2);
+			break;
+		default:
+			rc = buf_append(b, s, 1);
+			break;
+		}
+	}
+	return rc;
+}
+
+static size_t value_size(enum ldms_value_type type)
+{
+	switch (type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_CHAR_ARRAY:
+	case LDMS_V_U8:
+	case LDMS_V_U8_ARRAY:
+	case LDMS_V_S8:
+	case LDMS_V_S8_ARRAY:
+		return 1;
+	case LDMS_V_U16:
+	case LDMS_V_U16_ARRAY:
+	case LDMS_V_S16:
+	case LDMS_V_S16_ARRAY:
+		return 2;
+	case LDMS_V_U32:
+	case LDMS_V_U32_ARRAY:
+	case LDMS_V_S32:
+	case LDMS_V_S32_ARRAY:
+	case LDMS_V_F32:
+	case LDMS_V_F32_ARRAY:
+		return 4;
+	case LDMS_V_U64:
+	case LDMS_V_U64_ARRAY:
+	case LDMS_V_S64:
+	case LDMS_V_S64_ARRAY:
+	case LDMS_V_D64:
+	case LDMS_V_D64_ARRAY:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static void prom_template_free(struct prom_store *ps)
+{
+	int i;
+	if (ps->metric) {
+		for (i = 0; i < ps->metric_count; i++)
+			free(ps->metric[i].family);
+		free(ps->metric);
+	}
+	free(ps->label_mid);
+	ps->metric = NULL;
+	ps->label_mid = NULL;
+	ps->metric_count = ps->label_count = 0;
+	ps->snap_len = 0;
+	ps->compiled = 0;
+}
+
+/*
+ * Build the template from the first set: the numeric data values are the
+ * samples, the scalar and string meta values are labels. Character data
+ * arrays and numeric meta arrays are not exported.
+ * The write lock is held.
+ */
+static int prom_template_compile(struct prom_store *ps, ldms_set_t set,
+				 int *metric_arry, size_t metric_count)
+{
+	struct prom_metric *m;
+	enum ldms_value_type type;
+	int i, mid, is_meta;
+
+	ps->metric = calloc(metric_count, sizeof(*ps->metric));
+	ps->label_mid = calloc(metric_count, sizeof(*ps->label_mid));
+	if (!ps->metric || !ps->label_mid)
+		goto enomem;
+	for (i = 0; i < metric_count; i++) {
+		mid = metric_arry[i];
+		type = ldms_metric_type_get(set, mid);
+		is_meta = ldms_metric_flags_get(set, mid) & LDMS_MDESC_F_META;
+		if (is_meta) {
+			if (type == LDMS_V_CHAR_ARRAY ||
+			    !ldms_type_is_array(type))
+				ps->label_mid[ps->label_count++] = mid;
+			continue;
+		}
+		if (type == LDMS_V_CHAR_ARRAY || type == LDMS_V_CHAR)
+			continue;
+		m = &ps->metric[ps->metric_count];
+		m->mid = mid;
+		m->type = type;
+		m->count = ldms_type_is_array(type) ?
+				ldms_metric_array_get_len(set, mid) : 1;
+		m->size = m->count * value_size(type);
+		m->off = ps->snap_len;
+		m->family = family_name(ps->schema,
+					ldms_metric_name_get(set, mid));
+		if (!m->family)
+			goto enomem;
+		ps->metric_count++;
+		/* keep the values 8-byte aligned */
+		ps->snap_len += (m->size + 7) & ~7;
+	}
+	ps->compiled = 1;
+	return 0;
+enomem:
+	prom_template_free(ps);
+	return ENOMEM;
+}
+
+/* Build the label string of a set. The set lock is held. */
+static int prom_set_labels(struct prom_store *ps, struct prom_set *pset,
+			   ldms_set_t set)
+{
+	struct prom_buf b = { 0 };
+	int i, mid, rc;
+
+	rc = buf_printf(&b, "instance=\"");
+	rc = rc ? rc : label_value_append(&b, pset->name);
+	rc = rc ? rc : buf_printf(&b, "\",producer=\"");
+	rc = rc ? rc : label_value_append(&b, ldms_set_producer_name_get(set));
+	rc = rc ? rc : buf_append(&b, "\"", 1);
+	for (i = 0; !rc && i < ps->label_count; i++) {
+		mid = ps->label_mid[i];
+		rc = buf_append(&b, ",", 1);
+		rc = rc ? rc : label_name_append(&b, ldms_metric_name_get(set, mid));
+		rc = rc ? rc : buf_append(&b, "=\"", 2);
+		if (rc)
+			break;
+		if (ldms_metric_type_get(set, mid) == LDMS_V_CHAR_ARRAY)
+			rc = label_value_append(&b,
+					ldms_metric_array_get_str(set, mid));
+		else if (ldms_metric_type_get(set, mid) == LDMS_V_F32 ||
+			 ldms_metric_type_get(set, mid) == LDMS_V_D64)
+			rc = buf_printf(&b, "%g", ldms_metric_get_double(set, mid));
+		else if (ldms_metric_type_get(set, mid) == LDMS_V_S8 ||
+			 ldms_metric_type_get(set, mid) == LDMS_V_S16 ||
+			 ldms_metric_type_get(set, mid) == LDMS_V_S32 ||
+			 ldms_metric_type_get(set, mid) == LDMS_V_S64)
+			rc = buf_printf(&b, "%" PRId64, ldms_metric_get_s64(set, mid));
+		else
+			rc = buf_printf(&b, "%" PRIu64, ldms_metric_get_u64(set, mid));
+		rc = rc ? rc : buf_append(&b, "\"", 1);
+	}
+	rc = rc ? rc : buf_append(&b, "", 1);
+	if (rc) {
+		free(b.buf);
+		return rc;
+	}
+	free(pset->labels);
+	pset->labels = b.buf;
+	pset->meta_gn = ldms_set_meta_gn_get(set);
+	return 0;
+}
+
+static int set_name_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static void prom_set_free(struct prom_set *pset)
+{
+	pthread_mutex_destroy(&pset->lock);
+	free(pset->name);
+	free(pset->labels);
+	free(pset->snap);
+	free(pset->text);
+	free(pset->line_off);
+	free(pset);
+}
+
+static struct prom_set *prom_set_new(const char *name)
+{
+	struct prom_set *pset = calloc(1, sizeof(*pset));
+	if (!pset)
+		return NULL;
+	pset->name = strdup(name);
+	if (!pset->name) {
+		free(pset);
+		return NULL;
+	}
+	pthread_mutex_init(&pset->lock, NULL);
+	rbn_init(&pset->rbn, pset->name);
+	return pset;
+}
+
+/* The set lock is held */
+static void prom_set_snap(struct prom_store *ps, struct prom_set *pset,
+			  ldms_set_t set)
+{
+	struct ldms_timestamp ts;
+	struct prom_metric *m;
+	uint64_t gn;
+	int i;
+
+	gn = ldms_set_data_gn_get(set);
+	if (gn != pset->gn || !pset->labels) {
+		for (i = 0; i < ps->metric_count; i++) {
+			m = &ps->metric[i];
+			memcpy(&pset->snap[m->off],
+			       ldms_metric_get_addr(set, m->mid), m->size);
+		}
+		ts = ldms_transaction_timestamp_get(set);
+		pset->ts_ms = (uint64_t)ts.sec * 1000 + ts.usec / 1000;
+		pset->gn = gn;
+		__sync_fetch_and_add(&store_gen, 1);
+	}
+	if (!pset->labels || pset->meta_gn != ldms_set_meta_gn_get(set)) {
+		if (!prom_set_labels(ps, pset, set)) {
+			pset->text_gn = 0; /* render the new labels */
+			__sync_fetch_and_add(&store_gen, 1);
+		}
+	}
+	pset->last_store = time(NULL);
+}
+
+/* Add the set; the samples that meet a scrape or a compile are dropped. */
+static int prom_set_add(struct prom_store *ps, ldms_set_t set,
+			int *metric_arry, size_t metric_count)
+{
+	struct prom_set *pset;
+	struct rbn *rbn;
+	int rc = 0;
+
+	pset = prom_set_new(ldms_set_instance_name_get(set));
+	if (!pset)
+		return ENOMEM;
+	if (pthread_rwlock_trywrlock(&ps->rwlock)) {
+		prom_set_free(pset);
+		return 0;
+	}
+	rbn = rbt_find(&ps->set_tree, pset->name);
+	if (rbn)
+		goto out; /* raced with another thread */
+	if (!ps->compiled) {
+		rc = prom_template_compile(ps, set, metric_arry, metric_count);
+		if (rc)
+			goto out;
+	}
+	pset->snap = calloc(1, ps->snap_len + 1);
+	pset->line_off = calloc(ps->metric_count + 1, sizeof(size_t));
+	if (!pset->snap || !pset->line_off) {
+		rc = ENOMEM;
+		goto out;
+	}
+	pthread_mutex_lock(&pset->lock);
+	prom_set_snap(ps, pset, set);
+	pthread_mutex_unlock(&pset->lock);
+	rbt_ins(&ps->set_tree, &pset->rbn);
+	pset = NULL;
+out:
+	pthread_rwlock_unlock(&ps->rwlock);
+	if (pset)
+		prom_set_free(pset);
+	return rc;
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry,
+      size_t metric_count)
+{
+	struct prom_store *ps = _sh;
+	struct prom_set *pset;
+	struct rbn *rbn;
+
+	if (!ps)
+		return EINVAL;
+	if (pthread_rwlock_tryrdlock(&ps->rwlock))
+		return 0; /* pruning in progress */
+	rbn = rbt_find(&ps->set_tree, ldms_set_instance_name_get(set));
+	if (!rbn) {
+		pthread_rwlock_unlock(&ps->rwlock);
+		return prom_set_add(ps, set, metric_arry, metric_count);
+	}
+	pset = container_of(rbn, struct prom_set, rbn);
+	if (0 == pthread_mutex_trylock(&pset->lock)) {
+		prom_set_snap(ps, pset, set);
+		pthread_mutex_unlock(&pset->lock);
+	}
+	pthread_rwlock_unlock(&ps->rwlock);
+	return 0;
+}
+
+static int value_append(struct prom_buf *b, enum ldms_value_type type,
+			const char *p)
+{
+	union {
+		uint8_t u8;
+		uint16_t u16;
+		uint32_t u32;
+		uint64_t u64;
+		float f;
+		double d;
+	} v;
+	double d;
+	int prec = 17; /* digits to print a double back exactly */
+
+	switch (type) {
+	case LDMS_V_U8:
+	case LDMS_V_U8_ARRAY:
+		return buf_printf(b, "%" PRIu8, *(uint8_t *)p);
+	case LDMS_V_S8:
+	case LDMS_V_S8_ARRAY:
+		return buf_printf(b, "%" PRId8, *(int8_t *)p);
+	case LDMS_V_U16:
+	case LDMS_V_U16_ARRAY:
+		memcpy(&v.u16, p, 2);
+		return buf_printf(b, "%" PRIu16, le16toh(v.u16));
+	case LDMS_V_S16:
+	case LDMS_V_S16_ARRAY:
+		memcpy(&v.u16, p, 2);
+		return buf_printf(b, "%" PRId16, (int16_t)le16toh(v.u16));
+	case LDMS_V_U32:
+	case LDMS_V_U32_ARRAY:
+		memcpy(&v.u32, p, 4);
+		return buf_printf(b, "%" PRIu32, le32toh(v.u32));
+	case LDMS_V_S32:
+	case LDMS_V_S32_ARRAY:
+		memcpy(&v.u32, p, 4);
+		return buf_printf(b, "%" PRId32, (int32_t)le32toh(v.u32));
+	case LDMS_V_U64:
+	case LDMS_V_U64_ARRAY:
+		memcpy(&v.u64, p, 8);
+		return buf_printf(b, "%" PRIu64, le64toh(v.u64));
+	case LDMS_V_S64:
+	case LDMS_V_S64_ARRAY:
+		memcpy(&v.u64, p, 8);
+		return buf_printf(b, "%" PRId64, (int64_t)le64toh(v.u64));
+	case LDMS_V_F32:
+	case LDMS_V_F32_ARRAY:
+		memcpy(&v.u32, p, 4);
+		v.u32 = le32toh(v.u32);
+		d = v.f;
+		prec = 9;
+		break;
+	case LDMS_V_D64:
+	case LDMS_V_D64_ARRAY:
+		memcpy(&v.u64, p, 8);
+		v.u64 = le64toh(v.u64);
+		d = v.d;
+		break;
+	default:
+		return EINVAL;
+	}
+	if (isnan(d))
+		return buf_printf(b, "NaN");
+	if (isinf(d))
+		return buf_printf(b, d < 0 ? "-Inf" : "+Inf");
+	return buf_printf(b, "%.*g", prec, d);
+}
+
+/* Render the lines of a set from its snapshot. The set lock is held. */
+static int prom_set_render(struct prom_store *ps, struct prom_set *pset)
+{
+	struct prom_buf b = { pset->text, 0, pset->text_sz };
+	struct prom_metric *m;
+	const char *p;
+	int i, j, rc = 0;
+
+	for (i = 0; !rc && i < ps->metric_count; i++) {
+		m = &ps->metric[i];
+		pset->line_off[i] = b.len;
+		p = &pset->snap[m->off];
+		for (j = 0; !rc && j < m->count; j++) {
+			if (ldms_type_is_array(m->type))
+				rc = buf_printf(&b, "%s{%s,idx=\"%d\"} ",
+						m->family, pset->labels, j);
+			else
+				rc = buf_printf(&b, "%s{%s} ",
+						m->family, pset->labels);
+			rc = rc ? rc : value_append(&b, m->type,
+						p + j * value_size(m->type));
+			rc = rc ? rc : buf_printf(&b, " %" PRIu64 "\n",
+						  pset->ts_ms);
+		}
+	}
+	pset->line_off[ps->metric_count] = b.len;
+	pset->text = b.buf;
+	pset->text_sz = b.sz;
+	pset->text_len = b.len;
+	if (rc) {
+		/* render it again next time */
+		memset(pset->line_off, 0,
+		       (ps->metric_count + 1) * sizeof(size_t));
+		pset->text_gn = 0;
+		return rc;
+	}
+	pset->text_gn = pset->gn;
+	return 0;
+}
+
+static int prom_store_scrape(struct prom_store *ps, time_t now,
+			     time_t *expire)
+{
+	struct prom_set *pset;
+	struct rbn *rbn, *next;
+	int i, rc = 0, nstale = 0;
+
+	pthread_rwlock_rdlock(&ps->rwlock);
+	if (!ps->compiled)
+		goto out;
+	for (rbn = rbt_min(&ps->set_tree); rbn; rbn = rbn_succ(rbn)) {
+		pset = container_of(rbn, struct prom_set, rbn);
+		if (stale && now - pset->last_store > stale) {
+			nstale++;
+			continue;
+		}
+		if (stale && pset->last_store + stale + 1 < *expire)
+			*expire = pset->last_store + stale + 1;
+		pthread_mutex_lock(&pset->lock);
+		if (pset->text_gn != pset->gn || !pset->text_gn)
+			prom_set_render(ps, pset);
+		pthread_mutex_unlock(&pset->lock);
+	}
+	/* only the scraper writes pset->text, no lock needed */
+	for (i = 0; !rc && i < ps->metric_count; i++) {
+		rc = buf_printf(&resp, "# TYPE %s gauge\n",
+				ps->metric[i].family);
+		for (rbn = rbt_min(&ps->set_tree); !rc && rbn;
+		     rbn = rbn_succ(rbn)) {
+			pset = container_of(rbn, struct prom_set, rbn);
+			if (stale && now - pset->last_store > stale)
+				continue;
+			rc = buf_append(&resp, &pset->text[pset->line_off[i]],
+					pset->line_off[i + 1] -
+					pset->line_off[i]);
+		}
+	}
+out:
+	pthread_rwlock_unlock(&ps->rwlock);
+	if (!nstale)
+		return rc;
+
+	/* forget the sets that are no longer stored */
+	pthread_rwlock_wrlock(&ps->rwlock);
+	rbn = rbt_min(&ps->set_tree);
+	while (rbn) {
+		next = rbn_succ(rbn);
+		pset = container_of(rbn, struct prom_set, rbn);
+		if (now - pset->last_store > stale) {
+			rbt_del(&ps->set_tree, rbn);
+			prom_set_free(pset);
+		}
+		rbn = next;
+	}
+	pthread_rwlock_unlock(&ps->rwlock);
+	return rc;
+}
+
+/* Called from http_thread only */
+static int prom_scrape()
+{
+	struct prom_store *ps;
+	uint64_t gen;
+	time_t now;
+	int rc = 0;
+
+	gen = store_gen;
+	now = time(NULL);
+	if (resp.buf && gen == resp_gen && now < resp_expire)
+		return 0;
+	resp.len = 0;
+	resp_expire = now + (stale ? stale + 1 : 3600);
+	pthread_mutex_lock(&cfg_lock);
+	LIST_FOREACH(ps, &store_list, entry) {
+		rc = prom_store_scrape(ps, now, &resp_expire);
+		if (rc)
+			break;
+	}
+	pthread_mutex_unlock(&cfg_lock);
+	resp_gen = rc ? 0 : gen;
+	return rc;
+}
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+	while (len) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void http_reply(int fd, const char *status, const char *ctype,
+		       const char *body, size_t len)
+{
+	char hdr[256];
+	int n;
+	n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+		     "Content-Type: %s\r\n"
+		     "Content-Length: %zu\r\n"
+		     "Connection: close\r\n\r\n", status, ctype, len);
+	if (send_all(fd, hdr, n))
+		return;
+	send_all(fd, body, len);
+}
+
+static void http_serve(int fd)
+{
+	char req[PROM_REQ_MAX + 1];
+	struct timeval tv = { .tv_sec = 5 };
+	char *method, *path, *q, *sp;
+	size_t len = 0;
+	ssize_t n;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	while (len < PROM_REQ_MAX) {
+		n = recv(fd, &req[len], PROM_REQ_MAX - len, 0);
+		if (n <= 0)
+			return;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+			break;
+	}
+	req[len] = '\0';
+	method = strtok_r(req, " ", &sp);
+	path = strtok_r(NULL, " \r\n", &sp);
+	if (!method || !path) {
+		http_reply(fd, "400 Bad Request", "text/plain", "", 0);
+		return;
+	}
+	if (strcmp(method, "GET")) {
+		http_reply(fd, "405 Method Not Allowed", "text/plain", "", 0);
+		return;
+	}
+	q = strchr(path, '?');
+	if (q)
+		*q = '\0';
+	if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+		http_reply(fd, "404 Not Found", "text/plain", "", 0);
+		return;
+	}
+	if (prom_scrape()) {
+		msglog(LDMSD_LERROR, STRP ": out of memory rendering "
+		       "the metrics\n");
+		http_reply(fd, "500 Internal Server Error", "text/plain",
+			   "", 0);
+		return;
+	}
+	http_reply(fd, "200 OK", "text/plain; version=0.0.4",
+		   resp.buf, resp.len);
+}
+
+static void *http_proc(void *arg)
+{
+	int fd = (int)(long)arg;
+	int cfd;
+	while (1) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break; /* shut down */
+		}
+		http_serve(cfd);
+		close(cfd);
+	}
+	return NULL;
+}
+
+/* http_lock is held */
+static void http_stop()
+{
+	if (listen_fd < 0)
+		return;
+	shutdown(listen_fd, SHUT_RDWR);
+	pthread_join(http_thread, NULL);
+	close(listen_fd);
+	listen_fd = -1;
+}
+
+/* http_lock is held */
+static int http_start(const char *address, const char *port)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct addrinfo *ai;
+	int fd, rc, on = 1;
+
+	rc = getaddrinfo(address, port, &hints, &ai);
+	if (rc) {
+		msglog(LDMSD_LERROR, STRP ": cannot resolve %s:%s: %s\n",
+		       address, port, gai_strerror(rc));
+		return EINVAL;
+	}
+	fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0) {
+		rc = errno;
+		goto out;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, ai->ai_addr, ai->ai_addrlen) || listen(fd, 16)) {
+		rc = errno;
+		msglog(LDMSD_LERROR, STRP ": cannot listen on %s:%s: %s\n",
+		       address, port, strerror(rc));
+		close(fd);
+		goto out;
+	}
+	rc = pthread_create(&http_thread, NULL, http_proc, (void *)(long)fd);
+	if (rc) {
+		close(fd);
+		goto out;
+	}
+	listen_fd = fd;
+	msglog(LDMSD_LINFO, STRP ": serving http://%s:%s/metrics\n",
+	       address, port);
+out:
+	freeaddrinfo(ai);
+	return rc;
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	char *address, *port, *value, *end;
+	char port_buf[16];
+	long l;
+	int rc = 0;
+
+	address = av_value(avl, "address");
+	if (!address)
+		address = "127.0.0.1";
+	port = av_value(avl, "port");
+	if (!port) {
+		snprintf(port_buf, sizeof(port_buf), "%d", PROM_PORT);
+		port = port_buf;
+	}
+
+	pthread_mutex_lock(&cfg_lock);
+	value = av_value(avl, "stale");
+	if (value) {
+		l = strtol(value, &end, 0);
+		if (*end != '\0' || l < 0) {
+			msglog(LDMSD_LERROR, STRP ": invalid stale '%s'.\n",
+			       value);
+			rc = EINVAL;
+			goto out;
+		}
+		stale = l;
+	}
+	value = av_value(avl, "prefix");
+	if (value) {
+		if (!LIST_EMPTY(&store_list)) {
+			msglog(LDMSD_LERROR, STRP ": the prefix cannot be "
+			       "changed while storage policies are open.\n");
+			rc = EBUSY;
+			goto out;
+		}
+		value = strdup(value);
+		if (!value) {
+			rc = ENOMEM;
+			goto out;
+		}
+		free(prefix);
+		prefix = value;
+	}
+	pthread_mutex_unlock(&cfg_lock);
+
+	pthread_mutex_lock(&http_lock);
+	http_stop();
+	rc = http_start(address, port);
+	pthread_mutex_unlock(&http_lock);
+	return rc;
+out:
+	pthread_mutex_unlock(&cfg_lock);
+	return rc;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	pthread_mutex_lock(&http_lock);
+	http_stop();
+	pthread_mutex_unlock(&http_lock);
+	free(resp.buf);
+	memset(&resp, 0, sizeof(resp));
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return
+"    config name=store_prom [port=<port>] [address=<addr>] [stale=<sec>]\n"
+"           [prefix=<prefix>]\n"
+"              - Serve the latest stored values at http://<addr>:<port>/metrics\n"
+"                in the Prometheus text format.\n"
+"              port      The TCP port (default " stringify(PROM_PORT) ")\n"
+"              address   The address to listen on (default 127.0.0.1)\n"
+"              stale     Drop sets not stored for this many seconds\n"
+"                        (default " stringify(PROM_STALE) ", 0 keeps them)\n"
+"              prefix    The metric name prefix (default ldms)\n";
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	struct prom_store *ps = _sh;
+	return ps->ucontext;
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	struct prom_store *ps;
+	size_t len;
+	char *key;
+
+	len = strlen(container) + strlen(schema) + 2;
+	key = malloc(len);
+	if (!key)
+		return NULL;
+	snprintf(key, len, "%s:%s", container, schema);
+
+	pthread_mutex_lock(&cfg_lock);
+	LIST_FOREACH(ps, &store_list, entry) {
+		if (0 == strcmp(ps->key, key)) {
+			ps->ref_count++;
+			goto out;
+		}
+	}
+	ps = calloc(1, sizeof(*ps));
+	if (!ps)
+		goto out;
+	ps->schema = strdup(schema);
+	if (!ps->schema) {
+		free(ps);
+		ps = NULL;
+		goto out;
+	}
+	ps->key = key;
+	key = NULL;
+	ps->store = s;
+	ps->ucontext = ucontext;
+	ps->ref_count = 1;
+	pthread_rwlock_init(&ps->rwlock, NULL);
+	rbt_init(&ps->set_tree, set_name_cmp);
+	LIST_INSERT_HEAD(&store_list, ps, entry);
+out:
+	pthread_mutex_unlock(&cfg_lock);
+	free(key);
+	return ps;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	return 0;
+}
+
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct prom_store *ps = _sh;
+	struct prom_set *pset;
+	struct rbn *rbn;
+
+	if (!ps)
+		return;
+	pthread_mutex_lock(&cfg_lock);
+	if (--ps->ref_count) {
+		pthread_mutex_unlock(&cfg_lock);
+		return;
+	}
+	LIST_REMOVE(ps, entry);
+	pthread_mutex_unlock(&cfg_lock);
+	__sync_fetch_and_add(&store_gen, 1);
+
+	while ((rbn = rbt_min(&ps->set_tree))) {
+		rbt_del(&ps->set_tree, rbn);
+		pset = container_of(rbn, struct prom_set, rbn);
+		prom_set_free(pset);
+	}
+	prom_template_free(ps);
+	pthread_rwlock_destroy(&ps->rwlock);
+	free(ps->key);
+	free(ps->schema);
+	free(ps);
+}
+
+static struct ldmsd_store store_prom = {
+	.base = {
+		.name = STRP,
+		.type = LDMSD_PLUGIN_STORE,
+		.term = term,
+		.config = config,
+		.usage = usage,
+	},
+	.open = open_store,
+	.close = close_store,
+	.store = store,
+	.get_context = get_ucontext,
+	.flush = flush_store,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &store_prom.base;
+}
+
+static void __attribute__ ((constructor)) store_prom_init();
+static void store_prom_init()
+{
+	LIST_INIT(&store_list);
+	prefix = strdup("ldms");
+}
+
+static void __attribute__ ((destructor)) store_prom_fini(void);
+static void store_prom_fini()
+{
+	free(prefix);
+}
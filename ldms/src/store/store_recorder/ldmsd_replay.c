@@ -0,0 +1,779 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file ldmsd_replay.c
+ * \brief Replay a store_recorder recording into a store plugin.
+ *
+ * The sets of the recording are rebuilt in local memory and the store
+ * plugin is driven the way ldmsd drives it: one open per container and
+ * schema, a store() per recorded row, then flush and close. The rows
+ * are replayed as fast as possible or at a multiple of the recorded
+ * pace, and the throughput and the latency of store() are reported.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <coll/rbt.h>
+#include <ovis_util/util.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "store_recorder.h"
+
+#define FMT "f:s:o:x:F:v:"
+#define LDMSD_PLUGIN_LIBPATH_MAX 1024
+
+/* A set rebuilt from the recording, shared by the streams of all containers */
+struct rp_set {
+	struct rbn rbn;
+	char *name;
+	ldms_set_t set;
+	void *meta;		/* the recorded meta data block */
+	uint32_t meta_len;
+	uint32_t data_len;
+	void *data;		/* the data block of set */
+};
+
+/* A store handle: one per container and schema */
+struct rp_container {
+	struct rbn rbn;
+	char *key;		/* "<container>/<schema>" */
+	char *container;
+	char *schema;
+	struct ldmsd_strgp_metric_list metric_list;
+	ldmsd_store_handle_t sh;
+	uint64_t rows;
+};
+
+struct rp_stream {
+	struct rp_set *rs;
+	struct rp_container *rc;
+	int *metric_arry;
+	size_t metric_count;
+};
+
+static enum ldmsd_loglevel log_level = LDMSD_LERROR;
+static struct ldmsd_store *store;
+static struct rbt set_tree;
+static struct rbt container_tree;
+static struct rp_stream *streams;
+static uint32_t stream_count;
+
+static uint64_t rows, bytes, flushes;
+static uint64_t *lat;		/* store() latency of each row in nsec */
+static uint64_t lat_len;
+
+const char *ldmsd_loglevel_names[] = {
+	LOGLEVELS(LDMSD_STR_WRAP)
+	NULL
+};
+
+/* Used by the plugins that follow the ldmsd log level */
+enum ldmsd_loglevel ldmsd_loglevel_get()
+{
+	return log_level;
+}
+
+const char *ldmsd_myname_get()
+{
+	static char myname[512];
+	if (!myname[0])
+		gethostname(myname, sizeof(myname) - 1);
+	return myname;
+}
+
+static void rp_vlog(enum ldmsd_loglevel level, const char *fmt, va_list ap)
+{
+	if (level < log_level || level < 0)
+		return;
+	if (level < LDMSD_LLASTLEVEL)
+		fprintf(stderr, "%-10s: ", ldmsd_loglevel_names[level]);
+	vfprintf(stderr, fmt, ap);
+}
+
+static void rp_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	rp_vlog(level, fmt, ap);
+	va_end(ap);
+}
+
+/* Used by libplugattr */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	rp_vlog(level, fmt, ap);
+	va_end(ap);
+}
+
+void usage(char *argv[])
+{
+	printf("%s -f <recording> -s <store> [-o <attr>=<value> ...] ...\n"
+	       "\n    -f <recording>   The file written by store_recorder.\n"
+	       "\n    -s <store>       The store plugin to drive, e.g. store_csv. It is\n"
+	       "                     searched for in LDMSD_PLUGIN_LIBPATH.\n"
+	       "\n    -o <options>     The plugin configuration, as in 'config name=<store>\n"
+	       "                     <options>'. Repeat for several config lines.\n"
+	       "\n    -x <factor>      Replay at <factor> times the recorded pace; the\n"
+	       "                     default 0 replays as fast as possible.\n"
+	       "\n    -F <rows>        Flush a container every <rows> rows. By default\n"
+	       "                     it is only flushed before it is closed.\n"
+	       "\n    -v <level>       The log level: DEBUG, INFO, WARNING, ERROR or\n"
+	       "                     CRITICAL. The default is ERROR.\n",
+	       argv[0]);
+	exit(1);
+}
+
+static uint64_t ns_now(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int __str_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static struct ldmsd_store *load_store(const char *name)
+{
+	char library_name[LDMSD_PLUGIN_LIBPATH_MAX];
+	char library_path[LDMSD_PLUGIN_LIBPATH_MAX];
+	char *pathdir = library_path;
+	char *libpath, *saveptr = NULL;
+	char *path = getenv("LDMSD_PLUGIN_LIBPATH");
+	struct ldmsd_plugin *pi;
+	ldmsd_plugin_get_f pget;
+	void *d = NULL;
+
+	if (!path)
+		path = LDMSD_PLUGIN_LIBPATH_DEFAULT;
+	snprintf(library_path, sizeof(library_path), "%s", path);
+	while (!d && (libpath = strtok_r(pathdir, ":", &saveptr))) {
+		pathdir = NULL;
+		snprintf(library_name, sizeof(library_name), "%s/lib%s.so",
+			 libpath, name);
+		d = dlopen(library_name, RTLD_NOW);
+		if (!d && 0 == access(library_name, F_OK))
+			break;
+	}
+	if (!d) {
+		rp_log(LDMSD_LCRITICAL, "Failed to load the plugin '%s': "
+		       "dlerror %s\n", name, dlerror());
+		return NULL;
+	}
+	pget = dlsym(d, "get_plugin");
+	if (!pget) {
+		rp_log(LDMSD_LCRITICAL, "The library, '%s', is missing the "
+		       "get_plugin() function.\n", name);
+		return NULL;
+	}
+	pi = pget(rp_log);
+	if (!pi || pi->type != LDMSD_PLUGIN_STORE) {
+		rp_log(LDMSD_LCRITICAL, "'%s' is not a store plugin.\n", name);
+		return NULL;
+	}
+	return (struct ldmsd_store *)pi;
+}
+
+static int config_store(const char *name, const char *options)
+{
+	struct attr_value_list *avl, *kwl;
+	char *cmd;
+	int tokens, rc;
+	const char *s;
+
+	cmd = strdup(options);
+	if (!cmd)
+		return ENOMEM;
+	for (tokens = 1, s = cmd; *s; s++)
+		if (*s == ' ' || *s == '\t')
+			tokens++;
+	avl = av_new(tokens);
+	kwl = av_new(tokens);
+	rc = ENOMEM;
+	if (!avl || !kwl)
+		goto out;
+	rc = tokenize(cmd, kwl, avl);
+	if (!rc)
+		rc = store->base.config(&store->base, kwl, avl);
+	if (rc)
+		rp_log(LDMSD_LCRITICAL, "Error %d configuring '%s' with "
+		       "'%s'.\n", rc, name, options);
+ out:
+	if (avl)
+		av_free(avl);
+	if (kwl)
+		av_free(kwl);
+	free(cmd);
+	return rc;
+}
+
+static void rp_set_release(struct rp_set *rs)
+{
+	if (rs->set)
+		ldms_set_delete(rs->set);	/* unmaps the set memory */
+	rs->set = NULL;
+	free(rs->meta);
+	rs->meta = NULL;
+}
+
+/*
+ * Rebuild the set from its meta data block. The recorded set may have
+ * had several data buffers; the local copy has one, which each DATA
+ * record overwrites.
+ */
+static int rp_set_build(struct rp_set *rs, const void *meta,
+			uint32_t meta_len, uint32_t data_len)
+{
+	struct ldms_set_hdr *sh;
+	size_t len = meta_len + data_len;
+	void *mem;
+	int rc;
+
+	rs->meta = malloc(meta_len);
+	if (!rs->meta)
+		return ENOMEM;
+	memcpy(rs->meta, meta, meta_len);
+	mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		rc = errno;
+		free(rs->meta);
+		rs->meta = NULL;
+		return rc;
+	}
+	memcpy(mem, meta, meta_len);
+	sh = mem;
+	sh->array_card = __cpu_to_le32(1);
+	rs->data = (char *)mem + meta_len;
+	rc = ldms_mmap_set(mem, rs->data, &rs->set);
+	if (rc) {
+		rc = errno;
+		munmap(mem, len);
+		free(rs->meta);
+		rs->meta = NULL;
+		rs->set = NULL;
+		return rc;
+	}
+	rs->meta_len = meta_len;
+	rs->data_len = data_len;
+	return 0;
+}
+
+static struct rp_set *rp_set_get(const void *meta, uint32_t meta_len,
+				 uint32_t data_len)
+{
+	struct rp_set *rs;
+	struct rbn *rbn;
+	const char *name;
+	int rc;
+
+	name = get_instance_name((struct ldms_set_hdr *)meta)->name;
+	if (name + strnlen(name, meta_len) >= (const char *)meta + meta_len)
+		return NULL;
+	rbn = rbt_find(&set_tree, name);
+	if (rbn) {
+		rs = container_of(rbn, struct rp_set, rbn);
+		if (rs->meta_len == meta_len && rs->data_len == data_len &&
+		    0 == memcmp(rs->meta, meta, meta_len))
+			return rs;
+		/* The set was redefined, rebuild it in place */
+		rp_set_release(rs);
+	} else {
+		rs = calloc(1, sizeof(*rs));
+		if (!rs)
+			return NULL;
+		rs->name = strdup(name);
+		if (!rs->name) {
+			free(rs);
+			return NULL;
+		}
+		rbn_init(&rs->rbn, rs->name);
+		rbt_ins(&set_tree, &rs->rbn);
+	}
+	rc = rp_set_build(rs, meta, meta_len, data_len);
+	if (rc) {
+		rp_log(LDMSD_LERROR, "Error %d rebuilding the set '%s'.\n",
+		       rc, name);
+		return NULL;
+	}
+	return rs;
+}
+
+static struct rp_container *rp_container_get(const char *container,
+					     ldms_set_t set, int *metric_arry,
+					     size_t metric_count)
+{
+	const char *schema = ldms_set_schema_name_get(set);
+	struct rp_container *rc;
+	ldmsd_strgp_metric_t m;
+	struct rbn *rbn;
+	char *key;
+	int i;
+
+	if (-1 == asprintf(&key, "%s/%s", container, schema))
+		return NULL;
+	rbn = rbt_find(&container_tree, key);
+	if (rbn) {
+		free(key);
+		return container_of(rbn, struct rp_container, rbn);
+	}
+	rc = calloc(1, sizeof(*rc));
+	if (!rc)
+		goto err;
+	rc->key = key;
+	TAILQ_INIT(&rc->metric_list);
+	rc->container = strdup(container);
+	rc->schema = strdup(schema);
+	if (!rc->container || !rc->schema)
+		goto err;
+	for (i = 0; i < metric_count; i++) {
+		m = calloc(1, sizeof(*m));
+		if (!m)
+			goto err;
+		TAILQ_INSERT_TAIL(&rc->metric_list, m, entry);
+		m->name = strdup(ldms_metric_name_get(set, metric_arry[i]));
+		if (!m->name)
+			goto err;
+		m->type = ldms_metric_type_get(set, metric_arry[i]);
+	}
+	rc->sh = store->open(store, rc->container, rc->schema,
+			     &rc->metric_list, NULL);
+	if (!rc->sh) {
+		rp_log(LDMSD_LERROR, "The store could not open the container "
+		       "'%s' for the schema '%s'.\n", container, schema);
+		goto err;
+	}
+	rbn_init(&rc->rbn, rc->key);
+	rbt_ins(&container_tree, &rc->rbn);
+	return rc;
+ err:
+	if (rc) {
+		while ((m = TAILQ_FIRST(&rc->metric_list))) {
+			TAILQ_REMOVE(&rc->metric_list, m, entry);
+			free(m->name);
+			free(m);
+		}
+		free(rc->container);
+		free(rc->schema);
+		free(rc);
+	}
+	free(key);
+	return NULL;
+}
+
+static void rp_streams_reset()
+{
+	uint32_t i;
+	for (i = 0; i < stream_count; i++) {
+		free(streams[i].metric_arry);
+		memset(&streams[i], 0, sizeof(streams[i]));
+	}
+}
+
+static int rp_meta(struct recorder_rec *rec, const char *payload)
+{
+	const struct recorder_meta *rm = (const void *)payload;
+	const char *container;
+	const uint32_t *ids;
+	const void *meta;
+	const struct ldms_set_hdr *sh;
+	struct rp_stream *st;
+	struct rp_set *rs;
+	struct rp_container *rc;
+	int *metric_arry;
+	uint32_t i;
+
+	if (rec->len < sizeof(*rm) || rec->len != sizeof(*rm) +
+	    (uint64_t)rm->container_len + rm->metric_count * sizeof(*ids) +
+	    rm->meta_len || rm->meta_len < sizeof(*sh) || !rm->container_len)
+		return EINVAL;
+	container = payload + sizeof(*rm);
+	ids = (const void *)(container + rm->container_len);
+	meta = ids + rm->metric_count;
+	sh = meta;
+	if (container[rm->container_len - 1] ||
+	    __le32_to_cpu(sh->meta_sz) != rm->meta_len ||
+	    __le32_to_cpu(sh->data_sz) != rm->data_len)
+		return EINVAL;
+
+	if (rec->ref >= stream_count) {
+		st = realloc(streams, (rec->ref + 1) * sizeof(*st));
+		if (!st)
+			return ENOMEM;
+		memset(&st[stream_count], 0,
+		       (rec->ref + 1 - stream_count) * sizeof(*st));
+		streams = st;
+		stream_count = rec->ref + 1;
+	}
+	metric_arry = calloc(rm->metric_count ? rm->metric_count : 1,
+			     sizeof(*metric_arry));
+	if (!metric_arry)
+		return ENOMEM;
+	for (i = 0; i < rm->metric_count; i++) {
+		if (ids[i] >= __le32_to_cpu(sh->card)) {
+			free(metric_arry);
+			return EINVAL;
+		}
+		metric_arry[i] = ids[i];
+	}
+	rs = rp_set_get(meta, rm->meta_len, rm->data_len);
+	if (!rs) {
+		free(metric_arry);
+		return EINVAL;
+	}
+	rc = rp_container_get(container, rs->set, metric_arry,
+			      rm->metric_count);
+	if (!rc) {
+		free(metric_arry);
+		return EINVAL;
+	}
+	st = &streams[rec->ref];
+	free(st->metric_arry);
+	st->rs = rs;
+	st->rc = rc;
+	st->metric_arry = metric_arry;
+	st->metric_count = rm->metric_count;
+	return 0;
+}
+
+static int rp_data(struct recorder_rec *rec, const char *payload,
+		   uint64_t flush_rows)
+{
+	struct rp_stream *st;
+	uint64_t t0, t1;
+
+	if (rec->ref >= stream_count || !streams[rec->ref].rs ||
+	    !streams[rec->ref].rs->set)
+		return ENOENT;
+	st = &streams[rec->ref];
+	if (rec->len != st->rs->data_len)
+		return EINVAL;
+	memcpy(st->rs->data, payload, rec->len);
+
+	t0 = ns_now(CLOCK_MONOTONIC);
+	store->store(st->rc->sh, st->rs->set, st->metric_arry,
+		     st->metric_count);
+	t1 = ns_now(CLOCK_MONOTONIC);
+
+	if (rows == lat_len) {
+		uint64_t *l = realloc(lat, (lat_len ? lat_len * 2 : 4096) *
+				      sizeof(*lat));
+		if (!l)
+			return ENOMEM;
+		lat = l;
+		lat_len = lat_len ? lat_len * 2 : 4096;
+	}
+	lat[rows++] = t1 - t0;
+	bytes += rec->len;
+	st->rc->rows++;
+	if (flush_rows && 0 == st->rc->rows % flush_rows) {
+		store->flush(st->rc->sh);
+		flushes++;
+	}
+	return 0;
+}
+
+/* Sleep until the row recorded at ts is due */
+static void rp_pace(uint64_t ts, double factor)
+{
+	static uint64_t rec0, wall0;
+	struct timespec due;
+	uint64_t t;
+
+	if (!rec0) {
+		rec0 = ts;
+		wall0 = ns_now(CLOCK_MONOTONIC);
+		return;
+	}
+	if (ts < rec0)
+		return;
+	t = wall0 + (uint64_t)((ts - rec0) * 1000 / factor);
+	due.tv_sec = t / 1000000000;
+	due.tv_nsec = t % 1000000000;
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&due, NULL))
+		;
+}
+
+static int replay(FILE *f, const char *path, double factor,
+		  uint64_t flush_rows)
+{
+	struct recorder_rec rec;
+	struct recorder_start *start;
+	char *payload = NULL;
+	size_t payload_sz = 0;
+	uint64_t nrec = 0;
+	int rc = 0;
+
+	while (1 == fread(&rec, sizeof(rec), 1, f)) {
+		if (rec.len > payload_sz) {
+			char *p = realloc(payload, rec.len);
+			if (!p) {
+				rc = ENOMEM;
+				break;
+			}
+			payload = p;
+			payload_sz = rec.len;
+		}
+		if (rec.len && 1 != fread(payload, rec.len, 1, f)) {
+			rp_log(LDMSD_LWARNING, "'%s' is truncated after %"
+			       PRIu64 " records.\n", path, nrec);
+			break;
+		}
+		if (!nrec && rec.type != RECORDER_REC_START) {
+			rp_log(LDMSD_LCRITICAL, "'%s' is not a recording.\n",
+			       path);
+			rc = EINVAL;
+			break;
+		}
+		nrec++;
+		switch (rec.type) {
+		case RECORDER_REC_START:
+			start = (void *)payload;
+			if (rec.len < sizeof(*start) ||
+			    memcmp(start->magic, RECORDER_MAGIC,
+				   sizeof(start->magic)) ||
+			    start->version != RECORDER_VERSION) {
+				rp_log(LDMSD_LCRITICAL, "'%s': unsupported "
+				       "recording.\n", path);
+				rc = EINVAL;
+				goto out;
+			}
+			rp_streams_reset();
+			break;
+		case RECORDER_REC_META:
+			rc = rp_meta(&rec, payload);
+			if (rc)
+				rp_log(LDMSD_LERROR, "'%s': error %d in the "
+				       "meta record of stream %u.\n", path,
+				       rc, rec.ref);
+			break;
+		case RECORDER_REC_DATA:
+			if (factor > 0)
+				rp_pace(rec.ts, factor);
+			rc = rp_data(&rec, payload, flush_rows);
+			if (rc)
+				rp_log(LDMSD_LDEBUG, "'%s': error %d skipping "
+				       "a row of stream %u.\n", path, rc,
+				       rec.ref);
+			break;
+		default:
+			rp_log(LDMSD_LDEBUG, "'%s': skipping a record of type "
+			       "%u.\n", path, rec.type);
+			break;
+		}
+		if (rc == ENOMEM)
+			break;
+		rc = 0;
+	}
+	if (!rc && !nrec) {
+		rp_log(LDMSD_LCRITICAL, "'%s' is not a recording.\n", path);
+		rc = EINVAL;
+	}
+ out:
+	free(payload);
+	return rc;
+}
+
+static void rp_close()
+{
+	struct rp_container *rc;
+	struct rp_set *rs;
+	ldmsd_strgp_metric_t m;
+	struct rbn *rbn;
+
+	while ((rbn = rbt_min(&container_tree))) {
+		rbt_del(&container_tree, rbn);
+		rc = container_of(rbn, struct rp_container, rbn);
+		store->flush(rc->sh);
+		store->close(rc->sh);
+		while ((m = TAILQ_FIRST(&rc->metric_list))) {
+			TAILQ_REMOVE(&rc->metric_list, m, entry);
+			free(m->name);
+			free(m);
+		}
+		free(rc->container);
+		free(rc->schema);
+		free(rc->key);
+		free(rc);
+	}
+	while ((rbn = rbt_min(&set_tree))) {
+		rbt_del(&set_tree, rbn);
+		rs = container_of(rbn, struct rp_set, rbn);
+		rp_set_release(rs);
+		free(rs->name);
+		free(rs);
+	}
+	rp_streams_reset();
+	free(streams);
+}
+
+static int __u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static double pct(double p)
+{
+	uint64_t i = (uint64_t)(p * rows / 100);
+	if (i >= rows)
+		i = rows - 1;
+	return lat[i] / 1000.0;
+}
+
+static void report(uint64_t elapsed_ns, uint64_t close_ns)
+{
+	double sec = elapsed_ns / 1e9;
+
+	printf("rows %" PRIu64 " bytes %" PRIu64 " flushes %" PRIu64
+	       " elapsed %.3f s close %.3f s\n", rows, bytes, flushes, sec,
+	       close_ns / 1e9);
+	if (!rows)
+		return;
+	if (sec > 0)
+		printf("rows/s %.1f bytes/s %.1f\n", rows / sec, bytes / sec);
+	qsort(lat, rows, sizeof(*lat), __u64_cmp);
+	printf("store latency usec p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f "
+	       "max %.3f\n", pct(50), pct(90), pct(99), pct(99.9),
+	       lat[rows - 1] / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	char *path = NULL, *name = NULL;
+	char **options = NULL;
+	int op, i, option_count = 0;
+	double factor = 0;
+	uint64_t flush_rows = 0;
+	uint64_t t0, t1, t2;
+	FILE *f;
+	int rc;
+
+	while ((op = getopt(argc, argv, FMT)) != -1) {
+		switch (op) {
+		case 'f':
+			path = optarg;
+			break;
+		case 's':
+			name = optarg;
+			break;
+		case 'o':
+			options = realloc(options, (option_count + 1) *
+					  sizeof(*options));
+			if (!options) {
+				printf("Out of memory\n");
+				exit(1);
+			}
+			options[option_count++] = optarg;
+			break;
+		case 'x':
+			factor = strtod(optarg, NULL);
+			break;
+		case 'F':
+			flush_rows = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			for (i = 0; i < LDMSD_LLASTLEVEL; i++)
+				if (0 == strcasecmp(optarg,
+						    ldmsd_loglevel_names[i]))
+					break;
+			log_level = i;
+			if (log_level == LDMSD_LLASTLEVEL) {
+				printf("Invalid log level '%s'\n", optarg);
+				usage(argv);
+			}
+			break;
+		default:
+			usage(argv);
+		}
+	}
+	if (!path || !name)
+		usage(argv);
+
+	f = fopen(path, "r");
+	if (!f) {
+		printf("Error %d opening '%s'\n", errno, path);
+		exit(1);
+	}
+	store = load_store(name);
+	if (!store)
+		exit(1);
+	for (i = 0; i < option_count; i++) {
+		if (config_store(name, options[i]))
+			exit(1);
+	}
+	rbt_init(&set_tree, __str_cmp);
+	rbt_init(&container_tree, __str_cmp);
+
+	t0 = ns_now(CLOCK_MONOTONIC);
+	rc = replay(f, path, factor, flush_rows);
+	t1 = ns_now(CLOCK_MONOTONIC);
+	rp_close();
+	t2 = ns_now(CLOCK_MONOTONIC);
+	fclose(f);
+	report(t1 - t0, t2 - t1);
+	if (store->base.term)
+		store->base.term(&store->base);
+	free(options);
+	free(lat);
+	return rc ? 1 : 0;
+}
@@ -0,0 +1,430 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file store_recorder.c
+ * \brief Store plugin recording the raw blocks of the stored sets.
+ *
+ * Every row is appended to a binary recording (see store_recorder.h) as
+ * a copy of the set data block; the meta data block is recorded once per
+ * container and set, and again when it changes. ldmsd_replay rebuilds
+ * the sets from the recording and feeds them to another store plugin.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "store_recorder.h"
+
+#define STORE "store_recorder"
+#define RECORDER_BUFFER_DEFAULT (1024 * 1024)
+
+struct rec_handle {
+	struct ldmsd_store *store;
+	char *container;
+	char *schema;
+	struct rbt stream_tree;
+	void *ucontext;
+};
+
+struct rec_stream {
+	struct rbn rbn;
+	char *name;		/* set instance name */
+	uint32_t ref;
+	uint32_t session;	/* the session the META record was written in */
+	uint64_t meta_gn;
+	uint32_t meta_len;
+	uint32_t data_len;
+};
+
+static ldmsd_msg_log_f msglog;
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *rec_path;
+static FILE *rec_file;
+static char *rec_buf;
+static uint32_t rec_session;
+static uint32_t rec_next_ref;
+static int rec_handles;
+static uint64_t rec_records;
+static uint64_t rec_bytes;
+static int rec_error;
+
+static int __stream_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static uint64_t rec_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Caller must hold rec_lock */
+static int rec_put(const void *p, size_t len)
+{
+	if (len && 1 != fwrite(p, len, 1, rec_file)) {
+		if (!rec_error)
+			msglog(LDMSD_LERROR, STORE ": error %d writing '%s'.\n",
+			       errno, rec_path);
+		rec_error = errno ? errno : EIO;
+		return rec_error;
+	}
+	rec_bytes += len;
+	return 0;
+}
+
+/* Caller must hold rec_lock */
+static int rec_header(enum recorder_rec_type type, uint32_t ref,
+		      uint64_t ts, size_t len)
+{
+	struct recorder_rec rec = {
+		.type = type,
+		.len = len,
+		.ts = ts,
+		.ref = ref,
+	};
+	rec_records++;
+	return rec_put(&rec, sizeof(rec));
+}
+
+/* Caller must hold rec_lock */
+static void rec_close()
+{
+	if (!rec_file)
+		return;
+	if (fclose(rec_file))
+		msglog(LDMSD_LERROR, STORE ": error %d closing '%s'.\n",
+		       errno, rec_path);
+	rec_file = NULL;
+	free(rec_buf);
+	rec_buf = NULL;
+	msglog(LDMSD_LINFO, STORE ": '%s': %" PRIu64 " records, %" PRIu64
+	       " bytes.\n", rec_path, rec_records, rec_bytes);
+}
+
+/* Caller must hold rec_lock */
+static int rec_open(size_t buffer)
+{
+	struct recorder_start start = {
+		.version = RECORDER_VERSION,
+	};
+	int rc;
+
+	rec_file = fopen(rec_path, "a");
+	if (!rec_file) {
+		rc = errno;
+		msglog(LDMSD_LERROR, STORE ": error %d opening '%s'.\n",
+		       rc, rec_path);
+		return rc;
+	}
+	if (buffer) {
+		rec_buf = malloc(buffer);
+		if (rec_buf)
+			setvbuf(rec_file, rec_buf, _IOFBF, buffer);
+	}
+	rec_session++;
+	rec_records = rec_bytes = 0;
+	rec_error = 0;
+	memcpy(start.magic, RECORDER_MAGIC, sizeof(start.magic));
+	rc = rec_header(RECORDER_REC_START, 0, rec_now(), sizeof(start));
+	if (!rc)
+		rc = rec_put(&start, sizeof(start));
+	if (!rc)
+		rc = fflush(rec_file) ? errno : 0;
+	if (rc) {
+		rec_close();
+		return rc;
+	}
+	return 0;
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return
+"    config name=" STORE " path=<file> [buffer=<bytes>]\n"
+"           Append the stored rows to the recording <file> for\n"
+"           ldmsd_replay. buffer is the size of the write buffer\n"
+"           (default 1MB); the buffer is written on flush.\n";
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	size_t buffer = RECORDER_BUFFER_DEFAULT;
+	char *value, *path;
+	int rc;
+
+	value = av_value(avl, "path");
+	if (!value) {
+		msglog(LDMSD_LERROR, STORE ": the path attribute is required.\n");
+		return EINVAL;
+	}
+	path = strdup(value);
+	if (!path)
+		return ENOMEM;
+	value = av_value(avl, "buffer");
+	if (value)
+		buffer = strtoul(value, NULL, 0);
+
+	pthread_mutex_lock(&rec_lock);
+	if (rec_handles) {
+		msglog(LDMSD_LERROR, STORE ": the recording cannot be changed "
+		       "while a storage policy uses it.\n");
+		free(path);
+		rc = EBUSY;
+		goto out;
+	}
+	rec_close();
+	free(rec_path);
+	rec_path = path;
+	rc = rec_open(buffer);
+ out:
+	pthread_mutex_unlock(&rec_lock);
+	return rc;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	pthread_mutex_lock(&rec_lock);
+	rec_close();
+	free(rec_path);
+	rec_path = NULL;
+	pthread_mutex_unlock(&rec_lock);
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	struct rec_handle *rh;
+
+	rh = calloc(1, sizeof(*rh));
+	if (!rh)
+		return NULL;
+	rh->container = strdup(container);
+	rh->schema = strdup(schema);
+	if (!rh->container || !rh->schema) {
+		free(rh->container);
+		free(rh->schema);
+		free(rh);
+		return NULL;
+	}
+	rh->store = s;
+	rh->ucontext = ucontext;
+	rbt_init(&rh->stream_tree, __stream_cmp);
+	pthread_mutex_lock(&rec_lock);
+	rec_handles++;
+	pthread_mutex_unlock(&rec_lock);
+	return rh;
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	struct rec_handle *rh = _sh;
+	return rh->ucontext;
+}
+
+static struct rec_stream *rec_stream_get(struct rec_handle *rh, const char *name)
+{
+	struct rec_stream *rs;
+	struct rbn *rbn;
+
+	rbn = rbt_find(&rh->stream_tree, name);
+	if (rbn)
+		return container_of(rbn, struct rec_stream, rbn);
+	rs = calloc(1, sizeof(*rs));
+	if (!rs)
+		return NULL;
+	rs->name = strdup(name);
+	if (!rs->name) {
+		free(rs);
+		return NULL;
+	}
+	rs->ref = rec_next_ref++;
+	rbn_init(&rs->rbn, rs->name);
+	rbt_ins(&rh->stream_tree, &rs->rbn);
+	return rs;
+}
+
+/* Caller must hold rec_lock */
+static int rec_meta(struct rec_handle *rh, struct rec_stream *rs,
+		    ldms_set_t set, int *metric_arry, size_t metric_count,
+		    uint64_t ts)
+{
+	struct recorder_meta rm;
+	const void *meta;
+	size_t meta_len, data_len;
+	uint32_t idx;
+	int i, rc;
+
+	meta = ldms_set_meta_block_get(set, &meta_len);
+	(void)ldms_set_data_block_get(set, &data_len);
+	rm.container_len = strlen(rh->container) + 1;
+	rm.metric_count = metric_count;
+	rm.meta_len = meta_len;
+	rm.data_len = data_len;
+	rc = rec_header(RECORDER_REC_META, rs->ref, ts, sizeof(rm) +
+			rm.container_len + metric_count * sizeof(idx) + meta_len);
+	if (!rc)
+		rc = rec_put(&rm, sizeof(rm));
+	if (!rc)
+		rc = rec_put(rh->container, rm.container_len);
+	for (i = 0; !rc && i < metric_count; i++) {
+		idx = metric_arry[i];
+		rc = rec_put(&idx, sizeof(idx));
+	}
+	if (!rc)
+		rc = rec_put(meta, meta_len);
+	if (rc)
+		return rc;
+	rs->session = rec_session;
+	rs->meta_gn = ldms_set_meta_gn_get(set);
+	rs->meta_len = meta_len;
+	rs->data_len = data_len;
+	return 0;
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set,
+      int *metric_arry, size_t metric_count)
+{
+	struct rec_handle *rh = _sh;
+	struct rec_stream *rs;
+	const void *data;
+	size_t data_len;
+	uint64_t ts = rec_now();
+	int rc;
+
+	pthread_mutex_lock(&rec_lock);
+	if (!rec_file) {
+		rc = EBADF;
+		goto out;
+	}
+	rs = rec_stream_get(rh, ldms_set_instance_name_get(set));
+	if (!rs) {
+		rc = ENOMEM;
+		goto out;
+	}
+	data = ldms_set_data_block_get(set, &data_len);
+	if (rs->session != rec_session ||
+	    rs->meta_gn != ldms_set_meta_gn_get(set) ||
+	    rs->data_len != data_len) {
+		rc = rec_meta(rh, rs, set, metric_arry, metric_count, ts);
+		if (rc)
+			goto out;
+	}
+	rc = rec_header(RECORDER_REC_DATA, rs->ref, ts, data_len);
+	if (!rc)
+		rc = rec_put(data, data_len);
+ out:
+	pthread_mutex_unlock(&rec_lock);
+	return rc;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&rec_lock);
+	if (rec_file && fflush(rec_file))
+		rc = errno;
+	pthread_mutex_unlock(&rec_lock);
+	return rc;
+}
+
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct rec_handle *rh = _sh;
+	struct rec_stream *rs;
+	struct rbn *rbn;
+
+	pthread_mutex_lock(&rec_lock);
+	while ((rbn = rbt_min(&rh->stream_tree))) {
+		rbt_del(&rh->stream_tree, rbn);
+		rs = container_of(rbn, struct rec_stream, rbn);
+		free(rs->name);
+		free(rs);
+	}
+	rec_handles--;
+	if (rec_file)
+		fflush(rec_file);
+	pthread_mutex_unlock(&rec_lock);
+	free(rh->container);
+	free(rh->schema);
+	free(rh);
+}
+
+static struct ldmsd_store store_recorder = {
+	.base = {
+		.name = STORE,
+		.term = term,
+		.config = config,
+		.usage = usage,
+		.type = LDMSD_PLUGIN_STORE,
+	},
+	.open = open_store,
+	.get_context = get_ucontext,
+	.store = store,
+	.flush = flush_store,
+	.close = close_store,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &store_recorder.base;
+}
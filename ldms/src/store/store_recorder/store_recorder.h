@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file store_recorder.h
+ * \brief Record format shared by store_recorder and ldmsd_replay.
+ *
+ * A recording is a sequence of records, each a struct recorder_rec
+ * followed by \c len bytes of payload. The integers of the record
+ * headers are in the byte order of the host that wrote them; the
+ * blocks copied from the sets are in the set byte order.
+ *
+ * Every time store_recorder opens the file it writes a START record, so
+ * a file may hold several sessions. Stream references (\c ref) are only
+ * meaningful within the session that defined them.
+ *
+ * - RECORDER_REC_START: struct recorder_start.
+ * - RECORDER_REC_META: struct recorder_meta, the container name
+ *   (\c container_len bytes, NUL included), \c metric_count uint32_t
+ *   metric indices as passed to store(), then the meta data block
+ *   (\c meta_len bytes). It is written the first time a set is stored in
+ *   a container and again when the set meta data changes.
+ * - RECORDER_REC_DATA: the data block (\c data_len bytes of the last
+ *   META record of the stream).
+ */
+#ifndef __STORE_RECORDER_H__
+#define __STORE_RECORDER_H__
+
+#include <stdint.h>
+
+#define RECORDER_MAGIC		"LDMSREC1"
+#define RECORDER_VERSION	1
+
+enum recorder_rec_type {
+	RECORDER_REC_START = 1,
+	RECORDER_REC_META,
+	RECORDER_REC_DATA,
+};
+
+struct recorder_rec {
+	uint32_t type;		/* enum recorder_rec_type */
+	uint32_t len;		/* payload bytes following the header */
+	uint64_t ts;		/* capture time, usec since the Epoch */
+	uint32_t ref;		/* stream: one container and one set */
+	uint32_t pad;
+};
+
+struct recorder_start {
+	char magic[8];		/* RECORDER_MAGIC, not terminated */
+	uint32_t version;	/* RECORDER_VERSION */
+	uint32_t pad;
+};
+
+struct recorder_meta {
+	uint32_t container_len;
+	uint32_t metric_count;
+	uint32_t meta_len;
+	uint32_t data_len;
+};
+
+#endif
@@ -0,0 +1,1009 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * store_rollup derives sets on the aggregator from the sets stored by a
+ * storage policy: the sum, average, minimum, maximum, percentiles and
+ * member count of each metric across the stored sets, optionally split
+ * in groups by the value of a metric or a set info key. The derived sets
+ * are published like any other set, so that an upper level aggregator
+ * can update one set instead of every member.
+ *
+ * The rollup is maintained incrementally. Each member keeps the values
+ * it last contributed and a store only applies the difference: the sums
+ * are adjusted and, for the order statistics, the old value is moved to
+ * the position of the new one in a sorted array of the member values.
+ * Only the outputs of the metrics that changed are written.
+ */
+#include <sys/queue.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <coll/rbt.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+#define STRR "store_rollup"
+
+#define ROLLUP_OPS_DEFAULT "sum,avg,min,max"
+
+enum rollup_op_type {
+	ROLLUP_SUM,
+	ROLLUP_AVG,
+	ROLLUP_MIN,
+	ROLLUP_MAX,
+	ROLLUP_PCT,
+};
+
+struct rollup_op {
+	enum rollup_op_type type;
+	double pct;		/* ROLLUP_PCT */
+	char name[16];		/* metric name suffix */
+};
+
+/* The configuration of a container */
+struct rollup_cfg {
+	char *container;
+	char *instance;		/* derived set name or prefix */
+	char *schema;		/* derived schema name */
+	char *producer;
+	char *group_by;		/* metric name */
+	char *group_info;	/* set info key */
+	int stale;		/* seconds, 0 keeps the members */
+	int count;		/* add the member count */
+	int op_count;
+	struct rollup_op *op;
+	int ordered;		/* some op needs the sorted values */
+	LIST_ENTRY(rollup_cfg) entry;
+};
+
+/* A metric of the stored sets that is rolled up */
+struct rollup_metric {
+	int mid;
+	enum ldms_value_type type;
+	int *out_mid;		/* derived metric per op */
+};
+
+/* A derived set */
+struct rollup_group {
+	struct rbn rbn;
+	char *name;
+	ldms_set_t set;
+	int card;
+	int alloc;
+	long double *sum;	/* per metric */
+	double **sorted;	/* per metric, when ordered */
+};
+
+/* A stored set */
+struct rollup_member {
+	struct rbn rbn;
+	char *name;
+	struct rollup_group *grp;
+	uint64_t info_gn;	/* of the group_info lookup */
+	time_t last;
+	TAILQ_ENTRY(rollup_member) lru;
+	double val[];		/* contributed values */
+};
+
+struct rollup_store {
+	struct ldmsd_store *store;
+	void *ucontext;
+	struct rollup_cfg *cfg;
+	char *schema;
+	int ref_count;
+	pthread_mutex_t lock;
+	int compiled;		/* -1 if the schema cannot be rolled up */
+	int metric_count;
+	struct rollup_metric *metric;
+	int count_mid;
+	int group_mid;		/* -1 if not grouped by a metric */
+	enum ldms_value_type group_type;
+	ldms_schema_t dschema;
+	struct rbt member_tree;
+	struct rbt group_tree;
+	TAILQ_HEAD(, rollup_member) lru;	/* least recently stored first */
+	double *vbuf;
+	LIST_ENTRY(rollup_store) entry;
+};
+
+static ldmsd_msg_log_f msglog;
+static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(, rollup_cfg) cfg_list;
+static LIST_HEAD(, rollup_store) store_list;
+
+static int name_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static void cfg_free(struct rollup_cfg *cfg)
+{
+	free(cfg->container);
+	free(cfg->instance);
+	free(cfg->schema);
+	free(cfg->producer);
+	free(cfg->group_by);
+	free(cfg->group_info);
+	free(cfg->op);
+	free(cfg);
+}
+
+static struct rollup_cfg *cfg_find(const char *container)
+{
+	struct rollup_cfg *cfg;
+	LIST_FOREACH(cfg, &cfg_list, entry) {
+		if (0 == strcmp(cfg->container, container))
+			return cfg;
+	}
+	return NULL;
+}
+
+static int ops_parse(struct rollup_cfg *cfg, const char *str)
+{
+	char *s, *tok, *ptr, *end;
+	struct rollup_op *op;
+	int n, rc = 0;
+
+	s = strdup(str);
+	if (!s)
+		return ENOMEM;
+	for (n = 1, ptr = s; *ptr; ptr++) {
+		if (*ptr == ',')
+			n++;
+	}
+	cfg->op = calloc(n, sizeof(*cfg->op));
+	if (!cfg->op) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (tok = strtok_r(s, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr)) {
+		if (0 == strcmp(tok, "count")) {
+			cfg->count = 1;
+			continue;
+		}
+		op = &cfg->op[cfg->op_count];
+		if (0 == strcmp(tok, "sum")) {
+			op->type = ROLLUP_SUM;
+		} else if (0 == strcmp(tok, "avg")) {
+			op->type = ROLLUP_AVG;
+		} else if (0 == strcmp(tok, "min")) {
+			op->type = ROLLUP_MIN;
+			cfg->ordered = 1;
+		} else if (0 == strcmp(tok, "max")) {
+			op->type = ROLLUP_MAX;
+			cfg->ordered = 1;
+		} else if (tok[0] == 'p' && tok[1]) {
+			op->type = ROLLUP_PCT;
+			op->pct = strtod(&tok[1], &end);
+			if (*end || op->pct < 0 || op->pct > 100)
+				goto einval;
+			cfg->ordered = 1;
+		} else {
+			goto einval;
+		}
+		if (strlen(tok) >= sizeof(op->name))
+			goto einval;
+		strcpy(op->name, tok);
+		cfg->op_count++;
+	}
+	goto out;
+einval:
+	msglog(LDMSD_LERROR, STRR ": unknown function '%s'.\n", tok);
+	rc = EINVAL;
+out:
+	free(s);
+	return rc;
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	struct rollup_cfg *cfg, *old;
+	char *container, *value, *end;
+	long l;
+	int rc;
+
+	container = av_value(avl, "container");
+	if (!container) {
+		msglog(LDMSD_LERROR, STRR ": container is required.\n");
+		return EINVAL;
+	}
+	cfg = calloc(1, sizeof(*cfg));
+	if (!cfg)
+		return ENOMEM;
+	cfg->container = strdup(container);
+	value = av_value(avl, "instance");
+	cfg->instance = strdup(value ? value : container);
+	if (!cfg->container || !cfg->instance)
+		goto enomem;
+	value = av_value(avl, "producer");
+	cfg->producer = strdup(value ? value : container);
+	if (!cfg->producer)
+		goto enomem;
+	value = av_value(avl, "schema");
+	if (value && !(cfg->schema = strdup(value)))
+		goto enomem;
+	value = av_value(avl, "group_by");
+	if (value && !(cfg->group_by = strdup(value)))
+		goto enomem;
+	value = av_value(avl, "group_info");
+	if (value && !(cfg->group_info = strdup(value)))
+		goto enomem;
+	if (cfg->group_by && cfg->group_info) {
+		msglog(LDMSD_LERROR, STRR ": group_by and group_info are "
+		       "mutually exclusive.\n");
+		rc = EINVAL;
+		goto err;
+	}
+	value = av_value(avl, "stale");
+	if (value) {
+		l = strtol(value, &end, 0);
+		if (*end != '\0' || l < 0) {
+			msglog(LDMSD_LERROR, STRR ": invalid stale '%s'.\n",
+			       value);
+			rc = EINVAL;
+			goto err;
+		}
+		cfg->stale = l;
+	}
+	value = av_value(avl, "op");
+	rc = ops_parse(cfg, value ? value : ROLLUP_OPS_DEFAULT);
+	if (rc)
+		goto err;
+	if (!cfg->op_count && !cfg->count) {
+		msglog(LDMSD_LERROR, STRR ": no function given.\n");
+		rc = EINVAL;
+		goto err;
+	}
+
+	pthread_mutex_lock(&cfg_lock);
+	old = cfg_find(container);
+	if (old) {
+		struct rollup_store *rs;
+		LIST_FOREACH(rs, &store_list, entry) {
+			if (rs->cfg == old) {
+				pthread_mutex_unlock(&cfg_lock);
+				msglog(LDMSD_LERROR, STRR ": container '%s' is "
+				       "in use.\n", container);
+				rc = EBUSY;
+				goto err;
+			}
+		}
+		LIST_REMOVE(old, entry);
+		cfg_free(old);
+	}
+	LIST_INSERT_HEAD(&cfg_list, cfg, entry);
+	pthread_mutex_unlock(&cfg_lock);
+	return 0;
+enomem:
+	rc = ENOMEM;
+err:
+	cfg_free(cfg);
+	return rc;
+}
+
+static double value_get(ldms_set_t set, int mid, enum ldms_value_type type)
+{
+	double v;
+	switch (type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_U8:
+		return ldms_metric_get_u8(set, mid);
+	case LDMS_V_S8:
+		return ldms_metric_get_s8(set, mid);
+	case LDMS_V_U16:
+		return ldms_metric_get_u16(set, mid);
+	case LDMS_V_S16:
+		return ldms_metric_get_s16(set, mid);
+	case LDMS_V_U32:
+		return ldms_metric_get_u32(set, mid);
+	case LDMS_V_S32:
+		return ldms_metric_get_s32(set, mid);
+	case LDMS_V_U64:
+		return ldms_metric_get_u64(set, mid);
+	case LDMS_V_S64:
+		return ldms_metric_get_s64(set, mid);
+	case LDMS_V_F32:
+		v = ldms_metric_get_float(set, mid);
+		break;
+	case LDMS_V_D64:
+		v = ldms_metric_get_double(set, mid);
+		break;
+	default:
+		return 0;
+	}
+	/* NaN has no place in the sorted values, count it as 0 */
+	return isnan(v) ? 0 : v;
+}
+
+/* The first index in [lo, hi) with a[i] >= v */
+static int lower_bound(const double *a, int lo, int hi, double v)
+{
+	int mid;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (a[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void sorted_insert(double *a, int n, double v)
+{
+	int i = lower_bound(a, 0, n, v);
+	memmove(&a[i + 1], &a[i], (n - i) * sizeof(*a));
+	a[i] = v;
+}
+
+static void sorted_remove(double *a, int n, double v)
+{
+	int i = lower_bound(a, 0, n, v);
+	memmove(&a[i], &a[i + 1], (n - i - 1) * sizeof(*a));
+}
+
+/* Replace \c old by \c new, moving only the values in between */
+static void sorted_replace(double *a, int n, double old, double new)
+{
+	int i = lower_bound(a, 0, n, old);
+	int j;
+	if (new > old) {
+		j = lower_bound(a, i + 1, n, new);
+		memmove(&a[i], &a[i + 1], (j - i - 1) * sizeof(*a));
+		a[j - 1] = new;
+	} else {
+		j = lower_bound(a, 0, i, new);
+		memmove(&a[j + 1], &a[j], (i - j) * sizeof(*a));
+		a[j] = new;
+	}
+}
+
+/* Nearest rank */
+static double pct_get(const double *a, int n, double pct)
+{
+	int i = (int)ceil(pct / 100 * n) - 1;
+	if (i < 0)
+		i = 0;
+	if (i >= n)
+		i = n - 1;
+	return a[i];
+}
+
+static int rollup_compile(struct rollup_store *rs, ldms_set_t set,
+			  int *metric_arry, size_t metric_count)
+{
+	struct rollup_cfg *cfg = rs->cfg;
+	struct rollup_metric *m;
+	char name[256];
+	const char *mname;
+	enum ldms_value_type type;
+	int i, j, mid, rc;
+
+	rs->group_mid = -1;
+	if (cfg->group_by) {
+		rs->group_mid = ldms_metric_by_name(set, cfg->group_by);
+		if (rs->group_mid < 0) {
+			msglog(LDMSD_LERROR, STRR ": metric '%s' not in "
+			       "schema '%s'.\n", cfg->group_by, rs->schema);
+			return ENOENT;
+		}
+		rs->group_type = ldms_metric_type_get(set, rs->group_mid);
+	}
+	if (cfg->schema) {
+		rs->dschema = ldms_schema_new(cfg->schema);
+	} else {
+		snprintf(name, sizeof(name), "%s_rollup", rs->schema);
+		rs->dschema = ldms_schema_new(name);
+	}
+	if (!rs->dschema)
+		return ENOMEM;
+	rs->metric = calloc(metric_count, sizeof(*rs->metric));
+	rs->vbuf = calloc(metric_count, sizeof(*rs->vbuf));
+	if (!rs->metric || !rs->vbuf)
+		return ENOMEM;
+	rs->count_mid = -1;
+	if (cfg->count) {
+		rs->count_mid = ldms_schema_metric_add(rs->dschema, "count",
+						       LDMS_V_U64);
+		if (rs->count_mid < 0)
+			return -rs->count_mid;
+	}
+	for (i = 0; i < metric_count; i++) {
+		mid = metric_arry[i];
+		type = ldms_metric_type_get(set, mid);
+		/* only the numeric data values */
+		if (!(ldms_metric_flags_get(set, mid) & LDMS_MDESC_F_DATA) ||
+		    type < LDMS_V_CHAR || type > LDMS_V_D64)
+			continue;
+		m = &rs->metric[rs->metric_count];
+		m->mid = mid;
+		m->type = type;
+		m->out_mid = calloc(cfg->op_count, sizeof(*m->out_mid));
+		if (!m->out_mid)
+			return ENOMEM;
+		rs->metric_count++;
+		mname = ldms_metric_name_get(set, mid);
+		for (j = 0; j < cfg->op_count; j++) {
+			snprintf(name, sizeof(name), "%s_%s", mname,
+				 cfg->op[j].name);
+			rc = ldms_schema_metric_add(rs->dschema, name,
+						    LDMS_V_D64);
+			if (rc < 0)
+				return -rc;
+			m->out_mid[j] = rc;
+		}
+	}
+	rs->compiled = 1;
+	return 0;
+}
+
+static void group_free(struct rollup_store *rs, struct rollup_group *grp)
+{
+	int i;
+	if (grp->set) {
+		ldms_set_unpublish(grp->set);
+		ldms_set_delete(grp->set);
+	}
+	if (grp->sorted) {
+		for (i = 0; i < rs->metric_count; i++)
+			free(grp->sorted[i]);
+		free(grp->sorted);
+	}
+	free(grp->sum);
+	free(grp->name);
+	free(grp);
+}
+
+static struct rollup_group *group_get(struct rollup_store *rs,
+				      const char *key)
+{
+	struct rollup_group *grp;
+	struct rbn *rbn;
+	char *name;
+	size_t len;
+
+	rbn = rbt_find(&rs->group_tree, key);
+	if (rbn)
+		return container_of(rbn, struct rollup_group, rbn);
+	grp = calloc(1, sizeof(*grp));
+	if (!grp)
+		return NULL;
+	grp->name = strdup(key);
+	grp->sum = calloc(rs->metric_count, sizeof(*grp->sum));
+	if (!grp->name || !grp->sum)
+		goto err;
+	if (rs->cfg->ordered) {
+		grp->sorted = calloc(rs->metric_count, sizeof(*grp->sorted));
+		if (!grp->sorted)
+			goto err;
+	}
+	if (rs->group_mid < 0 && !rs->cfg->group_info) {
+		grp->set = ldms_set_new(rs->cfg->instance, rs->dschema);
+	} else {
+		len = strlen(rs->cfg->instance) + strlen(key) + 2;
+		name = malloc(len);
+		if (!name)
+			goto err;
+		snprintf(name, len, "%s/%s", rs->cfg->instance, key);
+		grp->set = ldms_set_new(name, rs->dschema);
+		free(name);
+	}
+	if (!grp->set) {
+		msglog(LDMSD_LERROR, STRR ": error %d creating the rollup "
+		       "set of '%s'.\n", errno, key);
+		goto err;
+	}
+	ldms_set_producer_name_set(grp->set, rs->cfg->producer);
+	ldms_set_publish(grp->set);
+	rbn_init(&grp->rbn, grp->name);
+	rbt_ins(&rs->group_tree, &grp->rbn);
+	return grp;
+err:
+	group_free(rs, grp);
+	return NULL;
+}
+
+/* Write the outputs of metric \c i of the group */
+static void group_output(struct rollup_store *rs, struct rollup_group *grp,
+			 int i)
+{
+	struct rollup_metric *m = &rs->metric[i];
+	struct rollup_op *op;
+	double v;
+	int j;
+
+	for (j = 0; j < rs->cfg->op_count; j++) {
+		op = &rs->cfg->op[j];
+		if (!grp->card) {
+			v = 0;
+			goto set;
+		}
+		switch (op->type) {
+		case ROLLUP_SUM:
+			v = grp->sum[i];
+			break;
+		case ROLLUP_AVG:
+			v = grp->sum[i] / grp->card;
+			break;
+		case ROLLUP_MIN:
+			v = grp->sorted[i][0];
+			break;
+		case ROLLUP_MAX:
+			v = grp->sorted[i][grp->card - 1];
+			break;
+		case ROLLUP_PCT:
+			v = pct_get(grp->sorted[i], grp->card, op->pct);
+			break;
+		default:
+			v = 0;
+			break;
+		}
+	set:
+		ldms_metric_set_double(grp->set, m->out_mid[j], v);
+	}
+}
+
+static int member_join(struct rollup_store *rs, struct rollup_member *mbr,
+		       struct rollup_group *grp)
+{
+	double *a;
+	int i, alloc;
+
+	if (grp->sorted && grp->card == grp->alloc) {
+		alloc = grp->alloc ? 2 * grp->alloc : 64;
+		for (i = 0; i < rs->metric_count; i++) {
+			a = realloc(grp->sorted[i], alloc * sizeof(*a));
+			if (!a)
+				return ENOMEM;
+			grp->sorted[i] = a;
+		}
+		grp->alloc = alloc;
+	}
+	ldms_transaction_begin(grp->set);
+	for (i = 0; i < rs->metric_count; i++) {
+		grp->sum[i] += mbr->val[i];
+		if (grp->sorted)
+			sorted_insert(grp->sorted[i], grp->card, mbr->val[i]);
+	}
+	grp->card++;
+	for (i = 0; i < rs->metric_count; i++)
+		group_output(rs, grp, i);
+	if (rs->count_mid >= 0)
+		ldms_metric_set_u64(grp->set, rs->count_mid, grp->card);
+	ldms_transaction_end(grp->set);
+	mbr->grp = grp;
+	return 0;
+}
+
+static void member_leave(struct rollup_store *rs, struct rollup_member *mbr)
+{
+	struct rollup_group *grp = mbr->grp;
+	int i;
+
+	mbr->grp = NULL;
+	grp->card--;
+	if (!grp->card) {
+		rbt_del(&rs->group_tree, &grp->rbn);
+		group_free(rs, grp);
+		return;
+	}
+	ldms_transaction_begin(grp->set);
+	for (i = 0; i < rs->metric_count; i++) {
+		grp->sum[i] -= mbr->val[i];
+		if (grp->sorted)
+			sorted_remove(grp->sorted[i], grp->card + 1,
+				      mbr->val[i]);
+		group_output(rs, grp, i);
+	}
+	if (rs->count_mid >= 0)
+		ldms_metric_set_u64(grp->set, rs->count_mid, grp->card);
+	ldms_transaction_end(grp->set);
+}
+
+static void member_free(struct rollup_store *rs, struct rollup_member *mbr)
+{
+	if (mbr->grp)
+		member_leave(rs, mbr);
+	rbt_del(&rs->member_tree, &mbr->rbn);
+	TAILQ_REMOVE(&rs->lru, mbr, lru);
+	free(mbr->name);
+	free(mbr);
+}
+
+/*
+ * The name of the group of the set in \c buf. Returns 0 if the set has
+ * no group, -1 if the group cannot have changed since the last store.
+ */
+static int group_key(struct rollup_store *rs, struct rollup_member *mbr,
+		     ldms_set_t set, char *buf, size_t sz)
+{
+	uint64_t gn;
+	char *value;
+
+	if (rs->group_mid >= 0) {
+		switch (rs->group_type) {
+		case LDMS_V_F32:
+		case LDMS_V_D64:
+			snprintf(buf, sz, "%g", ldms_metric_get_double(set,
+							rs->group_mid));
+			break;
+		case LDMS_V_S8:
+		case LDMS_V_S16:
+		case LDMS_V_S32:
+		case LDMS_V_S64:
+			snprintf(buf, sz, "%" PRId64,
+				 ldms_metric_get_s64(set, rs->group_mid));
+			break;
+		default:
+			snprintf(buf, sz, "%" PRIu64,
+				 ldms_metric_get_u64(set, rs->group_mid));
+			break;
+		}
+		return 1;
+	}
+	if (rs->cfg->group_info) {
+		gn = ldms_set_info_gn_get(set);
+		if (gn == mbr->info_gn)
+			return mbr->grp ? -1 : 0;
+		mbr->info_gn = gn;
+		value = ldms_set_info_get(set, rs->cfg->group_info);
+		if (!value)
+			return 0;
+		snprintf(buf, sz, "%s", value);
+		free(value);
+		return 1;
+	}
+	buf[0] = '\0';
+	return 1;
+}
+
+static struct rollup_member *member_new(struct rollup_store *rs,
+					const char *name)
+{
+	struct rollup_member *mbr;
+
+	mbr = calloc(1, sizeof(*mbr) + rs->metric_count * sizeof(double));
+	if (!mbr)
+		return NULL;
+	mbr->name = strdup(name);
+	if (!mbr->name) {
+		free(mbr);
+		return NULL;
+	}
+	mbr->info_gn = UINT64_MAX; /* look the group up */
+	rbn_init(&mbr->rbn, mbr->name);
+	rbt_ins(&rs->member_tree, &mbr->rbn);
+	TAILQ_INSERT_TAIL(&rs->lru, mbr, lru);
+	return mbr;
+}
+
+/* Apply the new values of a member that stays in its group */
+static void member_update(struct rollup_store *rs, struct rollup_member *mbr,
+			  const double *val)
+{
+	struct rollup_group *grp = mbr->grp;
+	int i, begun = 0;
+
+	for (i = 0; i < rs->metric_count; i++) {
+		if (val[i] == mbr->val[i])
+			continue;
+		if (!begun) {
+			ldms_transaction_begin(grp->set);
+			begun = 1;
+		}
+		grp->sum[i] += (long double)val[i] - mbr->val[i];
+		if (grp->sorted)
+			sorted_replace(grp->sorted[i], grp->card,
+				       mbr->val[i], val[i]);
+		mbr->val[i] = val[i];
+		group_output(rs, grp, i);
+	}
+	if (begun)
+		ldms_transaction_end(grp->set);
+}
+
+static void stale_prune(struct rollup_store *rs, time_t now)
+{
+	struct rollup_member *mbr;
+	while ((mbr = TAILQ_FIRST(&rs->lru))) {
+		if (mbr->last + rs->cfg->stale >= now)
+			break;
+		msglog(LDMSD_LDEBUG, STRR ": '%s' is stale.\n", mbr->name);
+		member_free(rs, mbr);
+	}
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry,
+      size_t metric_count)
+{
+	struct rollup_store *rs = _sh;
+	struct rollup_member *mbr;
+	struct rollup_group *grp;
+	const char *name;
+	struct rbn *rbn;
+	char key[256];
+	time_t now;
+	int i, rc = 0;
+
+	if (!rs)
+		return EINVAL;
+	if (!ldms_set_is_consistent(set))
+		return 0;
+	pthread_mutex_lock(&rs->lock);
+	if (!rs->compiled) {
+		rc = rollup_compile(rs, set, metric_arry, metric_count);
+		if (rc) {
+			msglog(LDMSD_LERROR, STRR ": error %d setting up the "
+			       "rollup of container '%s'.\n", rc,
+			       rs->cfg->container);
+			rs->compiled = -1;
+			goto out;
+		}
+	}
+	if (rs->compiled < 0) {
+		rc = EINVAL;
+		goto out;
+	}
+	name = ldms_set_instance_name_get(set);
+	rbn = rbt_find(&rs->member_tree, name);
+	if (rbn) {
+		mbr = container_of(rbn, struct rollup_member, rbn);
+	} else {
+		mbr = member_new(rs, name);
+		if (!mbr) {
+			rc = ENOMEM;
+			goto out;
+		}
+	}
+	now = time(NULL);
+	mbr->last = now;
+	TAILQ_REMOVE(&rs->lru, mbr, lru);
+	TAILQ_INSERT_TAIL(&rs->lru, mbr, lru);
+
+	for (i = 0; i < rs->metric_count; i++)
+		rs->vbuf[i] = value_get(set, rs->metric[i].mid,
+					rs->metric[i].type);
+	rc = group_key(rs, mbr, set, key, sizeof(key));
+	if (rc < 0 || (rc && mbr->grp && 0 == strcmp(key, mbr->grp->name))) {
+		member_update(rs, mbr, rs->vbuf);
+		rc = 0;
+		goto prune;
+	}
+	/* new member, or moving to another group */
+	if (mbr->grp)
+		member_leave(rs, mbr);
+	if (!rc)
+		goto prune; /* not in any group */
+	rc = 0;
+	grp = group_get(rs, key);
+	if (!grp) {
+		rc = ENOMEM;
+		goto prune;
+	}
+	memcpy(mbr->val, rs->vbuf, rs->metric_count * sizeof(double));
+	rc = member_join(rs, mbr, grp);
+	if (rc && !grp->card) {
+		rbt_del(&rs->group_tree, &grp->rbn);
+		group_free(rs, grp);
+	}
+prune:
+	if (rs->cfg->stale)
+		stale_prune(rs, now);
+out:
+	pthread_mutex_unlock(&rs->lock);
+	return rc;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	struct rollup_cfg *cfg;
+	pthread_mutex_lock(&cfg_lock);
+	while ((cfg = LIST_FIRST(&cfg_list))) {
+		LIST_REMOVE(cfg, entry);
+		cfg_free(cfg);
+	}
+	pthread_mutex_unlock(&cfg_lock);
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return
+"    config name=store_rollup container=<c> [op=<list>] [instance=<name>]\n"
+"           [schema=<name>] [producer=<name>] [group_by=<metric>]\n"
+"           [group_info=<key>] [stale=<sec>]\n"
+"              - Publish sets rolling up the sets stored by the storage\n"
+"                policies of container <c>.\n"
+"              op         Comma-separated functions: sum, avg, min, max,\n"
+"                         count and p<N> for the N-th percentile\n"
+"                         (default " ROLLUP_OPS_DEFAULT ")\n"
+"              instance   The rollup set name (default <c>); with a group,\n"
+"                         the sets are named <instance>/<group>\n"
+"              schema     The rollup schema (default <schema>_rollup)\n"
+"              producer   The rollup producer name (default <c>)\n"
+"              group_by   Roll up by the value of this metric\n"
+"              group_info Roll up by the value of this set info key\n"
+"              stale      Drop sets not stored for this many seconds\n"
+"                         (default 0, keep them)\n";
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	struct rollup_store *rs = _sh;
+	return rs->ucontext;
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	struct rollup_store *rs;
+	struct rollup_cfg *cfg;
+
+	pthread_mutex_lock(&cfg_lock);
+	cfg = cfg_find(container);
+	if (!cfg) {
+		msglog(LDMSD_LERROR, STRR ": container '%s' is not "
+		       "configured.\n", container);
+		rs = NULL;
+		goto out;
+	}
+	LIST_FOREACH(rs, &store_list, entry) {
+		if (rs->cfg != cfg)
+			continue;
+		if (strcmp(rs->schema, schema)) {
+			msglog(LDMSD_LERROR, STRR ": container '%s' already "
+			       "rolls up schema '%s'.\n", container,
+			       rs->schema);
+			rs = NULL;
+			goto out;
+		}
+		rs->ref_count++;
+		goto out;
+	}
+	rs = calloc(1, sizeof(*rs));
+	if (!rs)
+		goto out;
+	rs->schema = strdup(schema);
+	if (!rs->schema) {
+		free(rs);
+		rs = NULL;
+		goto out;
+	}
+	rs->cfg = cfg;
+	rs->store = s;
+	rs->ucontext = ucontext;
+	rs->ref_count = 1;
+	pthread_mutex_init(&rs->lock, NULL);
+	rbt_init(&rs->member_tree, name_cmp);
+	rbt_init(&rs->group_tree, name_cmp);
+	TAILQ_INIT(&rs->lru);
+	LIST_INSERT_HEAD(&store_list, rs, entry);
+out:
+	pthread_mutex_unlock(&cfg_lock);
+	return rs;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	return 0;
+}
+
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct rollup_store *rs = _sh;
+	struct rollup_member *mbr;
+	struct rollup_group *grp;
+	struct rbn *rbn;
+	int i;
+
+	if (!rs)
+		return;
+	pthread_mutex_lock(&cfg_lock);
+	if (--rs->ref_count) {
+		pthread_mutex_unlock(&cfg_lock);
+		return;
+	}
+	LIST_REMOVE(rs, entry);
+	pthread_mutex_unlock(&cfg_lock);
+
+	while ((mbr = TAILQ_FIRST(&rs->lru))) {
+		mbr->grp = NULL;
+		member_free(rs, mbr);
+	}
+	while ((rbn = rbt_min(&rs->group_tree))) {
+		rbt_del(&rs->group_tree, rbn);
+		grp = container_of(rbn, struct rollup_group, rbn);
+		group_free(rs, grp);
+	}
+	for (i = 0; i < rs->metric_count; i++)
+		free(rs->metric[i].out_mid);
+	free(rs->metric);
+	free(rs->vbuf);
+	if (rs->dschema)
+		ldms_schema_delete(rs->dschema);
+	pthread_mutex_destroy(&rs->lock);
+	free(rs->schema);
+	free(rs);
+}
+
+static struct ldmsd_store store_rollup = {
+	.base = {
+		.name = STRR,
+		.type = LDMSD_PLUGIN_STORE,
+		.term = term,
+		.config = config,
+		.usage = usage,
+	},
+	.open = open_store,
+	.close = close_store,
+	.store = store,
+	.get_context = get_ucontext,
+	.flush = flush_store,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &store_rollup.base;
+}
+
+static void __attribute__ ((constructor)) store_rollup_init();
+static void store_rollup_init()
+{
+	LIST_INIT(&cfg_list);
+	LIST_INIT(&store_list);
+}
@@ -0,0 +1,325 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of store_rollup with synthetic sets.
+ *
+ * Creates <members> local sets, stores them through the plugin grouped
+ * by job_id, then applies random updates (some of which move a member to
+ * another job). After each phase every rollup set is compared with the
+ * values computed from scratch, and the mean cost of a store is printed.
+ *
+ * usage: test_store_rollup [<members> [<updates>]]
+ */
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+#define _stringify(_x) #_x
+#define stringify(_x) _stringify(_x)
+
+#define JOBS	4
+#define PCT_A	50
+#define PCT_B	90
+
+static int verbose;
+static int failed;
+
+static void msglog(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+	if (level < LDMSD_LERROR && !verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf);
+
+static int members;
+static ldms_set_t *sets;
+static int mid_job, mid_a, mid_b, mid_c;
+
+static double member_value(int i, int mid)
+{
+	if (mid == mid_a)
+		return ldms_metric_get_u64(sets[i], mid);
+	if (mid == mid_b)
+		return ldms_metric_get_double(sets[i], mid);
+	return ldms_metric_get_s32(sets[i], mid);
+}
+
+static int dbl_cmp(const void *a, const void *b)
+{
+	double x = *(double *)a, y = *(double *)b;
+	return (x > y) - (x < y);
+}
+
+static void expect(const char *set_name, const char *metric, double v,
+		   double exp)
+{
+	if (fabs(v - exp) <= 1e-9 * fmax(1, fabs(exp)))
+		return;
+	printf("FAIL: %s %s: %.17g, expected %.17g\n", set_name, metric,
+	       v, exp);
+	failed++;
+}
+
+static void verify_metric(ldms_set_t rset, const char *set_name,
+			  const char *mname, double *v, int n)
+{
+	struct { const char *op; double exp; } chk[6];
+	long double sum = 0;
+	char name[64];
+	int i, rid;
+
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	qsort(v, n, sizeof(*v), dbl_cmp);
+	chk[0].op = "sum"; chk[0].exp = sum;
+	chk[1].op = "avg"; chk[1].exp = sum / n;
+	chk[2].op = "min"; chk[2].exp = v[0];
+	chk[3].op = "max"; chk[3].exp = v[n - 1];
+	chk[4].op = "p" stringify(PCT_A); chk[4].exp = v[(int)ceil(PCT_A / 100.0 * n) - 1];
+	chk[5].op = "p" stringify(PCT_B); chk[5].exp = v[(int)ceil(PCT_B / 100.0 * n) - 1];
+	for (i = 0; i < 6; i++) {
+		snprintf(name, sizeof(name), "%s_%s", mname, chk[i].op);
+		rid = ldms_metric_by_name(rset, name);
+		if (rid < 0) {
+			printf("FAIL: %s has no %s\n", set_name, name);
+			failed++;
+			continue;
+		}
+		expect(set_name, name, ldms_metric_get_double(rset, rid),
+		       chk[i].exp);
+	}
+}
+
+static void verify(const char *phase)
+{
+	static const char *mname[] = { "a", "b", "c" };
+	int mid[] = { mid_a, mid_b, mid_c };
+	char set_name[64];
+	ldms_set_t rset;
+	double *v;
+	int j, k, i, n;
+
+	v = calloc(members, sizeof(*v));
+	for (j = 1; j <= JOBS; j++) {
+		snprintf(set_name, sizeof(set_name), "rack/%d", j);
+		rset = ldms_set_by_name(set_name);
+		for (n = 0, i = 0; i < members; i++) {
+			if (ldms_metric_get_u64(sets[i], mid_job) == j)
+				n++;
+		}
+		if (!n) {
+			if (rset) {
+				printf("FAIL: %s: %s exists without members\n",
+				       phase, set_name);
+				failed++;
+				ldms_set_put(rset);
+			}
+			continue;
+		}
+		if (!rset) {
+			printf("FAIL: %s: %s not found\n", phase, set_name);
+			failed++;
+			continue;
+		}
+		expect(set_name, "count",
+		       ldms_metric_get_u64(rset, ldms_metric_by_name(rset, "count")),
+		       n);
+		if (ldms_metric_by_name(rset, "component_id_sum") >= 0) {
+			printf("FAIL: %s rolls up a meta metric\n", set_name);
+			failed++;
+		}
+		for (k = 0; k < 3; k++) {
+			for (n = 0, i = 0; i < members; i++) {
+				if (ldms_metric_get_u64(sets[i], mid_job) == j)
+					v[n++] = member_value(i, mid[k]);
+			}
+			verify_metric(rset, set_name, mname[k], v, n);
+		}
+		ldms_set_put(rset);
+	}
+	free(v);
+	printf("%s: %s\n", phase, failed ? "FAILED" : "ok");
+}
+
+static void member_set(int i, int job)
+{
+	ldms_transaction_begin(sets[i]);
+	if (job)
+		ldms_metric_set_u64(sets[i], mid_job, job);
+	ldms_metric_set_u64(sets[i], mid_a,
+			    ldms_metric_get_u64(sets[i], mid_a) + random() % 1000);
+	ldms_metric_set_double(sets[i], mid_b, random() / (double)RAND_MAX * 100);
+	ldms_metric_set_s32(sets[i], mid_c, random() % 2001 - 1000);
+	ldms_transaction_end(sets[i]);
+}
+
+static double now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+int main(int argc, char **argv)
+{
+	struct ldmsd_store *st;
+	struct attr_value_list *kwl, *avl;
+	ldmsd_store_handle_t sh;
+	ldms_schema_t schema;
+	char name[64];
+	char cfg[] = "container=rack instance=rack group_by=job_id "
+		     "op=count,sum,avg,min,max,p" stringify(PCT_A)
+		     ",p" stringify(PCT_B);
+	int *mids, mid_count;
+	int i, j, updates;
+	double t0, t;
+
+	members = argc > 1 ? atoi(argv[1]) : 10000;
+	updates = argc > 2 ? atoi(argv[2]) : 200000;
+	verbose = getenv("TEST_VERBOSE") != NULL;
+	srandom(1);
+
+	if (ldms_init(256 * 1024 * 1024)) {
+		printf("ldms_init failed\n");
+		return 1;
+	}
+	schema = ldms_schema_new("synth");
+	ldms_schema_meta_add(schema, "component_id", LDMS_V_U64);
+	mid_job = ldms_schema_metric_add(schema, "job_id", LDMS_V_U64);
+	mid_a = ldms_schema_metric_add(schema, "a", LDMS_V_U64);
+	mid_b = ldms_schema_metric_add(schema, "b", LDMS_V_D64);
+	mid_c = ldms_schema_metric_add(schema, "c", LDMS_V_S32);
+	mid_count = mid_c + 1;
+	mids = calloc(mid_count, sizeof(*mids));
+	for (i = 0; i < mid_count; i++)
+		mids[i] = i;
+
+	sets = calloc(members, sizeof(*sets));
+	for (i = 0; i < members; i++) {
+		snprintf(name, sizeof(name), "node%05d/synth", i);
+		sets[i] = ldms_set_new(name, schema);
+		if (!sets[i]) {
+			printf("ldms_set_new %s failed\n", name);
+			return 1;
+		}
+		ldms_metric_set_u64(sets[i], 0, i);
+		member_set(i, i % JOBS + 1);
+	}
+
+	st = (void *)get_plugin(msglog);
+	kwl = av_new(32);
+	avl = av_new(32);
+	tokenize(cfg, kwl, avl);
+	if (st->base.config(&st->base, kwl, avl)) {
+		printf("config failed\n");
+		return 1;
+	}
+	sh = st->open(st, "rack", "synth", NULL, NULL);
+	if (!sh) {
+		printf("open failed\n");
+		return 1;
+	}
+
+	t0 = now_us();
+	for (i = 0; i < members; i++)
+		st->store(sh, sets[i], mids, mid_count);
+	t = now_us() - t0;
+	printf("join: %d members, %.0f ns per member\n", members,
+	       t * 1000 / members);
+	verify("join");
+
+	t = 0;
+	for (j = 0; j < updates; j++) {
+		i = random() % members;
+		/* 1% of the updates move the member to another job */
+		member_set(i, random() % 100 ? 0 : random() % JOBS + 1);
+		t0 = now_us();
+		st->store(sh, sets[i], mids, mid_count);
+		t += now_us() - t0;
+	}
+	printf("update: %d updates, %.0f ns per member update\n", updates,
+	       t * 1000 / updates);
+	verify("update");
+
+	/* empty the last job; its rollup set must go away */
+	for (i = 0; i < members; i++) {
+		if (ldms_metric_get_u64(sets[i], mid_job) != JOBS)
+			continue;
+		member_set(i, 1);
+		st->store(sh, sets[i], mids, mid_count);
+	}
+	verify("move");
+
+	st->close(sh);
+	for (j = 1; j <= JOBS; j++) {
+		snprintf(name, sizeof(name), "rack/%d", j);
+		if (ldms_set_by_name(name)) {
+			printf("FAIL: %s remains after close\n", name);
+			failed++;
+		}
+	}
+	st->base.term(&st->base);
+	for (i = 0; i < members; i++)
+		ldms_set_delete(sets[i]);
+	free(sets);
+	free(mids);
+	ldms_schema_delete(schema);
+	return failed ? 1 : 0;
+}
@@ -291,15 +291,19 @@ void check_args()
 	}
 }
 
-struct ldms_set_info_pair *__set_info_get(struct ldms_set_info_list *list,
-								const char *key)
+const char *__set_info_get(struct ldms_set_info *info, const char *key)
 {
-	struct ldms_set_info_pair *pair;
-
-	LIST_FOREACH(pair, list, entry) {
-		if (0 == strcmp(pair->key, key))
-			return pair;
+	ldms_name_t k;
+
+	/* walk the records, the index is checked against this */
+	for (k = __ldms_set_info_first(info); k; k = __ldms_set_info_next(k)) {
+		if (0 == strcmp(k->name, key)) {
+			assert(__ldms_set_info_find(info, key) ==
+					__ldms_set_info_value(k)->name);
+			return __ldms_set_info_value(k)->name;
+		}
 	}
+	assert(NULL == __ldms_set_info_find(info, key));
 	return NULL;
 }
 
@@ -351,7 +355,7 @@ int test_ldms_set_info_traverse(ldms_set_t s)
 int test_ldms_set_info_set(ldms_set_t s, const char *key, const char *value)
 {
 	int rc;
-	struct ldms_set_info_pair *pair;
+	const char *v;
 
 	rc = ldms_set_info_set(s, key, value);
 	if (rc) {
@@ -359,21 +363,15 @@ int test_ldms_set_info_set(ldms_set_t s, const char *key, const char *value)
 		assert(0);
 	}
 
-	pair = LIST_FIRST(&s->set->local_info);
-	if (!pair) {
+	v = __set_info_get(&s->set->local_info, key);
+	if (!v) {
 		printf("\n	Failed to add key '%s' value '%s'\n", key, value);
 		assert(0);
 	}
 
-	if (0 != strcmp(key, pair->key)) {
-		printf("\n	Added key string '%s' is not the given string '%s'\n",
-				pair->key, key);
-		assert(0);
-	}
-
-	if (0 != strcmp(value, pair->value)) {
+	if (0 != strcmp(value, v)) {
 		printf("\n	Added value string '%s' is not the given string '%s'\n",
-				pair->value, value);
+				v, value);
 		assert(0);
 	}
 
@@ -384,7 +382,7 @@ int test_ldms_set_info_reset_value(ldms_set_t s, const char *key,
 				const char *new_value, const char *old_value)
 {
 	int rc;
-	struct ldms_set_info_pair *pair;
+	const char *v;
 
 	__add_pair(key, new_value);
 	rc = ldms_set_info_set(s, key, new_value);
@@ -393,15 +391,15 @@ int test_ldms_set_info_reset_value(ldms_set_t s, const char *key,
 		assert(0);
 	}
 
-	pair = __set_info_get(&s->set->local_info, key);
-	if (!pair) {
+	v = __set_info_get(&s->set->local_info, key);
+	if (!v) {
 		printf("\n	Failed!. The key does not exist.\n");
 		assert(0);
 	}
 
-	if (0 != strcmp(pair->value, new_value)) {
+	if (0 != strcmp(v, new_value)) {
 		printf("\n	Wrong new_value. expecting '%s' vs '%s'\n",
-							new_value, pair->value);
+							new_value, v);
 		assert(0);
 	}
 	return 0;
@@ -409,13 +407,10 @@ int test_ldms_set_info_reset_value(ldms_set_t s, const char *key,
 
 int test_ldms_set_info_unset(ldms_set_t s, const char *key, const char *value)
 {
-	struct ldms_set_info_pair *pair;
-
 	__add_pair(key, NULL);
 	ldms_set_info_unset(s, key);
 
-	pair = __set_info_get(&s->set->local_info, key);
-	if (pair) {
+	if (__set_info_get(&s->set->local_info, key)) {
 		printf("\n	Failed. The pair still exists after it was removed.\n");
 		assert(0);
 	}
@@ -432,6 +427,66 @@ void test_ldms_set_info_get(ldms_set_t s, const char *key, const char *exp_value
 	free(value);
 }
 
+static int __count_cb(const char *key, const char *value, void *arg)
+{
+	(*(int *)arg)++;
+	return 0;
+}
+
+/*
+ * The key and the value lengths are 8 bits in the set info records, longer
+ * strings must be refused without touching the existing pairs.
+ */
+void test_ldms_set_info_long(ldms_set_t s)
+{
+	char long_str[300];
+	char max_str[255];
+	int before, after;
+	int rc;
+
+	memset(long_str, 'v', sizeof(long_str) - 1);
+	long_str[sizeof(long_str) - 1] = '\0';
+	memset(max_str, 'm', sizeof(max_str) - 1);
+	max_str[sizeof(max_str) - 1] = '\0';
+
+	before = 0;
+	ldms_set_info_traverse(s, __count_cb, LDMS_SET_INFO_F_LOCAL, &before);
+
+	rc = ldms_set_info_set(s, "long_value", long_str);
+	if (rc != E2BIG) {
+		printf("\n	Expecting E2BIG for a long value, but got %d\n", rc);
+		assert(0);
+	}
+	rc = ldms_set_info_set(s, long_str, "v");
+	if (rc != E2BIG) {
+		printf("\n	Expecting E2BIG for a long key, but got %d\n", rc);
+		assert(0);
+	}
+	/* the longest value that fits */
+	test_ldms_set_info_set(s, "max_value", max_str);
+	test_ldms_set_info_set(s, "after_max", "1");
+	test_ldms_set_info_get(s, "max_value", max_str);
+	test_ldms_set_info_get(s, "after_max", "1");
+
+	after = 0;
+	ldms_set_info_traverse(s, __count_cb, LDMS_SET_INFO_F_LOCAL, &after);
+	if (after != before + 2) {
+		printf("\n	Expecting %d pairs, but traversed %d\n",
+		       before + 2, after);
+		assert(0);
+	}
+
+	ldms_set_info_unset(s, "max_value");
+	ldms_set_info_unset(s, "after_max");
+	after = 0;
+	ldms_set_info_traverse(s, __count_cb, LDMS_SET_INFO_F_LOCAL, &after);
+	if (after != before) {
+		printf("\n	Expecting %d pairs after unset, but traversed %d\n",
+		       before, after);
+		assert(0);
+	}
+}
+
 static void __test_set_info_key_value_pair(const char *key, const char *value,
 							struct exp_result *exp)
 {
@@ -1089,6 +1144,10 @@ ldms_set_t test_local_set_info()
 		assert(0);
 	printf(" ----- PASSED\n");
 
+	printf("Refuse a long key or value");
+	test_ldms_set_info_long(set);
+	printf(" ----- PASSED\n");
+
 	ldms_schema_delete(schema);
 	return set;
 }
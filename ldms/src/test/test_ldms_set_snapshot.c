@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of ldms_set_snapshot_get() on a consumer: a snapshot taken
+ * after an update must keep its values and data GN while the set is
+ * pulled or pushed again, with data slots and for a set with more than
+ * one set buffer. The sets are sampled by a child process, as a lookup
+ * in the process of the set returns the set itself.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ldms.h"
+
+#define SLOTS		3
+#define UPDATES		5
+#define SET_NAME	"snap_test/set"
+#define ARRAY_SET_NAME	"snap_test/array_set"
+
+/* A request to the producer */
+struct sample_req {
+	int set_idx;
+	int push;
+	uint64_t value;
+};
+
+static int req_fd[2], ack_fd[2];
+static sem_t sem;
+static int err;
+static ldms_set_t lookup_set;
+
+static void check(int cond, const char *what)
+{
+	if (!cond) {
+		err++;
+		printf("error: %s\n", what);
+	}
+}
+
+static void wait_cb(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 10;
+	if (sem_timedwait(&sem, &ts)) {
+		printf("error: timeout\n");
+		exit(1);
+	}
+}
+
+static ldms_set_t set_new(const char *name, int array_card)
+{
+	ldms_schema_t schema;
+	ldms_set_t set;
+
+	schema = ldms_schema_new(name);
+	if (!schema)
+		return NULL;
+	if (ldms_schema_metric_add(schema, "u64", LDMS_V_U64) < 0 ||
+	    ldms_schema_array_card_set(schema, array_card))
+		return NULL;
+	set = ldms_set_new(name, schema);
+	ldms_schema_delete(schema);
+	if (!set || ldms_set_publish(set))
+		return NULL;
+	return set;
+}
+
+/* Listen, report the port and serve the requests until EOF */
+static int producer(void)
+{
+	struct sockaddr_in sin;
+	struct sample_req req;
+	ldms_set_t set[2];
+	ldms_t x;
+	int port, rc;
+
+	ldms_init(1024 * 1024);
+	set[0] = set_new(SET_NAME, 1);
+	set[1] = set_new(ARRAY_SET_NAME, 2);
+	x = ldms_xprt_new("sock", NULL);
+	port = 0;
+	if (!set[0] || !set[1] || !x)
+		goto out;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	/* Find a free port */
+	port = 20000 + getpid() % 10000;
+	do {
+		sin.sin_port = htons(port);
+		rc = ldms_xprt_listen(x, (void *)&sin, sizeof(sin), NULL, NULL);
+	} while (rc && ++port < 65535);
+	if (rc)
+		port = 0;
+ out:
+	if (write(ack_fd[1], &port, sizeof(port)) != sizeof(port) || !port)
+		return 1;
+	while (read(req_fd[0], &req, sizeof(req)) == sizeof(req)) {
+		ldms_transaction_begin(set[req.set_idx]);
+		ldms_metric_set_u64(set[req.set_idx], 0, req.value);
+		ldms_transaction_end(set[req.set_idx]);
+		rc = req.push ? ldms_xprt_push(set[req.set_idx]) : 0;
+		if (write(ack_fd[1], &rc, sizeof(rc)) != sizeof(rc))
+			return 1;
+	}
+	return 0;
+}
+
+static void sample(int set_idx, uint64_t value, int push)
+{
+	struct sample_req req = {
+		.set_idx = set_idx,
+		.push = push,
+		.value = value,
+	};
+	int rc;
+
+	if (write(req_fd[1], &req, sizeof(req)) != sizeof(req) ||
+	    read(ack_fd[0], &rc, sizeof(rc)) != sizeof(rc)) {
+		printf("error: producer is gone\n");
+		exit(1);
+	}
+	check(rc == 0, push ? "push" : "sample");
+}
+
+static void event_cb(ldms_t x, ldms_xprt_event_t e, void *arg)
+{
+	if (e->type == LDMS_XPRT_EVENT_CONNECTED)
+		sem_post(&sem);
+	else if (e->type != LDMS_XPRT_EVENT_DISCONNECTED)
+		printf("unexpected event %d\n", e->type);
+}
+
+static void lookup_cb(ldms_t x, enum ldms_lookup_status status, int more,
+		      ldms_set_t s, void *arg)
+{
+	check(status == LDMS_LOOKUP_OK, "lookup");
+	lookup_set = s;
+	if (!more)
+		sem_post(&sem);
+}
+
+static void update_cb(ldms_t x, ldms_set_t s, int flags, void *arg)
+{
+	check(LDMS_UPD_ERROR(flags) == 0, "update");
+	if (!(flags & LDMS_UPD_F_MORE))
+		sem_post(&sem);
+}
+
+static void push_cb(ldms_t x, ldms_set_t s, int flags, void *arg)
+{
+	sem_post(&sem);
+}
+
+static void update(ldms_set_t s)
+{
+	check(ldms_xprt_update(s, update_cb, NULL) == 0, "update request");
+	wait_cb();
+}
+
+static ldms_set_t lookup(ldms_t x, const char *name)
+{
+	lookup_set = NULL;
+	if (ldms_xprt_lookup(x, name, LDMS_LOOKUP_BY_INSTANCE,
+			     lookup_cb, NULL))
+		return NULL;
+	wait_cb();
+	return lookup_set;
+}
+
+/*
+ * Keep a snapshot of the consumer set while the producer set is
+ * sampled and pulled, and then pushed if \c push.
+ */
+static void test_snapshot(ldms_t x, int set_idx, const char *name, int push)
+{
+	ldms_set_t s, snap;
+	uint64_t gn;
+	int i;
+
+	s = lookup(x, name);
+	check(s != NULL, name);
+	if (!s)
+		return;
+	if (push)
+		check(ldms_xprt_register_push(s, 0, push_cb, NULL) == 0,
+		      "register push");
+	sample(set_idx, 1, 0);
+	update(s);
+	check(ldms_metric_get_u64(s, 0) == 1, "first update");
+
+	snap = ldms_set_snapshot_get(s);
+	check(snap != NULL, "snapshot");
+	if (!snap)
+		return;
+	gn = ldms_set_data_gn_get(snap);
+	check(gn == ldms_set_data_gn_get(s), "snapshot GN");
+	for (i = 2; i < UPDATES + 2; i++) {
+		sample(set_idx, i, 0);
+		update(s);
+		check(ldms_metric_get_u64(s, 0) == i, "updated value");
+		check(ldms_metric_get_u64(snap, 0) == 1, "snapshot value");
+		check(ldms_set_data_gn_get(snap) == gn, "snapshot GN");
+	}
+	if (!push)
+		goto out;
+
+	/* The pushes are written in place */
+	for (; i < 2 * UPDATES + 2; i++) {
+		sample(set_idx, i, 1);
+		wait_cb();
+		check(ldms_metric_get_u64(s, 0) == i, "pushed value");
+		check(ldms_metric_get_u64(snap, 0) == 1, "snapshot value");
+		check(ldms_set_data_gn_get(snap) == gn, "snapshot GN");
+	}
+	ldms_set_snapshot_put(snap);
+
+	/* A snapshot of the pushed data */
+	snap = ldms_set_snapshot_get(s);
+	check(snap != NULL, "snapshot of pushed data");
+	if (!snap)
+		return;
+	gn = ldms_set_data_gn_get(snap);
+	sample(set_idx, 0, 1);
+	wait_cb();
+	check(ldms_metric_get_u64(s, 0) == 0, "pushed value");
+	check(ldms_metric_get_u64(snap, 0) == i - 1, "snapshot value");
+	check(ldms_set_data_gn_get(snap) == gn, "snapshot GN");
+ out:
+	ldms_set_snapshot_put(snap);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	ldms_t x;
+	pid_t pid;
+	int port, rc;
+
+	if (pipe(req_fd) || pipe(ack_fd)) {
+		printf("pipe error %d\n", errno);
+		return 1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		printf("fork error %d\n", errno);
+		return 1;
+	}
+	if (!pid) {
+		close(req_fd[1]);
+		close(ack_fd[0]);
+		return producer();
+	}
+	close(req_fd[0]);
+	close(ack_fd[1]);
+	if (read(ack_fd[0], &port, sizeof(port)) != sizeof(port) || !port) {
+		printf("producer error\n");
+		rc = 1;
+		goto out;
+	}
+
+	ldms_init(1024 * 1024);
+	ldms_set_snapshot_slots(SLOTS);
+	sem_init(&sem, 0, 0);
+	x = ldms_xprt_new("sock", NULL);
+	if (!x) {
+		printf("ldms_xprt_new error %d\n", errno);
+		rc = 1;
+		goto out;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	rc = ldms_xprt_connect(x, (void *)&sin, sizeof(sin), event_cb, NULL);
+	if (rc) {
+		printf("ldms_xprt_connect error %d\n", rc);
+		goto out;
+	}
+	wait_cb();
+
+	test_snapshot(x, 0, SET_NAME, 1);
+	test_snapshot(x, 1, ARRAY_SET_NAME, 0);
+	ldms_xprt_close(x);
+	if (err)
+		printf("%d errors\n", err);
+	rc = err ? 1 : 0;
+ out:
+	close(req_fd[1]);
+	waitpid(pid, NULL, 0);
+	return rc;
+}
@@ -0,0 +1,216 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the shared memory sets: a writer creates a set with
+ * ldms_shm_set_new(), then the set is opened, published and deleted as
+ * ldmsd does with shm_set_add/shm_set_del. Objects with an invalid
+ * dictionary, value offset or owner must be refused, and changes to the
+ * metadata after the set is open must not be seen.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ldms.h"
+
+#define INST_NAME	"shm_test/set"
+
+static char shm_name[64];
+static int err;
+
+static void check(int cond, const char *what)
+{
+	if (!cond) {
+		err++;
+		printf("error: %s\n", what);
+	}
+}
+
+/* Map the object as a misbehaving writer would */
+static struct ldms_set_hdr *raw_map(size_t *sz)
+{
+	struct ldms_set_hdr *meta;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(shm_name, O_RDWR, 0);
+	if (fd < 0 || fstat(fd, &st))
+		return NULL;
+	meta = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (meta == MAP_FAILED)
+		return NULL;
+	*sz = st.st_size;
+	return meta;
+}
+
+static int open_rc(void)
+{
+	ldms_set_t set;
+	int rc;
+
+	rc = ldms_shm_set_open(shm_name, &set, NULL);
+	if (!rc)
+		ldms_set_delete(set);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	ldms_schema_t schema;
+	ldms_set_t set, s;
+	struct ldms_set_hdr *meta;
+	struct ldms_value_desc *vd;
+	struct stat st;
+	uint32_t saved;
+	size_t sz;
+	int rc, i;
+
+	ldms_init(1024 * 1024);
+	snprintf(shm_name, sizeof(shm_name), "/test_ldms_shm_set.%d",
+		 (int)getpid());
+	schema = ldms_schema_new("shm_test");
+	if (!schema)
+		return ENOMEM;
+	if (ldms_schema_meta_add(schema, "component_id", LDMS_V_U64) < 0 ||
+	    ldms_schema_metric_add(schema, "u64", LDMS_V_U64) < 0 ||
+	    ldms_schema_metric_array_add(schema, "u32s", LDMS_V_U32_ARRAY, 4) < 0)
+		return ENOMEM;
+
+	/* The writer */
+	set = ldms_shm_set_new(shm_name, INST_NAME, schema,
+			       geteuid(), getegid(), 0640);
+	if (!set) {
+		printf("ldms_shm_set_new: error %d\n", errno);
+		return errno;
+	}
+	ldms_transaction_begin(set);
+	ldms_metric_set_u64(set, 0, 42);
+	ldms_metric_set_u64(set, 1, 1234);
+	for (i = 0; i < 4; i++)
+		ldms_metric_array_set_u32(set, 2, i, i + 1);
+	ldms_transaction_end(set);
+	/* The object outlives the writer's handle */
+	ldms_set_delete(set);
+
+	/* Open, publish, delete */
+	rc = ldms_shm_set_open(shm_name, &set, &st);
+	check(rc == 0, "open");
+	if (rc)
+		goto out;
+	check(st.st_uid == geteuid() && st.st_gid == getegid(),
+	      "object owner");
+	check(0 == strcmp(ldms_set_instance_name_get(set), INST_NAME),
+	      "instance name");
+	check(ldms_metric_get_u64(set, 0) == 42, "meta-metric value");
+	check(ldms_metric_get_u64(set, 1) == 1234, "metric value");
+	check(ldms_metric_array_get_u32(set, 2, 3) == 4, "array value");
+	check(ldms_shm_set_open(shm_name, &s, NULL) == EEXIST, "open twice");
+	check(ldms_set_publish(set) == 0, "publish");
+	s = ldms_set_by_name(INST_NAME);
+	check(s != NULL, "lookup by name");
+	if (s)
+		ldms_set_put(s);
+
+	/* Metadata changes after the open are not seen */
+	meta = raw_map(&sz);
+	check(meta != NULL, "raw map");
+	if (!meta)
+		goto out;
+	saved = meta->dict[1];
+	meta->dict[1] = __cpu_to_le32(sz);
+	check(ldms_metric_by_name(set, "u64") == 1, "private dictionary");
+	check(ldms_metric_get_u64(set, 1) == 1234, "private value offset");
+	meta->dict[1] = saved;
+
+	check(ldms_set_unpublish(set) == 0, "unpublish");
+	ldms_set_delete(set);
+	check(ldms_set_by_name(INST_NAME) == NULL, "deleted");
+	check(open_rc() == 0, "reopen");
+
+	/* Invalid objects are refused */
+	meta->dict[1] = __cpu_to_le32(sz);
+	check(open_rc() == EINVAL, "dictionary entry out of range");
+	meta->dict[1] = saved;
+
+	vd = ldms_ptr_(struct ldms_value_desc, meta,
+		       __le32_to_cpu(meta->dict[2]));
+	saved = vd->vd_data_offset;
+	vd->vd_data_offset = meta->data_sz;
+	check(open_rc() == EINVAL, "value offset out of range");
+	vd->vd_data_offset = saved;
+
+	saved = vd->vd_array_count;
+	vd->vd_array_count = __cpu_to_le32(0x10000000);
+	check(open_rc() == EINVAL, "array size out of range");
+	vd->vd_array_count = saved;
+
+	saved = meta->meta_sz;
+	meta->meta_sz = __cpu_to_le32(__le32_to_cpu(saved) - 8);
+	check(open_rc() == EINVAL, "metadata size");
+	meta->meta_sz = saved;
+
+	saved = meta->uid;
+	meta->uid = __cpu_to_le32(geteuid() + 1);
+	check(open_rc() == EPERM, "set owner is not the object owner");
+	meta->uid = saved;
+
+	check(open_rc() == 0, "restored object");
+	munmap(meta, sz);
+ out:
+	shm_unlink(shm_name);
+	if (err)
+		printf("%d errors\n", err);
+	return err ? 1 : 0;
+}
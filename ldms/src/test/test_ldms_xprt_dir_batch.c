@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the coalesced directory updates (ldms_dir_update_coalesce()):
+ * sets published and then deleted within one window must reach a
+ * LDMS_DIR_F_NOTIFY consumer as every ADD and then every DEL, in
+ * order, in fewer messages than sets, and no message may hold more
+ * than max_sets sets.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ldms.h"
+
+#define NUM_SETS	10
+#define WINDOW_US	500000
+#define MAX_SETS	4
+
+static sem_t sem;
+static int err;
+
+/* What the consumer received since the last reset() */
+static struct {
+	enum ldms_dir_type type;
+	char name[64];
+} rcvd[2 * NUM_SETS];
+static int rcvd_count;
+static int msg_count[LDMS_DIR_UPD + 1];
+static int msg_max_sets;
+
+static void check(int cond, const char *what)
+{
+	if (!cond) {
+		err++;
+		printf("error: %s\n", what);
+	}
+}
+
+static void wait_cb(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 10;
+	if (sem_timedwait(&sem, &ts)) {
+		printf("error: timeout\n");
+		exit(1);
+	}
+}
+
+static void reset(void)
+{
+	rcvd_count = 0;
+	memset(msg_count, 0, sizeof(msg_count));
+	msg_max_sets = 0;
+}
+
+static void event_cb(ldms_t x, ldms_xprt_event_t e, void *arg)
+{
+	if (e->type == LDMS_XPRT_EVENT_CONNECTED)
+		sem_post(&sem);
+	else if (e->type != LDMS_XPRT_EVENT_DISCONNECTED)
+		printf("unexpected event %d\n", e->type);
+}
+
+/* Posts once for the initial list, then once per set */
+static void dir_cb(ldms_t x, int status, ldms_dir_t dir, void *arg)
+{
+	int i;
+
+	check(status == 0, "dir status");
+	if (status)
+		return;
+	if (dir->type == LDMS_DIR_LIST) {
+		if (!dir->more)
+			sem_post(&sem);
+		goto out;
+	}
+	msg_count[dir->type]++;
+	if (dir->set_count > msg_max_sets)
+		msg_max_sets = dir->set_count;
+	for (i = 0; i < dir->set_count; i++) {
+		if (rcvd_count == 2 * NUM_SETS) {
+			check(0, "unexpected set");
+			break;
+		}
+		rcvd[rcvd_count].type = dir->type;
+		snprintf(rcvd[rcvd_count].name, sizeof(rcvd[0].name), "%s",
+			 dir->set_data[i].inst_name);
+		rcvd_count++;
+		sem_post(&sem);
+	}
+ out:
+	ldms_xprt_dir_free(x, dir);
+}
+
+/*
+ * Publish and delete NUM_SETS sets in one window and check the updates
+ * the consumer receives.
+ */
+static void test_batch(int max_sets)
+{
+	ldms_schema_t schema;
+	ldms_set_t set[NUM_SETS];
+	char name[64];
+	int i, n;
+
+	check(ldms_dir_update_coalesce(WINDOW_US, max_sets) == 0, "coalesce");
+	reset();
+	schema = ldms_schema_new("dir_batch_test");
+	if (!schema || ldms_schema_metric_add(schema, "u64", LDMS_V_U64) < 0) {
+		check(0, "schema");
+		return;
+	}
+	for (i = 0; i < NUM_SETS; i++) {
+		snprintf(name, sizeof(name), "dir_batch_test/%d", i);
+		set[i] = ldms_set_new(name, schema);
+		check(set[i] != NULL, "set new");
+		if (!set[i])
+			exit(1);
+		check(ldms_set_publish(set[i]) == 0, "publish");
+	}
+	for (i = 0; i < NUM_SETS; i++) {
+		check(ldms_set_unpublish(set[i]) == 0, "unpublish");
+		ldms_set_delete(set[i]);
+	}
+	ldms_schema_delete(schema);
+	for (i = 0; i < 2 * NUM_SETS; i++)
+		wait_cb();
+
+	/* Every ADD, then every DEL, each in the set order */
+	for (i = 0; i < 2 * NUM_SETS; i++) {
+		snprintf(name, sizeof(name), "dir_batch_test/%d", i % NUM_SETS);
+		check(rcvd[i].type == (i < NUM_SETS ? LDMS_DIR_ADD : LDMS_DIR_DEL),
+		      "update type");
+		check(0 == strcmp(rcvd[i].name, name), "update order");
+	}
+	check(msg_count[LDMS_DIR_ADD] < NUM_SETS, "ADD batched");
+	check(msg_count[LDMS_DIR_DEL] < NUM_SETS, "DEL batched");
+	if (!max_sets)
+		return;
+	n = (NUM_SETS + max_sets - 1) / max_sets;
+	check(msg_max_sets <= max_sets, "max_sets");
+	check(msg_count[LDMS_DIR_ADD] >= n, "ADD split");
+	check(msg_count[LDMS_DIR_DEL] >= n, "DEL split");
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	ldms_t listen_x, x;
+	int port, rc;
+
+	ldms_init(1024 * 1024);
+	sem_init(&sem, 0, 0);
+	listen_x = ldms_xprt_new("sock", NULL);
+	x = ldms_xprt_new("sock", NULL);
+	if (!listen_x || !x) {
+		printf("ldms_xprt_new error %d\n", errno);
+		return 1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	/* Find a free port */
+	port = 20000 + getpid() % 10000;
+	do {
+		sin.sin_port = htons(port);
+		rc = ldms_xprt_listen(listen_x, (void *)&sin, sizeof(sin),
+				      NULL, NULL);
+	} while (rc && ++port < 65535);
+	if (rc) {
+		printf("ldms_xprt_listen error %d\n", rc);
+		return 1;
+	}
+	rc = ldms_xprt_connect(x, (void *)&sin, sizeof(sin), event_cb, NULL);
+	if (rc) {
+		printf("ldms_xprt_connect error %d\n", rc);
+		return 1;
+	}
+	wait_cb();
+	rc = ldms_xprt_dir(x, dir_cb, NULL, LDMS_DIR_F_NOTIFY);
+	if (rc) {
+		printf("ldms_xprt_dir error %d\n", rc);
+		return 1;
+	}
+	wait_cb();
+
+	test_batch(0);
+	test_batch(MAX_SETS);
+	ldms_xprt_close(x);
+	if (err)
+		printf("%d errors\n", err);
+	return err ? 1 : 0;
+}
@@ -46,6 +46,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -56,12 +57,18 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <limits.h>
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sys/syscall.h>
+#ifdef SYS_mbind
+#include <linux/mempolicy.h>
+#endif
 #include "mmalloc.h"
 #include "../coll/rbt.h"
+#include "../ovis_util/util.h"
 #include "ovis-test/test.h"
 
 static int mm_is_disable_mm_free = 0;
@@ -78,6 +85,11 @@ typedef struct mm_region {
 	size_t grain_bits;
 	size_t size;
 	void *start;
+	int fd;			/* memfd backing the heap, or -1 */
+	int flags;		/* MM_F_* */
+	size_t page_size;
+	int numa_mode;
+	unsigned long numa_nodes;
 	pthread_mutex_t lock;
 	struct rbt size_tree;
 	struct rbt addr_tree;
@@ -106,10 +118,21 @@ static mm_region_t mmr;
 
 void mm_get_info(struct mm_info *mmi)
 {
+	if (!mmr) {
+		/* mm_init() has not been called */
+		memset(mmi, 0, sizeof(*mmi));
+		mmi->fd = -1;
+		return;
+	}
 	mmi->grain = mmr->grain;
 	mmi->grain_bits = mmr->grain_bits;
 	mmi->size = mmr->size;
 	mmi->start = mmr->start;
+	mmi->fd = mmr->fd;
+	mmi->flags = mmr->flags;
+	mmi->page_size = mmr->page_size;
+	mmi->numa_mode = mmr->numa_mode;
+	mmi->numa_nodes = mmr->numa_nodes;
 }
 
 static void get_pow2(size_t n, size_t *pow2, size_t *bits)
@@ -121,18 +144,162 @@ static void get_pow2(size_t n, size_t *pow2, size_t *bits)
 	*bits = _bits;
 }
 
+static size_t __hugepage_size(void)
+{
+	char line[128];
+	size_t kb = 0;
+	FILE *f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return 2 * 1024 * 1024;
+	while (fgets(line, sizeof(line), f)) {
+		if (1 == sscanf(line, "Hugepagesize: %zu kB", &kb))
+			break;
+	}
+	fclose(f);
+	return kb ? kb * 1024 : 2 * 1024 * 1024;
+}
+
+/* Map the heap; sets mmr->fd when it is backed by a memfd */
+static void *__mm_map(size_t size, int hugetlb)
+{
+	void *start;
+	int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+	const char *env;
+
+	mmr->fd = -1;
+#ifdef MFD_CLOEXEC
+	/*
+	 * Back the heap with a memfd so that a transport can hand it to
+	 * a co-located peer (see zap_shm). This is opt-in: a shared mapping
+	 * stays shared with fork()'d children and its fd goes to the peers.
+	 */
+	env = getenv("MMALLOC_SHARED");
+	if (env && atoi(env)) {
+		int mfd_flags = MFD_CLOEXEC;
+		if (hugetlb) {
+#ifdef MFD_HUGETLB
+			mfd_flags |= MFD_HUGETLB;
+#else
+			goto private;
+#endif
+		}
+		mmr->fd = memfd_create("mmalloc", mfd_flags);
+		if (mmr->fd >= 0 && ftruncate(mmr->fd, size)) {
+			close(mmr->fd);
+			mmr->fd = -1;
+		}
+	}
+	if (mmr->fd >= 0) {
+		start = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED, mmr->fd, 0);
+		if (MAP_FAILED != start)
+			return start;
+		close(mmr->fd);
+		mmr->fd = -1;
+	}
+#ifndef MFD_HUGETLB
+ private:
+#endif
+#endif
+	if (hugetlb) {
+#ifdef MAP_HUGETLB
+		flags |= MAP_HUGETLB;
+#else
+		return MAP_FAILED;
+#endif
+	}
+	return mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+/* Parse a node list such as "0-1,3" into a mask */
+static int __parse_nodes(const char *s, unsigned long *mask)
+{
+	cpu_set_t set;
+	int i;
+
+	if (ovis_cpulist_parse(s, &set))
+		return EINVAL;
+	*mask = 0;
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, &set))
+			continue;
+		if (i >= sizeof(*mask) * 8)
+			return EINVAL;
+		*mask |= 1UL << i;
+	}
+	return 0;
+}
+
+static void __mm_numa(void *start, size_t size)
+{
+#ifdef SYS_mbind
+	const char *env = getenv("MMALLOC_NUMA");
+	unsigned long mask;
+	int mode;
+
+	if (!env)
+		return;
+	if (0 == strncmp(env, "interleave:", 11)) {
+		mode = MPOL_INTERLEAVE;
+		env += 11;
+	} else if (0 == strncmp(env, "bind:", 5)) {
+		mode = MPOL_BIND;
+		env += 5;
+	} else if (0 == strncmp(env, "preferred:", 10)) {
+		mode = MPOL_PREFERRED;
+		env += 10;
+	} else {
+		return;
+	}
+	if (__parse_nodes(env, &mask))
+		return;
+	if (syscall(SYS_mbind, start, size, mode, &mask,
+		    sizeof(mask) * 8 + 1, 0))
+		return;
+	mmr->flags |= MM_F_NUMA;
+	mmr->numa_mode = mode;
+	mmr->numa_nodes = mask;
+#endif
+}
+
 int mm_init(size_t size, size_t grain)
 {
+	const char *huge, *tmp;
+	size_t hsize;
+
 	mmr = calloc(1, sizeof (*mmr));
 	if (!mmr)
 		return ENOMEM;
 	pthread_mutex_init(&mmr->lock, NULL);
 	size = MMR_ROUNDUP(size, 4096);
-	mmr->start = mmap(NULL, size, PROT_READ | PROT_WRITE,
-			  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	mmr->page_size = sysconf(_SC_PAGESIZE);
+	mmr->start = MAP_FAILED;
+	huge = getenv("MMALLOC_HUGEPAGES");
+	if (huge && 0 == strcasecmp(huge, "explicit")) {
+		hsize = __hugepage_size();
+		mmr->start = __mm_map(MMR_ROUNDUP(size, hsize), 1);
+		if (MAP_FAILED != mmr->start) {
+			size = MMR_ROUNDUP(size, hsize);
+			mmr->page_size = hsize;
+			mmr->flags |= MM_F_HUGETLB;
+		}
+	}
+	if (MAP_FAILED == mmr->start)
+		mmr->start = __mm_map(size, 0);
 	if (MAP_FAILED == mmr->start)
 		goto out;
 
+#ifdef MADV_HUGEPAGE
+	if (huge && 0 == strcasecmp(huge, "thp") &&
+	    0 == madvise(mmr->start, size, MADV_HUGEPAGE))
+		mmr->flags |= MM_F_THP;
+#endif
+	/* before the pages are touched so that they follow the policy */
+	__mm_numa(mmr->start, size);
+	tmp = getenv("MMALLOC_MLOCK");
+	if (tmp && atoi(tmp) && 0 == mlock(mmr->start, size))
+		mmr->flags |= MM_F_MLOCK;
+
 #ifdef DEBUG
 	memset(mmr->start, 0XAA, size);
 #endif
@@ -155,7 +322,7 @@ int mm_init(size_t size, size_t grain)
 	rbt_ins(&mmr->size_tree, &pfx->size_node);
 	rbt_ins(&mmr->addr_tree, &pfx->addr_node);
 
-	const char *tmp = getenv("MMALLOC_DISABLE_MM_FREE");
+	tmp = getenv("MMALLOC_DISABLE_MM_FREE");
 	if (tmp)
 		mm_is_disable_mm_free = atoi(tmp);
 
@@ -53,8 +53,18 @@ struct mm_info {
 	size_t grain_bits;	/*! x in 2^x*/
 	size_t size;		/*! The size of the heap in bytes */
 	void *start;		/*! The address of the start of the heap */
+	int fd;			/*! memfd backing the heap, -1 if private */
+	int flags;		/*! MM_F_* placement actually applied */
+	size_t page_size;	/*! The page size backing the heap */
+	int numa_mode;		/*! MPOL_* of the heap, if MM_F_NUMA */
+	unsigned long numa_nodes; /*! NUMA node mask of the heap */
 };
 
+#define MM_F_HUGETLB	0x1	/* backed by explicit huge pages */
+#define MM_F_THP	0x2	/* transparent huge pages advised */
+#define MM_F_MLOCK	0x4	/* locked in memory */
+#define MM_F_NUMA	0x8	/* NUMA memory policy applied */
+
 struct mm_stat {
 	size_t size;		/*< as in mm_info */
 	size_t grain;		/*< as in mm_info */
@@ -75,6 +85,20 @@ void mm_get_info(struct mm_info *mmi);
  * \brief Initialize the heap.
  *
  * Allocates memory for the heap and configures the minimum block size.
+ * The heap is private anonymous memory. With MMALLOC_SHARED=1 in the
+ * environment, and where memfd_create(2) is available, it is a shared
+ * mapping of a memfd instead (see ::mm_info.fd) that the shm transport
+ * hands to co-located peers.
+ *
+ * The placement of the heap is controlled by the environment:
+ * - MMALLOC_HUGEPAGES=explicit backs the heap with huge pages from the
+ *   hugetlb pool, MMALLOC_HUGEPAGES=thp advises transparent huge pages.
+ * - MMALLOC_MLOCK=1 locks the heap in memory.
+ * - MMALLOC_NUMA=interleave:<nodes>, bind:<nodes> or preferred:<node>
+ *   sets the NUMA memory policy of the heap, e.g. interleave:0-1.
+ *
+ * A placement that cannot be applied is skipped; ::mm_info.flags tells
+ * what was applied.
  *
  * \param size	The requested size of the heap in bytes.
  * \param grain	The minimum allocation size.
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "util.h"
 #include <string.h>
 #include <stdlib.h>
@@ -92,6 +93,22 @@ int main(int argc, char **argv)
 
 	test_av();
 
+	cpu_set_t set;
+	if (ovis_cpulist_parse("0-3,8", &set) || CPU_COUNT(&set) != 5) {
+		printf("error 9: ovis_cpulist_parse(\"0-3,8\")\n");
+		errcnt++;
+	}
+	ovis_cpulist_str(&set, buf, sizeof(buf));
+	if (strcmp(buf, "0-3,8")) {
+		printf("error 10: ovis_cpulist_str() %s\n", buf);
+		errcnt++;
+	}
+	if (!ovis_cpulist_parse("3-1", &set) || !ovis_cpulist_parse("1,", &set)
+	    || !ovis_cpulist_parse("", &set)) {
+		printf("error 11: ovis_cpulist_parse() accepted a bad list\n");
+		errcnt++;
+	}
+
 	/* odd cases */
 
 	r = ovis_join(NULL,NULL); // empty list
@@ -48,6 +48,9 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/errno.h>
 #include <linux/limits.h>
 #include <string.h>
@@ -1061,3 +1064,57 @@ void ovis_pgrep_free(ovis_pgrep_array_t a)
 	}
 	free(a);
 }
+
+int ovis_cpulist_parse(const char *s, cpu_set_t *set)
+{
+	unsigned long a, b;
+	char *end;
+
+	CPU_ZERO(set);
+	while (*s) {
+		a = b = strtoul(s, &end, 0);
+		if (end == s)
+			return EINVAL;
+		if (*end == '-') {
+			s = end + 1;
+			b = strtoul(s, &end, 0);
+			if (end == s)
+				return EINVAL;
+		}
+		if (a > b || b >= CPU_SETSIZE)
+			return EINVAL;
+		for (; a <= b; a++)
+			CPU_SET(a, set);
+		s = end;
+		if (*s == ',' && s[1])
+			s++;
+		else if (*s)
+			return EINVAL;
+	}
+	return CPU_COUNT(set) ? 0 : EINVAL;
+}
+
+void ovis_cpulist_str(cpu_set_t *set, char *buf, size_t len)
+{
+	int a, b, n;
+	size_t off = 0;
+
+	buf[0] = '\0';
+	for (a = 0; a < CPU_SETSIZE; a = b + 1) {
+		if (!CPU_ISSET(a, set)) {
+			b = a;
+			continue;
+		}
+		for (b = a; b + 1 < CPU_SETSIZE && CPU_ISSET(b + 1, set); b++)
+			;
+		if (a == b)
+			n = snprintf(buf + off, len - off, "%s%d",
+				     off ? "," : "", a);
+		else
+			n = snprintf(buf + off, len - off, "%s%d-%d",
+				     off ? "," : "", a, b);
+		if (n < 0 || n >= len - off)
+			return;
+		off += n;
+	}
+}
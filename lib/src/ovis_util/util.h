@@ -58,6 +58,7 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <sys/queue.h>
+#include <sched.h>
 #include "ovis-lib-config.h"
 
 /*
@@ -370,4 +371,23 @@ ovis_pgrep_array_t ovis_pgrep(const char *text);
  */
 void ovis_pgrep_free(ovis_pgrep_array_t array);
 
+#ifdef CPU_SETSIZE
+/**
+ * \brief Parse a list of ranges such as "0-3,8" into \c set.
+ *
+ * The list names CPUs or, for memory policies, NUMA nodes.
+ *
+ * \retval 0      If the list is valid and names at least one entry.
+ * \retval EINVAL If it is not.
+ */
+int ovis_cpulist_parse(const char *s, cpu_set_t *set);
+
+/**
+ * \brief Format \c set as a list of ranges, e.g. "0-3,8".
+ *
+ * The list is truncated at the last range that fits in \c buf.
+ */
+void ovis_cpulist_str(cpu_set_t *set, char *buf, size_t len);
+#endif
+
 #endif /* OVIS_UTIL_H_ */
@@ -2096,6 +2096,7 @@ static int init_once()
 	rc = pthread_create(&cq_thread, NULL, cq_thread_proc, NULL);
 	if (rc)
 		goto err_2;
+	zap_thread_register(cq_thread, ZAP_THREAD_IO);
 
 	rc = pthread_create(&cm_thread, NULL, cm_thread_proc, NULL);
 	if (rc)
@@ -2159,6 +2159,7 @@ static int init_once()
 			    (void *)(unsigned long)cq_fd);
 	if (rc)
 		goto err_2;
+	zap_thread_register(cq_thread, ZAP_THREAD_IO);
 
 	/*
 	 * Create the CM event thread that will wait for events on
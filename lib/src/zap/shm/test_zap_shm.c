@@ -0,0 +1,294 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Loopback test of the shm transport: a listener and a client in one
+ * process connect, exchange a message, and the client reads two maps
+ * shared by the server, one in the shared heap (mapped by the peer) and
+ * one outside it (read through the rings), then disconnects.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include "zap.h"
+
+#define HEAP_SZ		(1024 * 1024)
+#define BUF_SZ		(64 * 1024)
+#define TIMEOUT_SEC	10
+
+static struct zap_mem_info heap_info = { .fd = -1 };
+static char *heap;			/* shared heap, the server's buffer */
+static char priv_buf[BUF_SZ];		/* outside the heap */
+static char dst[2][BUF_SZ];		/* the client's read buffers */
+static zap_map_t dst_map[2];
+static zap_map_t src_map[2];
+
+static sem_t done_sem;
+static int recv_ok, reads_ok, disconnects, errors;
+
+static void test_log(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static zap_mem_info_t test_mem_info(void)
+{
+	return &heap_info;
+}
+
+static void fail(const char *what, int rc)
+{
+	fprintf(stderr, "test_zap_shm: %s: %d\n", what, rc);
+	__sync_add_and_fetch(&errors, 1);
+	sem_post(&done_sem);
+}
+
+static void fill(char *p, size_t len, int seed)
+{
+	size_t i;
+	for (i = 0; i < len; i++)
+		p[i] = (char)(i * 7 + seed);
+}
+
+static void server_cb(zap_ep_t ep, zap_event_t ev)
+{
+	static char msg[] = "ping";
+	zap_err_t zerr;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECT_REQUEST:
+		zerr = zap_accept(ep, server_cb, NULL, 0);
+		if (zerr)
+			fail("zap_accept", zerr);
+		break;
+	case ZAP_EVENT_CONNECTED:
+		zerr = zap_map(ep, &src_map[0], heap, BUF_SZ, ZAP_ACCESS_READ);
+		if (!zerr)
+			zerr = zap_share(ep, src_map[0], "0", 2);
+		if (!zerr)
+			zerr = zap_map(ep, &src_map[1], priv_buf, BUF_SZ,
+				       ZAP_ACCESS_READ);
+		if (!zerr)
+			zerr = zap_share(ep, src_map[1], "1", 2);
+		if (!zerr)
+			zerr = zap_send(ep, msg, sizeof(msg));
+		if (zerr)
+			fail("server share/send", zerr);
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		zap_unmap(ep, src_map[0]);
+		zap_unmap(ep, src_map[1]);
+		__sync_add_and_fetch(&disconnects, 1);
+		sem_post(&done_sem);
+		zap_free(ep);
+		break;
+	default:
+		break;
+	}
+}
+
+static void client_cb(zap_ep_t ep, zap_event_t ev)
+{
+	zap_err_t zerr;
+	int i;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECTED:
+		break;
+	case ZAP_EVENT_RECV_COMPLETE:
+		if (ev->data_len == 5 && 0 == strcmp((char *)ev->data, "ping"))
+			recv_ok = 1;
+		else
+			fail("unexpected message", (int)ev->data_len);
+		sem_post(&done_sem);
+		break;
+	case ZAP_EVENT_RENDEZVOUS:
+		i = ev->data[0] - '0';
+		if (i < 0 || i > 1) {
+			fail("unexpected rendezvous", i);
+			break;
+		}
+		zerr = zap_map(ep, &dst_map[i], dst[i], BUF_SZ,
+			       ZAP_ACCESS_NONE);
+		if (!zerr)
+			zerr = zap_read(ep, ev->map, zap_map_addr(ev->map),
+					dst_map[i], dst[i], BUF_SZ,
+					(void *)(long)i);
+		if (zerr)
+			fail("zap_read", zerr);
+		break;
+	case ZAP_EVENT_READ_COMPLETE:
+		i = (int)(long)ev->context;
+		if (ev->status)
+			fail("read completion", ev->status);
+		else if (memcmp(dst[i], i ? priv_buf : heap, BUF_SZ))
+			fail("read data mismatch", i);
+		else
+			__sync_add_and_fetch(&reads_ok, 1);
+		sem_post(&done_sem);
+		break;
+	case ZAP_EVENT_CONNECT_ERROR:
+	case ZAP_EVENT_REJECTED:
+		fail("connect", ev->type);
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		__sync_add_and_fetch(&disconnects, 1);
+		sem_post(&done_sem);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Wait until cond() holds; 0 on time out or error */
+static int wait_for(int (*cond)(void))
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += TIMEOUT_SEC;
+	while (!cond()) {
+		if (errors)
+			return 0;
+		if (sem_timedwait(&done_sem, &ts) && errno == ETIMEDOUT)
+			return cond();
+	}
+	return 1;
+}
+
+static int exchanged(void)
+{
+	return recv_ok && reads_ok == 2;
+}
+
+static int disconnected(void)
+{
+	return disconnects == 2;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	zap_ep_t listen_ep, ep;
+	zap_err_t zerr;
+	zap_t z;
+	int fd;
+
+	sem_init(&done_sem, 0, 0);
+	fd = memfd_create("test_zap_shm", MFD_CLOEXEC);
+	if (fd < 0 || ftruncate(fd, HEAP_SZ)) {
+		perror("memfd");
+		return 1;
+	}
+	heap = mmap(NULL, HEAP_SZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (heap == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	heap_info.start = heap;
+	heap_info.len = HEAP_SZ;
+	heap_info.fd = fd;
+	fill(heap, BUF_SZ, 1);
+	fill(priv_buf, BUF_SZ, 2);
+
+	z = zap_get("shm", test_log, test_mem_info);
+	if (!z) {
+		fprintf(stderr, "test_zap_shm: cannot load the shm transport\n");
+		return 1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(20000 + getpid() % 20000);
+
+	listen_ep = zap_new(z, server_cb);
+	if (!listen_ep)
+		return 1;
+	zerr = zap_listen(listen_ep, (void *)&sin, sizeof(sin));
+	if (zerr) {
+		fprintf(stderr, "test_zap_shm: zap_listen: %s\n",
+			zap_err_str(zerr));
+		return 1;
+	}
+	ep = zap_new(z, client_cb);
+	if (!ep)
+		return 1;
+	zerr = zap_connect(ep, (void *)&sin, sizeof(sin), NULL, 0);
+	if (zerr) {
+		fprintf(stderr, "test_zap_shm: zap_connect: %s\n",
+			zap_err_str(zerr));
+		return 1;
+	}
+	if (!wait_for(exchanged)) {
+		fprintf(stderr, "test_zap_shm: message %s, %d of 2 reads\n",
+			recv_ok ? "received" : "not received", reads_ok);
+		return 1;
+	}
+	zap_close(ep);
+	if (!wait_for(disconnected)) {
+		fprintf(stderr, "test_zap_shm: %d of 2 endpoints "
+			"disconnected\n", disconnects);
+		return 1;
+	}
+	zap_unmap(ep, dst_map[0]);
+	zap_unmap(ep, dst_map[1]);
+	zap_free(ep);
+	zap_close(listen_ep);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,1814 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <signal.h>
+#include "coll/rbt.h"
+#include "ovis_event/ovis_event.h"
+
+#include "zap_shm.h"
+
+#define LOG_(sep, ...) do { \
+	if ((sep) && (sep)->ep.z && (sep)->ep.z->log_fn) \
+		(sep)->ep.z->log_fn(__VA_ARGS__); \
+} while(0);
+
+/* Ring records start on an 8-byte boundary */
+#define SHM_ALIGN(x) (((x) + 7) & ~((size_t)7))
+
+/* Largest control socket message (connect data) */
+#define SHM_CTRL_MAX 65536
+
+static int init_complete = 0;
+
+static pthread_t io_thread;
+
+static ovis_scheduler_t sched;
+
+static void *io_thread_proc(void *arg);
+
+static void shm_sock_cb(ovis_event_t ev);
+static void shm_bell_cb(ovis_event_t ev);
+static void shm_disconnect(struct z_shm_ep *sep);
+static void __ring_drain(struct z_shm_ep *sep);
+
+static zap_err_t __shm_send_msg(struct z_shm_ep *sep, struct shm_msg_hdr *m,
+				size_t msg_size,
+				const char *data, size_t data_len);
+
+static zap_err_t __shm_send_msg_nolock(struct z_shm_ep *sep,
+				       struct shm_msg_hdr *m,
+				       size_t msg_size,
+				       const char *data, size_t data_len);
+
+static uint32_t z_last_key;
+static struct rbt z_key_tree;
+static pthread_mutex_t z_key_tree_mutex;
+
+static LIST_HEAD(, z_shm_ep) z_shm_list = LIST_HEAD_INITIALIZER(0);
+static pthread_mutex_t z_shm_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The read-only fd of our heap handed to the peers, looked up once from
+ * the mem_info_fn() of the first endpoint that needs it.
+ */
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int heap_checked;
+static int heap_fd = -1;
+static uint64_t heap_addr;
+static uint64_t heap_len;
+
+static int z_rbn_cmp(void *a, const void *b)
+{
+	uint32_t x = (uint32_t)(uint64_t)a;
+	uint32_t y = (uint32_t)(uint64_t)b;
+	return x - y;
+}
+
+static struct z_shm_key *z_key_alloc(struct zap_shm_map *map)
+{
+	struct z_shm_key *key = calloc(1, sizeof(*key));
+	if (!key)
+		return NULL;
+	key->map = map;
+	pthread_mutex_lock(&z_key_tree_mutex);
+	key->rb_node.key = (void*)(uint64_t)(++z_last_key);
+	rbt_ins(&z_key_tree, &key->rb_node);
+	pthread_mutex_unlock(&z_key_tree_mutex);
+	return key;
+}
+
+/* Caller must hold the z_key_tree_mutex lock. */
+static struct z_shm_key *z_shm_key_find(uint32_t key)
+{
+	struct rbn *krbn = rbt_find(&z_key_tree, (void*)(uint64_t)key);
+	if (!krbn)
+		return NULL;
+	return container_of(krbn, struct z_shm_key, rb_node);
+}
+
+static void z_key_delete(uint32_t key)
+{
+	struct z_shm_key *k;
+	pthread_mutex_lock(&z_key_tree_mutex);
+	k = z_shm_key_find(key);
+	if (!k)
+		goto out;
+	rbt_del(&z_key_tree, &k->rb_node);
+	free(k);
+out:
+	pthread_mutex_unlock(&z_key_tree_mutex);
+}
+
+/* The Caller must hold the z_key_tree_mutex lock. */
+static int z_shm_map_key_access_validate(uint32_t key, char *p, size_t sz,
+					 zap_access_t acc)
+{
+	struct z_shm_key *k = z_shm_key_find(key);
+	if (!k)
+		return ENOENT;
+	return z_map_access_validate((zap_map_t)k->map, p, sz, acc);
+}
+
+static uint16_t __acc_status(int rc)
+{
+	switch (rc) {
+	case 0:
+		return ZAP_ERR_OK;
+	case EACCES:
+		return ZAP_ERR_REMOTE_PERMISSION;
+	case ERANGE:
+		return ZAP_ERR_REMOTE_LEN;
+	case ENOENT:
+		return ZAP_ERR_REMOTE_MAP;
+	default:
+		return ZAP_ERR_PARAMETER;
+	}
+}
+
+static uint32_t g_xid = 0;
+static void z_shm_hdr_init(struct shm_msg_hdr *hdr, uint32_t xid,
+			   uint16_t type, uint64_t ctxt)
+{
+	if (!xid)
+		hdr->xid = __sync_add_and_fetch(&g_xid, 1);
+	else
+		hdr->xid = xid;
+	hdr->reserved = 0;
+	hdr->status = 0;
+	hdr->msg_type = type;
+	hdr->msg_len = 0; /* set when sent */
+	hdr->ctxt = ctxt;
+}
+
+/*
+ * Look up the heap we can share. The heap fd is reopened read-only
+ * through /proc so that the peer cannot map it writable.
+ */
+static void __heap_get(struct z_shm_ep *sep)
+{
+	zap_mem_info_t mi;
+	struct stat st;
+	char path[64];
+	int fd;
+
+	pthread_mutex_lock(&heap_mutex);
+	if (heap_checked)
+		goto out;
+	heap_checked = 1;
+	if (!sep->ep.z->mem_info_fn)
+		goto out;
+	mi = sep->ep.z->mem_info_fn();
+	if (!mi || mi->fd < 0)
+		goto out;
+	if (fstat(mi->fd, &st) || st.st_size < mi->len)
+		goto out;
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", mi->fd);
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0) {
+		LOG_(sep, "zap_shm: cannot reopen the heap fd, error %d. "
+			  "Reads will go through the rings.\n", errno);
+		goto out;
+	}
+	heap_fd = fd;
+	heap_addr = (uint64_t)mi->start;
+	heap_len = mi->len;
+ out:
+	pthread_mutex_unlock(&heap_mutex);
+}
+
+/* Map the heap of the peer, advertised in \c msg, read-only */
+static int __peer_heap_map(struct z_shm_ep *sep, struct shm_msg_conn *msg,
+			   int fd)
+{
+	struct stat st;
+	void *p;
+
+	if (!msg->heap_len || fd < 0)
+		return 0;
+	if (fstat(fd, &st) || st.st_size < msg->heap_len)
+		return EINVAL;
+	p = mmap(NULL, msg->heap_len, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return errno;
+	sep->peer_heap = p;
+	sep->peer_heap_addr = msg->heap_addr;
+	sep->peer_heap_len = msg->heap_len;
+	return 0;
+}
+
+static void __seg_setup(struct z_shm_ep *sep)
+{
+	char *data = (char *)(sep->seg + 1);
+	sep->ring_sz = sep->seg->ring_sz;
+	if (sep->active) {
+		sep->tx = &sep->seg->ring[0];
+		sep->rx = &sep->seg->ring[1];
+		sep->tx_data = data;
+		sep->rx_data = data + sep->ring_sz;
+	} else {
+		sep->tx = &sep->seg->ring[1];
+		sep->rx = &sep->seg->ring[0];
+		sep->tx_data = data + sep->ring_sz;
+		sep->rx_data = data;
+	}
+}
+
+/* Create the connection segment (active side). Returns the memfd. */
+static int __seg_create(struct z_shm_ep *sep)
+{
+	size_t sz = sizeof(struct shm_seg) + 2 * ZAP_SHM_RING_SZ;
+	void *p;
+	int fd;
+
+	fd = memfd_create("zap_shm", MFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, sz))
+		goto err;
+	p = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto err;
+	sep->seg = p;
+	sep->seg_sz = sz;
+	sep->seg->magic = ZAP_SHM_SEG_MAGIC;
+	sep->seg->ring_sz = ZAP_SHM_RING_SZ;
+	/* Nobody is consuming yet, the first message rings the bell */
+	sep->seg->ring[0].waiting = 1;
+	sep->seg->ring[1].waiting = 1;
+	__seg_setup(sep);
+	return fd;
+ err:
+	close(fd);
+	return -1;
+}
+
+/* Map the connection segment created by the peer (passive side) */
+static int __seg_attach(struct z_shm_ep *sep, int fd)
+{
+	struct shm_seg *seg;
+	struct stat st;
+	uint32_t ring_sz;
+	void *p;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(*seg))
+		return EINVAL;
+	p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return errno;
+	seg = p;
+	ring_sz = seg->ring_sz;
+	if (seg->magic != ZAP_SHM_SEG_MAGIC || !ring_sz ||
+	    (ring_sz & (ring_sz - 1)) ||
+	    st.st_size != sizeof(*seg) + 2 * (size_t)ring_sz) {
+		munmap(p, st.st_size);
+		return EINVAL;
+	}
+	sep->seg = seg;
+	sep->seg_sz = st.st_size;
+	__seg_setup(sep);
+	return 0;
+}
+
+/*
+ * Append a message to the tx ring. If the record does not fit before
+ * the end of the ring, the rest of the ring is skipped with a PAD
+ * record (or implicitly, when there is not room for a header).
+ *
+ * Caller must hold sep->ep.lock.
+ */
+static int __ring_put(struct z_shm_ep *sep, const void *msg, size_t msg_sz,
+		      const void *data, size_t data_len)
+{
+	struct shm_ring *r = sep->tx;
+	uint64_t head = r->head;
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t len = SHM_ALIGN(msg_sz + data_len);
+	size_t off = head & (sep->ring_sz - 1);
+	size_t contig = sep->ring_sz - off;
+	size_t need = len;
+	char *p;
+
+	if (contig < len)
+		need += contig;
+	if (sep->ring_sz - (head - tail) < need)
+		return EAGAIN;
+	if (contig < len) {
+		if (contig >= sizeof(struct shm_msg_hdr)) {
+			struct shm_msg_hdr *pad = (void*)(sep->tx_data + off);
+			pad->msg_len = contig;
+			pad->msg_type = SHM_MSG_PAD;
+		}
+		head += contig;
+		off = 0;
+	}
+	p = sep->tx_data + off;
+	memcpy(p, msg, msg_sz);
+	if (data_len)
+		memcpy(p + msg_sz, data, data_len);
+	__atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Wake up the consumer if it went to sleep on an empty ring */
+static void __ring_kick(struct z_shm_ep *sep)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&sep->tx->waiting, 0, __ATOMIC_SEQ_CST))
+		eventfd_write(sep->peer_bell, 1);
+}
+
+/*
+ * Move the messages queued while the tx ring was full into the ring.
+ *
+ * Caller must hold sep->ep.lock.
+ */
+static void __sq_flush(struct z_shm_ep *sep)
+{
+	struct z_shm_send_wr *wr;
+	int kick = 0;
+
+	while ((wr = TAILQ_FIRST(&sep->sq))) {
+		if (__ring_put(sep, wr->msg, wr->len, NULL, 0))
+			break;
+		TAILQ_REMOVE(&sep->sq, wr, link);
+		free(wr);
+		kick = 1;
+	}
+	if (kick)
+		__ring_kick(sep);
+}
+
+static zap_err_t __shm_send_msg_nolock(struct z_shm_ep *sep,
+				       struct shm_msg_hdr *m,
+				       size_t msg_size,
+				       const char *data, size_t data_len)
+{
+	struct z_shm_send_wr *wr;
+	size_t len = msg_size + data_len;
+
+	/* A record of at most half the ring always fits an empty ring */
+	if (SHM_ALIGN(len) > sep->ring_sz / 2)
+		return ZAP_ERR_NO_SPACE;
+	m->msg_len = len;
+	if (TAILQ_EMPTY(&sep->sq) &&
+	    0 == __ring_put(sep, m, msg_size, data, data_len)) {
+		__ring_kick(sep);
+		return ZAP_ERR_OK;
+	}
+
+	/* The ring is full, the peer rings our bell when it has room */
+	wr = malloc(sizeof(*wr) + len);
+	if (!wr)
+		return ZAP_ERR_RESOURCE;
+	wr->len = len;
+	memcpy(wr->msg, m, msg_size);
+	if (data_len)
+		memcpy(wr->msg + msg_size, data, data_len);
+	TAILQ_INSERT_TAIL(&sep->sq, wr, link);
+	__atomic_store_n(&sep->tx->blocked, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	__sq_flush(sep);
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t __shm_send_msg(struct z_shm_ep *sep, struct shm_msg_hdr *m,
+				size_t msg_size,
+				const char *data, size_t data_len)
+{
+	zap_err_t zerr;
+	pthread_mutex_lock(&sep->ep.lock);
+	zerr = __shm_send_msg_nolock(sep, m, msg_size, data, data_len);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+/* Send a control message on the socket, passing \c fds along */
+static int __ctrl_send(struct z_shm_ep *sep, struct shm_msg_hdr *m,
+		       size_t msg_size, int *fds, int nfds)
+{
+	struct msghdr mh = {0};
+	struct iovec iov = { .iov_base = m, .iov_len = msg_size };
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	struct cmsghdr *cmsg;
+	ssize_t rc;
+
+	m->msg_len = msg_size;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (nfds) {
+		memset(cbuf, 0, sizeof(cbuf));
+		mh.msg_control = cbuf;
+		mh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+	}
+	rc = sendmsg(sep->sock, &mh, MSG_NOSIGNAL);
+	if (rc < 0)
+		return errno;
+	return 0;
+}
+
+static zap_err_t __ctrl_send_conn(struct z_shm_ep *sep, uint16_t msg_type,
+				  const char *data, size_t data_len,
+				  int *fds, int nfds)
+{
+	struct shm_msg_conn *msg;
+	size_t msg_size = sizeof(*msg) + data_len;
+	int rc;
+
+	if (msg_size > SHM_CTRL_MAX)
+		return ZAP_ERR_NO_SPACE;
+	msg = calloc(1, msg_size);
+	if (!msg)
+		return ZAP_ERR_RESOURCE;
+	z_shm_hdr_init(&msg->hdr, 0, msg_type, 0);
+	ZAP_VERSION_SET(msg->ver);
+	memcpy(msg->sig, ZAP_SHM_SIG, sizeof(msg->sig));
+	if (msg_type != SHM_MSG_REJECTED && heap_fd >= 0) {
+		msg->heap_addr = heap_addr;
+		msg->heap_len = heap_len;
+		fds[nfds++] = heap_fd;
+	}
+	if (msg_type == SHM_MSG_CONNECT)
+		msg->ring_sz = sep->ring_sz;
+	msg->data_len = data_len;
+	if (data_len)
+		memcpy(msg->data, data, data_len);
+	rc = __ctrl_send(sep, &msg->hdr, msg_size, fds, nfds);
+	free(msg);
+	return rc ? zap_errno2zerr(rc) : ZAP_ERR_OK;
+}
+
+static int __bell_add(struct z_shm_ep *sep)
+{
+	int rc;
+	OVIS_EVENT_INIT(&sep->bell_ev);
+	sep->bell_ev.param.type = OVIS_EVENT_EPOLL;
+	sep->bell_ev.param.fd = sep->bell;
+	sep->bell_ev.param.epoll_events = EPOLLIN;
+	sep->bell_ev.param.cb_fn = shm_bell_cb;
+	sep->bell_ev.param.ctxt = sep;
+	rc = ovis_scheduler_event_add(sched, &sep->bell_ev);
+	if (!rc)
+		sep->bell_added = 1;
+	return rc;
+}
+
+static zap_err_t z_shm_close(zap_ep_t ep)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	switch (sep->ep.state) {
+	case ZAP_EP_PEER_CLOSE:
+	case ZAP_EP_CONNECTED:
+	case ZAP_EP_LISTENING:
+		sep->ep.state = ZAP_EP_CLOSE;
+		shutdown(sep->sock, SHUT_RDWR);
+		break;
+	case ZAP_EP_ERROR:
+	case ZAP_EP_ACCEPTING:
+	case ZAP_EP_CONNECTING:
+		shutdown(sep->sock, SHUT_RDWR);
+		break;
+	case ZAP_EP_CLOSE:
+		break;
+	default:
+		ZAP_ASSERT(0, ep, "%s: Unexpected state '%s'\n",
+				__func__, __zap_ep_state_str(ep->state));
+		break;
+	}
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+}
+
+/*
+ * Both ends are on this host. Report the loopback address and the
+ * port the passive side listens on.
+ */
+static zap_err_t z_get_name(zap_ep_t ep, struct sockaddr *local_sa,
+			    struct sockaddr *remote_sa, socklen_t *sa_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct sockaddr_in *lsin = (void*)local_sa;
+	struct sockaddr_in *rsin = (void*)remote_sa;
+
+	memset(lsin, 0, sizeof(*lsin));
+	memset(rsin, 0, sizeof(*rsin));
+	lsin->sin_family = rsin->sin_family = AF_INET;
+	lsin->sin_addr.s_addr = rsin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (sep->active)
+		rsin->sin_port = htons(sep->port);
+	else
+		lsin->sin_port = htons(sep->port);
+	*sa_len = sizeof(struct sockaddr_in);
+	return ZAP_ERR_OK;
+}
+
+/* Translate the IP address to the listening socket name */
+static int __shm_sun(struct sockaddr *sa, socklen_t sa_len,
+		     struct sockaddr_un *sun, socklen_t *sun_len,
+		     uint16_t *port)
+{
+	int n;
+
+	switch (sa->sa_family) {
+	case AF_INET:
+		if (sa_len < sizeof(struct sockaddr_in))
+			return EINVAL;
+		*port = ntohs(((struct sockaddr_in *)sa)->sin_port);
+		break;
+	case AF_INET6:
+		if (sa_len < sizeof(struct sockaddr_in6))
+			return EINVAL;
+		*port = ntohs(((struct sockaddr_in6 *)sa)->sin6_port);
+		break;
+	default:
+		return EAFNOSUPPORT;
+	}
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	/* abstract namespace: sun_path[0] is '\0' */
+	n = snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1,
+		     ZAP_SHM_SUN_PREFIX "%hu", *port);
+	*sun_len = offsetof(struct sockaddr_un, sun_path) + 1 + n;
+	return 0;
+}
+
+/* bind() only succeeds with an address of this host */
+static int __addr_is_local(struct sockaddr *sa, socklen_t sa_len)
+{
+	struct sockaddr_storage ss;
+	int fd, rc;
+
+	if (sa_len > sizeof(ss))
+		return 0;
+	memcpy(&ss, sa, sa_len);
+	if (ss.ss_family == AF_INET)
+		((struct sockaddr_in *)&ss)->sin_port = 0;
+	else if (ss.ss_family == AF_INET6)
+		((struct sockaddr_in6 *)&ss)->sin6_port = 0;
+	else
+		return 0;
+	fd = socket(ss.ss_family, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return 0;
+	rc = bind(fd, (struct sockaddr *)&ss, sa_len);
+	close(fd);
+	return rc == 0;
+}
+
+static zap_err_t z_shm_connect(zap_ep_t ep,
+			       struct sockaddr *sa, socklen_t sa_len,
+			       char *data, size_t data_len)
+{
+	int rc;
+	zap_err_t zerr;
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct sockaddr_un sun;
+	socklen_t sun_len;
+
+	if (!__addr_is_local(sa, sa_len))
+		return ZAP_ERR_ADDRESS;
+	rc = __shm_sun(sa, sa_len, &sun, &sun_len, &sep->port);
+	if (rc)
+		return ZAP_ERR_ADDRESS;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_INIT, ZAP_EP_CONNECTING);
+	if (zerr)
+		goto err1;
+	sep->active = 1;
+
+	sep->sock = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (sep->sock == -1) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err1;
+	}
+
+	if (data_len) {
+		sep->conn_data = malloc(data_len);
+		if (sep->conn_data)
+			memcpy(sep->conn_data, data, data_len);
+		else {
+			zerr = ZAP_ERR_RESOURCE;
+			goto err1;
+		}
+		sep->conn_data_len = data_len;
+	}
+
+	rc = connect(sep->sock, (struct sockaddr *)&sun, sun_len);
+	if (rc && errno != EINPROGRESS && errno != EAGAIN) {
+		zerr = zap_errno2zerr(errno);
+		goto err2;
+	}
+
+	zap_get_ep(&sep->ep); /* Release when disconnect */
+
+	OVIS_EVENT_INIT(&sep->sock_ev);
+	sep->sock_ev.param.type = OVIS_EVENT_EPOLL;
+	sep->sock_ev.param.cb_fn = shm_sock_cb;
+	sep->sock_ev.param.ctxt = sep;
+	sep->sock_ev.param.fd = sep->sock;
+	sep->sock_ev.param.epoll_events = EPOLLIN|EPOLLOUT;
+	rc = ovis_scheduler_event_add(sched, &sep->sock_ev);
+	if (rc) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err3;
+	}
+	return ZAP_ERR_OK;
+
+ err3:
+	zap_put_ep(&sep->ep);
+ err2:
+	free(sep->conn_data);
+	sep->conn_data = NULL;
+	sep->conn_data_len = 0;
+ err1:
+	return zerr;
+}
+
+/* Only peers running as us or as root get to read our heap */
+static int __peer_cred_check(struct z_shm_ep *sep)
+{
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+	int rc;
+
+	rc = getsockopt(sep->sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len);
+	if (rc || (cred.uid != geteuid() && cred.uid != 0)) {
+		LOG_(sep, "zap_shm: connection with uid %d refused\n",
+		     rc ? -1 : (int)cred.uid);
+		return EPERM;
+	}
+	return 0;
+}
+
+/*
+ * The socket is connected (active side). Create the segment and the
+ * doorbell and send them to the peer with the connect data.
+ */
+static void shm_connect(struct z_shm_ep *sep)
+{
+	int err = 0, seg_fd;
+	socklen_t err_len = sizeof(err);
+	int fds[3];
+	zap_err_t zerr;
+
+	getsockopt(sep->sock, SOL_SOCKET, SO_ERROR, &err, &err_len);
+	if (err)
+		return; /* the EPOLLERR/EPOLLHUP handling takes it from here */
+	ovis_scheduler_epoll_event_mod(sched, &sep->sock_ev, EPOLLIN);
+	if (__peer_cred_check(sep))
+		goto err;
+
+	__heap_get(sep);
+	seg_fd = __seg_create(sep);
+	if (seg_fd < 0) {
+		LOG_(sep, "zap_shm: cannot create the connection segment, "
+			  "error %d\n", errno);
+		goto err;
+	}
+	sep->bell = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (sep->bell < 0) {
+		close(seg_fd);
+		goto err;
+	}
+	fds[0] = seg_fd;
+	fds[1] = sep->bell;
+	zerr = __ctrl_send_conn(sep, SHM_MSG_CONNECT, sep->conn_data,
+				sep->conn_data_len, fds, 2);
+	close(seg_fd);
+	free(sep->conn_data);
+	sep->conn_data = NULL;
+	sep->conn_data_len = 0;
+	if (zerr)
+		goto err;
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+/* Pop the io matching the response \c hdr from the io_q */
+static struct z_shm_io *__io_pop(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct z_shm_io *io;
+	pthread_mutex_lock(&sep->ep.lock);
+	io = TAILQ_FIRST(&sep->io_q);
+	ZAP_ASSERT(io, (&sep->ep), "%s: The io_q is empty.\n", __func__);
+	ZAP_ASSERT(hdr->xid == io->xid, (&sep->ep),
+			"%s: The transaction IDs mismatched between the "
+			"IO entry %d and message %d.\n", __func__,
+			io->xid, hdr->xid);
+	TAILQ_REMOVE(&sep->io_q, io, q_link);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return io;
+}
+
+/*
+ * Control socket messages. \c fds holds the received file descriptors;
+ * a handler that keeps one sets its slot to -1.
+ */
+
+static void process_ctrl_connect(struct z_shm_ep *sep, struct shm_msg_conn *msg,
+				 size_t len, int *fds, int nfds)
+{
+	int rc;
+
+	if (!zap_version_check(&msg->ver)) {
+		LOG_(sep, "Connection request from an unsupported Zap version "
+				"%hhu.%hhu.%hhu.%hhu\n",
+				msg->ver.major, msg->ver.minor,
+				msg->ver.patch, msg->ver.flags);
+		goto err;
+	}
+	if (memcmp(msg->sig, ZAP_SHM_SIG, sizeof(msg->sig))) {
+		LOG_(sep, "Expecting sig '%s', but got '%.*s'.\n",
+				ZAP_SHM_SIG, (int)sizeof(msg->sig), msg->sig);
+		goto err;
+	}
+	if (nfds < 2) {
+		LOG_(sep, "zap_shm: connect request without segment\n");
+		goto err;
+	}
+	rc = __seg_attach(sep, fds[0]);
+	if (rc) {
+		LOG_(sep, "zap_shm: cannot map the connection segment, "
+			  "error %d\n", rc);
+		goto err;
+	}
+	sep->peer_bell = fds[1];
+	fds[1] = -1;
+	rc = __peer_heap_map(sep, msg, nfds > 2 ? fds[2] : -1);
+	if (rc)
+		LOG_(sep, "zap_shm: cannot map the peer heap, error %d. "
+			  "Reads will go through the rings.\n", rc);
+	sep->bell = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (sep->bell < 0)
+		goto err;
+	__heap_get(sep);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_CONNECT_REQUEST,
+		.data = (void*)msg->data,
+		.data_len = msg->data_len,
+	};
+	sep->ep.cb(&sep->ep, &ev);
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_accepted(struct z_shm_ep *sep, struct shm_msg_conn *msg,
+				  size_t len, int *fds, int nfds)
+{
+	struct shm_msg_hdr ack;
+	struct zap_event ev;
+	zap_err_t zerr;
+	int rc;
+
+	if (nfds < 1) {
+		LOG_(sep, "zap_shm: 'Accept' message without doorbell\n");
+		goto err;
+	}
+	sep->peer_bell = fds[0];
+	fds[0] = -1;
+	rc = __peer_heap_map(sep, msg, nfds > 1 ? fds[1] : -1);
+	if (rc)
+		LOG_(sep, "zap_shm: cannot map the peer heap, error %d. "
+			  "Reads will go through the rings.\n", rc);
+
+	z_shm_hdr_init(&ack, 0, SHM_MSG_ACK_ACCEPTED, 0);
+	pthread_mutex_lock(&sep->ep.lock);
+	rc = __ctrl_send(sep, &ack, sizeof(ack), NULL, 0);
+	if (!rc)
+		rc = __bell_add(sep);
+	pthread_mutex_unlock(&sep->ep.lock);
+	if (rc)
+		goto err;
+
+	ev.type = ZAP_EVENT_CONNECTED;
+	ev.status = ZAP_ERR_OK;
+	ev.data = (void*)msg->data;
+	ev.data_len = msg->data_len;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_CONNECTING, ZAP_EP_CONNECTED);
+	if (zerr != ZAP_ERR_OK) {
+		LOG_(sep, "'Accept' message received in unexpected state %d.\n",
+				sep->ep.state);
+		goto err;
+	}
+	sep->ep.cb((void*)sep, &ev);
+	return;
+err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_rejected(struct z_shm_ep *sep, struct shm_msg_conn *msg,
+				  size_t len, int *fds, int nfds)
+{
+	zap_err_t zerr;
+	struct zap_event ev;
+
+	ev.type = ZAP_EVENT_REJECTED;
+	ev.status = ZAP_ERR_OK;
+	ev.data = (void*)msg->data;
+	ev.data_len = msg->data_len;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_CONNECTING, ZAP_EP_ERROR);
+	if (zerr != ZAP_ERR_OK) {
+		LOG_(sep, "'reject' message received in unexpected state %d.\n",
+				sep->ep.state);
+		return;
+	}
+
+	sep->ep.cb((void*)sep, &ev);
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_ack_accepted(struct z_shm_ep *sep,
+				      struct shm_msg_conn *msg,
+				      size_t len, int *fds, int nfds)
+{
+	zap_err_t zerr;
+	int rc;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_ACCEPTING, ZAP_EP_CONNECTED);
+	if (zerr != ZAP_ERR_OK) {
+		LOG_(sep, "'Acknowledged' message received in unexpected state %d.\n",
+				sep->ep.state);
+		shutdown(sep->sock, SHUT_RDWR);
+		return;
+	}
+	pthread_mutex_lock(&sep->ep.lock);
+	rc = __bell_add(sep);
+	pthread_mutex_unlock(&sep->ep.lock);
+	if (rc) {
+		LOG_(sep, "zap_shm: ovis_scheduler_event_add() error %d\n", rc);
+		shutdown(sep->sock, SHUT_RDWR);
+	}
+	struct zap_event ev = {
+		.type = ZAP_EVENT_CONNECTED,
+		.status = ZAP_ERR_OK,
+	};
+	zap_get_ep(&sep->ep); /* Release when receive disconnect/error event. */
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+typedef void (*process_ctrl_fn_t)(struct z_shm_ep *, struct shm_msg_conn *,
+				  size_t, int *, int);
+static process_ctrl_fn_t process_ctrl_fns[SHM_MSG_ACK_ACCEPTED + 1] = {
+	[SHM_MSG_CONNECT] = process_ctrl_connect,
+	[SHM_MSG_ACCEPTED] = process_ctrl_accepted,
+	[SHM_MSG_REJECTED] = process_ctrl_rejected,
+	[SHM_MSG_ACK_ACCEPTED] = process_ctrl_ack_accepted,
+};
+
+/*
+ * Read one control message.
+ *
+ * \retval 0 if the socket is still up.
+ * \retval 1 on EOF or error.
+ */
+static int shm_ctrl_read(struct z_shm_ep *sep)
+{
+	struct msghdr mh = {0};
+	struct iovec iov;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct shm_msg_conn *msg;
+	int fds[3];
+	int i, nfds = 0;
+	ssize_t n;
+	int eof = 0;
+
+	msg = malloc(SHM_CTRL_MAX);
+	if (!msg)
+		return 0; /* level-triggered, try again later */
+	iov.iov_base = msg;
+	iov.iov_len = SHM_CTRL_MAX;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+	n = recvmsg(sep->sock, &mh, MSG_CMSG_CLOEXEC);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			goto out;
+		eof = 1;
+		goto out;
+	}
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		i = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (i > 3 - nfds)
+			i = 3 - nfds;
+		memcpy(&fds[nfds], CMSG_DATA(cmsg), i * sizeof(int));
+		nfds += i;
+	}
+	if ((mh.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) ||
+	    n < sizeof(struct shm_msg_hdr) || msg->hdr.msg_len != n ||
+	    msg->hdr.msg_type < SHM_MSG_FIRST ||
+	    msg->hdr.msg_type > SHM_MSG_ACK_ACCEPTED ||
+	    (msg->hdr.msg_type != SHM_MSG_ACK_ACCEPTED &&
+	     (n < sizeof(*msg) || msg->data_len > n - sizeof(*msg)))) {
+		LOG_(sep, "zap_shm: bad control message, len %zd\n", n);
+		shutdown(sep->sock, SHUT_RDWR);
+		goto out;
+	}
+	process_ctrl_fns[msg->hdr.msg_type](sep, msg, n, fds, nfds);
+ out:
+	for (i = 0; i < nfds; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+	free(msg);
+	return eof;
+}
+
+/*
+ * Ring messages. They are processed in place; the consumer releases the
+ * record after the handler returns.
+ */
+
+static void process_ring_sendrecv(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct shm_msg_sendrecv *msg = (void*)hdr;
+	struct zap_event ev = {
+		.type = ZAP_EVENT_RECV_COMPLETE,
+		.status = ZAP_ERR_OK,
+		.data = (unsigned char *)msg->data,
+		.data_len = hdr->msg_len - sizeof(*msg),
+	};
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+static void process_ring_rendezvous(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct shm_msg_rendezvous *msg = (void*)hdr;
+	struct zap_shm_map *map;
+	char *amsg = NULL;
+	size_t amsg_len;
+
+	if (hdr->msg_len < sizeof(*msg))
+		goto err;
+	map = calloc(1, sizeof(*map));
+	if (!map) {
+		LOG_(sep, "ENOMEM in %s at %s:%d\n",
+				__func__, __FILE__, __LINE__);
+		return;
+	}
+	amsg_len = hdr->msg_len - sizeof(*msg);
+	if (amsg_len)
+		amsg = msg->msg;
+
+	map->map.ref_count = 1;
+	map->map.ep = &sep->ep;
+	map->key = msg->rmap_key;
+	map->map.acc = msg->acc;
+	map->map.type = ZAP_MAP_REMOTE;
+	map->map.addr = (void *)msg->addr;
+	map->map.len = msg->data_len;
+	/* Read it straight from the peer heap if it is in there */
+	if (sep->peer_heap && msg->addr >= sep->peer_heap_addr &&
+	    msg->data_len <= sep->peer_heap_len &&
+	    msg->addr - sep->peer_heap_addr <= sep->peer_heap_len - msg->data_len)
+		map->direct = sep->peer_heap + (msg->addr - sep->peer_heap_addr);
+
+	zap_get_ep(&sep->ep); /* Release when app calls zap_unmap(). */
+	pthread_mutex_lock(&sep->ep.lock);
+	LIST_INSERT_HEAD(&sep->ep.map_list, &map->map, link);
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_RENDEZVOUS,
+		.map = (void*)map,
+		.data_len = amsg_len,
+		.data = (void*)amsg
+	};
+	sep->ep.cb((void*)sep, &ev);
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ring_read_req(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct shm_msg_read_req *msg = (void*)hdr;
+	struct shm_msg_read_resp rmsg;
+	uint32_t data_len = msg->data_len;
+	char *src = (char *)msg->src_ptr;
+	int rc;
+
+	pthread_mutex_lock(&z_key_tree_mutex);
+	rc = z_shm_map_key_access_validate(msg->src_map_key, src, data_len,
+					   ZAP_ACCESS_READ);
+	pthread_mutex_unlock(&z_key_tree_mutex);
+	z_shm_hdr_init(&rmsg.hdr, hdr->xid, SHM_MSG_READ_RESP, hdr->ctxt);
+	rmsg.hdr.status = __acc_status(rc);
+	if (rc)
+		data_len = 0;
+	if (__shm_send_msg(sep, &rmsg.hdr, sizeof(rmsg), src, data_len))
+		shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ring_read_resp(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct shm_msg_read_resp *msg = (void*)hdr;
+	struct z_shm_io *io = __io_pop(sep, hdr);
+	uint32_t data_len = hdr->msg_len - sizeof(*msg);
+	int rc;
+
+	if (hdr->status == 0) {
+		/* Only base and bounds, local access is always allowed. */
+		rc = z_map_access_validate(io->dst_map, io->dst_ptr,
+					   data_len, 0);
+		switch (rc) {
+		case 0:
+			memcpy(io->dst_ptr, msg->data, data_len);
+			break;
+		case EACCES:
+			rc = ZAP_ERR_LOCAL_PERMISSION;
+			break;
+		case ERANGE:
+			rc = ZAP_ERR_LOCAL_LEN;
+			break;
+		}
+	} else {
+		rc = hdr->status;
+	}
+	free(io);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_READ_COMPLETE,
+		.status = rc,
+		.context = (void*) hdr->ctxt
+	};
+	sep->ep.cb((void*)sep, &ev);
+}
+
+static void process_ring_write_req(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct shm_msg_write_req *msg = (void*)hdr;
+	struct shm_msg_hdr rmsg;
+	char *dst = (char *)msg->dst_ptr;
+	uint32_t data_len = msg->data_len;
+	int rc;
+
+	z_shm_hdr_init(&rmsg, hdr->xid, SHM_MSG_WRITE_RESP, hdr->ctxt);
+	if (hdr->msg_len < sizeof(*msg) ||
+	    data_len > hdr->msg_len - sizeof(*msg)) {
+		rc = ERANGE;
+		goto resp;
+	}
+	pthread_mutex_lock(&z_key_tree_mutex);
+	rc = z_shm_map_key_access_validate(msg->dst_map_key, dst, data_len,
+					   ZAP_ACCESS_WRITE);
+	pthread_mutex_unlock(&z_key_tree_mutex);
+	if (!rc)
+		memcpy(dst, msg->data, data_len);
+ resp:
+	rmsg.status = __acc_status(rc);
+	if (__shm_send_msg(sep, &rmsg, sizeof(rmsg), NULL, 0))
+		shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ring_write_resp(struct z_shm_ep *sep, struct shm_msg_hdr *hdr)
+{
+	struct z_shm_io *io = __io_pop(sep, hdr);
+	free(io);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_WRITE_COMPLETE,
+		.status = hdr->status,
+		.context = (void*) hdr->ctxt
+	};
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+typedef void (*process_ring_fn_t)(struct z_shm_ep *, struct shm_msg_hdr *);
+static process_ring_fn_t process_ring_fns[SHM_MSG_TYPE_LAST] = {
+	[SHM_MSG_SENDRECV] = process_ring_sendrecv,
+	[SHM_MSG_RENDEZVOUS] = process_ring_rendezvous,
+	[SHM_MSG_READ_REQ] = process_ring_read_req,
+	[SHM_MSG_READ_RESP] = process_ring_read_resp,
+	[SHM_MSG_WRITE_REQ] = process_ring_write_req,
+	[SHM_MSG_WRITE_RESP] = process_ring_write_resp,
+};
+
+static size_t process_ring_min_len[SHM_MSG_TYPE_LAST] = {
+	[SHM_MSG_SENDRECV] = sizeof(struct shm_msg_sendrecv),
+	[SHM_MSG_RENDEZVOUS] = sizeof(struct shm_msg_rendezvous),
+	[SHM_MSG_READ_REQ] = sizeof(struct shm_msg_read_req),
+	[SHM_MSG_READ_RESP] = sizeof(struct shm_msg_read_resp),
+	[SHM_MSG_WRITE_REQ] = sizeof(struct shm_msg_write_req),
+	[SHM_MSG_WRITE_RESP] = sizeof(struct shm_msg_hdr),
+	[SHM_MSG_PAD] = sizeof(struct shm_msg_hdr),
+};
+
+/*
+ * Consume the rx ring. Runs only on the io thread. Before giving up on
+ * an empty ring the consumer sets \c waiting so that the producer rings
+ * the bell for the next message.
+ */
+static void __ring_drain(struct z_shm_ep *sep)
+{
+	struct shm_ring *r = sep->rx;
+	struct shm_msg_hdr *hdr;
+	uint64_t head, tail = r->tail;
+	size_t off, contig, len;
+	uint16_t type;
+
+	for (;;) {
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			__atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+			if (head == tail)
+				break;
+		}
+		off = tail & (sep->ring_sz - 1);
+		contig = sep->ring_sz - off;
+		if (contig < sizeof(*hdr)) {
+			len = contig; /* implicit pad */
+			goto next;
+		}
+		hdr = (void*)(sep->rx_data + off);
+		type = hdr->msg_type;
+		len = (type == SHM_MSG_PAD) ? hdr->msg_len
+					    : SHM_ALIGN(hdr->msg_len);
+		if (type <= SHM_MSG_ACK_ACCEPTED || type >= SHM_MSG_TYPE_LAST ||
+		    hdr->msg_len < process_ring_min_len[type] ||
+		    len > contig || len > head - tail) {
+			LOG_(sep, "zap_shm: ring corrupted, type %hu len %u\n",
+			     type, hdr->msg_len);
+			shutdown(sep->sock, SHUT_RDWR);
+			break;
+		}
+		if (type != SHM_MSG_PAD && sep->ep.state == ZAP_EP_CONNECTED)
+			process_ring_fns[type](sep, hdr);
+	next:
+		tail += len;
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&r->blocked, 0, __ATOMIC_SEQ_CST))
+			eventfd_write(sep->peer_bell, 1);
+	}
+}
+
+static void shm_bell_cb(ovis_event_t ev)
+{
+	struct z_shm_ep *sep = ev->param.ctxt;
+	eventfd_t v;
+
+	zap_get_ep(&sep->ep);
+	eventfd_read(sep->bell, &v);
+	pthread_mutex_lock(&sep->ep.lock);
+	__sq_flush(sep);
+	pthread_mutex_unlock(&sep->ep.lock);
+	__ring_drain(sep);
+	zap_put_ep(&sep->ep);
+}
+
+static void shm_sock_cb(ovis_event_t ev)
+{
+	struct z_shm_ep *sep = ev->param.ctxt;
+	int eof = 0;
+
+	zap_get_ep(&sep->ep);
+	if (ev->cb.epoll_events & EPOLLOUT) {
+		pthread_mutex_lock(&sep->ep.lock);
+		if (!sep->sock_connected && sep->ep.state == ZAP_EP_CONNECTING) {
+			sep->sock_connected = 1;
+			pthread_mutex_unlock(&sep->ep.lock);
+			shm_connect(sep);
+		} else {
+			pthread_mutex_unlock(&sep->ep.lock);
+		}
+	}
+	if (ev->cb.epoll_events & EPOLLIN)
+		eof = shm_ctrl_read(sep);
+	/* This must be last to deliver everything before the disconnect */
+	if (eof || (ev->cb.epoll_events & (EPOLLERR|EPOLLHUP)))
+		shm_disconnect(sep);
+	zap_put_ep(&sep->ep);
+}
+
+static void *io_thread_proc(void *arg)
+{
+	/* Zap thread will not handle any signal */
+	int rc;
+	sigset_t sigset;
+	sigfillset(&sigset);
+	rc = sigprocmask(SIG_SETMASK, &sigset, NULL);
+	assert(rc == 0 && "pthread_sigmask error");
+	rc = ovis_scheduler_loop(sched, 0);
+	return NULL;
+}
+
+static void shm_disconnect(struct z_shm_ep *sep)
+{
+	struct zap_event zev = { 0 };
+	int do_cb = 0;
+	int drop_conn_ref = 0;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->disconnected) {
+		pthread_mutex_unlock(&sep->ep.lock);
+		return;
+	}
+	sep->disconnected = 1;
+	ovis_scheduler_event_del(sched, &sep->sock_ev);
+	if (sep->bell_added) {
+		ovis_scheduler_event_del(sched, &sep->bell_ev);
+		sep->bell_added = 0;
+	}
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	/* Deliver what the peer sent before it went away */
+	if (sep->rx && sep->ep.state == ZAP_EP_CONNECTED)
+		__ring_drain(sep);
+
+	pthread_mutex_lock(&sep->ep.lock);
+	/* Complete all outstanding I/O with ZEP_ERR_FLUSH */
+	while (!TAILQ_EMPTY(&sep->io_q)) {
+		struct z_shm_io *io = TAILQ_FIRST(&sep->io_q);
+		TAILQ_REMOVE(&sep->io_q, io, q_link);
+		struct zap_event zev = {
+			.type = (io->msg_type == SHM_MSG_READ_REQ) ?
+					ZAP_EVENT_READ_COMPLETE :
+					ZAP_EVENT_WRITE_COMPLETE,
+			.status = ZAP_ERR_FLUSH,
+			.context = (void *)io->ctxt
+		};
+		free(io);
+		pthread_mutex_unlock(&sep->ep.lock);
+		sep->ep.cb(&sep->ep, &zev);
+		pthread_mutex_lock(&sep->ep.lock);
+	}
+
+	switch (sep->ep.state) {
+	case ZAP_EP_ACCEPTING:
+		sep->ep.state = ZAP_EP_ERROR;
+		if (sep->app_accepted) {
+			zev.type = ZAP_EVENT_CONNECT_ERROR;
+			do_cb = drop_conn_ref = 1;
+		}
+		break;
+	case ZAP_EP_CONNECTING:
+		zev.type = ZAP_EVENT_CONNECT_ERROR;
+		sep->ep.state = ZAP_EP_ERROR;
+		do_cb = drop_conn_ref = 1;
+		break;
+	case ZAP_EP_CONNECTED:	/* Peer closed. */
+		sep->ep.state = ZAP_EP_PEER_CLOSE;
+		/* fall through */
+	case ZAP_EP_CLOSE:	/* App called close. */
+		zev.type = ZAP_EVENT_DISCONNECTED;
+		do_cb = drop_conn_ref = 1;
+		break;
+	case ZAP_EP_ERROR:
+		do_cb = 0;
+		break;
+	default:
+		LOG_(sep, "Unexpected state for EOF %d.\n",
+		     sep->ep.state);
+		sep->ep.state = ZAP_EP_ERROR;
+		do_cb = 0;
+		break;
+	}
+
+	pthread_mutex_unlock(&sep->ep.lock);
+	if (do_cb)
+		sep->ep.cb((void*)sep, &zev);
+
+	if (drop_conn_ref)
+		/* Taken in z_shm_connect and process_ctrl_ack_accepted */
+		zap_put_ep(&sep->ep);
+}
+
+static void __z_shm_conn_request(ovis_event_t ev)
+{
+	struct z_shm_ep *sep = ev->param.ctxt;
+	zap_ep_t new_ep;
+	struct z_shm_ep *new_sep;
+	zap_err_t zerr;
+	int sockfd;
+	int rc;
+
+	sockfd = accept4(sep->sock, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	if (sockfd == -1) {
+		LOG_(sep, "shm accept() error %d: in %s at %s:%d\n",
+				errno , __func__, __FILE__, __LINE__);
+		return;
+	}
+	new_ep = zap_new(sep->ep.z, sep->ep.app_cb);
+	if (!new_ep) {
+		zerr = errno;
+		LOG_(sep, "Zap Error %d (%s): in %s at %s:%d\n",
+				zerr, zap_err_str(zerr) , __func__, __FILE__,
+				__LINE__);
+		close(sockfd);
+		return;
+	}
+
+	void *uctxt = zap_get_ucontext(&sep->ep);
+	zap_set_ucontext(new_ep, uctxt);
+	new_sep = (void*) new_ep;
+	new_sep->sock = sockfd;
+	new_sep->port = sep->port;
+	new_sep->ep.state = ZAP_EP_ACCEPTING;
+	new_sep->sock_connected = 1;
+	if (__peer_cred_check(new_sep)) {
+		zap_free(new_ep);
+		return;
+	}
+
+	OVIS_EVENT_INIT(&new_sep->sock_ev);
+	new_sep->sock_ev.param.type = OVIS_EVENT_EPOLL;
+	new_sep->sock_ev.param.cb_fn = shm_sock_cb;
+	new_sep->sock_ev.param.ctxt = new_sep;
+	new_sep->sock_ev.param.epoll_events = EPOLLIN;
+	new_sep->sock_ev.param.fd = sockfd;
+
+	rc = ovis_scheduler_event_add(sched, &new_sep->sock_ev);
+	if (rc) {
+		/* the app doesn't know about this new endpoint yet */
+		LOG_(sep, "ovis_scheduler_event_add() error %d on fd %d", rc,
+					new_sep->sock);
+		zap_free(new_ep);
+	}
+}
+
+static zap_err_t z_shm_listen(zap_ep_t ep, struct sockaddr *sa,
+			      socklen_t sa_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct sockaddr_un sun;
+	socklen_t sun_len;
+	zap_err_t zerr;
+	int rc;
+
+	rc = __shm_sun(sa, sa_len, &sun, &sun_len, &sep->port);
+	if (rc)
+		return ZAP_ERR_ADDRESS;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_INIT, ZAP_EP_LISTENING);
+	if (zerr)
+		goto err_0;
+
+	sep->sock = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (sep->sock == -1) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err_0;
+	}
+
+	/* bind - listen */
+	rc = bind(sep->sock, (struct sockaddr *)&sun, sun_len);
+	if (rc) {
+		if (errno == EADDRINUSE)
+			zerr = ZAP_ERR_BUSY;
+		else
+			zerr = ZAP_ERR_RESOURCE;
+		goto err_1;
+	}
+	rc = listen(sep->sock, 1024);
+	if (rc) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err_1;
+	}
+
+	/* setup ovis event */
+	OVIS_EVENT_INIT(&sep->sock_ev);
+	sep->sock_ev.param.type = OVIS_EVENT_EPOLL;
+	sep->sock_ev.param.fd = sep->sock;
+	sep->sock_ev.param.epoll_events = EPOLLIN;
+	sep->sock_ev.param.cb_fn = __z_shm_conn_request;
+	sep->sock_ev.param.ctxt = sep;
+	rc = ovis_scheduler_event_add(sched, &sep->sock_ev);
+	if (rc) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err_1;
+	}
+
+	return ZAP_ERR_OK;
+
+ err_1:
+	close(sep->sock);
+	sep->sock = -1;
+ err_0:
+	return zerr;
+}
+
+static zap_err_t z_shm_send(zap_ep_t ep, char *buf, size_t len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct shm_msg_sendrecv msg;
+	zap_err_t zerr;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (ep->state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto out;
+	}
+	z_shm_hdr_init(&msg.hdr, 0, SHM_MSG_SENDRECV, 0);
+	zerr = __shm_send_msg_nolock(sep, &msg.hdr, sizeof(msg), buf, len);
+out:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static int init_once()
+{
+	int rc = ENOMEM;
+
+	sched = ovis_scheduler_new();
+	if (!sched)
+		return errno;
+
+	rc = pthread_create(&io_thread, NULL, io_thread_proc, 0);
+	if (rc)
+		goto err_1;
+	zap_thread_register(io_thread, ZAP_THREAD_IO);
+
+	init_complete = 1;
+
+	z_key_tree.root = NULL;
+	z_key_tree.comparator = z_rbn_cmp;
+	pthread_mutex_init(&z_key_tree_mutex, NULL);
+	return 0;
+
+ err_1:
+	ovis_scheduler_free(sched);
+	sched = NULL;
+	return rc;
+}
+
+static zap_ep_t z_shm_new(zap_t z, zap_cb_fn_t cb)
+{
+	struct z_shm_ep *sep = calloc(1, sizeof(*sep));
+	if (!sep) {
+		errno = ZAP_ERR_RESOURCE;
+		return NULL;
+	}
+	TAILQ_INIT(&sep->io_q);
+	TAILQ_INIT(&sep->sq);
+	sep->sock = -1;
+	sep->bell = -1;
+	sep->peer_bell = -1;
+
+	pthread_mutex_lock(&z_shm_list_mutex);
+	LIST_INSERT_HEAD(&z_shm_list, sep, link);
+	pthread_mutex_unlock(&z_shm_list_mutex);
+
+	return (zap_ep_t)sep;
+}
+
+static void z_shm_destroy(zap_ep_t ep)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct z_shm_send_wr *wr;
+
+	while ((wr = TAILQ_FIRST(&sep->sq))) {
+		TAILQ_REMOVE(&sep->sq, wr, link);
+		free(wr);
+	}
+	/* all pending I/O should have been flushed */
+	ZAP_ASSERT(TAILQ_EMPTY(&sep->io_q), ep, "%s: The io_q is not empty "
+			"when the reference count reaches 0.\n", __func__);
+	free(sep->conn_data);
+	if (sep->sock > -1)
+		close(sep->sock);
+	if (sep->bell > -1)
+		close(sep->bell);
+	if (sep->peer_bell > -1)
+		close(sep->peer_bell);
+	if (sep->seg)
+		munmap(sep->seg, sep->seg_sz);
+	if (sep->peer_heap)
+		munmap(sep->peer_heap, sep->peer_heap_len);
+	pthread_mutex_lock(&z_shm_list_mutex);
+	LIST_REMOVE(sep, link);
+	pthread_mutex_unlock(&z_shm_list_mutex);
+	free(ep);
+}
+
+zap_err_t z_shm_accept(zap_ep_t ep, zap_cb_fn_t cb, char *data, size_t data_len)
+{
+	/* ep is the newly created ep from __z_shm_conn_request */
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+	int fds[2];
+
+	pthread_mutex_lock(&sep->ep.lock);
+
+	if (sep->ep.state != ZAP_EP_ACCEPTING) {
+		zerr = ZAP_ERR_ENDPOINT;
+		goto err_0;
+	}
+
+	/* Replace the callback with the one provided by the caller */
+	sep->ep.cb = cb;
+
+	fds[0] = sep->bell;
+	zerr = __ctrl_send_conn(sep, SHM_MSG_ACCEPTED, data, data_len, fds, 1);
+	if (zerr)
+		goto err_1;
+	sep->app_accepted = 1;
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	return ZAP_ERR_OK;
+
+err_1:
+	sep->ep.state = ZAP_EP_ERROR;
+	shutdown(sep->sock, SHUT_RDWR);
+err_0:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_reject(zap_ep_t ep, char *data, size_t data_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	zerr = __ctrl_send_conn(sep, SHM_MSG_REJECTED, data, data_len, NULL, 0);
+	if (zerr)
+		goto err;
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+err:
+	sep->ep.state = ZAP_EP_ERROR;
+	shutdown(sep->sock, SHUT_RDWR);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t
+z_shm_map(zap_ep_t ep, zap_map_t *pm, void *buf, size_t len, zap_access_t acc)
+{
+	struct zap_shm_map *map = calloc(1, sizeof(*map));
+	struct z_shm_key *k;
+
+	if (!map)
+		return ZAP_ERR_RESOURCE;
+	/* zap_map in zap.c fills in map->map */
+	k = z_key_alloc(map);
+	if (!k) {
+		free(map);
+		return ZAP_ERR_RESOURCE;
+	}
+	map->key = (uint32_t)(uint64_t)k->rb_node.key;
+	*pm = (void*)map;
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t z_shm_unmap(zap_ep_t ep, zap_map_t map)
+{
+	struct zap_shm_map *m = (void*) map;
+	if (map->type == ZAP_MAP_LOCAL)
+		z_key_delete(m->key);
+	free(m);
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t z_shm_share(zap_ep_t ep, zap_map_t map,
+			     const char *msg, size_t msg_len)
+{
+	struct z_shm_ep *sep = (void*) ep;
+	struct zap_shm_map *smap = (void*)map;
+	struct shm_msg_rendezvous msgr;
+	zap_err_t zerr;
+
+	if (map->type != ZAP_MAP_LOCAL)
+		return ZAP_ERR_INVALID_MAP_TYPE;
+
+	z_shm_hdr_init(&msgr.hdr, 0, SHM_MSG_RENDEZVOUS, 0);
+	msgr.rmap_key = smap->key;
+	msgr.acc = map->acc;
+	msgr.addr = (uint64_t)map->addr;
+	msgr.data_len = map->len;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (ep->state != ZAP_EP_CONNECTED)
+		zerr = ZAP_ERR_NOT_CONNECTED;
+	else
+		zerr = __shm_send_msg_nolock(sep, &msgr.hdr, sizeof(msgr),
+					     msg, msg_len);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_read(zap_ep_t ep, zap_map_t src_map, char *src,
+			    zap_map_t dst_map, char *dst, size_t sz,
+			    void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct zap_shm_map *src_smap = (void*) src_map;
+	struct shm_msg_read_req msg;
+	struct z_shm_io *io;
+	zap_err_t zerr;
+
+	/* validate */
+	if (z_map_access_validate(src_map, src, sz, ZAP_ACCESS_READ) != 0)
+		return ZAP_ERR_REMOTE_PERMISSION;
+	if (z_map_access_validate(dst_map, dst, sz, ZAP_ACCESS_NONE) != 0)
+		return ZAP_ERR_LOCAL_LEN;
+	if (ep->state != ZAP_EP_CONNECTED)
+		return ZAP_ERR_NOT_CONNECTED;
+
+	if (src_smap->direct) {
+		struct zap_event ev = {
+			.type = ZAP_EVENT_READ_COMPLETE,
+			.status = ZAP_ERR_OK,
+			.context = context,
+		};
+		memcpy(dst, src_smap->direct + (src - src_map->addr), sz);
+		sep->ep.cb(&sep->ep, &ev);
+		return ZAP_ERR_OK;
+	}
+
+	/* The response carries the data through the ring */
+	if (SHM_ALIGN(sizeof(struct shm_msg_read_resp) + sz) > sep->ring_sz / 2)
+		return ZAP_ERR_NO_SPACE;
+	io = calloc(1, sizeof(*io));
+	if (!io)
+		return ZAP_ERR_RESOURCE;
+	z_shm_hdr_init(&msg.hdr, 0, SHM_MSG_READ_REQ, (uint64_t)context);
+	msg.src_map_key = src_smap->key;
+	msg.src_ptr = (uint64_t)src;
+	msg.data_len = sz;
+	io->xid = msg.hdr.xid;
+	io->msg_type = SHM_MSG_READ_REQ;
+	io->ctxt = msg.hdr.ctxt;
+	io->dst_map = dst_map;
+	io->dst_ptr = dst;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto err;
+	}
+	zerr = __shm_send_msg_nolock(sep, &msg.hdr, sizeof(msg), NULL, 0);
+	if (zerr)
+		goto err;
+	TAILQ_INSERT_TAIL(&sep->io_q, io, q_link);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+ err:
+	pthread_mutex_unlock(&sep->ep.lock);
+	free(io);
+	return zerr;
+}
+
+static zap_err_t z_shm_write(zap_ep_t ep, zap_map_t src_map, char *src,
+			     zap_map_t dst_map, char *dst, size_t sz,
+			     void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct zap_shm_map *sdst_map = (void*)dst_map;
+	struct shm_msg_write_req msg;
+	struct z_shm_io *io;
+	zap_err_t zerr;
+
+	/* validate */
+	if (z_map_access_validate(src_map, src, sz, ZAP_ACCESS_NONE) != 0)
+		return ZAP_ERR_LOCAL_LEN;
+	if (z_map_access_validate(dst_map, dst, sz, ZAP_ACCESS_WRITE) != 0)
+		return ZAP_ERR_REMOTE_PERMISSION;
+
+	io = calloc(1, sizeof(*io));
+	if (!io)
+		return ZAP_ERR_RESOURCE;
+	z_shm_hdr_init(&msg.hdr, 0, SHM_MSG_WRITE_REQ, (uint64_t)context);
+	msg.dst_map_key = sdst_map->key;
+	msg.dst_ptr = (uint64_t)dst;
+	msg.data_len = sz;
+	io->xid = msg.hdr.xid;
+	io->msg_type = SHM_MSG_WRITE_REQ;
+	io->ctxt = msg.hdr.ctxt;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto err;
+	}
+	zerr = __shm_send_msg_nolock(sep, &msg.hdr, sizeof(msg), src, sz);
+	if (zerr)
+		goto err;
+	TAILQ_INSERT_TAIL(&sep->io_q, io, q_link);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+ err:
+	pthread_mutex_unlock(&sep->ep.lock);
+	free(io);
+	return zerr;
+}
+
+zap_err_t zap_transport_get(zap_t *pz, zap_log_fn_t log_fn,
+			    zap_mem_info_fn_t mem_info_fn)
+{
+	zap_t z;
+
+	if (!init_complete && init_once())
+		goto err;
+
+	pthread_atfork(NULL, NULL, (void*)init_once);
+
+	z = calloc(1, sizeof (*z));
+	if (!z)
+		goto err;
+
+	/* must fit in half a ring, see __shm_send_msg_nolock() */
+	z->max_msg = (1024 * 1024) - sizeof(struct shm_msg_hdr);
+	z->new = z_shm_new;
+	z->destroy = z_shm_destroy;
+	z->connect = z_shm_connect;
+	z->accept = z_shm_accept;
+	z->reject = z_shm_reject;
+	z->listen = z_shm_listen;
+	z->close = z_shm_close;
+	z->send = z_shm_send;
+	z->read = z_shm_read;
+	z->write = z_shm_write;
+	z->map = z_shm_map;
+	z->unmap = z_shm_unmap;
+	z->share = z_shm_share;
+	z->get_name = z_get_name;
+	z->mem_info_fn = mem_info_fn;
+
+	*pz = z;
+	return ZAP_ERR_OK;
+
+ err:
+	return ZAP_ERR_RESOURCE;
+}
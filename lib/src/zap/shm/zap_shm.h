@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2019 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __ZAP_SHM_H__
+#define __ZAP_SHM_H__
+#include <sys/queue.h>
+#include "ovis_event/ovis_event.h"
+#include "ovis-lib-config.h"
+#include "coll/rbt.h"
+#include "zap.h"
+#include "zap_priv.h"
+
+/*
+ * zap_shm -- zap transport between processes on the same node.
+ *
+ * Connection management uses an AF_UNIX SOCK_SEQPACKET socket in the
+ * abstract namespace, named ZAP_SHM_SUN_PREFIX<port>. The socket also
+ * carries the file descriptors the peers exchange at connect time:
+ *
+ * - The connection segment, a memfd created by the active side that
+ *   holds two single-producer/single-consumer message rings, one per
+ *   direction.
+ * - Each side's doorbell, an eventfd that the peer writes after
+ *   producing into an empty ring or consuming from a full one.
+ * - Optionally a read-only fd of each side's heap (see
+ *   zap_mem_info.fd). The peer maps it, so zap_read() from a map
+ *   shared out of that heap is a memcpy() in the reader's context.
+ *   Other reads, and all writes, go through the rings.
+ *
+ * After the connection is established the socket is only used to
+ * detect that the peer has gone away.
+ *
+ * A connection is refused unless the peer runs under the same uid or
+ * as root, because it gets read access to the whole heap.
+ */
+
+#define ZAP_SHM_SUN_PREFIX "ovis-zap-shm."
+
+/** Size of each ring in bytes, must be a power of 2 */
+#define ZAP_SHM_RING_SZ (4 * 1024 * 1024)
+
+#define ZAP_SHM_SEG_MAGIC 0x5a41505f53484d31ULL /* "ZAP_SHM1" */
+
+struct zap_shm_map {
+	struct zap_map map;
+	uint32_t key; /**< Key of the map. */
+	char *direct; /**< Local address of map.addr in the peer's heap */
+};
+
+struct z_shm_key {
+	struct rbn rb_node;
+	struct zap_shm_map *map; /**< reference to zap_map */
+};
+
+typedef enum shm_msg_type {
+	/* control socket */
+	SHM_MSG_CONNECT = 1,  /*  Connect     data          */
+	SHM_MSG_ACCEPTED,     /*  Connection  accepted      */
+	SHM_MSG_REJECTED,     /*  Reject      data          */
+	SHM_MSG_ACK_ACCEPTED, /*  Acknowledge accepted msg  */
+	/* rings */
+	SHM_MSG_SENDRECV,     /*  send-receive  */
+	SHM_MSG_RENDEZVOUS,   /*  Share       zap_map       */
+	SHM_MSG_READ_REQ,     /*  Read        request       */
+	SHM_MSG_READ_RESP,    /*  Read        response      */
+	SHM_MSG_WRITE_REQ,    /*  Write       request       */
+	SHM_MSG_WRITE_RESP,   /*  Write       response      */
+	SHM_MSG_PAD,          /*  Ring filler up to the wrap point */
+	SHM_MSG_TYPE_LAST,    /*  Range limiter, upper  */
+	SHM_MSG_FIRST = SHM_MSG_CONNECT /* Range limiter, lower */
+} shm_msg_type_t;
+
+/*
+ * Both ends run on the same host, so unlike zap_sock the messages are
+ * in host byte order.
+ */
+
+/**
+ * \brief Zap message header for the shm transport.
+ *
+ * In a ring, each message starts on an 8-byte boundary.
+ */
+struct shm_msg_hdr {
+	uint32_t msg_len;  /**< Length of the entire message, header included. */
+	uint16_t msg_type; /**< The request type */
+	uint16_t status;   /**< Return status for responses */
+	uint32_t xid;	   /**< Transaction Id to check against reply */
+	uint32_t reserved;
+	uint64_t ctxt;	   /**< User context to be returned in reply */
+};
+
+static char ZAP_SHM_SIG[8] = "SHMEM";
+
+/**
+ * Connect, accepted and rejected messages (control socket).
+ */
+struct shm_msg_conn {
+	struct shm_msg_hdr hdr;
+	struct zap_version ver;
+	char sig[8];
+	uint64_t heap_addr; /**< Sender's heap address, 0 if not shared */
+	uint64_t heap_len;
+	uint32_t ring_sz;   /**< SHM_MSG_CONNECT only */
+	uint32_t data_len;
+	char data[OVIS_FLEX];
+};
+
+/**
+ * Send/Recv message.
+ */
+struct shm_msg_sendrecv {
+	struct shm_msg_hdr hdr;
+	char data[OVIS_FLEX];
+};
+
+/**
+ * Read request (src_addr --> dst_addr)
+ */
+struct shm_msg_read_req {
+	struct shm_msg_hdr hdr;
+	uint32_t src_map_key; /**< Source map reference (on non-initiator) */
+	uint32_t data_len; /**< Data length */
+	uint64_t src_ptr; /**< Source memory */
+};
+
+/**
+ * Read response
+ */
+struct shm_msg_read_resp {
+	struct shm_msg_hdr hdr;
+	char data[OVIS_FLEX]; /**< Response data */
+};
+
+/**
+ * Write request
+ */
+struct shm_msg_write_req {
+	struct shm_msg_hdr hdr;
+	uint32_t dst_map_key; /**< Destination map key */
+	uint32_t data_len; /**< Data length */
+	uint64_t dst_ptr; /**< Destination address */
+	char data[OVIS_FLEX]; /**< data for SHM_MSG_WRITE_REQ */
+};
+
+/**
+ * Message for exporting/sharing zap_map.
+ */
+struct shm_msg_rendezvous {
+	struct shm_msg_hdr hdr;
+	uint32_t rmap_key; /**< Remote map reference */
+	uint32_t acc; /**< Access */
+	uint64_t addr; /**< Address in the map */
+	uint64_t data_len; /**< Length */
+	char msg[OVIS_FLEX]; /**< Context */
+};
+
+/**
+ * One direction of the connection segment. The producer only writes
+ * \c head, the consumer only writes \c tail. They are on separate
+ * cache lines.
+ */
+struct shm_ring {
+	uint64_t head; /**< bytes produced */
+	char _pad0[56];
+	uint64_t tail; /**< bytes consumed */
+	char _pad1[56];
+	uint32_t waiting; /**< consumer may sleep, ring its doorbell */
+	uint32_t blocked; /**< producer has queued messages, ring its doorbell */
+	char _pad2[56];
+};
+
+/**
+ * The connection segment. The ring data follow the header: ring[0]
+ * (active to passive) at offset sizeof(struct shm_seg), ring[1]
+ * (passive to active) \c ring_sz bytes after that.
+ */
+struct shm_seg {
+	uint64_t magic;
+	uint32_t ring_sz;
+	uint32_t reserved;
+	char _pad[48];
+	struct shm_ring ring[2];
+};
+
+/**
+ * Outstanding ring-based read/write, completed by the response. The
+ * peer answers requests in order, so the io_q is FIFO.
+ */
+struct z_shm_io {
+	TAILQ_ENTRY(z_shm_io) q_link;
+	uint32_t xid;
+	uint16_t msg_type;
+	uint64_t ctxt;
+	zap_map_t dst_map; /**< Destination map for READ */
+	char *dst_ptr; /**< Destination address for READ */
+};
+
+/** A message waiting for room in the tx ring */
+struct z_shm_send_wr {
+	TAILQ_ENTRY(z_shm_send_wr) link;
+	size_t len;
+	char msg[OVIS_FLEX];
+};
+
+struct z_shm_ep {
+	struct zap_ep ep;
+
+	int sock; /**< control socket */
+	int bell; /**< my doorbell, written by the peer */
+	int peer_bell;
+	int active; /**< !0 on the connecting side */
+	int sock_connected;
+	int app_accepted;
+	int disconnected;
+	uint16_t port;
+
+	char *conn_data;
+	size_t conn_data_len;
+
+	struct shm_seg *seg;
+	size_t seg_sz;
+	struct shm_ring *tx;
+	struct shm_ring *rx;
+	char *tx_data;
+	char *rx_data;
+	uint32_t ring_sz;
+
+	char *peer_heap; /**< local mapping of the peer's heap */
+	uint64_t peer_heap_addr;
+	uint64_t peer_heap_len;
+
+	struct ovis_event_s sock_ev;
+	struct ovis_event_s bell_ev;
+	int bell_added;
+
+	TAILQ_HEAD(, z_shm_io) io_q;
+	TAILQ_HEAD(, z_shm_send_wr) sq; /**< overflow of the tx ring */
+	LIST_ENTRY(z_shm_ep) link;
+};
+
+#endif
@@ -1629,6 +1629,7 @@ static int init_once()
 	rc = pthread_create(&io_thread, NULL, io_thread_proc, 0);
 	if (rc)
 		goto err_1;
+	zap_thread_register(io_thread, ZAP_THREAD_IO);
 
 	init_complete = 1;
 
@@ -175,7 +175,7 @@ struct zap_test_mem {
 };
 
 struct zap_test_mem mem;
-struct zap_mem_info meminfo = {.start = &mem, .len = sizeof(mem)};
+struct zap_mem_info meminfo = {.start = &mem, .len = sizeof(mem), .fd = -1};
 
 zap_map_t write_map = NULL; /* exporting write map */
 zap_map_t read_map = NULL; /* exporting read map */
@@ -56,6 +56,7 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <sched.h>
 #include <dlfcn.h>
 #include <assert.h>
 #include <time.h>
@@ -63,6 +64,7 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include "ovis-lib-config.h"
+#include "../ovis_util/util.h"
 #include "zap.h"
 #include "zap_priv.h"
 
@@ -733,6 +735,78 @@ int zap_term(int timeout_sec)
 	return rc;
 }
 
+static pthread_mutex_t zap_affinity_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct zap_affinity {
+	int pinned;
+	cpu_set_t cpus;
+	int count;
+	int alloc;
+	pthread_t *threads;
+} zap_affinity[ZAP_THREAD_LAST];
+
+void zap_thread_register(pthread_t thread, enum zap_thread_type type)
+{
+	struct zap_affinity *za = &zap_affinity[type];
+	pthread_t *threads;
+
+	pthread_mutex_lock(&zap_affinity_lock);
+	if (za->count == za->alloc) {
+		threads = realloc(za->threads, (za->alloc + 8) * sizeof(*threads));
+		if (!threads)
+			goto out;
+		za->threads = threads;
+		za->alloc += 8;
+	}
+	za->threads[za->count++] = thread;
+	if (za->pinned)
+		pthread_setaffinity_np(thread, sizeof(za->cpus), &za->cpus);
+ out:
+	pthread_mutex_unlock(&zap_affinity_lock);
+}
+
+int zap_thread_affinity(enum zap_thread_type type, const char *cpus)
+{
+	struct zap_affinity *za;
+	cpu_set_t set;
+	int i, rc;
+
+	if (type < 0 || type >= ZAP_THREAD_LAST)
+		return EINVAL;
+	rc = ovis_cpulist_parse(cpus, &set);
+	if (rc)
+		return rc;
+	za = &zap_affinity[type];
+	pthread_mutex_lock(&zap_affinity_lock);
+	for (i = 0; i < za->count; i++) {
+		rc = pthread_setaffinity_np(za->threads[i], sizeof(set), &set);
+		if (rc)
+			goto out;
+	}
+	za->cpus = set;
+	za->pinned = 1;
+ out:
+	pthread_mutex_unlock(&zap_affinity_lock);
+	return rc;
+}
+
+int zap_thread_affinity_str(enum zap_thread_type type, char *buf, size_t len)
+{
+	struct zap_affinity *za;
+	int count;
+
+	if (type < 0 || type >= ZAP_THREAD_LAST)
+		return 0;
+	za = &zap_affinity[type];
+	pthread_mutex_lock(&zap_affinity_lock);
+	if (za->pinned)
+		ovis_cpulist_str(&za->cpus, buf, len);
+	else
+		snprintf(buf, len, "any");
+	count = za->count;
+	pthread_mutex_unlock(&zap_affinity_lock);
+	return count;
+}
+
 static void __attribute__ ((constructor)) cs_init(void)
 {
 	int i;
@@ -740,6 +814,10 @@ static void __attribute__ ((constructor)) cs_init(void)
 	pthread_atfork(NULL, NULL, cs_init);
 	pthread_mutex_init(&zap_list_lock, 0);
 
+	/* the threads of the parent do not exist in the child */
+	for (i = 0; i < ZAP_THREAD_LAST; i++)
+		zap_affinity[i].count = 0;
+
 	zap_event_workers = ZAP_ENV_INT(ZAP_EVENT_WORKERS);
 	zap_event_qdepth = ZAP_ENV_INT(ZAP_EVENT_QDEPTH);
 
@@ -751,6 +829,7 @@ static void __attribute__ ((constructor)) cs_init(void)
 		rc = pthread_create(&zev_queue[i].thread, NULL,
 					zap_event_thread_proc, &zev_queue[i]);
 		assert(rc == 0);
+		zap_thread_register(zev_queue[i].thread, ZAP_THREAD_EVENT);
 	}
 }
 
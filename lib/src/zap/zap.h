@@ -277,6 +277,8 @@ typedef void (*zap_cb_fn_t)(zap_ep_t zep, zap_event_t ev);
 typedef struct zap_mem_info {
 	void *start;
 	size_t len;
+	int fd;		/*! fd of a shareable mapping of [start, start+len),
+			 *  or -1. Only zap_shm uses it. */
 } *zap_mem_info_t;
 typedef zap_mem_info_t (*zap_mem_info_fn_t)(void);
 
@@ -619,6 +621,36 @@ zap_err_t zap_share(zap_ep_t ep, zap_map_t m, const char *msg, size_t msg_len);
 
 const char* zap_event_str(enum zap_event_type e);
 
+enum zap_thread_type {
+	ZAP_THREAD_EVENT,	/* event workers delivering the callbacks */
+	ZAP_THREAD_IO,		/* transport I/O and completion threads */
+	ZAP_THREAD_LAST,
+};
+
+/**
+ * \brief Pin zap threads to a set of CPUs
+ *
+ * The threads of \c type that are running are pinned right away and the
+ * ones that transports start later are pinned when they start.
+ *
+ * \param type The type of threads.
+ * \param cpus A CPU list, e.g. "0-3,8".
+ *
+ * \retval 0      The CPU list is set.
+ * \retval EINVAL The CPU list is invalid.
+ * \retval errno  The error of pthread_setaffinity_np().
+ */
+int zap_thread_affinity(enum zap_thread_type type, const char *cpus);
+
+/**
+ * \brief Describe the CPUs the threads of \c type run on
+ *
+ * \param buf The buffer receiving a CPU list such as "0-3,8", or "any" if
+ *            the threads were not pinned.
+ * \returns The number of threads of \c type.
+ */
+int zap_thread_affinity_str(enum zap_thread_type type, char *buf, size_t len);
+
 /**
  * \brief Terminate zap threads
  *
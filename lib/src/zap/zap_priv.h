@@ -327,6 +327,12 @@ int z_map_access_validate(zap_map_t map, char *p, size_t sz, zap_access_t acc);
 
 #define ZAP_ENV_INT(X) zap_env_int(#X, X)
 
+/**
+ * Called by a transport on a thread it started so that the thread follows
+ * the affinity set with zap_thread_affinity().
+ */
+void zap_thread_register(pthread_t thread, enum zap_thread_type type);
+
 
 /**
  * Add IO completion to the completion queue.